@@ -8,8 +8,22 @@
 
 #pragma once
 
-#define LDR_HASH_TABLE_ENTRIES 32
-#define LDR_GET_HASH_ENTRY(x) (RtlUpcaseUnicodeChar((x)) & (LDR_HASH_TABLE_ENTRIES - 1))
+#define LDR_HASH_TABLE_ENTRIES 128
+
+/* Hash the whole base name, most DLL names start with the same few letters.
+ * Upcase like RtlEqualUnicodeString does, so that equal names share a bucket */
+FORCEINLINE
+ULONG
+LdrpGetHashEntry(IN PCUNICODE_STRING BaseDllName)
+{
+    ULONG Hash = 0;
+    USHORT i;
+
+    for (i = 0; i < BaseDllName->Length / sizeof(WCHAR); i++)
+        Hash = Hash * 65599 + RtlUpcaseUnicodeChar(BaseDllName->Buffer[i]);
+
+    return Hash & (LDR_HASH_TABLE_ENTRIES - 1);
+}
 
 /* LdrpUpdateLoadCount2 flags */
 #define LDRP_UPDATE_REFCOUNT   0x01
@@ -96,6 +110,9 @@ NTSTATUS NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
                          IN PLDR_DATA_TABLE_ENTRY LdrEntry);
 
+VOID NTAPI
+LdrpFreeExportCache(IN PVOID ExportBase);
+
 
 /* ldrutils.c */
 NTSTATUS NTAPI
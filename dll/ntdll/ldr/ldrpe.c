@@ -13,10 +13,34 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Export tables smaller than this are binary searched without a cache */
+#define LDRP_EXPORT_CACHE_MIN_NAMES 64
+#define LDRP_EXPORT_CACHE_BUCKETS   16
+#define LDRP_EXPORT_CACHE_BUCKET(x) (((ULONG_PTR)(x) >> 16) & (LDRP_EXPORT_CACHE_BUCKETS - 1))
+
+typedef struct _LDRP_EXPORT_CACHE_SLOT
+{
+    ULONG Hash;
+    ULONG NameIndex;
+} LDRP_EXPORT_CACHE_SLOT, *PLDRP_EXPORT_CACHE_SLOT;
+
+/* Open addressed hash of the export names of an image, guarded by the loader lock */
+typedef struct _LDRP_EXPORT_CACHE
+{
+    struct _LDRP_EXPORT_CACHE *Next;
+    PVOID ExportBase;
+    PULONG NameTable;
+    ULONG NumberOfNames;
+    ULONG Mask;
+    LDRP_EXPORT_CACHE_SLOT Slots[ANYSIZE_ARRAY];
+} LDRP_EXPORT_CACHE, *PLDRP_EXPORT_CACHE;
+
 /* GLOBALS *******************************************************************/
 
 PLDR_MANIFEST_PROBER_ROUTINE LdrpManifestProberRoutine;
 ULONG LdrpNormalSnap;
+PLDRP_EXPORT_CACHE LdrpExportCacheTable[LDRP_EXPORT_CACHE_BUCKETS];
+PLDRP_EXPORT_CACHE LdrpLastExportCache;
 
 /* FUNCTIONS *****************************************************************/
 
@@ -623,6 +647,109 @@ LdrpHandleOldFormatImportDescriptors(IN LPWSTR DllPath OPTIONAL,
     return STATUS_SUCCESS;
 }
 
+static
+ULONG
+LdrpHashExportName(IN LPCSTR Name)
+{
+    ULONG Hash = 0;
+
+    /* A hash of 0 flags free slots, so never return it */
+    while (*Name) Hash = Hash * 65599 + (UCHAR)*Name++;
+    return Hash ? Hash : 1;
+}
+
+static
+PLDRP_EXPORT_CACHE
+LdrpGetExportCache(IN PVOID ExportBase,
+                   IN ULONG NumberOfNames,
+                   IN PULONG NameTable)
+{
+    PLDRP_EXPORT_CACHE Cache;
+    ULONG Size, Hash, i, j;
+    LPSTR Name;
+
+    /* Snapping a whole IAT hits the same image over and over */
+    Cache = LdrpLastExportCache;
+    if (!Cache || Cache->ExportBase != ExportBase)
+    {
+        /* Look it up */
+        Cache = LdrpExportCacheTable[LDRP_EXPORT_CACHE_BUCKET(ExportBase)];
+        while (Cache && Cache->ExportBase != ExportBase) Cache = Cache->Next;
+    }
+
+    if (Cache)
+    {
+        /* Make sure it is still describing the same table */
+        if ((Cache->NameTable == NameTable) &&
+            (Cache->NumberOfNames == NumberOfNames))
+        {
+            LdrpLastExportCache = Cache;
+            return Cache;
+        }
+
+        /* It is stale, build a new one */
+        LdrpFreeExportCache(ExportBase);
+    }
+
+    /* Not worth it for small tables, or before the loader heap exists */
+    if ((NumberOfNames < LDRP_EXPORT_CACHE_MIN_NAMES) || !LdrpHeap) return NULL;
+
+    /* Keep the table at most half full */
+    for (Size = LDRP_EXPORT_CACHE_MIN_NAMES * 2; Size < NumberOfNames * 2; Size <<= 1);
+
+    Cache = RtlAllocateHeap(LdrpHeap,
+                            HEAP_ZERO_MEMORY,
+                            FIELD_OFFSET(LDRP_EXPORT_CACHE, Slots[Size]));
+    if (!Cache) return NULL;
+
+    Cache->ExportBase = ExportBase;
+    Cache->NameTable = NameTable;
+    Cache->NumberOfNames = NumberOfNames;
+    Cache->Mask = Size - 1;
+
+    /* Hash all the names */
+    for (i = 0; i < NumberOfNames; i++)
+    {
+        Name = (LPSTR)((ULONG_PTR)ExportBase + NameTable[i]);
+        Hash = LdrpHashExportName(Name);
+
+        /* Find a free slot */
+        for (j = Hash & Cache->Mask; Cache->Slots[j].Hash; j = (j + 1) & Cache->Mask);
+        Cache->Slots[j].Hash = Hash;
+        Cache->Slots[j].NameIndex = i;
+    }
+
+    /* Insert it */
+    Cache->Next = LdrpExportCacheTable[LDRP_EXPORT_CACHE_BUCKET(ExportBase)];
+    LdrpExportCacheTable[LDRP_EXPORT_CACHE_BUCKET(ExportBase)] = Cache;
+    LdrpLastExportCache = Cache;
+
+    return Cache;
+}
+
+VOID
+NTAPI
+LdrpFreeExportCache(IN PVOID ExportBase)
+{
+    PLDRP_EXPORT_CACHE *Link, Cache;
+
+    /* Find the cache of this image, if it has one */
+    Link = &LdrpExportCacheTable[LDRP_EXPORT_CACHE_BUCKET(ExportBase)];
+    while ((Cache = *Link))
+    {
+        if (Cache->ExportBase == ExportBase)
+        {
+            /* Unlink and free it */
+            *Link = Cache->Next;
+            if (LdrpLastExportCache == Cache) LdrpLastExportCache = NULL;
+            RtlFreeHeap(LdrpHeap, 0, Cache);
+            return;
+        }
+
+        Link = &Cache->Next;
+    }
+}
+
 USHORT
 NTAPI
 LdrpNameToOrdinal(IN LPSTR ImportName,
@@ -632,6 +759,28 @@ LdrpNameToOrdinal(IN LPSTR ImportName,
                   IN PUSHORT OrdinalTable)
 {
     LONG Start, End, Next, CmpResult;
+    PLDRP_EXPORT_CACHE Cache;
+    PLDRP_EXPORT_CACHE_SLOT Slot;
+    ULONG Hash, i;
+
+    /* Try the export name cache of this image first */
+    Cache = LdrpGetExportCache(ExportBase, NumberOfNames, NameTable);
+    if (Cache)
+    {
+        Hash = LdrpHashExportName(ImportName);
+        for (i = Hash & Cache->Mask; Cache->Slots[i].Hash; i = (i + 1) & Cache->Mask)
+        {
+            Slot = &Cache->Slots[i];
+            if ((Slot->Hash == Hash) &&
+                !strcmp(ImportName, (PCHAR)((ULONG_PTR)ExportBase + NameTable[Slot->NameIndex])))
+            {
+                return OrdinalTable[Slot->NameIndex];
+            }
+        }
+
+        /* Every name is in there, so it doesn't exist */
+        return -1;
+    }
 
     /* Use classical binary search to find the ordinal */
     Start = Next = 0;
@@ -1582,7 +1582,7 @@ LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
     ULONG i;
 
     /* Insert into hash table */
-    i = LDR_GET_HASH_ENTRY(LdrEntry->BaseDllName.Buffer[0]);
+    i = LdrpGetHashEntry(&LdrEntry->BaseDllName);
     InsertTailList(&LdrpHashTable[i], &LdrEntry->HashLinks);
 
     /* Insert into other lists */
@@ -1609,6 +1609,9 @@ LdrpFinalizeAndDeallocateDataTableEntry(IN PLDR_DATA_TABLE_ENTRY Entry)
     /* Release the full dll name string */
     if (Entry->FullDllName.Buffer) LdrpFreeUnicodeString(&Entry->FullDllName);
 
+    /* Drop the export lookup cache of the image */
+    LdrpFreeExportCache(Entry->DllBase);
+
     /* Finally free the entry's memory */
     RtlFreeHeap(LdrpHeap, 0, Entry);
 }
@@ -2009,7 +2012,7 @@ lookinhash:
         /* FIXME: if we get redirected dll it means that we also get a full path so we need to find its filename for the hash lookup */
 
         /* Get hash index */
-        HashIndex = LDR_GET_HASH_ENTRY(DllName->Buffer[0]);
+        HashIndex = LdrpGetHashEntry(DllName);
 
         /* Traverse that list */
         ListHead = &LdrpHashTable[HashIndex];
@@ -16,3 +16,37 @@
 @ stdcall WakeConditionVariable(ptr)
 
 @ stdcall InitializeCriticalSectionEx(ptr long long)
+
+@ stdcall CallbackMayRunLong(ptr)
+@ stdcall CancelThreadpoolIo(ptr)
+@ stdcall CloseThreadpool(ptr)
+@ stdcall CloseThreadpoolCleanupGroup(ptr)
+@ stdcall CloseThreadpoolCleanupGroupMembers(ptr long ptr)
+@ stdcall CloseThreadpoolIo(ptr)
+@ stdcall CloseThreadpoolTimer(ptr)
+@ stdcall CloseThreadpoolWait(ptr)
+@ stdcall CloseThreadpoolWork(ptr)
+@ stdcall CreateThreadpool(ptr)
+@ stdcall CreateThreadpoolCleanupGroup()
+@ stdcall CreateThreadpoolIo(ptr ptr ptr ptr)
+@ stdcall CreateThreadpoolTimer(ptr ptr ptr)
+@ stdcall CreateThreadpoolWait(ptr ptr ptr)
+@ stdcall CreateThreadpoolWork(ptr ptr ptr)
+@ stdcall DisassociateCurrentThreadFromCallback(ptr)
+@ stdcall FreeLibraryWhenCallbackReturns(ptr ptr)
+@ stdcall IsThreadpoolTimerSet(ptr)
+@ stdcall LeaveCriticalSectionWhenCallbackReturns(ptr ptr)
+@ stdcall ReleaseMutexWhenCallbackReturns(ptr ptr)
+@ stdcall ReleaseSemaphoreWhenCallbackReturns(ptr ptr long)
+@ stdcall SetEventWhenCallbackReturns(ptr ptr)
+@ stdcall SetThreadpoolThreadMaximum(ptr long)
+@ stdcall SetThreadpoolThreadMinimum(ptr long)
+@ stdcall SetThreadpoolTimer(ptr ptr long long)
+@ stdcall SetThreadpoolWait(ptr ptr ptr)
+@ stdcall StartThreadpoolIo(ptr)
+@ stdcall SubmitThreadpoolWork(ptr)
+@ stdcall TrySubmitThreadpoolCallback(ptr ptr ptr)
+@ stdcall WaitForThreadpoolIoCallbacks(ptr long)
+@ stdcall WaitForThreadpoolTimerCallbacks(ptr long)
+@ stdcall WaitForThreadpoolWaitCallbacks(ptr long)
+@ stdcall WaitForThreadpoolWorkCallbacks(ptr long)
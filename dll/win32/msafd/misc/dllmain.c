@@ -1287,13 +1287,14 @@ WSPSelect(IN int nfds,
     PollInfo->HandleCount = HandleCount;
     PollBufferSize = FIELD_OFFSET(AFD_POLL_INFO, Handles) + PollInfo->HandleCount * sizeof(AFD_HANDLE);
 
-    /* Send IOCTL */
+    /* Send IOCTL. AFD keeps the handles of a poll set around, so that
+     * selecting on the same sockets again doesn't have to look them up */
     Status = NtDeviceIoControlFile((HANDLE)PollInfo->Handles[0].Handle,
                                    SockEvent,
                                    NULL,
                                    NULL,
                                    &IOSB,
-                                   IOCTL_AFD_SELECT,
+                                   IOCTL_AFD_SELECT_POLL_SET,
                                    PollInfo,
                                    PollBufferSize,
                                    PollInfo,
@@ -19,6 +19,9 @@ RtlpInitializeKeyedEvent(VOID);
 VOID
 RtlpCloseKeyedEvent(VOID);
 
+VOID
+RtlpInitializeThreadPool(VOID);
+
 BOOL
 WINAPI
 DllMain(HANDLE hDll,
@@ -29,6 +32,7 @@ DllMain(HANDLE hDll,
     {
         LdrDisableThreadCalloutsForDll(hDll);
         RtlpInitializeKeyedEvent();
+        RtlpInitializeThreadPool();
     }
     else if (dwReason == DLL_PROCESS_DETACH)
     {
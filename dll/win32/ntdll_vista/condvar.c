@@ -32,15 +32,30 @@ typedef struct _COND_VAR_WAIT_ENTRY
     LIST_ENTRY ListEntry;
     PVOID WaitKey;
     BOOLEAN ListRemovalHandled;
+    volatile LONG Wake;
 } COND_VAR_WAIT_ENTRY, * PCOND_VAR_WAIT_ENTRY;
 
 #define CONTAINING_COND_VAR_WAIT_ENTRY(address, field) \
     CONTAINING_RECORD(address, COND_VAR_WAIT_ENTRY, field)
 
+/* States of the wake flags of waiters that spin before they block on the
+   keyed event. The SRW locks use them through RtlpWaitForWake and
+   RtlpSignalWake. */
+#define RTLP_WAKE_WAITING            0
+#define RTLP_WAKE_SIGNALED           1
+#define RTLP_WAKE_SLEEPING           2
+
+#define RTLP_MIN_SPIN_COUNT          64
+#define RTLP_MAX_SPIN_COUNT          4096
+
 /* GLOBALS *******************************************************************/
 
 static HANDLE CondVarKeyedEventHandle = NULL;
 
+/* How long waiters spin before blocking, adapted to how often spinning
+   pays off. Always 0 on uniprocessor systems. */
+static ULONG RtlpSpinCount = 0;
+
 /* INTERNAL FUNCTIONS ********************************************************/
 
 FORCEINLINE
@@ -72,6 +87,58 @@ InternalGetListRemovalHandledFlag(IN PCOND_VAR_WAIT_ENTRY Entry)
     return (BOOLEAN *)&Entry->ListRemovalHandled;
 }
 
+static
+BOOLEAN
+RtlpSpinForWake(IN volatile LONG *Wake)
+{
+    ULONG SpinCount = RtlpSpinCount;
+    ULONG i;
+
+    for (i = 0; i < SpinCount; i++)
+    {
+        if (*Wake == RTLP_WAKE_SIGNALED)
+        {
+            /* It paid off, spin a bit longer next time */
+            RtlpSpinCount = min(SpinCount + SpinCount / 8, RTLP_MAX_SPIN_COUNT);
+            return TRUE;
+        }
+
+        YieldProcessor();
+    }
+
+    /* We have to block anyway, don't waste as much time next time */
+    if (SpinCount > RTLP_MIN_SPIN_COUNT)
+        RtlpSpinCount = SpinCount - SpinCount / 8;
+
+    return FALSE;
+}
+
+VOID
+RtlpWaitForWake(IN volatile LONG *Wake)
+{
+    if (RtlpSpinForWake(Wake))
+        return;
+
+    /* Tell the waker it has to release us, unless it was faster */
+    if (InterlockedCompareExchange(Wake,
+                                   RTLP_WAKE_SLEEPING,
+                                   RTLP_WAKE_WAITING) == RTLP_WAKE_WAITING)
+    {
+        NtWaitForKeyedEvent(CondVarKeyedEventHandle, (PVOID)Wake, FALSE, NULL);
+    }
+}
+
+VOID
+RtlpSignalWake(IN volatile LONG *Wake)
+{
+    /* Only enter the kernel if the waiter is blocked. Since it blocks without
+       a timeout, the release can't miss it. */
+    if (InterlockedExchange(Wake, RTLP_WAKE_SIGNALED) == RTLP_WAKE_SLEEPING)
+    {
+        NtReleaseKeyedEvent(CondVarKeyedEventHandle, (PVOID)Wake, FALSE, NULL);
+    }
+}
+
 static
 PCOND_VAR_WAIT_ENTRY
 InternalLockCondVar(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
@@ -302,12 +369,22 @@ InternalWake(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
             NextEntry = CONTAINING_COND_VAR_WAIT_ENTRY(Entry->ListEntry.Blink, ListEntry);
         }
 
-        /* Wake the thread associated with this event. We will
-           immediately return if we failed (zero timeout). */
-        Status = NtReleaseKeyedEvent(CondVarKeyedEventHandle,
-                                     &Entry->WaitKey,
-                                     FALSE,
-                                     &Timeout);
+        /* Wake the thread associated with this event. If it is still
+           spinning, flagging it is enough. Otherwise we will immediately
+           return if we failed (zero timeout). */
+        if (InterlockedCompareExchange(&Entry->Wake,
+                                       RTLP_WAKE_SIGNALED,
+                                       RTLP_WAKE_WAITING) == RTLP_WAKE_WAITING)
+        {
+            Status = STATUS_SUCCESS;
+        }
+        else
+        {
+            Status = NtReleaseKeyedEvent(CondVarKeyedEventHandle,
+                                         &Entry->WaitKey,
+                                         FALSE,
+                                         &Timeout);
+        }
 
         if (!NT_SUCCESS(Status))
         {
@@ -404,11 +481,26 @@ InternalSleep(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
         RtlLeaveCriticalSection(CriticalSection);
     }
 
-    /* Now sleep using the caller provided timeout. */
-    Status = NtWaitForKeyedEvent(CondVarKeyedEventHandle,
-                                 &OwnEntry.WaitKey,
-                                 FALSE,
-                                 (PLARGE_INTEGER)TimeOut);
+    /* Spin for a while, unless the caller just polls, then sleep using
+       the caller provided timeout if nobody woke us yet. */
+    if ((TimeOut == NULL || TimeOut->QuadPart != 0) &&
+        RtlpSpinForWake(&OwnEntry.Wake))
+    {
+        Status = STATUS_SUCCESS;
+    }
+    else if (InterlockedCompareExchange(&OwnEntry.Wake,
+                                        RTLP_WAKE_SLEEPING,
+                                        RTLP_WAKE_WAITING) != RTLP_WAKE_WAITING)
+    {
+        Status = STATUS_SUCCESS;
+    }
+    else
+    {
+        Status = NtWaitForKeyedEvent(CondVarKeyedEventHandle,
+                                     &OwnEntry.WaitKey,
+                                     FALSE,
+                                     (PLARGE_INTEGER)TimeOut);
+    }
 
     ASSERT(STATUS_INVALID_HANDLE != Status);
 
@@ -460,6 +552,10 @@ RtlpInitializeKeyedEvent(VOID)
 {
     ASSERT(CondVarKeyedEventHandle == NULL);
     NtCreateKeyedEvent(&CondVarKeyedEventHandle, EVENT_ALL_ACCESS, NULL, 0);
+
+    /* Spinning only makes sense if the owner can run meanwhile */
+    if (NtCurrentPeb()->NumberOfProcessors > 1)
+        RtlpSpinCount = RTLP_MAX_SPIN_COUNT / 4;
 }
 
 VOID
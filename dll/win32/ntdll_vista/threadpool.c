@@ -0,0 +1,1774 @@
+/*
+ * PROJECT:     ReactOS system libraries
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Vista thread pool (work, timers, waits and I/O)
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ * NOTES:       Every pool queues its callbacks and I/O completions to one
+ *              completion port, so the kernel keeps the number of running
+ *              workers at the number of processors. A worker is started
+ *              when work is posted and no worker is idle, up to that
+ *              target. Past it, the controller run by the timer thread
+ *              adds one worker per interval to pools whose queue isn't
+ *              draining, which is what keeps blocked callbacks from
+ *              starving the pool. Timers of all pools are kept in one
+ *              min-heap served by the timer thread, waits are multiplexed
+ *              by wait threads, up to 63 per thread.
+ */
+
+/* INCLUDES ******************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+VOID
+NTAPI
+RtlInitializeConditionVariable(OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+VOID
+NTAPI
+RtlWakeAllConditionVariable(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+NTSTATUS
+NTAPI
+RtlSleepConditionVariableCS(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
+                            IN OUT PRTL_CRITICAL_SECTION CriticalSection,
+                            IN PLARGE_INTEGER TimeOut OPTIONAL);
+
+/* INTERNAL TYPES ************************************************************/
+
+#define TP_DEFAULT_MAX_THREADS      500
+#define TP_WORKER_IDLE_TIMEOUT      (-20 * 1000 * 10000LL)  /* 20 seconds */
+#define TP_CONTROLLER_INTERVAL      (500 * 10000LL)         /* 500 ms */
+#define TP_MAX_WAITS_PER_THREAD     (MAXIMUM_WAIT_OBJECTS - 1)
+#define TP_INFINITE_TIMEOUT         MAXLONGLONG
+
+typedef enum _TP_OBJECT_TYPE
+{
+    TpWorkObject,
+    TpSimpleObject,
+    TpTimerObject,
+    TpWaitObject,
+    TpIoObject
+} TP_OBJECT_TYPE;
+
+#define TP_OBJECT_LONG_FUNCTION     0x1
+#define TP_OBJECT_RELEASED          0x2
+
+struct _TP_POOL
+{
+    LONG ReferenceCount;
+    HANDLE CompletionPort;
+    LIST_ENTRY PoolLinks;
+    RTL_CRITICAL_SECTION Lock;
+    ULONG MinThreads;
+    ULONG MaxThreads;
+    volatile ULONG Threads;
+    volatile ULONG LongThreads;
+    volatile LONG IdleThreads;
+    volatile LONG QueuedPackets;
+    BOOLEAN Shutdown;
+};
+
+struct _TP_CLEANUP_GROUP
+{
+    LONG ReferenceCount;
+    RTL_CRITICAL_SECTION Lock;
+    LIST_ENTRY Members;
+};
+
+/* Header shared by all the pool objects */
+typedef struct _TP_OBJECT
+{
+    TP_OBJECT_TYPE Type;
+    ULONG Flags;
+    LONG ReferenceCount;
+    PTP_POOL Pool;
+    PVOID Callback;
+    PVOID Context;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    PVOID RaceDll;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    LIST_ENTRY CleanupGroupLinks;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback;
+    volatile LONG Pending;              /* Queued callbacks that will still run */
+    volatile LONG Running;              /* Callbacks in progress */
+    RTL_CONDITION_VARIABLE Done;        /* Pending and Running went down to 0 */
+} TP_OBJECT, *PTP_OBJECT;
+
+struct _TP_WORK
+{
+    TP_OBJECT Object;
+};
+
+typedef struct _TP_SIMPLE
+{
+    TP_OBJECT Object;
+} TP_SIMPLE, *PTP_SIMPLE;
+
+struct _TP_TIMER
+{
+    TP_OBJECT Object;
+    LONGLONG DueTime;
+    ULONG Period;
+    LONG HeapIndex;                     /* -1 when the timer isn't set */
+};
+
+typedef struct _TP_WAIT_THREAD
+{
+    LIST_ENTRY WaitThreadLinks;
+    HANDLE UpdateEvent;
+    ULONG Count;
+    PTP_WAIT Waits[TP_MAX_WAITS_PER_THREAD];
+} TP_WAIT_THREAD, *PTP_WAIT_THREAD;
+
+struct _TP_WAIT
+{
+    TP_OBJECT Object;
+    HANDLE Handle;
+    LONGLONG Timeout;
+    PTP_WAIT_THREAD WaitThread;         /* NULL when the wait isn't set */
+    ULONG Index;
+};
+
+struct _TP_IO
+{
+    PVOID Win32Callback;                /* Reserved for kernel32, has to stay first */
+    TP_OBJECT Object;
+};
+
+struct _TP_CALLBACK_INSTANCE
+{
+    PTP_OBJECT Object;
+    BOOLEAN Associated;
+    BOOLEAN MayRunLong;
+    HANDLE Event;
+    HANDLE Semaphore;
+    ULONG SemaphoreReleaseCount;
+    HANDLE Mutex;
+    PRTL_CRITICAL_SECTION CriticalSection;
+    PVOID Dll;
+};
+
+/* GLOBALS *******************************************************************/
+
+/* Protects the pool list, the default pool, the timers and the controller */
+static RTL_CRITICAL_SECTION TppLock;
+static LIST_ENTRY TppPoolList;
+static PTP_POOL volatile TppDefaultPool;
+static ULONG TppProcessors;
+
+static HANDLE TppTimerEvent;
+static PTP_TIMER *TppTimerHeap;
+static ULONG TppTimerCount;
+static ULONG TppTimerObjects;
+static ULONG TppTimerHeapSize;
+static BOOLEAN TppControllerActive;
+static LONGLONG TppControllerTick;
+
+/* Protects the wait threads and the waits set on them */
+static RTL_CRITICAL_SECTION TppWaitLock;
+static LIST_ENTRY TppWaitThreadList;
+
+/* INTERNAL FUNCTIONS ********************************************************/
+
+static ULONG NTAPI TppWorkerThread(PVOID Parameter);
+static ULONG NTAPI TppTimerThread(PVOID Parameter);
+static ULONG NTAPI TppWaitThread(PVOID Parameter);
+static VOID TppStartController(VOID);
+
+VOID
+RtlpInitializeThreadPool(VOID)
+{
+    RtlInitializeCriticalSection(&TppLock);
+    RtlInitializeCriticalSection(&TppWaitLock);
+    InitializeListHead(&TppPoolList);
+    InitializeListHead(&TppWaitThreadList);
+    TppProcessors = max(NtCurrentPeb()->NumberOfProcessors, 1);
+}
+
+static
+NTSTATUS
+TppCreateThread(IN PTHREAD_START_ROUTINE StartRoutine,
+                IN PVOID Parameter)
+{
+    NTSTATUS Status;
+    HANDLE ThreadHandle;
+
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 StartRoutine,
+                                 Parameter,
+                                 &ThreadHandle,
+                                 NULL);
+    if (NT_SUCCESS(Status)) NtClose(ThreadHandle);
+    return Status;
+}
+
+/* Called with the pool lock held */
+static
+NTSTATUS
+TppStartWorker(IN PTP_POOL Pool)
+{
+    NTSTATUS Status;
+
+    Pool->Threads++;
+    Status = TppCreateThread(TppWorkerThread, Pool);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to start a pool worker: 0x%lx\n", Status);
+        Pool->Threads--;
+    }
+    return Status;
+}
+
+static
+VOID
+TppFreePool(IN PTP_POOL Pool)
+{
+    RtlEnterCriticalSection(&TppLock);
+    RemoveEntryList(&Pool->PoolLinks);
+    RtlLeaveCriticalSection(&TppLock);
+
+    NtClose(Pool->CompletionPort);
+    RtlDeleteCriticalSection(&Pool->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+}
+
+static
+VOID
+TppDereferencePool(IN PTP_POOL Pool)
+{
+    ULONG Threads, i;
+
+    if (InterlockedDecrement(&Pool->ReferenceCount)) return;
+
+    /*
+     * Nobody uses the pool anymore, send its workers home. The last worker out
+     * frees the pool, and they all need the lock to leave, so it stays around
+     * until the packets are posted.
+     */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->Shutdown = TRUE;
+    Threads = Pool->Threads;
+    for (i = 0; i < Threads; i++)
+    {
+        NtSetIoCompletion(Pool->CompletionPort, NULL, NULL, STATUS_SUCCESS, 0);
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (!Threads) TppFreePool(Pool);
+}
+
+static
+VOID
+TppExitWorker(IN PTP_POOL Pool,
+              IN BOOLEAN Counted)
+{
+    BOOLEAN Free;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (!Counted) Pool->Threads--;
+    Free = (Pool->Shutdown && !Pool->Threads);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (Free) TppFreePool(Pool);
+    RtlExitUserThread(STATUS_SUCCESS);
+}
+
+/* Makes sure someone picks up a packet that was just queued */
+static
+VOID
+TppWakeWorkers(IN PTP_POOL Pool)
+{
+    /* An idle worker will take it */
+    if (Pool->IdleThreads) return;
+
+    /* Up to the target, start a worker right away */
+    if ((Pool->Threads - Pool->LongThreads < TppProcessors) ||
+        (Pool->Threads < Pool->MinThreads))
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        if (!(Pool->IdleThreads) &&
+            (Pool->Threads < Pool->MaxThreads) &&
+            ((Pool->Threads - Pool->LongThreads < TppProcessors) ||
+             (Pool->Threads < Pool->MinThreads)))
+        {
+            TppStartWorker(Pool);
+        }
+        RtlLeaveCriticalSection(&Pool->Lock);
+        return;
+    }
+
+    /* Past it, the controller adds workers if the queue doesn't drain */
+    if ((Pool->Threads < Pool->MaxThreads) && !(TppControllerActive))
+    {
+        TppStartController();
+    }
+}
+
+static
+PTP_POOL
+TppGetPool(IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTP_POOL Pool;
+
+    if ((CallbackEnviron) && (CallbackEnviron->Pool)) return CallbackEnviron->Pool;
+
+    /* Create the default pool the first time it's needed */
+    if (!TppDefaultPool)
+    {
+        RtlEnterCriticalSection(&TppLock);
+        if (!TppDefaultPool && NT_SUCCESS(TpAllocPool(&Pool, NULL)))
+        {
+            TppDefaultPool = Pool;
+        }
+        RtlLeaveCriticalSection(&TppLock);
+    }
+
+    return TppDefaultPool;
+}
+
+static
+VOID
+TppWakeWaiters(IN PTP_OBJECT Object)
+{
+    RtlEnterCriticalSection(&Object->Pool->Lock);
+    RtlWakeAllConditionVariable(&Object->Done);
+    RtlLeaveCriticalSection(&Object->Pool->Lock);
+}
+
+static
+VOID
+TppDestroyObject(IN PTP_OBJECT Object)
+{
+    PTP_CLEANUP_GROUP CleanupGroup = Object->CleanupGroup;
+    BOOLEAN Member = FALSE;
+
+    /* Leave the cleanup group, unless it already let go of us */
+    if (CleanupGroup)
+    {
+        RtlEnterCriticalSection(&CleanupGroup->Lock);
+        if (Object->CleanupGroup)
+        {
+            RemoveEntryList(&Object->CleanupGroupLinks);
+            Object->CleanupGroup = NULL;
+            Member = TRUE;
+        }
+        RtlLeaveCriticalSection(&CleanupGroup->Lock);
+    }
+
+    if (Object->Type == TpTimerObject)
+    {
+        RtlEnterCriticalSection(&TppLock);
+        TppTimerObjects--;
+        RtlLeaveCriticalSection(&TppLock);
+    }
+
+    if (Object->RaceDll) LdrUnloadDll(Object->RaceDll);
+    TppDereferencePool(Object->Pool);
+    if (Member) TpReleaseCleanupGroup(CleanupGroup);
+
+    RtlFreeHeap(RtlGetProcessHeap(),
+                0,
+                (Object->Type == TpIoObject) ?
+                (PVOID)CONTAINING_RECORD(Object, TP_IO, Object) : (PVOID)Object);
+}
+
+static
+VOID
+TppDereferenceObject(IN PTP_OBJECT Object)
+{
+    if (!InterlockedDecrement(&Object->ReferenceCount)) TppDestroyObject(Object);
+}
+
+static
+NTSTATUS
+TppAllocateObject(IN TP_OBJECT_TYPE Type,
+                  IN SIZE_T Size,
+                  IN PVOID Callback,
+                  IN PVOID Context,
+                  IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL,
+                  OUT PVOID *Allocation)
+{
+    PTP_OBJECT Object;
+    PTP_POOL Pool;
+    PTP_CLEANUP_GROUP CleanupGroup = NULL;
+    PVOID Memory;
+    NTSTATUS Status;
+
+    if (!Callback) return STATUS_INVALID_PARAMETER;
+
+    Pool = TppGetPool(CallbackEnviron);
+    if (!Pool) return STATUS_NO_MEMORY;
+
+    Memory = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, Size);
+    if (!Memory) return STATUS_NO_MEMORY;
+
+    Object = (Type == TpIoObject) ? &((PTP_IO)Memory)->Object : Memory;
+    Object->Type = Type;
+    Object->ReferenceCount = 1;
+    Object->Pool = Pool;
+    Object->Callback = Callback;
+    Object->Context = Context;
+    RtlInitializeConditionVariable(&Object->Done);
+
+    if (CallbackEnviron)
+    {
+        /* Activation contexts aren't supported */
+        Object->FinalizationCallback = CallbackEnviron->FinalizationCallback;
+        Object->CleanupGroupCancelCallback = CallbackEnviron->CleanupGroupCancelCallback;
+        CleanupGroup = CallbackEnviron->CleanupGroup;
+        if (CallbackEnviron->u.s.LongFunction) Object->Flags |= TP_OBJECT_LONG_FUNCTION;
+
+        /* Keep the DLL around as long as the object can call into it */
+        if (CallbackEnviron->RaceDll)
+        {
+            Status = LdrAddRefDll(0, CallbackEnviron->RaceDll);
+            if (!NT_SUCCESS(Status))
+            {
+                RtlFreeHeap(RtlGetProcessHeap(), 0, Memory);
+                return Status;
+            }
+            Object->RaceDll = CallbackEnviron->RaceDll;
+        }
+    }
+
+    if (Type == TpTimerObject)
+    {
+        /* Make sure setting the timer never has to grow the heap */
+        RtlEnterCriticalSection(&TppLock);
+        if (TppTimerObjects == TppTimerHeapSize)
+        {
+            ULONG NewSize = max(TppTimerHeapSize * 2, 16);
+            PTP_TIMER *NewHeap;
+
+            NewHeap = RtlAllocateHeap(RtlGetProcessHeap(), 0, NewSize * sizeof(PTP_TIMER));
+            if (!NewHeap)
+            {
+                RtlLeaveCriticalSection(&TppLock);
+                if (Object->RaceDll) LdrUnloadDll(Object->RaceDll);
+                RtlFreeHeap(RtlGetProcessHeap(), 0, Memory);
+                return STATUS_NO_MEMORY;
+            }
+            if (TppTimerHeap)
+            {
+                RtlCopyMemory(NewHeap, TppTimerHeap, TppTimerCount * sizeof(PTP_TIMER));
+                RtlFreeHeap(RtlGetProcessHeap(), 0, TppTimerHeap);
+            }
+            TppTimerHeap = NewHeap;
+            TppTimerHeapSize = NewSize;
+        }
+        TppTimerObjects++;
+        RtlLeaveCriticalSection(&TppLock);
+    }
+
+    InterlockedIncrement(&Pool->ReferenceCount);
+
+    if (CleanupGroup)
+    {
+        InterlockedIncrement(&CleanupGroup->ReferenceCount);
+        RtlEnterCriticalSection(&CleanupGroup->Lock);
+        Object->CleanupGroup = CleanupGroup;
+        InsertTailList(&CleanupGroup->Members, &Object->CleanupGroupLinks);
+        RtlLeaveCriticalSection(&CleanupGroup->Lock);
+    }
+
+    *Allocation = Memory;
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+TppQueueCallback(IN PTP_OBJECT Object,
+                 IN ULONG WaitResult)
+{
+    PTP_POOL Pool = Object->Pool;
+    NTSTATUS Status;
+
+    /* Each packet holds a reference on the object */
+    InterlockedIncrement(&Object->ReferenceCount);
+    InterlockedIncrement(&Object->Pending);
+    InterlockedIncrement(&Pool->QueuedPackets);
+
+    Status = NtSetIoCompletion(Pool->CompletionPort, NULL, Object, WaitResult, 0);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to queue a pool callback: 0x%lx\n", Status);
+        InterlockedDecrement(&Pool->QueuedPackets);
+        InterlockedDecrement(&Object->Pending);
+        InterlockedDecrement(&Object->ReferenceCount);
+        return;
+    }
+
+    TppWakeWorkers(Pool);
+}
+
+static
+BOOLEAN
+TppTakePending(IN PTP_OBJECT Object)
+{
+    LONG Pending;
+
+    /* Take one of the pending callbacks, none are left if they were cancelled */
+    do
+    {
+        Pending = Object->Pending;
+        if (!Pending) return FALSE;
+    } while (InterlockedCompareExchange(&Object->Pending, Pending - 1, Pending) != Pending);
+
+    return TRUE;
+}
+
+static
+VOID
+TppCancelCallbacks(IN PTP_OBJECT Object)
+{
+    /* The packets stay queued, the workers drop them */
+    InterlockedExchange(&Object->Pending, 0);
+    if (!Object->Running) TppWakeWaiters(Object);
+}
+
+static
+VOID
+TppWaitForCallbacks(IN PTP_OBJECT Object,
+                    IN BOOLEAN CancelPendingCallbacks)
+{
+    PTP_POOL Pool = Object->Pool;
+
+    if (CancelPendingCallbacks) TppCancelCallbacks(Object);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    while ((Object->Pending) || (Object->Running))
+    {
+        RtlSleepConditionVariableCS(&Object->Done, &Pool->Lock, NULL);
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+static
+VOID
+TppFinishCallback(IN PTP_OBJECT Object)
+{
+    if (!InterlockedDecrement(&Object->Running) && !(Object->Pending))
+    {
+        TppWakeWaiters(Object);
+    }
+}
+
+static
+VOID
+TppCompleteInstance(IN PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+
+    /* Do what the callback asked for once it returned */
+    if (Instance->CriticalSection) RtlLeaveCriticalSection(Instance->CriticalSection);
+    if (Instance->Mutex) NtReleaseMutant(Instance->Mutex, NULL);
+    if (Instance->Semaphore)
+    {
+        NtReleaseSemaphore(Instance->Semaphore, Instance->SemaphoreReleaseCount, NULL);
+    }
+    if (Instance->Event) NtSetEvent(Instance->Event, NULL);
+
+    if (Instance->MayRunLong)
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        Pool->LongThreads--;
+        RtlLeaveCriticalSection(&Pool->Lock);
+    }
+
+    if (Instance->Associated) TppFinishCallback(Instance->Object);
+    if (Instance->Dll) LdrUnloadDll(Instance->Dll);
+}
+
+static
+VOID
+TppExecuteCallback(IN PTP_OBJECT Object,
+                   IN PVOID ApcContext,
+                   IN PIO_STATUS_BLOCK IoStatusBlock)
+{
+    TP_CALLBACK_INSTANCE Instance;
+
+    /* Count the callback as running before it stops being pending */
+    InterlockedIncrement(&Object->Running);
+    if (!TppTakePending(Object))
+    {
+        /* It was cancelled */
+        TppFinishCallback(Object);
+        TppDereferenceObject(Object);
+        return;
+    }
+
+    RtlZeroMemory(&Instance, sizeof(Instance));
+    Instance.Object = Object;
+    Instance.Associated = TRUE;
+    if (Object->Flags & TP_OBJECT_LONG_FUNCTION) TpCallbackMayRunLong(&Instance);
+
+    switch (Object->Type)
+    {
+        case TpWorkObject:
+            ((PTP_WORK_CALLBACK)Object->Callback)(&Instance,
+                                                  Object->Context,
+                                                  CONTAINING_RECORD(Object, TP_WORK, Object));
+            break;
+
+        case TpSimpleObject:
+            ((PTP_SIMPLE_CALLBACK)Object->Callback)(&Instance, Object->Context);
+            break;
+
+        case TpTimerObject:
+            ((PTP_TIMER_CALLBACK)Object->Callback)(&Instance,
+                                                   Object->Context,
+                                                   CONTAINING_RECORD(Object, TP_TIMER, Object));
+            break;
+
+        case TpWaitObject:
+            ((PTP_WAIT_CALLBACK)Object->Callback)(&Instance,
+                                                  Object->Context,
+                                                  CONTAINING_RECORD(Object, TP_WAIT, Object),
+                                                  (TP_WAIT_RESULT)IoStatusBlock->Status);
+            break;
+
+        case TpIoObject:
+            ((PTP_IO_CALLBACK)Object->Callback)(&Instance,
+                                                Object->Context,
+                                                ApcContext,
+                                                IoStatusBlock,
+                                                CONTAINING_RECORD(Object, TP_IO, Object));
+            break;
+    }
+
+    if (Object->FinalizationCallback) Object->FinalizationCallback(&Instance, Object->Context);
+
+    TppCompleteInstance(&Instance);
+    TppDereferenceObject(Object);
+}
+
+static
+ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter)
+{
+    PTP_POOL Pool = Parameter;
+    LARGE_INTEGER Timeout;
+    PVOID KeyContext, ApcContext;
+    IO_STATUS_BLOCK IoStatusBlock;
+    NTSTATUS Status;
+
+    Timeout.QuadPart = TP_WORKER_IDLE_TIMEOUT;
+    for (;;)
+    {
+        InterlockedIncrement(&Pool->IdleThreads);
+        Status = NtRemoveIoCompletion(Pool->CompletionPort,
+                                      &KeyContext,
+                                      &ApcContext,
+                                      &IoStatusBlock,
+                                      &Timeout);
+        InterlockedDecrement(&Pool->IdleThreads);
+
+        if (Status == STATUS_SUCCESS)
+        {
+            if (KeyContext)
+            {
+                /* An I/O completion, the key is the I/O object */
+                TppExecuteCallback(&((PTP_IO)KeyContext)->Object, ApcContext, &IoStatusBlock);
+            }
+            else if (ApcContext)
+            {
+                /* A callback we queued ourselves */
+                InterlockedDecrement(&Pool->QueuedPackets);
+                TppExecuteCallback(ApcContext, NULL, &IoStatusBlock);
+            }
+            else
+            {
+                /* The pool is going away */
+                TppExitWorker(Pool, FALSE);
+            }
+        }
+        else if (Status == STATUS_TIMEOUT)
+        {
+            /* Leave after being idle for a while, if there are enough workers */
+            RtlEnterCriticalSection(&Pool->Lock);
+            if ((Pool->Threads > Pool->MinThreads) && !(Pool->QueuedPackets))
+            {
+                Pool->Threads--;
+                RtlLeaveCriticalSection(&Pool->Lock);
+                TppExitWorker(Pool, TRUE);
+            }
+            RtlLeaveCriticalSection(&Pool->Lock);
+        }
+        else
+        {
+            DPRINT1("NtRemoveIoCompletion failed: 0x%lx\n", Status);
+            TppExitWorker(Pool, FALSE);
+        }
+    }
+
+    return 0;
+}
+
+/* Called with TppLock held */
+static
+BOOLEAN
+TppEnsureTimerThread(VOID)
+{
+    NTSTATUS Status;
+
+    if (TppTimerEvent) return TRUE;
+
+    Status = NtCreateEvent(&TppTimerEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        TppTimerEvent = NULL;
+        return FALSE;
+    }
+
+    Status = TppCreateThread(TppTimerThread, NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to start the pool timer thread: 0x%lx\n", Status);
+        NtClose(TppTimerEvent);
+        TppTimerEvent = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+TppStartController(VOID)
+{
+    LARGE_INTEGER Now;
+
+    RtlEnterCriticalSection(&TppLock);
+    if (!TppControllerActive && TppEnsureTimerThread())
+    {
+        NtQuerySystemTime(&Now);
+        TppControllerActive = TRUE;
+        TppControllerTick = Now.QuadPart + TP_CONTROLLER_INTERVAL;
+        NtSetEvent(TppTimerEvent, NULL);
+    }
+    RtlLeaveCriticalSection(&TppLock);
+}
+
+/* Called with TppLock held, returns whether a pool still needs watching */
+static
+BOOLEAN
+TppRunController(VOID)
+{
+    IO_COMPLETION_BASIC_INFORMATION BasicInfo;
+    PLIST_ENTRY ListEntry;
+    PTP_POOL Pool;
+    BOOLEAN Active = FALSE;
+
+    for (ListEntry = TppPoolList.Flink; ListEntry != &TppPoolList; ListEntry = ListEntry->Flink)
+    {
+        Pool = CONTAINING_RECORD(ListEntry, TP_POOL, PoolLinks);
+        if (Pool->IdleThreads) continue;
+
+        /* The port also holds the I/O completions nobody picked up yet */
+        if (!NT_SUCCESS(NtQueryIoCompletion(Pool->CompletionPort,
+                                            IoCompletionBasicInformation,
+                                            &BasicInfo,
+                                            sizeof(BasicInfo),
+                                            NULL)) ||
+            (BasicInfo.Depth <= 0))
+        {
+            continue;
+        }
+
+        /* Nothing drained the queue for a whole interval, add a worker */
+        RtlEnterCriticalSection(&Pool->Lock);
+        if (!(Pool->Shutdown) && (Pool->Threads < Pool->MaxThreads))
+        {
+            TppStartWorker(Pool);
+            Active = TRUE;
+        }
+        RtlLeaveCriticalSection(&Pool->Lock);
+    }
+
+    return Active;
+}
+
+/* Timer heap, ordered by due time. Called with TppLock held */
+static
+VOID
+TppSetHeapEntry(IN ULONG Index,
+                IN PTP_TIMER Timer)
+{
+    TppTimerHeap[Index] = Timer;
+    Timer->HeapIndex = Index;
+}
+
+static
+VOID
+TppSiftTimer(IN PTP_TIMER Timer,
+             IN ULONG Index)
+{
+    ULONG Parent, Child;
+
+    /* Move it up while it's due before its parent */
+    while (Index)
+    {
+        Parent = (Index - 1) / 2;
+        if (TppTimerHeap[Parent]->DueTime <= Timer->DueTime) break;
+        TppSetHeapEntry(Index, TppTimerHeap[Parent]);
+        Index = Parent;
+    }
+
+    /* Then down while one of its children is due before it */
+    for (;;)
+    {
+        Child = Index * 2 + 1;
+        if (Child >= TppTimerCount) break;
+        if ((Child + 1 < TppTimerCount) &&
+            (TppTimerHeap[Child + 1]->DueTime < TppTimerHeap[Child]->DueTime))
+        {
+            Child++;
+        }
+        if (Timer->DueTime <= TppTimerHeap[Child]->DueTime) break;
+        TppSetHeapEntry(Index, TppTimerHeap[Child]);
+        Index = Child;
+    }
+
+    TppSetHeapEntry(Index, Timer);
+}
+
+static
+VOID
+TppInsertTimer(IN PTP_TIMER Timer)
+{
+    ASSERT(TppTimerCount < TppTimerHeapSize);
+    TppSiftTimer(Timer, TppTimerCount++);
+}
+
+static
+VOID
+TppRemoveTimer(IN PTP_TIMER Timer)
+{
+    ULONG Index = Timer->HeapIndex;
+    PTP_TIMER Last;
+
+    Timer->HeapIndex = -1;
+    Last = TppTimerHeap[--TppTimerCount];
+    if (Last != Timer) TppSiftTimer(Last, Index);
+}
+
+static
+ULONG
+NTAPI
+TppTimerThread(IN PVOID Parameter)
+{
+    LARGE_INTEGER Now, Timeout;
+    PTP_TIMER Timer;
+    BOOLEAN Wait;
+
+    for (;;)
+    {
+        RtlEnterCriticalSection(&TppLock);
+        NtQuerySystemTime(&Now);
+
+        /* Queue the callbacks of the timers that are due, and set the periodic ones again */
+        while ((TppTimerCount) && (TppTimerHeap[0]->DueTime <= Now.QuadPart))
+        {
+            Timer = TppTimerHeap[0];
+            TppRemoveTimer(Timer);
+            TppQueueCallback(&Timer->Object, 0);
+
+            if (Timer->Period)
+            {
+                Timer->DueTime += Timer->Period * 10000LL;
+                if (Timer->DueTime <= Now.QuadPart)
+                {
+                    Timer->DueTime = Now.QuadPart + Timer->Period * 10000LL;
+                }
+                TppInsertTimer(Timer);
+            }
+        }
+
+        if ((TppControllerActive) && (TppControllerTick <= Now.QuadPart))
+        {
+            TppControllerActive = TppRunController();
+            TppControllerTick = Now.QuadPart + TP_CONTROLLER_INTERVAL;
+        }
+
+        /* Sleep until the next timer or controller tick, both are absolute times */
+        Wait = FALSE;
+        Timeout.QuadPart = TP_INFINITE_TIMEOUT;
+        if (TppTimerCount)
+        {
+            Timeout.QuadPart = TppTimerHeap[0]->DueTime;
+            Wait = TRUE;
+        }
+        if (TppControllerActive)
+        {
+            Timeout.QuadPart = min(Timeout.QuadPart, TppControllerTick);
+            Wait = TRUE;
+        }
+        RtlLeaveCriticalSection(&TppLock);
+
+        NtWaitForSingleObject(TppTimerEvent, FALSE, Wait ? &Timeout : NULL);
+    }
+
+    return 0;
+}
+
+/* Wait threads. Called with TppWaitLock held */
+static
+VOID
+TppRemoveWait(IN PTP_WAIT Wait,
+              IN BOOLEAN Notify)
+{
+    PTP_WAIT_THREAD WaitThread = Wait->WaitThread;
+    PTP_WAIT Last;
+
+    if (!WaitThread) return;
+
+    Last = WaitThread->Waits[--WaitThread->Count];
+    WaitThread->Waits[Wait->Index] = Last;
+    Last->Index = Wait->Index;
+    Wait->WaitThread = NULL;
+
+    if (Notify) NtSetEvent(WaitThread->UpdateEvent, NULL);
+}
+
+static
+NTSTATUS
+TppInsertWait(IN PTP_WAIT Wait)
+{
+    PTP_WAIT_THREAD WaitThread = NULL;
+    PLIST_ENTRY ListEntry;
+    NTSTATUS Status;
+
+    for (ListEntry = TppWaitThreadList.Flink;
+         ListEntry != &TppWaitThreadList;
+         ListEntry = ListEntry->Flink)
+    {
+        WaitThread = CONTAINING_RECORD(ListEntry, TP_WAIT_THREAD, WaitThreadLinks);
+        if (WaitThread->Count < TP_MAX_WAITS_PER_THREAD) break;
+        WaitThread = NULL;
+    }
+
+    if (!WaitThread)
+    {
+        /* All wait threads are full, start another one */
+        WaitThread = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*WaitThread));
+        if (!WaitThread) return STATUS_NO_MEMORY;
+
+        Status = NtCreateEvent(&WaitThread->UpdateEvent,
+                               EVENT_ALL_ACCESS,
+                               NULL,
+                               SynchronizationEvent,
+                               FALSE);
+        if (NT_SUCCESS(Status))
+        {
+            Status = TppCreateThread(TppWaitThread, WaitThread);
+            if (!NT_SUCCESS(Status)) NtClose(WaitThread->UpdateEvent);
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            RtlFreeHeap(RtlGetProcessHeap(), 0, WaitThread);
+            return Status;
+        }
+
+        InsertTailList(&TppWaitThreadList, &WaitThread->WaitThreadLinks);
+    }
+
+    Wait->WaitThread = WaitThread;
+    Wait->Index = WaitThread->Count;
+    WaitThread->Waits[WaitThread->Count++] = Wait;
+    NtSetEvent(WaitThread->UpdateEvent, NULL);
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+TppFireWait(IN PTP_WAIT_THREAD WaitThread,
+            IN PTP_WAIT Wait,
+            IN HANDLE Handle)
+{
+    ULONG i;
+
+    /*
+     * The wait may have been changed or closed while we weren't holding the
+     * lock, only trust it if it's still set on us for the same handle.
+     */
+    for (i = 0; i < WaitThread->Count; i++)
+    {
+        if ((WaitThread->Waits[i] == Wait) && (Wait->Handle == Handle))
+        {
+            TppRemoveWait(Wait, FALSE);
+            TppQueueCallback(&Wait->Object, WAIT_OBJECT_0);
+            return;
+        }
+    }
+}
+
+static
+VOID
+TppDropInvalidWaits(IN PTP_WAIT_THREAD WaitThread)
+{
+    LARGE_INTEGER Timeout;
+    PTP_WAIT Wait;
+    NTSTATUS Status;
+    ULONG i;
+
+    /*
+     * Check the handles one by one. Polling a handle satisfies the wait like
+     * the real one would have, so fire the waits whose object got signaled.
+     */
+    Timeout.QuadPart = 0;
+    for (i = WaitThread->Count; i-- > 0;)
+    {
+        Wait = WaitThread->Waits[i];
+        Status = NtWaitForSingleObject(Wait->Handle, FALSE, &Timeout);
+        if ((Status == STATUS_WAIT_0) || (Status == STATUS_ABANDONED_WAIT_0))
+        {
+            TppRemoveWait(Wait, FALSE);
+            TppQueueCallback(&Wait->Object, WAIT_OBJECT_0);
+        }
+        else if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Dropping wait %p on invalid handle %p\n", Wait, Wait->Handle);
+            TppRemoveWait(Wait, FALSE);
+        }
+    }
+}
+
+static
+ULONG
+NTAPI
+TppWaitThread(IN PVOID Parameter)
+{
+    PTP_WAIT_THREAD WaitThread = Parameter;
+    HANDLE Handles[MAXIMUM_WAIT_OBJECTS];
+    PTP_WAIT Waits[TP_MAX_WAITS_PER_THREAD];
+    LARGE_INTEGER Now, Timeout;
+    PTP_WAIT Wait;
+    NTSTATUS Status;
+    ULONG Count, i;
+
+    for (;;)
+    {
+        /* Wait for our update event first, then for every wait set on us */
+        RtlEnterCriticalSection(&TppWaitLock);
+        Handles[0] = WaitThread->UpdateEvent;
+        Timeout.QuadPart = TP_INFINITE_TIMEOUT;
+        Count = WaitThread->Count;
+        for (i = 0; i < Count; i++)
+        {
+            Waits[i] = WaitThread->Waits[i];
+            Handles[i + 1] = Waits[i]->Handle;
+            Timeout.QuadPart = min(Timeout.QuadPart, Waits[i]->Timeout);
+        }
+        RtlLeaveCriticalSection(&TppWaitLock);
+
+        /* Without waits, only stay around for a while in case more are set */
+        if (!Count) Timeout.QuadPart = TP_WORKER_IDLE_TIMEOUT;
+
+        Status = NtWaitForMultipleObjects(Count + 1,
+                                          Handles,
+                                          WaitAny,
+                                          FALSE,
+                                          (Timeout.QuadPart != TP_INFINITE_TIMEOUT) ?
+                                          &Timeout : NULL);
+
+        RtlEnterCriticalSection(&TppWaitLock);
+
+        if (!(Count) && (Status == STATUS_TIMEOUT) && !(WaitThread->Count))
+        {
+            /* Nobody set a wait on us since, leave */
+            RemoveEntryList(&WaitThread->WaitThreadLinks);
+            RtlLeaveCriticalSection(&TppWaitLock);
+
+            NtClose(WaitThread->UpdateEvent);
+            RtlFreeHeap(RtlGetProcessHeap(), 0, WaitThread);
+            RtlExitUserThread(STATUS_SUCCESS);
+        }
+
+        i = (ULONG)Status - STATUS_WAIT_0;
+        if ((i > 0) && (i <= Count))
+        {
+            TppFireWait(WaitThread, Waits[i - 1], Handles[i]);
+        }
+        else
+        {
+            i = (ULONG)Status - STATUS_ABANDONED_WAIT_0;
+            if ((i > 0) && (i <= Count)) TppFireWait(WaitThread, Waits[i - 1], Handles[i]);
+        }
+
+        if (!NT_SUCCESS(Status)) TppDropInvalidWaits(WaitThread);
+
+        /* Time out the waits that expired, the last ones move down as we remove */
+        NtQuerySystemTime(&Now);
+        for (i = WaitThread->Count; i-- > 0;)
+        {
+            Wait = WaitThread->Waits[i];
+            if (Wait->Timeout <= Now.QuadPart)
+            {
+                TppRemoveWait(Wait, FALSE);
+                TppQueueCallback(&Wait->Object, WAIT_TIMEOUT);
+            }
+        }
+
+        RtlLeaveCriticalSection(&TppWaitLock);
+    }
+
+    return 0;
+}
+
+/* Converts a relative or absolute NT time to an absolute one */
+static
+LONGLONG
+TppAbsoluteTime(IN PLARGE_INTEGER Time)
+{
+    LARGE_INTEGER Now;
+
+    if (Time->QuadPart > 0) return Time->QuadPart;
+
+    NtQuerySystemTime(&Now);
+    return Now.QuadPart - Time->QuadPart;
+}
+
+static
+VOID
+TppReleaseObject(IN PTP_OBJECT Object)
+{
+    ASSERT(!(Object->Flags & TP_OBJECT_RELEASED));
+    Object->Flags |= TP_OBJECT_RELEASED;
+    TppDereferenceObject(Object);
+}
+
+/* PUBLIC FUNCTIONS **********************************************************/
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocPool(OUT PTP_POOL *PoolReturn,
+            IN PVOID Reserved)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    Pool = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Pool));
+    if (!Pool) return STATUS_NO_MEMORY;
+
+    /* Let the port run as many workers at once as there are processors */
+    Status = NtCreateIoCompletion(&Pool->CompletionPort, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Status = RtlInitializeCriticalSection(&Pool->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(Pool->CompletionPort);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Pool->ReferenceCount = 1;
+    Pool->MaxThreads = TP_DEFAULT_MAX_THREADS;
+
+    RtlEnterCriticalSection(&TppLock);
+    InsertTailList(&TppPoolList, &Pool->PoolLinks);
+    RtlLeaveCriticalSection(&TppLock);
+
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleasePool(IN OUT PTP_POOL Pool)
+{
+    ASSERT(Pool != TppDefaultPool);
+    TppDereferencePool(Pool);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetPoolMaxThreads(IN OUT PTP_POOL Pool,
+                    IN ULONG MaxThreads)
+{
+    /* Extra workers leave when they become idle */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->MaxThreads = max(MaxThreads, 1);
+    Pool->MinThreads = min(Pool->MinThreads, Pool->MaxThreads);
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSetPoolMinThreads(IN OUT PTP_POOL Pool,
+                    IN ULONG MinThreads)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->MinThreads = MinThreads;
+    Pool->MaxThreads = max(Pool->MaxThreads, MinThreads);
+    while ((Pool->Threads < Pool->MinThreads) && NT_SUCCESS(Status))
+    {
+        Status = TppStartWorker(Pool);
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocCleanupGroup(OUT PTP_CLEANUP_GROUP *CleanupGroupReturn)
+{
+    PTP_CLEANUP_GROUP CleanupGroup;
+    NTSTATUS Status;
+
+    CleanupGroup = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(*CleanupGroup));
+    if (!CleanupGroup) return STATUS_NO_MEMORY;
+
+    Status = RtlInitializeCriticalSection(&CleanupGroup->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+        return Status;
+    }
+
+    /* Members hold a reference each, until they are gone */
+    CleanupGroup->ReferenceCount = 1;
+    InitializeListHead(&CleanupGroup->Members);
+
+    *CleanupGroupReturn = CleanupGroup;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroup(IN OUT PTP_CLEANUP_GROUP CleanupGroup)
+{
+    if (InterlockedDecrement(&CleanupGroup->ReferenceCount)) return;
+
+    RtlDeleteCriticalSection(&CleanupGroup->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP CleanupGroup,
+                             IN BOOLEAN CancelPendingCallbacks,
+                             IN OUT PVOID CleanupParameter OPTIONAL)
+{
+    LIST_ENTRY Members;
+    PLIST_ENTRY ListEntry, NextEntry;
+    PTP_OBJECT Object;
+    LONG References;
+
+    /* Take the members that are still alive out of the group */
+    InitializeListHead(&Members);
+    RtlEnterCriticalSection(&CleanupGroup->Lock);
+    for (ListEntry = CleanupGroup->Members.Flink;
+         ListEntry != &CleanupGroup->Members;
+         ListEntry = NextEntry)
+    {
+        NextEntry = ListEntry->Flink;
+        Object = CONTAINING_RECORD(ListEntry, TP_OBJECT, CleanupGroupLinks);
+
+        /* Objects already on their way out leave the group by themselves */
+        do
+        {
+            References = Object->ReferenceCount;
+            if (!References) break;
+        } while (InterlockedCompareExchange(&Object->ReferenceCount,
+                                            References + 1,
+                                            References) != References);
+        if (!References) continue;
+
+        RemoveEntryList(&Object->CleanupGroupLinks);
+        InsertTailList(&Members, &Object->CleanupGroupLinks);
+        Object->CleanupGroup = NULL;
+    }
+    RtlLeaveCriticalSection(&CleanupGroup->Lock);
+
+    while (!IsListEmpty(&Members))
+    {
+        ListEntry = RemoveHeadList(&Members);
+        Object = CONTAINING_RECORD(ListEntry, TP_OBJECT, CleanupGroupLinks);
+
+        /* Members that are closed here don't get new callbacks */
+        if (!(Object->Flags & TP_OBJECT_RELEASED))
+        {
+            if (Object->Type == TpTimerObject)
+            {
+                TpSetTimer(CONTAINING_RECORD(Object, TP_TIMER, Object), NULL, 0, 0);
+            }
+            else if (Object->Type == TpWaitObject)
+            {
+                TpSetWait(CONTAINING_RECORD(Object, TP_WAIT, Object), NULL, NULL);
+            }
+        }
+
+        if (CancelPendingCallbacks)
+        {
+            TppCancelCallbacks(Object);
+            if (Object->CleanupGroupCancelCallback)
+            {
+                Object->CleanupGroupCancelCallback(Object->Context, CleanupParameter);
+            }
+        }
+
+        TppWaitForCallbacks(Object, FALSE);
+
+        if (!(Object->Flags & TP_OBJECT_RELEASED)) TppReleaseObject(Object);
+        TppDereferenceObject(Object);
+
+        /* Drop the reference the member had on the group */
+        TpReleaseCleanupGroup(CleanupGroup);
+    }
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackSetEventOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                               IN HANDLE Event)
+{
+    Instance->Event = Event;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseSemaphoreOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                       IN HANDLE Semaphore,
+                                       IN ULONG ReleaseCount)
+{
+    Instance->Semaphore = Semaphore;
+    Instance->SemaphoreReleaseCount = ReleaseCount;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseMutexOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                   IN HANDLE Mutex)
+{
+    Instance->Mutex = Mutex;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackLeaveCriticalSectionOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                           IN OUT PRTL_CRITICAL_SECTION CriticalSection)
+{
+    Instance->CriticalSection = CriticalSection;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackUnloadDllOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                IN PVOID DllHandle)
+{
+    Instance->Dll = DllHandle;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpCallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (Instance->MayRunLong) return STATUS_SUCCESS;
+
+    /* This worker stops counting against the target, make sure another one is around */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Instance->MayRunLong = TRUE;
+    Pool->LongThreads++;
+    if (!Pool->IdleThreads)
+    {
+        if (Pool->Threads < Pool->MaxThreads)
+            Status = TppStartWorker(Pool);
+        else
+            Status = STATUS_TOO_MANY_THREADS;
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpDisassociateCallback(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    /* Waiting for the object's callbacks no longer waits for this one */
+    if (!Instance->Associated) return;
+    Instance->Associated = FALSE;
+    TppFinishCallback(Instance->Object);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSimpleTryPost(IN PTP_SIMPLE_CALLBACK Callback,
+                IN OUT PVOID Context OPTIONAL,
+                IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTP_SIMPLE Simple;
+    NTSTATUS Status;
+
+    Status = TppAllocateObject(TpSimpleObject,
+                               sizeof(*Simple),
+                               Callback,
+                               Context,
+                               CallbackEnviron,
+                               (PVOID*)&Simple);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* The queued callback keeps it alive */
+    TppQueueCallback(&Simple->Object, 0);
+    TppReleaseObject(&Simple->Object);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWork(OUT PTP_WORK *WorkReturn,
+            IN PTP_WORK_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocateObject(TpWorkObject,
+                             sizeof(TP_WORK),
+                             Callback,
+                             Context,
+                             CallbackEnviron,
+                             (PVOID*)WorkReturn);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpPostWork(IN OUT PTP_WORK Work)
+{
+    TppQueueCallback(&Work->Object, 0);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWork(IN OUT PTP_WORK Work,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks(&Work->Object, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWork(IN OUT PTP_WORK Work)
+{
+    TppReleaseObject(&Work->Object);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocTimer(OUT PTP_TIMER *TimerReturn,
+             IN PTP_TIMER_CALLBACK Callback,
+             IN OUT PVOID Context OPTIONAL,
+             IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    NTSTATUS Status;
+
+    Status = TppAllocateObject(TpTimerObject,
+                               sizeof(TP_TIMER),
+                               Callback,
+                               Context,
+                               CallbackEnviron,
+                               (PVOID*)TimerReturn);
+    if (NT_SUCCESS(Status)) (*TimerReturn)->HeapIndex = -1;
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetTimer(IN OUT PTP_TIMER Timer,
+           IN PLARGE_INTEGER DueTime OPTIONAL,
+           IN ULONG Period,
+           IN ULONG WindowLength OPTIONAL)
+{
+    /* Timers always fire when they are due, so the window is never used */
+    UNREFERENCED_PARAMETER(WindowLength);
+
+    RtlEnterCriticalSection(&TppLock);
+
+    if (Timer->HeapIndex != -1) TppRemoveTimer(Timer);
+
+    if ((DueTime) && TppEnsureTimerThread())
+    {
+        Timer->DueTime = TppAbsoluteTime(DueTime);
+        Timer->Period = Period;
+        TppInsertTimer(Timer);
+
+        /* Let the timer thread know if this one is due first */
+        if (Timer->HeapIndex == 0) NtSetEvent(TppTimerEvent, NULL);
+    }
+
+    RtlLeaveCriticalSection(&TppLock);
+}
+
+/*
+ * @implemented
+ */
+BOOLEAN
+NTAPI
+TpIsTimerSet(IN PTP_TIMER Timer)
+{
+    return (Timer->HeapIndex != -1);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForTimer(IN OUT PTP_TIMER Timer,
+               IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks(&Timer->Object, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseTimer(IN OUT PTP_TIMER Timer)
+{
+    TpSetTimer(Timer, NULL, 0, 0);
+    TppReleaseObject(&Timer->Object);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWait(OUT PTP_WAIT *WaitReturn,
+            IN PTP_WAIT_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocateObject(TpWaitObject,
+                             sizeof(TP_WAIT),
+                             Callback,
+                             Context,
+                             CallbackEnviron,
+                             (PVOID*)WaitReturn);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetWait(IN OUT PTP_WAIT Wait,
+          IN HANDLE Handle OPTIONAL,
+          IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    NTSTATUS Status;
+
+    RtlEnterCriticalSection(&TppWaitLock);
+
+    TppRemoveWait(Wait, TRUE);
+
+    if (Handle)
+    {
+        Wait->Handle = Handle;
+        Wait->Timeout = Timeout ? TppAbsoluteTime(Timeout) : TP_INFINITE_TIMEOUT;
+
+        Status = TppInsertWait(Wait);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to set wait %p: 0x%lx\n", Wait, Status);
+        }
+    }
+
+    RtlLeaveCriticalSection(&TppWaitLock);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWait(IN OUT PTP_WAIT Wait,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks(&Wait->Object, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWait(IN OUT PTP_WAIT Wait)
+{
+    TpSetWait(Wait, NULL, NULL);
+    TppReleaseObject(&Wait->Object);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocIoCompletion(OUT PTP_IO *IoReturn,
+                    IN HANDLE File,
+                    IN PTP_IO_CALLBACK Callback,
+                    IN OUT PVOID Context OPTIONAL,
+                    IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    FILE_COMPLETION_INFORMATION CompletionInfo;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PTP_IO Io;
+    NTSTATUS Status;
+
+    Status = TppAllocateObject(TpIoObject,
+                               sizeof(TP_IO),
+                               Callback,
+                               Context,
+                               CallbackEnviron,
+                               (PVOID*)&Io);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Completions for the file come to the pool's port, with the object as the key */
+    CompletionInfo.Port = Io->Object.Pool->CompletionPort;
+    CompletionInfo.Key = Io;
+    Status = NtSetInformationFile(File,
+                                  &IoStatusBlock,
+                                  &CompletionInfo,
+                                  sizeof(CompletionInfo),
+                                  FileCompletionInformation);
+    if (!NT_SUCCESS(Status))
+    {
+        TppReleaseObject(&Io->Object);
+        return Status;
+    }
+
+    *IoReturn = Io;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpStartAsyncIoOperation(IN OUT PTP_IO Io)
+{
+    /* The completion packet holds a reference, like the ones we queue */
+    InterlockedIncrement(&Io->Object.ReferenceCount);
+    InterlockedIncrement(&Io->Object.Pending);
+    TppWakeWorkers(Io->Object.Pool);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCancelAsyncIoOperation(IN OUT PTP_IO Io)
+{
+    /* The operation failed right away, there won't be a completion */
+    TppTakePending(&Io->Object);
+    if (!(Io->Object.Pending) && !(Io->Object.Running)) TppWakeWaiters(&Io->Object);
+    TppDereferenceObject(&Io->Object);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForIoCompletion(IN OUT PTP_IO Io,
+                      IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks(&Io->Object, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseIoCompletion(IN OUT PTP_IO Io)
+{
+    TppReleaseObject(&Io->Object);
+}
+
+/* EOF */
@@ -303,6 +303,94 @@ FAT12FindAndMarkAvailableCluster(
     return STATUS_DISK_FULL;
 }
 
+/*
+ * FUNCTION: Takes a run of up to Count free clusters from the free cluster
+ *           bitmap, as close as possible after Hint, and chains them in the
+ *           FAT. The last one is marked as end of file.
+ */
+static
+NTSTATUS
+FAT32MarkClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG Hint,
+    ULONG Count,
+    PULONG FirstCluster,
+    PULONG RunLength)
+{
+    NTSTATUS Status;
+    ULONG Start, Length, Unused;
+    ULONG i, OldValue, Dummy;
+
+    ASSERT(DeviceExt->FreeClusterBitmapValid);
+
+    if (Hint < 2 || Hint >= DeviceExt->FatInfo.NumberOfClusters + 2)
+        Hint = 2;
+
+    for (;;)
+    {
+        /* Prefer the longest run, but take whatever is there */
+        Length = Count;
+        Start = RtlFindClearBitsAndSet(&DeviceExt->FreeClusterBitmap, Length, Hint);
+        while (Start == 0xffffffff && Length > 1)
+        {
+            Length /= 2;
+            Start = RtlFindClearBitsAndSet(&DeviceExt->FreeClusterBitmap, Length, Hint);
+        }
+
+        if (Start == 0xffffffff)
+            return STATUS_DISK_FULL;
+
+        for (i = Start; i < Start + Length; i++)
+        {
+            Status = FAT32WriteCluster(DeviceExt,
+                                       i,
+                                       (i == Start + Length - 1) ? 0x0fffffff : i + 1,
+                                       &OldValue);
+            if (!NT_SUCCESS(Status))
+                break;
+
+            if (OldValue != 0)
+            {
+                /* The bitmap is out of sync with the FAT, keep that cluster */
+                DPRINT1("Cluster 0x%x is in use, but marked free in the bitmap\n", i);
+                FAT32WriteCluster(DeviceExt, i, OldValue, &Dummy);
+                break;
+            }
+        }
+
+        if (i != Start + Length)
+        {
+            /* Give back what wasn't chained, a cluster found in use stays marked */
+            Unused = NT_SUCCESS(Status) ? i + 1 : i;
+            if (Unused < Start + Length)
+                RtlClearBits(&DeviceExt->FreeClusterBitmap, Unused, Start + Length - Unused);
+
+            Length = i - Start;
+            if (Length == 0)
+            {
+                if (!NT_SUCCESS(Status))
+                    return Status;
+
+                /* Look somewhere else */
+                continue;
+            }
+
+            /* Terminate the part that was chained */
+            FAT32WriteCluster(DeviceExt, i - 1, 0x0fffffff, &Dummy);
+        }
+
+        break;
+    }
+
+    DeviceExt->LastAvailableCluster = Start + Length - 1;
+    if (DeviceExt->AvailableClustersValid)
+        InterlockedExchangeAdd((PLONG)&DeviceExt->AvailableClusters, -(LONG)Length);
+
+    *FirstCluster = Start;
+    *RunLength = Length;
+    return STATUS_SUCCESS;
+}
+
 /*
  * FUNCTION: Finds the first available cluster in a FAT32 table
  */
@@ -320,6 +408,11 @@ FAT32FindAndMarkAvailableCluster(
     LARGE_INTEGER Offset;
     PULONG Block;
     PULONG BlockEnd;
+    ULONG RunLength;
+
+    /* Don't scan the FAT if we know where free clusters are */
+    if (DeviceExt->FreeClusterBitmapValid)
+        return FAT32MarkClusterRun(DeviceExt, DeviceExt->LastAvailableCluster, 1, Cluster, &RunLength);
 
     ChunkSize = CACHEPAGESIZE(DeviceExt);
     FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
@@ -356,6 +449,8 @@ FAT32FindAndMarkAvailableCluster(
                     CcUnpinData(Context);
                     if (DeviceExt->AvailableClustersValid)
                         InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
+                    if (i < DeviceExt->FreeClusterBitmapScanned)
+                        RtlSetBit(&DeviceExt->FreeClusterBitmap, i);
                     return STATUS_SUCCESS;
                 }
 
@@ -535,12 +630,159 @@ FAT32CountAvailableClusters(
     return STATUS_SUCCESS;
 }
 
+/*
+ * FUNCTION: Builds the free cluster bitmap of a FAT32 volume. It runs in a
+ *           worker thread and scans the FAT one chunk at a time, so that the
+ *           volume can be used meanwhile. Writers keep the part that has
+ *           already been scanned up to date.
+ */
+static
+VOID
+NTAPI
+FAT32BuildFreeClusterBitmap(
+    PVOID Parameter)
+{
+    PDEVICE_EXTENSION DeviceExt = Parameter;
+    PULONG Block;
+    PULONG BlockEnd;
+    PVOID BaseAddress = NULL;
+    ULONG i;
+    ULONG ChunkSize;
+    PVOID Context = NULL;
+    LARGE_INTEGER Offset;
+    ULONG FatLength;
+    BOOLEAN Failed = FALSE;
+
+    ChunkSize = CACHEPAGESIZE(DeviceExt);
+    FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
+
+    for (i = 2; i < FatLength && !DeviceExt->FreeClusterBitmapStop; )
+    {
+        ExAcquireResourceSharedLite(&DeviceExt->FatResource, TRUE);
+
+        Offset.QuadPart = ROUND_DOWN(i * 4, ChunkSize);
+        _SEH2_TRY
+        {
+            CcMapData(DeviceExt->FATFileObject, &Offset, ChunkSize, MAP_WAIT, &Context, &BaseAddress);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            DPRINT1("CcMapData(Offset %x, Length %u) failed\n", (ULONG)Offset.QuadPart, ChunkSize);
+            Failed = TRUE;
+        }
+        _SEH2_END;
+
+        if (Failed)
+        {
+            ExReleaseResourceLite(&DeviceExt->FatResource);
+            break;
+        }
+
+        Block = (PULONG)((ULONG_PTR)BaseAddress + (i * 4) % ChunkSize);
+        BlockEnd = (PULONG)((ULONG_PTR)BaseAddress + ChunkSize);
+
+        /* Now process the whole block */
+        while (Block < BlockEnd && i < FatLength)
+        {
+            if ((*Block & 0x0fffffff) != 0)
+                RtlSetBit(&DeviceExt->FreeClusterBitmap, i);
+            Block++;
+            i++;
+        }
+
+        CcUnpinData(Context);
+
+        DeviceExt->FreeClusterBitmapScanned = i;
+        ExReleaseResourceLite(&DeviceExt->FatResource);
+    }
+
+    if (i >= FatLength && !Failed)
+    {
+        ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+        DeviceExt->FreeClusterBitmapValid = TRUE;
+        DeviceExt->AvailableClusters = RtlNumberOfClearBits(&DeviceExt->FreeClusterBitmap);
+        DeviceExt->AvailableClustersValid = TRUE;
+        ExReleaseResourceLite(&DeviceExt->FatResource);
+
+        DPRINT("Free cluster bitmap built, %u free clusters\n", DeviceExt->AvailableClusters);
+    }
+
+    KeSetEvent(&DeviceExt->FreeClusterBitmapEvent, IO_NO_INCREMENT, FALSE);
+}
+
+/*
+ * FUNCTION: Starts building the free cluster bitmap of a freshly mounted
+ *           volume. Only FAT32 gets one, smaller FATs are cheap to scan.
+ */
+VOID
+StartFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    PULONG Buffer;
+    ULONG FatLength;
+
+    /* Nothing is building it */
+    KeInitializeEvent(&DeviceExt->FreeClusterBitmapEvent, NotificationEvent, TRUE);
+
+    /* Small FATs are quickly scanned */
+    if (DeviceExt->FatInfo.FatType != FAT32 && DeviceExt->FatInfo.FatType != FATX32)
+    {
+        CountAvailableClusters(DeviceExt, NULL);
+        return;
+    }
+
+    FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
+    Buffer = ExAllocatePoolWithTag(PagedPool, ROUND_UP(FatLength, 32) / 8, TAG_BITMAP);
+    if (Buffer == NULL)
+    {
+        /* We'll keep scanning the FAT */
+        DPRINT1("No memory for the free cluster bitmap of %u clusters\n", FatLength);
+        CountAvailableClusters(DeviceExt, NULL);
+        return;
+    }
+
+    RtlInitializeBitMap(&DeviceExt->FreeClusterBitmap, Buffer, FatLength);
+    RtlClearAllBits(&DeviceExt->FreeClusterBitmap);
+
+    /* Clusters 0 and 1 don't exist */
+    RtlSetBits(&DeviceExt->FreeClusterBitmap, 0, 2);
+    DeviceExt->FreeClusterBitmapScanned = 2;
+
+    KeClearEvent(&DeviceExt->FreeClusterBitmapEvent);
+    ExInitializeWorkItem(&DeviceExt->FreeClusterBitmapWorkItem, FAT32BuildFreeClusterBitmap, DeviceExt);
+    ExQueueWorkItem(&DeviceExt->FreeClusterBitmapWorkItem, DelayedWorkQueue);
+}
+
+/*
+ * FUNCTION: Stops building the free cluster bitmap and releases it
+ */
+VOID
+StopFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->FreeClusterBitmap.Buffer == NULL)
+        return;
+
+    DeviceExt->FreeClusterBitmapStop = TRUE;
+    KeWaitForSingleObject(&DeviceExt->FreeClusterBitmapEvent, Executive, KernelMode, FALSE, NULL);
+
+    DeviceExt->FreeClusterBitmapValid = FALSE;
+    DeviceExt->FreeClusterBitmapScanned = 0;
+    ExFreePoolWithTag(DeviceExt->FreeClusterBitmap.Buffer, TAG_BITMAP);
+    DeviceExt->FreeClusterBitmap.Buffer = NULL;
+}
+
 NTSTATUS
 CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
     PLARGE_INTEGER Clusters)
 {
     NTSTATUS Status = STATUS_SUCCESS;
+
+    /* The free cluster bitmap builder counts them as well, don't scan twice */
+    if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+        KeWaitForSingleObject(&DeviceExt->FreeClusterBitmapEvent, Executive, KernelMode, FALSE, NULL);
+
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     if (!DeviceExt->AvailableClustersValid)
     {
@@ -717,6 +959,14 @@ WriteCluster(
         else if (OldValue == 0 && NewValue)
             InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
     }
+    /* Keep the part of the free cluster bitmap which was already built in sync */
+    if (NT_SUCCESS(Status) && ClusterToWrite < DeviceExt->FreeClusterBitmapScanned)
+    {
+        if (NewValue == 0)
+            RtlClearBit(&DeviceExt->FreeClusterBitmap, ClusterToWrite);
+        else
+            RtlSetBit(&DeviceExt->FreeClusterBitmap, ClusterToWrite);
+    }
     ExReleaseResourceLite(&DeviceExt->FatResource);
     return Status;
 }
@@ -822,6 +1072,51 @@ GetNextClusterExtend(
     return Status;
 }
 
+/*
+ * FUNCTION: Appends Count clusters to the chain ending with LastCluster. With
+ *           a free cluster bitmap they are taken in runs, as long as possible
+ *           and right after LastCluster, so that files stay contiguous.
+ */
+NTSTATUS
+ExtendClusterChain(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG Count,
+    PULONG NewLastCluster)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG NewCluster;
+    ULONG Length;
+
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+
+    while (Count > 0)
+    {
+        if (DeviceExt->FreeClusterBitmapValid)
+        {
+            Status = FAT32MarkClusterRun(DeviceExt, LastCluster + 1, Count, &NewCluster, &Length);
+        }
+        else
+        {
+            Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+            Length = 1;
+        }
+
+        if (!NT_SUCCESS(Status))
+            break;
+
+        /* Link the new clusters to the chain */
+        WriteCluster(DeviceExt, LastCluster, NewCluster);
+        LastCluster = NewCluster + Length - 1;
+        Count -= Length;
+    }
+
+    ExReleaseResourceLite(&DeviceExt->FatResource);
+
+    *NewLastCluster = LastCluster;
+    return Status;
+}
+
 /*
  * FUNCTION: Retrieve the dirty status
  */
@@ -733,7 +733,6 @@ VfatMount(
     _SEH2_END;
 
     DeviceExt->LastAvailableCluster = 2;
-    CountAvailableClusters(DeviceExt, NULL);
     ExInitializeResourceLite(&DeviceExt->FatResource);
 
     InitializeListHead(&DeviceExt->FcbListHead);
@@ -792,6 +791,9 @@ VfatMount(
     InitializeListHead(&DeviceExt->NotifyList);
     FsRtlNotifyInitializeSync(&DeviceExt->NotifySync);
 
+    /* Count the free clusters, in the background for FAT32 */
+    StartFreeClusterBitmap(DeviceExt);
+
     /* The VCB is OK for usage */
     SetFlag(DeviceExt->Flags, VCB_GOOD);
 
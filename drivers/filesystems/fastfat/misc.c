@@ -514,6 +514,9 @@ VfatCheckForDismount(
         /* We are uninitializing, the VCB cannot be used anymore */
         ClearFlag(DeviceExt->Flags, VCB_GOOD);
 
+        /* The bitmap builder reads the FAT, stop it first */
+        StopFreeClusterBitmap(DeviceExt);
+
         /* Invalidate and close the internal opened meta-files */
         if (DeviceExt->RootFcb)
         {
@@ -65,7 +65,8 @@ OffsetToCluster(
     PULONG Cluster,
     BOOLEAN Extend)
 {
-    ULONG CurrentCluster;
+    ULONG CurrentCluster, NextCluster;
+    ULONG Clusters;
     ULONG i;
     NTSTATUS Status;
 /*
@@ -91,11 +92,23 @@ OffsetToCluster(
         CurrentCluster = FirstCluster;
         if (Extend)
         {
-            for (i = 0; i < FileOffset / DeviceExt->FatInfo.BytesPerCluster; i++)
+            Clusters = FileOffset / DeviceExt->FatInfo.BytesPerCluster;
+            for (i = 0; i < Clusters; i++)
             {
-                Status = GetNextClusterExtend (DeviceExt, CurrentCluster, &CurrentCluster);
+                Status = GetNextCluster (DeviceExt, CurrentCluster, &NextCluster);
                 if (!NT_SUCCESS(Status))
                     return Status;
+
+                if (NextCluster == 0xffffffff)
+                {
+                    /* End of the chain, allocate all the missing clusters at once */
+                    Status = ExtendClusterChain(DeviceExt, CurrentCluster, Clusters - i, &CurrentCluster);
+                    if (!NT_SUCCESS(Status))
+                        return Status;
+                    break;
+                }
+
+                CurrentCluster = NextCluster;
             }
             *Cluster = CurrentCluster;
         }
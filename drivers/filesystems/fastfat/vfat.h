@@ -325,6 +325,15 @@ typedef struct DEVICE_EXTENSION
     ULONG LastAvailableCluster;
     ULONG AvailableClusters;
     BOOLEAN AvailableClustersValid;
+
+    /* FAT32 only: one bit per cluster, set when in use. It is built in the
+     * background, up to FreeClusterBitmapScanned, and usable once valid */
+    RTL_BITMAP FreeClusterBitmap;
+    ULONG FreeClusterBitmapScanned;
+    BOOLEAN FreeClusterBitmapValid;
+    BOOLEAN FreeClusterBitmapStop;
+    WORK_QUEUE_ITEM FreeClusterBitmapWorkItem;
+    KEVENT FreeClusterBitmapEvent;
     ULONG Flags;
     struct _VFATFCB *VolumeFcb;
     struct _VFATFCB *RootFcb;
@@ -547,6 +556,7 @@ typedef struct _VFATCCB
 #define TAG_NAME 'ntaF'
 #define TAG_SEARCH 'LtaF'
 #define TAG_DIRENT 'DtaF'
+#define TAG_BITMAP 'BtaF'
 
 #define ENTRIES_PER_SECTOR (BLOCKSIZE / sizeof(FATDirEntry))
 
@@ -926,6 +936,21 @@ WriteCluster(
     ULONG ClusterToWrite,
     ULONG NewValue);
 
+NTSTATUS
+ExtendClusterChain(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG Count,
+    PULONG NewLastCluster);
+
+VOID
+StartFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt);
+
+VOID
+StopFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt);
+
 NTSTATUS
 GetDirtyStatus(
     PDEVICE_EXTENSION DeviceExt,
@@ -191,7 +191,7 @@ AllocateIndexNode(PDEVICE_EXTENSION DeviceExt,
     Status = ReadAttribute(DeviceExt, BitmapCtx, 0, (PCHAR)BitmapPtr, BitmapLength);
 
     // Initialize bitmap
-    RtlInitializeBitMap(&Bitmap, BitmapPtr, NextNodeNumber);
+    RtlInitializeBitMap(&Bitmap, BitmapPtr, NextNodeNumber + 1);
 
     // Do we need to enlarge the bitmap?
     if (BytesNeeded > BitmapLength)
@@ -416,9 +416,6 @@ CreateEmptyBTree(PB_TREE *NewTree)
 LONG
 CompareTreeKeys(PB_TREE_KEY Key1, PB_TREE_KEY Key2, BOOLEAN CaseSensitive)
 {
-    UNICODE_STRING Key1Name, Key2Name;
-    LONG Comparison;
-
     // Key1 must not be the final key (AKA the dummy key)
     ASSERT(!(Key1->IndexEntry->Flags & NTFS_INDEX_ENTRY_END));
 
@@ -426,13 +423,42 @@ CompareTreeKeys(PB_TREE_KEY Key1, PB_TREE_KEY Key2, BOOLEAN CaseSensitive)
     if (Key2->NextKey == NULL)
         return -1;
 
-    Key1Name.Buffer = Key1->IndexEntry->FileName.Name;
+    return CompareIndexEntryNames(Key1->IndexEntry, Key2->IndexEntry, CaseSensitive);
+}
+
+/**
+* @name CompareIndexEntryNames
+* @implemented
+*
+* Compare the filenames of two index entries to determine their order in an index.
+*
+* @param Entry1
+* Pointer to an INDEX_ENTRY_ATTRIBUTE that will be compared. Must not be the final (dummy) entry of a node.
+*
+* @param Entry2
+* Pointer to the other INDEX_ENTRY_ATTRIBUTE that will be compared. Must not be the final (dummy) entry of a node.
+*
+* @param CaseSensitive
+* Boolean indicating if the function should operate in case-sensitive mode.
+*
+* @returns
+* 0 if the two names are equal.
+* < 0 if Entry1 sorts before Entry2
+* > 0 if Entry1 sorts after Entry2
+*/
+LONG
+CompareIndexEntryNames(PINDEX_ENTRY_ATTRIBUTE Entry1, PINDEX_ENTRY_ATTRIBUTE Entry2, BOOLEAN CaseSensitive)
+{
+    UNICODE_STRING Key1Name, Key2Name;
+    LONG Comparison;
+
+    Key1Name.Buffer = Entry1->FileName.Name;
     Key1Name.Length = Key1Name.MaximumLength
-        = Key1->IndexEntry->FileName.NameLength * sizeof(WCHAR);
+        = Entry1->FileName.NameLength * sizeof(WCHAR);
 
-    Key2Name.Buffer = Key2->IndexEntry->FileName.Name;
+    Key2Name.Buffer = Entry2->FileName.Name;
     Key2Name.Length = Key2Name.MaximumLength
-        = Key2->IndexEntry->FileName.NameLength * sizeof(WCHAR);
+        = Entry2->FileName.NameLength * sizeof(WCHAR);
 
     // Are the two keys the same length?
     if (Key1Name.Length == Key2Name.Length)
@@ -2028,3 +2054,816 @@ SplitBTreeNode(PB_TREE Tree,
 
     return STATUS_SUCCESS;
 }
+
+// Deepest index we'll walk without rebuilding the tree; real directories are a handful of levels deep
+#define NTFS_MAX_INDEX_DEPTH 16
+
+// Stand-in VCN for the right-hand sibling of a node split at Level, until AllocateIndexNode() assigns the real one
+#define NTFS_SPLIT_PLACEHOLDER_VCN(Level) (~0ULL - (Level))
+
+typedef struct
+{
+    PINDEX_BUFFER Buffer;       // The node we went through, fixed up
+    PINDEX_BUFFER NewBuffer;    // Right-hand sibling, if the node was split
+    ULONGLONG NewVCN;
+    ULONG EntryOffset;          // Offset, relative to Buffer->Header, of the entry we went through
+    BOOLEAN Dirty;
+} INDEX_PATH_NODE, *PINDEX_PATH_NODE;
+
+static
+NTSTATUS
+FindIndexEntryPosition(PINDEX_HEADER_ATTRIBUTE Header,
+                       PINDEX_ENTRY_ATTRIBUTE NewEntry,
+                       BOOLEAN CaseSensitive,
+                       PULONG EntryOffset)
+{
+    ULONG Offset = Header->FirstEntryOffset;
+
+    while (Offset + FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName) <= Header->TotalSizeOfEntries)
+    {
+        PINDEX_ENTRY_ATTRIBUTE CurrentEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)Header + Offset);
+        LONG Comparison;
+
+        if (CurrentEntry->Length == 0 || Offset + CurrentEntry->Length > Header->TotalSizeOfEntries)
+            break;
+
+        // The new entry goes before the first entry that sorts after it, or before the end marker
+        if (CurrentEntry->Flags & NTFS_INDEX_ENTRY_END)
+        {
+            *EntryOffset = Offset;
+            return STATUS_SUCCESS;
+        }
+
+        Comparison = CompareIndexEntryNames(NewEntry, CurrentEntry, CaseSensitive);
+        if (Comparison == 0)
+        {
+            DPRINT1("ERROR: %.*S is already in the index!\n", NewEntry->FileName.NameLength, NewEntry->FileName.Name);
+            return STATUS_OBJECT_NAME_COLLISION;
+        }
+
+        if (Comparison < 0)
+        {
+            *EntryOffset = Offset;
+            return STATUS_SUCCESS;
+        }
+
+        Offset += CurrentEntry->Length;
+    }
+
+    DPRINT1("ERROR: Index node has no end marker!\n");
+    return STATUS_FILE_CORRUPT_ERROR;
+}
+
+static
+VOID
+InsertEntryIntoIndexBuffer(PINDEX_HEADER_ATTRIBUTE Header,
+                           ULONG EntryOffset,
+                           PINDEX_ENTRY_ATTRIBUTE NewEntry)
+{
+    PUCHAR Destination = (PUCHAR)Header + EntryOffset;
+
+    ASSERT(Header->TotalSizeOfEntries + NewEntry->Length <= Header->AllocatedSize);
+
+    // Make room for the new entry, then copy it in
+    RtlMoveMemory(Destination + NewEntry->Length,
+                  Destination,
+                  Header->TotalSizeOfEntries - EntryOffset);
+    RtlCopyMemory(Destination, NewEntry, NewEntry->Length);
+
+    Header->TotalSizeOfEntries += NewEntry->Length;
+}
+
+/**
+* @name SplitIndexBuffer
+* @implemented
+*
+* Inserts an index entry into an index record that has no room left for it, by splitting the record in two.
+* Works the same way SplitBTreeNode() does: the original record keeps the entries before the median, a new
+* right-hand sibling receives the entries after it, and the median is handed back so the caller can insert it
+* into the parent, where it will point to the original record.
+*
+* @param Node
+* Pointer to the INDEX_PATH_NODE describing the record being split. Receives the new right-hand sibling.
+*
+* @param Level
+* Depth of the record being split, used to tag the right-hand sibling until it's allocated.
+*
+* @param IndexBufferSize
+* Size of an index record for this index, in bytes.
+*
+* @param EntryOffset
+* Offset, relative to the index header, where NewEntry must be inserted to keep the record sorted.
+*
+* @param NewEntry
+* Pointer to the INDEX_ENTRY_ATTRIBUTE being inserted.
+*
+* @param MedianEntry
+* Pointer to a PINDEX_ENTRY_ATTRIBUTE that will receive the median entry, which the caller must free.
+*
+* @return
+* STATUS_SUCCESS on success.
+* STATUS_INSUFFICIENT_RESOURCES if an allocation fails.
+* STATUS_FILE_CORRUPT_ERROR if the record's entries can't be split.
+*/
+static
+NTSTATUS
+SplitIndexBuffer(PINDEX_PATH_NODE Node,
+                 ULONG Level,
+                 ULONG IndexBufferSize,
+                 ULONG EntryOffset,
+                 PINDEX_ENTRY_ATTRIBUTE NewEntry,
+                 PINDEX_ENTRY_ATTRIBUTE *MedianEntry)
+{
+    PINDEX_HEADER_ATTRIBUTE Header = &Node->Buffer->Header;
+    PINDEX_HEADER_ATTRIBUTE NewHeader;
+    PINDEX_ENTRY_ATTRIBUTE CurrentEntry, Median, EndEntry;
+    PUCHAR Entries;
+    ULONG EntriesSize, LeftSize, HalfSize;
+    ULONG EndEntrySize = ALIGN_UP_BY(FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName), 8);
+    BOOLEAN MedianHasChild;
+
+    // Lay out all the entries, including the new one, in order
+    EntriesSize = Header->TotalSizeOfEntries - Header->FirstEntryOffset + NewEntry->Length;
+    Entries = ExAllocatePoolWithTag(NonPagedPool, EntriesSize, TAG_NTFS);
+    if (!Entries)
+    {
+        DPRINT1("ERROR: Couldn't allocate memory to split index record!\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlCopyMemory(Entries,
+                  (PUCHAR)Header + Header->FirstEntryOffset,
+                  EntryOffset - Header->FirstEntryOffset);
+    RtlCopyMemory(Entries + EntryOffset - Header->FirstEntryOffset,
+                  NewEntry,
+                  NewEntry->Length);
+    RtlCopyMemory(Entries + EntryOffset - Header->FirstEntryOffset + NewEntry->Length,
+                  (PUCHAR)Header + EntryOffset,
+                  Header->TotalSizeOfEntries - EntryOffset);
+
+    // Use size to locate the median entry, the same way SplitBTreeNode() does
+    HalfSize = (Header->AllocatedSize - Header->FirstEntryOffset) / 2;
+    LeftSize = 0;
+    CurrentEntry = (PINDEX_ENTRY_ATTRIBUTE)Entries;
+    while (!(CurrentEntry->Flags & NTFS_INDEX_ENTRY_END) &&
+           CurrentEntry->Length != 0 &&
+           LeftSize + CurrentEntry->Length <= HalfSize)
+    {
+        LeftSize += CurrentEntry->Length;
+        CurrentEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)CurrentEntry + CurrentEntry->Length);
+    }
+    if ((CurrentEntry->Flags & NTFS_INDEX_ENTRY_END) || CurrentEntry->Length == 0)
+    {
+        DPRINT1("ERROR: Couldn't find a median in index record %I64u!\n", Node->Buffer->VCN);
+        ExFreePoolWithTag(Entries, TAG_NTFS);
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+    MedianHasChild = BooleanFlagOn(CurrentEntry->Flags, NTFS_INDEX_ENTRY_NODE);
+
+    // The median will have a child node: the original record
+    Median = ExAllocatePoolWithTag(NonPagedPool,
+                                   CurrentEntry->Length + (MedianHasChild ? 0 : sizeof(ULONGLONG)),
+                                   TAG_NTFS);
+    Node->NewBuffer = ExAllocatePoolWithTag(NonPagedPool, IndexBufferSize, TAG_NTFS);
+    if (!Median || !Node->NewBuffer)
+    {
+        DPRINT1("ERROR: Couldn't allocate memory to split index record!\n");
+        if (Median)
+            ExFreePoolWithTag(Median, TAG_NTFS);
+        if (Node->NewBuffer)
+            ExFreePoolWithTag(Node->NewBuffer, TAG_NTFS);
+        Node->NewBuffer = NULL;
+        ExFreePoolWithTag(Entries, TAG_NTFS);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlCopyMemory(Median, CurrentEntry, CurrentEntry->Length);
+    if (!MedianHasChild)
+    {
+        Median->Length += sizeof(ULONGLONG);
+        Median->Flags |= NTFS_INDEX_ENTRY_NODE;
+    }
+    SetIndexEntryVCN(Median, Node->Buffer->VCN);
+
+    // Everything to the right of the median goes to the right-hand sibling, which shares the record's layout
+    RtlZeroMemory(Node->NewBuffer, IndexBufferSize);
+    RtlCopyMemory(&Node->NewBuffer->Ntfs, &Node->Buffer->Ntfs, sizeof(NTFS_RECORD_HEADER));
+    Node->NewBuffer->VCN = NTFS_SPLIT_PLACEHOLDER_VCN(Level);
+    Node->NewBuffer->Header = *Header;
+    Node->NewVCN = Node->NewBuffer->VCN;
+
+    NewHeader = &Node->NewBuffer->Header;
+    NewHeader->TotalSizeOfEntries = NewHeader->FirstEntryOffset
+                                    + EntriesSize - LeftSize - CurrentEntry->Length;
+    RtlCopyMemory((PUCHAR)NewHeader + NewHeader->FirstEntryOffset,
+                  (PUCHAR)CurrentEntry + CurrentEntry->Length,
+                  EntriesSize - LeftSize - CurrentEntry->Length);
+
+    // The original record keeps everything to the left of the median, followed by an end marker
+    // which inherits the median's child, if it had one
+    RtlCopyMemory((PUCHAR)Header + Header->FirstEntryOffset, Entries, LeftSize);
+    Header->TotalSizeOfEntries = Header->FirstEntryOffset + LeftSize;
+
+    EndEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)Header + Header->TotalSizeOfEntries);
+    RtlZeroMemory(EndEntry, EndEntrySize + sizeof(ULONGLONG));
+    EndEntry->Flags = NTFS_INDEX_ENTRY_END;
+    EndEntry->Length = EndEntrySize;
+    if (MedianHasChild)
+    {
+        EndEntry->Flags |= NTFS_INDEX_ENTRY_NODE;
+        EndEntry->Length += sizeof(ULONGLONG);
+        SetIndexEntryVCN(EndEntry, GetIndexEntryVCN(CurrentEntry));
+    }
+    Header->TotalSizeOfEntries += EndEntry->Length;
+
+    // Clear what's left of the old entries
+    RtlZeroMemory((PUCHAR)Header + Header->TotalSizeOfEntries,
+                  Header->AllocatedSize - Header->TotalSizeOfEntries);
+
+    DPRINT("Split index record %I64u at %.*S\n", Node->Buffer->VCN, Median->FileName.NameLength, Median->FileName.Name);
+
+    ExFreePoolWithTag(Entries, TAG_NTFS);
+
+    *MedianEntry = Median;
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+ReplaceSplitPlaceholderVCNs(PINDEX_BUFFER IndexBuffer,
+                            PINDEX_PATH_NODE Path,
+                            ULONG Depth)
+{
+    PINDEX_HEADER_ATTRIBUTE Header = &IndexBuffer->Header;
+    ULONG Offset = Header->FirstEntryOffset;
+    ULONG Level;
+
+    while (Offset < Header->TotalSizeOfEntries)
+    {
+        PINDEX_ENTRY_ATTRIBUTE CurrentEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)Header + Offset);
+
+        if (CurrentEntry->Length == 0)
+            break;
+
+        if (CurrentEntry->Flags & NTFS_INDEX_ENTRY_NODE)
+        {
+            for (Level = 0; Level < Depth; Level++)
+            {
+                if (Path[Level].NewBuffer && GetIndexEntryVCN(CurrentEntry) == NTFS_SPLIT_PLACEHOLDER_VCN(Level))
+                {
+                    SetIndexEntryVCN(CurrentEntry, Path[Level].NewVCN);
+                    break;
+                }
+            }
+        }
+
+        Offset += CurrentEntry->Length;
+    }
+}
+
+static
+NTSTATUS
+WriteIndexBuffer(PDEVICE_EXTENSION DeviceExt,
+                 PFILE_RECORD_HEADER FileRecord,
+                 PNTFS_ATTR_CONTEXT IndexAllocationContext,
+                 PINDEX_BUFFER IndexBuffer,
+                 ULONG IndexBufferSize)
+{
+    ULONGLONG NodeOffset;
+    ULONG LengthWritten;
+    NTSTATUS Status;
+
+    Status = AddFixupArray(DeviceExt, &IndexBuffer->Ntfs);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    NodeOffset = GetAllocationOffsetFromVCN(DeviceExt, IndexBufferSize, IndexBuffer->VCN);
+
+    Status = WriteAttribute(DeviceExt,
+                            IndexAllocationContext,
+                            NodeOffset,
+                            (const PUCHAR)IndexBuffer,
+                            IndexBufferSize,
+                            &LengthWritten,
+                            FileRecord);
+    if (NT_SUCCESS(Status) && LengthWritten != IndexBufferSize)
+        Status = STATUS_END_OF_FILE;
+
+    return Status;
+}
+
+/**
+* @name DemoteIndexRoot
+* @implemented
+*
+* Works out the index record that takes over the entries of the index root when the top index record is split,
+* the same way DemoteBTreeRoot() does it for a B_TREE. The new record receives all the entries of the root,
+* plus the median of the split, and becomes the top of the tree; the root is left with a single end entry
+* pointing to it, see WriteDemotedIndexRoot(). The index gets one level deeper.
+*
+* @param IndexRoot
+* Pointer to the $I30 INDEX_ROOT_ATTRIBUTE of the directory. It isn't modified.
+*
+* @param RootEntryOffset
+* Offset, relative to the root's index header, of the entry that points to the record that was split.
+*
+* @param Child
+* Pointer to the INDEX_PATH_NODE of the record that was split.
+*
+* @param IndexBufferSize
+* Size of an index record for this index, in bytes.
+*
+* @param MedianEntry
+* Pointer to the median entry handed back by SplitIndexBuffer().
+*
+* @param NewBuffer
+* Pointer to a PINDEX_BUFFER that will receive the new index record, which the caller must free.
+*
+* @return
+* STATUS_SUCCESS on success.
+* STATUS_INSUFFICIENT_RESOURCES if an allocation fails.
+* STATUS_NOT_IMPLEMENTED if the entries of the root don't fit in an index record.
+*/
+static
+NTSTATUS
+DemoteIndexRoot(PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                ULONG RootEntryOffset,
+                PINDEX_PATH_NODE Child,
+                ULONG IndexBufferSize,
+                PINDEX_ENTRY_ATTRIBUTE MedianEntry,
+                PINDEX_BUFFER *NewBuffer)
+{
+    PINDEX_HEADER_ATTRIBUTE RootHeader = &IndexRoot->Header;
+    PINDEX_HEADER_ATTRIBUTE Header;
+    PINDEX_BUFFER Buffer;
+    ULONG EntriesSize = RootHeader->TotalSizeOfEntries - RootHeader->FirstEntryOffset;
+    ULONG EntryOffset;
+
+    // Only a root filling a file record as large as an index record can get here
+    if (Child->Buffer->Header.FirstEntryOffset + EntriesSize + MedianEntry->Length > Child->Buffer->Header.AllocatedSize)
+    {
+        DPRINT1("Index root is too large to be moved into an index record\n");
+        return STATUS_NOT_IMPLEMENTED;
+    }
+
+    Buffer = ExAllocatePoolWithTag(NonPagedPool, IndexBufferSize, TAG_NTFS);
+    if (!Buffer)
+    {
+        DPRINT1("ERROR: Couldn't allocate memory for index record!\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // The new record shares the layout of the record that was split
+    RtlZeroMemory(Buffer, IndexBufferSize);
+    RtlCopyMemory(&Buffer->Ntfs, &Child->Buffer->Ntfs, sizeof(NTFS_RECORD_HEADER));
+    Buffer->Header = Child->Buffer->Header;
+    Buffer->Header.Flags = INDEX_NODE_LARGE;
+
+    Header = &Buffer->Header;
+    RtlCopyMemory((PUCHAR)Header + Header->FirstEntryOffset,
+                  (PUCHAR)RootHeader + RootHeader->FirstEntryOffset,
+                  EntriesSize);
+    Header->TotalSizeOfEntries = Header->FirstEntryOffset + EntriesSize;
+
+    // As in any other parent, the entry that pointed to the split record now points to its right-hand sibling,
+    // and the median is inserted right before it
+    EntryOffset = RootEntryOffset - RootHeader->FirstEntryOffset + Header->FirstEntryOffset;
+    SetIndexEntryVCN((PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)Header + EntryOffset), Child->NewVCN);
+    InsertEntryIntoIndexBuffer(Header, EntryOffset, MedianEntry);
+
+    *NewBuffer = Buffer;
+    return STATUS_SUCCESS;
+}
+
+/**
+* @name WriteDemotedIndexRoot
+* @implemented
+*
+* Leaves the index root with a single end entry pointing to the index record that took over its entries,
+* shrinks the $INDEX_ROOT attribute to match and writes it back.
+*
+* @param DeviceExt
+* Points to the target disk's DEVICE_EXTENSION.
+*
+* @param FileRecord
+* Pointer to a copy of the file record of the directory.
+*
+* @param IndexRoot
+* Pointer to the $I30 INDEX_ROOT_ATTRIBUTE of the directory, which is rewritten in place.
+*
+* @param VCN
+* VCN of the index record created by DemoteIndexRoot(), which must already be on the disk.
+*
+* @return
+* STATUS_SUCCESS on success, or the error of the first operation that failed.
+*/
+static
+NTSTATUS
+WriteDemotedIndexRoot(PDEVICE_EXTENSION DeviceExt,
+                      PFILE_RECORD_HEADER FileRecord,
+                      PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                      ULONGLONG VCN)
+{
+    PNTFS_ATTR_CONTEXT IndexRootContext;
+    ULONG IndexRootOffset;
+    PINDEX_ENTRY_ATTRIBUTE EndEntry;
+    ULONG EndEntrySize = ALIGN_UP_BY(FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName), 8) + sizeof(ULONGLONG);
+    ULONG AttributeLength, LengthWritten;
+    NTSTATUS Status;
+
+    Status = FindAttribute(DeviceExt,
+                           FileRecord,
+                           AttributeIndexRoot,
+                           L"$I30",
+                           4,
+                           &IndexRootContext,
+                           &IndexRootOffset);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("ERROR: Couldn't find $I30 $INDEX_ROOT attribute!\n");
+        return Status;
+    }
+
+    // The root always had an entry pointing to a sub-node, so the end entry fits where its entries were
+    EndEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&IndexRoot->Header + IndexRoot->Header.FirstEntryOffset);
+    RtlZeroMemory(EndEntry, EndEntrySize);
+    EndEntry->Flags = NTFS_INDEX_ENTRY_END | NTFS_INDEX_ENTRY_NODE;
+    EndEntry->Length = EndEntrySize;
+    SetIndexEntryVCN(EndEntry, VCN);
+
+    IndexRoot->Header.Flags = INDEX_ROOT_LARGE;
+    IndexRoot->Header.TotalSizeOfEntries = IndexRoot->Header.FirstEntryOffset + EndEntrySize;
+    IndexRoot->Header.AllocatedSize = IndexRoot->Header.TotalSizeOfEntries;
+
+    // $INDEX_ROOT must always be resident, so it's resized the same way NtfsAddFilenameToDirectory() does it
+    AttributeLength = IndexRoot->Header.AllocatedSize + FIELD_OFFSET(INDEX_ROOT_ATTRIBUTE, Header);
+    if (AttributeLength != IndexRootContext->pRecord->Resident.ValueLength)
+    {
+        Status = InternalSetResidentAttributeLength(DeviceExt,
+                                                    IndexRootContext,
+                                                    FileRecord,
+                                                    IndexRootOffset,
+                                                    AttributeLength);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("ERROR: Unable to set length of index root!\n");
+            ReleaseAttributeContext(IndexRootContext);
+            return Status;
+        }
+    }
+
+    Status = UpdateFileRecord(DeviceExt, IndexRootContext->FileMFTIndex, FileRecord);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("ERROR: Failed to update file record of directory with index: %I64u\n", IndexRootContext->FileMFTIndex);
+        ReleaseAttributeContext(IndexRootContext);
+        return Status;
+    }
+
+    Status = WriteAttribute(DeviceExt,
+                            IndexRootContext,
+                            0,
+                            (PUCHAR)IndexRoot,
+                            AttributeLength,
+                            &LengthWritten,
+                            FileRecord);
+    if (NT_SUCCESS(Status) && LengthWritten != AttributeLength)
+        Status = STATUS_END_OF_FILE;
+
+    ReleaseAttributeContext(IndexRootContext);
+    return Status;
+}
+
+/**
+* @name NtfsInsertIndexEntry
+* @implemented
+*
+* Inserts a FILENAME_ATTRIBUTE into a directory index in place, without converting the index to a B_TREE.
+* Only the index records along the path from the root to the new entry are read, and only the records that
+* change are written back.
+*
+* @param DeviceExt
+* Points to the target disk's DEVICE_EXTENSION.
+*
+* @param FileRecord
+* Pointer to a copy of the file record of the directory. Updated if an index record has to be allocated.
+*
+* @param IndexRoot
+* Pointer to the $I30 INDEX_ROOT_ATTRIBUTE of the directory. Rewritten in place if the root has to be demoted.
+*
+* @param FileReference
+* Reference number to the file being added. This will be a combination of the MFT index and update sequence number.
+*
+* @param FileNameAttribute
+* Pointer to the FILENAME_ATTRIBUTE of the file being added to the directory.
+*
+* @param CaseSensitive
+* Boolean indicating if the function should operate in case-sensitive mode. This will be TRUE
+* if an application created the file with the FILE_FLAG_POSIX_SEMANTICS flag.
+*
+* @return
+* STATUS_SUCCESS on success.
+* STATUS_NOT_IMPLEMENTED if the index can't be updated in place, e.g. because the index is still small and lives
+* entirely in the index root. Nothing has been written to the disk in that case, and the caller should fall back
+* to rebuilding the index with CreateBTreeFromIndex().
+* STATUS_OBJECT_NAME_COLLISION if the name is already in the index.
+* STATUS_INSUFFICIENT_RESOURCES if an allocation fails.
+*
+* @remarks
+* Index records that grow too large are split like SplitBTreeNode() would do it. When the top index record is
+* split, the index root is demoted with DemoteIndexRoot() instead of growing in the file record. New index records
+* are only allocated once the whole insertion has been worked out in memory.
+*/
+NTSTATUS
+NtfsInsertIndexEntry(PDEVICE_EXTENSION DeviceExt,
+                     PFILE_RECORD_HEADER FileRecord,
+                     PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                     ULONGLONG FileReference,
+                     PFILENAME_ATTRIBUTE FileNameAttribute,
+                     BOOLEAN CaseSensitive)
+{
+    INDEX_PATH_NODE Path[NTFS_MAX_INDEX_DEPTH];
+    PNTFS_ATTR_CONTEXT IndexAllocationContext;
+    ULONG IndexAllocationOffset;
+    ULONG IndexBufferSize = IndexRoot->SizeOfEntry;
+    PINDEX_ENTRY_ATTRIBUTE NewEntry, CurrentEntry;
+    ULONG AttributeSize, EntrySize;
+    ULONG EntryOffset, RootEntryOffset;
+    PINDEX_BUFFER RootBuffer = NULL;
+    ULONG Depth, Level;
+    ULONGLONG VCN;
+    NTSTATUS Status;
+
+    DPRINT("NtfsInsertIndexEntry(%p, %p, %p, 0x%I64x, %p, %s)\n",
+           DeviceExt,
+           FileRecord,
+           IndexRoot,
+           FileReference,
+           FileNameAttribute,
+           CaseSensitive ? "TRUE" : "FALSE");
+
+    // Small indices live entirely in the file record
+    if (!(IndexRoot->Header.Flags & INDEX_ROOT_LARGE))
+        return STATUS_NOT_IMPLEMENTED;
+
+    Status = FindAttribute(DeviceExt,
+                           FileRecord,
+                           AttributeIndexAllocation,
+                           L"$I30",
+                           4,
+                           &IndexAllocationContext,
+                           &IndexAllocationOffset);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("ERROR: Couldn't find index allocation attribute even though there should be one!\n");
+        return STATUS_NOT_IMPLEMENTED;
+    }
+
+    // Create the index entry for the file
+    AttributeSize = GetFileNameAttributeLength(FileNameAttribute);
+    EntrySize = ALIGN_UP_BY(AttributeSize + FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName), 8);
+    NewEntry = ExAllocatePoolWithTag(NonPagedPool, EntrySize, TAG_NTFS);
+    if (!NewEntry)
+    {
+        DPRINT1("ERROR: Failed to allocate memory for Index Entry!\n");
+        ReleaseAttributeContext(IndexAllocationContext);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(NewEntry, EntrySize);
+    NewEntry->Data.Directory.IndexedFile = FileReference;
+    NewEntry->Length = EntrySize;
+    NewEntry->KeyLength = AttributeSize;
+    RtlCopyMemory(&NewEntry->FileName, FileNameAttribute, AttributeSize);
+
+    RtlZeroMemory(Path, sizeof(Path));
+    Depth = 0;
+
+    // Find the entry of the root we need to go through
+    Status = FindIndexEntryPosition(&IndexRoot->Header, NewEntry, CaseSensitive, &EntryOffset);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+    RootEntryOffset = EntryOffset;
+    CurrentEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&IndexRoot->Header + EntryOffset);
+
+    // Walk down to the leaf the new entry belongs in, reading only the index records along the way
+    while (CurrentEntry->Flags & NTFS_INDEX_ENTRY_NODE)
+    {
+        ULONG BytesRead;
+
+        if (Depth == NTFS_MAX_INDEX_DEPTH)
+        {
+            DPRINT1("Index is more than %u levels deep\n", NTFS_MAX_INDEX_DEPTH);
+            Status = STATUS_NOT_IMPLEMENTED;
+            goto Cleanup;
+        }
+
+        VCN = GetIndexEntryVCN(CurrentEntry);
+
+        Path[Depth].Buffer = ExAllocatePoolWithTag(NonPagedPool, IndexBufferSize, TAG_NTFS);
+        if (!Path[Depth].Buffer)
+        {
+            DPRINT1("ERROR: Couldn't allocate memory for index record!\n");
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Cleanup;
+        }
+
+        BytesRead = ReadAttribute(DeviceExt,
+                                  IndexAllocationContext,
+                                  GetAllocationOffsetFromVCN(DeviceExt, IndexBufferSize, VCN),
+                                  (PCHAR)Path[Depth].Buffer,
+                                  IndexBufferSize);
+        if (BytesRead != IndexBufferSize)
+        {
+            DPRINT1("ERROR: Failed to read index record with VCN %I64u!\n", VCN);
+            Depth++;
+            Status = STATUS_UNSUCCESSFUL;
+            goto Cleanup;
+        }
+
+        Status = FixupUpdateSequenceArray(DeviceExt, &Path[Depth].Buffer->Ntfs);
+        Depth++;
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("ERROR: Failed to fixup index record with VCN %I64u!\n", VCN);
+            goto Cleanup;
+        }
+
+        if (Path[Depth - 1].Buffer->Ntfs.Type != NRH_INDX_TYPE ||
+            Path[Depth - 1].Buffer->VCN != VCN ||
+            Path[Depth - 1].Buffer->Header.AllocatedSize > IndexBufferSize - FIELD_OFFSET(INDEX_BUFFER, Header) ||
+            Path[Depth - 1].Buffer->Header.TotalSizeOfEntries > Path[Depth - 1].Buffer->Header.AllocatedSize)
+        {
+            DPRINT1("ERROR: Index record with VCN %I64u is corrupt!\n", VCN);
+            Status = STATUS_FILE_CORRUPT_ERROR;
+            goto Cleanup;
+        }
+
+        Status = FindIndexEntryPosition(&Path[Depth - 1].Buffer->Header, NewEntry, CaseSensitive, &EntryOffset);
+        if (!NT_SUCCESS(Status))
+            goto Cleanup;
+
+        Path[Depth - 1].EntryOffset = EntryOffset;
+        CurrentEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&Path[Depth - 1].Buffer->Header + EntryOffset);
+    }
+
+    if (Depth == 0)
+    {
+        DPRINT1("Large index root without any sub-node!\n");
+        Status = STATUS_NOT_IMPLEMENTED;
+        goto Cleanup;
+    }
+
+    // Insert the entry into the leaf, splitting records upward until one has room for the median
+    CurrentEntry = NewEntry;
+    Level = Depth - 1;
+    for (;;)
+    {
+        PINDEX_HEADER_ATTRIBUTE Header = &Path[Level].Buffer->Header;
+        PINDEX_ENTRY_ATTRIBUTE MedianEntry;
+
+        Path[Level].Dirty = TRUE;
+
+        if (Header->TotalSizeOfEntries + CurrentEntry->Length <= Header->AllocatedSize)
+        {
+            InsertEntryIntoIndexBuffer(Header, Path[Level].EntryOffset, CurrentEntry);
+            break;
+        }
+
+        Status = SplitIndexBuffer(&Path[Level],
+                                  Level,
+                                  IndexBufferSize,
+                                  Path[Level].EntryOffset,
+                                  CurrentEntry,
+                                  &MedianEntry);
+        if (CurrentEntry != NewEntry)
+            ExFreePoolWithTag(CurrentEntry, TAG_NTFS);
+        CurrentEntry = NewEntry;
+        if (!NT_SUCCESS(Status))
+            break;
+        CurrentEntry = MedianEntry;
+
+        // The median of the top record would have to go into the index root, which lives in the file record;
+        // move the root's entries into a new record instead
+        if (Level == 0)
+        {
+            DPRINT("Demoting index root\n");
+            Status = DemoteIndexRoot(IndexRoot, RootEntryOffset, &Path[0], IndexBufferSize, MedianEntry, &RootBuffer);
+            break;
+        }
+
+        // The parent entry that pointed to the record now points to its right-hand sibling,
+        // and the median is inserted right before it
+        Level--;
+        SetIndexEntryVCN((PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&Path[Level].Buffer->Header + Path[Level].EntryOffset),
+                         Path[Level + 1].NewVCN);
+    }
+
+    if (CurrentEntry != NewEntry)
+        ExFreePoolWithTag(CurrentEntry, TAG_NTFS);
+
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    // Everything fits, now give the new records their place in the index allocation
+    for (Level = 0; Level < Depth; Level++)
+    {
+        if (!Path[Level].NewBuffer)
+            continue;
+
+        Status = AllocateIndexNode(DeviceExt,
+                                   FileRecord,
+                                   IndexBufferSize,
+                                   IndexAllocationContext,
+                                   IndexAllocationOffset,
+                                   &Path[Level].NewVCN);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("ERROR: Failed to allocate index record in index allocation!\n");
+            // Nothing was written yet; don't let the caller mistake this for a request to rebuild the index
+            if (Status == STATUS_NOT_IMPLEMENTED)
+                Status = STATUS_UNSUCCESSFUL;
+            goto Cleanup;
+        }
+
+        Path[Level].NewBuffer->VCN = Path[Level].NewVCN;
+    }
+
+    if (RootBuffer)
+    {
+        Status = AllocateIndexNode(DeviceExt,
+                                   FileRecord,
+                                   IndexBufferSize,
+                                   IndexAllocationContext,
+                                   IndexAllocationOffset,
+                                   &RootBuffer->VCN);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("ERROR: Failed to allocate index record in index allocation!\n");
+            if (Status == STATUS_NOT_IMPLEMENTED)
+                Status = STATUS_UNSUCCESSFUL;
+            goto Cleanup;
+        }
+    }
+
+    // Write back only the records that changed, children first
+    for (Level = Depth; Level-- > 0;)
+    {
+        if (!Path[Level].Dirty)
+            continue;
+
+        if (Path[Level].NewBuffer)
+        {
+            ReplaceSplitPlaceholderVCNs(Path[Level].NewBuffer, Path, Depth);
+
+            Status = WriteIndexBuffer(DeviceExt, FileRecord, IndexAllocationContext, Path[Level].NewBuffer, IndexBufferSize);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("ERROR: Failed to write index record with VCN %I64u!\n", Path[Level].NewVCN);
+                goto Cleanup;
+            }
+        }
+
+        ReplaceSplitPlaceholderVCNs(Path[Level].Buffer, Path, Depth);
+
+        Status = WriteIndexBuffer(DeviceExt, FileRecord, IndexAllocationContext, Path[Level].Buffer, IndexBufferSize);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("ERROR: Failed to write index record with VCN %I64u!\n", Path[Level].Buffer->VCN);
+            goto Cleanup;
+        }
+    }
+
+    // The root only points to the record that took over its entries once that record is on the disk
+    if (RootBuffer)
+    {
+        ReplaceSplitPlaceholderVCNs(RootBuffer, Path, Depth);
+
+        Status = WriteIndexBuffer(DeviceExt, FileRecord, IndexAllocationContext, RootBuffer, IndexBufferSize);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("ERROR: Failed to write index record with VCN %I64u!\n", RootBuffer->VCN);
+            goto Cleanup;
+        }
+
+        Status = WriteDemotedIndexRoot(DeviceExt, FileRecord, IndexRoot, RootBuffer->VCN);
+        if (!NT_SUCCESS(Status))
+            DPRINT1("ERROR: Failed to write demoted index root!\n");
+    }
+
+Cleanup:
+    if (RootBuffer)
+        ExFreePoolWithTag(RootBuffer, TAG_NTFS);
+
+    for (Level = 0; Level < Depth; Level++)
+    {
+        if (Path[Level].NewBuffer)
+            ExFreePoolWithTag(Path[Level].NewBuffer, TAG_NTFS);
+        ExFreePoolWithTag(Path[Level].Buffer, TAG_NTFS);
+    }
+
+    ExFreePoolWithTag(NewEntry, TAG_NTFS);
+    ReleaseAttributeContext(IndexAllocationContext);
+
+    return Status;
+}
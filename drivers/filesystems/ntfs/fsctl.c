@@ -459,6 +459,8 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
     Vcb->Identifier.Type = NTFS_TYPE_VCB;
     Vcb->Identifier.Size = sizeof(NTFS_TYPE_VCB);
 
+    NtfsInitializeFileRecordCache(Vcb);
+
     Status = NtfsGetVolumeData(DeviceToMount,
                                Vcb);
     if (!NT_SUCCESS(Status))
@@ -466,6 +468,8 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
 
     Lookaside = TRUE;
 
+    NtfsReadUpcaseTable(Vcb);
+
     NewDeviceObject->Vpb = DeviceToMount->Vpb;
 
     Vcb->StorageDevice = DeviceToMount;
@@ -564,6 +568,12 @@ ByeBye:
         if (Ccb)
             ExFreePool(Ccb);
 
+        if (Vcb)
+        {
+            NtfsFlushFileRecordCache(Vcb);
+            NtfsFreeUpcaseTable(Vcb);
+        }
+
         if (Lookaside)
             ExDeleteNPagedLookasideList(&Vcb->FileRecLookasideList);
 
@@ -895,6 +905,47 @@ LockOrUnlockVolume(PDEVICE_EXTENSION DeviceExt,
 }
 
 
+static
+NTSTATUS
+NtfsDismountVolume(PDEVICE_EXTENSION DeviceExt,
+                   PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack;
+
+    DPRINT("NtfsDismountVolume(%p, %p)\n", DeviceExt, Irp);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    /* We only allow dismounting a locked volume */
+    if (!(DeviceExt->Flags & VCB_VOLUME_LOCKED))
+    {
+        return STATUS_ACCESS_DENIED;
+    }
+
+    /* Don't dismount twice */
+    if (DeviceExt->Flags & VCB_DISMOUNT_PENDING)
+    {
+        return STATUS_VOLUME_DISMOUNTED;
+    }
+
+    FsRtlNotifyVolumeEvent(Stack->FileObject, FSRTL_VOLUME_DISMOUNT);
+
+    /* Lookups run with the directory resource held, so nothing uses the caches below anymore */
+    ExAcquireResourceExclusiveLite(&DeviceExt->DirResource, TRUE);
+
+    NtfsFlushFileRecordCache(DeviceExt);
+    NtfsFreeUpcaseTable(DeviceExt);
+
+    /* Mark we're being dismounted */
+    DeviceExt->Flags |= VCB_DISMOUNT_PENDING;
+    DeviceExt->StorageDevice->Vpb->Flags &= ~VPB_MOUNTED;
+
+    ExReleaseResourceLite(&DeviceExt->DirResource);
+
+    return STATUS_SUCCESS;
+}
+
+
 static
 NTSTATUS
 NtfsUserFsRequest(PDEVICE_OBJECT DeviceObject,
@@ -937,6 +988,10 @@ NtfsUserFsRequest(PDEVICE_OBJECT DeviceObject,
             Status = LockOrUnlockVolume(DeviceExt, Irp, FALSE);
             break;
 
+        case FSCTL_DISMOUNT_VOLUME:
+            Status = NtfsDismountVolume(DeviceExt, Irp);
+            break;
+
         case FSCTL_GET_NTFS_VOLUME_DATA:
             Status = GetNfsVolumeData(DeviceExt, Irp);
             break;
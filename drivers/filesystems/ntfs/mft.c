@@ -1627,15 +1627,289 @@ Cleanup:
     return Status;
 }
 
+/* A cached file record; the fixed-up record itself follows the entry */
+typedef struct _FILE_RECORD_CACHE_ENTRY
+{
+    LIST_ENTRY HashEntry;
+    LIST_ENTRY LruEntry;
+    ULONGLONG MftIndex;
+    LONG RefCount;
+} FILE_RECORD_CACHE_ENTRY, *PFILE_RECORD_CACHE_ENTRY;
+
+#define FILE_RECORD_CACHE_BUCKET(Cache, MftIndex) \
+    (&(Cache)->Buckets[(ULONG)(MftIndex) % NTFS_FILE_RECORD_CACHE_BUCKETS])
+
+VOID
+NtfsInitializeFileRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    PNTFS_FILE_RECORD_CACHE Cache = &Vcb->FileRecordCache;
+    ULONG i;
+
+    KeInitializeSpinLock(&Cache->Lock);
+    for (i = 0; i < NTFS_FILE_RECORD_CACHE_BUCKETS; i++)
+    {
+        InitializeListHead(&Cache->Buckets[i]);
+    }
+    InitializeListHead(&Cache->LruList);
+    Cache->Count = 0;
+    Cache->Generation = 0;
+}
+
+static
+VOID
+DereferenceFileRecordCacheEntry(PFILE_RECORD_CACHE_ENTRY Entry)
+{
+    if (InterlockedDecrement(&Entry->RefCount) == 0)
+    {
+        ExFreePoolWithTag(Entry, TAG_FILE_REC);
+    }
+}
+
+/* Must be called with the cache lock held. The caller drops the cache's reference once it released the lock */
+static
+VOID
+RemoveFileRecordCacheEntry(PNTFS_FILE_RECORD_CACHE Cache,
+                           PFILE_RECORD_CACHE_ENTRY Entry)
+{
+    RemoveEntryList(&Entry->HashEntry);
+    RemoveEntryList(&Entry->LruEntry);
+    Cache->Count--;
+}
+
+static
+PFILE_RECORD_CACHE_ENTRY
+FindFileRecordCacheEntry(PNTFS_FILE_RECORD_CACHE Cache,
+                         ULONGLONG MftIndex)
+{
+    PLIST_ENTRY Bucket = FILE_RECORD_CACHE_BUCKET(Cache, MftIndex);
+    PLIST_ENTRY ListEntry;
+
+    for (ListEntry = Bucket->Flink; ListEntry != Bucket; ListEntry = ListEntry->Flink)
+    {
+        PFILE_RECORD_CACHE_ENTRY Entry = CONTAINING_RECORD(ListEntry, FILE_RECORD_CACHE_ENTRY, HashEntry);
+        if (Entry->MftIndex == MftIndex)
+            return Entry;
+    }
+
+    return NULL;
+}
+
+/* Copies a cached file record to FileRecord. Returns FALSE if MftIndex isn't cached */
+static
+BOOLEAN
+ReadCachedFileRecord(PDEVICE_EXTENSION Vcb,
+                     ULONGLONG MftIndex,
+                     PFILE_RECORD_HEADER FileRecord)
+{
+    PNTFS_FILE_RECORD_CACHE Cache = &Vcb->FileRecordCache;
+    PFILE_RECORD_CACHE_ENTRY Entry;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Cache->Lock, &OldIrql);
+    Entry = FindFileRecordCacheEntry(Cache, MftIndex);
+    if (Entry)
+    {
+        // Keep it alive while we copy, and mark it as the most recently used
+        InterlockedIncrement(&Entry->RefCount);
+        RemoveEntryList(&Entry->LruEntry);
+        InsertHeadList(&Cache->LruList, &Entry->LruEntry);
+    }
+    KeReleaseSpinLock(&Cache->Lock, OldIrql);
+
+    if (!Entry)
+        return FALSE;
+
+    // Cached records are never modified, only replaced
+    RtlCopyMemory(FileRecord, Entry + 1, Vcb->NtfsInfo.BytesPerFileRecord);
+    DereferenceFileRecordCacheEntry(Entry);
+
+    return TRUE;
+}
+
+static
+VOID
+CacheFileRecord(PDEVICE_EXTENSION Vcb,
+                ULONGLONG MftIndex,
+                PFILE_RECORD_HEADER FileRecord,
+                ULONG Generation)
+{
+    PNTFS_FILE_RECORD_CACHE Cache = &Vcb->FileRecordCache;
+    PFILE_RECORD_CACHE_ENTRY Entry, Victim = NULL;
+    KIRQL OldIrql;
+
+    Entry = ExAllocatePoolWithTag(NonPagedPool,
+                                  sizeof(FILE_RECORD_CACHE_ENTRY) + Vcb->NtfsInfo.BytesPerFileRecord,
+                                  TAG_FILE_REC);
+    if (!Entry)
+        return;
+
+    Entry->MftIndex = MftIndex;
+    Entry->RefCount = 1;
+    RtlCopyMemory(Entry + 1, FileRecord, Vcb->NtfsInfo.BytesPerFileRecord);
+
+    KeAcquireSpinLock(&Cache->Lock, &OldIrql);
+
+    // Don't cache what we read if a file record was written meanwhile, or if someone beat us to it
+    if (Cache->Generation != Generation || FindFileRecordCacheEntry(Cache, MftIndex))
+    {
+        KeReleaseSpinLock(&Cache->Lock, OldIrql);
+        ExFreePoolWithTag(Entry, TAG_FILE_REC);
+        return;
+    }
+
+    InsertHeadList(FILE_RECORD_CACHE_BUCKET(Cache, MftIndex), &Entry->HashEntry);
+    InsertHeadList(&Cache->LruList, &Entry->LruEntry);
+    Cache->Count++;
+
+    // Evict the least recently used record
+    if (Cache->Count > NTFS_FILE_RECORD_CACHE_ENTRIES)
+    {
+        Victim = CONTAINING_RECORD(Cache->LruList.Blink, FILE_RECORD_CACHE_ENTRY, LruEntry);
+        RemoveFileRecordCacheEntry(Cache, Victim);
+    }
+
+    KeReleaseSpinLock(&Cache->Lock, OldIrql);
+
+    if (Victim)
+        DereferenceFileRecordCacheEntry(Victim);
+}
+
+static
+VOID
+InvalidateCachedFileRecord(PDEVICE_EXTENSION Vcb,
+                           ULONGLONG MftIndex)
+{
+    PNTFS_FILE_RECORD_CACHE Cache = &Vcb->FileRecordCache;
+    PFILE_RECORD_CACHE_ENTRY Entry;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Cache->Lock, &OldIrql);
+    Cache->Generation++;
+    Entry = FindFileRecordCacheEntry(Cache, MftIndex);
+    if (Entry)
+        RemoveFileRecordCacheEntry(Cache, Entry);
+    KeReleaseSpinLock(&Cache->Lock, OldIrql);
+
+    if (Entry)
+        DereferenceFileRecordCacheEntry(Entry);
+}
+
+VOID
+NtfsFlushFileRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    PNTFS_FILE_RECORD_CACHE Cache = &Vcb->FileRecordCache;
+    PFILE_RECORD_CACHE_ENTRY Entry;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Cache->Lock, &OldIrql);
+    Cache->Generation++;
+    while (!IsListEmpty(&Cache->LruList))
+    {
+        Entry = CONTAINING_RECORD(Cache->LruList.Flink, FILE_RECORD_CACHE_ENTRY, LruEntry);
+        RemoveFileRecordCacheEntry(Cache, Entry);
+        KeReleaseSpinLock(&Cache->Lock, OldIrql);
+
+        DereferenceFileRecordCacheEntry(Entry);
+
+        KeAcquireSpinLock(&Cache->Lock, &OldIrql);
+    }
+    KeReleaseSpinLock(&Cache->Lock, OldIrql);
+}
+
+/**
+* @name NtfsReadUpcaseTable
+* @implemented
+*
+* Reads $UpCase, the table the volume's directory indexes are sorted with, into Vcb->UpcaseTable.
+*
+* @remarks
+* Failing to read it isn't fatal: without the table, name lookups walk every index entry
+* instead of searching them, see LookupIndexNodeEntry().
+*/
+VOID
+NtfsReadUpcaseTable(PDEVICE_EXTENSION Vcb)
+{
+    PFILE_RECORD_HEADER FileRecord;
+    PNTFS_ATTR_CONTEXT DataContext;
+    ULONGLONG DataLength;
+    PWCHAR UpcaseTable;
+    NTSTATUS Status;
+
+    FileRecord = ExAllocateFromNPagedLookasideList(&Vcb->FileRecLookasideList);
+    if (!FileRecord)
+    {
+        DPRINT1("Unable to allocate memory for $UpCase file record!\n");
+        return;
+    }
+
+    Status = ReadFileRecord(Vcb, NTFS_FILE_UPCASE, FileRecord);
+    if (NT_SUCCESS(Status))
+        Status = FindAttribute(Vcb, FileRecord, AttributeData, L"", 0, &DataContext, NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Unable to find $UpCase data, status 0x%08lx\n", Status);
+        ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, FileRecord);
+        return;
+    }
+
+    // One character for each UTF-16 code unit, at most
+    DataLength = AttributeDataLength(DataContext->pRecord);
+    if (DataLength == 0 || DataLength > 0x10000 * sizeof(WCHAR) || DataLength % sizeof(WCHAR) != 0)
+    {
+        DPRINT1("$UpCase has an invalid length: %I64u\n", DataLength);
+        ReleaseAttributeContext(DataContext);
+        ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, FileRecord);
+        return;
+    }
+
+    // Only used at passive level, by name lookups
+    UpcaseTable = ExAllocatePoolWithTag(PagedPool, (ULONG)DataLength, TAG_NTFS);
+    if (!UpcaseTable)
+    {
+        DPRINT1("Unable to allocate memory for $UpCase!\n");
+    }
+    else if (ReadAttribute(Vcb, DataContext, 0, (PCHAR)UpcaseTable, (ULONG)DataLength) != DataLength)
+    {
+        DPRINT1("Unable to read $UpCase!\n");
+        ExFreePoolWithTag(UpcaseTable, TAG_NTFS);
+    }
+    else
+    {
+        Vcb->UpcaseTable = UpcaseTable;
+        Vcb->UpcaseTableLength = (ULONG)(DataLength / sizeof(WCHAR));
+    }
+
+    ReleaseAttributeContext(DataContext);
+    ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, FileRecord);
+}
+
+VOID
+NtfsFreeUpcaseTable(PDEVICE_EXTENSION Vcb)
+{
+    if (Vcb->UpcaseTable)
+    {
+        ExFreePoolWithTag(Vcb->UpcaseTable, TAG_NTFS);
+        Vcb->UpcaseTable = NULL;
+        Vcb->UpcaseTableLength = 0;
+    }
+}
+
 NTSTATUS
 ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
                PFILE_RECORD_HEADER file)
 {
     ULONGLONG BytesRead;
+    ULONG Generation;
+    NTSTATUS Status;
 
     DPRINT("ReadFileRecord(%p, %I64x, %p)\n", Vcb, index, file);
 
+    if (ReadCachedFileRecord(Vcb, index, file))
+        return STATUS_SUCCESS;
+
+    Generation = *(volatile ULONG *)&Vcb->FileRecordCache.Generation;
+
     BytesRead = ReadAttribute(Vcb, Vcb->MFTContext, index * Vcb->NtfsInfo.BytesPerFileRecord, (PCHAR)file, Vcb->NtfsInfo.BytesPerFileRecord);
     if (BytesRead != Vcb->NtfsInfo.BytesPerFileRecord)
     {
@@ -1645,7 +1919,11 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
 
     /* Apply update sequence array fixups. */
     DPRINT("Sequence number: %u\n", file->SequenceNumber);
-    return FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    Status = FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    if (NT_SUCCESS(Status))
+        CacheFileRecord(Vcb, index, file, Generation);
+
+    return Status;
 }
 
 
@@ -1954,6 +2232,10 @@ UpdateFileRecord(PDEVICE_EXTENSION Vcb,
         DPRINT1("UpdateFileRecord failed: %lu written, %lu expected\n", BytesWritten, Vcb->NtfsInfo.BytesPerFileRecord);
     }
 
+    // Whatever ended up on the disk, the cached copy is out of date. This has to happen after
+    // the write, so a read that raced with it can't cache what was there before
+    InvalidateCachedFileRecord(Vcb, MftIndex);
+
     // remove the fixup array (so the file record pointer can still be used)
     FixupUpdateSequenceArray(Vcb, &FileRecord->Ntfs);
 
@@ -2300,6 +2582,27 @@ NtfsAddFilenameToDirectory(PDEVICE_EXTENSION DeviceExt,
         return Status;
     }
 
+#ifdef NTFS_INSERT_INDEX_IN_PLACE
+    // Try to add the entry straight to the index record it belongs in; only fall back to
+    // rebuilding the whole index when the index root itself has to change
+    Status = NtfsInsertIndexEntry(DeviceExt,
+                                  ParentFileRecord,
+                                  I30IndexRoot,
+                                  FileReferenceNumber,
+                                  FilenameAttribute,
+                                  CaseSensitive);
+    if (Status != STATUS_NOT_IMPLEMENTED)
+    {
+        if (!NT_SUCCESS(Status))
+            DPRINT1("ERROR: Failed to insert entry into index of Mft index #%I64u!\n", DirectoryMftIndex);
+
+        ReleaseAttributeContext(IndexRootContext);
+        ExFreePoolWithTag(I30IndexRoot, TAG_NTFS);
+        ExFreeToNPagedLookasideList(&DeviceExt->FileRecLookasideList, ParentFileRecord);
+        return Status;
+    }
+#endif
+
     // Convert the index to a B*Tree
     Status = CreateBTreeFromIndex(DeviceExt,
                                   ParentFileRecord,
@@ -2835,6 +3138,202 @@ DumpIndexEntry(PINDEX_ENTRY_ATTRIBUTE IndexEntry)
 }
 #endif
 
+NTSTATUS
+BrowseSubNodeIndexEntries(PNTFS_VCB Vcb,
+                          PFILE_RECORD_HEADER MftRecord,
+                          ULONG IndexBlockSize,
+                          PUNICODE_STRING FileName,
+                          PNTFS_ATTR_CONTEXT IndexAllocationContext,
+                          PRTL_BITMAP Bitmap,
+                          ULONGLONG VCN,
+                          PULONG StartEntry,
+                          PULONG CurrentEntry,
+                          BOOLEAN DirSearch,
+                          BOOLEAN CaseSensitive,
+                          ULONGLONG *OutMFTIndex);
+
+/**
+* Compares two file names the way the volume's directory indexes are sorted: character by character,
+* after upcasing both through the volume's $UpCase table.
+*/
+static
+LONG
+CollateFileNames(PNTFS_VCB Vcb,
+                 PCUNICODE_STRING Name1,
+                 PCUNICODE_STRING Name2)
+{
+    ULONG Length1 = Name1->Length / sizeof(WCHAR);
+    ULONG Length2 = Name2->Length / sizeof(WCHAR);
+    ULONG i;
+    WCHAR Char1, Char2;
+
+    for (i = 0; i < Length1 && i < Length2; i++)
+    {
+        Char1 = Name1->Buffer[i];
+        Char2 = Name2->Buffer[i];
+        if (Char1 < Vcb->UpcaseTableLength)
+            Char1 = Vcb->UpcaseTable[Char1];
+        if (Char2 < Vcb->UpcaseTableLength)
+            Char2 = Vcb->UpcaseTable[Char2];
+
+        if (Char1 != Char2)
+            return (Char1 < Char2) ? -1 : 1;
+    }
+
+    if (Length1 == Length2)
+        return 0;
+    return (Length1 < Length2) ? -1 : 1;
+}
+
+/**
+* @name LookupIndexNodeEntry
+* @implemented
+*
+* Looks up a file name, without wildcards, in one node of a directory index and in the sub-node it belongs in.
+*
+* @param FirstEntry
+* Pointer to the first index entry of the node.
+*
+* @param LastEntry
+* Pointer past which there can't be any index entry of the node.
+*
+* @param HasSubNodes
+* Boolean indicating if the node is flagged as having sub-nodes.
+*
+* @return
+* STATUS_SUCCESS if the file was found, STATUS_OBJECT_PATH_NOT_FOUND otherwise.
+*
+* @remarks
+* Entries are sorted by their names upcased through $UpCase, so instead of walking every entry and every
+* sub-node before it, a binary search finds the first entry that doesn't sort before FileName. Only that entry's sub-node can hold
+* the file. For case-sensitive lookups, the following entries that only differ in case are checked as well.
+* Unlike directory searches, entries aren't counted, so StartEntry and CurrentEntry are left untouched.
+* Requires Vcb->UpcaseTable; when $UpCase couldn't be read, callers walk the entries instead.
+*/
+static
+NTSTATUS
+LookupIndexNodeEntry(PNTFS_VCB Vcb,
+                     PFILE_RECORD_HEADER MftRecord,
+                     ULONG IndexBlockSize,
+                     PUNICODE_STRING FileName,
+                     PNTFS_ATTR_CONTEXT IndexAllocationContext,
+                     PRTL_BITMAP Bitmap,
+                     BOOLEAN HasSubNodes,
+                     PINDEX_ENTRY_ATTRIBUTE FirstEntry,
+                     PINDEX_ENTRY_ATTRIBUTE LastEntry,
+                     PULONG StartEntry,
+                     PULONG CurrentEntry,
+                     BOOLEAN CaseSensitive,
+                     ULONGLONG *OutMFTIndex)
+{
+    PINDEX_ENTRY_ATTRIBUTE *Entries;
+    PINDEX_ENTRY_ATTRIBUTE IndexEntry;
+    UNICODE_STRING EntryName;
+    ULONG EntryCount, Low, High, Middle, i;
+    NTSTATUS Status;
+
+    // Count the entries, including the end marker
+    EntryCount = 0;
+    IndexEntry = FirstEntry;
+    while (IndexEntry <= LastEntry)
+    {
+        EntryCount++;
+        if ((IndexEntry->Flags & NTFS_INDEX_ENTRY_END) || IndexEntry->Length < sizeof(INDEX_ENTRY_ATTRIBUTE))
+            break;
+        IndexEntry = (PINDEX_ENTRY_ATTRIBUTE)((PCHAR)IndexEntry + IndexEntry->Length);
+    }
+
+    if (EntryCount == 0)
+        return STATUS_OBJECT_PATH_NOT_FOUND;
+
+    Entries = ExAllocatePoolWithTag(NonPagedPool, EntryCount * sizeof(PINDEX_ENTRY_ATTRIBUTE), TAG_NTFS);
+    if (!Entries)
+    {
+        DPRINT1("Unable to allocate memory for index entries!\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    IndexEntry = FirstEntry;
+    for (i = 0; i < EntryCount; i++)
+    {
+        Entries[i] = IndexEntry;
+        IndexEntry = (PINDEX_ENTRY_ATTRIBUTE)((PCHAR)IndexEntry + IndexEntry->Length);
+    }
+
+    // Find the first entry that doesn't sort before FileName; the end marker sorts after everything
+    Low = 0;
+    High = EntryCount - 1;
+    if (!(Entries[High]->Flags & NTFS_INDEX_ENTRY_END))
+        High++;
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        EntryName.Buffer = Entries[Middle]->FileName.Name;
+        EntryName.Length = EntryName.MaximumLength = Entries[Middle]->FileName.NameLength * sizeof(WCHAR);
+
+        if (CollateFileNames(Vcb, FileName, &EntryName) > 0)
+            Low = Middle + 1;
+        else
+            High = Middle;
+    }
+
+    Status = STATUS_OBJECT_PATH_NOT_FOUND;
+    for (i = Low; i < EntryCount; i++)
+    {
+        IndexEntry = Entries[i];
+
+        // Anything sorting between the previous entry and this one is in its sub-node
+        if (IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE)
+        {
+            if (!HasSubNodes || !IndexAllocationContext)
+            {
+                DPRINT1("Filesystem corruption detected!\n");
+            }
+            else
+            {
+                Status = BrowseSubNodeIndexEntries(Vcb,
+                                                   MftRecord,
+                                                   IndexBlockSize,
+                                                   FileName,
+                                                   IndexAllocationContext,
+                                                   Bitmap,
+                                                   GetIndexEntryVCN(IndexEntry),
+                                                   StartEntry,
+                                                   CurrentEntry,
+                                                   FALSE,
+                                                   CaseSensitive,
+                                                   OutMFTIndex);
+                if (NT_SUCCESS(Status))
+                    break;
+                Status = STATUS_OBJECT_PATH_NOT_FOUND;
+            }
+        }
+
+        if (IndexEntry->Flags & NTFS_INDEX_ENTRY_END)
+            break;
+
+        // Past the names FileName could match?
+        EntryName.Buffer = IndexEntry->FileName.Name;
+        EntryName.Length = EntryName.MaximumLength = IndexEntry->FileName.NameLength * sizeof(WCHAR);
+        if (CollateFileNames(Vcb, FileName, &EntryName) != 0)
+            break;
+
+        if ((IndexEntry->Data.Directory.IndexedFile & NTFS_MFT_MASK) >= NTFS_FILE_FIRST_USER_FILE &&
+            IndexEntry->FileName.NameType != NTFS_FILE_NAME_DOS &&
+            CompareFileName(FileName, IndexEntry, FALSE, CaseSensitive))
+        {
+            *OutMFTIndex = (IndexEntry->Data.Directory.IndexedFile & NTFS_MFT_MASK);
+            Status = STATUS_SUCCESS;
+            break;
+        }
+    }
+
+    ExFreePoolWithTag(Entries, TAG_NTFS);
+
+    return Status;
+}
+
 NTSTATUS
 BrowseSubNodeIndexEntries(PNTFS_VCB Vcb,
                           PFILE_RECORD_HEADER MftRecord,
@@ -2920,6 +3419,26 @@ BrowseSubNodeIndexEntries(PNTFS_VCB Vcb,
     LastEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&IndexRecord->Header + IndexRecord->Header.TotalSizeOfEntries);
     ASSERT(LastEntry <= (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)IndexRecord + IndexBlockSize));
 
+    // Looking for a single name? Without $UpCase, the entries' order is unknown, so walk them all
+    if (!DirSearch && Vcb->UpcaseTable)
+    {
+        Status = LookupIndexNodeEntry(Vcb,
+                                      MftRecord,
+                                      IndexBlockSize,
+                                      FileName,
+                                      IndexAllocationContext,
+                                      Bitmap,
+                                      BooleanFlagOn(IndexRecord->Header.Flags, INDEX_NODE_LARGE),
+                                      FirstEntry,
+                                      LastEntry,
+                                      StartEntry,
+                                      CurrentEntry,
+                                      CaseSensitive,
+                                      OutMFTIndex);
+        ExFreePoolWithTag(IndexRecord, TAG_NTFS);
+        return Status;
+    }
+
     // Loop through all Index Entries of index, starting with FirstEntry
     IndexEntry = FirstEntry;
     while (IndexEntry <= LastEntry)
@@ -3068,7 +3587,31 @@ BrowseIndexEntries(PDEVICE_EXTENSION Vcb,
         // Couldn't find an index allocation
         IndexAllocationContext = NULL;
     }
-    
+
+    // Looking for a single name? Without $UpCase, the entries' order is unknown, so walk them all
+    if (!DirSearch && Vcb->UpcaseTable)
+    {
+        Status = LookupIndexNodeEntry(Vcb,
+                                      MftRecord,
+                                      IndexBlockSize,
+                                      FileName,
+                                      IndexAllocationContext,
+                                      &Bitmap,
+                                      BooleanFlagOn(IndexRecord->Header.Flags, INDEX_ROOT_LARGE),
+                                      FirstEntry,
+                                      LastEntry,
+                                      StartEntry,
+                                      CurrentEntry,
+                                      CaseSensitive,
+                                      OutMFTIndex);
+        if (IndexAllocationContext)
+        {
+            ExFreePoolWithTag(BitmapMem, TAG_NTFS);
+            ReleaseAttributeContext(BitmapContext);
+            ReleaseAttributeContext(IndexAllocationContext);
+        }
+        return Status;
+    }
 
     // Loop through all Index Entries of index, starting with FirstEntry
     IndexEntry = FirstEntry;
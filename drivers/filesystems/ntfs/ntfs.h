@@ -21,6 +21,11 @@
 
 #define DEVICE_NAME L"\\Ntfs"
 
+/* NtfsAddFilenameToDirectory() rebuilds the whole directory index for every new file.
+ * NtfsInsertIndexEntry() updates only the index records that change; it passes the
+ * host round trip in sdk/tools/ntfsindextest but hasn't been run on a real volume yet */
+// #define NTFS_INSERT_INDEX_IN_PLACE
+
 #include <pshpack1.h>
 typedef struct _BIOS_PARAMETERS_BLOCK
 {
@@ -96,6 +101,19 @@ typedef struct
     ULONG Size;
 } NTFSIDENTIFIER, *PNTFSIDENTIFIER;
 
+#define NTFS_FILE_RECORD_CACHE_BUCKETS  64
+#define NTFS_FILE_RECORD_CACHE_ENTRIES  256
+
+// Fixed-up copies of recently read file records, keyed by their MFT index
+typedef struct
+{
+    KSPIN_LOCK Lock;
+    LIST_ENTRY Buckets[NTFS_FILE_RECORD_CACHE_BUCKETS];
+    LIST_ENTRY LruList;
+    ULONG Count;
+    ULONG Generation;   // Bumped on every file record write, so stale reads aren't cached
+} NTFS_FILE_RECORD_CACHE, *PNTFS_FILE_RECORD_CACHE;
+
 typedef struct
 {
     NTFSIDENTIFIER Identifier;
@@ -117,6 +135,10 @@ typedef struct
     NTFS_INFO NtfsInfo;
 
     NPAGED_LOOKASIDE_LIST FileRecLookasideList;
+    NTFS_FILE_RECORD_CACHE FileRecordCache;
+
+    PWCHAR UpcaseTable;         // Contents of $UpCase, which sorts the names in directory indexes
+    ULONG UpcaseTableLength;    // In characters
 
     ULONG MftDataOffset;
     ULONG Flags;
@@ -125,6 +147,7 @@ typedef struct
 } DEVICE_EXTENSION, *PDEVICE_EXTENSION, NTFS_VCB, *PNTFS_VCB;
 
 #define VCB_VOLUME_LOCKED       0x0001
+#define VCB_DISMOUNT_PENDING    0x0002
 
 typedef struct
 {
@@ -743,6 +766,11 @@ CompareTreeKeys(PB_TREE_KEY Key1,
                 PB_TREE_KEY Key2,
                 BOOLEAN CaseSensitive);
 
+LONG
+CompareIndexEntryNames(PINDEX_ENTRY_ATTRIBUTE Entry1,
+                       PINDEX_ENTRY_ATTRIBUTE Entry2,
+                       BOOLEAN CaseSensitive);
+
 NTSTATUS
 CreateBTreeFromIndex(PDEVICE_EXTENSION Vcb,
                      PFILE_RECORD_HEADER FileRecordWithIndex,
@@ -796,6 +824,14 @@ GetIndexEntryVCN(PINDEX_ENTRY_ATTRIBUTE IndexEntry);
 ULONG
 GetSizeOfIndexEntries(PB_TREE_FILENAME_NODE Node);
 
+NTSTATUS
+NtfsInsertIndexEntry(PDEVICE_EXTENSION DeviceExt,
+                     PFILE_RECORD_HEADER FileRecord,
+                     PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                     ULONGLONG FileReference,
+                     PFILENAME_ATTRIBUTE FileNameAttribute,
+                     BOOLEAN CaseSensitive);
+
 NTSTATUS
 NtfsInsertKey(PB_TREE Tree,
               ULONGLONG FileReference,
@@ -1106,6 +1142,18 @@ CompareFileName(PUNICODE_STRING FileName,
 NTSTATUS
 UpdateMftMirror(PNTFS_VCB Vcb);
 
+VOID
+NtfsInitializeFileRecordCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsFlushFileRecordCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsReadUpcaseTable(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsFreeUpcaseTable(PDEVICE_EXTENSION Vcb);
+
 NTSTATUS
 ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
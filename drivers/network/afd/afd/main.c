@@ -367,6 +367,7 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     InitializeListHead( &FCB->DatagramList );
     InitializeListHead( &FCB->PendingConnections );
+    InitializeListHead( &FCB->PollWaiters );
 
     AFD_DbgPrint(MID_TRACE,("%p: Checking command channel\n", FCB));
 
@@ -397,6 +398,9 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     FileObject->FsContext = FCB;
 
+    /* A handle value remembered by a poll set may now refer to this socket */
+    InvalidatePollSets( DeviceExt );
+
     /* It seems that UDP sockets are writable from inception */
     if( FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS ) {
         AFD_DbgPrint(MID_TRACE,("Packet oriented socket\n"));
@@ -451,7 +455,9 @@ AfdCleanupSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         }
     }
 
+    InvalidatePollSets( FCB->DeviceExt );
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
+    FreePollSet( FCB );
 
     return UnlockAndMaybeComplete(FCB, STATUS_SUCCESS, Irp, 0);
 }
@@ -965,6 +971,9 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_SELECT:
             return AfdSelect( DeviceObject, Irp, IrpSp );
 
+        case IOCTL_AFD_SELECT_POLL_SET:
+            return AfdSelectPollSet( DeviceObject, Irp, IrpSp );
+
         case IOCTL_AFD_EVENT_SELECT:
             return AfdEventSelect( DeviceObject, Irp, IrpSp );
 
@@ -1168,7 +1177,8 @@ CleanupPendingIrp(PAFD_FCB FCB, PIRP Irp, PIO_STACK_LOCATION IrpSp, PAFD_ACTIVE_
             SendReq = GetLockedData(Irp, IrpSp);
             UnlockBuffers(SendReq->BufferArray, SendReq->BufferCount, CheckUnlockExtraBuffers(FCB, IrpSp));
         }
-        else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SELECT)
+        else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SELECT ||
+                 IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SELECT_POLL_SET)
         {
             ASSERT(Poll);
 
@@ -1240,6 +1250,7 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             break;
 
         case IOCTL_AFD_SELECT:
+        case IOCTL_AFD_SELECT_POLL_SET:
             KeAcquireSpinLock(&DeviceExt->Lock, &OldIrql);
 
             CurrentEntry = DeviceExt->Polls.Flink;
@@ -68,6 +68,8 @@ VOID SignalSocket(
     {
         KeCancelTimer( &Poll->Timer );
         RemoveEntryList( &Poll->ListEntry );
+        for( i = 0; i < Poll->WaiterCount; i++ )
+            RemoveEntryList( &Poll->Waiters[i].ListEntry );
         ExFreePoolWithTag(Poll, TAG_AFD_ACTIVE_POLL);
     }
 
@@ -92,6 +94,20 @@ VOID SignalSocket(
     AFD_DbgPrint(MID_TRACE,("Done\n"));
 }
 
+/* Returns the first waiter after Entry that belongs to another poll. A poll
+ * that lists the same socket more than once has its waiters next to each
+ * other, as they are all queued at once under the device lock. */
+static PLIST_ENTRY SkipPollWaiters( PLIST_ENTRY Head,
+                                    PLIST_ENTRY Entry,
+                                    PAFD_ACTIVE_POLL Poll ) {
+    do {
+        Entry = Entry->Flink;
+    } while( Entry != Head &&
+             CONTAINING_RECORD(Entry, AFD_POLL_WAITER, ListEntry)->Poll == Poll );
+
+    return Entry;
+}
+
 static KDEFERRED_ROUTINE SelectTimeout;
 static VOID NTAPI SelectTimeout( PKDPC Dpc,
                            PVOID DeferredContext,
@@ -128,31 +144,24 @@ VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
     KIRQL OldIrql;
     PLIST_ENTRY ListEntry;
     PAFD_ACTIVE_POLL Poll;
-    PIRP Irp;
     PAFD_POLL_INFO PollReq;
-    PAFD_HANDLE HandleArray;
-    UINT i;
+    PAFD_FCB FCB = FileObject->FsContext;
 
     AFD_DbgPrint(MID_TRACE,("Killing selects that refer to %p\n", FileObject));
 
+    if( !FCB ) return;
+
     KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
 
-    ListEntry = DeviceExt->Polls.Flink;
-    while ( ListEntry != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD(ListEntry, AFD_ACTIVE_POLL, ListEntry);
-        ListEntry = ListEntry->Flink;
-        Irp = Poll->Irp;
-        PollReq = Irp->AssociatedIrp.SystemBuffer;
-        HandleArray = AFD_HANDLES(PollReq);
+    ListEntry = FCB->PollWaiters.Flink;
+    while ( ListEntry != &FCB->PollWaiters ) {
+        Poll = CONTAINING_RECORD(ListEntry, AFD_POLL_WAITER, ListEntry)->Poll;
+        ListEntry = SkipPollWaiters( &FCB->PollWaiters, ListEntry, Poll );
+        PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
 
-        for( i = 0; i < PollReq->HandleCount; i++ ) {
-            AFD_DbgPrint(MAX_TRACE,("Req: %u, This %p\n",
-                                    HandleArray[i].Handle, FileObject));
-            if( (PVOID)HandleArray[i].Handle == FileObject &&
-                (!OnlyExclusive || (OnlyExclusive && Poll->Exclusive)) ) {
-                ZeroEvents( PollReq->Handles, PollReq->HandleCount );
-                SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
-            }
+        if( !OnlyExclusive || Poll->Exclusive ) {
+            ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+            SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
         }
     }
 
@@ -161,33 +170,16 @@ VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
     AFD_DbgPrint(MID_TRACE,("Done\n"));
 }
 
-NTSTATUS NTAPI
-AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
-           PIO_STACK_LOCATION IrpSp ) {
+/* Completes the request right away if one of the sockets is ready, otherwise
+ * queues it on every socket it waits for. The handles must be locked. */
+static NTSTATUS StartPoll( PAFD_DEVICE_EXTENSION DeviceExt, PIRP Irp,
+                           PAFD_POLL_INFO PollReq, ULONG Exclusive ) {
     NTSTATUS Status = STATUS_NO_MEMORY;
     PAFD_FCB FCB;
     PFILE_OBJECT FileObject;
-    PAFD_POLL_INFO PollReq = Irp->AssociatedIrp.SystemBuffer;
-    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_ACTIVE_POLL Poll;
     KIRQL OldIrql;
     UINT i, Signalled = 0;
-    ULONG Exclusive = PollReq->Exclusive;
-
-    UNREFERENCED_PARAMETER(IrpSp);
-
-    AFD_DbgPrint(MID_TRACE,("Called (HandleCount %u Timeout %d)\n",
-                            PollReq->HandleCount,
-                            (INT)(PollReq->Timeout.QuadPart)));
-
-    SET_AFD_HANDLES(PollReq,
-                    LockHandles( PollReq->Handles, PollReq->HandleCount ));
-
-    if( !AFD_HANDLES(PollReq) ) {
-        Irp->IoStatus.Status = STATUS_NO_MEMORY;
-        Irp->IoStatus.Information = 0;
-        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
-        return STATUS_NO_MEMORY;
-    }
 
     if( Exclusive ) {
         for( i = 0; i < PollReq->HandleCount; i++ ) {
@@ -226,16 +218,16 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
         SignalSocket( NULL, Irp, PollReq, Status );
     } else {
 
-       PAFD_ACTIVE_POLL Poll = NULL;
-
        Poll = ExAllocatePoolWithTag(NonPagedPool,
-                                    sizeof(AFD_ACTIVE_POLL),
+                                    FIELD_OFFSET(AFD_ACTIVE_POLL, Waiters) +
+                                    max(PollReq->HandleCount, 1) * sizeof(AFD_POLL_WAITER),
                                     TAG_AFD_ACTIVE_POLL);
 
        if (Poll){
           Poll->Irp = Irp;
           Poll->DeviceExt = DeviceExt;
           Poll->Exclusive = Exclusive;
+          Poll->WaiterCount = PollReq->HandleCount;
 
           KeInitializeTimerEx( &Poll->Timer, NotificationTimer );
 
@@ -243,6 +235,19 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
           InsertTailList( &DeviceExt->Polls, &Poll->ListEntry );
 
+          /* Let each socket know who is waiting for it */
+          for( i = 0; i < PollReq->HandleCount; i++ ) {
+              Poll->Waiters[i].Poll = Poll;
+              if( !AFD_HANDLES(PollReq)[i].Handle ) {
+                  InitializeListHead( &Poll->Waiters[i].ListEntry );
+                  continue;
+              }
+
+              FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
+              FCB = FileObject->FsContext;
+              InsertTailList( &FCB->PollWaiters, &Poll->Waiters[i].ListEntry );
+          }
+
           KeSetTimer( &Poll->Timer, PollReq->Timeout, &Poll->TimeoutDpc );
 
           Status = STATUS_PENDING;
@@ -261,6 +266,228 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return Status;
 }
 
+NTSTATUS NTAPI
+AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+           PIO_STACK_LOCATION IrpSp ) {
+    PAFD_POLL_INFO PollReq = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    ULONG Exclusive = PollReq->Exclusive;
+
+    UNREFERENCED_PARAMETER(IrpSp);
+
+    AFD_DbgPrint(MID_TRACE,("Called (HandleCount %u Timeout %d)\n",
+                            PollReq->HandleCount,
+                            (INT)(PollReq->Timeout.QuadPart)));
+
+    SET_AFD_HANDLES(PollReq,
+                    LockHandles( PollReq->Handles, PollReq->HandleCount ));
+
+    if( !AFD_HANDLES(PollReq) ) {
+        Irp->IoStatus.Status = STATUS_NO_MEMORY;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        return STATUS_NO_MEMORY;
+    }
+
+    return StartPoll( DeviceExt, Irp, PollReq, Exclusive );
+}
+
+/* Takes new references on the file objects of a poll set, as LockHandles
+ * would. Called with the device lock held, the poll set keeps them alive. */
+static PAFD_HANDLE ReferencePollSet( PAFD_POLL_SET PollSet ) {
+    PAFD_HANDLE FileObjects;
+    UINT i;
+
+    FileObjects = ExAllocatePoolWithTag(NonPagedPool,
+                                        PollSet->HandleCount * sizeof(AFD_HANDLE),
+                                        TAG_AFD_POLL_HANDLE);
+    if( !FileObjects ) return NULL;
+
+    RtlCopyMemory( FileObjects, PollSet->FileObjects,
+                   PollSet->HandleCount * sizeof(AFD_HANDLE) );
+
+    for( i = 0; i < PollSet->HandleCount; i++ ) {
+        if( FileObjects[i].Handle )
+            ObReferenceObject( (PVOID)FileObjects[i].Handle );
+    }
+
+    return FileObjects;
+}
+
+/* A handle can be closed and its value reused for another object without any
+ * socket being created or cleaned up, e.g. when one of two duplicates is
+ * closed. Make sure every handle still refers to the file object remembered
+ * for it. The remembered ones are referenced, so their addresses can't be
+ * taken by new objects meanwhile. */
+static BOOLEAN CheckPollSetHandles( PAFD_HANDLE HandleArray,
+                                    PAFD_HANDLE FileObjects,
+                                    UINT HandleCount ) {
+    PVOID Object;
+    NTSTATUS Status;
+    UINT i;
+
+    for( i = 0; i < HandleCount; i++ ) {
+        if( !HandleArray[i].Handle ) continue;
+
+        Status = ObReferenceObjectByHandle( (PVOID)HandleArray[i].Handle,
+                                            FILE_ALL_ACCESS,
+                                            NULL,
+                                            KernelMode,
+                                            &Object,
+                                            NULL );
+        if( !NT_SUCCESS(Status) ) return FALSE;
+
+        ObDereferenceObject( Object );
+        if( Object != (PVOID)FileObjects[i].Handle ) return FALSE;
+    }
+
+    return TRUE;
+}
+
+static VOID DestroyPollSet( PAFD_POLL_SET PollSet ) {
+    UINT i;
+
+    for( i = 0; i < PollSet->HandleCount; i++ ) {
+        if( PollSet->FileObjects[i].Handle )
+            ObDereferenceObject( (PVOID)PollSet->FileObjects[i].Handle );
+    }
+
+    ExFreePoolWithTag(PollSet, TAG_AFD_POLL_SET);
+}
+
+NTSTATUS NTAPI
+AfdSelectPollSet( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp ) {
+    PAFD_POLL_INFO PollReq = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_FCB FCB = IrpSp->FileObject->FsContext;
+    ULONG BufferLength = min(IrpSp->Parameters.DeviceIoControl.InputBufferLength,
+                             IrpSp->Parameters.DeviceIoControl.OutputBufferLength);
+    PAFD_POLL_SET PollSet, OldPollSet;
+    PAFD_HANDLE FileObjects = NULL;
+    ULONG Exclusive;
+    LONG Generation;
+    KIRQL OldIrql;
+    UINT i;
+
+    if( BufferLength < FIELD_OFFSET(AFD_POLL_INFO, Handles) ||
+        PollReq->HandleCount > (BufferLength - FIELD_OFFSET(AFD_POLL_INFO, Handles)) /
+                               sizeof(AFD_HANDLE) ) {
+        Irp->IoStatus.Status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Exclusive = PollReq->Exclusive;
+
+    AFD_DbgPrint(MID_TRACE,("Called (HandleCount %u Timeout %d)\n",
+                            PollReq->HandleCount,
+                            (INT)(PollReq->Timeout.QuadPart)));
+
+    /* Reuse the file objects of the last call when the same process asked
+     * for the same handles and events, no socket came or went in between and
+     * the handles still refer to them */
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    Generation = DeviceExt->PollSetGeneration;
+    PollSet = FCB->PollSet;
+    if( PollSet &&
+        PollSet->Process == PsGetCurrentProcess() &&
+        PollSet->Generation == Generation &&
+        PollSet->HandleCount == PollReq->HandleCount ) {
+        for( i = 0; i < PollSet->HandleCount; i++ ) {
+            if( PollSet->Handles[i].Handle != PollReq->Handles[i].Handle ||
+                PollSet->Handles[i].Events != PollReq->Handles[i].Events )
+                break;
+        }
+
+        if( i == PollSet->HandleCount )
+            FileObjects = ReferencePollSet( PollSet );
+    }
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    if( FileObjects &&
+        !CheckPollSetHandles( PollReq->Handles, FileObjects, PollReq->HandleCount ) ) {
+        AFD_DbgPrint(MID_TRACE,("Poll set handles were reused\n"));
+        UnlockHandles( FileObjects, PollReq->HandleCount );
+        FileObjects = NULL;
+    }
+
+    if( !FileObjects ) {
+        FileObjects = LockHandles( PollReq->Handles, PollReq->HandleCount );
+
+        if( !FileObjects ) {
+            Irp->IoStatus.Status = STATUS_NO_MEMORY;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+            return STATUS_NO_MEMORY;
+        }
+
+        /* Remember them for the next call, it's fine to go without */
+        PollSet = ExAllocatePoolWithTag(NonPagedPool,
+                                        FIELD_OFFSET(AFD_POLL_SET, Handles) +
+                                        2 * max(PollReq->HandleCount, 1) * sizeof(AFD_HANDLE),
+                                        TAG_AFD_POLL_SET);
+        if( PollSet ) {
+            PollSet->Process = PsGetCurrentProcess();
+            PollSet->Generation = Generation;
+            PollSet->HandleCount = PollReq->HandleCount;
+            PollSet->FileObjects = PollSet->Handles + PollReq->HandleCount;
+            RtlCopyMemory( PollSet->Handles, PollReq->Handles,
+                           PollReq->HandleCount * sizeof(AFD_HANDLE) );
+            RtlCopyMemory( PollSet->FileObjects, FileObjects,
+                           PollReq->HandleCount * sizeof(AFD_HANDLE) );
+
+            /* The poll set holds its own references, the ones taken by
+             * LockHandles go away with the request */
+            for( i = 0; i < PollSet->HandleCount; i++ ) {
+                if( PollSet->FileObjects[i].Handle )
+                    ObReferenceObject( (PVOID)PollSet->FileObjects[i].Handle );
+            }
+
+            KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+            OldPollSet = FCB->PollSet;
+            FCB->PollSet = PollSet;
+            KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+            if( OldPollSet )
+                DestroyPollSet( OldPollSet );
+        }
+    }
+
+    SET_AFD_HANDLES(PollReq, FileObjects);
+
+    return StartPoll( DeviceExt, Irp, PollReq, Exclusive );
+}
+
+/* Called whenever a socket is created or cleaned up. The handles of the poll
+ * sets have to be looked up again: one may have been closed or now refer to
+ * another socket. Handles closed and reused without that are caught by
+ * CheckPollSetHandles. A stale poll set keeps its file objects referenced
+ * until it is replaced by the next call, or its socket is cleaned up. */
+VOID InvalidatePollSets( PAFD_DEVICE_EXTENSION DeviceExt ) {
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+    DeviceExt->PollSetGeneration++;
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+}
+
+VOID FreePollSet( PAFD_FCB FCB ) {
+    PAFD_POLL_SET PollSet;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock( &FCB->DeviceExt->Lock, &OldIrql );
+    PollSet = FCB->PollSet;
+    FCB->PollSet = NULL;
+    KeReleaseSpinLock( &FCB->DeviceExt->Lock, OldIrql );
+
+    if( PollSet )
+        DestroyPollSet( PollSet );
+}
+
 NTSTATUS NTAPI
 AfdEventSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
                 PIO_STACK_LOCATION IrpSp ) {
@@ -424,20 +651,19 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
         return;
     }
 
-    /* Now signal normal select irps */
-    ThePollEnt = DeviceExt->Polls.Flink;
+    /* Now signal the select irps waiting for this socket */
+    ThePollEnt = FCB->PollWaiters.Flink;
 
-    while( ThePollEnt != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD( ThePollEnt, AFD_ACTIVE_POLL, ListEntry );
+    while( ThePollEnt != &FCB->PollWaiters ) {
+        Poll = CONTAINING_RECORD( ThePollEnt, AFD_POLL_WAITER, ListEntry )->Poll;
+        ThePollEnt = SkipPollWaiters( &FCB->PollWaiters, ThePollEnt, Poll );
         PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
         AFD_DbgPrint(MID_TRACE,("Checking poll %p\n", Poll));
 
         if( UpdatePollWithFCB( Poll, FileObject ) ) {
-            ThePollEnt = ThePollEnt->Flink;
             AFD_DbgPrint(MID_TRACE,("Signalling socket\n"));
             SignalSocket( Poll, NULL, PollReq, STATUS_SUCCESS );
-        } else
-            ThePollEnt = ThePollEnt->Flink;
+        }
     }
 
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
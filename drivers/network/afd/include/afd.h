@@ -47,6 +47,7 @@
 #define TAG_AFD_POLL_HANDLE                'hpfA'
 #define TAG_AFD_FCB                        'cffA'
 #define TAG_AFD_ACTIVE_POLL                'pafA'
+#define TAG_AFD_POLL_SET                   'spfA'
 #define TAG_AFD_EA_INFO                    'aefA'
 #define TAG_AFD_STORED_DATAGRAM            'gsfA'
 #define TAG_AFD_SNMP_ADDRESS_INFO          'asfA'
@@ -111,8 +112,15 @@ typedef struct _AFD_DEVICE_EXTENSION {
     PDEVICE_OBJECT DeviceObject;
     LIST_ENTRY Polls;
     KSPIN_LOCK Lock;
+    LONG PollSetGeneration;
 } AFD_DEVICE_EXTENSION, *PAFD_DEVICE_EXTENSION;
 
+/* Links an active poll into the waiter list of one of its sockets */
+typedef struct _AFD_POLL_WAITER {
+    LIST_ENTRY ListEntry;
+    struct _AFD_ACTIVE_POLL *Poll;
+} AFD_POLL_WAITER, *PAFD_POLL_WAITER;
+
 typedef struct _AFD_ACTIVE_POLL {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -121,8 +129,22 @@ typedef struct _AFD_ACTIVE_POLL {
     KTIMER Timer;
     PKEVENT EventObject;
     BOOLEAN Exclusive;
+    UINT WaiterCount;
+    AFD_POLL_WAITER Waiters[1];
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
+/* The handles of the last IOCTL_AFD_SELECT_POLL_SET issued on a socket,
+ * and the referenced file objects they stood for. The handles only mean
+ * the same in the same process, and as long as no socket was created or
+ * cleaned up since, which Generation keeps track of. */
+typedef struct _AFD_POLL_SET {
+    PEPROCESS Process;
+    LONG Generation;
+    UINT HandleCount;
+    PAFD_HANDLE FileObjects;
+    AFD_HANDLE Handles[1];
+} AFD_POLL_SET, *PAFD_POLL_SET;
+
 typedef struct _IRP_LIST {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -184,6 +206,8 @@ typedef struct _AFD_FCB {
     PVOID Context;
     DWORD PollState;
     NTSTATUS PollStatus[FD_MAX_EVENTS];
+    LIST_ENTRY PollWaiters;
+    PAFD_POLL_SET PollSet;
     NTSTATUS LastReceiveStatus;
     UINT ContextSize;
     PVOID ConnectData;
@@ -323,6 +347,9 @@ NTSTATUS NTAPI
 AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 	   PIO_STACK_LOCATION IrpSp );
 NTSTATUS NTAPI
+AfdSelectPollSet( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
 AfdEventSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 		PIO_STACK_LOCATION IrpSp );
 NTSTATUS NTAPI
@@ -331,6 +358,8 @@ AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceObject, PFILE_OBJECT FileObject );
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject, BOOLEAN ExclusiveOnly );
+VOID InvalidatePollSets( PAFD_DEVICE_EXTENSION DeviceExt );
+VOID FreePollSet( PAFD_FCB FCB );
 VOID ZeroEvents( PAFD_HANDLE HandleArray,
 		 UINT HandleCount );
 VOID SignalSocket(
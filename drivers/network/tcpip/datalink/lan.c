@@ -313,6 +313,7 @@ VOID LanReceiveWorker( PVOID Context ) {
     IP_PACKET IPPacket;
     BOOLEAN LegacyReceive;
     PIP_INTERFACE Interface;
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
 
     TI_DbgPrint(DEBUG_DATALINK, ("Called.\n"));
 
@@ -358,6 +359,22 @@ VOID LanReceiveWorker( PVOID Context ) {
 
         /* Calculate packet size (excluding media header) */
         NdisQueryPacketLength(IPPacket.NdisPacket, &IPPacket.TotalSize);
+
+        /* Checksums the adapter verified don't need to be checked again */
+        if (Interface->ChecksumOffload)
+        {
+            ChecksumInfo.Value = (ULONG)(ULONG_PTR)NDIS_PER_PACKET_INFO_FROM_PACKET(Packet,
+                                                                                   TcpIpChecksumPacketInfo);
+            if (ChecksumInfo.Receive.NdisPacketIpChecksumSucceeded &&
+                (Interface->ChecksumOffload & IP_CHECKSUM_RX_IP))
+                IPPacket.Flags |= IP_PACKET_FLAG_IP_CHECKSUM_OK;
+            if (ChecksumInfo.Receive.NdisPacketTcpChecksumSucceeded &&
+                (Interface->ChecksumOffload & IP_CHECKSUM_RX_TCP))
+                IPPacket.Flags |= IP_PACKET_FLAG_TCP_CHECKSUM_OK;
+            if (ChecksumInfo.Receive.NdisPacketUdpChecksumSucceeded &&
+                (Interface->ChecksumOffload & IP_CHECKSUM_RX_UDP))
+                IPPacket.Flags |= IP_PACKET_FLAG_UDP_CHECKSUM_OK;
+        }
     }
 
     TI_DbgPrint
@@ -1006,6 +1023,10 @@ VOID LANTransmit(
 
     RtlCopyMemory(Data + Adapter->HeaderSize, OldData, OldSize);
 
+    /* Pass on the checksums the adapter should fill in */
+    NDIS_PER_PACKET_INFO_FROM_PACKET(XmitPacket, TcpIpChecksumPacketInfo) =
+        NDIS_PER_PACKET_INFO_FROM_PACKET(NdisPacket, TcpIpChecksumPacketInfo);
+
     (*PC(NdisPacket)->DLComplete)(PC(NdisPacket)->Context, NdisPacket, NDIS_STATUS_SUCCESS);
 
     switch (Adapter->Media) {
@@ -1309,6 +1330,119 @@ VOID GetName( PUNICODE_STRING RegistryKey,
     AppendUnicodeString( OutName, &PartialRegistryKey, FALSE );
 }
 
+ULONG LANSetChecksumOffload(
+    PLAN_ADAPTER Adapter)
+/*
+ * FUNCTION: Enables the checksum offload tasks of an adapter we can use
+ * ARGUMENTS:
+ *     Adapter = Pointer to LAN_ADAPTER structure
+ * RETURNS:
+ *     Checksums the adapter computes (IP_CHECKSUM_xx flags)
+ */
+{
+    ULONG Buffer[64];
+    PNDIS_TASK_OFFLOAD_HEADER Header = (PNDIS_TASK_OFFLOAD_HEADER)Buffer;
+    PNDIS_TASK_OFFLOAD Task;
+    PNDIS_TASK_TCP_IP_CHECKSUM Capabilities = NULL, Enable;
+    NDIS_STATUS NdisStatus;
+    ULONG Offset, Offload = 0;
+
+    if (Adapter->Media != NdisMedium802_3)
+        return 0;
+
+    /* Ask for the tasks the adapter supports */
+    RtlZeroMemory(Buffer, sizeof(Buffer));
+    Header->Version = NDIS_TASK_OFFLOAD_VERSION;
+    Header->Size = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    Header->EncapsulationFormat.Encapsulation = IEEE_802_3_Encapsulation;
+    Header->EncapsulationFormat.Flags.FixedHeaderSize = 1;
+    Header->EncapsulationFormat.EncapsulationHeaderSize = Adapter->HeaderSize;
+
+    NdisStatus = NDISCall(Adapter,
+                          NdisRequestQueryInformation,
+                          OID_TCP_TASK_OFFLOAD,
+                          Buffer,
+                          sizeof(Buffer));
+    if (NdisStatus != NDIS_STATUS_SUCCESS)
+        return 0;
+
+    for (Offset = Header->OffsetFirstTask; Offset; Offset += Task->OffsetNextTask) {
+        if (Offset + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) > sizeof(Buffer))
+            break;
+
+        Task = (PNDIS_TASK_OFFLOAD)((PUCHAR)Buffer + Offset);
+        if (Task->Task == TcpIpChecksumNdisTask &&
+            Task->TaskBufferLength >= sizeof(NDIS_TASK_TCP_IP_CHECKSUM) &&
+            Offset + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) +
+                sizeof(NDIS_TASK_TCP_IP_CHECKSUM) <= sizeof(Buffer)) {
+            Capabilities = (PNDIS_TASK_TCP_IP_CHECKSUM)Task->TaskBuffer;
+            break;
+        }
+
+        if (!Task->OffsetNextTask)
+            break;
+    }
+
+    if (!Capabilities)
+        return 0;
+
+    /* We send TCP options, but never IP options */
+    if (Capabilities->V4Transmit.TcpChecksum && Capabilities->V4Transmit.TcpOptionsSupported)
+        Offload |= IP_CHECKSUM_TX_TCP;
+    if (Capabilities->V4Transmit.UdpChecksum)
+        Offload |= IP_CHECKSUM_TX_UDP;
+    if (Capabilities->V4Receive.IpChecksum)
+        Offload |= IP_CHECKSUM_RX_IP;
+    if (Capabilities->V4Receive.TcpChecksum)
+        Offload |= IP_CHECKSUM_RX_TCP;
+    if (Capabilities->V4Receive.UdpChecksum)
+        Offload |= IP_CHECKSUM_RX_UDP;
+
+    if (!Offload)
+        return 0;
+
+    /* Now enable just those */
+    RtlZeroMemory(Buffer, sizeof(Buffer));
+    Header->Version = NDIS_TASK_OFFLOAD_VERSION;
+    Header->Size = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    Header->OffsetFirstTask = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    Header->EncapsulationFormat.Encapsulation = IEEE_802_3_Encapsulation;
+    Header->EncapsulationFormat.Flags.FixedHeaderSize = 1;
+    Header->EncapsulationFormat.EncapsulationHeaderSize = Adapter->HeaderSize;
+
+    Task = (PNDIS_TASK_OFFLOAD)(Header + 1);
+    Task->Version = NDIS_TASK_OFFLOAD_VERSION;
+    Task->Size = sizeof(NDIS_TASK_OFFLOAD);
+    Task->Task = TcpIpChecksumNdisTask;
+    Task->OffsetNextTask = 0;
+    Task->TaskBufferLength = sizeof(NDIS_TASK_TCP_IP_CHECKSUM);
+
+    Enable = (PNDIS_TASK_TCP_IP_CHECKSUM)Task->TaskBuffer;
+    Enable->V4Transmit.TcpOptionsSupported = !!(Offload & IP_CHECKSUM_TX_TCP);
+    Enable->V4Transmit.TcpChecksum = !!(Offload & IP_CHECKSUM_TX_TCP);
+    Enable->V4Transmit.UdpChecksum = !!(Offload & IP_CHECKSUM_TX_UDP);
+    Enable->V4Receive.IpChecksum = !!(Offload & IP_CHECKSUM_RX_IP);
+    Enable->V4Receive.TcpChecksum = !!(Offload & IP_CHECKSUM_RX_TCP);
+    Enable->V4Receive.UdpChecksum = !!(Offload & IP_CHECKSUM_RX_UDP);
+
+    NdisStatus = NDISCall(Adapter,
+                          NdisRequestSetInformation,
+                          OID_TCP_TASK_OFFLOAD,
+                          Buffer,
+                          sizeof(NDIS_TASK_OFFLOAD_HEADER) +
+                          FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) +
+                          sizeof(NDIS_TASK_TCP_IP_CHECKSUM));
+    if (NdisStatus != NDIS_STATUS_SUCCESS) {
+        TI_DbgPrint(MIN_TRACE, ("Could not enable checksum offload (0x%X).\n", NdisStatus));
+        return 0;
+    }
+
+    TI_DbgPrint(DEBUG_DATALINK, ("Checksum offload enabled (0x%X).\n", Offload));
+
+    return Offload;
+}
+
+
 BOOLEAN BindAdapter(
     PLAN_ADAPTER Adapter,
     PNDIS_STRING RegistryPath)
@@ -1410,6 +1544,9 @@ BOOLEAN BindAdapter(
     if (NdisStatus != NDIS_STATUS_SUCCESS)
         return FALSE;
 
+    /* Let the adapter compute checksums if it can */
+    IF->ChecksumOffload = LANSetChecksumOffload(Adapter);
+
     /* Register interface with IP layer */
     IPRegisterInterface(IF);
 
@@ -15,6 +15,17 @@ ULONG ChecksumCompute(
     UINT Count,
     ULONG Seed);
 
+ULONG ChecksumCopy(
+    PVOID Destination,
+    PVOID Source,
+    UINT Count,
+    ULONG Seed);
+
+ULONG ChecksumPseudoHeaderIPv4(
+    PIPv4_HEADER IPHeader,
+    UCHAR Protocol,
+    USHORT Length);
+
 unsigned int
 csum_partial(
   const unsigned char * buff,
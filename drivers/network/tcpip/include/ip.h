@@ -91,6 +91,12 @@ typedef struct _IP_PACKET {
 } IP_PACKET, *PIP_PACKET;
 
 #define IP_PACKET_FLAG_RAW      0x01    /* Raw IP packet */
+#define IP_PACKET_FLAG_TCP_CHECKSUM     0x02    /* TCP checksum field holds the pseudo header sum,
+                                                 * the send path completes it */
+#define IP_PACKET_FLAG_UDP_CHECKSUM     0x04    /* Same for UDP */
+#define IP_PACKET_FLAG_IP_CHECKSUM_OK   0x08    /* IP header checksum was verified by the adapter */
+#define IP_PACKET_FLAG_TCP_CHECKSUM_OK  0x10    /* TCP checksum was verified by the adapter */
+#define IP_PACKET_FLAG_UDP_CHECKSUM_OK  0x20    /* UDP checksum was verified by the adapter */
 
 
 /* Packet context */
@@ -168,14 +174,30 @@ typedef struct _IP_INTERFACE {
     LL_TRANSMIT_ROUTINE Transmit; /* Pointer to transmit function */
     PVOID TCPContext;             /* TCP Content for this interface */
     SEND_RECV_STATS Stats;        /* Send/Receive statistics */
+    ULONG ChecksumOffload;        /* Checksums done by the adapter (see IP_CHECKSUM_xx below) */
 } IP_INTERFACE, *PIP_INTERFACE;
 
+/* Checksum offload flags */
+#define IP_CHECKSUM_TX_TCP      0x01    /* Adapter computes TCP checksums of sent packets */
+#define IP_CHECKSUM_TX_UDP      0x02    /* Adapter computes UDP checksums of sent packets */
+#define IP_CHECKSUM_RX_IP       0x04    /* Adapter verifies IP header checksums of received packets */
+#define IP_CHECKSUM_RX_TCP      0x08    /* Adapter verifies TCP checksums of received packets */
+#define IP_CHECKSUM_RX_UDP      0x10    /* Adapter verifies UDP checksums of received packets */
+
 typedef struct _IP_SET_ADDRESS {
     ULONG NteIndex;
     IPv4_RAW_ADDRESS Address;
     IPv4_RAW_ADDRESS Netmask;
 } IP_SET_ADDRESS, *PIP_SET_ADDRESS;
 
+/* Route remembered by RouteGetCachedRouteToDestination. It is valid as long
+ * as the route generation doesn't change */
+typedef struct _ROUTE_CACHE {
+    IP_ADDRESS Destination;            /* Destination the route was looked up for */
+    struct NEIGHBOR_CACHE_ENTRY *NCE;  /* NCE to send to */
+    LONG Generation;                   /* Route generation at the time of the lookup */
+} ROUTE_CACHE, *PROUTE_CACHE;
+
 #define IP_PROTOCOL_TABLE_SIZE 0x100
 
 typedef VOID (*IP_PROTOCOL_HANDLER)(
@@ -14,6 +14,14 @@
 #include <info.h>
 #include <arp.h>
 
+extern volatile LONG RouteGeneration;
+
 PNEIGHBOR_CACHE_ENTRY RouteGetRouteToDestination(PIP_ADDRESS Destination);
 
+PNEIGHBOR_CACHE_ENTRY RouteGetCachedRouteToDestination(
+    PROUTE_CACHE Cache,
+    PIP_ADDRESS Destination);
+
+VOID RouteInvalidateCaches(VOID);
+
 /* EOF */
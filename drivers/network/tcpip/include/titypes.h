@@ -154,6 +154,7 @@ typedef struct _ADDRESS_FILE {
     /* Associated listener (see transport/tcp/accept.c) */
     IP_ADDRESS AddrCache;                 /* One entry address cache (destination
                                              address of last packet transmitted) */
+    ROUTE_CACHE RouteCache;               /* Route of the last datagram sent */
     HANDLE ProcessId;                     /* Creator process ID */
     PVOID SubProcessTag;                  /* Creator process tag */
     LARGE_INTEGER CreationTime;           /* Time of creation */
@@ -275,6 +276,8 @@ typedef struct _CONNECTION_ENDPOINT {
     LIST_ENTRY ShutdownRequest;/* Queued shutdown requests */
 
     LIST_ENTRY PacketQueue;    /* Queued received packets waiting to be processed */
+    LIST_ENTRY ReceiveEventEntry; /* Entry on the deferred receive event list (tcpip thread only) */
+    BOOLEAN ReceiveEventPending;  /* The connection is on the deferred receive event list */
     
     /* Disconnect Timer */
     KTIMER DisconnectTimer;
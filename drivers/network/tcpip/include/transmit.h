@@ -27,6 +27,8 @@ typedef struct IPFRAGMENT_CONTEXT {
     PNEIGHBOR_CACHE_ENTRY NCE;          /* Pointer to NCE to use */
     KEVENT Event;                       /* Signalled when the transmission is complete */
     NDIS_STATUS Status;                 /* Status of the transmission */
+    UCHAR ChecksumProtocol;             /* Protocol of the checksum to complete while copying, 0 if none */
+    UINT ChecksumOffset;                /* Offset of that checksum in the data */
 } IPFRAGMENT_CONTEXT, *PIPFRAGMENT_CONTEXT;
 
 
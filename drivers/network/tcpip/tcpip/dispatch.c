@@ -978,15 +978,10 @@ NTSTATUS DispTdiSend(
   TI_DbgPrint(MID_TRACE,("TCPIP<<< Got an MDL: %x\n", Irp->MdlAddress));
   if (NT_SUCCESS(Status))
     {
-	PVOID Data;
-	UINT Len;
-
-	NdisQueryBuffer( Irp->MdlAddress, &Data, &Len );
-
 	TI_DbgPrint(MID_TRACE,("About to TCPSendData\n"));
 	Status = TCPSendData(
 	    TranContext->Handle.ConnectionContext,
-	    Data,
+	    Irp->MdlAddress,
 	    SendInfo->SendLength,
 	    &BytesSent,
 	    SendInfo->SendFlags,
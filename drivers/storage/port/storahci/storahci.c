@@ -118,6 +118,22 @@ AhciPortInitialize (
                                                                                   PortExtension->IdentifyDeviceData,
                                                                                   &mappedLength);
 
+    PortExtension->RecoveryCommandTablePhysicalAddress = StorPortGetPhysicalAddress(adapterExtension,
+                                                                                    NULL,
+                                                                                    PortExtension->RecoveryCommandTable,
+                                                                                    &mappedLength);
+
+    if ((mappedLength == 0) || ((PortExtension->RecoveryCommandTablePhysicalAddress.LowPart % 128) != 0))
+    {
+        AhciDebugPrint("\tRecoveryCommandTablePhysicalAddress mappedLength:%d\n", mappedLength);
+        return FALSE;
+    }
+
+    PortExtension->NcqErrorLogPhysicalAddress = StorPortGetPhysicalAddress(adapterExtension,
+                                                                           NULL,
+                                                                           PortExtension->NcqErrorLog,
+                                                                           &mappedLength);
+
     // set device power state flag to D0
     PortExtension->DevicePowerState = StorPowerDeviceD0;
 
@@ -172,7 +188,9 @@ AhciAllocateResourceForAdapter (
     AdapterExtension->PortCount = portCount;
     nonCachedExtensionSize =    sizeof(AHCI_COMMAND_HEADER) * AlignedNCS + //should be 1K aligned
                                 sizeof(AHCI_RECEIVED_FIS) +
-                                sizeof(IDENTIFY_DEVICE_DATA);
+                                sizeof(IDENTIFY_DEVICE_DATA) +
+                                128 + sizeof(AHCI_COMMAND_TABLE) + // should be 128 byte aligned
+                                DEVICE_ATA_BLOCK_SIZE;             // NCQ Command Error log
 
     // align nonCachedExtensionSize to 1024
     nonCachedExtensionSize = ROUND_UP(nonCachedExtensionSize, 1024);
@@ -206,6 +224,12 @@ AhciAllocateResourceForAdapter (
 
             PortExtension->ReceivedFIS = (PAHCI_RECEIVED_FIS)tmp;
             PortExtension->IdentifyDeviceData = (PIDENTIFY_DEVICE_DATA)(tmp + sizeof(AHCI_RECEIVED_FIS));
+
+            tmp = (PCHAR)(PortExtension->IdentifyDeviceData + 1);
+            tmp = nonCachedExtension + ROUND_UP((ULONG)(tmp - nonCachedExtension), 128);
+
+            PortExtension->RecoveryCommandTable = (PAHCI_COMMAND_TABLE)tmp;
+            PortExtension->NcqErrorLog = (PUCHAR)(tmp + sizeof(AHCI_COMMAND_TABLE));
             PortExtension->MaxPortQueueDepth = NCS;
             nonCachedExtension += nonCachedExtensionSize;
         }
@@ -446,14 +470,11 @@ AhciCommandCompletionDpcRoutine (
 
     NT_ASSERT(Srb != NULL);
 
+    // failed requests are completed here too, with the error status set by the interrupt handler
     if (Srb->SrbStatus == SRB_STATUS_PENDING)
     {
         Srb->SrbStatus = SRB_STATUS_SUCCESS;
     }
-    else
-    {
-        return;
-    }
 
     SrbExtension = GetSrbExtension(Srb);
 
@@ -497,8 +518,9 @@ AhciHwPassiveInitialize (
         if ((AdapterExtension->PortImplemented & (0x1 << index)) != 0)
         {
             PortExtension = &AdapterExtension->PortExtension[index];
-            PortExtension->DeviceParams.IsActive = AhciStartPort(PortExtension);
             StorPortInitializeDpc(AdapterExtension, &PortExtension->CommandCompletion, AhciCommandCompletionDpcRoutine);
+            StorPortInitializeDpc(AdapterExtension, &PortExtension->ErrorRecoveryDpc, AhciErrorRecoveryDpcRoutine);
+            PortExtension->DeviceParams.IsActive = AhciStartPort(PortExtension);
         }
     }
 
@@ -579,7 +601,7 @@ AhciCompleteIssuedSrb (
 
     for (i = 0; i < NCS; i++)
     {
-        if (((1 << i) & CommandsToComplete) != 0)
+        if (((1UL << i) & CommandsToComplete) != 0)
         {
             Srb = PortExtension->Slot[i];
 
@@ -588,6 +610,10 @@ AhciCompleteIssuedSrb (
                 continue;
             }
 
+            // release the slot
+            PortExtension->Slot[i] = NULL;
+            PortExtension->NcqSlots &= ~(1UL << i);
+
             SrbExtension = GetSrbExtension(Srb);
             NT_ASSERT(SrbExtension != NULL);
 
@@ -598,8 +624,10 @@ AhciCompleteIssuedSrb (
             }
             else
             {
-                NT_ASSERT(Srb->SrbStatus == SRB_STATUS_PENDING);
-                Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                if (Srb->SrbStatus == SRB_STATUS_PENDING)
+                {
+                    Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                }
                 StorPortNotification(RequestComplete, AdapterExtension, Srb);
             }
         }
@@ -608,9 +636,374 @@ AhciCompleteIssuedSrb (
     return;
 }// -- AhciCompleteIssuedSrb();
 
+/**
+ * @name AhciFailIssuedSrb
+ * @implemented
+ *
+ * Complete the Srbs of the given slots with an error
+ *
+ * @param PortExtension
+ * @param CommandsToFail
+ *
+ */
+VOID
+AhciFailIssuedSrb (
+    __in PAHCI_PORT_EXTENSION PortExtension,
+    __in ULONG CommandsToFail
+    )
+{
+    ULONG i;
+
+    AhciDebugPrint("AhciFailIssuedSrb()\n");
+
+    if (CommandsToFail == 0)
+    {
+        return;
+    }
+
+    AhciDebugPrint("\tFailed Commands: %x\n", CommandsToFail);
+
+    for (i = 0; i < MAXIMUM_AHCI_PORT_NCS; i++)
+    {
+        if ((((1UL << i) & CommandsToFail) != 0) && (PortExtension->Slot[i] != NULL))
+        {
+            PortExtension->Slot[i]->SrbStatus = SRB_STATUS_ERROR;
+        }
+    }
+
+    AhciCompleteIssuedSrb(PortExtension, CommandsToFail);
+    return;
+}// -- AhciFailIssuedSrb();
+
+/**
+ * @name AhciRequeueSlots
+ * @implemented
+ *
+ * Program the command headers of the given slots again, and queue them for issue
+ *
+ * @param PortExtension
+ * @param Slots
+ *
+ */
+VOID
+AhciRequeueSlots (
+    __in PAHCI_PORT_EXTENSION PortExtension,
+    __in ULONG Slots
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < MAXIMUM_AHCI_PORT_NCS; i++)
+    {
+        if ((((1UL << i) & Slots) != 0) && (PortExtension->Slot[i] != NULL))
+        {
+            AhciProcessSrb(PortExtension, PortExtension->Slot[i], i);
+        }
+    }
+
+    return;
+}// -- AhciRequeueSlots();
+
+/**
+ * @name AhciRestartPort
+ * @implemented
+ *
+ * 6.2.2.1 / 6.2.2.2
+ * Stop the port after a fatal error, reset the device if it is still busy and start the port again.
+ * Every command outstanding on the port is dropped.
+ *
+ * @param PortExtension
+ *
+ * @return
+ * return TRUE if the port is running again
+ */
+BOOLEAN
+AhciRestartPort (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    ULONG ticks;
+    AHCI_PORT_CMD cmd;
+    AHCI_TASK_FILE_DATA tfd;
+    AHCI_SERIAL_ATA_STATUS ssts;
+    AHCI_SERIAL_ATA_CONTROL sctl;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+
+    AhciDebugPrint("AhciRestartPort()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
+    // clearing PxCMD.ST resets PxCI and PxSACT, PxCMD.CR should clear within 500 milliseconds
+    cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+    cmd.ST = 0;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CMD, cmd.Status);
+
+    for (ticks = 0; ticks < 50; ticks++)
+    {
+        cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+        if (cmd.CR == 0)
+        {
+            break;
+        }
+        StorPortStallExecution(10000);
+    }
+
+    if (cmd.CR != 0)
+    {
+        AhciDebugPrint("\tPxCMD.CR did not clear\n");
+        return FALSE;
+    }
+
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SERR, (ULONG)~0);
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, (ULONG)~0);
+    StorPortWriteRegisterUlong(AdapterExtension, AdapterExtension->IS, (1 << PortExtension->PortNumber));
+
+    // If PxTFD.STS.BSY or PxTFD.STS.DRQ is still set the device needs a COMRESET (10.4.2)
+    tfd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->TFD);
+    if ((tfd.STS.BSY) || (tfd.STS.DRQ))
+    {
+        AhciDebugPrint("\tCOMRESET\n");
+
+        sctl.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL);
+        sctl.DET = 1;
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
+
+        StorPortStallExecution(1000);
+
+        sctl.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL);
+        sctl.DET = 0;
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
+
+        for (ticks = 0; ticks < 30; ticks++)
+        {
+            StorPortStallExecution(1000);
+            ssts.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SSTS);
+            if (ssts.DET == 0x3)
+            {
+                break;
+            }
+        }
+
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SERR, (ULONG)~0);
+    }
+
+    return AhciStartPort(PortExtension);
+}// -- AhciRestartPort();
+
+/**
+ * @name AhciIssueNcqErrorLog
+ * @implemented
+ *
+ * Read the NCQ Command Error log (READ LOG EXT, page 10h) through command slot 0,
+ * the command table and the log buffer are reserved for the port.
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciIssueNcqErrorLog (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    PAHCI_COMMAND_TABLE cmdTable;
+    PAHCI_COMMAND_HEADER CommandHeader;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+
+    AhciDebugPrint("AhciIssueNcqErrorLog()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+    cmdTable = PortExtension->RecoveryCommandTable;
+    CommandHeader = &PortExtension->CommandList[0];
+
+    AhciZeroMemory((PCHAR)cmdTable->CFIS, sizeof(cmdTable->CFIS));
+
+    cmdTable->CFIS[AHCI_ATA_CFIS_FisType] = FIS_TYPE_REG_H2D;       // FIS Type
+    cmdTable->CFIS[AHCI_ATA_CFIS_PMPort_C] = (1 << 7);              // PM Port & C
+    cmdTable->CFIS[AHCI_ATA_CFIS_CommandReg] = IDE_COMMAND_READ_LOG_EXT;
+    cmdTable->CFIS[AHCI_ATA_CFIS_LBA0] = IDE_LOG_NCQ_COMMAND_ERROR; // Log Address
+    cmdTable->CFIS[AHCI_ATA_CFIS_Device] = 0xA0;
+    cmdTable->CFIS[AHCI_ATA_CFIS_SectorCountLow] = 1;               // single page
+
+    cmdTable->PRDT[0].DBA = PortExtension->NcqErrorLogPhysicalAddress.LowPart;
+    cmdTable->PRDT[0].DBAU = 0;
+    if (IsAdapterCAPS64(AdapterExtension->CAP))
+    {
+        cmdTable->PRDT[0].DBAU = PortExtension->NcqErrorLogPhysicalAddress.HighPart;
+    }
+    cmdTable->PRDT[0].DBC = DEVICE_ATA_BLOCK_SIZE - 1;
+    cmdTable->PRDT[0].I = 0;
+
+    CommandHeader->DI.Status = 0;
+    CommandHeader->DI.PRDTL = 1;
+    CommandHeader->DI.CFL = 5;
+    CommandHeader->PRDBC = 0;
+    CommandHeader->CTBA = PortExtension->RecoveryCommandTablePhysicalAddress.LowPart;
+    CommandHeader->CTBA_U = 0;
+    if (IsAdapterCAPS64(AdapterExtension->CAP))
+    {
+        CommandHeader->CTBA_U = PortExtension->RecoveryCommandTablePhysicalAddress.HighPart;
+    }
+
+    PortExtension->DeviceParams.NcqErrorRecovery = TRUE;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CI, 1);
+
+    return;
+}// -- AhciIssueNcqErrorLog();
+
+/**
+ * @name AhciNcqErrorLogCompletion
+ * @implemented
+ *
+ * The NCQ Command Error log names the tag of the failed command, that one is failed
+ * and the commands the device aborted along with it are issued again.
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciNcqErrorLogCompletion (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    UCHAR log;
+    ULONG tag, abortedSlots;
+
+    AhciDebugPrint("AhciNcqErrorLogCompletion()\n");
+
+    log = PortExtension->NcqErrorLog[0];
+    tag = log & IDE_LOG_NCQ_ERROR_TAG_MASK;
+
+    abortedSlots = PortExtension->ErrorRecoverySlots;
+    PortExtension->ErrorRecoverySlots = 0;
+    PortExtension->DeviceParams.NcqErrorRecovery = FALSE;
+
+    if (((log & IDE_LOG_NCQ_ERROR_NQ) != 0) || ((abortedSlots & (1UL << tag)) == 0))
+    {
+        // we can't tell which command failed, retrying them could fail forever
+        AhciDebugPrint("\tNo outstanding command failed: %x\n", log);
+        AhciFailIssuedSrb(PortExtension, abortedSlots);
+        abortedSlots = 0;
+    }
+    else
+    {
+        AhciDebugPrint("\tCommand in slot %d failed\n", tag);
+        AhciFailIssuedSrb(PortExtension, (1UL << tag));
+        abortedSlots &= ~(1UL << tag);
+    }
+
+    // slot 0 was borrowed for the log, reprogram it if it holds a command waiting for issue
+    AhciRequeueSlots(PortExtension, abortedSlots | (PortExtension->QueueSlots & 1));
+
+    return;
+}// -- AhciNcqErrorLogCompletion();
+
+/**
+ * @name AhciErrorRecoveryDpcRoutine
+ * @implemented
+ *
+ * 6.2.2 Software Error Recovery
+ * Restarting the port can take more than half a second, so it is done here instead of in the
+ * interrupt handler, without holding the interrupt lock. The interrupt handler and
+ * AhciActivatePort leave the port alone until the recovery is over.
+ *
+ * @param Dpc
+ * @param HwDeviceExtension
+ * @param SystemArgument1
+ * @param SystemArgument2
+ */
+VOID
+AhciErrorRecoveryDpcRoutine (
+    __in PSTOR_DPC Dpc,
+    __in PVOID HwDeviceExtension,
+    __in PVOID SystemArgument1,
+    __in PVOID SystemArgument2
+  )
+{
+    BOOLEAN restarted;
+    ULONG ci, sact, outstanding, failedSlots;
+    AHCI_INTERRUPT_STATUS PxIS;
+    STOR_LOCK_HANDLE lockhandle = {0};
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+    PAHCI_PORT_EXTENSION PortExtension;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    AhciDebugPrint("AhciErrorRecoveryDpcRoutine()\n");
+
+    AdapterExtension = (PAHCI_ADAPTER_EXTENSION)HwDeviceExtension;
+    PortExtension = (PAHCI_PORT_EXTENSION)SystemArgument1;
+
+    StorPortAcquireSpinLock(AdapterExtension, InterruptLock, NULL, &lockhandle);
+
+    NT_ASSERT(PortExtension->DeviceParams.ErrorRecovery);
+    PxIS.Status = PortExtension->ErrorInterruptStatus;
+
+    // commands whose bits were cleared before the error have completed successfully
+    ci = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CI);
+    sact = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SACT);
+
+    outstanding = ci | sact;
+    if ((PortExtension->CommandIssuedSlots & (~outstanding)) != 0)
+    {
+        AhciCompleteIssuedSrb(PortExtension, (PortExtension->CommandIssuedSlots & (~outstanding)));
+    }
+
+    failedSlots = PortExtension->CommandIssuedSlots & outstanding;
+    PortExtension->CommandIssuedSlots = 0;
+
+    StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+
+    restarted = AhciRestartPort(PortExtension);
+
+    StorPortAcquireSpinLock(AdapterExtension, InterruptLock, NULL, &lockhandle);
+
+    PortExtension->DeviceParams.ErrorRecovery = FALSE;
+    PortExtension->ErrorInterruptStatus = 0;
+
+    // On a task file error the device aborts every outstanding native queued command,
+    // the NCQ Command Error log tells which one actually failed
+    if (restarted && PxIS.TFES &&
+        ((failedSlots & PortExtension->NcqSlots) != 0) &&
+        (PortExtension->DeviceParams.NcqErrorRecovery == FALSE))
+    {
+        PortExtension->ErrorRecoverySlots = failedSlots;
+        AhciIssueNcqErrorLog(PortExtension);
+
+        StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+        return;
+    }
+
+    // non-queued command, or the recovery itself failed
+    failedSlots |= PortExtension->ErrorRecoverySlots;
+    PortExtension->ErrorRecoverySlots = 0;
+
+    if (!restarted)
+    {
+        failedSlots |= PortExtension->QueueSlots;
+        PortExtension->QueueSlots = 0;
+    }
+
+    AhciFailIssuedSrb(PortExtension, failedSlots);
+
+    if (PortExtension->DeviceParams.NcqErrorRecovery)
+    {
+        PortExtension->DeviceParams.NcqErrorRecovery = FALSE;
+        AhciRequeueSlots(PortExtension, (PortExtension->QueueSlots & 1));
+    }
+
+    // fill the released slots and issue whatever is waiting
+    AhciAssignSlots(PortExtension);
+    AhciActivatePort(PortExtension);
+
+    StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+
+    return;
+}// -- AhciErrorRecoveryDpcRoutine();
+
 /**
  * @name AhciInterruptHandler
- * @not_implemented
+ * @implemented
  *
  * Interrupt Handler for PortExtension
  *
@@ -652,7 +1045,8 @@ AhciInterruptHandler (
     // 6.2.2
     // Fatal Error
     // signified by the setting of PxIS.HBFS, PxIS.HBDS, PxIS.IFS, or PxIS.TFES
-    if (PxIS.HBFS || PxIS.HBDS || PxIS.IFS || PxIS.TFES)
+    if (PortExtension->DeviceParams.ErrorRecovery ||
+        PxIS.HBFS || PxIS.HBDS || PxIS.IFS || PxIS.TFES)
     {
         // In this state, the HBA shall not issue any new commands nor acknowledge DMA Setup FISes to process
         // any native command queuing commands. To recover, the port must be restarted
@@ -662,7 +1056,20 @@ AhciInterruptHandler (
         // software should perform the appropriate error recovery actions based on whether
         // non-queued commands were being issued or native command queuing commands were being issued.
 
+        // The port is restarted by AhciErrorRecoveryDpcRoutine, which waits for it to stop
+        // and may have to reset the device. Until then the port only gets its interrupts cleared.
+
         AhciDebugPrint("\tFatal Error: %x\n", PxIS.Status);
+        PortExtension->ErrorInterruptStatus |= PxIS.Status;
+        if (PortExtension->DeviceParams.ErrorRecovery == FALSE)
+        {
+            PortExtension->DeviceParams.ErrorRecovery = TRUE;
+            StorPortIssueDpc(AdapterExtension, &PortExtension->ErrorRecoveryDpc, PortExtension, NULL);
+        }
+
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, PxIS.Status);
+        StorPortWriteRegisterUlong(AdapterExtension, AdapterExtension->IS, (1 << PortExtension->PortNumber));
+        return;
     }
 
     // Normal Command Completion
@@ -692,13 +1099,28 @@ AhciInterruptHandler (
     ci = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CI);
     sact = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SACT);
 
-    outstanding = ci | sact; // NOTE: Including both non-NCQ and NCQ based commands
-    if ((PortExtension->CommandIssuedSlots & (~outstanding)) != 0)
+    if (PortExtension->DeviceParams.NcqErrorRecovery)
     {
-        AhciCompleteIssuedSrb(PortExtension, (PortExtension->CommandIssuedSlots & (~outstanding)));
-        PortExtension->CommandIssuedSlots &= outstanding;
+        // READ LOG EXT runs alone in slot 0
+        if ((ci & 1) == 0)
+        {
+            AhciNcqErrorLogCompletion(PortExtension);
+        }
+    }
+    else
+    {
+        outstanding = ci | sact; // NOTE: Including both non-NCQ and NCQ based commands
+        if ((PortExtension->CommandIssuedSlots & (~outstanding)) != 0)
+        {
+            AhciCompleteIssuedSrb(PortExtension, (PortExtension->CommandIssuedSlots & (~outstanding)));
+            PortExtension->CommandIssuedSlots &= outstanding;
+        }
     }
 
+    // fill the released slots and issue whatever is waiting
+    AhciAssignSlots(PortExtension);
+    AhciActivatePort(PortExtension);
+
     return;
 }// -- AhciInterruptHandler();
 
@@ -1403,6 +1825,12 @@ AhciProcessSrb (
     NT_ASSERT(SlotIndex < AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
     SrbExtension->SlotIndex = SlotIndex;
 
+    // FPDMA QUEUED commands carry the command slot as their tag in SectorCount(7:3)
+    if (IsNcqCommand(SrbExtension))
+    {
+        SrbExtension->SectorCountLow = (UCHAR)(SlotIndex << 3);
+    }
+
     // program the CFIS in the CommandTable
     CommandHeader = &PortExtension->CommandList[SlotIndex];
 
@@ -1467,7 +1895,16 @@ AhciProcessSrb (
 
     // mark this slot
     PortExtension->Slot[SlotIndex] = Srb;
-    PortExtension->QueueSlots |= 1 << SlotIndex;
+    PortExtension->QueueSlots |= 1UL << SlotIndex;
+
+    if (IsNcqCommand(SrbExtension))
+    {
+        PortExtension->NcqSlots |= 1UL << SlotIndex;
+    }
+    else
+    {
+        PortExtension->NcqSlots &= ~(1UL << SlotIndex);
+    }
     return;
 }// -- AhciProcessSrb();
 
@@ -1481,18 +1918,13 @@ AhciProcessSrb (
  *
  */
 
-#ifdef _MSC_VER     // avoid MSVC C4700
-    #pragma warning(push)
-    #pragma warning(disable: 4700)
-#endif
-
 VOID
 AhciActivatePort (
     __in PAHCI_PORT_EXTENSION PortExtension
     )
 {
     AHCI_PORT_CMD cmd;
-    ULONG QueueSlots, slotToActivate, tmp;
+    ULONG QueueSlots, slotToActivate, nonQueuedSlots;
     PAHCI_ADAPTER_EXTENSION AdapterExtension;
 
     AhciDebugPrint("AhciActivatePort()\n");
@@ -1500,7 +1932,10 @@ AhciActivatePort (
     AdapterExtension = PortExtension->AdapterExtension;
     QueueSlots = PortExtension->QueueSlots;
 
-    if (QueueSlots == 0)
+    // nothing goes out while the NCQ error log is being read or the port is being restarted
+    if ((QueueSlots == 0) ||
+        (PortExtension->DeviceParams.NcqErrorRecovery) ||
+        (PortExtension->DeviceParams.ErrorRecovery))
     {
         return;
     }
@@ -1514,13 +1949,30 @@ AhciActivatePort (
         return;
     }
 
-    // get the lowest set bit
-    tmp = QueueSlots & (QueueSlots - 1);
+    // Native queued and non-queued commands can't be outstanding at the same time.
+    // A waiting non-queued command holds back new queued ones, so it doesn't starve.
+    nonQueuedSlots = QueueSlots & (~PortExtension->NcqSlots);
+    if (nonQueuedSlots != 0)
+    {
+        if (PortExtension->CommandIssuedSlots != 0)
+        {
+            return;
+        }
 
-    if (tmp == 0)
-        slotToActivate = QueueSlots;
+        // get the lowest set bit
+        slotToActivate = nonQueuedSlots & (~(nonQueuedSlots - 1));
+    }
     else
-        slotToActivate = (QueueSlots & (~tmp));
+    {
+        if ((PortExtension->CommandIssuedSlots & (~PortExtension->NcqSlots)) != 0)
+        {
+            return;
+        }
+
+        // issue all of them at once, PxSACT must be set before PxCI (5.3.2.3)
+        slotToActivate = QueueSlots;
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SACT, slotToActivate);
+    }
 
     // mark that bit off in QueueSlots
     // so we can know we it is really needed to activate port or not
@@ -1535,9 +1987,58 @@ AhciActivatePort (
     return;
 }// -- AhciActivatePort();
 
-#ifdef _MSC_VER     // avoid MSVC C4700
-    #pragma warning(pop)
-#endif
+/**
+ * @name AhciAssignSlots
+ * @implemented
+ *
+ * Move pending Srbs to the free command slots of the port, caller must hold the InterruptLock
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciAssignSlots (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    PSCSI_REQUEST_BLOCK Srb;
+    ULONG freeSlots, occupiedSlots, slotIndex;
+
+    AhciDebugPrint("AhciAssignSlots()\n");
+
+    // Busy command slots for given port, NCQ error recovery holds slot 0 and the aborted slots
+    occupiedSlots = (PortExtension->QueueSlots |
+                     PortExtension->CommandIssuedSlots |
+                     PortExtension->ErrorRecoverySlots);
+
+    if (PortExtension->DeviceParams.NcqErrorRecovery)
+    {
+        occupiedSlots |= 1;
+    }
+
+    // NCQ tags are limited by the device queue depth too
+    freeSlots = AHCI_SLOT_MASK(PortExtension->MaxPortQueueDepth) & (~occupiedSlots);
+
+    for (slotIndex = 0; (freeSlots != 0) && (slotIndex < MAXIMUM_AHCI_PORT_NCS); slotIndex++)
+    {
+        if ((freeSlots & (1UL << slotIndex)) == 0)
+        {
+            continue;
+        }
+
+        Srb = RemoveQueue(&PortExtension->SrbQueue);
+        if (Srb == NULL)
+        {
+            break;
+        }
+
+        NT_ASSERT(Srb->PathId == PortExtension->PortNumber);
+        AhciProcessSrb(PortExtension, Srb, slotIndex);
+        freeSlots &= ~(1UL << slotIndex);
+    }
+
+    return;
+}// -- AhciAssignSlots();
 
 /**
  * @name AhciProcessIO
@@ -1558,10 +2059,8 @@ AhciProcessIO (
     __in PSCSI_REQUEST_BLOCK Srb
     )
 {
-    PSCSI_REQUEST_BLOCK tmpSrb;
     STOR_LOCK_HANDLE lockhandle = {0};
     PAHCI_PORT_EXTENSION PortExtension;
-    ULONG commandSlotMask, occupiedSlots, slotIndex, NCS;
 
     AhciDebugPrint("AhciProcessIO()\n");
     AhciDebugPrint("\tPathId: %d\n", PathId);
@@ -1583,36 +2082,8 @@ AhciProcessIO (
         return; // we should wait for device to get active
     }
 
-    occupiedSlots = (PortExtension->QueueSlots | PortExtension->CommandIssuedSlots); // Busy command slots for given port
-    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
-    commandSlotMask = (1 << NCS) - 1; // available slots mask
-
-    commandSlotMask = (commandSlotMask & ~occupiedSlots);
-    if(commandSlotMask != 0)
-    {
-        // iterate over HBA port slots
-        for (slotIndex = 0; slotIndex < NCS; slotIndex++)
-        {
-            // find first free slot
-            if ((commandSlotMask & (1 << slotIndex)) != 0)
-            {
-                tmpSrb = RemoveQueue(&PortExtension->SrbQueue);
-                if (tmpSrb != NULL)
-                {
-                    NT_ASSERT(tmpSrb->PathId == PathId);
-                    AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
-                }
-                else
-                {
-                    break;
-                }
-            }
-            else
-            {
-                break;
-            }
-        }
-    }
+    // populate free command slots
+    AhciAssignSlots(PortExtension);
 
     // program HBA port
     AhciActivatePort(PortExtension);
@@ -1688,6 +2159,8 @@ InquiryCompletion (
 
 //    PCDB cdb;
     BOOLEAN status;
+    UCHAR NcqSupported;
+    ULONG MaxQueueDepth;
     PINQUIRYDATA InquiryData;
     PAHCI_SRB_EXTENSION SrbExtension;
     PAHCI_ADAPTER_EXTENSION AdapterExtension;
@@ -1735,6 +2208,28 @@ InquiryCompletion (
             PortExtension->DeviceParams.Lba48BitMode = 1;
         }
 
+        // Native Command Queuing needs HBA and device support, FPDMA QUEUED commands use 48-bit LBA
+        MaxQueueDepth = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+        NcqSupported = 0;
+#ifdef AHCI_ENABLE_NCQ
+        if (IsAdapterCAPSNCQ(AdapterExtension->CAP) &&
+            (IdentifyDeviceData->ReservedWords76[0] & IDENTIFY_SATA_CAPABILITIES_NCQ) &&
+            (PortExtension->DeviceParams.Lba48BitMode))
+        {
+            NcqSupported = 1;
+
+            // QueueDepth is 0's based, tags above it are invalid
+            if (MaxQueueDepth > (ULONG)IdentifyDeviceData->QueueDepth + 1)
+            {
+                MaxQueueDepth = IdentifyDeviceData->QueueDepth + 1;
+            }
+        }
+#endif
+
+        AhciDebugPrint("\tNCQ: %d Queue Depth: %d\n", NcqSupported, MaxQueueDepth);
+        PortExtension->MaxPortQueueDepth = MaxQueueDepth;
+        PortExtension->DeviceParams.NcqSupported = NcqSupported;
+
         PortExtension->DeviceParams.AccessType = DIRECT_ACCESS_DEVICE;
 
         /* Device max address lba */
@@ -1798,7 +2293,7 @@ InquiryCompletion (
     // prepare data to send
     InquiryData->Versions = 2;
     InquiryData->Wide32Bit = 1;
-    InquiryData->CommandQueue = 0; // NCQ not supported
+    InquiryData->CommandQueue = PortExtension->DeviceParams.NcqSupported;
     InquiryData->ResponseDataFormat = 0x2;
     InquiryData->DeviceTypeModifier = 0;
     InquiryData->DeviceTypeQualifier = DEVICE_CONNECTED;
@@ -1820,7 +2315,7 @@ InquiryCompletion (
                                          Srb->PathId,
                                          Srb->TargetId,
                                          Srb->Lun,
-                                         AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
+                                         PortExtension->MaxPortQueueDepth);
 
     NT_ASSERT(status == TRUE);
     return;
@@ -2027,7 +2522,7 @@ DeviceRequestReadWrite (
     NT_ASSERT(SectorCount > 0);
 
     SrbExtension->AtaFunction = ATA_FUNCTION_ATA_READ;
-    SrbExtension->Flags |= ATA_FLAGS_USE_DMA;
+    SrbExtension->Flags = ATA_FLAGS_USE_DMA;
     SrbExtension->CompletionRoutine = NULL;
 
     if (IsReading)
@@ -2074,6 +2569,28 @@ DeviceRequestReadWrite (
     SrbExtension->SectorCountLow = (SectorCount >> 0) & 0xFF;
     SrbExtension->SectorCountHigh = (SectorCount >> 8) & 0xFF;
 
+    if (PortExtension->DeviceParams.NcqSupported)
+    {
+        // READ/WRITE FPDMA QUEUED take the sector count in the features register,
+        // the tag is stored in SectorCount once AhciProcessSrb has picked a slot
+        SrbExtension->Flags |= ATA_FLAGS_NCQ_COMMAND;
+
+        if (IsReading)
+        {
+            SrbExtension->CommandReg = IDE_COMMAND_READ_FPDMA_QUEUED;
+        }
+        else
+        {
+            SrbExtension->CommandReg = IDE_COMMAND_WRITE_FPDMA_QUEUED;
+        }
+
+        SrbExtension->FeaturesLow = SrbExtension->SectorCountLow;
+        SrbExtension->FeaturesHigh = SrbExtension->SectorCountHigh;
+        SrbExtension->SectorCountLow = 0;
+        SrbExtension->SectorCountHigh = 0;
+        SrbExtension->Device = IDE_LBA_MODE;
+    }
+
     NT_ASSERT(SectorCount < 0x100);
 
     SrbExtension->pSgl = (PLOCAL_SCATTER_GATHER_LIST)StorPortGetScatterGatherList(AdapterExtension, Srb);
@@ -2284,7 +2801,7 @@ DeviceInquiryRequest (
         NT_ASSERT(SrbExtension != NULL);
 
         SrbExtension->AtaFunction = ATA_FUNCTION_ATA_IDENTIFY;
-        SrbExtension->Flags |= ATA_FLAGS_DATA_IN;
+        SrbExtension->Flags = ATA_FLAGS_DATA_IN;
         SrbExtension->CompletionRoutine = InquiryCompletion;
         SrbExtension->CommandReg = IDE_COMMAND_NOT_VALID;
 
@@ -506,3 +506,82 @@ AfdGetInformation(
 
     return Status;
 }
+
+NTSTATUS
+AfdSelectPollSet(
+    _In_ HANDLE SocketHandle,
+    _In_reads_(HandleCount) const HANDLE *Handles,
+    _In_ ULONG HandleCount,
+    _In_ ULONG Events,
+    _In_ LONGLONG Timeout,
+    _Out_ PULONG Signalled)
+{
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    PAFD_POLL_INFO PollInfo;
+    ULONG PollInfoLength;
+    HANDLE Event;
+    ULONG i;
+
+    *Signalled = 0;
+
+    Status = NtCreateEvent(&Event,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           NotificationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    PollInfoLength = FIELD_OFFSET(AFD_POLL_INFO, Handles) + HandleCount * sizeof(AFD_HANDLE);
+    PollInfo = RtlAllocateHeap(RtlGetProcessHeap(),
+                               HEAP_ZERO_MEMORY,
+                               PollInfoLength);
+    if (!PollInfo)
+    {
+        NtClose(Event);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    PollInfo->Timeout.QuadPart = Timeout;
+    PollInfo->HandleCount = HandleCount;
+    PollInfo->Exclusive = FALSE;
+    for (i = 0; i < HandleCount; i++)
+    {
+        PollInfo->Handles[i].Handle = (SOCKET)Handles[i];
+        PollInfo->Handles[i].Events = Events;
+    }
+
+    Status = NtDeviceIoControlFile(SocketHandle,
+                                   Event,
+                                   NULL,
+                                   NULL,
+                                   &IoStatus,
+                                   IOCTL_AFD_SELECT_POLL_SET,
+                                   PollInfo,
+                                   PollInfoLength,
+                                   PollInfo,
+                                   PollInfoLength);
+    if (Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Event, FALSE, NULL);
+        Status = IoStatus.Status;
+    }
+
+    /* AFD returns the events each handle got in place of the requested ones */
+    if (NT_SUCCESS(Status))
+    {
+        for (i = 0; i < HandleCount && i < 32; i++)
+        {
+            if (PollInfo->Handles[i].Events & Events)
+                *Signalled |= 1 << i;
+        }
+    }
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, PollInfo);
+    NtClose(Event);
+
+    return Status;
+}
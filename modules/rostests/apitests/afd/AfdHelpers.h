@@ -56,3 +56,12 @@ AfdGetInformation(
     _In_opt_ PBOOLEAN Boolean,
     _In_opt_ PULONG Ulong,
     _In_opt_ PLARGE_INTEGER LargeInteger);
+
+NTSTATUS
+AfdSelectPollSet(
+    _In_ HANDLE SocketHandle,
+    _In_reads_(HandleCount) const HANDLE *Handles,
+    _In_ ULONG HandleCount,
+    _In_ ULONG Events,
+    _In_ LONGLONG Timeout,
+    _Out_ PULONG Signalled);
@@ -0,0 +1,117 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test for IOCTL_AFD_SELECT_POLL_SET
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+
+/* 1 ms, relative */
+#define TEST_TIMEOUT (-10 * 1000LL)
+
+static
+void
+TestPollSet(void)
+{
+    NTSTATUS Status;
+    HANDLE PollSocket, Udp, Tcp, Duplicate, Reused;
+    HANDLE Handles[3];
+    ULONG Signalled;
+    ULONG i;
+
+    /* Datagram sockets are writable right away, stream sockets only once connected */
+    Status = AfdCreateSocket(&PollSocket, AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(Status == STATUS_SUCCESS, "AfdCreateSocket failed with %lx\n", Status);
+    Status = AfdCreateSocket(&Udp, AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Status == STATUS_SUCCESS, "AfdCreateSocket failed with %lx\n", Status);
+    Status = AfdCreateSocket(&Tcp, AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(Status == STATUS_SUCCESS, "AfdCreateSocket failed with %lx\n", Status);
+
+    Handles[0] = Udp;
+    Handles[1] = Tcp;
+    Status = AfdSelectPollSet(PollSocket, Handles, 2, AFD_EVENT_SEND, TEST_TIMEOUT, &Signalled);
+    if (Status != STATUS_SUCCESS)
+    {
+        skip("IOCTL_AFD_SELECT_POLL_SET failed with %lx\n", Status);
+        goto Cleanup;
+    }
+    ok(Signalled == 0x1, "Signalled = %lx\n", Signalled);
+
+    /* The same set again, the poll set is reused */
+    for (i = 0; i < 4; i++)
+    {
+        Status = AfdSelectPollSet(PollSocket, Handles, 2, AFD_EVENT_SEND, TEST_TIMEOUT, &Signalled);
+        ok(Status == STATUS_SUCCESS, "[%lu] AfdSelectPollSet failed with %lx\n", i, Status);
+        ok(Signalled == 0x1, "[%lu] Signalled = %lx\n", i, Signalled);
+    }
+
+    /* Changing sets, each one replaces the last */
+    for (i = 0; i < 4; i++)
+    {
+        Handles[0] = Tcp;
+        Handles[1] = Udp;
+        Status = AfdSelectPollSet(PollSocket, Handles, 2, AFD_EVENT_SEND, TEST_TIMEOUT, &Signalled);
+        ok(Status == STATUS_SUCCESS, "[%lu] AfdSelectPollSet failed with %lx\n", i, Status);
+        ok(Signalled == 0x2, "[%lu] Signalled = %lx\n", i, Signalled);
+
+        Status = AfdSelectPollSet(PollSocket, Handles, 1, AFD_EVENT_SEND, TEST_TIMEOUT, &Signalled);
+        ok(Status == STATUS_TIMEOUT, "[%lu] AfdSelectPollSet failed with %lx\n", i, Status);
+        ok(Signalled == 0, "[%lu] Signalled = %lx\n", i, Signalled);
+
+        Handles[2] = Udp;
+        Status = AfdSelectPollSet(PollSocket, Handles, 3, AFD_EVENT_SEND, TEST_TIMEOUT, &Signalled);
+        ok(Status == STATUS_SUCCESS, "[%lu] AfdSelectPollSet failed with %lx\n", i, Status);
+        ok(Signalled == 0x6, "[%lu] Signalled = %lx\n", i, Signalled);
+    }
+
+    /* Closing a duplicate doesn't clean up its socket, and the handle value
+     * can come back for another one */
+    Status = NtDuplicateObject(NtCurrentProcess(), Udp,
+                               NtCurrentProcess(), &Duplicate,
+                               0, 0, DUPLICATE_SAME_ACCESS);
+    ok(Status == STATUS_SUCCESS, "NtDuplicateObject failed with %lx\n", Status);
+
+    Handles[0] = Duplicate;
+    for (i = 0; i < 2; i++)
+    {
+        Status = AfdSelectPollSet(PollSocket, Handles, 1, AFD_EVENT_SEND, TEST_TIMEOUT, &Signalled);
+        ok(Status == STATUS_SUCCESS, "[%lu] AfdSelectPollSet failed with %lx\n", i, Status);
+        ok(Signalled == 0x1, "[%lu] Signalled = %lx\n", i, Signalled);
+    }
+
+    NtClose(Duplicate);
+    Status = NtDuplicateObject(NtCurrentProcess(), Tcp,
+                               NtCurrentProcess(), &Reused,
+                               0, 0, DUPLICATE_SAME_ACCESS);
+    ok(Status == STATUS_SUCCESS, "NtDuplicateObject failed with %lx\n", Status);
+
+    if (Reused == Duplicate)
+    {
+        /* Same handle value, but it's the stream socket now */
+        Status = AfdSelectPollSet(PollSocket, Handles, 1, AFD_EVENT_SEND, TEST_TIMEOUT, &Signalled);
+        ok(Status == STATUS_TIMEOUT, "AfdSelectPollSet failed with %lx\n", Status);
+        ok(Signalled == 0, "Signalled = %lx\n", Signalled);
+    }
+    else
+    {
+        skip("Handle %p wasn't reused, got %p\n", Duplicate, Reused);
+    }
+
+    /* A closed handle must not be polled through the old poll set either */
+    NtClose(Reused);
+    Handles[0] = Reused;
+    Status = AfdSelectPollSet(PollSocket, Handles, 1, AFD_EVENT_SEND, TEST_TIMEOUT, &Signalled);
+    ok(!NT_SUCCESS(Status), "AfdSelectPollSet returned %lx\n", Status);
+    ok(Signalled == 0, "Signalled = %lx\n", Signalled);
+
+Cleanup:
+    NtClose(Tcp);
+    NtClose(Udp);
+    NtClose(PollSocket);
+}
+
+START_TEST(select)
+{
+    TestPollSet();
+}
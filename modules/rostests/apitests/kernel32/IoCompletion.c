@@ -0,0 +1,283 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Tests for GetQueuedCompletionStatusEx and completion notification modes
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+
+#ifndef FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+#define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+#endif
+
+#define TEST_PACKETS 100
+#define TEST_ENTRIES 200
+
+typedef BOOL (WINAPI *PGET_QUEUED_COMPLETION_STATUS_EX)(HANDLE, LPOVERLAPPED_ENTRY, ULONG, PULONG, DWORD, BOOL);
+typedef BOOL (WINAPI *PSET_FILE_COMPLETION_NOTIFICATION_MODES)(HANDLE, UCHAR);
+
+static PGET_QUEUED_COMPLETION_STATUS_EX pGetQueuedCompletionStatusEx;
+static PSET_FILE_COMPLETION_NOTIFICATION_MODES pSetFileCompletionNotificationModes;
+
+static LONG ApcCount;
+
+static
+VOID
+CALLBACK
+ApcRoutine(ULONG_PTR Parameter)
+{
+    ok(Parameter == 0x1234, "Parameter = %Ix\n", Parameter);
+    InterlockedIncrement(&ApcCount);
+}
+
+static
+VOID
+PostPackets(HANDLE Port, ULONG Count)
+{
+    ULONG i;
+    BOOL Ret;
+
+    for (i = 0; i < Count; i++)
+    {
+        Ret = PostQueuedCompletionStatus(Port, i, i, (LPOVERLAPPED)(ULONG_PTR)(i + 1));
+        ok(Ret, "[%lu] PostQueuedCompletionStatus failed with %lu\n", i, GetLastError());
+    }
+}
+
+static
+VOID
+TestBatches(VOID)
+{
+    static OVERLAPPED_ENTRY Entries[TEST_ENTRIES];
+    HANDLE Port;
+    ULONG Removed, Total, Calls, i;
+    BOOL Ret;
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(Port != NULL, "CreateIoCompletionPort failed with %lu\n", GetLastError());
+    if (!Port)
+        return;
+
+    /* Nothing to take */
+    SetLastError(0xdeadbeef);
+    Removed = 0x55555555;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, TEST_ENTRIES, &Removed, 0, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "Error = %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    /* An empty array isn't allowed */
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 0, &Removed, 0, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "Error = %lu\n", GetLastError());
+
+    /* More room than queued packets: all of them at once */
+    PostPackets(Port, 5);
+    Removed = 0;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, TEST_ENTRIES, &Removed, 0, FALSE);
+    ok(Ret == TRUE, "GetQueuedCompletionStatusEx failed with %lu\n", GetLastError());
+    ok(Removed == 5, "Removed = %lu\n", Removed);
+    for (i = 0; i < Removed; i++)
+    {
+        ok(Entries[i].lpCompletionKey == i, "[%lu] Key = %Iu\n", i, Entries[i].lpCompletionKey);
+        ok(Entries[i].dwNumberOfBytesTransferred == i, "[%lu] Bytes = %lu\n", i, Entries[i].dwNumberOfBytesTransferred);
+        ok(Entries[i].lpOverlapped == (LPOVERLAPPED)(ULONG_PTR)(i + 1), "[%lu] Overlapped = %p\n", i, Entries[i].lpOverlapped);
+    }
+
+    /* Less room than queued packets: the rest stays queued */
+    PostPackets(Port, 5);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 2, &Removed, 0, FALSE);
+    ok(Ret == TRUE, "GetQueuedCompletionStatusEx failed with %lu\n", GetLastError());
+    ok(Removed == 2, "Removed = %lu\n", Removed);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, TEST_ENTRIES, &Removed, 0, FALSE);
+    ok(Ret == TRUE, "GetQueuedCompletionStatusEx failed with %lu\n", GetLastError());
+    ok(Removed == 3, "Removed = %lu\n", Removed);
+    ok(Entries[0].lpCompletionKey == 2, "Key = %Iu\n", Entries[0].lpCompletionKey);
+
+    /* More than 64 packets, with room for all of them: the calls may return
+     * fewer, but every packet comes out once and in order */
+    PostPackets(Port, TEST_PACKETS);
+    Total = 0;
+    for (Calls = 0; Total < TEST_PACKETS && Calls < TEST_PACKETS; Calls++)
+    {
+        Removed = 0;
+        Ret = pGetQueuedCompletionStatusEx(Port, Entries, TEST_ENTRIES, &Removed, 0, FALSE);
+        ok(Ret == TRUE, "GetQueuedCompletionStatusEx failed with %lu\n", GetLastError());
+        if (!Ret)
+            break;
+
+        ok(Removed >= 1 && Removed <= TEST_PACKETS - Total, "Removed = %lu\n", Removed);
+        for (i = 0; i < Removed && Total + i < TEST_PACKETS; i++)
+        {
+            ok(Entries[i].lpCompletionKey == Total + i, "[%lu] Key = %Iu\n", Total + i, Entries[i].lpCompletionKey);
+        }
+        Total += Removed;
+    }
+    ok(Total == TEST_PACKETS, "Total = %lu\n", Total);
+    trace("%lu packets in %lu calls\n", Total, Calls);
+
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, TEST_ENTRIES, &Removed, 0, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "Error = %lu\n", GetLastError());
+
+    CloseHandle(Port);
+}
+
+static
+VOID
+TestWaits(VOID)
+{
+    OVERLAPPED_ENTRY Entries[4];
+    HANDLE Port;
+    ULONG Removed;
+    BOOL Ret;
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(Port != NULL, "CreateIoCompletionPort failed with %lu\n", GetLastError());
+    if (!Port)
+        return;
+
+    /* A timeout with an empty port */
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, _countof(Entries), &Removed, 50, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "Error = %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    /* A non-alertable wait doesn't run APCs */
+    ApcCount = 0;
+    Ret = QueueUserAPC(ApcRoutine, GetCurrentThread(), 0x1234);
+    ok(Ret, "QueueUserAPC failed with %lu\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, _countof(Entries), &Removed, 0, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "Error = %lu\n", GetLastError());
+    ok(ApcCount == 0, "ApcCount = %ld\n", ApcCount);
+
+    /* An alertable one returns once the APC ran */
+    SetLastError(0xdeadbeef);
+    Removed = 0x55555555;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, _countof(Entries), &Removed, INFINITE, TRUE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_IO_COMPLETION, "Error = %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+    ok(ApcCount == 1, "ApcCount = %ld\n", ApcCount);
+
+    /* With a packet queued, the packet is returned */
+    PostPackets(Port, 1);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, _countof(Entries), &Removed, INFINITE, TRUE);
+    ok(Ret == TRUE, "GetQueuedCompletionStatusEx failed with %lu\n", GetLastError());
+    ok(Removed == 1, "Removed = %lu\n", Removed);
+
+    CloseHandle(Port);
+}
+
+static
+VOID
+TestSkipOnSuccess(VOID)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    static CHAR Buffer[512];
+    OVERLAPPED Overlapped, *Completed;
+    HANDLE File, Port;
+    ULONG_PTR Key;
+    DWORD Bytes;
+    BOOL Ret;
+
+    if (!GetTempPathW(_countof(TempPath), TempPath) ||
+        !GetTempFileNameW(TempPath, L"iop", 0, FileName))
+    {
+        skip("No temporary file: %lu\n", GetLastError());
+        return;
+    }
+
+    File = CreateFileW(FileName,
+                       GENERIC_READ | GENERIC_WRITE,
+                       0,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_FLAG_OVERLAPPED | FILE_FLAG_DELETE_ON_CLOSE,
+                       NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    Port = CreateIoCompletionPort(File, NULL, 0x1234, 1);
+    ok(Port != NULL, "CreateIoCompletionPort failed with %lu\n", GetLastError());
+    if (!Port)
+    {
+        CloseHandle(File);
+        return;
+    }
+
+    /* Without the mode, even a synchronous success queues a packet */
+    RtlFillMemory(Buffer, sizeof(Buffer), 0x55);
+    RtlZeroMemory(&Overlapped, sizeof(Overlapped));
+    Ret = WriteFile(File, Buffer, sizeof(Buffer), NULL, &Overlapped);
+    ok(Ret || GetLastError() == ERROR_IO_PENDING, "WriteFile failed with %lu\n", GetLastError());
+    Completed = NULL;
+    Ret = GetQueuedCompletionStatus(Port, &Bytes, &Key, &Completed, 5000);
+    ok(Ret == TRUE, "GetQueuedCompletionStatus failed with %lu\n", GetLastError());
+    ok(Completed == &Overlapped, "Completed = %p\n", Completed);
+    ok(Key == 0x1234, "Key = %Ix\n", Key);
+    ok(Bytes == sizeof(Buffer), "Bytes = %lu\n", Bytes);
+
+    Ret = pSetFileCompletionNotificationModes(File, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS);
+    ok(Ret == TRUE, "SetFileCompletionNotificationModes failed with %lu\n", GetLastError());
+
+    /* With it, a synchronous success doesn't */
+    RtlZeroMemory(&Overlapped, sizeof(Overlapped));
+    Ret = ReadFile(File, Buffer, sizeof(Buffer), NULL, &Overlapped);
+    if (Ret)
+    {
+        ok(Overlapped.InternalHigh == sizeof(Buffer), "Bytes = %Iu\n", Overlapped.InternalHigh);
+        SetLastError(0xdeadbeef);
+        Ret = GetQueuedCompletionStatus(Port, &Bytes, &Key, &Completed, 0);
+        ok(Ret == FALSE, "A packet was queued for %p\n", Completed);
+        ok(GetLastError() == WAIT_TIMEOUT, "Error = %lu\n", GetLastError());
+    }
+    else
+    {
+        /* A pending request still completes through the port */
+        ok(GetLastError() == ERROR_IO_PENDING, "ReadFile failed with %lu\n", GetLastError());
+        skip("ReadFile didn't complete synchronously\n");
+        Ret = GetQueuedCompletionStatus(Port, &Bytes, &Key, &Completed, 5000);
+        ok(Ret == TRUE, "GetQueuedCompletionStatus failed with %lu\n", GetLastError());
+        ok(Completed == &Overlapped, "Completed = %p\n", Completed);
+    }
+
+    /* Unknown modes are refused */
+    SetLastError(0xdeadbeef);
+    Ret = pSetFileCompletionNotificationModes(File, 0x80);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "Error = %lu\n", GetLastError());
+
+    CloseHandle(Port);
+    CloseHandle(File);
+}
+
+START_TEST(IoCompletion)
+{
+    HMODULE hKernel32 = GetModuleHandleW(L"kernel32.dll");
+
+    pGetQueuedCompletionStatusEx = (PGET_QUEUED_COMPLETION_STATUS_EX)GetProcAddress(hKernel32, "GetQueuedCompletionStatusEx");
+    pSetFileCompletionNotificationModes = (PSET_FILE_COMPLETION_NOTIFICATION_MODES)GetProcAddress(hKernel32, "SetFileCompletionNotificationModes");
+
+    if (pGetQueuedCompletionStatusEx)
+    {
+        TestBatches();
+        TestWaits();
+    }
+    else
+    {
+        skip("GetQueuedCompletionStatusEx is not available\n");
+    }
+
+    if (pSetFileCompletionNotificationModes)
+        TestSkipOnSuccess();
+    else
+        skip("SetFileCompletionNotificationModes is not available\n");
+}
@@ -0,0 +1,325 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Contention tests and benchmark for SRW locks, condition
+ *              variables and keyed events
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+
+#define LOCK_COUNT          1024
+#define LOCK_ITERATIONS     200000
+#define PING_PONG_ROUNDS    20000
+#define KEYED_WAITERS       256
+
+typedef VOID (NTAPI *PFN_SRWLOCK)(PRTL_SRWLOCK);
+typedef VOID (NTAPI *PFN_CONDITION_VARIABLE)(PRTL_CONDITION_VARIABLE);
+typedef NTSTATUS (NTAPI *PFN_SLEEP_CONDITION_VARIABLE_SRW)(PRTL_CONDITION_VARIABLE, PRTL_SRWLOCK,
+                                                           PLARGE_INTEGER, ULONG);
+
+static PFN_SRWLOCK pRtlInitializeSRWLock;
+static PFN_SRWLOCK pRtlAcquireSRWLockExclusive;
+static PFN_SRWLOCK pRtlReleaseSRWLockExclusive;
+static PFN_SRWLOCK pRtlAcquireSRWLockShared;
+static PFN_SRWLOCK pRtlReleaseSRWLockShared;
+static PFN_CONDITION_VARIABLE pRtlInitializeConditionVariable;
+static PFN_CONDITION_VARIABLE pRtlWakeConditionVariable;
+static PFN_SLEEP_CONDITION_VARIABLE_SRW pRtlSleepConditionVariableSRW;
+
+typedef struct _CONTENDED_LOCK
+{
+    RTL_SRWLOCK Lock;
+    ULONG Counter;
+    ULONG Shadow;
+    /* One lock per cache line */
+    UCHAR Padding[64 - sizeof(RTL_SRWLOCK) - 2 * sizeof(ULONG)];
+} CONTENDED_LOCK, *PCONTENDED_LOCK;
+
+typedef struct _LOCK_TEST
+{
+    PCONTENDED_LOCK Locks;
+    ULONG LockCount;
+    ULONG Iterations;
+    LONG Torn;
+    HANDLE StartEvent;
+} LOCK_TEST, *PLOCK_TEST;
+
+typedef struct _PING_PONG
+{
+    RTL_SRWLOCK Lock;
+    RTL_CONDITION_VARIABLE Changed;
+    ULONG Turn;
+    ULONG Rounds;
+} PING_PONG, *PPING_PONG;
+
+static ULONG ThreadCount;
+
+static
+BOOLEAN
+LoadFunctions(VOID)
+{
+    HMODULE hDll;
+
+    /* Windows has them in ntdll, ReactOS in ntdll_vista */
+    hDll = GetModuleHandleW(L"ntdll.dll");
+    if (!GetProcAddress(hDll, "RtlAcquireSRWLockExclusive"))
+        hDll = LoadLibraryW(L"ntdll_vista.dll");
+    if (!hDll)
+        return FALSE;
+
+    pRtlInitializeSRWLock = (PFN_SRWLOCK)GetProcAddress(hDll, "RtlInitializeSRWLock");
+    pRtlAcquireSRWLockExclusive = (PFN_SRWLOCK)GetProcAddress(hDll, "RtlAcquireSRWLockExclusive");
+    pRtlReleaseSRWLockExclusive = (PFN_SRWLOCK)GetProcAddress(hDll, "RtlReleaseSRWLockExclusive");
+    pRtlAcquireSRWLockShared = (PFN_SRWLOCK)GetProcAddress(hDll, "RtlAcquireSRWLockShared");
+    pRtlReleaseSRWLockShared = (PFN_SRWLOCK)GetProcAddress(hDll, "RtlReleaseSRWLockShared");
+    pRtlInitializeConditionVariable = (PFN_CONDITION_VARIABLE)GetProcAddress(hDll, "RtlInitializeConditionVariable");
+    pRtlWakeConditionVariable = (PFN_CONDITION_VARIABLE)GetProcAddress(hDll, "RtlWakeConditionVariable");
+    pRtlSleepConditionVariableSRW = (PFN_SLEEP_CONDITION_VARIABLE_SRW)GetProcAddress(hDll, "RtlSleepConditionVariableSRW");
+
+    return pRtlInitializeSRWLock && pRtlAcquireSRWLockExclusive && pRtlReleaseSRWLockExclusive &&
+           pRtlAcquireSRWLockShared && pRtlReleaseSRWLockShared &&
+           pRtlInitializeConditionVariable && pRtlWakeConditionVariable &&
+           pRtlSleepConditionVariableSRW;
+}
+
+static
+double
+ElapsedMs(LARGE_INTEGER *Start)
+{
+    LARGE_INTEGER End, Frequency;
+
+    QueryPerformanceCounter(&End);
+    QueryPerformanceFrequency(&Frequency);
+    return (double)(End.QuadPart - Start->QuadPart) * 1000.0 / Frequency.QuadPart;
+}
+
+static
+HANDLE
+StartThread(LPTHREAD_START_ROUTINE Routine, PVOID Parameter)
+{
+    HANDLE hThread;
+
+    hThread = CreateThread(NULL, 0, Routine, Parameter, 0, NULL);
+    ok(hThread != NULL, "CreateThread failed with %lu\n", GetLastError());
+    return hThread;
+}
+
+static
+DWORD
+WINAPI
+LockThread(PVOID Parameter)
+{
+    PLOCK_TEST Test = Parameter;
+    PCONTENDED_LOCK Lock;
+    ULONG i, Seed;
+
+    Seed = GetCurrentThreadId();
+    WaitForSingleObject(Test->StartEvent, INFINITE);
+
+    for (i = 0; i < Test->Iterations; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Lock = &Test->Locks[(Seed >> 8) % Test->LockCount];
+
+        if (i % 4)
+        {
+            /* Writers keep both counters equal */
+            pRtlAcquireSRWLockExclusive(&Lock->Lock);
+            Lock->Counter++;
+            YieldProcessor();
+            Lock->Shadow++;
+            pRtlReleaseSRWLockExclusive(&Lock->Lock);
+        }
+        else
+        {
+            pRtlAcquireSRWLockShared(&Lock->Lock);
+            if (Lock->Counter != Lock->Shadow)
+                InterlockedIncrement(&Test->Torn);
+            pRtlReleaseSRWLockShared(&Lock->Lock);
+        }
+    }
+
+    return 0;
+}
+
+static
+VOID
+TestLockContention(ULONG LockCount)
+{
+    LOCK_TEST Test;
+    HANDLE Threads[MAXIMUM_WAIT_OBJECTS];
+    LARGE_INTEGER Start;
+    ULONG i, Expected, Total;
+    double Time;
+
+    Test.Locks = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, LockCount * sizeof(CONTENDED_LOCK));
+    if (!Test.Locks)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (i = 0; i < LockCount; i++)
+        pRtlInitializeSRWLock(&Test.Locks[i].Lock);
+
+    Test.LockCount = LockCount;
+    Test.Iterations = LOCK_ITERATIONS / ThreadCount;
+    Test.Torn = 0;
+    Test.StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    for (i = 0; i < ThreadCount; i++)
+        Threads[i] = StartThread(LockThread, &Test);
+
+    QueryPerformanceCounter(&Start);
+    SetEvent(Test.StartEvent);
+    ok_int(WaitForMultipleObjects(ThreadCount, Threads, TRUE, 120000), WAIT_OBJECT_0);
+    Time = ElapsedMs(&Start);
+
+    /* Every 4th acquisition of each thread is shared */
+    Expected = ThreadCount * (Test.Iterations - (Test.Iterations + 3) / 4);
+    Total = 0;
+    for (i = 0; i < LockCount; i++)
+    {
+        Total += Test.Locks[i].Counter;
+        ok(Test.Locks[i].Counter == Test.Locks[i].Shadow, "Lock %lu: %lu != %lu\n",
+           i, Test.Locks[i].Counter, Test.Locks[i].Shadow);
+    }
+    ok_int(Total, Expected);
+    ok_int(Test.Torn, 0);
+
+    trace("%lu threads on %lu locks: %lu acquisitions in %.1f ms (%.0f/ms)\n",
+          ThreadCount, LockCount, ThreadCount * Test.Iterations, Time,
+          ThreadCount * Test.Iterations / (Time ? Time : 1));
+
+    for (i = 0; i < ThreadCount; i++)
+        CloseHandle(Threads[i]);
+    CloseHandle(Test.StartEvent);
+    HeapFree(GetProcessHeap(), 0, Test.Locks);
+}
+
+static
+DWORD
+WINAPI
+PingPongThread(PVOID Parameter)
+{
+    PPING_PONG PingPong = (PPING_PONG)((ULONG_PTR)Parameter & ~1);
+    ULONG Me = (ULONG)((ULONG_PTR)Parameter & 1);
+    ULONG i;
+
+    for (i = 0; i < PingPong->Rounds; i++)
+    {
+        pRtlAcquireSRWLockExclusive(&PingPong->Lock);
+        while (PingPong->Turn != Me)
+            pRtlSleepConditionVariableSRW(&PingPong->Changed, &PingPong->Lock, NULL, 0);
+        PingPong->Turn = !Me;
+        pRtlWakeConditionVariable(&PingPong->Changed);
+        pRtlReleaseSRWLockExclusive(&PingPong->Lock);
+    }
+
+    return 0;
+}
+
+static
+VOID
+TestConditionVariablePingPong(VOID)
+{
+    static PING_PONG PingPong;
+    HANDLE Threads[2];
+    LARGE_INTEGER Start;
+    double Time;
+
+    pRtlInitializeSRWLock(&PingPong.Lock);
+    pRtlInitializeConditionVariable(&PingPong.Changed);
+    PingPong.Turn = 0;
+    PingPong.Rounds = PING_PONG_ROUNDS;
+
+    QueryPerformanceCounter(&Start);
+    Threads[0] = StartThread(PingPongThread, &PingPong);
+    Threads[1] = StartThread(PingPongThread, (PVOID)((ULONG_PTR)&PingPong | 1));
+    ok_int(WaitForMultipleObjects(2, Threads, TRUE, 120000), WAIT_OBJECT_0);
+    Time = ElapsedMs(&Start);
+
+    /* Both threads finished all their rounds, so it's thread 0's turn again */
+    ok_int(PingPong.Turn, 0);
+
+    trace("Condition variable ping-pong: %u round trips in %.1f ms (%.0f/ms)\n",
+          PING_PONG_ROUNDS, Time, PING_PONG_ROUNDS / (Time ? Time : 1));
+
+    CloseHandle(Threads[0]);
+    CloseHandle(Threads[1]);
+}
+
+static HANDLE KeyedEvent;
+static ULONG KeyedKeys[KEYED_WAITERS];
+
+static
+DWORD
+WINAPI
+KeyedWaitThread(PVOID Parameter)
+{
+    return NtWaitForKeyedEvent(KeyedEvent, Parameter, FALSE, NULL);
+}
+
+static
+VOID
+TestKeyedEventWaiters(VOID)
+{
+    HANDLE Threads[KEYED_WAITERS];
+    LARGE_INTEGER Start;
+    NTSTATUS Status;
+    DWORD ExitCode;
+    ULONG i;
+    double Time;
+
+    Status = NtCreateKeyedEvent(&KeyedEvent, EVENT_ALL_ACCESS, NULL, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* Neighbouring keys, like the wait blocks of many contended locks */
+    for (i = 0; i < KEYED_WAITERS; i++)
+        Threads[i] = StartThread(KeyedWaitThread, &KeyedKeys[i]);
+
+    /* Releasing blocks until the waiter arrives, so the order doesn't matter */
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < KEYED_WAITERS; i++)
+    {
+        Status = NtReleaseKeyedEvent(KeyedEvent, &KeyedKeys[i], FALSE, NULL);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+    Time = ElapsedMs(&Start);
+
+    for (i = 0; i < KEYED_WAITERS; i++)
+    {
+        ok_int(WaitForSingleObject(Threads[i], 10000), WAIT_OBJECT_0);
+        ok(GetExitCodeThread(Threads[i], &ExitCode), "GetExitCodeThread failed\n");
+        ok_ntstatus(ExitCode, STATUS_SUCCESS);
+        CloseHandle(Threads[i]);
+    }
+
+    trace("Keyed event: released %u waiters in %.1f ms\n", KEYED_WAITERS, Time);
+
+    NtClose(KeyedEvent);
+}
+
+START_TEST(RtlSRWLock)
+{
+    SYSTEM_INFO SystemInfo;
+
+    TestKeyedEventWaiters();
+
+    if (!LoadFunctions())
+    {
+        skip("SRW locks are not available\n");
+        return;
+    }
+
+    GetSystemInfo(&SystemInfo);
+    ThreadCount = min(max(SystemInfo.dwNumberOfProcessors * 2, 4), MAXIMUM_WAIT_OBJECTS);
+
+    TestLockContention(1);
+    TestLockContention(16);
+    TestLockContention(LOCK_COUNT);
+    TestConditionVariablePingPong();
+}
@@ -0,0 +1,234 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test for RtlSetHeapInformation and the low fragmentation heap
+ */
+
+#include "precomp.h"
+
+#define THREAD_COUNT 4
+#define THREAD_BLOCKS 512
+
+static
+BOOLEAN
+CheckBuffer(
+    PVOID Buffer,
+    SIZE_T Size,
+    UCHAR Value)
+{
+    PUCHAR Array = Buffer;
+    SIZE_T i;
+
+    for (i = 0; i < Size; i++)
+        if (Array[i] != Value)
+            return FALSE;
+    return TRUE;
+}
+
+static
+ULONG
+QueryFrontEnd(
+    PVOID HeapHandle)
+{
+    NTSTATUS Status;
+    ULONG Info = 0xdeadbeef;
+
+    Status = RtlQueryHeapInformation(HeapHandle, HeapCompatibilityInformation, &Info, sizeof(Info), NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    return Info;
+}
+
+static
+DWORD
+WINAPI
+StressThread(
+    PVOID HeapHandle)
+{
+    PUCHAR Blocks[THREAD_BLOCKS];
+    ULONG Round, i;
+    SIZE_T Size;
+    BOOLEAN Valid = TRUE;
+
+    for (Round = 0; Round < 50; Round++)
+    {
+        for (i = 0; i < THREAD_BLOCKS; i++)
+        {
+            Size = (i * 37 + Round) % 2000 + 1;
+            Blocks[i] = RtlAllocateHeap(HeapHandle, 0, Size);
+            if (!Blocks[i])
+                return 1;
+            RtlFillMemory(Blocks[i], Size, (UCHAR)i);
+        }
+
+        for (i = 0; i < THREAD_BLOCKS; i++)
+        {
+            Size = (i * 37 + Round) % 2000 + 1;
+            if (RtlSizeHeap(HeapHandle, 0, Blocks[i]) != Size ||
+                !CheckBuffer(Blocks[i], Size, (UCHAR)i))
+            {
+                Valid = FALSE;
+            }
+            RtlFreeHeap(HeapHandle, 0, Blocks[i]);
+        }
+    }
+
+    return Valid ? 0 : 2;
+}
+
+START_TEST(RtlSetHeapInformation)
+{
+    PVOID HeapHandle;
+    NTSTATUS Status;
+    ULONG Info;
+    PUCHAR Buffer, Buffer2;
+    PVOID UserValue;
+    ULONG UserFlags;
+    BOOLEAN Success;
+    SIZE_T Size;
+    HANDLE Threads[THREAD_COUNT];
+    DWORD ExitCode;
+    ULONG i;
+
+    HeapHandle = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    if (!HeapHandle)
+    {
+        skip("RtlCreateHeap failed\n");
+        return;
+    }
+    ok_long(QueryFrontEnd(HeapHandle), 0);
+
+    /* Only the LFH can be requested */
+    Info = 1;
+    Status = RtlSetHeapInformation(HeapHandle, HeapCompatibilityInformation, &Info, sizeof(Info));
+    ok_hex(Status, STATUS_UNSUCCESSFUL);
+    Info = 2;
+    Status = RtlSetHeapInformation(HeapHandle, HeapCompatibilityInformation, &Info, sizeof(Info) - 1);
+    ok_hex(Status, STATUS_BUFFER_TOO_SMALL);
+    ok_long(QueryFrontEnd(HeapHandle), 0);
+
+    Status = RtlSetHeapInformation(HeapHandle, HeapCompatibilityInformation, &Info, sizeof(Info));
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(QueryFrontEnd(HeapHandle), 2);
+
+    /* Enabling it twice is fine */
+    Status = RtlSetHeapInformation(HeapHandle, HeapCompatibilityInformation, &Info, sizeof(Info));
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(QueryFrontEnd(HeapHandle), 2);
+
+    /* Sizes and zeroing */
+    for (Size = 0; Size < 0x1400; Size += 7)
+    {
+        Buffer = RtlAllocateHeap(HeapHandle, HEAP_ZERO_MEMORY, Size);
+        ok(Buffer != NULL, "RtlAllocateHeap failed for size %lu\n", (ULONG)Size);
+        if (!Buffer)
+            continue;
+        ok(((ULONG_PTR)Buffer & (sizeof(PVOID) * 2 - 1)) == 0, "Buffer %p is misaligned\n", Buffer);
+        ok(RtlSizeHeap(HeapHandle, 0, Buffer) == Size, "RtlSizeHeap returned %lu, expected %lu\n",
+           (ULONG)RtlSizeHeap(HeapHandle, 0, Buffer), (ULONG)Size);
+        ok(CheckBuffer(Buffer, Size, 0), "HEAP_ZERO_MEMORY not respected for size %lu\n", (ULONG)Size);
+        ok(RtlValidateHeap(HeapHandle, 0, Buffer), "RtlValidateHeap failed for size %lu\n", (ULONG)Size);
+        RtlFillMemory(Buffer, Size, 0x55);
+        ok(RtlFreeHeap(HeapHandle, 0, Buffer), "RtlFreeHeap failed for size %lu\n", (ULONG)Size);
+    }
+    ok(RtlValidateHeap(HeapHandle, 0, NULL), "RtlValidateHeap failed\n");
+
+    /* Freed blocks can't be freed twice */
+    Buffer = RtlAllocateHeap(HeapHandle, 0, 24);
+    ok(Buffer != NULL, "RtlAllocateHeap failed\n");
+    ok(RtlFreeHeap(HeapHandle, 0, Buffer), "RtlFreeHeap failed\n");
+    ok(!RtlFreeHeap(HeapHandle, 0, Buffer), "Double free succeeded\n");
+
+    /* Settable flags are kept, user values need extra stuff which the front end doesn't have */
+    Buffer = RtlAllocateHeap(HeapHandle, HEAP_SETTABLE_USER_FLAG2, 0x40);
+    ok(Buffer != NULL, "RtlAllocateHeap failed\n");
+    UserValue = InvalidPointer;
+    UserFlags = 0x55555555;
+    Success = RtlGetUserInfoHeap(HeapHandle, 0, Buffer, &UserValue, &UserFlags);
+    ok(Success == TRUE, "RtlGetUserInfoHeap returned %u\n", Success);
+    ok(UserFlags == HEAP_SETTABLE_USER_FLAG2, "UserFlags = %lx\n", UserFlags);
+    RtlFreeHeap(HeapHandle, 0, Buffer);
+
+    Buffer = RtlAllocateHeap(HeapHandle, HEAP_SETTABLE_USER_VALUE, 0x40);
+    ok(Buffer != NULL, "RtlAllocateHeap failed\n");
+    Success = RtlSetUserValueHeap(HeapHandle, 0, Buffer, &UserValue);
+    ok(Success == TRUE, "RtlSetUserValueHeap returned %u\n", Success);
+    UserValue = InvalidPointer;
+    Success = RtlGetUserInfoHeap(HeapHandle, 0, Buffer, &UserValue, &UserFlags);
+    ok(Success == TRUE, "RtlGetUserInfoHeap returned %u\n", Success);
+    ok(UserValue == &UserValue, "UserValue = %p, expected %p\n", UserValue, &UserValue);
+    RtlFreeHeap(HeapHandle, 0, Buffer);
+
+    /* Reallocation, in and out of the front end */
+    Buffer = RtlAllocateHeap(HeapHandle, HEAP_ZERO_MEMORY, 0x10);
+    ok(Buffer != NULL, "RtlAllocateHeap failed\n");
+    Size = 0x10;
+    while (Buffer && Size < 0x3000)
+    {
+        RtlFillMemory(Buffer, Size, 0x7a);
+        Buffer2 = RtlReAllocateHeap(HeapHandle, HEAP_ZERO_MEMORY, Buffer, Size * 2 + 1);
+        ok(Buffer2 != NULL, "RtlReAllocateHeap failed for size %lu\n", (ULONG)(Size * 2 + 1));
+        if (!Buffer2)
+            break;
+        ok(RtlSizeHeap(HeapHandle, 0, Buffer2) == Size * 2 + 1, "Wrong size for %lu\n", (ULONG)(Size * 2 + 1));
+        ok(CheckBuffer(Buffer2, Size, 0x7a), "Contents lost at size %lu\n", (ULONG)Size);
+        ok(CheckBuffer(Buffer2 + Size, Size + 1, 0), "HEAP_ZERO_MEMORY not respected at size %lu\n", (ULONG)Size);
+        Buffer = Buffer2;
+        Size = Size * 2 + 1;
+    }
+    while (Buffer && Size > 8)
+    {
+        RtlFillMemory(Buffer, Size, 0x7a);
+        Buffer2 = RtlReAllocateHeap(HeapHandle, 0, Buffer, Size / 3);
+        ok(Buffer2 != NULL, "RtlReAllocateHeap failed for size %lu\n", (ULONG)(Size / 3));
+        if (!Buffer2)
+            break;
+        ok(RtlSizeHeap(HeapHandle, 0, Buffer2) == Size / 3, "Wrong size for %lu\n", (ULONG)(Size / 3));
+        ok(CheckBuffer(Buffer2, Size / 3, 0x7a), "Contents lost at size %lu\n", (ULONG)Size);
+        Buffer = Buffer2;
+        Size = Size / 3;
+    }
+    if (Buffer)
+        RtlFreeHeap(HeapHandle, 0, Buffer);
+
+    /* Growing within the same size class works in place */
+    Buffer = RtlAllocateHeap(HeapHandle, 0, 0x100);
+    ok(Buffer != NULL, "RtlAllocateHeap failed\n");
+    Buffer2 = RtlReAllocateHeap(HeapHandle, HEAP_REALLOC_IN_PLACE_ONLY, Buffer, 0x101);
+    ok(Buffer2 == Buffer || Buffer2 == NULL, "Buffer2 = %p, expected %p or NULL\n", Buffer2, Buffer);
+    Buffer2 = RtlReAllocateHeap(HeapHandle, HEAP_REALLOC_IN_PLACE_ONLY, Buffer, 0x8000);
+    ok(Buffer2 == NULL, "Buffer2 = %p\n", Buffer2);
+    ok(RtlSizeHeap(HeapHandle, 0, Buffer) >= 0x100, "Buffer was resized\n");
+    RtlFreeHeap(HeapHandle, 0, Buffer);
+
+    /* Several threads hammering the buckets concurrently */
+    for (i = 0; i < THREAD_COUNT; i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, StressThread, HeapHandle, 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+    for (i = 0; i < THREAD_COUNT; i++)
+    {
+        if (!Threads[i])
+            continue;
+        ok(WaitForSingleObject(Threads[i], 60 * 1000) == WAIT_OBJECT_0, "Thread %lu timed out\n", i);
+        ok(GetExitCodeThread(Threads[i], &ExitCode), "GetExitCodeThread failed\n");
+        ok(ExitCode == 0, "Thread %lu failed with %lu\n", i, ExitCode);
+        CloseHandle(Threads[i]);
+    }
+    ok(RtlValidateHeap(HeapHandle, 0, NULL), "RtlValidateHeap failed\n");
+
+    RtlDestroyHeap(HeapHandle);
+
+    /* Unserialized heaps can't get a front end */
+    HeapHandle = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, NULL);
+    if (!HeapHandle)
+    {
+        skip("RtlCreateHeap failed\n");
+        return;
+    }
+    Info = 2;
+    Status = RtlSetHeapInformation(HeapHandle, HeapCompatibilityInformation, &Info, sizeof(Info));
+    ok(!NT_SUCCESS(Status), "Status = 0x%lx\n", Status);
+    ok_long(QueryFrontEnd(HeapHandle), 0);
+    RtlDestroyHeap(HeapHandle);
+}
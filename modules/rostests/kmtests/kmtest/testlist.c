@@ -12,6 +12,7 @@ KMT_TESTFUNC Test_CcMapData;
 KMT_TESTFUNC Test_CcPinMappedData;
 KMT_TESTFUNC Test_CcPinRead;
 KMT_TESTFUNC Test_CcSetFileSizes;
+KMT_TESTFUNC Test_CcViewLookup;
 KMT_TESTFUNC Test_Example;
 KMT_TESTFUNC Test_FileAttributes;
 KMT_TESTFUNC Test_FindFile;
@@ -36,6 +37,7 @@ KMT_TESTFUNC Test_RtlUnicodeString;
 KMT_TESTFUNC Test_TcpIpIoctl;
 KMT_TESTFUNC Test_TcpIpTdi;
 KMT_TESTFUNC Test_TcpIpConnect;
+KMT_TESTFUNC Test_TcpIpSend;
 
 /* tests with a leading '-' will not be listed */
 const KMT_TEST TestList[] =
@@ -46,6 +48,7 @@ const KMT_TEST TestList[] =
     { "CcPinMappedData",              Test_CcPinMappedData },
     { "CcPinRead",                    Test_CcPinRead },
     { "CcSetFileSizes",               Test_CcSetFileSizes },
+    { "CcViewLookup",                 Test_CcViewLookup },
     { "-Example",                     Test_Example },
     { "FileAttributes",               Test_FileAttributes },
     { "FindFile",                     Test_FindFile },
@@ -69,5 +72,6 @@ const KMT_TEST TestList[] =
     { "RtlUnicodeString",             Test_RtlUnicodeString },
     { "TcpIpTdi",                     Test_TcpIpTdi },
     { "TcpIpConnect",                 Test_TcpIpConnect },
+    { "TcpIpSend",                    Test_TcpIpSend },
     { NULL,                           NULL },
 };
@@ -0,0 +1,357 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test driver checking and timing view lookups in Cc
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define IOCTL_START_TEST  1
+#define IOCTL_FINISH_TEST 2
+
+#define LOOKUP_ITERATIONS 20000
+
+typedef struct _TEST_FCB
+{
+    FSRTL_ADVANCED_FCB_HEADER Header;
+    SECTION_OBJECT_POINTERS SectionObjectPointers;
+    FAST_MUTEX HeaderMutex;
+} TEST_FCB, *PTEST_FCB;
+
+static const ULONG TestViews[] = { 1, 16, 64, 256 };
+
+static ULONG TestTestId = -1;
+static PFILE_OBJECT TestFileObject;
+static PDEVICE_OBJECT TestDeviceObject;
+static KMT_IRP_HANDLER TestIrpHandler;
+static KMT_MESSAGE_HANDLER TestMessageHandler;
+
+NTSTATUS
+TestEntry(
+    _In_ PDRIVER_OBJECT DriverObject,
+    _In_ PCUNICODE_STRING RegistryPath,
+    _Out_ PCWSTR *DeviceName,
+    _Inout_ INT *Flags)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(RegistryPath);
+
+    *DeviceName = L"CcViewLookup";
+    *Flags = TESTENTRY_NO_EXCLUSIVE_DEVICE |
+             TESTENTRY_BUFFERED_IO_DEVICE |
+             TESTENTRY_NO_READONLY_DEVICE;
+
+    KmtRegisterIrpHandler(IRP_MJ_READ, NULL, TestIrpHandler);
+    KmtRegisterMessageHandler(0, NULL, TestMessageHandler);
+
+    return Status;
+}
+
+VOID
+TestUnload(
+    _In_ PDRIVER_OBJECT DriverObject)
+{
+    PAGED_CODE();
+}
+
+BOOLEAN
+NTAPI
+AcquireForLazyWrite(
+    _In_ PVOID Context,
+    _In_ BOOLEAN Wait)
+{
+    return TRUE;
+}
+
+VOID
+NTAPI
+ReleaseFromLazyWrite(
+    _In_ PVOID Context)
+{
+    return;
+}
+
+BOOLEAN
+NTAPI
+AcquireForReadAhead(
+    _In_ PVOID Context,
+    _In_ BOOLEAN Wait)
+{
+    return TRUE;
+}
+
+VOID
+NTAPI
+ReleaseFromReadAhead(
+    _In_ PVOID Context)
+{
+    return;
+}
+
+static CACHE_MANAGER_CALLBACKS Callbacks = {
+    AcquireForLazyWrite,
+    ReleaseFromLazyWrite,
+    AcquireForReadAhead,
+    ReleaseFromReadAhead,
+};
+
+static
+PVOID
+MapAndLockUserBuffer(
+    _In_ _Out_ PIRP Irp,
+    _In_ ULONG BufferLength)
+{
+    PMDL Mdl;
+
+    if (Irp->MdlAddress == NULL)
+    {
+        Mdl = IoAllocateMdl(Irp->UserBuffer, BufferLength, FALSE, FALSE, Irp);
+        if (Mdl == NULL)
+        {
+            return NULL;
+        }
+
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(Mdl, Irp->RequestorMode, IoWriteAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            IoFreeMdl(Mdl);
+            Irp->MdlAddress = NULL;
+            _SEH2_YIELD(return NULL);
+        }
+        _SEH2_END;
+    }
+
+    return MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+}
+
+static
+VOID
+PerformTest(
+    ULONG TestId,
+    PDEVICE_OBJECT DeviceObject)
+{
+    PVOID Bcb;
+    BOOLEAN Ret;
+    PULONG Buffer;
+    PTEST_FCB Fcb;
+    ULONG Views, i, Mismatches;
+    LARGE_INTEGER Offset;
+    LARGE_INTEGER Start, End, Frequency;
+    ULONGLONG Cost;
+
+    ok_eq_pointer(TestFileObject, NULL);
+    ok_eq_pointer(TestDeviceObject, NULL);
+    ok_eq_ulong(TestTestId, -1);
+
+    if (skip(TestId < RTL_NUMBER_OF(TestViews), "Invalid test id: %lu\n", TestId))
+        return;
+
+    Views = TestViews[TestId];
+    TestDeviceObject = DeviceObject;
+    TestTestId = TestId;
+    TestFileObject = IoCreateStreamFileObject(NULL, DeviceObject);
+    if (skip(TestFileObject != NULL, "Failed to allocate FO\n"))
+        return;
+
+    Fcb = ExAllocatePool(NonPagedPool, sizeof(TEST_FCB));
+    if (skip(Fcb != NULL, "ExAllocatePool failed\n"))
+        return;
+
+    RtlZeroMemory(Fcb, sizeof(TEST_FCB));
+    ExInitializeFastMutex(&Fcb->HeaderMutex);
+    FsRtlSetupAdvancedHeader(&Fcb->Header, &Fcb->HeaderMutex);
+
+    TestFileObject->FsContext = Fcb;
+    TestFileObject->SectionObjectPointer = &Fcb->SectionObjectPointers;
+    Fcb->Header.AllocationSize.QuadPart = (LONGLONG)Views * VACB_MAPPING_GRANULARITY;
+    Fcb->Header.FileSize.QuadPart = (LONGLONG)Views * VACB_MAPPING_GRANULARITY;
+    Fcb->Header.ValidDataLength.QuadPart = (LONGLONG)Views * VACB_MAPPING_GRANULARITY;
+
+    KmtStartSeh();
+    CcInitializeCacheMap(TestFileObject, (PCC_FILE_SIZES)&Fcb->Header.AllocationSize, FALSE, &Callbacks, NULL);
+    KmtEndSeh(STATUS_SUCCESS);
+
+    if (skip(CcIsFileCached(TestFileObject) == TRUE, "CcInitializeCacheMap failed\n"))
+        return;
+
+    /* Make all the views resident */
+    for (i = 0; i < Views; ++i)
+    {
+        Offset.QuadPart = (LONGLONG)i * VACB_MAPPING_GRANULARITY;
+        KmtStartSeh();
+        Ret = CcMapData(TestFileObject, &Offset, PAGE_SIZE, MAP_WAIT, &Bcb, (PVOID *)&Buffer);
+        KmtEndSeh(STATUS_SUCCESS);
+
+        if (skip(Ret == TRUE, "CcMapData failed for view %lu\n", i))
+            return;
+
+        ok_eq_ulong(Buffer[0], Offset.LowPart);
+        ok_eq_ulong(Buffer[1], 0xBABABABA);
+        CcUnpinData(Bcb);
+    }
+
+    /* And now, hit them, always starting with the farthest one */
+    Mismatches = 0;
+    Start = KeQueryPerformanceCounter(&Frequency);
+    for (i = 0; i < LOOKUP_ITERATIONS; ++i)
+    {
+        Offset.QuadPart = (LONGLONG)(Views - 1 - (i % Views)) * VACB_MAPPING_GRANULARITY;
+        Ret = CcMapData(TestFileObject, &Offset, PAGE_SIZE, MAP_WAIT, &Bcb, (PVOID *)&Buffer);
+        if (!Ret)
+            break;
+
+        /* Each page holds its own offset, so a wrong view shows up here */
+        if (Buffer[0] != Offset.LowPart)
+            ++Mismatches;
+
+        CcUnpinData(Bcb);
+    }
+    End = KeQueryPerformanceCounter(NULL);
+    ok_eq_ulong(i, LOOKUP_ITERATIONS);
+    ok_eq_ulong(Mismatches, 0);
+
+    /* Cost of a lookup, in ns */
+    Cost = ((ULONGLONG)(End.QuadPart - Start.QuadPart) * 1000000000ULL) /
+           ((ULONGLONG)Frequency.QuadPart * LOOKUP_ITERATIONS);
+    /* Timing depends on the machine, so it's only reported */
+    trace("%lu views: %I64u ns per lookup\n", Views, Cost);
+}
+
+
+static
+VOID
+CleanupTest(
+    ULONG TestId,
+    PDEVICE_OBJECT DeviceObject)
+{
+    LARGE_INTEGER Zero = RTL_CONSTANT_LARGE_INTEGER(0LL);
+    CACHE_UNINITIALIZE_EVENT CacheUninitEvent;
+
+    ok_eq_pointer(TestDeviceObject, DeviceObject);
+    ok_eq_ulong(TestTestId, TestId);
+
+    if (!skip(TestFileObject != NULL, "No test FO\n"))
+    {
+        if (CcIsFileCached(TestFileObject))
+        {
+            KeInitializeEvent(&CacheUninitEvent.Event, NotificationEvent, FALSE);
+            CcUninitializeCacheMap(TestFileObject, &Zero, &CacheUninitEvent);
+            KeWaitForSingleObject(&CacheUninitEvent.Event, Executive, KernelMode, FALSE, NULL);
+        }
+
+        if (TestFileObject->FsContext != NULL)
+        {
+            ExFreePool(TestFileObject->FsContext);
+            TestFileObject->FsContext = NULL;
+            TestFileObject->SectionObjectPointer = NULL;
+        }
+
+        ObDereferenceObject(TestFileObject);
+    }
+
+    TestFileObject = NULL;
+    TestDeviceObject = NULL;
+    TestTestId = -1;
+}
+
+
+static
+NTSTATUS
+TestMessageHandler(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ ULONG ControlCode,
+    _In_opt_ PVOID Buffer,
+    _In_ SIZE_T InLength,
+    _Inout_ PSIZE_T OutLength)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    FsRtlEnterFileSystem();
+
+    switch (ControlCode)
+    {
+        case IOCTL_START_TEST:
+            ok_eq_ulong((ULONG)InLength, sizeof(ULONG));
+            PerformTest(*(PULONG)Buffer, DeviceObject);
+            break;
+
+        case IOCTL_FINISH_TEST:
+            ok_eq_ulong((ULONG)InLength, sizeof(ULONG));
+            CleanupTest(*(PULONG)Buffer, DeviceObject);
+            break;
+
+        default:
+            Status = STATUS_NOT_IMPLEMENTED;
+            break;
+    }
+
+    FsRtlExitFileSystem();
+
+    return Status;
+}
+
+static
+NTSTATUS
+TestIrpHandler(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PIO_STACK_LOCATION IoStack)
+{
+    NTSTATUS Status;
+
+    PAGED_CODE();
+
+    DPRINT("IRP %x/%x\n", IoStack->MajorFunction, IoStack->MinorFunction);
+    ASSERT(IoStack->MajorFunction == IRP_MJ_READ);
+
+    FsRtlEnterFileSystem();
+
+    Status = STATUS_NOT_SUPPORTED;
+    Irp->IoStatus.Information = 0;
+
+    if (IoStack->MajorFunction == IRP_MJ_READ)
+    {
+        ULONG Length, i;
+        PVOID Buffer;
+        LARGE_INTEGER Offset;
+
+        Length = IoStack->Parameters.Read.Length;
+        Offset = IoStack->Parameters.Read.ByteOffset;
+
+        ok_eq_pointer(DeviceObject, TestDeviceObject);
+        ok_eq_pointer(IoStack->FileObject, TestFileObject);
+        ok(FlagOn(Irp->Flags, IRP_NOCACHE), "Not coming from Cc\n");
+
+        Buffer = MapAndLockUserBuffer(Irp, Length);
+        ok(Buffer != NULL, "Null pointer!\n");
+        if (Buffer != NULL)
+        {
+            RtlFillMemory(Buffer, Length, 0xBA);
+            /* Stamp every page with its file offset */
+            for (i = 0; i + sizeof(ULONG) <= Length; i += PAGE_SIZE)
+                *(PULONG)((PCHAR)Buffer + i) = Offset.LowPart + i;
+            Status = STATUS_SUCCESS;
+            Irp->IoStatus.Information = Length;
+        }
+        else
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    FsRtlExitFileSystem();
+
+    return Status;
+}
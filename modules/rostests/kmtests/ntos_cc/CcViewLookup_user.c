@@ -0,0 +1,35 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite CcViewLookup test user-mode part
+ */
+
+#include <kmt_test.h>
+
+#define IOCTL_START_TEST  1
+#define IOCTL_FINISH_TEST 2
+
+START_TEST(CcViewLookup)
+{
+    DWORD Ret;
+    ULONG TestId;
+
+    KmtLoadDriver(L"CcViewLookup", FALSE);
+    KmtOpenDriver();
+
+    /* 0: 1 resident view (baseline)
+     * 1: 16 resident views
+     * 2: 64 resident views
+     * 3: 256 resident views
+     */
+    for (TestId = 0; TestId < 4; ++TestId)
+    {
+        Ret = KmtSendUlongToDriver(IOCTL_START_TEST, TestId);
+        ok(Ret == ERROR_SUCCESS, "KmtSendUlongToDriver failed: %lx\n", Ret);
+        Ret = KmtSendUlongToDriver(IOCTL_FINISH_TEST, TestId);
+        ok(Ret == ERROR_SUCCESS, "KmtSendUlongToDriver failed: %lx\n", Ret);
+    }
+
+    KmtCloseDriver();
+    KmtUnloadDriver();
+}
@@ -0,0 +1,244 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Kernel-Mode Test Suite multiprocessor scheduler test
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define MAX_WORKERS         32
+#define TOTAL_ITERATIONS    0x4000000
+#define PIN_ROUNDS          50
+
+#define CPU_BIT(Number) ((KAFFINITY)1 << (Number))
+
+typedef struct _WORKER
+{
+    PKTHREAD Thread;
+    PKEVENT StartEvent;
+    KAFFINITY Affinity;
+    ULONG Iterations;
+    ULONG Result;
+    KAFFINITY RanOn;
+    ULONG Violations;
+    volatile BOOLEAN Stop;
+} WORKER, *PWORKER;
+
+static
+ULONG
+DoWork(
+    PWORKER Worker,
+    ULONG Iterations)
+{
+    ULONG i, Value = 0x12345678;
+
+    for (i = 0; i < Iterations; i++)
+    {
+        Value = Value * 1103515245 + 12345;
+        if (!(i & 0xFFFF))
+            Worker->RanOn |= CPU_BIT(KeGetCurrentProcessorNumber());
+    }
+    return Value;
+}
+
+static
+VOID
+NTAPI
+WorkThread(
+    PVOID Parameter)
+{
+    PWORKER Worker = Parameter;
+    NTSTATUS Status;
+
+    Status = KeWaitForSingleObject(Worker->StartEvent, Executive, KernelMode, FALSE, NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    Worker->Result = DoWork(Worker, Worker->Iterations);
+}
+
+/* Runs the same amount of work split over Count threads, returns the time it took */
+static
+ULONGLONG
+RunWorkers(
+    PWORKER Workers,
+    ULONG Count,
+    PKAFFINITY RanOn)
+{
+    KEVENT StartEvent;
+    ULONGLONG StartTime;
+    ULONG i;
+
+    KeInitializeEvent(&StartEvent, NotificationEvent, FALSE);
+    RtlZeroMemory(Workers, Count * sizeof(*Workers));
+    for (i = 0; i < Count; i++)
+    {
+        Workers[i].StartEvent = &StartEvent;
+        Workers[i].Iterations = TOTAL_ITERATIONS / Count;
+        Workers[i].Thread = KmtStartThread(WorkThread, &Workers[i]);
+    }
+
+    StartTime = KeQueryInterruptTime();
+    KeSetEvent(&StartEvent, IO_NO_INCREMENT, FALSE);
+
+    *RanOn = 0;
+    for (i = 0; i < Count; i++)
+    {
+        KmtFinishThread(Workers[i].Thread, NULL);
+        *RanOn |= Workers[i].RanOn;
+    }
+
+    return KeQueryInterruptTime() - StartTime;
+}
+
+static
+ULONG
+CountProcessors(
+    KAFFINITY Set)
+{
+    ULONG Count = 0;
+
+    for (; Set; Set &= Set - 1)
+        Count++;
+    return Count;
+}
+
+static
+VOID
+TestThroughput(
+    ULONG Count)
+{
+    static WORKER Workers[MAX_WORKERS];
+    ULONGLONG SingleTime, ParallelTime;
+    KAFFINITY RanOn;
+
+    SingleTime = RunWorkers(Workers, 1, &RanOn);
+    ok(CountProcessors(RanOn) >= 1, "Worker didn't run\n");
+
+    ParallelTime = RunWorkers(Workers, Count, &RanOn);
+    trace("1 thread: %I64u ms, %lu threads: %I64u ms, %lu CPUs used\n",
+          SingleTime / 10000, Count, ParallelTime / 10000, CountProcessors(RanOn));
+
+    /* Every CPU should have picked up one of the workers */
+    ok(CountProcessors(RanOn) == Count,
+       "Workers ran on %lu of %lu CPUs (0x%Ix)\n", CountProcessors(RanOn), Count, RanOn);
+
+    /* Expect at least half of the ideal speedup, TCG and other guests are noisy */
+    ok(ParallelTime * Count <= SingleTime * 2,
+       "%lu threads took %I64u ms, 1 thread took %I64u ms\n",
+       Count, ParallelTime / 10000, SingleTime / 10000);
+}
+
+static
+VOID
+NTAPI
+PinnedThread(
+    PVOID Parameter)
+{
+    PWORKER Worker = Parameter;
+    LARGE_INTEGER Interval;
+    ULONG i;
+
+    /* Restrict ourselves to one CPU, then keep sleeping and yielding */
+    KeSetAffinityThread(KeGetCurrentThread(), Worker->Affinity);
+    Interval.QuadPart = -10 * 1000; /* 1 ms */
+    for (i = 0; i < PIN_ROUNDS; i++)
+    {
+        if (!(CPU_BIT(KeGetCurrentProcessorNumber()) & Worker->Affinity))
+            Worker->Violations++;
+        Worker->Result = DoWork(Worker, 0x10000);
+        if (i & 1)
+            ZwYieldExecution();
+        else
+            KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+    }
+}
+
+static
+VOID
+NTAPI
+SpinningThread(
+    PVOID Parameter)
+{
+    PWORKER Worker = Parameter;
+
+    /* Don't wait, so the thread is moved while it is running or ready */
+    while (!Worker->Stop)
+    {
+        if (Worker->Affinity &&
+            !(CPU_BIT(KeGetCurrentProcessorNumber()) & Worker->Affinity))
+        {
+            Worker->Violations++;
+        }
+        Worker->Result = DoWork(Worker, 0x1000);
+    }
+}
+
+static
+VOID
+TestAffinity(
+    ULONG Count)
+{
+    static WORKER Workers[MAX_WORKERS];
+    WORKER Spinner;
+    LARGE_INTEGER Interval;
+    ULONG i;
+
+    /* Each thread pins itself to its own CPU */
+    RtlZeroMemory(Workers, sizeof(Workers));
+    for (i = 0; i < Count; i++)
+    {
+        Workers[i].Affinity = CPU_BIT(i);
+        Workers[i].Thread = KmtStartThread(PinnedThread, &Workers[i]);
+    }
+    for (i = 0; i < Count; i++)
+    {
+        KmtFinishThread(Workers[i].Thread, NULL);
+        ok(Workers[i].Violations == 0,
+           "Thread pinned to CPU %lu ran elsewhere %lu times\n", i, Workers[i].Violations);
+        ok(Workers[i].RanOn == CPU_BIT(i),
+           "Thread pinned to CPU %lu ran on 0x%Ix\n", i, Workers[i].RanOn);
+    }
+
+    /* Move a busy thread around from the outside */
+    RtlZeroMemory(&Spinner, sizeof(Spinner));
+    Spinner.Thread = KmtStartThread(SpinningThread, &Spinner);
+    if (skip(Spinner.Thread != NULL, "No thread\n"))
+        return;
+
+    Interval.QuadPart = -10 * 1000 * 20; /* 20 ms */
+    for (i = 0; i < Count; i++)
+    {
+        /* Pin it first, then give it time to be migrated and run there */
+        KeSetAffinityThread(Spinner.Thread, CPU_BIT(i));
+        KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+        Spinner.RanOn = 0;
+        Spinner.Violations = 0;
+        Spinner.Affinity = CPU_BIT(i);
+        KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+        Spinner.Affinity = 0;
+
+        ok(Spinner.Violations == 0,
+           "Thread moved to CPU %lu ran elsewhere %lu times\n", i, Spinner.Violations);
+        ok((Spinner.RanOn & ~CPU_BIT(i)) == 0,
+           "Thread moved to CPU %lu ran on 0x%Ix\n", i, Spinner.RanOn);
+    }
+
+    Spinner.Stop = TRUE;
+    KmtFinishThread(Spinner.Thread, NULL);
+}
+
+START_TEST(KeScheduler)
+{
+    ULONG Count;
+
+    Count = min(KeNumberProcessors, MAX_WORKERS);
+    trace("Running on %lu CPUs\n", Count);
+    if (skip(Count > 1, "This test needs more than one CPU\n"))
+        return;
+
+    TestAffinity(Count);
+    TestThroughput(Count);
+}
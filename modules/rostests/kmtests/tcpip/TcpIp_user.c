@@ -110,3 +110,97 @@ START_TEST(TcpIpConnect)
 
     WSACleanup();
 }
+
+typedef struct _RECEIVE_CONTEXT
+{
+    HANDLE ReadyToConnectEvent;
+    ULONG Received;
+    ULONG Mismatches;
+} RECEIVE_CONTEXT, *PRECEIVE_CONTEXT;
+
+static
+DWORD
+WINAPI
+ReceiveProc(
+    _In_ LPVOID Parameter)
+{
+    PRECEIVE_CONTEXT Context = Parameter;
+    WSADATA WsaData;
+    int Error, Length, i;
+    SOCKET ListenSocket, AcceptSocket;
+    struct sockaddr_in ListenAddress;
+    static char Buffer[64 * 1024];
+
+    Error = WSAStartup(MAKEWORD(2, 0), &WsaData);
+    ok_eq_int(Error, 0);
+
+    ListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(ListenSocket != INVALID_SOCKET, "socket failed\n");
+
+    ZeroMemory(&ListenAddress, sizeof(ListenAddress));
+    ListenAddress.sin_addr.S_un.S_addr = inet_addr("127.0.0.1");
+    ListenAddress.sin_port = htons(TEST_SEND_SERVER_PORT);
+    ListenAddress.sin_family = AF_INET;
+
+    Error = bind(ListenSocket, (struct sockaddr*)&ListenAddress, sizeof(ListenAddress));
+    ok_eq_int(Error, 0);
+
+    Error = listen(ListenSocket, 1);
+    ok_eq_int(Error, 0);
+
+    SetEvent(Context->ReadyToConnectEvent);
+
+    AcceptSocket = accept(ListenSocket, NULL, NULL);
+    ok(AcceptSocket != INVALID_SOCKET, "accept failed\n");
+    closesocket(ListenSocket);
+    if (AcceptSocket == INVALID_SOCKET)
+        return 0;
+
+    /* The driver sends a byte pattern that follows the stream offset */
+    while ((Length = recv(AcceptSocket, Buffer, sizeof(Buffer), 0)) > 0)
+    {
+        for (i = 0; i < Length; i++)
+        {
+            if ((unsigned char)Buffer[i] != (unsigned char)(Context->Received + i))
+                Context->Mismatches++;
+        }
+        Context->Received += Length;
+    }
+    ok_eq_int(Length, 0);
+
+    closesocket(AcceptSocket);
+    return 0;
+}
+
+START_TEST(TcpIpSend)
+{
+    RECEIVE_CONTEXT Context;
+    HANDLE ReceiveThread;
+    DWORD Error;
+
+    ZeroMemory(&Context, sizeof(Context));
+    Context.ReadyToConnectEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    ok(Context.ReadyToConnectEvent != NULL, "CreateEvent failed\n");
+
+    ReceiveThread = CreateThread(NULL, 0, ReceiveProc, &Context, 0, NULL);
+    ok(ReceiveThread != NULL, "CreateThread failed\n");
+
+    WaitForSingleObject(Context.ReadyToConnectEvent, INFINITE);
+
+    LoadTcpIpTestDriver();
+
+    Error = KmtSendToDriver(IOCTL_TEST_SEND);
+    ok_eq_ulong(Error, ERROR_SUCCESS);
+
+    WaitForSingleObject(ReceiveThread, INFINITE);
+
+    ok_eq_ulong(Context.Received, (ULONG)TEST_SEND_TOTAL_LENGTH);
+    ok_eq_ulong(Context.Mismatches, 0UL);
+
+    UnloadTcpIpTestDriver();
+
+    CloseHandle(ReceiveThread);
+    CloseHandle(Context.ReadyToConnectEvent);
+
+    WSACleanup();
+}
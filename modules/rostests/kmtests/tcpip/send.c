@@ -0,0 +1,325 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Kernel-Mode Test Suite for TCPIP.sys large loopback sends
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include <kmt_test.h>
+#include <tdikrnl.h>
+#include <ndk/rtlfuncs.h>
+
+#include <sys/param.h>
+
+#include "tcpip.h"
+
+#define TAG_TEST 'tseT'
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+static
+USHORT
+htons(USHORT x)
+{
+    return ((x & 0x00FF) << 8) | ((x & 0xFF00) >> 8);
+}
+#else
+#define htons(x) (x)
+#endif
+
+static
+NTSTATUS
+NTAPI
+IrpCompletionRoutine(
+    _In_ PDEVICE_OBJECT    DeviceObject,
+    _In_ PIRP              Irp,
+    _In_ PVOID             Context)
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+    UNREFERENCED_PARAMETER(Irp);
+
+    KeSetEvent((PKEVENT)Context, IO_NETWORK_INCREMENT, FALSE);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+/* Sends a prepared IRP down and waits for it, the IRP is freed */
+static
+NTSTATUS
+CallTdi(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _Out_opt_ PULONG_PTR Information)
+{
+    KEVENT Event;
+    NTSTATUS Status;
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+    IoSetCompletionRoutine(Irp, IrpCompletionRoutine, &Event, TRUE, TRUE, TRUE);
+
+    Status = IoCallDriver(DeviceObject, Irp);
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+        Status = Irp->IoStatus.Status;
+    }
+    if (Information)
+        *Information = Irp->IoStatus.Information;
+
+    IoFreeIrp(Irp);
+    return Status;
+}
+
+static
+NTSTATUS
+OpenTcpFile(
+    _Out_ PHANDLE Handle,
+    _In_ PCSTR EaName,
+    _In_ UCHAR EaNameLength,
+    _In_ PVOID EaValue,
+    _In_ USHORT EaValueLength)
+{
+    UNICODE_STRING TcpDeviceName = RTL_CONSTANT_STRING(L"\\Device\\Tcp");
+    PFILE_FULL_EA_INFORMATION FileInfo;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK StatusBlock;
+    ULONG FileInfoSize;
+    NTSTATUS Status;
+
+    FileInfoSize = FIELD_OFFSET(FILE_FULL_EA_INFORMATION, EaName[EaNameLength]) + 1 + EaValueLength;
+    FileInfo = ExAllocatePoolWithTag(NonPagedPool, FileInfoSize, TAG_TEST);
+    if (!FileInfo)
+        return STATUS_INSUFFICIENT_RESOURCES;
+    RtlZeroMemory(FileInfo, FileInfoSize);
+
+    FileInfo->EaNameLength = EaNameLength;
+    FileInfo->EaValueLength = EaValueLength;
+    RtlCopyMemory(&FileInfo->EaName[0], EaName, EaNameLength);
+    RtlCopyMemory(&FileInfo->EaName[EaNameLength + 1], EaValue, EaValueLength);
+
+    InitializeObjectAttributes(&ObjectAttributes,
+            &TcpDeviceName,
+            OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+            NULL,
+            NULL);
+
+    Status = ZwCreateFile(
+        Handle,
+        GENERIC_READ | GENERIC_WRITE,
+        &ObjectAttributes,
+        &StatusBlock,
+        0,
+        FILE_ATTRIBUTE_NORMAL,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        FILE_OPEN_IF,
+        0L,
+        FileInfo,
+        FileInfoSize);
+
+    ExFreePoolWithTag(FileInfo, TAG_TEST);
+    return Status;
+}
+
+static
+VOID
+FillAddress(
+    _Out_ PTA_IP_ADDRESS Address,
+    _In_ USHORT Port)
+{
+    LPCWSTR AddressTerminator;
+    IN_ADDR InAddr;
+    NTSTATUS Status;
+
+    RtlZeroMemory(Address, sizeof(*Address));
+    Address->TAAddressCount = 1;
+    Address->Address[0].AddressType = TDI_ADDRESS_TYPE_IP;
+    Address->Address[0].AddressLength = TDI_ADDRESS_LENGTH_IP;
+    Address->Address[0].Address[0].sin_port = htons(Port);
+    Status = RtlIpv4StringToAddressW(L"127.0.0.1", TRUE, &AddressTerminator, &InAddr);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    Address->Address[0].Address[0].in_addr = InAddr.S_un.S_addr;
+}
+
+/* Sends TEST_SEND_TOTAL_LENGTH bytes, returns the time it took */
+static
+ULONGLONG
+SendAll(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PFILE_OBJECT ConnectionFileObject,
+    _In_ PUCHAR Buffer)
+{
+    ULONGLONG StartTime;
+    ULONG_PTR BytesSent;
+    ULONG Sent = 0, Offset, Length, Sends = 0;
+    NTSTATUS Status = STATUS_SUCCESS;
+    PMDL Mdl;
+    PIRP Irp;
+
+    StartTime = KeQueryInterruptTime();
+    while (Sent < TEST_SEND_TOTAL_LENGTH)
+    {
+        /* The buffer holds the pattern for any offset that is a multiple of its size */
+        Offset = Sent % TEST_SEND_CHUNK_LENGTH;
+        Length = min(TEST_SEND_TOTAL_LENGTH - Sent, TEST_SEND_CHUNK_LENGTH - Offset);
+
+        Mdl = IoAllocateMdl(Buffer + Offset, Length, FALSE, FALSE, NULL);
+        Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+        if (!Mdl || !Irp)
+        {
+            ok(0, "Out of memory\n");
+            if (Mdl)
+                IoFreeMdl(Mdl);
+            if (Irp)
+                IoFreeIrp(Irp);
+            break;
+        }
+        MmBuildMdlForNonPagedPool(Mdl);
+
+        TdiBuildSend(Irp, DeviceObject, ConnectionFileObject, NULL, NULL, Mdl, 0, Length);
+        Status = CallTdi(DeviceObject, Irp, &BytesSent);
+        IoFreeMdl(Mdl);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        /* Sends may be partial if the send buffer was almost full */
+        ok(BytesSent != 0 && BytesSent <= Length, "Sent %Iu of %lu bytes\n", BytesSent, Length);
+        if (BytesSent == 0 || BytesSent > Length)
+            break;
+        Sent += (ULONG)BytesSent;
+        Sends++;
+    }
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    ok_eq_ulong(Sent, (ULONG)TEST_SEND_TOTAL_LENGTH);
+    trace("%lu bytes in %lu sends\n", Sent, Sends);
+
+    return KeQueryInterruptTime() - StartTime;
+}
+
+static
+VOID
+TestTcpSend(void)
+{
+    PIRP Irp;
+    HANDLE AddressHandle, ConnectionHandle;
+    FILE_OBJECT* ConnectionFileObject;
+    DEVICE_OBJECT* DeviceObject;
+    NTSTATUS Status;
+    TA_IP_ADDRESS LocalAddress, ConnectAddress, ReturnAddress;
+    CONNECTION_CONTEXT ConnectionContext = (CONNECTION_CONTEXT)(ULONG_PTR)0xC0CAC01AC0CAC01AULL;
+    TDI_CONNECTION_INFORMATION RequestInfo, ReturnInfo;
+    ULONGLONG Time;
+    PUCHAR Buffer;
+    ULONG i;
+
+    Buffer = ExAllocatePoolWithTag(NonPagedPool, TEST_SEND_CHUNK_LENGTH, TAG_TEST);
+    if (skip(Buffer != NULL, "Out of memory\n"))
+        return;
+    for (i = 0; i < TEST_SEND_CHUNK_LENGTH; i++)
+        Buffer[i] = (UCHAR)i;
+
+    /* Create a TCP address file and a connection file */
+    FillAddress(&LocalAddress, TEST_SEND_CLIENT_PORT);
+    Status = OpenTcpFile(&AddressHandle,
+                         TdiTransportAddress,
+                         TDI_TRANSPORT_ADDRESS_LENGTH,
+                         &LocalAddress,
+                         sizeof(LocalAddress));
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    Status = OpenTcpFile(&ConnectionHandle,
+                         TdiConnectionContext,
+                         TDI_CONNECTION_CONTEXT_LENGTH,
+                         &ConnectionContext,
+                         sizeof(ConnectionContext));
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    Status = ObReferenceObjectByHandle(
+        ConnectionHandle,
+        GENERIC_READ,
+        *IoFileObjectType,
+        KernelMode,
+        (PVOID*)&ConnectionFileObject,
+        NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (skip(NT_SUCCESS(Status), "No connection\n"))
+    {
+        ExFreePoolWithTag(Buffer, TAG_TEST);
+        return;
+    }
+    DeviceObject = IoGetRelatedDeviceObject(ConnectionFileObject);
+
+    /* Associate the connection file and the address */
+    Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    ok(Irp != NULL, "IoAllocateIrp failed.\n");
+    TdiBuildAssociateAddress(Irp, DeviceObject, ConnectionFileObject, NULL, NULL, AddressHandle);
+    Status = CallTdi(DeviceObject, Irp, NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    /* Connect to the user mode part of the test */
+    RtlZeroMemory(&RequestInfo, sizeof(RequestInfo));
+    FillAddress(&ConnectAddress, TEST_SEND_SERVER_PORT);
+    RequestInfo.RemoteAddressLength = sizeof(ConnectAddress);
+    RequestInfo.RemoteAddress = &ConnectAddress;
+    RtlZeroMemory(&ReturnInfo, sizeof(ReturnInfo));
+    RtlZeroMemory(&ReturnAddress, sizeof(ReturnAddress));
+    ReturnInfo.RemoteAddressLength = sizeof(ReturnAddress);
+    ReturnInfo.RemoteAddress = &ReturnAddress;
+
+    Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    ok(Irp != NULL, "IoAllocateIrp failed.\n");
+    TdiBuildConnect(Irp, DeviceObject, ConnectionFileObject, NULL, NULL, NULL, &RequestInfo, &ReturnInfo);
+    Status = CallTdi(DeviceObject, Irp, NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    if (NT_SUCCESS(Status))
+    {
+        Time = SendAll(DeviceObject, ConnectionFileObject, Buffer);
+        trace("Loopback send: %lu KiB in %I64u ms, %I64u KiB/s\n",
+              TEST_SEND_TOTAL_LENGTH / 1024, Time / 10000,
+              (ULONGLONG)TEST_SEND_TOTAL_LENGTH * 10000000 / 1024 / max(Time, 1));
+
+        /* Let the peer see the end of the data */
+        Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+        ok(Irp != NULL, "IoAllocateIrp failed.\n");
+        TdiBuildDisconnect(Irp, DeviceObject, ConnectionFileObject, NULL, NULL, NULL,
+                           TDI_DISCONNECT_RELEASE, NULL, NULL);
+        Status = CallTdi(DeviceObject, Irp, NULL);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+    }
+
+    ObDereferenceObject(ConnectionFileObject);
+
+    ZwClose(ConnectionHandle);
+    ZwClose(AddressHandle);
+
+    ExFreePoolWithTag(Buffer, TAG_TEST);
+}
+
+static KSTART_ROUTINE RunTest;
+static
+VOID
+NTAPI
+RunTest(
+    _In_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    TestTcpSend();
+}
+
+KMT_MESSAGE_HANDLER TestSend;
+NTSTATUS
+TestSend(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ ULONG ControlCode,
+    _In_opt_ PVOID Buffer,
+    _In_ SIZE_T InLength,
+    _Inout_ PSIZE_T OutLength
+)
+{
+    PKTHREAD Thread;
+
+    Thread = KmtStartThread(RunTest, NULL);
+    KmtFinishThread(Thread, NULL);
+
+    return STATUS_SUCCESS;
+}
@@ -1,7 +1,14 @@
 
 #define IOCTL_TEST_TDI      1
 #define IOCTL_TEST_CONNECT  2
+#define IOCTL_TEST_SEND     3
 
 /* For the TDI_CONNECT test */
 #define TEST_CONNECT_SERVER_PORT 12345
 #define TEST_CONNECT_CLIENT_PORT 54321
+
+/* For the TDI_SEND test */
+#define TEST_SEND_SERVER_PORT 12346
+#define TEST_SEND_CLIENT_PORT 54322
+#define TEST_SEND_TOTAL_LENGTH (64 * 1024 * 1024)
+#define TEST_SEND_CHUNK_LENGTH (256 * 1024)
@@ -168,8 +168,8 @@ CcPurgeCacheSection (
     LONGLONG EndOffset;
     LIST_ENTRY FreeList;
     KIRQL OldIrql;
-    PLIST_ENTRY ListEntry;
     PROS_VACB Vacb;
+    LONGLONG NextOffset;
     LONGLONG ViewEnd;
     BOOLEAN Success;
 
@@ -203,15 +203,16 @@ CcPurgeCacheSection (
 
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    ListEntry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (ListEntry != &SharedCacheMap->CacheMapVacbListHead)
+
+    /* The VACB list isn't sorted, walk the range through the index instead */
+    NextOffset = StartOffset;
+    while ((Vacb = CcRosFindNextVacbLocked(SharedCacheMap, NextOffset, EndOffset)) != NULL)
     {
         ULONG Refs;
 
-        Vacb = CONTAINING_RECORD(ListEntry, ROS_VACB, CacheMapVacbListEntry);
-        ListEntry = ListEntry->Flink;
+        NextOffset = Vacb->FileOffset.QuadPart + VACB_MAPPING_GRANULARITY;
 
-        /* Skip VACBs outside the range, or only partially in range */
+        /* Skip VACBs only partially in range */
         if (Vacb->FileOffset.QuadPart < StartOffset)
         {
             continue;
@@ -220,7 +221,7 @@ CcPurgeCacheSection (
                       SharedCacheMap->SectionSize.QuadPart);
         if (ViewEnd >= EndOffset)
         {
-            break;
+            continue;
         }
 
         /* Still in use, it cannot be purged, fail
@@ -242,6 +243,7 @@ CcPurgeCacheSection (
         {
             CcRosUnmarkDirtyVacb(Vacb, FALSE);
         }
+        CcRosRemoveVacbFromIndex(Vacb);
         RemoveEntryList(&Vacb->CacheMapVacbListEntry);
         InsertHeadList(&FreeList, &Vacb->CacheMapVacbListEntry);
     }
@@ -62,6 +62,21 @@ LIST_ENTRY CcDeferredWrites;
 KSPIN_LOCK CcDeferredWriteSpinLock;
 LIST_ENTRY CcCleanSharedCacheMapList;
 
+/* VACB index: a sparse radix tree over the view number of each VACB
+ * (FileOffset / VACB_MAPPING_GRANULARITY), VACB_INDEX_SHIFT bits per level.
+ * The tree only grows in depth while the shared cache map lives, so that
+ * lookups are a few array dereferences whatever the number of views.
+ * It is protected by the shared cache map CacheMapLock.
+ */
+#define VACB_INDEX_SHIFT 7
+#define VACB_INDEX_SLOTS (1 << VACB_INDEX_SHIFT)
+#define VACB_INDEX_MASK (VACB_INDEX_SLOTS - 1)
+
+typedef struct _ROS_VACB_INDEX_NODE
+{
+    PVOID Slots[VACB_INDEX_SLOTS];
+} ROS_VACB_INDEX_NODE, *PROS_VACB_INDEX_NODE;
+
 #if DBG
 ULONG CcRosVacbIncRefCount_(PROS_VACB vacb, PCSTR file, INT line)
 {
@@ -110,9 +125,176 @@ ULONG CcRosVacbGetRefCount_(PROS_VACB vacb, PCSTR file, INT line)
 }
 #endif
 
-
 /* FUNCTIONS *****************************************************************/
 
+static
+PVOID*
+CcRosVacbIndexSlot (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    ULONGLONG ViewNumber,
+    BOOLEAN Create)
+{
+    PROS_VACB_INDEX_NODE Node;
+    PVOID *Slot;
+    ULONG Level;
+
+    /* Grow the tree until it covers the requested view */
+    while (SharedCacheMap->VacbIndex == NULL ||
+           (SharedCacheMap->VacbIndexDepth * VACB_INDEX_SHIFT < 64 &&
+            (ViewNumber >> (SharedCacheMap->VacbIndexDepth * VACB_INDEX_SHIFT)) != 0))
+    {
+        if (!Create)
+            return NULL;
+
+        Node = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Node), TAG_VACB_INDEX);
+        if (Node == NULL)
+            return NULL;
+
+        RtlZeroMemory(Node, sizeof(*Node));
+        Node->Slots[0] = SharedCacheMap->VacbIndex;
+        SharedCacheMap->VacbIndex = Node;
+        SharedCacheMap->VacbIndexDepth++;
+    }
+
+    /* And walk down to the leaf */
+    Slot = (PVOID *)&SharedCacheMap->VacbIndex;
+    for (Level = SharedCacheMap->VacbIndexDepth; Level > 0; Level--)
+    {
+        Node = *Slot;
+        if (Node == NULL)
+        {
+            if (!Create)
+                return NULL;
+
+            Node = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Node), TAG_VACB_INDEX);
+            if (Node == NULL)
+                return NULL;
+
+            RtlZeroMemory(Node, sizeof(*Node));
+            *Slot = Node;
+        }
+
+        Slot = &Node->Slots[(ViewNumber >> ((Level - 1) * VACB_INDEX_SHIFT)) & VACB_INDEX_MASK];
+    }
+
+    return Slot;
+}
+
+static
+VOID
+CcRosFreeVacbIndex (
+    PROS_VACB_INDEX_NODE Node,
+    ULONG Depth)
+{
+    ULONG i;
+
+    if (Node == NULL)
+        return;
+
+    if (Depth > 1)
+    {
+        for (i = 0; i < VACB_INDEX_SLOTS; i++)
+        {
+            CcRosFreeVacbIndex(Node->Slots[i], Depth - 1);
+        }
+    }
+
+    ExFreePoolWithTag(Node, TAG_VACB_INDEX);
+}
+
+/* Caller must hold the shared cache map CacheMapLock */
+VOID
+CcRosRemoveVacbFromIndex (
+    PROS_VACB Vacb)
+{
+    PVOID *Slot;
+
+    Slot = CcRosVacbIndexSlot(Vacb->SharedCacheMap,
+                              Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY,
+                              FALSE);
+    ASSERT(Slot != NULL && *Slot == Vacb);
+    if (Slot != NULL)
+    {
+        *Slot = NULL;
+    }
+}
+
+/* Caller must hold the shared cache map CacheMapLock */
+PROS_VACB
+CcRosLookupVacbLocked (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    PVOID *Slot;
+
+    ASSERT(FileOffset >= 0);
+
+    Slot = CcRosVacbIndexSlot(SharedCacheMap,
+                              FileOffset / VACB_MAPPING_GRANULARITY,
+                              FALSE);
+    if (Slot == NULL)
+        return NULL;
+
+    return *Slot;
+}
+
+static
+PROS_VACB
+CcRosFindVacbInIndexNode (
+    PROS_VACB_INDEX_NODE Node,
+    ULONG Level,
+    ULONGLONG BaseView,
+    ULONGLONG FirstView,
+    ULONGLONG LastView)
+{
+    ULONG Shift = (Level - 1) * VACB_INDEX_SHIFT;
+    ULONGLONG SlotFirst, SlotLast;
+    PROS_VACB Vacb;
+    ULONG i;
+
+    for (i = 0; i < VACB_INDEX_SLOTS; i++)
+    {
+        SlotFirst = BaseView + ((ULONGLONG)i << Shift);
+        SlotLast = SlotFirst + ((1ULL << Shift) - 1);
+
+        if (SlotFirst > LastView)
+            break;
+
+        if (Node->Slots[i] == NULL || SlotLast < FirstView)
+            continue;
+
+        if (Level == 1)
+            return Node->Slots[i];
+
+        Vacb = CcRosFindVacbInIndexNode(Node->Slots[i], Level - 1, SlotFirst, FirstView, LastView);
+        if (Vacb != NULL)
+            return Vacb;
+    }
+
+    return NULL;
+}
+
+/* Returns the VACB with the lowest file offset in [FileOffset, EndOffset),
+ * skipping over the empty parts of the index.
+ * Caller must hold the shared cache map CacheMapLock */
+PROS_VACB
+CcRosFindNextVacbLocked (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset,
+    LONGLONG EndOffset)
+{
+    ASSERT(FileOffset >= 0);
+
+    if (SharedCacheMap->VacbIndex == NULL || FileOffset >= EndOffset)
+        return NULL;
+
+    return CcRosFindVacbInIndexNode(SharedCacheMap->VacbIndex,
+                                    SharedCacheMap->VacbIndexDepth,
+                                    0,
+                                    FileOffset / VACB_MAPPING_GRANULARITY,
+                                    (EndOffset - 1) / VACB_MAPPING_GRANULARITY);
+}
+
 VOID
 NTAPI
 CcRosTraceCacheMap (
@@ -363,6 +545,7 @@ retry:
             ASSERT(!current->MappedCount);
             ASSERT(Refs == 1);
 
+            CcRosRemoveVacbFromIndex(current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -452,14 +635,13 @@ CcRosReleaseVacb (
     return STATUS_SUCCESS;
 }
 
-/* Returns with VACB Lock Held! */
+/* Returns with a reference on the VACB */
 PROS_VACB
 NTAPI
 CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
     PROS_VACB current;
     KIRQL oldIrql;
 
@@ -468,33 +650,23 @@ CcRosLookupVacb (
     DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
            SharedCacheMap, FileOffset);
 
-    oldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    /* The index and the VACB references are protected by the cache map
+     * lock alone: no need to serialize against the whole system here.
+     */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosLookupVacbLocked(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        ASSERT(IsPointInRange(current->FileOffset.QuadPart,
+                              VACB_MAPPING_GRANULARITY,
+                              FileOffset));
+        CcRosVacbIncRefCount(current);
     }
 
-    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 
-    return NULL;
+    return current;
 }
 
 VOID
@@ -733,6 +905,7 @@ CcRosFreeUnusedVacb (
             ASSERT(Refs == 1);
 
             /* Reset and move to free list */
+            CcRosRemoveVacbFromIndex(current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -783,8 +956,7 @@ CcRosCreateVacb (
     PROS_VACB *Vacb)
 {
     PROS_VACB current;
-    PROS_VACB previous;
-    PLIST_ENTRY current_entry;
+    PVOID *Slot;
     NTSTATUS Status;
     KIRQL oldIrql;
     ULONG Refs;
@@ -853,56 +1025,49 @@ Retry:
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosLookupVacbLocked(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        CcRosVacbIncRefCount(current);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
+        if (SharedCacheMap->Trace)
+        {
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
+        }
 #endif
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-            Refs = CcRosVacbDecRefCount(*Vacb);
-            ASSERT(Refs == 0);
+        Refs = CcRosVacbDecRefCount(*Vacb);
+        ASSERT(Refs == 0);
 
-            *Vacb = current;
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
-        {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        *Vacb = current;
+        return STATUS_SUCCESS;
     }
-    /* There was no existing VACB. */
+
+    /* There was no existing VACB, index ours */
     current = *Vacb;
-    if (previous)
-    {
-        InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
-    }
-    else
+    Slot = CcRosVacbIndexSlot(SharedCacheMap,
+                              current->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY,
+                              TRUE);
+    if (Slot == NULL)
     {
-        InsertHeadList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+
+        Refs = CcRosVacbDecRefCount(current);
+        ASSERT(Refs == 0);
+
+        *Vacb = NULL;
+        return STATUS_INSUFFICIENT_RESOURCES;
     }
+
+    ASSERT(*Slot == NULL);
+    *Slot = current;
+    InsertTailList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
     InsertTailList(&VacbLruListHead, &current->VacbLruListEntry);
     KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
@@ -1167,6 +1332,8 @@ CcRosDeleteFileCache (
     PLIST_ENTRY current_entry;
     PROS_VACB current;
     LIST_ENTRY FreeList;
+    PROS_VACB_INDEX_NODE VacbIndex;
+    ULONG VacbIndexDepth;
 
     ASSERT(SharedCacheMap);
 
@@ -1189,9 +1356,10 @@ CcRosDeleteFileCache (
         while (!IsListEmpty(&SharedCacheMap->CacheMapVacbListHead))
         {
             current_entry = RemoveTailList(&SharedCacheMap->CacheMapVacbListHead);
+            current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
+            CcRosRemoveVacbFromIndex(current);
             KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
-            current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
             if (current->Dirty)
@@ -1214,10 +1382,16 @@ CcRosDeleteFileCache (
 #if DBG
         SharedCacheMap->Trace = FALSE;
 #endif
+        /* All the views are gone, detach their index */
+        VacbIndex = SharedCacheMap->VacbIndex;
+        VacbIndexDepth = SharedCacheMap->VacbIndexDepth;
+        SharedCacheMap->VacbIndex = NULL;
+        SharedCacheMap->VacbIndexDepth = 0;
         KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
         KeReleaseQueuedSpinLock(LockQueueMasterLock, *OldIrql);
         ObDereferenceObject(SharedCacheMap->FileObject);
+        CcRosFreeVacbIndex(VacbIndex, VacbIndexDepth);
 
         while (!IsListEmpty(&FreeList))
         {
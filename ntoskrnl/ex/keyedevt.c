@@ -14,15 +14,22 @@
 
 /* INTERNAL TYPES *************************************************************/
 
-#define NUM_KEY_HASH_BUCKETS 23
+/* The hash table is sized for the number of processors when the event is created */
+#define MIN_KEY_HASH_SHIFT 6
+#define MAX_KEY_HASH_SHIFT 10
+#define KEY_HASH_BUCKETS_PER_PROCESSOR 32
+
+typedef struct _EX_KEYED_EVENT_BUCKET
+{
+    EX_PUSH_LOCK Lock;
+    LIST_ENTRY WaitListHead;
+    LIST_ENTRY ReleaseListHead;
+} EX_KEYED_EVENT_BUCKET, *PEX_KEYED_EVENT_BUCKET;
+
 typedef struct _EX_KEYED_EVENT
 {
-    struct
-    {
-        EX_PUSH_LOCK Lock;
-        LIST_ENTRY WaitListHead;
-        LIST_ENTRY ReleaseListHead;
-    } HashTable[NUM_KEY_HASH_BUCKETS];
+    ULONG HashShift;
+    EX_KEYED_EVENT_BUCKET HashTable[ANYSIZE_ARRAY];
 } EX_KEYED_EVENT, *PEX_KEYED_EVENT;
 
 /* GLOBALS *******************************************************************/
@@ -41,6 +48,22 @@ GENERIC_MAPPING ExpKeyedEventMapping =
 
 /* FUNCTIONS *****************************************************************/
 
+static
+ULONG
+ExpGetKeyedEventHashShift(VOID)
+{
+    ULONG Shift = MIN_KEY_HASH_SHIFT;
+
+    /* Use the smallest power of two covering all processors */
+    while ((Shift < MAX_KEY_HASH_SHIFT) &&
+           ((1UL << Shift) < (ULONG)KeNumberProcessors * KEY_HASH_BUCKETS_PER_PROCESSOR))
+    {
+        Shift++;
+    }
+
+    return Shift;
+}
+
 _IRQL_requires_max_(APC_LEVEL)
 INIT_FUNCTION
 BOOLEAN
@@ -93,12 +116,15 @@ ExpInitializeKeyedEventImplementation(VOID)
 VOID
 NTAPI
 ExpInitializeKeyedEvent(
-    _Out_ PEX_KEYED_EVENT KeyedEvent)
+    _Out_ PEX_KEYED_EVENT KeyedEvent,
+    _In_ ULONG HashShift)
 {
     ULONG i;
 
+    KeyedEvent->HashShift = HashShift;
+
     /* Loop all hash buckets */
-    for (i = 0; i < NUM_KEY_HASH_BUCKETS; i++)
+    for (i = 0; i < (1UL << HashShift); i++)
     {
         /* Initialize the mutex and the wait lists */
         ExInitializePushLock(&KeyedEvent->HashTable[i].Lock);
@@ -120,33 +146,36 @@ ExpReleaseOrWaitForKeyedEvent(
     PETHREAD Thread, CurrentThread;
     PEPROCESS CurrentProcess;
     PLIST_ENTRY ListEntry, WaitListHead1, WaitListHead2;
+    PEX_KEYED_EVENT_BUCKET Bucket;
     NTSTATUS Status;
-    ULONG_PTR HashIndex;
+    ULONG HashIndex;
     PVOID PreviousKeyedWaitValue;
 
     /* Get the current process */
     CurrentProcess = PsGetCurrentProcess();
 
-    /* Calculate the hash index */
-    HashIndex = (ULONG_PTR)KeyedWaitValue >> 5;
-    HashIndex ^= (ULONG_PTR)CurrentProcess >> 6;
-    HashIndex %= NUM_KEY_HASH_BUCKETS;
+    /* Calculate the hash index. Keys are usually stack or heap addresses
+       a few bytes apart, multiply to spread them over the whole table */
+    HashIndex = (ULONG)((ULONG_PTR)KeyedWaitValue >> 2);
+    HashIndex ^= (ULONG)((ULONG_PTR)CurrentProcess >> 6);
+    HashIndex = (HashIndex * 0x9E3779B1) >> (32 - KeyedEvent->HashShift);
+    Bucket = &KeyedEvent->HashTable[HashIndex];
 
     /* Lock the lists */
     KeEnterCriticalRegion();
-    ExAcquirePushLockExclusive(&KeyedEvent->HashTable[HashIndex].Lock);
+    ExAcquirePushLockExclusive(&Bucket->Lock);
 
     /* Get the lists for search and wait, depending on whether
        we want to wait for the event or signal it */
     if (Release)
     {
-        WaitListHead1 = &KeyedEvent->HashTable[HashIndex].WaitListHead;
-        WaitListHead2 = &KeyedEvent->HashTable[HashIndex].ReleaseListHead;
+        WaitListHead1 = &Bucket->WaitListHead;
+        WaitListHead2 = &Bucket->ReleaseListHead;
     }
     else
     {
-        WaitListHead1 = &KeyedEvent->HashTable[HashIndex].ReleaseListHead;
-        WaitListHead2 = &KeyedEvent->HashTable[HashIndex].WaitListHead;
+        WaitListHead1 = &Bucket->ReleaseListHead;
+        WaitListHead2 = &Bucket->WaitListHead;
     }
 
     /* loop the first wait list */
@@ -178,7 +207,7 @@ ExpReleaseOrWaitForKeyedEvent(
             Thread = NULL;
 
             /* Unlock the list. After this it is not safe to access Thread */
-            ExReleasePushLockExclusive(&KeyedEvent->HashTable[HashIndex].Lock);
+            ExReleasePushLockExclusive(&Bucket->Lock);
             KeLeaveCriticalRegion();
 
             return STATUS_SUCCESS;
@@ -199,7 +228,7 @@ ExpReleaseOrWaitForKeyedEvent(
     InsertTailList(WaitListHead2, &CurrentThread->KeyedWaitChain);
 
     /* Unlock the list */
-    ExReleasePushLockExclusive(&KeyedEvent->HashTable[HashIndex].Lock);
+    ExReleasePushLockExclusive(&Bucket->Lock);
     KeLeaveCriticalRegion();
 
     /* Wait for the keyed wait semaphore */
@@ -214,7 +243,7 @@ ExpReleaseOrWaitForKeyedEvent(
     {
         /* Lock the lists to make sure no one else messes with the entry */
         KeEnterCriticalRegion();
-        ExAcquirePushLockExclusive(&KeyedEvent->HashTable[HashIndex].Lock);
+        ExAcquirePushLockExclusive(&Bucket->Lock);
 
         /* Check if the wait list entry is still in the list */
         if (!IsListEmpty(&CurrentThread->KeyedWaitChain))
@@ -225,7 +254,7 @@ ExpReleaseOrWaitForKeyedEvent(
         }
 
         /* Unlock the list */
-        ExReleasePushLockExclusive(&KeyedEvent->HashTable[HashIndex].Lock);
+        ExReleasePushLockExclusive(&Bucket->Lock);
         KeLeaveCriticalRegion();
     }
 
@@ -281,6 +310,7 @@ NtCreateKeyedEvent(
     KPROCESSOR_MODE PreviousMode = KeGetPreviousMode();
     PEX_KEYED_EVENT KeyedEvent;
     HANDLE KeyedEventHandle;
+    ULONG HashShift;
     NTSTATUS Status;
 
     /* Check flags */
@@ -291,12 +321,13 @@ NtCreateKeyedEvent(
     }
 
     /* Create the object */
+    HashShift = ExpGetKeyedEventHashShift();
     Status = ObCreateObject(PreviousMode,
                             ExKeyedEventObjectType,
                             ObjectAttributes,
                             PreviousMode,
                             NULL,
-                            sizeof(EX_KEYED_EVENT),
+                            FIELD_OFFSET(EX_KEYED_EVENT, HashTable[1UL << HashShift]),
                             0,
                             0,
                             (PVOID*)&KeyedEvent);
@@ -305,7 +336,7 @@ NtCreateKeyedEvent(
     if (!NT_SUCCESS(Status)) return Status;
 
     /* Initialize the keyed event */
-    ExpInitializeKeyedEvent(KeyedEvent);
+    ExpInitializeKeyedEvent(KeyedEvent, HashShift);
 
     /* Insert it */
     Status = ObInsertObject(KeyedEvent,
@@ -188,6 +188,9 @@ typedef struct _ROS_SHARED_CACHE_MAP
 
     /* ROS specific */
     LIST_ENTRY CacheMapVacbListHead;
+    /* Sparse index of the VACBs, by FileOffset / VACB_MAPPING_GRANULARITY */
+    struct _ROS_VACB_INDEX_NODE *VacbIndex;
+    ULONG VacbIndexDepth;
     BOOLEAN PinAccess;
     KSPIN_LOCK CacheMapLock;
 #if DBG
@@ -360,6 +363,24 @@ CcRosLookupVacb(
     LONGLONG FileOffset
 );
 
+PROS_VACB
+CcRosLookupVacbLocked(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset
+);
+
+PROS_VACB
+CcRosFindNextVacbLocked(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset,
+    LONGLONG EndOffset
+);
+
+VOID
+CcRosRemoveVacbFromIndex(
+    PROS_VACB Vacb
+);
+
 VOID
 NTAPI
 CcInitCacheZeroPage(VOID);
@@ -86,6 +86,25 @@
 //
 #define IOP_MAX_REPARSE_TRAVERSAL 0x20
 
+//
+// Max entries NtRemoveIoCompletionEx takes off a completion port at once
+//
+#define IOP_MAX_REMOVED_COMPLETIONS 0x40
+
+//
+// Vista class used by SetFileCompletionNotificationModes, handled by the I/O
+// manager itself. We build for 2003, which hides it from the headers.
+//
+#if (NTDDI_VERSION < NTDDI_VISTA)
+#define FileIoCompletionNotificationInformation \
+    ((FILE_INFORMATION_CLASS)(FileShortNameInformation + 1))
+#endif
+
+//
+// Highest class NtSetInformationFile takes, plus one
+//
+#define IOP_MAX_SET_INFORMATION_CLASS (FileIoCompletionNotificationInformation + 1)
+
 //
 // Private flags for IoCreateFile / IoParseDevice
 //
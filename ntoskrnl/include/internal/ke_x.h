@@ -471,6 +471,40 @@ KiReleasePrcbLock(IN PKPRCB Prcb)
     InterlockedAnd((PLONG)&Prcb->PrcbLock, 0);
 }
 
+//
+// This routine acquires the PRCB locks of two different CPUs, always in the
+// order of their processor numbers so that two CPUs grabbing each other's
+// locks can't deadlock.
+//
+FORCEINLINE
+VOID
+KiAcquireTwoPrcbLocks(IN PKPRCB FirstPrcb,
+                      IN PKPRCB SecondPrcb)
+{
+    /* Acquire the lower numbered PRCB first */
+    ASSERT(FirstPrcb != SecondPrcb);
+    if (FirstPrcb->Number < SecondPrcb->Number)
+    {
+        KiAcquirePrcbLock(FirstPrcb);
+        KiAcquirePrcbLock(SecondPrcb);
+    }
+    else
+    {
+        KiAcquirePrcbLock(SecondPrcb);
+        KiAcquirePrcbLock(FirstPrcb);
+    }
+}
+
+FORCEINLINE
+VOID
+KiReleaseTwoPrcbLocks(IN PKPRCB FirstPrcb,
+                      IN PKPRCB SecondPrcb)
+{
+    /* The release order doesn't matter */
+    KiReleasePrcbLock(FirstPrcb);
+    KiReleasePrcbLock(SecondPrcb);
+}
+
 //
 // This routine acquires the thread lock so that only one caller can touch
 // volatile thread data.
@@ -1235,7 +1269,7 @@ KxSetTimerForThreadWait(IN PKTIMER Timer,
     }                                                                       \
                                                                             \
     /* Set wait settings */                                                 \
-    Thread->Alertable = FALSE;                                              \
+    Thread->Alertable = Alertable;                                          \
     Thread->WaitMode = WaitMode;                                            \
     Thread->WaitReason = WrQueue;                                           \
                                                                             \
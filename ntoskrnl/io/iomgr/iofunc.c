@@ -444,8 +444,10 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                     IopUnlockFileObject(FileObject);
                 }
 
-                /* Set completion if required */
-                if (CompletionInfo.Port != NULL && UserApcContext != NULL)
+                /* Set completion if required, unless the caller skips it on success */
+                if (CompletionInfo.Port != NULL && UserApcContext != NULL &&
+                    (!(FileObject->Flags & FO_SKIP_COMPLETION_PORT) ||
+                     !NT_SUCCESS(KernelIosb.Status)))
                 {
                     if (!NT_SUCCESS(IoSetIoCompletion(CompletionInfo.Port,
                                                       CompletionInfo.Key,
@@ -1875,8 +1877,10 @@ NtLockFile(IN HANDLE FileHandle,
                 ObDereferenceObject(Event);
             }
 
-            /* Set completion if required */
-            if (FileObject->CompletionContext != NULL && ApcContext != NULL)
+            /* Set completion if required, unless the caller skips it on success */
+            if (FileObject->CompletionContext != NULL && ApcContext != NULL &&
+                (!(FileObject->Flags & FO_SKIP_COMPLETION_PORT) ||
+                 !NT_SUCCESS(KernelIosb.Status)))
             {
                 if (!NT_SUCCESS(IoSetIoCompletion(FileObject->CompletionContext->Port,
                                                   FileObject->CompletionContext->Key,
@@ -3059,6 +3063,7 @@ NtSetInformationFile(IN HANDLE FileHandle,
     IO_STATUS_BLOCK KernelIosb;
     PVOID Queue;
     PFILE_COMPLETION_INFORMATION CompletionInfo = FileInformation;
+    PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION NotificationInfo;
     PIO_COMPLETION_CONTEXT Context;
     PFILE_RENAME_INFORMATION RenameInfo;
     HANDLE TargetHandle = NULL;
@@ -3070,7 +3075,7 @@ NtSetInformationFile(IN HANDLE FileHandle,
     {
         /* Validate the information class */
         if ((FileInformationClass < 0) ||
-            (FileInformationClass >= FileMaximumInformation) ||
+            (FileInformationClass >= IOP_MAX_SET_INFORMATION_CLASS) ||
             !(IopSetOperationLength[FileInformationClass]))
         {
             /* Invalid class */
@@ -3107,7 +3112,7 @@ NtSetInformationFile(IN HANDLE FileHandle,
     {
         /* Validate the information class */
         if ((FileInformationClass < 0) ||
-            (FileInformationClass >= FileMaximumInformation) ||
+            (FileInformationClass >= IOP_MAX_SET_INFORMATION_CLASS) ||
             !(IopSetOperationLength[FileInformationClass]))
         {
             /* Invalid class */
@@ -3323,6 +3328,32 @@ NtSetInformationFile(IN HANDLE FileHandle,
         Irp->IoStatus.Status = Status;
         Irp->IoStatus.Information = 0;
     }
+    else if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        /* The I/O manager handles these itself, they can't be turned off again */
+        NotificationInfo = Irp->AssociatedIrp.SystemBuffer;
+        if (NotificationInfo->Flags & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                        FILE_SKIP_SET_EVENT_ON_HANDLE))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+        }
+        else
+        {
+            if (NotificationInfo->Flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)
+            {
+                FileObject->Flags |= FO_SKIP_COMPLETION_PORT;
+            }
+            if (NotificationInfo->Flags & FILE_SKIP_SET_EVENT_ON_HANDLE)
+            {
+                FileObject->Flags |= FO_SKIP_SET_EVENT;
+            }
+            Status = STATUS_SUCCESS;
+        }
+
+        /* Set the IRP Status */
+        Irp->IoStatus.Status = Status;
+        Irp->IoStatus.Information = 0;
+    }
     else if (FileInformationClass == FileRenameInformation ||
              FileInformationClass == FileLinkInformation ||
              FileInformationClass == FileMoveClusterInformation)
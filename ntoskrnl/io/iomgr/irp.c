@@ -332,8 +332,15 @@ IopCompleteRequest(IN PKAPC Apc,
         (Irp->PendingReturned &&
          !IsIrpSynchronous(Irp, FileObject)))
     {
-        /* Get any information we need from the FO before we kill it */
-        if ((FileObject) && (FileObject->CompletionContext))
+        /*
+         * Get any information we need from the FO before we kill it. A request
+         * that succeeded without pending doesn't get a completion packet if
+         * the caller asked to skip it, the return value already told it.
+         */
+        if ((FileObject) && (FileObject->CompletionContext) &&
+            (!(FileObject->Flags & FO_SKIP_COMPLETION_PORT) ||
+             (Irp->PendingReturned) ||
+             !(NT_SUCCESS(Irp->IoStatus.Status))))
         {
             /* Save Completion Data */
             Port = FileObject->CompletionContext->Port;
@@ -399,8 +406,14 @@ IopCompleteRequest(IN PKAPC Apc,
         }
         else if (FileObject)
         {
-            /* Signal the file object and set the status */
-            KeSetEvent(&FileObject->Event, 0, FALSE);
+            /* Signal the file object, unless asynchronous I/O asked not to */
+            if ((FileObject->Flags & FO_SYNCHRONOUS_IO) ||
+                !(FileObject->Flags & FO_SKIP_SET_EVENT))
+            {
+                KeSetEvent(&FileObject->Event, 0, FALSE);
+            }
+
+            /* Set the status */
             FileObject->FinalStatus = Irp->IoStatus.Status;
 
             /*
@@ -52,23 +52,37 @@ KiDpcInterruptHandler(VOID)
     }
     else if (Prcb->NextThread)
     {
-        /* Capture current thread data */
-        OldThread = Prcb->CurrentThread;
+        /* Lock the PRCB, the old thread gets queued on its ready lists */
+        KiAcquirePrcbLock(Prcb);
+
+        /* Another CPU may have taken the next thread back meanwhile */
         NewThread = Prcb->NextThread;
+        if (!NewThread)
+        {
+            KiReleasePrcbLock(Prcb);
+        }
+        else
+        {
+            /* Capture current thread data */
+            OldThread = Prcb->CurrentThread;
+
+            /* Set current thread's swap busy to true */
+            KiSetThreadSwapBusy(OldThread);
 
-        /* Set new thread data */
-        Prcb->NextThread = NULL;
-        Prcb->CurrentThread = NewThread;
+            /* Set new thread data */
+            Prcb->NextThread = NULL;
+            Prcb->CurrentThread = NewThread;
 
-        /* The thread is now running */
-        NewThread->State = Running;
-        OldThread->WaitReason = WrDispatchInt;
+            /* The thread is now running */
+            NewThread->State = Running;
+            OldThread->WaitReason = WrDispatchInt;
 
-        /* Make the old thread ready */
-        KxQueueReadyThread(OldThread, Prcb);
+            /* Make the old thread ready, this releases the PRCB lock */
+            KxQueueReadyThread(OldThread, Prcb);
 
-        /* Swap to the new thread */
-        KiSwapContext(APC_LEVEL, OldThread);
+            /* Swap to the new thread */
+            KiSwapContext(APC_LEVEL, OldThread);
+        }
     }
 
     /* Go back to old irql and disable interrupts */
@@ -142,16 +156,28 @@ KiIdleLoop(VOID)
             /* Enable interrupts */
             _enable();
 
+            /* Lock the PRCB, another CPU may still replace the next thread */
+            KiAcquirePrcbLock(Prcb);
+
+            /* Or take it back, if its affinity changed and nothing replaces it */
+            NewThread = Prcb->NextThread;
+            if (!NewThread)
+            {
+                KiReleasePrcbLock(Prcb);
+                continue;
+            }
+
             /* Capture current thread data */
             OldThread = Prcb->CurrentThread;
-            NewThread = Prcb->NextThread;
 
             /* Set new thread data */
             Prcb->NextThread = NULL;
             Prcb->CurrentThread = NewThread;
+            Prcb->IdleSchedule = FALSE;
 
             /* The thread is now running */
             NewThread->State = Running;
+            KiReleasePrcbLock(Prcb);
 
             /* Do the swap at SYNCH_LEVEL */
             KfRaiseIrql(SYNCH_LEVEL);
@@ -162,6 +188,12 @@ KiIdleLoop(VOID)
             /* Go back to DISPATCH_LEVEL */
             KeLowerIrql(DISPATCH_LEVEL);
         }
+        else if (Prcb->IdleSchedule)
+        {
+            /* We just went idle, look for work on the other CPUs */
+            _enable();
+            KiIdleSchedule(Prcb);
+        }
         else
         {
             /* Continue staying idle. Note the HAL returns with interrupts on */
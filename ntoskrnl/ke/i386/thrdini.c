@@ -300,20 +300,38 @@ KiIdleLoop(VOID)
             /* Enable interrupts */
             _enable();
 
+            /* Lock the PRCB, another CPU may still replace the next thread */
+            KiAcquirePrcbLock(Prcb);
+
+            /* Or take it back, if its affinity changed and nothing replaces it */
+            NewThread = Prcb->NextThread;
+            if (!NewThread)
+            {
+                KiReleasePrcbLock(Prcb);
+                continue;
+            }
+
             /* Capture current thread data */
             OldThread = Prcb->CurrentThread;
-            NewThread = Prcb->NextThread;
 
             /* Set new thread data */
             Prcb->NextThread = NULL;
             Prcb->CurrentThread = NewThread;
+            Prcb->IdleSchedule = FALSE;
 
             /* The thread is now running */
             NewThread->State = Running;
+            KiReleasePrcbLock(Prcb);
 
             /* Switch away from the idle thread */
             KiSwapContext(APC_LEVEL, OldThread);
         }
+        else if (Prcb->IdleSchedule)
+        {
+            /* We just went idle, look for work on the other CPUs */
+            _enable();
+            KiIdleSchedule(Prcb);
+        }
         else
         {
             /* Continue staying idle. Note the HAL returns with interrupts on */
@@ -334,6 +352,11 @@ KiSwapContextExit(IN PKTHREAD OldThread,
     /* We are on the new thread stack now */
     NewThread = Pcr->PrcbData.CurrentThread;
 
+#ifdef CONFIG_SMP
+    /* The old thread's stack is saved, other CPUs may switch to it now */
+    OldThread->SwapBusy = FALSE;
+#endif
+
     /* Now we are the new thread. Check if it's in a new process */
     OldProcess = OldThread->ApcState.Process;
     NewProcess = NewThread->ApcState.Process;
@@ -438,6 +461,11 @@ KiSwapContextEntry(IN PKSWITCHFRAME SwitchFrame,
     /* Get the old thread and set its kernel stack */
     OldThread->KernelStack = SwitchFrame;
 
+#ifdef CONFIG_SMP
+    /* Wait until the CPU the new thread last ran on is done switching away */
+    while (NewThread->SwapBusy) YieldProcessor();
+#endif
+
     /* ISRs can change FPU state, so disable interrupts while checking */
     _disable();
 
@@ -493,23 +521,37 @@ KiDispatchInterrupt(VOID)
     }
     else if (Prcb->NextThread)
     {
-        /* Capture current thread data */
-        OldThread = Prcb->CurrentThread;
+        /* Lock the PRCB, the old thread gets queued on its ready lists */
+        KiAcquirePrcbLock(Prcb);
+
+        /* Another CPU may have taken the next thread back meanwhile */
         NewThread = Prcb->NextThread;
+        if (!NewThread)
+        {
+            KiReleasePrcbLock(Prcb);
+        }
+        else
+        {
+            /* Capture current thread data */
+            OldThread = Prcb->CurrentThread;
 
-        /* Set new thread data */
-        Prcb->NextThread = NULL;
-        Prcb->CurrentThread = NewThread;
+            /* Set current thread's swap busy to true */
+            KiSetThreadSwapBusy(OldThread);
 
-        /* The thread is now running */
-        NewThread->State = Running;
-        OldThread->WaitReason = WrDispatchInt;
+            /* Set new thread data */
+            Prcb->NextThread = NULL;
+            Prcb->CurrentThread = NewThread;
+
+            /* The thread is now running */
+            NewThread->State = Running;
+            OldThread->WaitReason = WrDispatchInt;
 
-        /* Make the old thread ready */
-        KxQueueReadyThread(OldThread, Prcb);
+            /* Make the old thread ready, this releases the PRCB lock */
+            KxQueueReadyThread(OldThread, Prcb);
 
-        /* Swap to the new thread */
-        KiSwapContext(APC_LEVEL, OldThread);
+            /* Swap to the new thread */
+            KiSwapContext(APC_LEVEL, OldThread);
+        }
     }
 }
 
@@ -34,8 +34,23 @@ FASTCALL
 KiIpiSend(IN KAFFINITY TargetProcessors,
           IN ULONG IpiRequest)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("Not yet implemented\n", FALSE);
+#ifdef CONFIG_SMP
+    LONG i;
+    KAFFINITY Current;
+
+    /* Flag the request on each target CPU */
+    for (i = 0, Current = 1; i < KeNumberProcessors; i++, Current <<= 1)
+    {
+        if (TargetProcessors & Current)
+        {
+            InterlockedBitTestAndSet((PLONG)&KiProcessorBlock[i]->IpiFrozen,
+                                     IpiRequest);
+        }
+    }
+
+    /* Interrupt them all, KiIpiServiceRoutine handles the request */
+    HalRequestIpi(TargetProcessors);
+#endif
 }
 
 VOID
@@ -30,9 +30,10 @@ ULONG KiMask32Array[MAXIMUM_PRIORITY] =
 UCHAR
 NTAPI
 KeFindNextRightSetAffinity(IN UCHAR Number,
-                           IN ULONG Set)
+                           IN KAFFINITY Set)
 {
-    ULONG Bit, Result;
+    KAFFINITY Bit;
+    ULONG Result;
     ASSERT(Set != 0);
 
     /* Calculate the mask */
@@ -42,7 +43,11 @@ KeFindNextRightSetAffinity(IN UCHAR Number,
     if (!Bit) Bit = Set;
 
     /* Now find the right set and return it */
+#ifdef _WIN64
+    BitScanReverse64(&Result, Bit);
+#else
     BitScanReverse(&Result, Bit);
+#endif
     return (UCHAR)Result;
 }
 
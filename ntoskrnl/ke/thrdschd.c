@@ -15,9 +15,13 @@
 #ifdef _WIN64
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr64((PLONG64)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd64((PLONG64)Destination, SetMember);
 #else
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr((PLONG)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd((PLONG)Destination, SetMember);
 #endif
 
 /* GLOBALS *******************************************************************/
@@ -27,13 +31,139 @@ ULONG_PTR KiIdleSMTSummary;
 
 /* FUNCTIONS *****************************************************************/
 
+#ifdef CONFIG_SMP
+//
+// This routine looks for the highest priority thread on another CPU's ready
+// lists that is allowed to run on the given CPU, and removes it from there.
+// Both PRCB locks must be held.
+//
+static
+PKTHREAD
+KiStealReadyThread(IN PKPRCB Prcb,
+                   IN PKPRCB OtherPrcb)
+{
+    ULONG PrioritySet;
+    LONG Priority;
+    PLIST_ENTRY ListHead, ListEntry;
+    PKTHREAD Thread;
+
+    /* Scan the ready lists from the highest priority down */
+    PrioritySet = OtherPrcb->ReadySummary;
+    while (PrioritySet)
+    {
+        /* Get the highest priority left */
+        BitScanReverse((PULONG)&Priority, PrioritySet);
+        PrioritySet ^= PRIORITY_MASK(Priority);
+
+        /* Loop the threads waiting at this priority */
+        ListHead = &OtherPrcb->DispatcherReadyListHead[Priority];
+        for (ListEntry = ListHead->Flink;
+             ListEntry != ListHead;
+             ListEntry = ListEntry->Flink)
+        {
+            /* Skip threads that can't run on this CPU */
+            Thread = CONTAINING_RECORD(ListEntry, KTHREAD, WaitListEntry);
+            if (!(Thread->Affinity & Prcb->SetMember)) continue;
+
+            /* Make sure this thread is here for a reason */
+            ASSERT(Thread->State == Ready);
+            ASSERT(Thread->Priority == Priority);
+            ASSERT(Thread->NextProcessor == OtherPrcb->Number);
+
+            /* Remove it from the list */
+            if (RemoveEntryList(&Thread->WaitListEntry))
+            {
+                /* The list is empty now, reset the ready summary */
+                OtherPrcb->ReadySummary ^= PRIORITY_MASK(Priority);
+            }
+
+            /* It belongs to this CPU now */
+            Thread->NextProcessor = Prcb->Number;
+            return Thread;
+        }
+    }
+
+    /* Nothing this CPU can run */
+    return NULL;
+}
+#endif
+
+//
+// This routine is called by the idle loop after the CPU went idle. It looks
+// for a thread to run, first on this CPU's ready lists and then on the ready
+// lists of the other CPUs, and sets it up as the next thread.
+//
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
-    return NULL;
+    PKTHREAD Thread;
+#ifdef CONFIG_SMP
+    PKPRCB OtherPrcb;
+    ULONG Number, i;
+#endif
+
+    /* Sanity check */
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    ASSERT(Prcb == KeGetCurrentPrcb());
+
+    /* Lock the PRCB and clear the idle schedule request */
+    KiAcquirePrcbLock(Prcb);
+    Prcb->IdleSchedule = FALSE;
+
+    /* Check if we got a thread in the meantime */
+    Thread = Prcb->NextThread;
+    if (!Thread)
+    {
+        /* Check our own ready lists first */
+        Thread = KiSelectReadyThread(0, Prcb);
+        if (Thread)
+        {
+            /* Set it on standby */
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+            InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+        }
+    }
+
+    /* Release the PRCB lock */
+    KiReleasePrcbLock(Prcb);
+
+#ifdef CONFIG_SMP
+    /* Loop the other CPUs, starting with the next one to spread the thieves */
+    Number = Prcb->Number;
+    for (i = 1; (i < (ULONG)KeNumberProcessors) && !(Thread); i++)
+    {
+        /* Get the next CPU and skip it if it has nothing ready */
+        if (++Number == (ULONG)KeNumberProcessors) Number = 0;
+        OtherPrcb = KiProcessorBlock[Number];
+        if (!(OtherPrcb) || !(OtherPrcb->ReadySummary)) continue;
+
+        /* Lock both PRCBs */
+        KiAcquireTwoPrcbLocks(Prcb, OtherPrcb);
+
+        /* Check if we got a thread in the meantime */
+        Thread = Prcb->NextThread;
+        if (!Thread)
+        {
+            /* Try to take one of the other CPU's ready threads */
+            Thread = KiStealReadyThread(Prcb, OtherPrcb);
+            if (Thread)
+            {
+                /* Set it on standby */
+                Thread->State = Standby;
+                Prcb->NextThread = Thread;
+                InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+            }
+        }
+
+        /* Release both PRCBs */
+        KiReleaseTwoPrcbLocks(Prcb, OtherPrcb);
+    }
+#endif
+
+    /* Return the thread that was found, if any */
+    return Thread;
 }
 
 VOID
@@ -83,6 +213,9 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     ULONG Processor = 0;
     KPRIORITY OldPriority;
     PKTHREAD NextThread;
+#ifdef CONFIG_SMP
+    KAFFINITY Affinity, ProcessorSet;
+#endif
 
     /* Sanity checks */
     ASSERT(Thread->State == DeferredReady);
@@ -228,29 +361,65 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     OldPriority = Thread->Priority;
     Thread->Preempted = FALSE;
 
-    /* Queue the thread on CPU 0 and get the PRCB and lock it */
-    Thread->NextProcessor = 0;
-    Prcb = KiProcessorBlock[0];
+#ifdef CONFIG_SMP
+PickProcessor:
+    /* Check if any idle CPU can run this thread */
+    Affinity = Thread->Affinity;
+    ProcessorSet = KiIdleSummary & Affinity;
+    if (!ProcessorSet)
+    {
+        /* No, so queue it on one of the CPUs it is allowed to use */
+        ProcessorSet = Affinity & KeActiveProcessors;
+        ASSERT(ProcessorSet != 0);
+    }
+
+    /* Prefer the ideal CPU, then the one it last ran on, then any other */
+    Processor = Thread->IdealProcessor;
+    if (!(ProcessorSet & AFFINITY_MASK(Processor)))
+    {
+        Processor = Thread->NextProcessor;
+        if (!(ProcessorSet & AFFINITY_MASK(Processor)))
+        {
+            Processor = KeFindNextRightSetAffinity(Thread->IdealProcessor,
+                                                   ProcessorSet);
+        }
+    }
+#endif
+
+    /* Set the CPU number, then get the PRCB and lock it */
+    Thread->NextProcessor = (UCHAR)Processor;
+    Prcb = KiProcessorBlock[Processor];
     KiAcquirePrcbLock(Prcb);
 
-    /* Check if we have an idle summary */
-    if (KiIdleSummary)
+#ifdef CONFIG_SMP
+    /*
+     * KiSetAffinityThread changes the affinity with the PRCB lock of our
+     * next processor held. Make sure it didn't exclude the CPU we picked.
+     */
+    if (!(Thread->Affinity & Prcb->SetMember))
     {
-        /* Clear it and set this thread as the next one */
-        KiIdleSummary = 0;
+        KiReleasePrcbLock(Prcb);
+        goto PickProcessor;
+    }
+#endif
+
+    /* Check if the CPU is idle, or about to become idle */
+    NextThread = Prcb->NextThread;
+    if ((NextThread == Prcb->IdleThread) ||
+        (!(NextThread) && (Prcb->CurrentThread == Prcb->IdleThread)))
+    {
+        /* Clear its idle bit and set this thread as the next one */
+        InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
         Thread->State = Standby;
         Prcb->NextThread = Thread;
 
-        /* Unlock the PRCB and return */
+        /* Unlock the PRCB and wake up the CPU if it isn't this one */
         KiReleasePrcbLock(Prcb);
+        KiRescheduleThread(TRUE, Processor);
         return;
     }
 
-    /* Set the CPU number */
-    Thread->NextProcessor = (UCHAR)Processor;
-
-    /* Get the next scheduled thread */
-    NextThread = Prcb->NextThread;
+    /* Check if there's a next scheduled thread */
     if (NextThread)
     {
         /* Sanity check */
@@ -336,12 +505,12 @@ KiSelectNextThread(IN PKPRCB Prcb)
         /* Didn't find any, get the current idle thread */
         Thread = Prcb->IdleThread;
 
-        /* Enable idle scheduling */
+        /*
+         * Enable idle scheduling, so that the idle loop can look for work on
+         * the other CPUs, and let them know they can give us threads.
+         */
         InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
         Prcb->IdleSchedule = TRUE;
-
-        /* FIXME: SMT support */
-        ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     }
 
     /* Sanity checks and return the thread */
@@ -375,24 +544,10 @@ KiSwapThread(IN PKTHREAD CurrentThread,
     }
     else
     {
-        /* Try to find a ready thread */
-        NextThread = KiSelectReadyThread(0, Prcb);
-        if (NextThread)
-        {
-            /* Switch to it */
-            Prcb->CurrentThread = NextThread;
-            NextThread->State = Running;
-        }
-        else
-        {
-            /* Set the idle summary */
-            InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
-
-            /* Schedule the idle thread */
-            NextThread = Prcb->IdleThread;
-            Prcb->CurrentThread = NextThread;
-            NextThread->State = Running;
-        }
+        /* Find a ready thread, or go idle, and switch to it */
+        NextThread = KiSelectNextThread(Prcb);
+        Prcb->CurrentThread = NextThread;
+        NextThread->State = Running;
     }
 
     /* Sanity check and release the PRCB */
@@ -680,6 +835,109 @@ KiSetPriorityThread(IN PKTHREAD Thread,
     }
 }
 
+#ifdef CONFIG_SMP
+//
+// This routine changes the affinity of a thread with the PRCB lock of its
+// processor held, so that this CPU never sees a ready thread it may not run,
+// and makes sure the thread doesn't stay scheduled there if it isn't allowed.
+//
+static
+VOID
+KiMigrateThread(IN PKTHREAD Thread,
+                IN KAFFINITY Affinity)
+{
+    PKPRCB Prcb;
+    ULONG Processor;
+    PKTHREAD NextThread;
+    BOOLEAN Reschedule;
+
+    /* Loop in case the thread moves to another CPU while we look at it */
+    for (;;)
+    {
+        /* Get the PRCB the thread belongs to and lock it */
+        Processor = Thread->NextProcessor;
+        Prcb = KiProcessorBlock[Processor];
+        KiAcquirePrcbLock(Prcb);
+
+        /* Make sure it's still the right one */
+        if (Thread->NextProcessor != Processor)
+        {
+            /* Release the lock and loop again */
+            KiReleasePrcbLock(Prcb);
+            continue;
+        }
+
+        /* Set the new affinity */
+        Thread->Affinity = Affinity;
+
+        /* Check if the thread may not run here anymore */
+        Reschedule = FALSE;
+        if (!(Affinity & Prcb->SetMember))
+        {
+            /* Choose action based on thread's state */
+            if ((Thread->State == Ready) && !(Thread->ProcessReadyQueue))
+            {
+                /* Remove it from the current queue */
+                if (RemoveEntryList(&Thread->WaitListEntry))
+                {
+                    /* Update the ready summary */
+                    Prcb->ReadySummary ^= PRIORITY_MASK(Thread->Priority);
+                }
+
+                /* Re-insert it on an allowed CPU */
+                KiInsertDeferredReadyList(Thread);
+            }
+            else if ((Thread->State == Standby) && (Thread == Prcb->NextThread))
+            {
+                /* Find a replacement, unless the CPU simply stays idle */
+                NextThread = KiSelectNextThread(Prcb);
+                if (NextThread == Prcb->CurrentThread)
+                {
+                    /* It does, so there's nothing to switch to */
+                    Prcb->NextThread = NULL;
+                }
+                else
+                {
+                    /* Set the replacement on standby */
+                    NextThread->State = Standby;
+                    Prcb->NextThread = NextThread;
+                }
+
+                /* Re-insert our thread on an allowed CPU */
+                KiInsertDeferredReadyList(Thread);
+            }
+            else if ((Thread->State == Running) &&
+                     (Thread == Prcb->CurrentThread) &&
+                     !(Prcb->NextThread))
+            {
+                /*
+                 * Find a replacement and set it on standby. Once the CPU
+                 * switches to it, the thread is queued on an allowed CPU.
+                 */
+                NextThread = KiSelectNextThread(Prcb);
+                NextThread->State = Standby;
+                Prcb->NextThread = NextThread;
+                Reschedule = TRUE;
+            }
+        }
+
+        /* Release the lock */
+        KiReleasePrcbLock(Prcb);
+
+        /*
+         * KiDeferredReadyThread sets the next processor before it locks it
+         * and checks the affinity. If it didn't change, that check will see
+         * the new affinity. Otherwise, go look at the new CPU.
+         */
+        if (Thread->NextProcessor != Processor) continue;
+
+        /* Make the CPU switch if needed */
+        KiRescheduleThread(Reschedule, Processor);
+        break;
+    }
+}
+#endif
+
 KAFFINITY
 FASTCALL
 KiSetAffinityThread(IN PKTHREAD Thread,
@@ -705,8 +963,21 @@ KiSetAffinityThread(IN PKTHREAD Thread,
     if (!Thread->SystemAffinityActive)
     {
 #ifdef CONFIG_SMP
-        /* FIXME: TODO */
-        DPRINT1("Affinity support disabled!\n");
+        /* Make sure the ideal processor is still part of the affinity */
+        if (!(Affinity & AFFINITY_MASK(Thread->UserIdealProcessor)))
+        {
+            /* It's not, pick a new one */
+            Thread->UserIdealProcessor =
+                KeFindNextRightSetAffinity(Thread->UserIdealProcessor,
+                                           Affinity);
+        }
+        Thread->IdealProcessor = Thread->UserIdealProcessor;
+
+        /* Apply the new affinity, moving the thread away if needed */
+        KiMigrateThread(Thread, Affinity);
+#else
+        /* Update the affinity */
+        Thread->Affinity = Affinity;
 #endif
     }
 
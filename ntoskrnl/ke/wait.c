@@ -228,8 +228,15 @@ KiExitDispatcher(IN KIRQL OldIrql)
     /* Lock the PRCB */
     KiAcquirePrcbLock(Prcb);
 
-    /* Get the next and current threads now */
+    /* Another CPU may have taken the next thread back meanwhile */
     NextThread = Prcb->NextThread;
+    if (!NextThread)
+    {
+        KiReleasePrcbLock(Prcb);
+        goto Quickie;
+    }
+
+    /* Get the current thread now */
     Thread = Prcb->CurrentThread;
 
     /* Set current thread's swap busy to true */
@@ -30,10 +30,45 @@ typedef struct _POOL_DPC_CONTEXT
     SIZE_T PoolTrackTableSizeExpansion;
 } POOL_DPC_CONTEXT, *PPOOL_DPC_CONTEXT;
 
+//
+// Nonpaged blocks too big for the lookaside lists are rounded up to a size
+// class and cached in per-processor magazines when they are freed
+//
+#define POOL_MAGAZINE_GRANULARITY   8
+#define POOL_MAGAZINE_MAX_DEPTH     16
+#define POOL_MAGAZINE_CLASSES       ((POOL_LISTS_PER_PAGE - NUMBER_POOL_LOOKASIDE_LISTS) / \
+                                     POOL_MAGAZINE_GRANULARITY - 1)
+#define POOL_MAGAZINE_CLASS(i)      (((i) - NUMBER_POOL_LOOKASIDE_LISTS - 1) / \
+                                     POOL_MAGAZINE_GRANULARITY)
+#define POOL_MAGAZINE_BLOCK_SIZE(c) (NUMBER_POOL_LOOKASIDE_LISTS + \
+                                     ((c) + 1) * POOL_MAGAZINE_GRANULARITY)
+
+typedef struct _POOL_MAGAZINE
+{
+    USHORT Depth;
+    USHORT Count;
+    PPOOL_HEADER Blocks[POOL_MAGAZINE_MAX_DEPTH];
+} POOL_MAGAZINE, *PPOOL_MAGAZINE;
+
+typedef struct _POOL_PROCESSOR_BLOCK
+{
+    PPOOL_DESCRIPTOR NonPagedPoolDescriptor;
+    ULONG LockAcquires;
+    ULONG LockContentions;
+    ULONG MagazineHits;
+    ULONG MagazineMisses;
+    SIZE_T MagazineBytes;
+    POOL_MAGAZINE Magazines[POOL_MAGAZINE_CLASSES];
+} POOL_PROCESSOR_BLOCK, *PPOOL_PROCESSOR_BLOCK;
+
+extern KSPIN_LOCK NonPagedPoolLock;
+
 ULONG ExpNumberOfPagedPools;
 POOL_DESCRIPTOR NonPagedPoolDescriptor;
 PPOOL_DESCRIPTOR ExpPagedPoolDescriptor[16 + 1];
 PPOOL_DESCRIPTOR PoolVector[2];
+POOL_PROCESSOR_BLOCK ExpBootPoolProcessorBlock;
+PPOOL_PROCESSOR_BLOCK ExpPoolProcessorBlock[MAXIMUM_PROCESSORS];
 PKGUARDED_MUTEX ExpPagedPoolMutex;
 SIZE_T PoolTrackTableSize, PoolTrackTableMask;
 SIZE_T PoolBigPageTableSize, PoolBigPageTableHash;
@@ -485,6 +520,8 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
 {
     SIZE_T i;
     BOOLEAN Verbose;
+    ULONG LockAcquires, LockContentions, MagazineHits, MagazineMisses;
+    SIZE_T MagazineBytes;
 
     //
     // Only print header if called from OOM situation
@@ -507,6 +544,13 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
     //
     Verbose = BooleanFlagOn(Flags, 1);
 
+    //
+    // Show how hard the processors fight over the nonpaged pool locks
+    //
+    ExQueryPoolContention(&LockAcquires, &LockContentions, &MagazineHits, &MagazineMisses, &MagazineBytes);
+    MiDumperPrint(CalledFromDbg, "NonPaged locks: %lu acquired, %lu contended; magazines: %lu hits, %lu misses, %Iu bytes cached\n",
+                  LockAcquires, LockContentions, MagazineHits, MagazineMisses, MagazineBytes);
+
     //
     // Print table header
     //
@@ -952,7 +996,6 @@ ExpInsertPoolTracker(IN ULONG Key,
     DPRINT1("Out of pool tag space, ignoring...\n");
 }
 
-INIT_FUNCTION
 VOID
 NTAPI
 ExInitializePoolDescriptor(IN PPOOL_DESCRIPTOR PoolDescriptor,
@@ -1003,6 +1046,27 @@ ExInitializePoolDescriptor(IN PPOOL_DESCRIPTOR PoolDescriptor,
     ASSERT(PoolType != PagedPoolSession);
 }
 
+static
+VOID
+ExpInitializePoolProcessorBlock(IN PPOOL_PROCESSOR_BLOCK Block,
+                                IN PPOOL_DESCRIPTOR NonPagedPoolDescriptor)
+{
+    ULONG i, Depth;
+
+    RtlZeroMemory(Block, sizeof(*Block));
+    Block->NonPagedPoolDescriptor = NonPagedPoolDescriptor;
+
+    //
+    // Let each magazine cache about a page worth of blocks
+    //
+    for (i = 0; i < POOL_MAGAZINE_CLASSES; i++)
+    {
+        Depth = PAGE_SIZE / (POOL_MAGAZINE_BLOCK_SIZE(i) * POOL_BLOCK_SIZE);
+        Depth = min(max(Depth, 2), POOL_MAGAZINE_MAX_DEPTH);
+        Block->Magazines[i].Depth = (USHORT)Depth;
+    }
+}
+
 INIT_FUNCTION
 VOID
 NTAPI
@@ -1208,6 +1272,14 @@ InitializePool(IN POOL_TYPE PoolType,
                                    0,
                                    Threshold,
                                    NULL);
+
+        //
+        // The boot processor owns the well-known descriptor, the others get
+        // their own the first time they allocate nonpaged pool
+        //
+        ExpInitializePoolProcessorBlock(&ExpBootPoolProcessorBlock,
+                                        &NonPagedPoolDescriptor);
+        ExpPoolProcessorBlock[0] = &ExpBootPoolProcessorBlock;
     }
     else
     {
@@ -1261,15 +1333,39 @@ FORCEINLINE
 KIRQL
 ExLockPool(IN PPOOL_DESCRIPTOR Descriptor)
 {
+    PPOOL_PROCESSOR_BLOCK Block;
+    BOOLEAN Contended;
+    KIRQL OldIrql;
+
     //
     // Check if this is nonpaged pool
     //
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
+        if (Descriptor->PoolIndex == 0)
+        {
+            //
+            // The boot processor's descriptor uses the queued spin lock
+            //
+            Contended = !KeTestSpinLock(&NonPagedPoolLock);
+            OldIrql = KeAcquireQueuedSpinLock(LockQueueNonPagedPoolLock);
+        }
+        else
+        {
+            //
+            // The other ones have their own spin lock
+            //
+            Contended = !KeTestSpinLock(Descriptor->LockAddress);
+            KeAcquireSpinLock(Descriptor->LockAddress, &OldIrql);
+        }
+
         //
-        // Use the queued spin lock
+        // Update the contention counters, which the lock protects
         //
-        return KeAcquireQueuedSpinLock(LockQueueNonPagedPoolLock);
+        Block = ExpPoolProcessorBlock[Descriptor->PoolIndex];
+        Block->LockAcquires++;
+        if (Contended) Block->LockContentions++;
+        return OldIrql;
     }
     else
     {
@@ -1292,9 +1388,16 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
         //
-        // Use the queued spin lock
+        // Use the queued spin lock or the descriptor's own spin lock
         //
-        KeReleaseQueuedSpinLock(LockQueueNonPagedPoolLock, OldIrql);
+        if (Descriptor->PoolIndex == 0)
+        {
+            KeReleaseQueuedSpinLock(LockQueueNonPagedPoolLock, OldIrql);
+        }
+        else
+        {
+            KeReleaseSpinLock(Descriptor->LockAddress, OldIrql);
+        }
     }
     else
     {
@@ -1305,6 +1408,393 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     }
 }
 
+static
+PPOOL_PROCESSOR_BLOCK
+ExpCreatePoolProcessorBlock(IN ULONG Number)
+{
+    PPOOL_PROCESSOR_BLOCK Block, OldBlock;
+    PPOOL_DESCRIPTOR Descriptor;
+    PKSPIN_LOCK Lock;
+    SIZE_T Size;
+
+    //
+    // Get pages for the block, the descriptor and its lock straight from the
+    // pool page allocator, so that we don't recurse into ExAllocatePoolWithTag
+    //
+    Size = sizeof(POOL_PROCESSOR_BLOCK) + sizeof(POOL_DESCRIPTOR) + sizeof(KSPIN_LOCK);
+    Block = MiAllocatePoolPages(NonPagedPool, Size);
+    if (!Block) return NULL;
+
+    Descriptor = (PPOOL_DESCRIPTOR)(Block + 1);
+    Lock = (PKSPIN_LOCK)(Descriptor + 1);
+    KeInitializeSpinLock(Lock);
+    ExInitializePoolDescriptor(Descriptor,
+                               NonPagedPool,
+                               Number,
+                               NonPagedPoolDescriptor.Threshold,
+                               Lock);
+    ExpInitializePoolProcessorBlock(Block, Descriptor);
+
+    //
+    // Another thread on this processor may have beaten us to it
+    //
+    OldBlock = InterlockedCompareExchangePointer((PVOID*)&ExpPoolProcessorBlock[Number],
+                                                 Block,
+                                                 NULL);
+    if (OldBlock)
+    {
+        MiFreePoolPages(Block);
+        return OldBlock;
+    }
+
+    ExpInsertPoolTracker('looP', ROUND_TO_PAGES(Size), NonPagedPool);
+    return Block;
+}
+
+FORCEINLINE
+PPOOL_DESCRIPTOR
+ExpGetNonPagedPoolDescriptor(VOID)
+{
+    PPOOL_PROCESSOR_BLOCK Block;
+    ULONG Number;
+
+    //
+    // Use the current processor's descriptor, it doesn't matter if we get
+    // moved to another one afterwards
+    //
+    Number = KeGetCurrentProcessorNumber();
+    Block = ExpPoolProcessorBlock[Number];
+    if (!Block)
+    {
+        //
+        // Fall back to the boot processor's descriptor if we're out of memory
+        //
+        Block = ExpCreatePoolProcessorBlock(Number);
+        if (!Block) return &NonPagedPoolDescriptor;
+    }
+
+    return Block->NonPagedPoolDescriptor;
+}
+
+static
+VOID
+ExpReleasePoolBlock(IN PPOOL_DESCRIPTOR PoolDesc,
+                    IN PPOOL_HEADER Entry)
+{
+    PPOOL_HEADER NextEntry;
+    USHORT BlockSize = Entry->BlockSize;
+    BOOLEAN Combined = FALSE;
+    KIRQL OldIrql;
+
+    //
+    // Get the pointer to the next entry
+    //
+    NextEntry = POOL_BLOCK(Entry, BlockSize);
+
+    //
+    // Acquire the pool lock
+    //
+    OldIrql = ExLockPool(PoolDesc);
+
+    //
+    // Check if the next allocation is at the end of the page
+    //
+    ExpCheckPoolBlocks(Entry);
+    if (PAGE_ALIGN(NextEntry) != NextEntry)
+    {
+        //
+        // We may be able to combine the block if it's free
+        //
+        if (NextEntry->PoolType == 0)
+        {
+            //
+            // The next block is free, so we'll do a combine
+            //
+            Combined = TRUE;
+
+            //
+            // Make sure there's actual data in the block -- anything smaller
+            // than this means we only have the header, so there's no linked list
+            // for us to remove
+            //
+            if ((NextEntry->BlockSize != 1))
+            {
+                //
+                // The block is at least big enough to have a linked list, so go
+                // ahead and remove it
+                //
+                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
+                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
+            }
+
+            //
+            // Our entry is now combined with the next entry
+            //
+            Entry->BlockSize = Entry->BlockSize + NextEntry->BlockSize;
+        }
+    }
+
+    //
+    // Now check if there was a previous entry on the same page as us
+    //
+    if (Entry->PreviousSize)
+    {
+        //
+        // Great, grab that entry and check if it's free
+        //
+        NextEntry = POOL_PREV_BLOCK(Entry);
+        if (NextEntry->PoolType == 0)
+        {
+            //
+            // It is, so we can do a combine
+            //
+            Combined = TRUE;
+
+            //
+            // Make sure there's actual data in the block -- anything smaller
+            // than this means we only have the header so there's no linked list
+            // for us to remove
+            //
+            if ((NextEntry->BlockSize != 1))
+            {
+                //
+                // The block is at least big enough to have a linked list, so go
+                // ahead and remove it
+                //
+                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
+                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
+            }
+
+            //
+            // Combine our original block (which might've already been combined
+            // with the next block), into the previous block
+            //
+            NextEntry->BlockSize = NextEntry->BlockSize + Entry->BlockSize;
+
+            //
+            // And now we'll work with the previous block instead
+            //
+            Entry = NextEntry;
+        }
+    }
+
+    //
+    // By now, it may have been possible for our combined blocks to actually
+    // have made up a full page (if there were only 2-3 allocations on the
+    // page, they could've all been combined).
+    //
+    if ((PAGE_ALIGN(Entry) == Entry) &&
+        (PAGE_ALIGN(POOL_NEXT_BLOCK(Entry)) == POOL_NEXT_BLOCK(Entry)))
+    {
+        //
+        // In this case, release the pool lock, update the performance counter,
+        // and free the page
+        //
+        ExUnlockPool(PoolDesc, OldIrql);
+        InterlockedExchangeAdd((PLONG)&PoolDesc->TotalPages, -1);
+        MiFreePoolPages(Entry);
+        return;
+    }
+
+    //
+    // Otherwise, we now have a free block (or a combination of 2 or 3)
+    //
+    Entry->PoolType = 0;
+    BlockSize = Entry->BlockSize;
+    ASSERT(BlockSize != 1);
+
+    //
+    // Check if we actually did combine it with anyone
+    //
+    if (Combined)
+    {
+        //
+        // Get the first combined block (either our original to begin with, or
+        // the one after the original, depending if we combined with the previous)
+        //
+        NextEntry = POOL_NEXT_BLOCK(Entry);
+
+        //
+        // As long as the next block isn't on a page boundary, have it point
+        // back to us
+        //
+        if (PAGE_ALIGN(NextEntry) != NextEntry) NextEntry->PreviousSize = BlockSize;
+    }
+
+    //
+    // Insert this new free block, and release the pool lock
+    //
+    ExpInsertPoolHeadList(&PoolDesc->ListHeads[BlockSize - 1], POOL_FREE_BLOCK(Entry));
+    ExpCheckPoolLinks(POOL_FREE_BLOCK(Entry));
+    ExUnlockPool(PoolDesc, OldIrql);
+}
+
+static
+PPOOL_HEADER
+ExpPopPoolMagazine(IN ULONG Class)
+{
+    PPOOL_PROCESSOR_BLOCK Block;
+    PPOOL_DESCRIPTOR PoolDesc;
+    PPOOL_MAGAZINE Magazine;
+    PPOOL_HEADER Entry = NULL;
+    KIRQL OldIrql;
+
+    //
+    // Magazines are only used by their own processor, at DISPATCH_LEVEL
+    //
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    Block = ExpPoolProcessorBlock[KeGetCurrentProcessorNumber()];
+    if (Block)
+    {
+        Magazine = &Block->Magazines[Class];
+        if (Magazine->Count)
+        {
+            Entry = Magazine->Blocks[--Magazine->Count];
+            Block->MagazineBytes -= Entry->BlockSize * POOL_BLOCK_SIZE;
+            Block->MagazineHits++;
+
+            //
+            // The block is allocated again, as far as its descriptor knows
+            //
+            PoolDesc = ExpPoolProcessorBlock[Entry->PoolIndex]->NonPagedPoolDescriptor;
+            InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, Entry->BlockSize * POOL_BLOCK_SIZE);
+            InterlockedIncrement((PLONG)&PoolDesc->RunningAllocs);
+        }
+        else
+        {
+            Block->MagazineMisses++;
+        }
+    }
+    KeLowerIrql(OldIrql);
+
+    return Entry;
+}
+
+static
+BOOLEAN
+ExpPushPoolMagazine(IN ULONG Class,
+                    IN PPOOL_HEADER Entry)
+{
+    PPOOL_PROCESSOR_BLOCK Block;
+    PPOOL_DESCRIPTOR PoolDesc;
+    PPOOL_MAGAZINE Magazine;
+    BOOLEAN Pushed = FALSE;
+    KIRQL OldIrql;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    Block = ExpPoolProcessorBlock[KeGetCurrentProcessorNumber()];
+    if (Block)
+    {
+        Magazine = &Block->Magazines[Class];
+        if (Magazine->Count < Magazine->Depth)
+        {
+            Magazine->Blocks[Magazine->Count++] = Entry;
+            Block->MagazineBytes += Entry->BlockSize * POOL_BLOCK_SIZE;
+            Pushed = TRUE;
+
+            //
+            // A cached block is free, as far as its descriptor knows, even
+            // though it isn't given back to its pages until a trim
+            //
+            PoolDesc = ExpPoolProcessorBlock[Entry->PoolIndex]->NonPagedPoolDescriptor;
+            InterlockedIncrement((PLONG)&PoolDesc->RunningDeAllocs);
+            InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, -Entry->BlockSize * POOL_BLOCK_SIZE);
+        }
+    }
+    KeLowerIrql(OldIrql);
+
+    return Pushed;
+}
+
+static
+SIZE_T
+ExpTrimPoolMagazine(VOID)
+{
+    PPOOL_PROCESSOR_BLOCK Block;
+    PPOOL_MAGAZINE Magazine;
+    PPOOL_HEADER Entry;
+    SIZE_T Released;
+    ULONG i;
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+
+    //
+    // Give every block cached by this processor back to the descriptor whose
+    // pages it came from, so that they can be coalesced and freed again
+    //
+    Block = ExpPoolProcessorBlock[KeGetCurrentProcessorNumber()];
+    if (!Block) return 0;
+    Released = Block->MagazineBytes;
+    for (i = 0; i < POOL_MAGAZINE_CLASSES; i++)
+    {
+        Magazine = &Block->Magazines[i];
+        while (Magazine->Count)
+        {
+            Entry = Magazine->Blocks[--Magazine->Count];
+            Block->MagazineBytes -= Entry->BlockSize * POOL_BLOCK_SIZE;
+
+            //
+            // Its free was already counted when it was pushed
+            //
+            ExpReleasePoolBlock(ExpPoolProcessorBlock[Entry->PoolIndex]->NonPagedPoolDescriptor,
+                                Entry);
+        }
+    }
+
+    ASSERT(Block->MagazineBytes == 0);
+    return Released;
+}
+
+VOID
+NTAPI
+ExpTrimPoolMagazineTarget(IN PKDPC Dpc,
+                          IN PVOID DeferredContext,
+                          IN PVOID SystemArgument1,
+                          IN PVOID SystemArgument2)
+{
+    PSIZE_T Released = DeferredContext;
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+
+    //
+    // Every processor empties its own magazines
+    //
+    InterlockedExchangeAddSizeT(Released, ExpTrimPoolMagazine());
+    KeSignalCallDpcDone(SystemArgument1);
+}
+
+static
+BOOLEAN
+ExpTrimPoolMagazines(VOID)
+{
+    SIZE_T Released = 0;
+    KIRQL OldIrql;
+
+    if (KeGetCurrentIrql() < DISPATCH_LEVEL)
+    {
+        //
+        // Do a "Generic DPC" to have all the processors empty their magazines
+        //
+        KeGenericCallDpc(ExpTrimPoolMagazineTarget, &Released);
+    }
+    else
+    {
+        //
+        // We can't wait for the other processors, so only this one's magazines
+        // can be trimmed
+        //
+        KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+        Released = ExpTrimPoolMagazine();
+        KeLowerIrql(OldIrql);
+    }
+
+    return (Released != 0);
+}
+
 VOID
 NTAPI
 ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
@@ -1722,6 +2212,7 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
 {
     ULONG i;
     PPOOL_DESCRIPTOR PoolDesc;
+    PPOOL_PROCESSOR_BLOCK Block;
 
     //
     // Assume all failures
@@ -1750,21 +2241,22 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
     *NonPagedPoolFrees = PoolDesc->RunningDeAllocs;
 
     //
-    // If the system has more than one non-paged pool, copy the other descriptor
-    // totals as well
+    // Copy the totals of the other processors' descriptors as well, and count
+    // their magazine hits as lookaside hits
     //
-#if 0
-    if (ExpNumberOfNonPagedPools > 1)
+    for (i = 0; i < MAXIMUM_PROCESSORS; i++)
     {
-        for (i = 0; i < ExpNumberOfNonPagedPools; i++)
-        {
-            PoolDesc = ExpNonPagedPoolDescriptor[i];
-            *NonPagedPoolPages += PoolDesc->TotalPages + PoolDesc->TotalBigPages;
-            *NonPagedPoolAllocs += PoolDesc->RunningAllocs;
-            *NonPagedPoolFrees += PoolDesc->RunningDeAllocs;
-        }
+        Block = ExpPoolProcessorBlock[i];
+        if (!Block) continue;
+
+        *NonPagedPoolLookasideHits += Block->MagazineHits;
+
+        PoolDesc = Block->NonPagedPoolDescriptor;
+        if (PoolDesc == &NonPagedPoolDescriptor) continue;
+        *NonPagedPoolPages += PoolDesc->TotalPages + PoolDesc->TotalBigPages;
+        *NonPagedPoolAllocs += PoolDesc->RunningAllocs;
+        *NonPagedPoolFrees += PoolDesc->RunningDeAllocs;
     }
-#endif
 
     //
     // Get the amount of hits in the system lookaside lists
@@ -1793,6 +2285,39 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
     }
 }
 
+VOID
+NTAPI
+ExQueryPoolContention(OUT PULONG NonPagedPoolLockAcquires,
+                      OUT PULONG NonPagedPoolLockContentions,
+                      OUT PULONG NonPagedPoolMagazineHits,
+                      OUT PULONG NonPagedPoolMagazineMisses,
+                      OUT PSIZE_T NonPagedPoolMagazineBytes)
+{
+    ULONG i;
+    PPOOL_PROCESSOR_BLOCK Block;
+
+    *NonPagedPoolLockAcquires = 0;
+    *NonPagedPoolLockContentions = 0;
+    *NonPagedPoolMagazineHits = 0;
+    *NonPagedPoolMagazineMisses = 0;
+    *NonPagedPoolMagazineBytes = 0;
+
+    //
+    // Tally up the counters of all the processors
+    //
+    for (i = 0; i < MAXIMUM_PROCESSORS; i++)
+    {
+        Block = ExpPoolProcessorBlock[i];
+        if (!Block) continue;
+
+        *NonPagedPoolLockAcquires += Block->LockAcquires;
+        *NonPagedPoolLockContentions += Block->LockContentions;
+        *NonPagedPoolMagazineHits += Block->MagazineHits;
+        *NonPagedPoolMagazineMisses += Block->MagazineMisses;
+        *NonPagedPoolMagazineBytes += Block->MagazineBytes;
+    }
+}
+
 VOID
 NTAPI
 ExReturnPoolQuota(IN PVOID P)
@@ -1856,9 +2381,10 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     PPOOL_HEADER Entry, NextEntry, FragmentEntry;
     KIRQL OldIrql;
     USHORT BlockSize, i;
-    ULONG OriginalType;
+    ULONG OriginalType, Class;
     PKPRCB Prcb = KeGetCurrentPrcb();
     PGENERAL_LOOKASIDE LookasideList;
+    BOOLEAN Trimmed = FALSE;
 
     //
     // Some sanity checks
@@ -1923,6 +2449,13 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
         // Allocate pages for it
         //
         Entry = MiAllocatePoolPages(OriginalType, NumberOfBytes);
+        if (!Entry && (PoolType == NonPagedPool) && ExpTrimPoolMagazines())
+        {
+            //
+            // Some pages may have been freed by emptying the magazines
+            //
+            Entry = MiAllocatePoolPages(OriginalType, NumberOfBytes);
+        }
         if (!Entry)
         {
 #if DBG
@@ -2077,10 +2610,50 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
         }
     }
 
+    //
+    // Nonpaged pool has a descriptor per processor, so that processors don't
+    // fight over a single lock
+    //
+    if (PoolType == NonPagedPool)
+    {
+        PoolDesc = ExpGetNonPagedPoolDescriptor();
+
+        //
+        // Round bigger blocks up to their magazine size class, and try popping
+        // one from this processor's magazine
+        //
+        Class = POOL_MAGAZINE_CLASS(i);
+        if ((i > NUMBER_POOL_LOOKASIDE_LISTS) && (Class < POOL_MAGAZINE_CLASSES))
+        {
+            i = POOL_MAGAZINE_BLOCK_SIZE(Class);
+            Entry = ExpPopPoolMagazine(Class);
+            if (Entry)
+            {
+                //
+                // Write down its pool type, and track it
+                //
+                ASSERT(Entry->BlockSize == i);
+                Entry->PoolType = OriginalType + 1;
+                ExpInsertPoolTracker(Tag,
+                                     Entry->BlockSize * POOL_BLOCK_SIZE,
+                                     OriginalType);
+
+                //
+                // Return the pool allocation
+                //
+                Entry->PoolTag = Tag;
+                (POOL_FREE_BLOCK(Entry))->Flink = NULL;
+                (POOL_FREE_BLOCK(Entry))->Blink = NULL;
+                return POOL_FREE_BLOCK(Entry);
+            }
+        }
+    }
+
     //
     // Loop in the free lists looking for a block if this size. Start with the
     // list optimized for this kind of size lookup
     //
+Retry:
     ListHead = &PoolDesc->ListHeads[i];
     do
     {
@@ -2201,9 +2774,12 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
                 }
 
                 //
-                // Now our (allocation) entry is the right size
+                // Now our (allocation) entry is the right size, and both halves
+                // still belong to the descriptor that owns the page
                 //
                 Entry->BlockSize = i;
+                Entry->PoolIndex = PoolDesc->PoolIndex;
+                FragmentEntry->PoolIndex = PoolDesc->PoolIndex;
 
                 //
                 // And the next entry is now the free fragment which contains
@@ -2265,6 +2841,15 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     // There were no free entries left, so we have to allocate a new fresh page
     //
     Entry = MiAllocatePoolPages(OriginalType, PAGE_SIZE);
+    if (!Entry && (PoolType == NonPagedPool) && !Trimmed)
+    {
+        //
+        // Empty the magazines, which gives their blocks back to the free lists
+        // or frees whole pages, and look again
+        //
+        Trimmed = TRUE;
+        if (ExpTrimPoolMagazines()) goto Retry;
+    }
     if (!Entry)
     {
 #if DBG
@@ -2332,6 +2917,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     // Setup the entry data
     //
     Entry->Ulong1 = 0;
+    Entry->PoolIndex = PoolDesc->PoolIndex;
     Entry->BlockSize = i;
     Entry->PoolType = OriginalType + 1;
 
@@ -2344,6 +2930,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     BlockSize = (PAGE_SIZE / POOL_BLOCK_SIZE) - i;
     FragmentEntry = POOL_BLOCK(Entry, i);
     FragmentEntry->Ulong1 = 0;
+    FragmentEntry->PoolIndex = PoolDesc->PoolIndex;
     FragmentEntry->BlockSize = BlockSize;
     FragmentEntry->PreviousSize = i;
 
@@ -2440,17 +3027,16 @@ NTAPI
 ExFreePoolWithTag(IN PVOID P,
                   IN ULONG TagToFree)
 {
-    PPOOL_HEADER Entry, NextEntry;
+    PPOOL_HEADER Entry;
     USHORT BlockSize;
-    KIRQL OldIrql;
     POOL_TYPE PoolType;
     PPOOL_DESCRIPTOR PoolDesc;
     ULONG Tag;
-    BOOLEAN Combined = FALSE;
     PFN_NUMBER PageCount, RealPageCount;
     PKPRCB Prcb = KeGetCurrentPrcb();
     PGENERAL_LOOKASIDE LookasideList;
     PEPROCESS Process;
+    ULONG Class;
 
     //
     // Check if any of the debug flags are enabled
@@ -2615,7 +3201,9 @@ ExFreePoolWithTag(IN PVOID P,
     //
     BlockSize = Entry->BlockSize;
     PoolType = (Entry->PoolType - 1) & BASE_POOL_TYPE_MASK;
-    PoolDesc = PoolVector[PoolType];
+    PoolDesc = (PoolType == NonPagedPool) ?
+               ExpPoolProcessorBlock[Entry->PoolIndex]->NonPagedPoolDescriptor :
+               PoolVector[PoolType];
 
     //
     // Make sure that the IRQL makes sense
@@ -2702,158 +3290,31 @@ ExFreePoolWithTag(IN PVOID P,
             return;
         }
     }
-
-    //
-    // Get the pointer to the next entry
-    //
-    NextEntry = POOL_BLOCK(Entry, BlockSize);
-
-    //
-    // Update performance counters
-    //
-    InterlockedIncrement((PLONG)&PoolDesc->RunningDeAllocs);
-    InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, -BlockSize * POOL_BLOCK_SIZE);
-
-    //
-    // Acquire the pool lock
-    //
-    OldIrql = ExLockPool(PoolDesc);
-
-    //
-    // Check if the next allocation is at the end of the page
-    //
-    ExpCheckPoolBlocks(Entry);
-    if (PAGE_ALIGN(NextEntry) != NextEntry)
-    {
-        //
-        // We may be able to combine the block if it's free
-        //
-        if (NextEntry->PoolType == 0)
-        {
-            //
-            // The next block is free, so we'll do a combine
-            //
-            Combined = TRUE;
-
-            //
-            // Make sure there's actual data in the block -- anything smaller
-            // than this means we only have the header, so there's no linked list
-            // for us to remove
-            //
-            if ((NextEntry->BlockSize != 1))
-            {
-                //
-                // The block is at least big enough to have a linked list, so go
-                // ahead and remove it
-                //
-                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
-                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
-            }
-
-            //
-            // Our entry is now combined with the next entry
-            //
-            Entry->BlockSize = Entry->BlockSize + NextEntry->BlockSize;
-        }
-    }
-
-    //
-    // Now check if there was a previous entry on the same page as us
-    //
-    if (Entry->PreviousSize)
+    else if (PoolType == NonPagedPool)
     {
         //
-        // Great, grab that entry and check if it's free
+        // Try pushing bigger nonpaged blocks of a magazine size class into
+        // this processor's magazine
         //
-        NextEntry = POOL_PREV_BLOCK(Entry);
-        if (NextEntry->PoolType == 0)
+        Class = POOL_MAGAZINE_CLASS(BlockSize);
+        if ((Class < POOL_MAGAZINE_CLASSES) &&
+            (POOL_MAGAZINE_BLOCK_SIZE(Class) == BlockSize) &&
+            (ExpPushPoolMagazine(Class, Entry)))
         {
-            //
-            // It is, so we can do a combine
-            //
-            Combined = TRUE;
-
-            //
-            // Make sure there's actual data in the block -- anything smaller
-            // than this means we only have the header so there's no linked list
-            // for us to remove
-            //
-            if ((NextEntry->BlockSize != 1))
-            {
-                //
-                // The block is at least big enough to have a linked list, so go
-                // ahead and remove it
-                //
-                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
-                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
-            }
-
-            //
-            // Combine our original block (which might've already been combined
-            // with the next block), into the previous block
-            //
-            NextEntry->BlockSize = NextEntry->BlockSize + Entry->BlockSize;
-
-            //
-            // And now we'll work with the previous block instead
-            //
-            Entry = NextEntry;
+            return;
         }
     }
 
     //
-    // By now, it may have been possible for our combined blocks to actually
-    // have made up a full page (if there were only 2-3 allocations on the
-    // page, they could've all been combined).
-    //
-    if ((PAGE_ALIGN(Entry) == Entry) &&
-        (PAGE_ALIGN(POOL_NEXT_BLOCK(Entry)) == POOL_NEXT_BLOCK(Entry)))
-    {
-        //
-        // In this case, release the pool lock, update the performance counter,
-        // and free the page
-        //
-        ExUnlockPool(PoolDesc, OldIrql);
-        InterlockedExchangeAdd((PLONG)&PoolDesc->TotalPages, -1);
-        MiFreePoolPages(Entry);
-        return;
-    }
-
-    //
-    // Otherwise, we now have a free block (or a combination of 2 or 3)
-    //
-    Entry->PoolType = 0;
-    BlockSize = Entry->BlockSize;
-    ASSERT(BlockSize != 1);
-
-    //
-    // Check if we actually did combine it with anyone
+    // Update performance counters
     //
-    if (Combined)
-    {
-        //
-        // Get the first combined block (either our original to begin with, or
-        // the one after the original, depending if we combined with the previous)
-        //
-        NextEntry = POOL_NEXT_BLOCK(Entry);
-
-        //
-        // As long as the next block isn't on a page boundary, have it point
-        // back to us
-        //
-        if (PAGE_ALIGN(NextEntry) != NextEntry) NextEntry->PreviousSize = BlockSize;
-    }
+    InterlockedIncrement((PLONG)&PoolDesc->RunningDeAllocs);
+    InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, -BlockSize * POOL_BLOCK_SIZE);
 
     //
-    // Insert this new free block, and release the pool lock
+    // Give the block back to the pages of its descriptor
     //
-    ExpInsertPoolHeadList(&PoolDesc->ListHeads[BlockSize - 1], POOL_FREE_BLOCK(Entry));
-    ExpCheckPoolLinks(POOL_FREE_BLOCK(Entry));
-    ExUnlockPool(PoolDesc, OldIrql);
+    ExpReleasePoolBlock(PoolDesc, Entry);
 }
 
 /*
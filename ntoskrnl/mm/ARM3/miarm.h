@@ -1844,7 +1844,6 @@ InitializePool(           //
 );                        //
 
 // FIXFIX: THIS ONE TOO
-INIT_FUNCTION
 VOID
 NTAPI
 ExInitializePoolDescriptor(
@@ -1855,6 +1854,16 @@ ExInitializePoolDescriptor(
     IN PVOID PoolLock
 );
 
+VOID
+NTAPI
+ExQueryPoolContention(
+    OUT PULONG NonPagedPoolLockAcquires,
+    OUT PULONG NonPagedPoolLockContentions,
+    OUT PULONG NonPagedPoolMagazineHits,
+    OUT PULONG NonPagedPoolMagazineMisses,
+    OUT PSIZE_T NonPagedPoolMagazineBytes
+);
+
 NTSTATUS
 NTAPI
 MiInitializeSessionPool(
@@ -1019,6 +1019,7 @@ OFFSET(KTHREAD_WAIT_IRQL, KTHREAD, WaitIrql),
 OFFSET(KTHREAD_TrapFrame, KTHREAD, TrapFrame),
 OFFSET(KTHREAD_PreviousMode, KTHREAD, PreviousMode),
 OFFSET(KTHREAD_KernelStack, KTHREAD, KernelStack),
+OFFSET(KTHREAD_SwapBusy, KTHREAD, SwapBusy),
 OFFSET(KTHREAD_UserApcPending, KTHREAD, ApcState.UserApcPending),
 
 HEADER("KINTERRUPT"),
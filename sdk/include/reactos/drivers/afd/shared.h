@@ -261,6 +261,7 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_DEFER_ACCEPT		35
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
+#define AFD_SELECT_POLL_SET		43
 
 /* AFD IOCTLs */
 
@@ -336,6 +337,8 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_SELECT_POLL_SET \
+  _AFD_CONTROL_CODE(AFD_SELECT_POLL_SET, METHOD_BUFFERED )
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
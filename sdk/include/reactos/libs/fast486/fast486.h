@@ -106,6 +106,18 @@
 
 #define FAST486_PAGE_SIZE 4096
 #define FAST486_CACHE_SIZE 32
+#define FAST486_CODE_CACHE_BLOCKS 128
+
+/*
+ * The decoded code cache is opt-in: its per-instruction lookup currently costs
+ * more than the decoding it saves (see fast486bench). Define FAST486_CODE_CACHE
+ * to build it. It fills the prefetch buffer, so it can't exist without it.
+ */
+#if !defined(FAST486_CODE_CACHE) || defined(FAST486_NO_PREFETCH)
+#ifndef FAST486_NO_CODE_CACHE
+#define FAST486_NO_CODE_CACHE
+#endif
+#endif
 
 /*
  * These are condiciones sine quibus non that should be respected, because
@@ -116,6 +128,14 @@
 C_ASSERT((FAST486_CACHE_SIZE >= sizeof(ULONG))
          && (FAST486_CACHE_SIZE <= FAST486_PAGE_SIZE));
 
+/*
+ * The prefetch buffer is aligned on its size, so that it never crosses a page
+ * boundary, and each code cache block holds exactly one of them. Both are
+ * indexed with masks.
+ */
+C_ASSERT(((FAST486_CACHE_SIZE & (FAST486_CACHE_SIZE - 1)) == 0)
+         && ((FAST486_CODE_CACHE_BLOCKS & (FAST486_CODE_CACHE_BLOCKS - 1)) == 0));
+
 struct _FAST486_STATE;
 typedef struct _FAST486_STATE FAST486_STATE, *PFAST486_STATE;
 
@@ -511,6 +531,46 @@ typedef union _FAST486_FPU_CONTROL_REG
     };
 } FAST486_FPU_CONTROL_REG, *PFAST486_FPU_CONTROL_REG;
 
+/*
+ * Flags of a decoded instruction
+ */
+#define FAST486_DECODED_ADSIZE  (1 << 0)
+#define FAST486_DECODED_MEMORY  (1 << 1)
+#define FAST486_DECODED_SS      (1 << 2)
+
+/*
+ * An instruction as decoded the last time it was executed: its prefixes and
+ * opcode, and the form of its MOD REG R/M operand (if ModRmOffset isn't 0).
+ */
+typedef struct _FAST486_DECODED_INST
+{
+    LONG Displacement;
+    UCHAR PrefixFlags;
+    UCHAR SegmentOverride;
+    UCHAR Opcode;
+    UCHAR Length;
+    UCHAR ModRmOffset;
+    UCHAR ModRmLength;
+    UCHAR Register;
+    UCHAR Base;
+    UCHAR Index;
+    UCHAR Scale;
+    UCHAR Flags;
+} FAST486_DECODED_INST, *PFAST486_DECODED_INST;
+
+/*
+ * FAST486_CACHE_SIZE bytes of code at the physical address Address, and the
+ * instructions decoded from them. Only instructions which fit entirely in the
+ * block are cached, so writing to it is all it takes to invalidate them.
+ */
+typedef struct _FAST486_CODE_BLOCK
+{
+    ULONG Address;
+    ULONG Generation;
+    UCHAR Data[FAST486_CACHE_SIZE];
+    FAST486_DECODED_INST Instructions[FAST486_CACHE_SIZE];
+} FAST486_CODE_BLOCK, *PFAST486_CODE_BLOCK;
+
 struct _FAST486_STATE
 {
     FAST486_MEM_READ_PROC MemReadCallback;
@@ -543,6 +603,16 @@ struct _FAST486_STATE
     BOOLEAN PrefetchValid;
     ULONG PrefetchAddress;
     UCHAR PrefetchCache[FAST486_CACHE_SIZE];
+    ULONG PrefetchPhysical;
+    BOOLEAN PrefetchPageValid;
+    ULONG PrefetchPage;
+    ULONG PrefetchPageEntry;
+#endif
+#ifndef FAST486_NO_CODE_CACHE
+    PFAST486_CODE_BLOCK PrefetchBlock;
+    ULONG CodeCacheGeneration;
+    PFAST486_DECODED_INST DecodedInst;
+    FAST486_CODE_BLOCK CodeCache[FAST486_CODE_CACHE_BLOCKS];
 #endif
 #ifndef FAST486_NO_FPU
     FAST486_FPU_DATA_REG FpuRegisters[FAST486_NUM_FPU_REGS];
@@ -619,6 +689,21 @@ VOID
 NTAPI
 Fast486Rewind(PFAST486_STATE State);
 
+/*
+ * The prefetch buffer and the code cache see all the writes done by the CPU,
+ * whatever mapping they go through. Hosts which modify guest memory without
+ * going through it (other than from a BOP handler) must call one of these
+ * before resuming the execution. Addresses are physical, as passed to the
+ * memory callbacks.
+ */
+VOID
+NTAPI
+Fast486FlushCodeCache(PFAST486_STATE State);
+
+VOID
+NTAPI
+Fast486InvalidateCodeRange(PFAST486_STATE State, ULONG Address, ULONG Size);
+
 #endif // _FAST486_H_
 
 /* EOF */
@@ -21,6 +21,7 @@ HvpAddBin(
     ULONG BitmapSize;
     ULONG BlockCount;
     ULONG OldBlockListSize;
+    ULONG NewBlockListSize;
     PHCELL Block;
 
     BinSize = ROUND_UP(Size + sizeof(HBIN), HBLOCK_SIZE);
@@ -36,26 +37,36 @@ HvpAddBin(
                       HBLOCK_SIZE;
     Bin->Size = BinSize;
 
-    /* Allocate new block list */
+    /*
+     * Grow the block list, by half its size at least, so that adding
+     * bins to a large hive doesn't copy the whole list every time.
+     */
     OldBlockListSize = RegistryHive->Storage[Storage].Length;
-    BlockList = RegistryHive->Allocate(sizeof(HMAP_ENTRY) *
-                                       (OldBlockListSize + BlockCount),
-                                       TRUE,
-                                       TAG_CM);
-    if (BlockList == NULL)
+    if (OldBlockListSize + BlockCount > RegistryHive->Storage[Storage].BlockListSize)
     {
-        RegistryHive->Free(Bin, 0);
-        return NULL;
-    }
+        NewBlockListSize = OldBlockListSize + OldBlockListSize / 2;
+        if (NewBlockListSize < OldBlockListSize + BlockCount)
+            NewBlockListSize = OldBlockListSize + BlockCount;
+        BlockList = RegistryHive->Allocate(sizeof(HMAP_ENTRY) * NewBlockListSize,
+                                           TRUE,
+                                           TAG_CM);
+        if (BlockList == NULL)
+        {
+            RegistryHive->Free(Bin, 0);
+            return NULL;
+        }
 
-    if (OldBlockListSize > 0)
-    {
-        RtlCopyMemory(BlockList, RegistryHive->Storage[Storage].BlockList,
-                      OldBlockListSize * sizeof(HMAP_ENTRY));
-        RegistryHive->Free(RegistryHive->Storage[Storage].BlockList, 0);
+        if (OldBlockListSize > 0)
+        {
+            RtlCopyMemory(BlockList, RegistryHive->Storage[Storage].BlockList,
+                          OldBlockListSize * sizeof(HMAP_ENTRY));
+            RegistryHive->Free(RegistryHive->Storage[Storage].BlockList, 0);
+        }
+
+        RegistryHive->Storage[Storage].BlockList = BlockList;
+        RegistryHive->Storage[Storage].BlockListSize = NewBlockListSize;
     }
 
-    RegistryHive->Storage[Storage].BlockList = BlockList;
     RegistryHive->Storage[Storage].Length += BlockCount;
 
     for (i = 0; i < BlockCount; i++)
@@ -143,31 +143,63 @@ HvIsCellDirty(IN PHHIVE Hive,
     return IsDirty;
 }
 
+/*
+ * Free cells of at least HV_MIN_FREE_CELL bytes are kept in doubly linked
+ * lists, with the links stored in the cells themselves. Each list holds a
+ * single 16-byte size class up to HV_FREE_EXACT_MAX, and a power of two
+ * range above. FreeSummary has a bit set for every non-empty list, which
+ * finds the best fitting list without walking the empty ones. Smaller free
+ * cells, only found in hives written by Windows, are never allocated from
+ * and are left out of the lists.
+ */
+
+#define HvpFreeCellNext(Cell)   (((PHCELL_INDEX)((PHCELL)(Cell) + 1))[0])
+#define HvpFreeCellPrev(Cell)   (((PHCELL_INDEX)((PHCELL)(Cell) + 1))[1])
+
 static __inline ULONG CMAPI
 HvpComputeFreeListIndex(
     ULONG Size)
 {
     ULONG Index;
-    static CCHAR FindFirstSet[128] = {
-        0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6};
 
     ASSERT(Size >= (1 << 3));
-    Index = (Size >> 3) - 1;
-    if (Index >= 16)
+
+    /* Too small to carry the list links */
+    if (Size < HV_MIN_FREE_CELL)
+        return HV_FREE_DISPLAY_SIZE;
+
+    if (Size < HV_FREE_EXACT_MAX)
+        return (Size / 16) - 1;
+
+    /* One list per power of two from there */
+    Index = HV_FREE_EXACT_LISTS;
+    for (Size /= HV_FREE_EXACT_MAX; Size > 1; Size >>= 1)
+        Index++;
+
+    ASSERT(Index < HV_FREE_DISPLAY_SIZE);
+    return Index;
+}
+
+static __inline ULONG CMAPI
+HvpFindNextFreeList(
+    PDUAL Dual,
+    ULONG Index)
+{
+    ULONG Word, Bits;
+
+    Word = Index / 32;
+    Bits = Dual->FreeSummary[Word] & ~((1UL << (Index % 32)) - 1);
+    while (Bits == 0)
     {
-        if (Index > 127)
-            Index = 23;
-        else
-            Index = FindFirstSet[Index] + 16;
+        if (++Word == HV_FREE_SUMMARY_SIZE)
+            return HV_FREE_DISPLAY_SIZE;
+        Bits = Dual->FreeSummary[Word];
     }
 
+    /* Lowest set bit */
+    for (Index = Word * 32; !(Bits & 1); Bits >>= 1)
+        Index++;
+
     return Index;
 }
 
@@ -177,19 +209,24 @@ HvpAddFree(
     PHCELL FreeBlock,
     HCELL_INDEX FreeIndex)
 {
-    PHCELL_INDEX FreeBlockData;
-    HSTORAGE_TYPE Storage;
+    PDUAL Dual;
     ULONG Index;
 
     ASSERT(RegistryHive != NULL);
     ASSERT(FreeBlock != NULL);
 
-    Storage = HvGetCellType(FreeIndex);
     Index = HvpComputeFreeListIndex((ULONG)FreeBlock->Size);
+    if (Index == HV_FREE_DISPLAY_SIZE)
+        return STATUS_SUCCESS;
+
+    Dual = &RegistryHive->Storage[HvGetCellType(FreeIndex)];
 
-    FreeBlockData = (PHCELL_INDEX)(FreeBlock + 1);
-    *FreeBlockData = RegistryHive->Storage[Storage].FreeDisplay[Index];
-    RegistryHive->Storage[Storage].FreeDisplay[Index] = FreeIndex;
+    HvpFreeCellNext(FreeBlock) = Dual->FreeDisplay[Index];
+    HvpFreeCellPrev(FreeBlock) = HCELL_NIL;
+    if (Dual->FreeDisplay[Index] != HCELL_NIL)
+        HvpFreeCellPrev(HvpGetCellHeader(RegistryHive, Dual->FreeDisplay[Index])) = FreeIndex;
+    Dual->FreeDisplay[Index] = FreeIndex;
+    Dual->FreeSummary[Index / 32] |= 1UL << (Index % 32);
 
     /* FIXME: Eventually get rid of free bins. */
 
@@ -202,47 +239,35 @@ HvpRemoveFree(
     PHCELL CellBlock,
     HCELL_INDEX CellIndex)
 {
-    PHCELL_INDEX FreeCellData;
-    PHCELL_INDEX pFreeCellOffset;
-    HSTORAGE_TYPE Storage;
-    ULONG Index, FreeListIndex;
+    HCELL_INDEX Next, Prev;
+    PDUAL Dual;
+    ULONG Index;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
 
-    Storage = HvGetCellType(CellIndex);
     Index = HvpComputeFreeListIndex((ULONG)CellBlock->Size);
+    if (Index == HV_FREE_DISPLAY_SIZE)
+        return;
 
-    pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
-    while (*pFreeCellOffset != HCELL_NIL)
+    Dual = &RegistryHive->Storage[HvGetCellType(CellIndex)];
+    Next = HvpFreeCellNext(CellBlock);
+    Prev = HvpFreeCellPrev(CellBlock);
+
+    if (Prev != HCELL_NIL)
     {
-        FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-        if (*pFreeCellOffset == CellIndex)
-        {
-            *pFreeCellOffset = *FreeCellData;
-            return;
-        }
-        pFreeCellOffset = FreeCellData;
+        HvpFreeCellNext(HvpGetCellHeader(RegistryHive, Prev)) = Next;
     }
-
-    /* Something bad happened, print a useful trace info and bugcheck */
-    CMLTRACE(CMLIB_HCELL_DEBUG, "-- beginning of HvpRemoveFree trace --\n");
-    CMLTRACE(CMLIB_HCELL_DEBUG, "block we are about to free: %08x\n", CellIndex);
-    CMLTRACE(CMLIB_HCELL_DEBUG, "chosen free list index: %u\n", Index);
-    for (FreeListIndex = 0; FreeListIndex < 24; FreeListIndex++)
+    else
     {
-        CMLTRACE(CMLIB_HCELL_DEBUG, "free list [%u]: ", FreeListIndex);
-        pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[FreeListIndex];
-        while (*pFreeCellOffset != HCELL_NIL)
-        {
-            CMLTRACE(CMLIB_HCELL_DEBUG, "%08x ", *pFreeCellOffset);
-            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-            pFreeCellOffset = FreeCellData;
-        }
-        CMLTRACE(CMLIB_HCELL_DEBUG, "\n");
+        /* It must be the head of its list, otherwise the lists are corrupted */
+        ASSERT(Dual->FreeDisplay[Index] == CellIndex);
+        Dual->FreeDisplay[Index] = Next;
+        if (Next == HCELL_NIL)
+            Dual->FreeSummary[Index / 32] &= ~(1UL << (Index % 32));
     }
-    CMLTRACE(CMLIB_HCELL_DEBUG, "-- end of HvpRemoveFree trace --\n");
 
-    ASSERT(FALSE);
+    if (Next != HCELL_NIL)
+        HvpFreeCellPrev(HvpGetCellHeader(RegistryHive, Next)) = Prev;
 }
 
 static HCELL_INDEX CMAPI
@@ -251,28 +276,45 @@ HvpFindFree(
     ULONG Size,
     HSTORAGE_TYPE Storage)
 {
-    PHCELL_INDEX FreeCellData;
+    PDUAL Dual = &RegistryHive->Storage[Storage];
     HCELL_INDEX FreeCellOffset;
-    PHCELL_INDEX pFreeCellOffset;
+    PHCELL FreeCell;
     ULONG Index;
 
-    for (Index = HvpComputeFreeListIndex(Size); Index < 24; Index++)
+    Index = HvpComputeFreeListIndex(Size);
+
+    /*
+     * Sizes are multiples of 16, so any cell of an exact list at or above
+     * ours fits, and the first non-empty one is the best fit. The cells of
+     * a power of two list may be smaller than requested, so our own list
+     * is searched, then any cell of a higher one fits.
+     */
+    if (Index >= HV_FREE_EXACT_LISTS)
     {
-        pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
-        while (*pFreeCellOffset != HCELL_NIL)
+        for (FreeCellOffset = Dual->FreeDisplay[Index];
+             FreeCellOffset != HCELL_NIL;
+             FreeCellOffset = HvpFreeCellNext(FreeCell))
         {
-            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-            if ((ULONG)HvpGetCellFullSize(RegistryHive, FreeCellData) >= Size)
+            FreeCell = HvpGetCellHeader(RegistryHive, FreeCellOffset);
+            if ((ULONG)FreeCell->Size >= Size)
             {
-                FreeCellOffset = *pFreeCellOffset;
-                *pFreeCellOffset = *FreeCellData;
+                HvpRemoveFree(RegistryHive, FreeCell, FreeCellOffset);
                 return FreeCellOffset;
             }
-            pFreeCellOffset = FreeCellData;
         }
+
+        Index++;
     }
 
-    return HCELL_NIL;
+    Index = HvpFindNextFreeList(Dual, Index);
+    if (Index == HV_FREE_DISPLAY_SIZE)
+        return HCELL_NIL;
+
+    FreeCellOffset = Dual->FreeDisplay[Index];
+    FreeCell = HvpGetCellHeader(RegistryHive, FreeCellOffset);
+    ASSERT((ULONG)FreeCell->Size >= Size);
+    HvpRemoveFree(RegistryHive, FreeCell, FreeCellOffset);
+    return FreeCellOffset;
 }
 
 NTSTATUS CMAPI
@@ -288,11 +330,13 @@ HvpCreateHiveFreeCellList(
     ULONG Index;
 
     /* Initialize the free cell list */
-    for (Index = 0; Index < 24; Index++)
+    for (Index = 0; Index < HV_FREE_DISPLAY_SIZE; Index++)
     {
         Hive->Storage[Stable].FreeDisplay[Index] = HCELL_NIL;
         Hive->Storage[Volatile].FreeDisplay[Index] = HCELL_NIL;
     }
+    RtlZeroMemory(Hive->Storage[Stable].FreeSummary, sizeof(Hive->Storage[Stable].FreeSummary));
+    RtlZeroMemory(Hive->Storage[Volatile].FreeSummary, sizeof(Hive->Storage[Volatile].FreeSummary));
 
     BlockOffset = 0;
     BlockIndex = 0;
@@ -44,6 +44,16 @@
 
 #define HV_LOG_HEADER_SIZE              FIELD_OFFSET(HBASE_BLOCK, Reserved2)
 
+//
+// Free cell lists: one per 16 bytes of cell size up to 2 KB,
+// then one per power of two
+//
+#define HV_FREE_EXACT_LISTS             128
+#define HV_FREE_EXACT_MAX               (16 * (HV_FREE_EXACT_LISTS + 1))
+#define HV_FREE_DISPLAY_SIZE            (HV_FREE_EXACT_LISTS + 20)
+#define HV_FREE_SUMMARY_SIZE            ((HV_FREE_DISPLAY_SIZE + 31) / 32)
+#define HV_MIN_FREE_CELL                16
+
 //
 // Hive structure identifiers
 //
@@ -276,9 +286,10 @@ typedef struct _DUAL
     ULONG Length;
     PHMAP_DIRECTORY Map;
     PHMAP_ENTRY BlockList; // PHMAP_TABLE SmallDir;
+    ULONG BlockListSize;
     ULONG Guard;
-    HCELL_INDEX FreeDisplay[24]; // FREE_DISPLAY FreeDisplay[24];
-    ULONG FreeSummary;
+    HCELL_INDEX FreeDisplay[HV_FREE_DISPLAY_SIZE]; // FREE_DISPLAY FreeDisplay[24];
+    ULONG FreeSummary[HV_FREE_SUMMARY_SIZE];
     LIST_ENTRY FreeBins;
 } DUAL, *PDUAL;
 
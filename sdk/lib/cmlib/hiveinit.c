@@ -197,11 +197,15 @@ HvpCreateHive(
     RegistryHive->BaseBlock = BaseBlock;
     RegistryHive->Version = BaseBlock->Minor; // == HSYS_MINOR
 
-    for (Index = 0; Index < 24; Index++)
+    for (Index = 0; Index < HV_FREE_DISPLAY_SIZE; Index++)
     {
         RegistryHive->Storage[Stable].FreeDisplay[Index] = HCELL_NIL;
         RegistryHive->Storage[Volatile].FreeDisplay[Index] = HCELL_NIL;
     }
+    RtlZeroMemory(RegistryHive->Storage[Stable].FreeSummary,
+                  sizeof(RegistryHive->Storage[Stable].FreeSummary));
+    RtlZeroMemory(RegistryHive->Storage[Volatile].FreeSummary,
+                  sizeof(RegistryHive->Storage[Volatile].FreeSummary));
 
     HvpInitFileName(BaseBlock, FileName);
 
@@ -267,6 +271,8 @@ HvpInitializeMemoryHive(
         return STATUS_NO_MEMORY;
     }
 
+    Hive->Storage[Stable].BlockListSize = Hive->Storage[Stable].Length;
+
     for (BlockIndex = 0; BlockIndex < Hive->Storage[Stable].Length; )
     {
         Bin = (PHBIN)((ULONG_PTR)ChunkBase + (BlockIndex + 1) * HBLOCK_SIZE);
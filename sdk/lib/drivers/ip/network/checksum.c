@@ -24,6 +24,72 @@ ULONG ChecksumFold(
   return Sum;
 }
 
+/*
+ * The sums below add up 32-bit words into a 64-bit accumulator. In one's
+ * complement arithmetic that gives the same result as adding up 16-bit words,
+ * once folded. On amd64 16 bytes are added at a time with the SSE2 registers,
+ * which kernel mode code may use there.
+ */
+#if defined(_M_AMD64) && defined(__GNUC__)
+#define CHECKSUM_SIMD
+
+typedef ULONGLONG CHECKSUM_V2ULL __attribute__((__vector_size__(16), __may_alias__, __aligned__(1)));
+
+#define CHECKSUM_V2ULL_LOW  ((CHECKSUM_V2ULL){0xFFFFFFFF, 0xFFFFFFFF})
+#endif
+
+static __inline ULONG ChecksumFold64(
+  ULONGLONG Sum)
+{
+  /* Fold 64-bit sum to 32 bits */
+  Sum = (Sum & 0xFFFFFFFF) + (Sum >> 32);
+  Sum = (Sum & 0xFFFFFFFF) + (Sum >> 32);
+
+  return (ULONG)Sum;
+}
+
+static __inline ULONGLONG ChecksumTail(
+  PUCHAR Data,
+  UINT Count,
+  ULONGLONG Sum)
+/*
+ * FUNCTION: Adds up the last bytes of a buffer
+ * ARGUMENTS:
+ *     Data  = Pointer to the remaining data
+ *     Count = Number of remaining bytes, less than 16
+ *     Sum   = Sum so far
+ * RETURNS:
+ *     New sum
+ */
+{
+  ULONGLONG Word;
+
+  if (Count & 8)
+    {
+      Word = *(ULONGLONG UNALIGNED *)Data;
+      Sum += (Word & 0xFFFFFFFF) + (Word >> 32);
+      Data += 8;
+    }
+  if (Count & 4)
+    {
+      Sum += *(ULONG UNALIGNED *)Data;
+      Data += 4;
+    }
+  if (Count & 2)
+    {
+      Sum += *(USHORT UNALIGNED *)Data;
+      Data += 2;
+    }
+
+  /* Add left-over byte, if any */
+  if (Count & 1)
+    {
+      Sum += *Data;
+    }
+
+  return Sum;
+}
+
 ULONG ChecksumCompute(
   PVOID Data,
   UINT Count,
@@ -38,22 +104,140 @@ ULONG ChecksumCompute(
  *     Checksum of buffer
  */
 {
-  register ULONG Sum = Seed;
+  PUCHAR Buffer = Data;
+  ULONGLONG Sum = Seed;
+#ifdef CHECKSUM_SIMD
+  CHECKSUM_V2ULL Word0, Word1, Sum0 = {0, 0}, Sum1 = {0, 0};
 
-  while (Count > 1)
+  while (Count >= 32)
     {
-      Sum += *(PUSHORT)Data;
-      Count -= 2;
-      Data = (PVOID)((ULONG_PTR) Data + 2);
+      Word0 = *(CHECKSUM_V2ULL *)Buffer;
+      Word1 = *(CHECKSUM_V2ULL *)(Buffer + 16);
+      Sum0 += (Word0 & CHECKSUM_V2ULL_LOW) + (Word0 >> 32);
+      Sum1 += (Word1 & CHECKSUM_V2ULL_LOW) + (Word1 >> 32);
+      Buffer += 32;
+      Count -= 32;
     }
 
-  /* Add left-over byte, if any */
-  if (Count > 0)
+  if (Count >= 16)
     {
-      Sum += *(PUCHAR)Data;
+      Word0 = *(CHECKSUM_V2ULL *)Buffer;
+      Sum0 += (Word0 & CHECKSUM_V2ULL_LOW) + (Word0 >> 32);
+      Buffer += 16;
+      Count -= 16;
     }
 
-  return Sum;
+  /* The lanes hold less than 2^36 each for any 32-bit count */
+  Sum0 += Sum1;
+  Sum += Sum0[0] + Sum0[1];
+#else
+  ULONGLONG Word;
+
+  while (Count >= 16)
+    {
+      Word = *(ULONGLONG UNALIGNED *)Buffer;
+      Sum += (Word & 0xFFFFFFFF) + (Word >> 32);
+      Word = *(ULONGLONG UNALIGNED *)(Buffer + 8);
+      Sum += (Word & 0xFFFFFFFF) + (Word >> 32);
+      Buffer += 16;
+      Count -= 16;
+    }
+#endif
+
+  return ChecksumFold64(ChecksumTail(Buffer, Count, Sum));
+}
+
+ULONG ChecksumCopy(
+  PVOID Destination,
+  PVOID Source,
+  UINT Count,
+  ULONG Seed)
+/*
+ * FUNCTION: Copy a buffer and calculate its checksum at the same time
+ * ARGUMENTS:
+ *     Destination = Pointer to buffer to copy to
+ *     Source      = Pointer to buffer with data
+ *     Count       = Number of bytes in buffer
+ *     Seed        = Previously calculated checksum (if any)
+ * RETURNS:
+ *     Checksum of buffer
+ * NOTES:
+ *     The buffers must not overlap
+ */
+{
+  PUCHAR From = Source, To = Destination;
+  ULONGLONG Sum = Seed;
+#ifdef CHECKSUM_SIMD
+  CHECKSUM_V2ULL Word0, Word1, Sum0 = {0, 0}, Sum1 = {0, 0};
+
+  while (Count >= 32)
+    {
+      Word0 = *(CHECKSUM_V2ULL *)From;
+      Word1 = *(CHECKSUM_V2ULL *)(From + 16);
+      *(CHECKSUM_V2ULL *)To = Word0;
+      *(CHECKSUM_V2ULL *)(To + 16) = Word1;
+      Sum0 += (Word0 & CHECKSUM_V2ULL_LOW) + (Word0 >> 32);
+      Sum1 += (Word1 & CHECKSUM_V2ULL_LOW) + (Word1 >> 32);
+      From += 32;
+      To += 32;
+      Count -= 32;
+    }
+
+  if (Count >= 16)
+    {
+      Word0 = *(CHECKSUM_V2ULL *)From;
+      *(CHECKSUM_V2ULL *)To = Word0;
+      Sum0 += (Word0 & CHECKSUM_V2ULL_LOW) + (Word0 >> 32);
+      From += 16;
+      To += 16;
+      Count -= 16;
+    }
+
+  Sum0 += Sum1;
+  Sum += Sum0[0] + Sum0[1];
+#else
+  ULONGLONG Word;
+
+  while (Count >= 16)
+    {
+      Word = *(ULONGLONG UNALIGNED *)From;
+      *(ULONGLONG UNALIGNED *)To = Word;
+      Sum += (Word & 0xFFFFFFFF) + (Word >> 32);
+      Word = *(ULONGLONG UNALIGNED *)(From + 8);
+      *(ULONGLONG UNALIGNED *)(To + 8) = Word;
+      Sum += (Word & 0xFFFFFFFF) + (Word >> 32);
+      From += 16;
+      To += 16;
+      Count -= 16;
+    }
+#endif
+
+  /* The rest is small, copy it and add it up separately */
+  RtlCopyMemory(To, From, Count);
+
+  return ChecksumFold64(ChecksumTail(From, Count, Sum));
+}
+
+ULONG ChecksumPseudoHeaderIPv4(
+  PIPv4_HEADER IPHeader,
+  UCHAR Protocol,
+  USHORT Length)
+/*
+ * FUNCTION: Calculate checksum of the pseudo header of a TCP or UDP packet
+ * ARGUMENTS:
+ *     IPHeader = Pointer to IPv4 header with the addresses
+ *     Protocol = Transport protocol
+ *     Length   = Length of transport header and data in host byte order
+ * RETURNS:
+ *     Checksum of pseudo header, to be used as seed
+ */
+{
+  ULONGLONG Sum;
+
+  Sum = (ULONGLONG)IPHeader->SrcAddr + IPHeader->DstAddr;
+  Sum += WH2N((USHORT)Protocol) + WH2N(Length);
+
+  return ChecksumFold64(Sum);
 }
 
 ULONG
@@ -62,44 +246,12 @@ UDPv4ChecksumCalculate(
   PUCHAR PacketBuffer,
   ULONG DataLength)
 {
-  ULONG Sum = 0;
-  USHORT TmpSum;
-  ULONG i;
-  BOOLEAN Pad;
-
-  /* Pad the data if needed */
-  Pad = (DataLength & 1);
-  if (Pad)
-      DataLength++;
-
-  /* Add from the UDP header and data */
-  for (i = 0; i < DataLength; i += 2)
-  {
-       TmpSum = ((PacketBuffer[i] << 8) & 0xFF00) +
-                ((Pad && i == DataLength - 2) ? 0 : (PacketBuffer[i+1] & 0x00FF));
-       Sum += TmpSum;
-  }
-
-  /* Add the source address */
-  for (i = 0; i < sizeof(IPv4_RAW_ADDRESS); i += 2)
-  {
-       TmpSum = ((((PUCHAR)&IPHeader->SrcAddr)[i] << 8) & 0xFF00) +
-                (((PUCHAR)&IPHeader->SrcAddr)[i+1] & 0x00FF);
-       Sum += TmpSum;
-  }
-
-  /* Add the destination address */
-  for (i = 0; i < sizeof(IPv4_RAW_ADDRESS); i += 2)
-  {
-       TmpSum = ((((PUCHAR)&IPHeader->DstAddr)[i] << 8) & 0xFF00) +
-                (((PUCHAR)&IPHeader->DstAddr)[i+1] & 0x00FF);
-       Sum += TmpSum;
-  }
-
-  /* Add the proto number and length */
-  Sum += IPPROTO_UDP + (DataLength - (Pad ? 1 : 0));
-
-  /* Fold the checksum and return the one's complement */
-  return ~ChecksumFold(Sum);
-}
+  ULONG Sum;
 
+  /* Add the pseudo header and the UDP header and data */
+  Sum = ChecksumPseudoHeaderIPv4(IPHeader, IPPROTO_UDP, (USHORT)DataLength);
+  Sum = ChecksumCompute(PacketBuffer, DataLength, Sum);
+
+  /* Fold the checksum and return the one's complement in host byte order */
+  return ~(ULONG)WN2H((USHORT)ChecksumFold(Sum));
+}
@@ -154,6 +154,8 @@ VOID NBTimeout(VOID)
                     
                     NBFlushPacketQueue(NCE, Status);
 
+                    /* Drop the cached routes to it before it goes away */
+                    RouteInvalidateCaches();
                     ExFreePoolWithTag(NCE, NCE_TAG);
 
                     continue;
@@ -205,6 +207,7 @@ VOID NBShutdown(VOID)
           /* Flush wait queue */
 	  NBFlushPacketQueue( CurNCE, NDIS_STATUS_NOT_ACCEPTED );
 
+          RouteInvalidateCaches();
           ExFreePoolWithTag(CurNCE, NCE_TAG);
 
 	  CurNCE = NextNCE;
@@ -255,6 +258,7 @@ VOID NBDestroyNeighborsForInterface(PIP_INTERFACE Interface)
                 *PrevNCE = NCE->Next;
 
                 NBFlushPacketQueue(NCE, NDIS_STATUS_REQUEST_ABORTED);
+                RouteInvalidateCaches();
                 ExFreePoolWithTag(NCE, NCE_TAG);
 
                 continue;
@@ -623,6 +627,7 @@ VOID NBRemoveNeighbor(
           *PrevNCE = CurNCE->Next;
 
 	  NBFlushPacketQueue( CurNCE, NDIS_STATUS_REQUEST_ABORTED );
+          RouteInvalidateCaches();
           ExFreePoolWithTag(CurNCE, NCE_TAG);
 
 	  break;
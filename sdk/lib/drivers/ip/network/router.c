@@ -17,6 +17,36 @@
 LIST_ENTRY FIBListHead;
 KSPIN_LOCK FIBLock;
 
+/* Bumped whenever a cached route may have become wrong, see ROUTE_CACHE */
+volatile LONG RouteGeneration = 1;
+
+/*
+ * The IPv4 routes are also kept in a path compressed binary trie, so lookups
+ * cost one step per prefix bit that matters instead of a pass over the whole
+ * FIB. Lookups don't take FIBLock, they only raise to DISPATCH_LEVEL. Writers
+ * hold FIBLock, fill in new nodes completely before linking them in and never
+ * free what a lookup may still be looking at: unlinked nodes and FIB entries
+ * are retired, and freed by a worker once every processor has dropped below
+ * DISPATCH_LEVEL since.
+ */
+typedef struct _FIB_NODE {
+    struct _FIB_NODE * volatile Child[2]; /* Longer prefixes, by their next bit */
+    PFIB_ENTRY volatile Routes;           /* Routes for exactly this prefix */
+    ULONG Prefix;                         /* Host order, bits past PrefixLength are zero */
+    UCHAR PrefixLength;                   /* Length of the prefix in bits */
+    struct _FIB_NODE *NextRetired;        /* Next node waiting to be freed */
+} FIB_NODE, *PFIB_NODE;
+
+static PFIB_NODE volatile FIBRoot;
+static PFIB_NODE FIBRetiredNodes;
+static LIST_ENTRY FIBRetiredEntries;
+static BOOLEAN FIBReclaimQueued;
+
+#define FIB_MASK(Length)        ((Length) ? 0xFFFFFFFF << (32 - (Length)) : 0)
+#define FIB_BIT(Key, Position)  (((Key) >> (31 - (Position))) & 1)
+
+#define FIBPublish(Link, Node)  InterlockedExchangePointer((PVOID volatile *)(Link), (Node))
+
 void RouterDumpRoutes() {
     PLIST_ENTRY CurrentEntry;
     PLIST_ENTRY NextEntry;
@@ -54,6 +84,280 @@ VOID FreeFIB(
 }
 
 
+static VOID FIBFreeRetired(
+    PFIB_NODE Nodes,
+    PLIST_ENTRY Entries)
+{
+    PFIB_NODE Node;
+    PLIST_ENTRY Entry;
+
+    while ((Node = Nodes) != NULL) {
+        Nodes = Node->NextRetired;
+        ExFreePoolWithTag(Node, FIB_TAG);
+    }
+
+    while (!IsListEmpty(Entries)) {
+        Entry = RemoveHeadList(Entries);
+        FreeFIB(CONTAINING_RECORD(Entry, FIB_ENTRY, ListEntry));
+    }
+}
+
+
+static VOID FIBReclaimWorker(
+    PVOID Context)
+/*
+ * FUNCTION: Frees retired trie nodes and FIB entries
+ * NOTES:
+ *     Runs at PASSIVE_LEVEL. Lookups run at DISPATCH_LEVEL, so once this
+ *     thread got to run on every processor no lookup that could have seen
+ *     the retired objects is left
+ */
+{
+    KIRQL OldIrql;
+    KAFFINITY Active, Processor;
+    PFIB_NODE Nodes;
+    LIST_ENTRY Entries;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
+    FIBReclaimQueued = FALSE;
+    Nodes = FIBRetiredNodes;
+    FIBRetiredNodes = NULL;
+    InitializeListHead(&Entries);
+    if (!IsListEmpty(&FIBRetiredEntries)) {
+        /* Move the whole list over */
+        Entries = FIBRetiredEntries;
+        Entries.Flink->Blink = &Entries;
+        Entries.Blink->Flink = &Entries;
+        InitializeListHead(&FIBRetiredEntries);
+    }
+    TcpipReleaseSpinLock(&FIBLock, OldIrql);
+
+    Active = KeQueryActiveProcessors();
+    for (Processor = 1; Processor && Processor <= Active; Processor <<= 1) {
+        if (Active & Processor)
+            KeSetSystemAffinityThread(Processor);
+    }
+    KeRevertToUserAffinityThread();
+
+    FIBFreeRetired(Nodes, &Entries);
+}
+
+
+static VOID FIBQueueReclaim(
+    VOID)
+/*
+ * FUNCTION: Makes sure retired objects get freed
+ * NOTES:
+ *     The forward information base lock must be held when called. If no
+ *     worker can be queued now the objects wait for the next retirement
+ */
+{
+    if (!FIBReclaimQueued) {
+        FIBReclaimQueued = TRUE;
+        if (!ChewCreate(FIBReclaimWorker, NULL))
+            FIBReclaimQueued = FALSE;
+    }
+}
+
+
+static UCHAR FIBCommonLength(
+    ULONG Key1,
+    ULONG Key2,
+    UCHAR MaxLength)
+{
+    UCHAR Length = 0;
+
+    while (Length < MaxLength && !FIB_BIT(Key1 ^ Key2, Length))
+        Length++;
+
+    return Length;
+}
+
+
+static PFIB_NODE FIBTakeNode(
+    PFIB_NODE *Spare,
+    ULONG Prefix,
+    UCHAR PrefixLength)
+{
+    PFIB_NODE Node;
+
+    Node = Spare[0] ? Spare[0] : Spare[1];
+    ASSERT(Node);
+    if (Node == Spare[0])
+        Spare[0] = NULL;
+    else
+        Spare[1] = NULL;
+
+    RtlZeroMemory(Node, sizeof(*Node));
+    Node->Prefix = Prefix & FIB_MASK(PrefixLength);
+    Node->PrefixLength = PrefixLength;
+
+    return Node;
+}
+
+
+static PFIB_NODE FIBInsertNode(
+    ULONG Prefix,
+    UCHAR PrefixLength,
+    PFIB_NODE *Spare)
+/*
+ * FUNCTION: Finds or adds the trie node for a prefix
+ * ARGUMENTS:
+ *     Prefix       = Prefix in host order
+ *     PrefixLength = Length of the prefix
+ *     Spare        = Two preallocated nodes, the ones used are set to NULL
+ * RETURNS:
+ *     Node for the prefix
+ * NOTES:
+ *     The forward information base lock must be held when called
+ */
+{
+    PFIB_NODE volatile *Link = &FIBRoot;
+    PFIB_NODE Node, New, Fork;
+    UCHAR Common;
+
+    Prefix &= FIB_MASK(PrefixLength);
+
+    while ((Node = *Link) != NULL) {
+        Common = FIBCommonLength(Prefix, Node->Prefix, min(PrefixLength, Node->PrefixLength));
+        if (Common == Node->PrefixLength) {
+            if (Common == PrefixLength)
+                return Node;
+
+            Link = &Node->Child[FIB_BIT(Prefix, Common)];
+            continue;
+        }
+
+        /* The new prefix branches off above this node */
+        New = FIBTakeNode(Spare, Prefix, PrefixLength);
+        if (Common == PrefixLength) {
+            /* It is a prefix of this node */
+            New->Child[FIB_BIT(Node->Prefix, Common)] = Node;
+            FIBPublish(Link, New);
+        } else {
+            /* They only share a shorter prefix, which needs a node of its own */
+            Fork = FIBTakeNode(Spare, Prefix, Common);
+            Fork->Child[FIB_BIT(Prefix, Common)] = New;
+            Fork->Child[FIB_BIT(Node->Prefix, Common)] = Node;
+            FIBPublish(Link, Fork);
+        }
+        return New;
+    }
+
+    New = FIBTakeNode(Spare, Prefix, PrefixLength);
+    FIBPublish(Link, New);
+
+    return New;
+}
+
+
+static VOID FIBRemoveRoute(
+    PFIB_ENTRY FIBE)
+/*
+ * FUNCTION: Takes a FIB entry out of the route trie
+ * ARGUMENTS:
+ *     FIBE = Pointer to FIB entry
+ * NOTES:
+ *     The forward information base lock must be held when called.
+ *     Nodes that are no longer needed are retired
+ */
+{
+    PFIB_NODE volatile *Link = &FIBRoot, *ParentLink = NULL;
+    PFIB_NODE Node, Parent = NULL, Child;
+    PFIB_ENTRY volatile *Route;
+    ULONG Prefix;
+    UCHAR PrefixLength;
+
+    Prefix = IPv4NToHl(FIBE->NetworkAddress.Address.IPv4Address);
+    PrefixLength = (UCHAR)AddrCountPrefixBits(&FIBE->Netmask);
+    Prefix &= FIB_MASK(PrefixLength);
+
+    while ((Node = *Link) != NULL && Node->PrefixLength < PrefixLength) {
+        ParentLink = Link;
+        Parent = Node;
+        Link = &Node->Child[FIB_BIT(Prefix, Node->PrefixLength)];
+    }
+    if (!Node || Node->PrefixLength != PrefixLength || Node->Prefix != Prefix)
+        return;
+
+    for (Route = &Node->Routes; *Route; Route = &(*Route)->NodeNext) {
+        if (*Route == FIBE) {
+            FIBPublish(Route, FIBE->NodeNext);
+            break;
+        }
+    }
+
+    /* Nodes without routes are only kept to fork */
+    if (Node->Routes || (Node->Child[0] && Node->Child[1]))
+        return;
+
+    Child = Node->Child[0] ? Node->Child[0] : Node->Child[1];
+    FIBPublish(Link, Child);
+    Node->NextRetired = FIBRetiredNodes;
+    FIBRetiredNodes = Node;
+
+    /* A fork without routes that lost a child isn't needed either */
+    if (!Child && Parent && !Parent->Routes) {
+        Child = Parent->Child[0] ? Parent->Child[0] : Parent->Child[1];
+        FIBPublish(ParentLink, Child);
+        Parent->NextRetired = FIBRetiredNodes;
+        FIBRetiredNodes = Parent;
+    }
+}
+
+
+static PNEIGHBOR_CACHE_ENTRY FIBLookup(
+    ULONG Destination)
+/*
+ * FUNCTION: Finds the router of the longest prefix matching a destination
+ * ARGUMENTS:
+ *     Destination = Destination address in host order
+ * RETURNS:
+ *     Pointer to NCE for router, NULL if no route matches
+ * NOTES:
+ *     Must be called at DISPATCH_LEVEL. Routers that are neither stale nor
+ *     incomplete are preferred, then the ones with the lowest metric
+ */
+{
+    PFIB_NODE Node;
+    PFIB_ENTRY Route;
+    PNEIGHBOR_CACHE_ENTRY Best = NULL, BestReachable = NULL, NodeBest, NodeReachable;
+    UINT BestMetric, ReachableMetric;
+
+    for (Node = FIBRoot;
+         Node && !((Destination ^ Node->Prefix) & FIB_MASK(Node->PrefixLength));
+         Node = Node->Child[FIB_BIT(Destination, Node->PrefixLength)]) {
+        NodeBest = NodeReachable = NULL;
+        BestMetric = ReachableMetric = 0;
+
+        for (Route = Node->Routes; Route; Route = Route->NodeNext) {
+            if (!NodeBest || Route->Metric < BestMetric) {
+                NodeBest = Route->Router;
+                BestMetric = Route->Metric;
+            }
+            if (!(Route->Router->State & (NUD_STALE | NUD_INCOMPLETE)) &&
+                (!NodeReachable || Route->Metric < ReachableMetric)) {
+                NodeReachable = Route->Router;
+                ReachableMetric = Route->Metric;
+            }
+        }
+
+        /* Longer prefixes come later and win */
+        if (NodeBest)
+            Best = NodeBest;
+        if (NodeReachable)
+            BestReachable = NodeReachable;
+
+        if (Node->PrefixLength == 32)
+            break;
+    }
+
+    return BestReachable ? BestReachable : Best;
+}
+
+
 VOID DestroyFIBE(
     PFIB_ENTRY FIBE)
 /*
@@ -61,16 +365,22 @@ VOID DestroyFIBE(
  * ARGUMENTS:
  *     FIBE = Pointer to FIB entry
  * NOTES:
- *     The forward information base lock must be held when called
+ *     The forward information base lock must be held when called.
+ *     The entry is only freed once no lookup can be using it anymore
  */
 {
     TI_DbgPrint(DEBUG_ROUTER, ("Called. FIBE (0x%X).\n", FIBE));
 
-    /* Unlink the FIB entry from the list */
+    /* Unlink the FIB entry from the list and the trie */
     RemoveEntryList(&FIBE->ListEntry);
+    if (FIBE->NetworkAddress.Type == IP_ADDRESS_V4)
+        FIBRemoveRoute(FIBE);
+
+    /* And retire the FIB entry */
+    InsertTailList(&FIBRetiredEntries, &FIBE->ListEntry);
+    FIBQueueReclaim();
 
-    /* And free the FIB entry */
-    FreeFIB(FIBE);
+    RouteInvalidateCaches();
 }
 
 
@@ -207,6 +517,8 @@ PFIB_ENTRY RouterAddRoute(
  */
 {
     PFIB_ENTRY FIBE;
+    PFIB_NODE Node, Spare[2];
+    KIRQL OldIrql;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called. NetworkAddress (0x%X)  Netmask (0x%X) "
         "Router (0x%X)  Metric (%d).\n", NetworkAddress, Netmask, Router, Metric));
@@ -217,8 +529,14 @@ PFIB_ENTRY RouterAddRoute(
 			       A2S(&Router->Address)));
 
     FIBE = ExAllocatePoolWithTag(NonPagedPool, sizeof(FIB_ENTRY), FIB_TAG);
-    if (!FIBE) {
+    /* Adding a prefix to the trie takes at most two new nodes */
+    Spare[0] = ExAllocatePoolWithTag(NonPagedPool, sizeof(FIB_NODE), FIB_TAG);
+    Spare[1] = ExAllocatePoolWithTag(NonPagedPool, sizeof(FIB_NODE), FIB_TAG);
+    if (!FIBE || !Spare[0] || !Spare[1]) {
         TI_DbgPrint(MIN_TRACE, ("Insufficient resources.\n"));
+        if (FIBE) ExFreePoolWithTag(FIBE, FIB_TAG);
+        if (Spare[0]) ExFreePoolWithTag(Spare[0], FIB_TAG);
+        if (Spare[1]) ExFreePoolWithTag(Spare[1], FIB_TAG);
         return NULL;
     }
 
@@ -228,9 +546,28 @@ PFIB_ENTRY RouterAddRoute(
 		   sizeof(FIBE->Netmask) );
     FIBE->Router         = Router;
     FIBE->Metric         = Metric;
+    FIBE->NodeNext       = NULL;
+
+    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
 
     /* Add FIB to the forward information base */
-    TcpipInterlockedInsertTailList(&FIBListHead, &FIBE->ListEntry, &FIBLock);
+    InsertTailList(&FIBListHead, &FIBE->ListEntry);
+
+    /* And to the route trie */
+    if (NetworkAddress->Type == IP_ADDRESS_V4) {
+        Node = FIBInsertNode(IPv4NToHl(NetworkAddress->Address.IPv4Address),
+                             (UCHAR)AddrCountPrefixBits(Netmask),
+                             Spare);
+        FIBE->NodeNext = Node->Routes;
+        FIBPublish(&Node->Routes, FIBE);
+    }
+
+    RouteInvalidateCaches();
+
+    TcpipReleaseSpinLock(&FIBLock, OldIrql);
+
+    if (Spare[0]) ExFreePoolWithTag(Spare[0], FIB_TAG);
+    if (Spare[1]) ExFreePoolWithTag(Spare[1], FIB_TAG);
 
     return FIBE;
 }
@@ -248,45 +585,20 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
  */
 {
     KIRQL OldIrql;
-    PLIST_ENTRY CurrentEntry;
-    PLIST_ENTRY NextEntry;
-    PFIB_ENTRY Current;
-    UCHAR State;
-    UINT Length, BestLength = 0, MaskLength;
-    PNEIGHBOR_CACHE_ENTRY NCE, BestNCE = NULL;
+    PNEIGHBOR_CACHE_ENTRY BestNCE;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called. Destination (0x%X)\n", Destination));
 
     TI_DbgPrint(DEBUG_ROUTER, ("Destination (%s)\n", A2S(Destination)));
 
-    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
-
-    CurrentEntry = FIBListHead.Flink;
-    while (CurrentEntry != &FIBListHead) {
-        NextEntry = CurrentEntry->Flink;
-	    Current = CONTAINING_RECORD(CurrentEntry, FIB_ENTRY, ListEntry);
-
-        NCE   = Current->Router;
-        State = NCE->State;
-
-	Length = CommonPrefixLength(Destination, &Current->NetworkAddress);
-	MaskLength = AddrCountPrefixBits(&Current->Netmask);
-
-	TI_DbgPrint(DEBUG_ROUTER,("This-Route: %s (Sharing %d bits)\n",
-				  A2S(&NCE->Address), Length));
-
-	if(Length >= MaskLength && (Length > BestLength || !BestNCE) &&
-           ((!(State & NUD_STALE) && !(State & NUD_INCOMPLETE)) || !BestNCE)) {
-	    /* This seems to be a better router */
-	    BestNCE    = NCE;
-	    BestLength = Length;
-	    TI_DbgPrint(DEBUG_ROUTER,("Route selected\n"));
-	}
+    /* Only IPv4 routes are in the trie */
+    if (Destination->Type != IP_ADDRESS_V4)
+        return NULL;
 
-        CurrentEntry = NextEntry;
-    }
-
-    TcpipReleaseSpinLock(&FIBLock, OldIrql);
+    /* This keeps the trie nodes we look at from being freed, see FIB_NODE */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    BestNCE = FIBLookup(IPv4NToHl(Destination->Address.IPv4Address));
+    KeLowerIrql(OldIrql);
 
     if( BestNCE ) {
 	TI_DbgPrint(DEBUG_ROUTER,("Routing to %s\n", A2S(&BestNCE->Address)));
@@ -338,6 +650,48 @@ PNEIGHBOR_CACHE_ENTRY RouteGetRouteToDestination(PIP_ADDRESS Destination)
     return NCE;
 }
 
+PNEIGHBOR_CACHE_ENTRY RouteGetCachedRouteToDestination(
+    PROUTE_CACHE Cache,
+    PIP_ADDRESS Destination)
+/*
+ * FUNCTION: Locates the NCE to send to a destination through a route cache
+ * ARGUMENTS:
+ *     Cache       = Pointer to the route cache of the sender
+ *     Destination = Pointer to destination address to find route to
+ * RETURNS:
+ *     Pointer to NCE, NULL if the destination can't be reached
+ * NOTES:
+ *     The caller serializes the use of the cache. A zeroed cache is empty
+ */
+{
+    LONG Generation = RouteGeneration;
+    PNEIGHBOR_CACHE_ENTRY NCE;
+
+    if (Cache->NCE && Cache->Generation == Generation &&
+        AddrIsEqual(&Cache->Destination, Destination))
+        return Cache->NCE;
+
+    /* A change during the lookup bumps the generation again, so this
+     * result isn't used past it */
+    NCE = RouteGetRouteToDestination(Destination);
+
+    Cache->Destination = *Destination;
+    Cache->NCE = NCE;
+    Cache->Generation = Generation;
+
+    return NCE;
+}
+
+VOID RouteInvalidateCaches(VOID)
+/*
+ * FUNCTION: Invalidates all route caches
+ * NOTES:
+ *     Called when a route or an NCE goes away or a new route is added
+ */
+{
+    InterlockedIncrement(&RouteGeneration);
+}
+
 VOID RouterRemoveRoutesForInterface(PIP_INTERFACE Interface)
 {
     KIRQL OldIrql;
@@ -492,6 +846,9 @@ NTSTATUS RouterStartup(
     /* Initialize the Forward Information Base */
     InitializeListHead(&FIBListHead);
     TcpipInitializeSpinLock(&FIBLock);
+    FIBRoot = NULL;
+    FIBRetiredNodes = NULL;
+    InitializeListHead(&FIBRetiredEntries);
 
     return STATUS_SUCCESS;
 }
@@ -512,6 +869,11 @@ NTSTATUS RouterShutdown(
     /* Clear Forward Information Base */
     TcpipAcquireSpinLock(&FIBLock, &OldIrql);
     DestroyFIBEs();
+    ASSERT(FIBRoot == NULL);
+
+    /* Nobody is looking anymore */
+    FIBFreeRetired(FIBRetiredNodes, &FIBRetiredEntries);
+    FIBRetiredNodes = NULL;
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
     return STATUS_SUCCESS;
@@ -59,6 +59,85 @@ NTSTATUS IPSendFragment(
     return NBQueuePacket(NCE, NdisPacket, IPSendComplete, IFC);
 }
 
+static USHORT CompleteTransportChecksum(
+    ULONG Sum,
+    UCHAR Protocol)
+/*
+ * FUNCTION: Turns the sum of a TCP or UDP packet into its checksum
+ * ARGUMENTS:
+ *     Sum      = Sum of the packet, including the pseudo header
+ *     Protocol = Transport protocol
+ * RETURNS:
+ *     Checksum to store in the packet
+ */
+{
+    USHORT Checksum = (USHORT)~ChecksumFold(Sum);
+
+    /* A zero UDP checksum means that there is none */
+    if (Protocol == IPPROTO_UDP && Checksum == 0)
+        Checksum = 0xFFFF;
+
+    return Checksum;
+}
+
+static VOID PrepareTransportChecksum(
+    PIP_PACKET IPPacket,
+    PIPFRAGMENT_CONTEXT IFC)
+/*
+ * FUNCTION: Decides how the TCP or UDP checksum of a datagram is completed
+ * ARGUMENTS:
+ *     IPPacket = Pointer to an IP packet
+ *     IFC      = Pointer to IP fragment context
+ * NOTES:
+ *     The adapter completes the checksum if it can. Otherwise it is done
+ *     while the data is copied into the fragment, unless the datagram
+ *     is fragmented
+ */
+{
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
+    UCHAR Protocol;
+    UINT Offset, MaxData;
+    ULONG Offload;
+    PUSHORT Checksum;
+
+    if (IPPacket->Flags & IP_PACKET_FLAG_TCP_CHECKSUM) {
+        Protocol = IPPROTO_TCP;
+        Offset = FIELD_OFFSET(TCPv4_HEADER, Checksum);
+        Offload = IP_CHECKSUM_TX_TCP;
+    } else if (IPPacket->Flags & IP_PACKET_FLAG_UDP_CHECKSUM) {
+        Protocol = IPPROTO_UDP;
+        Offset = FIELD_OFFSET(UDP_HEADER, Checksum);
+        Offload = IP_CHECKSUM_TX_UDP;
+    } else {
+        return;
+    }
+
+    /* Same as in PrepareNextFragment */
+    MaxData  = IFC->PathMTU - IFC->HeaderSize;
+    MaxData -= MaxData % 8;
+
+    if (IFC->BytesLeft > MaxData) {
+        /* The fragments are copied piecewise, sum up the datagram first */
+        Checksum = (PUSHORT)((PCHAR)IFC->DatagramData + Offset);
+        *Checksum = CompleteTransportChecksum(ChecksumCompute(IFC->DatagramData, IFC->BytesLeft, 0),
+                                              Protocol);
+    } else if (IFC->NCE->Interface->ChecksumOffload & Offload) {
+        ChecksumInfo.Value = 0;
+        ChecksumInfo.Transmit.NdisPacketChecksumV4 = 1;
+        if (Protocol == IPPROTO_TCP)
+            ChecksumInfo.Transmit.NdisPacketTcpChecksum = 1;
+        else
+            ChecksumInfo.Transmit.NdisPacketUdpChecksum = 1;
+
+        /* This is a value, not a pointer */
+        NDIS_PER_PACKET_INFO_FROM_PACKET(IFC->NdisPacket,
+                                         TcpIpChecksumPacketInfo) = (PVOID)(ULONG_PTR)ChecksumInfo.Value;
+    } else {
+        IFC->ChecksumProtocol = Protocol;
+        IFC->ChecksumOffset = Offset;
+    }
+}
+
 BOOLEAN PrepareNextFragment(
     PIPFRAGMENT_CONTEXT IFC)
 /*
@@ -96,7 +175,15 @@ BOOLEAN PrepareNextFragment(
 	TI_DbgPrint(MID_TRACE,("Copying data from %x to %x (%d)\n",
 			       IFC->DatagramData, IFC->Data, DataSize));
 
-        RtlCopyMemory(IFC->Data, IFC->DatagramData, DataSize); // SAFE
+        if (IFC->ChecksumProtocol) {
+            /* Only set for datagrams sent in one fragment */
+            ASSERT(!MoreFragments);
+            *(PUSHORT)((PCHAR)IFC->Data + IFC->ChecksumOffset) =
+                CompleteTransportChecksum(ChecksumCopy(IFC->Data, IFC->DatagramData, DataSize, 0),
+                                          IFC->ChecksumProtocol);
+        } else {
+            RtlCopyMemory(IFC->Data, IFC->DatagramData, DataSize); // SAFE
+        }
 
         /* Fragment offset is in 8 byte blocks */
         FragOfs = (USHORT)(IFC->Position / 8);
@@ -189,6 +276,10 @@ NTSTATUS SendFragments(
     IFC->BytesLeft    = IPPacket->TotalSize - IPPacket->HeaderSize;
     IFC->Data         = (PVOID)((ULONG_PTR)IFC->Header + IPPacket->HeaderSize);
     KeInitializeEvent(&IFC->Event, NotificationEvent, FALSE);
+    IFC->ChecksumProtocol = 0;
+    IFC->ChecksumOffset = 0;
+
+    PrepareTransportChecksum(IPPacket, IFC);
 
     TI_DbgPrint(MID_TRACE,("Copying header from %x to %x (%d)\n",
 			   IPPacket->Header, IFC->Header,
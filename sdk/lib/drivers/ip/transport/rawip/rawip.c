@@ -221,7 +221,7 @@ NTSTATUS RawIPSendDatagram(
          * then use the unicast address of the
          * interface we're sending over
          */
-        if(!(NCE = RouteGetRouteToDestination( &RemoteAddress ))) {
+        if(!(NCE = RouteGetCachedRouteToDestination( &AddrFile->RouteCache, &RemoteAddress ))) {
             UnlockObject(AddrFile, OldIrql);
             return STATUS_NETWORK_UNREACHABLE;
         }
@@ -370,21 +370,16 @@ TCPSendEventHandler(void *arg, const u16_t space)
 
     while ((Entry = ExInterlockedRemoveHeadList(&Connection->SendRequest, &Connection->Lock)))
     {
-        UINT SendLen = 0;
-        PVOID SendBuffer = 0;
+        PTDI_REQUEST_KERNEL_SEND SendInfo;
         
         Bucket = CONTAINING_RECORD( Entry, TDI_BUCKET, Entry );
         
         Irp = Bucket->Request.RequestContext;
         Mdl = Irp->MdlAddress;
+        SendInfo = (PTDI_REQUEST_KERNEL_SEND)&IoGetCurrentIrpStackLocation(Irp)->Parameters;
         
         TI_DbgPrint(DEBUG_TCP,
-                    ("Getting the user buffer from %x\n", Mdl));
-        
-        NdisQueryBuffer( Mdl, &SendBuffer, &SendLen );
-        
-        TI_DbgPrint(DEBUG_TCP,
-                    ("Writing %d bytes to %x\n", SendLen, SendBuffer));
+                    ("Writing %d bytes from %x\n", SendInfo->SendLength, Mdl));
         
         TI_DbgPrint(DEBUG_TCP, ("Connection: %x\n", Connection));
         TI_DbgPrint
@@ -393,8 +388,9 @@ TCPSendEventHandler(void *arg, const u16_t space)
           Connection->SocketContext));
         
         Status = TCPTranslateError(LibTCPSend(Connection,
-                                              SendBuffer,
-                                              SendLen, &BytesSent, TRUE));
+                                              Mdl,
+                                              SendInfo->SendLength,
+                                              &BytesSent, TRUE));
         
         TI_DbgPrint(DEBUG_TCP,("TCP Bytes: %d\n", BytesSent));
         
@@ -7,6 +7,17 @@
 #include "lwip/api.h"
 #include "lwip/tcpip.h"
 
+/*
+ * lwIP calls us without the connection, so routes are cached per
+ * destination. Only the tcpip thread sends, so no lock is needed
+ */
+#define TCP_ROUTE_CACHE_SIZE 16
+
+static ROUTE_CACHE TCPRouteCache[TCP_ROUTE_CACHE_SIZE];
+
+#define TCP_ROUTE_CACHE_INDEX(Address) \
+    (((Address) ^ ((Address) >> 8) ^ ((Address) >> 16) ^ ((Address) >> 24)) % TCP_ROUTE_CACHE_SIZE)
+
 err_t
 TCPSendDataCallback(struct netif *netif, struct pbuf *p, struct ip_addr *dest)
 {
@@ -15,6 +26,7 @@ TCPSendDataCallback(struct netif *netif, struct pbuf *p, struct ip_addr *dest)
     IP_PACKET Packet;
     IP_ADDRESS RemoteAddress, LocalAddress;
     PIPv4_HEADER Header;
+    PTCPv4_HEADER TCPHeader;
     ULONG Length;
     ULONG TotalLength;
 
@@ -37,7 +49,8 @@ TCPSendDataCallback(struct netif *netif, struct pbuf *p, struct ip_addr *dest)
 
     IPInitializePacket(&Packet, LocalAddress.Type);
 
-    if (!(NCE = RouteGetRouteToDestination(&RemoteAddress)))
+    if (!(NCE = RouteGetCachedRouteToDestination(&TCPRouteCache[TCP_ROUTE_CACHE_INDEX(RemoteAddress.Address.IPv4Address)],
+                                                  &RemoteAddress)))
     {
         return ERR_RTE;
     }
@@ -70,6 +83,17 @@ TCPSendDataCallback(struct netif *netif, struct pbuf *p, struct ip_addr *dest)
     Packet.SrcAddr = LocalAddress;
     Packet.DstAddr = RemoteAddress;
 
+    /* lwIP leaves the TCP checksum to the send path, or the adapter */
+    if (((PIPv4_HEADER)Packet.Header)->Protocol == IPPROTO_TCP)
+    {
+        TCPHeader = (PTCPv4_HEADER)((PCHAR)Packet.Header + Packet.HeaderSize);
+        TCPHeader->Checksum = (USHORT)ChecksumFold(
+            ChecksumPseudoHeaderIPv4(Packet.Header,
+                                     IPPROTO_TCP,
+                                     (USHORT)(TotalLength - Packet.HeaderSize)));
+        Packet.Flags |= IP_PACKET_FLAG_TCP_CHECKSUM;
+    }
+
     NdisStatus = IPSendDatagram(&Packet, NCE);
     if (!NT_SUCCESS(NdisStatus))
         return ERR_RTE;
@@ -173,10 +173,28 @@ VOID TCPReceive(PIP_INTERFACE Interface, PIP_PACKET IPPacket)
  *     This is the low level interface for receiving TCP data
  */
 {
+    ULONG Sum;
+
     TI_DbgPrint(DEBUG_TCP,("Sending packet %d (%d) to lwIP\n",
                            IPPacket->TotalSize,
                            IPPacket->HeaderSize));
-    
+
+    /* lwIP doesn't check the checksum, so do it here unless the adapter did */
+    if (!(IPPacket->Flags & IP_PACKET_FLAG_TCP_CHECKSUM_OK))
+    {
+        Sum = ChecksumPseudoHeaderIPv4(IPPacket->Header,
+                                       IPPROTO_TCP,
+                                       (USHORT)(IPPacket->TotalSize - IPPacket->HeaderSize));
+        Sum = ChecksumCompute((PCHAR)IPPacket->Header + IPPacket->HeaderSize,
+                              IPPacket->TotalSize - IPPacket->HeaderSize,
+                              Sum);
+        if (ChecksumFold(Sum) != 0xFFFF)
+        {
+            TI_DbgPrint(MIN_TRACE, ("Bad checksum on packet received.\n"));
+            return;
+        }
+    }
+
     LibIPInsertPacket(Interface->TCPContext, IPPacket->Header, IPPacket->TotalSize);
 }
 
@@ -523,7 +541,7 @@ NTSTATUS TCPReceiveData
 
 NTSTATUS TCPSendData
 ( PCONNECTION_ENDPOINT Connection,
-  PCHAR BufferData,
+  PMDL Mdl,
   ULONG SendLength,
   PULONG BytesSent,
   ULONG Flags,
@@ -543,11 +561,21 @@ NTSTATUS TCPSendData
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Connection->SocketContext = %x\n",
                            Connection->SocketContext));
 
-    Status = TCPTranslateError(LibTCPSend(Connection,
-                                          BufferData,
-                                          SendLength,
-                                          BytesSent,
-                                          FALSE));
+    /* Earlier sends are still waiting for buffer space so this one can't
+     * go out yet either. Queue it without a trip to the tcpip thread */
+    if (!IsListEmpty(&Connection->SendRequest))
+    {
+        *BytesSent = 0;
+        Status = STATUS_PENDING;
+    }
+    else
+    {
+        Status = TCPTranslateError(LibTCPSend(Connection,
+                                              Mdl,
+                                              SendLength,
+                                              BytesSent,
+                                              FALSE));
+    }
     
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Send: %x, %d\n", Status, SendLength));
 
@@ -61,10 +61,12 @@ NTSTATUS AddUDPHeaderIPv4(
 
     RtlCopyMemory(IPPacket->Data, Data, DataLength);
 
-    UDPHeader->Checksum = UDPv4ChecksumCalculate((PIPv4_HEADER)IPPacket->Header,
-                                                 (PUCHAR)UDPHeader,
-                                                 DataLength + sizeof(UDP_HEADER));
-    UDPHeader->Checksum = WH2N(UDPHeader->Checksum);
+    /* The send path completes the checksum, or the adapter does */
+    UDPHeader->Checksum = (USHORT)ChecksumFold(
+        ChecksumPseudoHeaderIPv4((PIPv4_HEADER)IPPacket->Header,
+                                 IPPROTO_UDP,
+                                 (USHORT)(DataLength + sizeof(UDP_HEADER))));
+    IPPacket->Flags |= IP_PACKET_FLAG_UDP_CHECKSUM;
 
     TI_DbgPrint(MID_TRACE, ("Packet: %d ip %d udp %d payload\n",
 			    (PCHAR)UDPHeader - (PCHAR)IPPacket->Header,
@@ -199,7 +201,7 @@ NTSTATUS UDPSendDatagram(
          * then use the unicast address of the
          * interface we're sending over
          */
-        if(!(NCE = RouteGetRouteToDestination( &RemoteAddress ))) {
+        if(!(NCE = RouteGetCachedRouteToDestination( &AddrFile->RouteCache, &RemoteAddress ))) {
             UnlockObject(AddrFile, OldIrql);
             return STATUS_NETWORK_UNREACHABLE;
         }
@@ -279,14 +281,17 @@ VOID UDPReceive(PIP_INTERFACE Interface, PIP_PACKET IPPacket)
 
   UDPHeader = (PUDP_HEADER)IPPacket->Data;
 
-  /* Calculate and validate UDP checksum */
-  i = UDPv4ChecksumCalculate(IPv4Header,
-                             (PUCHAR)UDPHeader,
-                             WH2N(UDPHeader->Length));
-  if (i != DH2N(0x0000FFFF) && UDPHeader->Checksum != 0)
+  /* Calculate and validate UDP checksum, unless the adapter did */
+  if (!(IPPacket->Flags & IP_PACKET_FLAG_UDP_CHECKSUM_OK) && UDPHeader->Checksum != 0)
   {
-      TI_DbgPrint(MIN_TRACE, ("Bad checksum on packet received.\n"));
-      return;
+      i = UDPv4ChecksumCalculate(IPv4Header,
+                                 (PUCHAR)UDPHeader,
+                                 WH2N(UDPHeader->Length));
+      if (i != DH2N(0x0000FFFF))
+      {
+          TI_DbgPrint(MIN_TRACE, ("Bad checksum on packet received.\n"));
+          return;
+      }
   }
 
   /* Sanity checks */
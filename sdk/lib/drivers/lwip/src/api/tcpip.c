@@ -83,6 +83,9 @@ tcpip_thread(void *arg)
 
   LOCK_TCPIP_CORE();
   while (1) {                          /* MAIN Loop */
+#ifdef __REACTOS__
+    sys_arch_mbox_flush_events(&mbox);
+#endif /* __REACTOS__ */
     UNLOCK_TCPIP_CORE();
     LWIP_TCPIP_THREAD_ALIVE();
     /* wait for a message, timeouts are processed while waiting */
@@ -457,6 +457,9 @@ sys_timeouts_mbox_fetch(sys_mbox_t *mbox, void **msg)
            timeout handler function. */
         LOCK_TCPIP_CORE();
         handler(arg);
+#ifdef __REACTOS__
+        sys_arch_mbox_flush_events(mbox);
+#endif /* __REACTOS__ */
         UNLOCK_TCPIP_CORE();
       }
       LWIP_TCPIP_THREAD_ALIVE();
@@ -41,3 +41,6 @@ sys_arch_unprotect(sys_prot_t lev);
 void
 sys_shutdown(void);
 
+void
+sys_arch_mbox_flush_events(sys_mbox_t *mbox);
+
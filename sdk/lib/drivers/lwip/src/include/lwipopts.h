@@ -96,6 +96,15 @@
 
 #define PPPOS_SUPPORT                   0
 
+/* The IP library checks received IP headers and TCP segments and fills in
+ * TCP checksums when sending, so the adapter can do it where it supports
+ * checksum offload. See TCPReceive and TCPSendDataCallback */
+#define CHECKSUM_CHECK_IP               0
+
+#define CHECKSUM_CHECK_TCP              0
+
+#define CHECKSUM_GEN_TCP                0
+
 /*
    ---------------------------------------
    ---------- Debugging options ----------
@@ -32,6 +32,10 @@ extern KEVENT TerminationEvent;
 extern NPAGED_LOOKASIDE_LIST MessageLookasideList;
 extern NPAGED_LOOKASIDE_LIST QueueEntryLookasideList;
 
+/* Connections that got data since the tcpip thread last ran out of work. Only the
+ * tcpip thread touches this list so it doesn't need a lock */
+static LIST_ENTRY ReceiveEventListHead = { &ReceiveEventListHead, &ReceiveEventListHead };
+
 /* Required for ERR_T to NTSTATUS translation in receive error handling */
 NTSTATUS TCPTranslateError(const err_t err);
 
@@ -214,6 +218,21 @@ InternalSendEventHandler(void *arg, PTCP_PCB pcb, const u16_t space)
     return ERR_OK;
 }
 
+static
+void
+FlushReceiveEvent(PCONNECTION_ENDPOINT Connection)
+{
+    if (!Connection->ReceiveEventPending)
+        return;
+
+    RemoveEntryList(&Connection->ReceiveEventEntry);
+    Connection->ReceiveEventPending = FALSE;
+
+    TCPRecvEventHandler(Connection);
+
+    DereferenceObject(Connection);
+}
+
 static
 err_t
 InternalRecvEventHandler(void *arg, PTCP_PCB pcb, struct pbuf *p, const err_t err)
@@ -235,10 +254,21 @@ InternalRecvEventHandler(void *arg, PTCP_PCB pcb, struct pbuf *p, const err_t er
 
         tcp_recved(pcb, p->tot_len);
 
-        TCPRecvEventHandler(arg);
+        /* Hold the receive event back until the tcpip thread has processed all
+         * queued packets, so a burst of segments completes one read instead of
+         * one read per segment. See LibTCPFlushReceiveEvents */
+        if (!Connection->ReceiveEventPending)
+        {
+            ReferenceObject(Connection);
+            Connection->ReceiveEventPending = TRUE;
+            InsertTailList(&ReceiveEventListHead, &Connection->ReceiveEventEntry);
+        }
     }
     else if (err == ERR_OK)
     {
+        /* Deliver the data that came before the FIN first */
+        FlushReceiveEvent(Connection);
+
         /* Complete pending reads with 0 bytes to indicate a graceful closure,
          * but note that send is still possible in this state so we don't close the
          * whole socket here (by calling tcp_close()) as that would violate TCP specs
@@ -266,6 +296,21 @@ InternalRecvEventHandler(void *arg, PTCP_PCB pcb, struct pbuf *p, const err_t er
     return ERR_OK;
 }
 
+/* Called by the tcpip thread before it waits for more work, see sys_arch_mbox_flush_events */
+void
+LibTCPFlushReceiveEvents(void)
+{
+    PCONNECTION_ENDPOINT Connection;
+    PLIST_ENTRY Entry;
+
+    while (!IsListEmpty(&ReceiveEventListHead))
+    {
+        Entry = ReceiveEventListHead.Flink;
+        Connection = CONTAINING_RECORD(Entry, CONNECTION_ENDPOINT, ReceiveEventEntry);
+        FlushReceiveEvent(Connection);
+    }
+}
+
 /* This function MUST return an error value that is not ERR_ABRT or ERR_OK if the connection
  * is not accepted to avoid leaking the new PCB */
 static
@@ -307,6 +352,9 @@ InternalErrorEventHandler(void *arg, const err_t err)
     /* Make sure the socket didn't get closed */
     if (!arg || Connection->SocketContext == NULL) return;
 
+    /* Deliver the data that came before the error first */
+    FlushReceiveEvent(Connection);
+
     /* The PCB is dead now */
     Connection->SocketContext = NULL;
 
@@ -478,8 +526,11 @@ LibTCPSendCallback(void *arg)
 {
     struct lwip_callback_msg *msg = arg;
     PTCP_PCB pcb = msg->Input.Send.Connection->SocketContext;
-    ULONG SendLength;
+    PMDL Mdl = msg->Input.Send.Mdl;
+    PUCHAR Buffer = NULL;
+    ULONG BufferLength = 0, Remaining, SendLength, Sent = 0;
     UCHAR SendFlags;
+    err_t Error = ERR_OK;
 
     ASSERT(msg);
 
@@ -495,45 +546,73 @@ LibTCPSendCallback(void *arg)
         goto done;
     }
 
-    SendFlags = TCP_WRITE_FLAG_COPY;
-    SendLength = msg->Input.Send.DataLength;
-    if (tcp_sndbuf(pcb) == 0)
-    {
-        /* No buffer space so return pending */
-        msg->Output.Send.Error = ERR_INPROGRESS;
-        goto done;
-    }
-    else if (tcp_sndbuf(pcb) < SendLength)
+    /* Queue as much of the MDL chain as the send buffer takes. tcp_write only
+     * takes 64 KiB at a time, so the data goes in pieces but the whole request
+     * costs a single trip to this thread */
+    Remaining = msg->Input.Send.DataLength;
+    while (Remaining != 0 && tcp_sndbuf(pcb) != 0)
     {
-        /* We've got some room so let's send what we can */
-        SendLength = tcp_sndbuf(pcb);
+        if (BufferLength == 0)
+        {
+            if (!Mdl)
+                break;
+
+            Buffer = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+            if (!Buffer)
+            {
+                Error = ERR_MEM;
+                break;
+            }
+
+            BufferLength = MmGetMdlByteCount(Mdl);
+            Mdl = Mdl->Next;
+            continue;
+        }
 
-        /* Don't set the push flag */
-        SendFlags |= TCP_WRITE_FLAG_MORE;
+        SendLength = MIN(Remaining, BufferLength);
+        SendLength = MIN(SendLength, tcp_sndbuf(pcb));
+        SendLength = MIN(SendLength, 0xFFFF);
+
+        SendFlags = TCP_WRITE_FLAG_COPY;
+        if (SendLength < Remaining)
+        {
+            /* Don't set the push flag */
+            SendFlags |= TCP_WRITE_FLAG_MORE;
+        }
+
+        Error = tcp_write(pcb, Buffer, (u16_t)SendLength, SendFlags);
+        if (Error != ERR_OK)
+            break;
+
+        Buffer += SendLength;
+        BufferLength -= SendLength;
+        Remaining -= SendLength;
+        Sent += SendLength;
     }
 
-    msg->Output.Send.Error = tcp_write(pcb,
-                                       msg->Input.Send.Data,
-                                       SendLength,
-                                       SendFlags);
-    if (msg->Output.Send.Error == ERR_OK)
+    if (Sent != 0 || msg->Input.Send.DataLength == 0)
     {
         /* Queued successfully so try to send it */
-        tcp_output((PTCP_PCB)msg->Input.Send.Connection->SocketContext);
-        msg->Output.Send.Information = SendLength;
+        tcp_output(pcb);
+        msg->Output.Send.Error = ERR_OK;
+        msg->Output.Send.Information = Sent;
     }
-    else if (msg->Output.Send.Error == ERR_MEM)
+    else if (Error == ERR_OK || Error == ERR_MEM)
     {
-        /* The queue is too long */
+        /* No buffer space or the queue is too long so return pending */
         msg->Output.Send.Error = ERR_INPROGRESS;
     }
+    else
+    {
+        msg->Output.Send.Error = Error;
+    }
 
 done:
     KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
 }
 
 err_t
-LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe)
+LibTCPSend(PCONNECTION_ENDPOINT Connection, PMDL Mdl, const u32_t len, u32_t *sent, const int safe)
 {
     err_t ret;
     struct lwip_callback_msg *msg;
@@ -543,7 +622,7 @@ LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len
     {
         KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
         msg->Input.Send.Connection = Connection;
-        msg->Input.Send.Data = dataptr;
+        msg->Input.Send.Mdl = Mdl;
         msg->Input.Send.DataLength = len;
 
         if (safe)
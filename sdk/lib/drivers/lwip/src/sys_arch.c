@@ -239,6 +239,16 @@ sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
     return SYS_ARCH_TIMEOUT;
 }
 
+/* Called by the tcpip thread before it waits for more messages */
+void
+sys_arch_mbox_flush_events(sys_mbox_t *mbox)
+{
+    /* Deliver the receive events that were held back while it was busy,
+     * once no more messages are queued */
+    if (!KeReadStateEvent(&mbox->Event))
+        LibTCPFlushReceiveEvents();
+}
+
 u32_t
 sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
 {
@@ -29,6 +29,79 @@
 #include <fast486.h>
 #include "common.h"
 
+/* PRIVATE FUNCTIONS **********************************************************/
+
+#ifndef FAST486_NO_PREFETCH
+
+static
+BOOLEAN
+FASTCALL
+Fast486Prefetch(PFAST486_STATE State,
+                ULONG LinearAddress)
+{
+    ULONG Address = State->PrefetchAddress;
+#ifndef FAST486_NO_CODE_CACHE
+    PFAST486_CODE_BLOCK Block;
+#endif
+
+    /* The prefetch buffer never crosses a page boundary, so one translation is enough */
+    if (State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG)
+    {
+        FAST486_PAGE_TABLE TableEntry;
+
+        if (State->PrefetchPageValid && (State->PrefetchPage == PAGE_ALIGN(Address)))
+        {
+            /* Same page as the last time */
+            TableEntry.Value = State->PrefetchPageEntry;
+        }
+        else
+        {
+            TableEntry.Value = Fast486GetPageTableEntry(State, PAGE_ALIGN(Address), FALSE);
+        }
+
+        if (!TableEntry.Present || (!TableEntry.Usermode && (Fast486GetCurrentPrivLevel(State) > 0)))
+        {
+            State->ControlRegisters[FAST486_REG_CR2] = LinearAddress;
+
+            /* Exception */
+            Fast486ExceptionWithErrorCode(State,
+                                          FAST486_EXCEPTION_PF,
+                                          TableEntry.Present | (State->Cpl ? 0x04 : 0));
+            return FALSE;
+        }
+
+        /* Remember it, code usually keeps running from the same page */
+        State->PrefetchPageValid = TRUE;
+        State->PrefetchPage = PAGE_ALIGN(Address);
+        State->PrefetchPageEntry = TableEntry.Value;
+
+        Address = (TableEntry.Address << 12) | PAGE_OFFSET(Address);
+    }
+
+#ifndef FAST486_NO_CODE_CACHE
+    Block = &State->CodeCache[(Address / FAST486_CACHE_SIZE) & (FAST486_CODE_CACHE_BLOCKS - 1)];
+
+    if ((Block->Address != Address) || (Block->Generation != State->CodeCacheGeneration))
+    {
+        /* Read the code into the block, and forget what was decoded there */
+        State->MemReadCallback(State, Address, Block->Data, FAST486_CACHE_SIZE);
+        RtlZeroMemory(Block->Instructions, sizeof(Block->Instructions));
+        Block->Address = Address;
+        Block->Generation = State->CodeCacheGeneration;
+    }
+
+    RtlMoveMemory(State->PrefetchCache, Block->Data, FAST486_CACHE_SIZE);
+    State->PrefetchBlock = Block;
+#else
+    State->MemReadCallback(State, Address, State->PrefetchCache, FAST486_CACHE_SIZE);
+#endif
+
+    State->PrefetchPhysical = Address;
+    return TRUE;
+}
+
+#endif
+
 /* PUBLIC FUNCTIONS ***********************************************************/
 
 BOOLEAN
@@ -111,51 +184,32 @@ Fast486ReadMemory(PFAST486_STATE State,
     LinearAddress = CachedDescriptor->Base + Offset;
 
 #ifndef FAST486_NO_PREFETCH
-    if (InstFetch && ((Offset + FAST486_CACHE_SIZE - 1) <= CachedDescriptor->Limit))
+    if (InstFetch)
     {
-        State->PrefetchAddress = LinearAddress;
+        ULONG PrefetchOffset = LinearAddress & (FAST486_CACHE_SIZE - 1);
 
-        if ((State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG)
-            && (PAGE_OFFSET(State->PrefetchAddress) > (FAST486_PAGE_SIZE - FAST486_CACHE_SIZE)))
+        /* The whole prefetch buffer must be within the limit */
+        if (((PrefetchOffset + Size) <= FAST486_CACHE_SIZE)
+            && ((Offset - PrefetchOffset + FAST486_CACHE_SIZE - 1) <= CachedDescriptor->Limit))
         {
-            /* We mustn't prefetch across a page boundary */
-            State->PrefetchAddress = PAGE_ALIGN(State->PrefetchAddress)
-                                     | (FAST486_PAGE_SIZE - FAST486_CACHE_SIZE);
+            State->PrefetchAddress = LinearAddress - PrefetchOffset;
 
-            if ((LinearAddress - State->PrefetchAddress + Size) >= FAST486_CACHE_SIZE)
+            /* Prefetch */
+            if (!Fast486Prefetch(State, LinearAddress))
             {
-                /* We can't prefetch without possibly violating page permissions */
                 State->PrefetchValid = FALSE;
-                return Fast486ReadLinearMemory(State, LinearAddress, Buffer, Size, TRUE);
+                return FALSE;
             }
-        }
 
-        /* Prefetch */
-        if (Fast486ReadLinearMemory(State,
-                                    State->PrefetchAddress,
-                                    State->PrefetchCache,
-                                    FAST486_CACHE_SIZE,
-                                    TRUE))
-        {
             State->PrefetchValid = TRUE;
-
-            RtlMoveMemory(Buffer,
-                          &State->PrefetchCache[LinearAddress - State->PrefetchAddress],
-                          Size);
+            RtlMoveMemory(Buffer, &State->PrefetchCache[PrefetchOffset], Size);
             return TRUE;
         }
-        else
-        {
-            State->PrefetchValid = FALSE;
-            return FALSE;
-        }
     }
-    else
 #endif
-    {
-        /* Read from the linear address */
-        return Fast486ReadLinearMemory(State, LinearAddress, Buffer, Size, TRUE);
-    }
+
+    /* Read from the linear address */
+    return Fast486ReadLinearMemory(State, LinearAddress, Buffer, Size, TRUE);
 }
 
 BOOLEAN
@@ -910,6 +964,7 @@ Fast486TaskSwitch(PFAST486_STATE State, FAST486_TASK_SWITCH_TYPE Type, USHORT Se
 #ifndef FAST486_NO_PREFETCH
     /* Context switching invalidates the prefetch */
     State->PrefetchValid = FALSE;
+    State->PrefetchPageValid = FALSE;
 #endif
 
     /* Load the registers */
@@ -1310,4 +1365,90 @@ Fast486CallGate(PFAST486_STATE State,
     return TRUE;
 }
 
+#ifndef FAST486_NO_CODE_CACHE
+
+BOOLEAN
+FASTCALL
+Fast486GetCachedModRegRm(PFAST486_STATE State,
+                         BOOLEAN AddressSize,
+                         PFAST486_MOD_REG_RM ModRegRm)
+{
+    PFAST486_DECODED_INST DecodedInst = State->DecodedInst;
+
+    /*
+     * The operand must have been cached at this point of the instruction.
+     * It only was if all its bytes are in the same block as the rest of it.
+     */
+    if ((DecodedInst->ModRmOffset == 0)
+        || (DecodedInst->ModRmOffset != (UCHAR)(State->InstPtr.Long - State->SavedInstPtr.Long))
+        || (!(DecodedInst->Flags & FAST486_DECODED_ADSIZE) != !AddressSize))
+    {
+        return FALSE;
+    }
+
+    /* Skip its bytes */
+    if (State->SegmentRegs[FAST486_REG_CS].Size) State->InstPtr.Long += DecodedInst->ModRmLength;
+    else State->InstPtr.LowWord += DecodedInst->ModRmLength;
+
+    ModRegRm->Register = DecodedInst->Register;
+
+    if (!(DecodedInst->Flags & FAST486_DECODED_MEMORY))
+    {
+        /* The second operand is a register */
+        ModRegRm->Memory = FALSE;
+        ModRegRm->SecondRegister = DecodedInst->Base;
+        return TRUE;
+    }
+
+    /* Calculate the address */
+    ModRegRm->Memory = TRUE;
+    Fast486SetModRegRmAddress(State,
+                              AddressSize,
+                              DecodedInst->Base,
+                              DecodedInst->Index,
+                              DecodedInst->Scale,
+                              DecodedInst->Displacement,
+                              (DecodedInst->Flags & FAST486_DECODED_SS) != 0,
+                              ModRegRm);
+    return TRUE;
+}
+
+VOID
+FASTCALL
+Fast486CacheModRegRm(PFAST486_STATE State,
+                     ULONG ModRmOffset,
+                     BOOLEAN AddressSize,
+                     PFAST486_MOD_REG_RM ModRegRm,
+                     UCHAR Base,
+                     UCHAR Index,
+                     UCHAR Scale,
+                     LONG Displacement,
+                     BOOLEAN DefaultSs)
+{
+    PFAST486_DECODED_INST DecodedInst = State->DecodedInst;
+    ULONG Length;
+
+    /* The instruction may have been invalidated in the meantime */
+    if (DecodedInst == NULL) return;
+
+    /* The operand must be in the same block as the rest of the instruction */
+    Length = Fast486GetDecodedLength(State);
+    if (Length == 0) return;
+
+    DecodedInst->ModRmOffset = (UCHAR)ModRmOffset;
+    DecodedInst->ModRmLength = (UCHAR)(Length - ModRmOffset);
+    DecodedInst->Register = (UCHAR)ModRegRm->Register;
+    DecodedInst->Base = Base;
+    DecodedInst->Index = Index;
+    DecodedInst->Scale = Scale;
+    DecodedInst->Displacement = Displacement;
+    DecodedInst->Flags = 0;
+
+    if (AddressSize) DecodedInst->Flags |= FAST486_DECODED_ADSIZE;
+    if (ModRegRm->Memory) DecodedInst->Flags |= FAST486_DECODED_MEMORY;
+    if (DefaultSs) DecodedInst->Flags |= FAST486_DECODED_SS;
+}
+
+#endif
+
 /* EOF */
@@ -70,6 +70,7 @@ if (State->PrefixFlags & FAST486_PREFIX_LOCK)\
 #define GET_ADDR_PTE(x) (((x) >> 12) & 0x3FF)
 #define INVALID_TLB_FIELD 0xFFFFFFFF
 #define NUM_TLB_ENTRIES 0x100000
+#define FAST486_NO_REG 0xFF
 
 typedef struct _FAST486_MOD_REG_RM
 {
@@ -194,6 +195,34 @@ Fast486CallGate
     BOOLEAN Call
 );
 
+#ifndef FAST486_NO_CODE_CACHE
+
+BOOLEAN
+FASTCALL
+Fast486GetCachedModRegRm
+(
+    PFAST486_STATE State,
+    BOOLEAN AddressSize,
+    PFAST486_MOD_REG_RM ModRegRm
+);
+
+VOID
+FASTCALL
+Fast486CacheModRegRm
+(
+    PFAST486_STATE State,
+    ULONG ModRmOffset,
+    BOOLEAN AddressSize,
+    PFAST486_MOD_REG_RM ModRegRm,
+    UCHAR Base,
+    UCHAR Index,
+    UCHAR Scale,
+    LONG Displacement,
+    BOOLEAN DefaultSs
+);
+
+#endif
+
 /* INLINED FUNCTIONS **********************************************************/
 
 #include "common.inl"
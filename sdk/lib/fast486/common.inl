@@ -155,6 +155,173 @@ Fast486FlushTlb(PFAST486_STATE State)
     State->TlbEmpty = TRUE;
 }
 
+FORCEINLINE
+VOID
+FASTCALL
+Fast486ClearCodeCache(PFAST486_STATE State)
+{
+#ifndef FAST486_NO_CODE_CACHE
+    /* Changing the generation invalidates all the blocks at once */
+    if (++State->CodeCacheGeneration == 0)
+    {
+        /* Wrapped around, make sure no old block looks valid */
+        RtlZeroMemory(State->CodeCache, sizeof(State->CodeCache));
+        State->CodeCacheGeneration = 1;
+    }
+
+    /* The prefetch buffer was read from one of them */
+    State->PrefetchValid = FALSE;
+    State->DecodedInst = NULL;
+#else
+    UNREFERENCED_PARAMETER(State);
+#endif
+}
+
+#ifndef FAST486_NO_PREFETCH
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486InvalidateCode(PFAST486_STATE State,
+                      ULONG Address,
+                      ULONG Size)
+{
+#ifndef FAST486_NO_CODE_CACHE
+    ULONG First = Address / FAST486_CACHE_SIZE;
+    ULONG Last = (Address + Size - 1) / FAST486_CACHE_SIZE;
+    PFAST486_CODE_BLOCK Block;
+
+    if ((Last - First) >= FAST486_CODE_CACHE_BLOCKS)
+    {
+        /* Quicker to drop everything */
+        Fast486ClearCodeCache(State);
+        return;
+    }
+
+    do
+    {
+        Block = &State->CodeCache[First & (FAST486_CODE_CACHE_BLOCKS - 1)];
+
+        if (Block->Address == First * FAST486_CACHE_SIZE)
+        {
+            Block->Generation = 0;
+
+            /* The current instruction may be in there */
+            State->DecodedInst = NULL;
+        }
+    }
+    while (First++ != Last);
+#endif
+
+    if (State->PrefetchValid
+        && (Address < State->PrefetchPhysical + FAST486_CACHE_SIZE)
+        && (Address + Size > State->PrefetchPhysical))
+    {
+        /* This may have been written through another mapping */
+        State->PrefetchValid = FALSE;
+    }
+}
+
+#endif
+
+#ifndef FAST486_NO_CODE_CACHE
+
+FORCEINLINE
+BOOLEAN
+FASTCALL
+Fast486FetchDecodedInst(PFAST486_STATE State,
+                        PUCHAR Opcode)
+{
+    PFAST486_SEG_REG CachedDescriptor = &State->SegmentRegs[FAST486_REG_CS];
+    ULONG Offset = (CachedDescriptor->Size) ? State->SavedInstPtr.Long
+                                            : State->SavedInstPtr.LowWord;
+    ULONG PrefetchOffset = CachedDescriptor->Base + Offset - State->PrefetchAddress;
+    PFAST486_DECODED_INST DecodedInst;
+
+    /* The prefetch buffer holds the code of a block */
+    if (!State->PrefetchValid || (PrefetchOffset >= FAST486_CACHE_SIZE))
+    {
+        State->DecodedInst = NULL;
+        return FALSE;
+    }
+
+    /* Remember where this instruction goes, whether it's decoded already or not */
+    DecodedInst = &State->PrefetchBlock->Instructions[PrefetchOffset];
+    State->DecodedInst = DecodedInst;
+    if (DecodedInst->Length == 0) return FALSE;
+
+    /* Skip the prefixes and the opcode */
+    State->PrefixFlags = DecodedInst->PrefixFlags;
+    State->SegmentOverride = DecodedInst->SegmentOverride;
+    *Opcode = DecodedInst->Opcode;
+
+    if (CachedDescriptor->Size) State->InstPtr.Long = Offset + DecodedInst->Length;
+    else State->InstPtr.LowWord = (USHORT)(Offset + DecodedInst->Length);
+
+    return TRUE;
+}
+
+FORCEINLINE
+ULONG
+FASTCALL
+Fast486GetDecodedLength(PFAST486_STATE State)
+{
+    PFAST486_SEG_REG CachedDescriptor = &State->SegmentRegs[FAST486_REG_CS];
+    ULONG Start, Length;
+
+    if (CachedDescriptor->Size)
+    {
+        Start = State->SavedInstPtr.Long;
+        Length = State->InstPtr.Long - Start;
+    }
+    else
+    {
+        Start = State->SavedInstPtr.LowWord;
+        Length = (USHORT)(State->InstPtr.LowWord - Start);
+    }
+
+    /* All the bytes must still be in the prefetch buffer, which is in one block */
+    Start = CachedDescriptor->Base + Start - State->PrefetchAddress;
+    if (!State->PrefetchValid
+        || (Start >= FAST486_CACHE_SIZE)
+        || ((Start + Length) > FAST486_CACHE_SIZE))
+    {
+        return 0;
+    }
+
+    return Length;
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486CacheDecodedInst(PFAST486_STATE State,
+                        UCHAR Opcode)
+{
+    PFAST486_DECODED_INST DecodedInst = State->DecodedInst;
+    ULONG Length;
+
+    if (DecodedInst == NULL) return;
+
+    Length = Fast486GetDecodedLength(State);
+    if (Length == 0)
+    {
+        /* Can't cache it */
+        State->DecodedInst = NULL;
+        return;
+    }
+
+    DecodedInst->PrefixFlags = (UCHAR)State->PrefixFlags;
+    DecodedInst->SegmentOverride = (UCHAR)State->SegmentOverride;
+    DecodedInst->Opcode = Opcode;
+    DecodedInst->Length = (UCHAR)Length;
+
+    /* The operand is cached when it's parsed */
+    DecodedInst->ModRmOffset = 0;
+}
+
+#endif
+
 FORCEINLINE
 BOOLEAN
 FASTCALL
@@ -286,6 +453,11 @@ Fast486WriteLinearMemory(PFAST486_STATE State,
                                     (PVOID)((ULONG_PTR)Buffer + BufferOffset),
                                     PageLength);
 
+#ifndef FAST486_NO_PREFETCH
+            /* Forget the code we may have read from there */
+            Fast486InvalidateCode(State, (TableEntry.Address << 12) | PageOffset, PageLength);
+#endif
+
             BufferOffset += PageLength;
         }
     }
@@ -293,6 +465,11 @@ Fast486WriteLinearMemory(PFAST486_STATE State,
     {
         /* Write the memory */
         State->MemWriteCallback(State, LinearAddress, Buffer, Size);
+
+#ifndef FAST486_NO_PREFETCH
+        /* Forget the code we may have read from there */
+        Fast486InvalidateCode(State, LinearAddress, Size);
+#endif
     }
 
     return TRUE;
@@ -1013,6 +1190,45 @@ Fast486CalculateParity(UCHAR Number)
     return (0x9669 >> ((Number & 0x0F) ^ (Number >> 4))) & 1;
 }
 
+FORCEINLINE
+VOID
+FASTCALL
+Fast486SetModRegRmAddress(PFAST486_STATE State,
+                          BOOLEAN AddressSize,
+                          UCHAR Base,
+                          UCHAR Index,
+                          UCHAR Scale,
+                          LONG Displacement,
+                          BOOLEAN DefaultSs,
+                          PFAST486_MOD_REG_RM ModRegRm)
+{
+    ULONG Address = (ULONG)Displacement;
+
+    if (AddressSize)
+    {
+        if (Base != FAST486_NO_REG) Address += State->GeneralRegs[Base].Long;
+        if (Index != FAST486_NO_REG) Address += State->GeneralRegs[Index].Long << Scale;
+    }
+    else
+    {
+        if (Base != FAST486_NO_REG) Address += State->GeneralRegs[Base].LowWord;
+        if (Index != FAST486_NO_REG) Address += State->GeneralRegs[Index].LowWord;
+
+        /* Clear the top 16 bits */
+        Address &= 0x0000FFFF;
+    }
+
+    ModRegRm->MemoryAddress = Address;
+
+    /* Check if there is no segment override */
+    if (DefaultSs && !(State->PrefixFlags & FAST486_PREFIX_SEG))
+    {
+        /* Add a SS: prefix */
+        State->PrefixFlags |= FAST486_PREFIX_SEG;
+        State->SegmentOverride = FAST486_REG_SS;
+    }
+}
+
 FORCEINLINE
 BOOLEAN
 FASTCALL
@@ -1021,6 +1237,22 @@ Fast486ParseModRegRm(PFAST486_STATE State,
                      PFAST486_MOD_REG_RM ModRegRm)
 {
     UCHAR ModRmByte, Mode, RegMem;
+    UCHAR Base = FAST486_NO_REG, Index = FAST486_NO_REG, Scale = 0;
+    BOOLEAN DefaultSs = FALSE;
+    LONG Displacement = 0;
+#ifndef FAST486_NO_CODE_CACHE
+    PFAST486_DECODED_INST DecodedInst = State->DecodedInst;
+    ULONG ModRmOffset = 0;
+
+    if (DecodedInst != NULL)
+    {
+        /* Check if the operand was parsed before */
+        if (Fast486GetCachedModRegRm(State, AddressSize, ModRegRm)) return TRUE;
+
+        /* Find where the operand starts in the instruction, to cache it */
+        ModRmOffset = Fast486GetDecodedLength(State);
+    }
+#endif
 
     /* Fetch the MOD REG R/M byte */
     if (!Fast486FetchByte(State, &ModRmByte))
@@ -1042,20 +1274,16 @@ Fast486ParseModRegRm(PFAST486_STATE State,
         /* The second operand is also a register */
         ModRegRm->Memory = FALSE;
         ModRegRm->SecondRegister = RegMem;
-
-        /* Done parsing */
-        return TRUE;
+        Base = RegMem;
     }
-
-    /* The second operand is memory */
-    ModRegRm->Memory = TRUE;
-
-    if (AddressSize)
+    else if (AddressSize)
     {
+        /* The second operand is memory */
+        ModRegRm->Memory = TRUE;
+
         if (RegMem == FAST486_REG_ESP)
         {
             UCHAR SibByte;
-            ULONG Scale, Index, Base;
 
             /* Fetch the SIB byte */
             if (!Fast486FetchByte(State, &SibByte))
@@ -1065,62 +1293,40 @@ Fast486ParseModRegRm(PFAST486_STATE State,
             }
 
             /* Unpack the scale, index and base */
-            Scale = 1 << (SibByte >> 6);
+            Scale = SibByte >> 6;
             Index = (SibByte >> 3) & 0x07;
-            if (Index != FAST486_REG_ESP) Index = State->GeneralRegs[Index].Long;
-            else Index = 0;
+            if (Index == FAST486_REG_ESP) Index = FAST486_NO_REG;
 
             if (((SibByte & 0x07) != FAST486_REG_EBP) || (Mode != 0))
             {
                 /* Use the register a base */
-                Base = State->GeneralRegs[SibByte & 0x07].Long;
+                Base = SibByte & 0x07;
             }
             else
             {
                 /* Fetch the base */
-                if (!Fast486FetchDword(State, &Base))
+                if (!Fast486FetchDword(State, (PULONG)&Displacement))
                 {
                     /* Exception occurred */
                     return FALSE;
                 }
             }
 
-            if (((SibByte & 0x07) == FAST486_REG_ESP)
-                || ((SibByte & 0x07) == FAST486_REG_EBP && Mode != 0))
-            {
-                /* Check if there is no segment override */
-                if (!(State->PrefixFlags & FAST486_PREFIX_SEG))
-                {
-                    /* Add a SS: prefix */
-                    State->PrefixFlags |= FAST486_PREFIX_SEG;
-                    State->SegmentOverride = FAST486_REG_SS;
-                }
-            }
-
-            /* Calculate the address */
-            ModRegRm->MemoryAddress = Base + Index * Scale;
+            /* The default segment is SS for ESP and EBP */
+            DefaultSs = (Base == FAST486_REG_ESP) || (Base == FAST486_REG_EBP);
         }
         else if (RegMem == FAST486_REG_EBP)
         {
-            if (Mode) ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_EBP].Long;
-            else ModRegRm->MemoryAddress = 0;
+            if (Mode)
+            {
+                Base = FAST486_REG_EBP;
+                DefaultSs = TRUE;
+            }
         }
         else
         {
             /* Get the base from the register */
-            ModRegRm->MemoryAddress = State->GeneralRegs[RegMem].Long;
-        }
-
-        /* Check if there is no segment override */
-        if (!(State->PrefixFlags & FAST486_PREFIX_SEG))
-        {
-            /* Check if the default segment should be SS */
-            if ((RegMem == FAST486_REG_EBP) && Mode)
-            {
-                /* Add a SS: prefix */
-                State->PrefixFlags |= FAST486_PREFIX_SEG;
-                State->SegmentOverride = FAST486_REG_SS;
-            }
+            Base = RegMem;
         }
 
         if (Mode == 1)
@@ -1135,71 +1341,71 @@ Fast486ParseModRegRm(PFAST486_STATE State,
             }
 
             /* Add the signed offset to the address */
-            ModRegRm->MemoryAddress += (LONG)Offset;
+            Displacement = (LONG)Offset;
         }
         else if ((Mode == 2) || ((Mode == 0) && (RegMem == FAST486_REG_EBP)))
         {
-            LONG Offset;
-
             /* Fetch the dword */
-            if (!Fast486FetchDword(State, (PULONG)&Offset))
+            if (!Fast486FetchDword(State, (PULONG)&Displacement))
             {
                 /* Exception occurred */
                 return FALSE;
             }
-
-            /* Add the signed offset to the address */
-            ModRegRm->MemoryAddress += Offset;
         }
     }
     else
     {
+        /* The second operand is memory */
+        ModRegRm->Memory = TRUE;
+
         /* Check the operand */
         switch (RegMem)
         {
             case 0:
             {
                 /* [BX + SI] */
-                ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_EBX].LowWord
-                                           + State->GeneralRegs[FAST486_REG_ESI].LowWord;
+                Base = FAST486_REG_EBX;
+                Index = FAST486_REG_ESI;
                 break;
             }
 
             case 1:
             {
                 /* [BX + DI] */
-                ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_EBX].LowWord
-                                           + State->GeneralRegs[FAST486_REG_EDI].LowWord;
+                Base = FAST486_REG_EBX;
+                Index = FAST486_REG_EDI;
                 break;
             }
 
             case 2:
             {
                 /* SS:[BP + SI] */
-                ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_EBP].LowWord
-                                           + State->GeneralRegs[FAST486_REG_ESI].LowWord;
+                Base = FAST486_REG_EBP;
+                Index = FAST486_REG_ESI;
+                DefaultSs = TRUE;
                 break;
             }
 
             case 3:
             {
                 /* SS:[BP + DI] */
-                ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_EBP].LowWord
-                                           + State->GeneralRegs[FAST486_REG_EDI].LowWord;
+                Base = FAST486_REG_EBP;
+                Index = FAST486_REG_EDI;
+                DefaultSs = TRUE;
                 break;
             }
 
             case 4:
             {
                 /* [SI] */
-                ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_ESI].LowWord;
+                Base = FAST486_REG_ESI;
                 break;
             }
 
             case 5:
             {
                 /* [DI] */
-                ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_EDI].LowWord;
+                Base = FAST486_REG_EDI;
                 break;
             }
 
@@ -1207,38 +1413,23 @@ Fast486ParseModRegRm(PFAST486_STATE State,
             {
                 if (Mode)
                 {
-                    /* [BP] */
-                    ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_EBP].LowWord;
-                }
-                else
-                {
-                    /* [constant] (added later) */
-                    ModRegRm->MemoryAddress = 0;
+                    /* SS:[BP] */
+                    Base = FAST486_REG_EBP;
+                    DefaultSs = TRUE;
                 }
 
+                /* Otherwise [constant] (added later) */
                 break;
             }
 
             case 7:
             {
                 /* [BX] */
-                ModRegRm->MemoryAddress = State->GeneralRegs[FAST486_REG_EBX].LowWord;
+                Base = FAST486_REG_EBX;
                 break;
             }
         }
 
-        /* Check if there is no segment override */
-        if (!(State->PrefixFlags & FAST486_PREFIX_SEG))
-        {
-            /* Check if the default segment should be SS */
-            if ((RegMem == 2) || (RegMem == 3) || ((RegMem == 6) && Mode))
-            {
-                /* Add a SS: prefix */
-                State->PrefixFlags |= FAST486_PREFIX_SEG;
-                State->SegmentOverride = FAST486_REG_SS;
-            }
-        }
-
         if (Mode == 1)
         {
             CHAR Offset;
@@ -1251,7 +1442,7 @@ Fast486ParseModRegRm(PFAST486_STATE State,
             }
 
             /* Add the signed offset to the address */
-            ModRegRm->MemoryAddress += (LONG)Offset;
+            Displacement = (LONG)Offset;
         }
         else if ((Mode == 2) || ((Mode == 0) && (RegMem == 6)))
         {
@@ -1265,11 +1456,37 @@ Fast486ParseModRegRm(PFAST486_STATE State,
             }
 
             /* Add the signed offset to the address */
-            ModRegRm->MemoryAddress += (LONG)Offset;
+            Displacement = (LONG)Offset;
         }
+    }
 
-        /* Clear the top 16 bits */
-        ModRegRm->MemoryAddress &= 0x0000FFFF;
+#ifndef FAST486_NO_CODE_CACHE
+    if (ModRmOffset != 0)
+    {
+        /* Cache the form of the operand */
+        Fast486CacheModRegRm(State,
+                             ModRmOffset,
+                             AddressSize,
+                             ModRegRm,
+                             Base,
+                             Index,
+                             Scale,
+                             Displacement,
+                             DefaultSs);
+    }
+#endif
+
+    if (ModRegRm->Memory)
+    {
+        /* Calculate the address */
+        Fast486SetModRegRmAddress(State,
+                                  AddressSize,
+                                  Base,
+                                  Index,
+                                  Scale,
+                                  Displacement,
+                                  DefaultSs,
+                                  ModRegRm);
     }
 
     return TRUE;
@@ -52,6 +52,9 @@ Fast486ExecutionControl(PFAST486_STATE State, FAST486_EXEC_CMD Command)
     FAST486_OPCODE_HANDLER_PROC CurrentHandler;
     INT ProcedureCallCount = 0;
     BOOLEAN Trap;
+#ifndef FAST486_NO_CODE_CACHE
+    BOOLEAN Decoded;
+#endif
 
     /* Main execution loop */
     do
@@ -68,25 +71,59 @@ NextInst:
                 State->SavedStackPtr = State->GeneralRegs[FAST486_REG_ESP];
             }
 
-            /* Perform an instruction fetch */
-            if (!Fast486FetchByte(State, &Opcode))
+#ifndef FAST486_NO_CODE_CACHE
+            /* Check if the prefixes and the opcode were decoded already */
+            Decoded = (State->PrefixFlags == 0) && Fast486FetchDecodedInst(State, &Opcode);
+            if (!Decoded)
+#endif
+            {
+                /* Perform an instruction fetch */
+                if (!Fast486FetchByte(State, &Opcode))
+                {
+                    /* Exception occurred */
+                    State->PrefixFlags = 0;
+                    continue;
+                }
+
+#ifndef FAST486_NO_CODE_CACHE
+                /* The fetch may have moved the prefetch buffer there, check again */
+                if ((State->PrefixFlags == 0) && (State->DecodedInst == NULL))
+                {
+                    Decoded = Fast486FetchDecodedInst(State, &Opcode);
+                }
+#endif
+            }
+
+#ifndef FAST486_NO_CODE_CACHE
+            if (Decoded)
             {
-                /* Exception occurred */
+                /* Call the opcode handler, this is never a prefix */
+                Fast486OpcodeHandlers[Opcode](State, Opcode);
+
+                /* Reset the prefix flags */
                 State->PrefixFlags = 0;
-                continue;
             }
+            else
+#endif
+            {
+                // TODO: Check for CALL/RET to update ProcedureCallCount.
 
-            // TODO: Check for CALL/RET to update ProcedureCallCount.
+                /* Call the opcode handler */
+                CurrentHandler = Fast486OpcodeHandlers[Opcode];
 
-            /* Call the opcode handler */
-            CurrentHandler = Fast486OpcodeHandlers[Opcode];
-            CurrentHandler(State, Opcode);
+#ifndef FAST486_NO_CODE_CACHE
+                /* Cache the decoded instruction before it starts executing */
+                if (CurrentHandler != Fast486OpcodePrefix) Fast486CacheDecodedInst(State, Opcode);
+#endif
 
-            /* If this is a prefix, go to the next instruction immediately */
-            if (CurrentHandler == Fast486OpcodePrefix) goto NextInst;
+                CurrentHandler(State, Opcode);
 
-            /* A non-prefix opcode has been executed, reset the prefix flags */
-            State->PrefixFlags = 0;
+                /* If this is a prefix, go to the next instruction immediately */
+                if (CurrentHandler == Fast486OpcodePrefix) goto NextInst;
+
+                /* A non-prefix opcode has been executed, reset the prefix flags */
+                State->PrefixFlags = 0;
+            }
         }
 
         /*
@@ -638,6 +638,7 @@ FAST486_OPCODE_HANDLER(Fast486ExtOpcodeLoadControlReg)
 #ifndef FAST486_NO_PREFETCH
     /* Changing CR0 or CR3 can interfere with prefetching (because of paging) */
     State->PrefetchValid = FALSE;
+    State->PrefetchPageValid = FALSE;
 #endif
 
     if (ModRegRm.Register == (INT)FAST486_REG_CR3)
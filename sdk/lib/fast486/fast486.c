@@ -198,6 +198,11 @@ Fast486Reset(PFAST486_STATE State)
 
     /* Flush the TLB */
     Fast486FlushTlb(State);
+
+#ifndef FAST486_NO_CODE_CACHE
+    /* All the blocks are invalid */
+    State->CodeCacheGeneration = 1;
+#endif
 }
 
 VOID
@@ -260,4 +265,34 @@ Fast486Rewind(PFAST486_STATE State)
 #endif
 }
 
+VOID
+NTAPI
+Fast486FlushCodeCache(PFAST486_STATE State)
+{
+#ifndef FAST486_NO_PREFETCH
+    /* The page tables may have changed too */
+    State->PrefetchValid = FALSE;
+    State->PrefetchPageValid = FALSE;
+#endif
+
+    /* Call the internal function */
+    Fast486ClearCodeCache(State);
+}
+
+VOID
+NTAPI
+Fast486InvalidateCodeRange(PFAST486_STATE State, ULONG Address, ULONG Size)
+{
+#ifndef FAST486_NO_PREFETCH
+    if (Size == 0) return;
+
+    /* Call the internal function */
+    Fast486InvalidateCode(State, Address, Size);
+#else
+    UNREFERENCED_PARAMETER(State);
+    UNREFERENCED_PARAMETER(Address);
+    UNREFERENCED_PARAMETER(Size);
+#endif
+}
+
 /* EOF */
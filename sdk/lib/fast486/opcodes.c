@@ -4148,6 +4148,12 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeLdsLes)
             /* Call the BOP handler */
             State->BopCallback(State, BopCode);
 
+            /*
+             * It can also have modified code, possibly after running guest
+             * code of its own, so the code cache is dropped afterwards.
+             */
+            Fast486ClearCodeCache(State);
+
             /*
              * If an interrupt should occur at this time, delay it.
              * We must do this because if an interrupt begins and the BOP callback
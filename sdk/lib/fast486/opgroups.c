@@ -2262,6 +2262,7 @@ FAST486_OPCODE_HANDLER(Fast486ExtOpcodeGroup0F01)
 #ifndef FAST486_NO_PREFETCH
             /* Invalidate the prefetch */
             State->PrefetchValid = FALSE;
+            State->PrefetchPageValid = FALSE;
 #endif
 
             /* This is a privileged instruction */
@@ -20,6 +20,8 @@
 #define COMPRESSION_FORMAT_MASK  0x00FF
 #define COMPRESSION_ENGINE_MASK  0xFF00
 
+#define TAG_RTL_XPRESS           'pXlR'
+
 
 
 
@@ -27,12 +29,55 @@
 
 /* Based on Wine Staging */
 
+/* copy a backwards reference, source and destination may overlap */
+static inline VOID lznt1_copy_match(UCHAR *dst_cur, ULONG displacement, ULONG length)
+{
+    const UCHAR *src_cur = dst_cur - displacement;
+
+    /* copies are done front to back, so a block is safe to move at once
+     * as long as it doesn't reach into the bytes it produces */
+    if (displacement >= 8 && length >= 4 && length <= 16)
+    {
+        /* short references are covered exactly by two blocks overlapping each other */
+        if (length >= 8)
+        {
+            memcpy(dst_cur, src_cur, 8);
+            memcpy(dst_cur + length - 8, src_cur + length - 8, 8);
+        }
+        else
+        {
+            memcpy(dst_cur, src_cur, 4);
+            memcpy(dst_cur + length - 4, src_cur + length - 4, 4);
+        }
+        return;
+    }
+
+    if (displacement >= 16)
+    {
+        for (; length >= 16; length -= 16, src_cur += 16, dst_cur += 16)
+            memcpy(dst_cur, src_cur, 16);
+    }
+    else if (displacement >= 8)
+    {
+        for (; length >= 8; length -= 8, src_cur += 8, dst_cur += 8)
+            memcpy(dst_cur, src_cur, 8);
+    }
+    else if (displacement == 1)
+    {
+        memset(dst_cur, *src_cur, length);
+        return;
+    }
+
+    while (length--)
+        *dst_cur++ = *src_cur++;
+}
+
 /* decompress a single LZNT1 chunk */
 static PUCHAR lznt1_decompress_chunk(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size)
 {
     UCHAR *src_cur, *src_end, *dst_cur, *dst_end;
-    ULONG displacement_bits, length_bits;
-    ULONG code_displacement, code_length;
+    ULONG displacement_bits, length_bits, length_mask;
+    ULONG code_displacement, code_length, literals;
     WORD flags, code;
 
     src_cur = src;
@@ -40,14 +85,73 @@ static PUCHAR lznt1_decompress_chunk(UCHAR *dst, ULONG dst_size, UCHAR *src, ULO
     dst_cur = dst;
     dst_end = dst + dst_size;
 
+    /* the displacement field grows with the amount of data already decompressed,
+     * from 4 bits (up to 16 bytes) to 12 bits (more than 2048 bytes) */
+    displacement_bits = 4;
+    length_bits       = 12;
+    length_mask       = (1 << length_bits) - 1;
+
     /* Partial decompression is no error on Windows. */
     while (src_cur < src_end && dst_cur < dst_end)
     {
-        /* read flags header */
-        flags = 0x8000 | *src_cur++;
+        /* read flags header, the extra bit marks the end of the group */
+        flags = 0x100 | *src_cur++;
+
+        /* Fast path, when the input holds this group and two more complete ones:
+         * those produce at least 16 more bytes, so blocks can be copied past the
+         * current position, the excess is always overwritten by following data. */
+        if (src_end - src_cur >= 3 * 8 * sizeof(WORD) + 2)
+        {
+            while (dst_end - dst_cur >= 24)
+            {
+                /* uncompressed data, up to the next backwards reference */
+                BitScanForward(&literals, flags);
+                memcpy(dst_cur, src_cur, 8);
+                src_cur += literals;
+                dst_cur += literals;
+                flags >>= literals;
+                if (flags == 1) break;
+
+                /* backwards reference */
+                code = *(WORD *)src_cur;
+                src_cur += sizeof(WORD);
+
+                while (displacement_bits < 12 && dst_cur - dst > (1 << displacement_bits))
+                {
+                    displacement_bits++;
+                    length_bits--;
+                    length_mask >>= 1;
+                }
+                code_length       = (code & length_mask) + 3;
+                code_displacement = (code >> length_bits) + 1;
+
+                /* ensure reference is valid */
+                if (dst_cur < dst + code_displacement)
+                    return NULL;
+
+                if (code_length <= 16 && code_displacement >= 8)
+                {
+                    memcpy(dst_cur, dst_cur - code_displacement, 8);
+                    memcpy(dst_cur + 8, dst_cur + 8 - code_displacement, 8);
+                }
+                else if (code_length > dst_end - dst_cur)
+                {
+                    lznt1_copy_match(dst_cur, code_displacement, dst_end - dst_cur);
+                    return dst_end;
+                }
+                else
+                {
+                    lznt1_copy_match(dst_cur, code_displacement, code_length);
+                }
+                dst_cur += code_length;
+                flags >>= 1;
+            }
+
+            /* finish the group with exact copies when close to the end of the output */
+        }
 
-        /* parse following 8 entities, either uncompressed data or backwards reference */
-        while ((flags & 0xFF00) && src_cur < src_end)
+        /* parse following entities, either uncompressed data or backwards reference */
+        while (flags != 1 && src_cur < src_end)
         {
             if (flags & 1)
             {
@@ -58,24 +162,27 @@ static PUCHAR lznt1_decompress_chunk(UCHAR *dst, ULONG dst_size, UCHAR *src, ULO
                 src_cur += sizeof(WORD);
 
                 /* find length / displacement bits */
-                for (displacement_bits = 12; displacement_bits > 4; displacement_bits--)
-                    if ((1 << (displacement_bits - 1)) < dst_cur - dst) break;
-                length_bits       = 16 - displacement_bits;
-                code_length       = (code & ((1 << length_bits) - 1)) + 3;
+                while (displacement_bits < 12 && dst_cur - dst > (1 << displacement_bits))
+                {
+                    displacement_bits++;
+                    length_bits--;
+                    length_mask >>= 1;
+                }
+                code_length       = (code & length_mask) + 3;
                 code_displacement = (code >> length_bits) + 1;
 
                 /* ensure reference is valid */
                 if (dst_cur < dst + code_displacement)
                     return NULL;
 
-                /* copy bytes of chunk - we can't use memcpy()
-                 * since source and dest can be overlapping */
-                while (code_length--)
+                /* stop at the end of the output */
+                if (code_length > dst_end - dst_cur)
                 {
-                    if (dst_cur >= dst_end) return dst_cur;
-                    *dst_cur = *(dst_cur - code_displacement);
-                    dst_cur++;
+                    lznt1_copy_match(dst_cur, code_displacement, dst_end - dst_cur);
+                    return dst_end;
                 }
+                lznt1_copy_match(dst_cur, code_displacement, code_length);
+                dst_cur += code_length;
             }
             else
             {
@@ -270,6 +377,871 @@ RtlpWorkSpaceSizeLZNT1(USHORT Engine,
 }
 
 
+/* XPRESS (plain LZ77) and XPRESS Huffman (LZ77+Huffman), see [MS-XCA] */
+
+#define XPRESS_MIN_MATCH            3
+#define XPRESS_HASH_BITS            13
+#define XPRESS_HASH_SIZE            (1 << XPRESS_HASH_BITS)
+#define XPRESS_MAX_CHAIN            64
+
+#define XPRESS_LZ_WINDOW            0x2000
+#define XPRESS_LZ_MAX_MATCH         0xFFFF
+
+#define XPRESS_HUFF_WINDOW          0x10000
+#define XPRESS_HUFF_CHUNK           0x10000
+#define XPRESS_HUFF_MAX_MATCH       (0x7FFF + XPRESS_MIN_MATCH)
+#define XPRESS_HUFF_SYMBOLS         512
+#define XPRESS_HUFF_EOF_SYMBOL      256
+#define XPRESS_HUFF_MAX_BITS        15
+#define XPRESS_HUFF_TABLE_BITS      11
+#define XPRESS_HUFF_TABLE_SIZE      (XPRESS_HUFF_SYMBOLS / 2)
+
+#define XPRESS_HUFF_MATCH_TOKEN     0x80000000
+
+typedef struct _XPRESS_MATCH_FINDER
+{
+    PULONG Head;
+    PUSHORT Chain;
+    ULONG Window;
+    ULONG MaxChain;
+} XPRESS_MATCH_FINDER, *PXPRESS_MATCH_FINDER;
+
+typedef struct _XPRESS_HUFF_ENCODER
+{
+    ULONG Tokens[XPRESS_HUFF_CHUNK];
+    ULONG Frequencies[XPRESS_HUFF_SYMBOLS];
+    ULONG Sorted[XPRESS_HUFF_SYMBOLS];
+    USHORT Codes[XPRESS_HUFF_SYMBOLS];
+    UCHAR Lengths[XPRESS_HUFF_SYMBOLS];
+} XPRESS_HUFF_ENCODER, *PXPRESS_HUFF_ENCODER;
+
+typedef struct _XPRESS_HUFF_DECODER
+{
+    USHORT Table[1 << XPRESS_HUFF_TABLE_BITS];
+    USHORT Sorted[XPRESS_HUFF_SYMBOLS];
+    USHORT Count[XPRESS_HUFF_MAX_BITS + 1];
+    USHORT First[XPRESS_HUFF_MAX_BITS + 1];
+    USHORT Index[XPRESS_HUFF_MAX_BITS + 1];
+    UCHAR Lengths[XPRESS_HUFF_SYMBOLS];
+} XPRESS_HUFF_DECODER, *PXPRESS_HUFF_DECODER;
+
+/* size of the match finder, depending on the engine: the standard one only
+ * probes the last position with the same hash, the maximum one walks chains */
+#define XPRESS_FINDER_SIZE(max, window) \
+    (XPRESS_HASH_SIZE * sizeof(ULONG) + ((max) ? (window) * sizeof(USHORT) : 0))
+
+static inline ULONG xpress_hash(const UCHAR *p)
+{
+    return ((p[0] | (p[1] << 8) | (p[2] << 16)) * 2654435761U) >> (32 - XPRESS_HASH_BITS);
+}
+
+static VOID xpress_init_finder(PXPRESS_MATCH_FINDER finder, UCHAR *workspace,
+                               BOOLEAN maximum, ULONG window)
+{
+    finder->Head = (PULONG)workspace;
+    finder->Chain = maximum ? (PUSHORT)(workspace + XPRESS_HASH_SIZE * sizeof(ULONG)) : NULL;
+    finder->Window = window;
+    finder->MaxChain = maximum ? XPRESS_MAX_CHAIN : 1;
+    memset(finder->Head, 0, XPRESS_HASH_SIZE * sizeof(ULONG));
+}
+
+/* record position pos (relative to src) in the match finder */
+static inline VOID xpress_insert(PXPRESS_MATCH_FINDER finder, const UCHAR *src, ULONG pos)
+{
+    ULONG hash = xpress_hash(src + pos);
+    ULONG prev = finder->Head[hash];
+
+    if (finder->Chain)
+    {
+        /* chain entries store the distance to the previous position with the same hash */
+        finder->Chain[pos & (finder->Window - 1)] =
+            (prev && pos + 1 - prev < finder->Window) ? (USHORT)(pos + 1 - prev) : 0;
+    }
+    finder->Head[hash] = pos + 1;
+}
+
+/* find the longest match for position pos, limited to max_length bytes */
+static ULONG xpress_find_match(PXPRESS_MATCH_FINDER finder, const UCHAR *src, ULONG pos,
+                               ULONG max_length, ULONG *offset)
+{
+    ULONG candidate, length, best_length = 0, chain = finder->MaxChain;
+    const UCHAR *cur = src + pos;
+
+    candidate = finder->Head[xpress_hash(cur)];
+    while (candidate && chain--)
+    {
+        candidate--;
+        if (pos - candidate >= finder->Window)
+            break;
+
+        if (src[candidate + best_length] == cur[best_length] &&
+            src[candidate] == cur[0] && src[candidate + 1] == cur[1])
+        {
+            for (length = 0; length < max_length && src[candidate + length] == cur[length]; length++);
+            if (length > best_length)
+            {
+                best_length = length;
+                *offset = pos - candidate;
+                if (length == max_length)
+                    break;
+            }
+        }
+
+        if (!finder->Chain || !finder->Chain[candidate & (finder->Window - 1)])
+            break;
+        candidate -= finder->Chain[candidate & (finder->Window - 1)] - 1;
+    }
+
+    return best_length >= XPRESS_MIN_MATCH ? best_length : 0;
+}
+
+/* compress data with plain LZ77 */
+static NTSTATUS xpress_compress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                                ULONG *final_size, UCHAR *workspace, BOOLEAN maximum)
+{
+    XPRESS_MATCH_FINDER finder;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    UCHAR *flags_pos, *nibble_pos = NULL;
+    ULONG flags = 0, flag_count = 0;
+    ULONG pos = 0, length, extra, offset, i;
+    USHORT code;
+
+    if (!workspace) return STATUS_INVALID_PARAMETER;
+    xpress_init_finder(&finder, workspace, maximum, XPRESS_LZ_WINDOW);
+
+    if (dst_size < sizeof(ULONG))
+        return STATUS_BUFFER_TOO_SMALL;
+    flags_pos = dst_cur;
+    dst_cur += sizeof(ULONG);
+
+    while (pos < src_size)
+    {
+        length = 0;
+        if (src_size - pos >= XPRESS_MIN_MATCH)
+        {
+            length = xpress_find_match(&finder, src, pos, min(src_size - pos, XPRESS_LZ_MAX_MATCH), &offset);
+        }
+
+        if (!length)
+        {
+            /* literal */
+            if (dst_cur >= dst_end)
+                return STATUS_BUFFER_TOO_SMALL;
+            *dst_cur++ = src[pos];
+            if (src_size - pos >= XPRESS_MIN_MATCH)
+                xpress_insert(&finder, src, pos);
+            pos++;
+            flags <<= 1;
+        }
+        else
+        {
+            /* match: 13 bits of offset, 3 bits of length, then extra length */
+            if (dst_cur + sizeof(WORD) > dst_end)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            code = (USHORT)((offset - 1) << 3);
+            extra = length - XPRESS_MIN_MATCH;
+            if (extra < 7)
+            {
+                *(WORD *)dst_cur = code | extra;
+                dst_cur += sizeof(WORD);
+            }
+            else
+            {
+                *(WORD *)dst_cur = code | 7;
+                dst_cur += sizeof(WORD);
+                extra -= 7;
+
+                /* the first match of a pair stores its length in the low nibble
+                 * of a shared byte, the second one in the high nibble */
+                if (!nibble_pos)
+                {
+                    if (dst_cur >= dst_end)
+                        return STATUS_BUFFER_TOO_SMALL;
+                    nibble_pos = dst_cur++;
+                    *nibble_pos = (UCHAR)min(extra, 15);
+                }
+                else
+                {
+                    *nibble_pos |= (UCHAR)(min(extra, 15) << 4);
+                    nibble_pos = NULL;
+                }
+
+                if (extra >= 15)
+                {
+                    extra -= 15;
+                    if (extra < 255)
+                    {
+                        if (dst_cur >= dst_end)
+                            return STATUS_BUFFER_TOO_SMALL;
+                        *dst_cur++ = (UCHAR)extra;
+                    }
+                    else
+                    {
+                        if (dst_cur + 1 + sizeof(WORD) > dst_end)
+                            return STATUS_BUFFER_TOO_SMALL;
+                        *dst_cur++ = 255;
+                        *(WORD *)dst_cur = (WORD)(length - XPRESS_MIN_MATCH);
+                        dst_cur += sizeof(WORD);
+                    }
+                }
+            }
+
+            for (i = 0; i < length; i++)
+            {
+                if (src_size - (pos + i) >= XPRESS_MIN_MATCH)
+                    xpress_insert(&finder, src, pos + i);
+            }
+            pos += length;
+            flags = (flags << 1) | 1;
+        }
+
+        if (++flag_count == 32)
+        {
+            *(DWORD *)flags_pos = flags;
+            flag_count = 0;
+            if (dst_cur + sizeof(ULONG) > dst_end)
+                return STATUS_BUFFER_TOO_SMALL;
+            flags_pos = dst_cur;
+            dst_cur += sizeof(ULONG);
+        }
+    }
+
+    /* terminate with a match flag not followed by any match */
+    flags = (flag_count ? flags << (32 - flag_count) : 0) | (1U << (31 - flag_count));
+    *(DWORD *)flags_pos = flags;
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+/* decompress data encoded with plain LZ77 */
+static NTSTATUS xpress_decompress(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                                  ULONG *final_size)
+{
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    UCHAR *nibble_pos = NULL;
+    ULONG flags = 0, flag_count = 0;
+    ULONG length, offset;
+    WORD code;
+
+    while (dst_cur < dst_end)
+    {
+        if (!flag_count)
+        {
+            if (src_cur + sizeof(DWORD) > src_end)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+            flags = *(DWORD *)src_cur;
+            src_cur += sizeof(DWORD);
+            flag_count = 32;
+        }
+        flag_count--;
+
+        if (!(flags & (1U << flag_count)))
+        {
+            /* literal */
+            if (src_cur >= src_end)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+            *dst_cur++ = *src_cur++;
+            continue;
+        }
+
+        /* match, or end of stream */
+        if (src_cur == src_end)
+            break;
+        if (src_cur + sizeof(WORD) > src_end)
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        code = *(WORD *)src_cur;
+        src_cur += sizeof(WORD);
+
+        length = code & 7;
+        offset = (code >> 3) + 1;
+        if (length == 7)
+        {
+            if (!nibble_pos)
+            {
+                if (src_cur >= src_end)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                nibble_pos = src_cur++;
+                length = *nibble_pos & 0xF;
+            }
+            else
+            {
+                length = *nibble_pos >> 4;
+                nibble_pos = NULL;
+            }
+
+            if (length == 15)
+            {
+                if (src_cur >= src_end)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                length = *src_cur++;
+                if (length == 255)
+                {
+                    if (src_cur + sizeof(WORD) > src_end)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length = *(WORD *)src_cur;
+                    src_cur += sizeof(WORD);
+                    if (!length)
+                    {
+                        if (src_cur + sizeof(DWORD) > src_end)
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+                        length = *(DWORD *)src_cur;
+                        src_cur += sizeof(DWORD);
+                    }
+                    if (length < 15 + 7)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length -= 15 + 7;
+                }
+                length += 15;
+            }
+            length += 7;
+        }
+        length += XPRESS_MIN_MATCH;
+
+        if (dst_cur - dst < offset)
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        /* source and destination can overlap, copy bytewise */
+        length = min(length, dst_end - dst_cur);
+        while (length--)
+        {
+            *dst_cur = *(dst_cur - offset);
+            dst_cur++;
+        }
+    }
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+/* compute Huffman code lengths limited to XPRESS_HUFF_MAX_BITS */
+static VOID xpress_huff_build_lengths(PXPRESS_HUFF_ENCODER encoder)
+{
+    ULONG *freq = encoder->Frequencies, *sorted = encoder->Sorted;
+    ULONG n, i, j, gap, sym, root, leaf, next, avail, used, depth;
+    ULONG values[XPRESS_HUFF_SYMBOLS];
+
+    for (;;)
+    {
+        /* sort the used symbols by increasing frequency */
+        for (n = 0, sym = 0; sym < XPRESS_HUFF_SYMBOLS; sym++)
+        {
+            encoder->Lengths[sym] = 0;
+            if (freq[sym]) sorted[n++] = sym;
+        }
+        for (gap = n / 2; gap > 0; gap /= 2)
+        {
+            for (i = gap; i < n; i++)
+            {
+                sym = sorted[i];
+                for (j = i; j >= gap && freq[sorted[j - gap]] > freq[sym]; j -= gap)
+                    sorted[j] = sorted[j - gap];
+                sorted[j] = sym;
+            }
+        }
+
+        /* in-place minimum redundancy code computation (Moffat & Katajainen) */
+        for (i = 0; i < n; i++) values[i] = freq[sorted[i]];
+        values[0] += values[1];
+        for (root = 0, leaf = 2, next = 1; next < n - 1; next++)
+        {
+            if (leaf >= n || values[root] < values[leaf])
+            {
+                values[next] = values[root];
+                values[root++] = next;
+            }
+            else
+                values[next] = values[leaf++];
+
+            if (leaf >= n || (root < next && values[root] < values[leaf]))
+            {
+                values[next] += values[root];
+                values[root++] = next;
+            }
+            else
+                values[next] += values[leaf++];
+        }
+        values[n - 2] = 0;
+        for (next = n - 2; next-- > 0;)
+            values[next] = values[values[next]] + 1;
+        for (avail = 1, used = 0, depth = 0, root = n - 1, next = n; avail > 0; depth++)
+        {
+            while (root > 0 && values[root - 1] == depth) { used++; root--; }
+            while (avail > used) { values[--next] = depth; avail--; }
+            avail = 2 * used;
+            used = 0;
+        }
+
+        if (values[0] <= XPRESS_HUFF_MAX_BITS)
+            break;
+
+        /* codes too long, flatten the distribution and try again */
+        for (sym = 0; sym < XPRESS_HUFF_SYMBOLS; sym++)
+            if (freq[sym]) freq[sym] = (freq[sym] >> 1) | 1;
+    }
+
+    for (i = 0; i < n; i++)
+        encoder->Lengths[sorted[i]] = (UCHAR)values[i];
+}
+
+/* assign canonical codes: by increasing length, then by increasing symbol */
+static VOID xpress_huff_build_codes(const UCHAR *lengths, USHORT *codes)
+{
+    USHORT count[XPRESS_HUFF_MAX_BITS + 1] = {0}, next[XPRESS_HUFF_MAX_BITS + 1];
+    ULONG sym, bits, code = 0;
+
+    for (sym = 0; sym < XPRESS_HUFF_SYMBOLS; sym++)
+        count[lengths[sym]]++;
+    count[0] = 0;
+    for (bits = 1; bits <= XPRESS_HUFF_MAX_BITS; bits++)
+    {
+        code = (code + count[bits - 1]) << 1;
+        next[bits] = (USHORT)code;
+    }
+    for (sym = 0; sym < XPRESS_HUFF_SYMBOLS; sym++)
+        if (lengths[sym]) codes[sym] = next[lengths[sym]]++;
+}
+
+typedef struct _XPRESS_BIT_WRITER
+{
+    UCHAR *dst_cur, *dst_end;
+    UCHAR *slot1, *slot2;
+    ULONG bits, count;
+    BOOLEAN overflow;
+} XPRESS_BIT_WRITER;
+
+/* bits are written by 16-bit words, two of them being reserved in advance so
+ * that bytes written in between land where the decoder will read them */
+static inline VOID xpress_write_bits(XPRESS_BIT_WRITER *writer, ULONG value, ULONG count)
+{
+    writer->bits = (writer->bits << count) | value;
+    writer->count += count;
+    if (writer->count > 16)
+    {
+        writer->count -= 16;
+        *(WORD *)writer->slot1 = (WORD)(writer->bits >> writer->count);
+        writer->slot1 = writer->slot2;
+        writer->slot2 = writer->dst_cur;
+        if (writer->dst_cur + sizeof(WORD) > writer->dst_end)
+        {
+            writer->overflow = TRUE;
+            writer->slot2 = writer->dst_end - sizeof(WORD);
+        }
+        else
+            writer->dst_cur += sizeof(WORD);
+    }
+}
+
+static inline VOID xpress_write_byte(XPRESS_BIT_WRITER *writer, UCHAR value)
+{
+    if (writer->dst_cur >= writer->dst_end)
+        writer->overflow = TRUE;
+    else
+        *writer->dst_cur++ = value;
+}
+
+static inline ULONG xpress_log2(ULONG value)
+{
+    ULONG bits = 0;
+    while (value >>= 1) bits++;
+    return bits;
+}
+
+/* compress data with LZ77+Huffman */
+static NTSTATUS xpress_huff_compress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                                     ULONG *final_size, UCHAR *workspace, BOOLEAN maximum)
+{
+    PXPRESS_HUFF_ENCODER encoder = (PXPRESS_HUFF_ENCODER)workspace;
+    XPRESS_MATCH_FINDER finder;
+    XPRESS_BIT_WRITER writer;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    ULONG pos = 0, chunk_end, token_count, token, length, offset, sym, bits, i;
+    BOOLEAN last;
+
+    if (!workspace) return STATUS_INVALID_PARAMETER;
+    xpress_init_finder(&finder, workspace + sizeof(*encoder), maximum, XPRESS_HUFF_WINDOW);
+
+    do
+    {
+        /* parse the chunk and count symbols */
+        chunk_end = pos + min(src_size - pos, XPRESS_HUFF_CHUNK);
+        last = (chunk_end - pos < XPRESS_HUFF_CHUNK);
+        memset(encoder->Frequencies, 0, sizeof(encoder->Frequencies));
+        token_count = 0;
+        while (pos < chunk_end)
+        {
+            length = 0;
+            if (src_size - pos >= XPRESS_MIN_MATCH)
+            {
+                length = xpress_find_match(&finder, src, pos,
+                                           min(chunk_end - pos, XPRESS_HUFF_MAX_MATCH), &offset);
+            }
+
+            if (!length)
+            {
+                encoder->Tokens[token_count++] = src[pos];
+                encoder->Frequencies[src[pos]]++;
+                if (src_size - pos >= XPRESS_MIN_MATCH)
+                    xpress_insert(&finder, src, pos);
+                pos++;
+            }
+            else
+            {
+                encoder->Tokens[token_count++] = XPRESS_HUFF_MATCH_TOKEN |
+                                                 ((length - XPRESS_MIN_MATCH) << 16) | offset;
+                encoder->Frequencies[256 + (xpress_log2(offset) << 4) +
+                                     min(length - XPRESS_MIN_MATCH, 15)]++;
+                for (i = 0; i < length; i++)
+                {
+                    if (src_size - (pos + i) >= XPRESS_MIN_MATCH)
+                        xpress_insert(&finder, src, pos + i);
+                }
+                pos += length;
+            }
+        }
+
+        /* the EOF symbol terminates the last chunk; when the data ends on a chunk
+         * boundary it is stored in an extra chunk of its own, so that a decoder
+         * given the exact size never has to look past the end of a full chunk */
+        if (last)
+            encoder->Frequencies[XPRESS_HUFF_EOF_SYMBOL]++;
+
+        /* we need a complete code, hence at least two symbols */
+        for (i = 0, sym = 0; sym < XPRESS_HUFF_SYMBOLS; sym++)
+            if (encoder->Frequencies[sym]) i++;
+        while (i++ < 2)
+            encoder->Frequencies[encoder->Frequencies[0] ? 1 : 0] = 1;
+
+        xpress_huff_build_lengths(encoder);
+        xpress_huff_build_codes(encoder->Lengths, encoder->Codes);
+
+        /* write the code lengths, 4 bits per symbol */
+        if (dst_cur + XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(WORD) > dst_end)
+            return STATUS_BUFFER_TOO_SMALL;
+        for (i = 0; i < XPRESS_HUFF_TABLE_SIZE; i++)
+            dst_cur[i] = encoder->Lengths[2 * i] | (encoder->Lengths[2 * i + 1] << 4);
+        dst_cur += XPRESS_HUFF_TABLE_SIZE;
+
+        writer.slot1 = dst_cur;
+        writer.slot2 = dst_cur + sizeof(WORD);
+        writer.dst_cur = dst_cur + 2 * sizeof(WORD);
+        writer.dst_end = dst_end;
+        writer.bits = writer.count = 0;
+        writer.overflow = FALSE;
+
+        for (i = 0; i < token_count && !writer.overflow; i++)
+        {
+            token = encoder->Tokens[i];
+            if (!(token & XPRESS_HUFF_MATCH_TOKEN))
+            {
+                xpress_write_bits(&writer, encoder->Codes[token], encoder->Lengths[token]);
+                continue;
+            }
+
+            length = (token & ~XPRESS_HUFF_MATCH_TOKEN) >> 16;
+            offset = token & 0xFFFF;
+            bits = xpress_log2(offset);
+            sym = 256 + (bits << 4) + min(length, 15);
+            xpress_write_bits(&writer, encoder->Codes[sym], encoder->Lengths[sym]);
+            if (length >= 15)
+            {
+                if (length - 15 < 255)
+                    xpress_write_byte(&writer, (UCHAR)(length - 15));
+                else
+                {
+                    xpress_write_byte(&writer, 255);
+                    xpress_write_byte(&writer, (UCHAR)length);
+                    xpress_write_byte(&writer, (UCHAR)(length >> 8));
+                }
+            }
+            xpress_write_bits(&writer, offset - (1 << bits), bits);
+        }
+
+        if (last)
+        {
+            xpress_write_bits(&writer, encoder->Codes[XPRESS_HUFF_EOF_SYMBOL],
+                              encoder->Lengths[XPRESS_HUFF_EOF_SYMBOL]);
+        }
+
+        if (writer.overflow)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        /* flush the pending bits in the reserved words */
+        *(WORD *)writer.slot1 = (WORD)(writer.bits << (16 - writer.count));
+        *(WORD *)writer.slot2 = 0;
+        dst_cur = writer.dst_cur;
+    }
+    while (!last);
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+/* build the decoding tables for a chunk */
+static BOOLEAN xpress_huff_build_decoder(PXPRESS_HUFF_DECODER decoder, const UCHAR *table)
+{
+    ULONG sym, bits, code, total = 0, i;
+    USHORT next[XPRESS_HUFF_MAX_BITS + 1];
+
+    memset(decoder->Count, 0, sizeof(decoder->Count));
+    for (i = 0; i < XPRESS_HUFF_TABLE_SIZE; i++)
+    {
+        decoder->Lengths[2 * i] = table[i] & 0xF;
+        decoder->Lengths[2 * i + 1] = table[i] >> 4;
+        decoder->Count[table[i] & 0xF]++;
+        decoder->Count[table[i] >> 4]++;
+    }
+    decoder->Count[0] = 0;
+
+    /* the code must not be oversubscribed */
+    for (bits = 1; bits <= XPRESS_HUFF_MAX_BITS; bits++)
+        total += decoder->Count[bits] << (XPRESS_HUFF_MAX_BITS - bits);
+    if (total > 1 << XPRESS_HUFF_MAX_BITS)
+        return FALSE;
+
+    for (code = 0, i = 0, bits = 1; bits <= XPRESS_HUFF_MAX_BITS; bits++)
+    {
+        code = (code + (bits > 1 ? decoder->Count[bits - 1] : 0)) << 1;
+        decoder->First[bits] = (USHORT)code;
+        decoder->Index[bits] = (USHORT)i;
+        next[bits] = (USHORT)i;
+        i += decoder->Count[bits];
+    }
+
+    for (sym = 0; sym < XPRESS_HUFF_SYMBOLS; sym++)
+    {
+        if (decoder->Lengths[sym])
+            decoder->Sorted[next[decoder->Lengths[sym]]++] = (USHORT)sym;
+    }
+
+    /* short codes are resolved with a single lookup */
+    for (code = 0, i = 0, bits = 1; bits <= XPRESS_HUFF_TABLE_BITS; bits++)
+    {
+        for (sym = 0; sym < decoder->Count[bits]; sym++)
+        {
+            ULONG entries = 1 << (XPRESS_HUFF_TABLE_BITS - bits);
+            USHORT entry = (USHORT)((decoder->Sorted[decoder->Index[bits] + sym] << 4) | bits);
+            while (entries--)
+                decoder->Table[i++] = entry;
+        }
+    }
+    while (i < (1 << XPRESS_HUFF_TABLE_BITS))
+        decoder->Table[i++] = 0;
+
+    return TRUE;
+}
+
+static inline ULONG xpress_huff_decode(PXPRESS_HUFF_DECODER decoder, ULONG next_bits, ULONG *length)
+{
+    USHORT entry = decoder->Table[next_bits >> (32 - XPRESS_HUFF_TABLE_BITS)];
+    ULONG bits, code;
+
+    if (entry)
+    {
+        *length = entry & 0xF;
+        return entry >> 4;
+    }
+
+    /* longer codes are found by walking the canonical code */
+    for (bits = XPRESS_HUFF_TABLE_BITS + 1; bits <= XPRESS_HUFF_MAX_BITS; bits++)
+    {
+        code = next_bits >> (32 - bits);
+        if (code - decoder->First[bits] < decoder->Count[bits])
+        {
+            *length = bits;
+            return decoder->Sorted[decoder->Index[bits] + code - decoder->First[bits]];
+        }
+    }
+
+    /* not a valid code */
+    *length = XPRESS_HUFF_MAX_BITS;
+    return 0;
+}
+
+/* decompress data encoded with LZ77+Huffman */
+static NTSTATUS xpress_huff_decompress(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                                       ULONG *final_size, UCHAR *workspace)
+{
+    PXPRESS_HUFF_DECODER decoder = (PXPRESS_HUFF_DECODER)workspace;
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *block_end;
+    ULONG next_bits, length, offset, sym, bits;
+    LONG extra_bits;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    if (!decoder)
+    {
+        decoder = RtlpAllocateMemory(sizeof(*decoder), TAG_RTL_XPRESS);
+        if (!decoder) return STATUS_NO_MEMORY;
+    }
+
+    while (dst_cur < dst_end && src_cur < src_end)
+    {
+        if (src_cur + XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(WORD) > src_end ||
+            !xpress_huff_build_decoder(decoder, src_cur))
+        {
+            status = STATUS_BAD_COMPRESSION_BUFFER;
+            goto out;
+        }
+        src_cur += XPRESS_HUFF_TABLE_SIZE;
+
+        next_bits = ((ULONG)*(WORD *)src_cur << 16) | *(WORD *)(src_cur + sizeof(WORD));
+        src_cur += 2 * sizeof(WORD);
+        extra_bits = 16;
+
+        block_end = dst_cur + min(XPRESS_HUFF_CHUNK, dst_end - dst_cur);
+        while (dst_cur < block_end)
+        {
+            sym = xpress_huff_decode(decoder, next_bits, &bits);
+            next_bits <<= bits;
+            extra_bits -= bits;
+            if (extra_bits < 0)
+            {
+                if (src_cur + sizeof(WORD) > src_end)
+                {
+                    status = STATUS_BAD_COMPRESSION_BUFFER;
+                    goto out;
+                }
+                next_bits |= (ULONG)*(WORD *)src_cur << -extra_bits;
+                src_cur += sizeof(WORD);
+                extra_bits += 16;
+            }
+
+            if (sym < 256)
+            {
+                *dst_cur++ = (UCHAR)sym;
+                continue;
+            }
+
+            if (sym == XPRESS_HUFF_EOF_SYMBOL && src_cur == src_end)
+                goto out;
+
+            sym -= 256;
+            length = sym & 0xF;
+            bits = sym >> 4;
+            if (length == 15)
+            {
+                if (src_cur >= src_end)
+                {
+                    status = STATUS_BAD_COMPRESSION_BUFFER;
+                    goto out;
+                }
+                length = *src_cur++;
+                if (length == 255)
+                {
+                    if (src_cur + sizeof(WORD) > src_end)
+                    {
+                        status = STATUS_BAD_COMPRESSION_BUFFER;
+                        goto out;
+                    }
+                    length = *(WORD *)src_cur;
+                    src_cur += sizeof(WORD);
+                    if (!length)
+                    {
+                        if (src_cur + sizeof(DWORD) > src_end)
+                        {
+                            status = STATUS_BAD_COMPRESSION_BUFFER;
+                            goto out;
+                        }
+                        length = *(DWORD *)src_cur;
+                        src_cur += sizeof(DWORD);
+                    }
+                    if (length < 15)
+                    {
+                        status = STATUS_BAD_COMPRESSION_BUFFER;
+                        goto out;
+                    }
+                    length -= 15;
+                }
+                length += 15;
+            }
+            length += XPRESS_MIN_MATCH;
+
+            offset = 1 << bits;
+            if (bits)
+            {
+                offset += next_bits >> (32 - bits);
+                next_bits <<= bits;
+                extra_bits -= bits;
+                if (extra_bits < 0)
+                {
+                    if (src_cur + sizeof(WORD) > src_end)
+                    {
+                        status = STATUS_BAD_COMPRESSION_BUFFER;
+                        goto out;
+                    }
+                    next_bits |= (ULONG)*(WORD *)src_cur << -extra_bits;
+                    src_cur += sizeof(WORD);
+                    extra_bits += 16;
+                }
+            }
+
+            if (dst_cur - dst < offset)
+            {
+                status = STATUS_BAD_COMPRESSION_BUFFER;
+                goto out;
+            }
+
+            /* source and destination can overlap, copy bytewise */
+            length = min(length, dst_end - dst_cur);
+            while (length--)
+            {
+                *dst_cur = *(dst_cur - offset);
+                dst_cur++;
+            }
+        }
+    }
+
+out:
+    if (decoder != (PXPRESS_HUFF_DECODER)workspace)
+        RtlpFreeMemory(decoder, TAG_RTL_XPRESS);
+
+    if (NT_SUCCESS(status) && final_size)
+        *final_size = dst_cur - dst;
+
+    return status;
+}
+
+
+static NTSTATUS
+RtlpWorkSpaceSizeXpress(USHORT Format,
+                        USHORT Engine,
+                        PULONG BufferAndWorkSpaceSize,
+                        PULONG FragmentWorkSpaceSize)
+{
+   BOOLEAN Maximum;
+
+   if (Engine == COMPRESSION_ENGINE_STANDARD)
+      Maximum = FALSE;
+   else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+      Maximum = TRUE;
+   else
+      return(STATUS_NOT_SUPPORTED);
+
+   if (Format == COMPRESSION_FORMAT_XPRESS)
+   {
+      *BufferAndWorkSpaceSize = XPRESS_FINDER_SIZE(Maximum, XPRESS_LZ_WINDOW);
+      *FragmentWorkSpaceSize = 0;
+   }
+   else
+   {
+      *BufferAndWorkSpaceSize = sizeof(XPRESS_HUFF_ENCODER) +
+                                XPRESS_FINDER_SIZE(Maximum, XPRESS_HUFF_WINDOW);
+      *FragmentWorkSpaceSize = sizeof(XPRESS_HUFF_DECODER);
+   }
+
+   return(STATUS_SUCCESS);
+}
+
+
 /*
  * @implemented
  */
@@ -284,7 +1256,7 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                   IN PVOID WorkSpace)
 {
    USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
 
    if ((Format == COMPRESSION_FORMAT_NONE) ||
          (Format == COMPRESSION_FORMAT_DEFAULT))
@@ -299,6 +1271,28 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                                      FinalCompressedSize,
                                      WorkSpace));
 
+   if ((Engine != COMPRESSION_ENGINE_STANDARD) &&
+         (Engine != COMPRESSION_ENGINE_MAXIMUM))
+      return(STATUS_NOT_SUPPORTED);
+
+   if (Format == COMPRESSION_FORMAT_XPRESS)
+      return(xpress_compress(UncompressedBuffer,
+                             UncompressedBufferSize,
+                             CompressedBuffer,
+                             CompressedBufferSize,
+                             FinalCompressedSize,
+                             WorkSpace,
+                             Engine == COMPRESSION_ENGINE_MAXIMUM));
+
+   if (Format == COMPRESSION_FORMAT_XPRESS_HUFF)
+      return(xpress_huff_compress(UncompressedBuffer,
+                                  UncompressedBufferSize,
+                                  CompressedBuffer,
+                                  CompressedBufferSize,
+                                  FinalCompressedSize,
+                                  WorkSpace,
+                                  Engine == COMPRESSION_ENGINE_MAXIMUM));
+
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
 
@@ -357,6 +1351,16 @@ RtlDecompressFragment(IN USHORT format,
             return lznt1_decompress(uncompressed, uncompressed_size, compressed,
                                     compressed_size, offset, final_size, workspace);
 
+        case COMPRESSION_FORMAT_XPRESS:
+            if (offset) return STATUS_UNSUPPORTED_COMPRESSION;
+            return xpress_decompress(uncompressed, uncompressed_size, compressed,
+                                     compressed_size, final_size);
+
+        case COMPRESSION_FORMAT_XPRESS_HUFF:
+            if (offset) return STATUS_UNSUPPORTED_COMPRESSION;
+            return xpress_huff_decompress(uncompressed, uncompressed_size, compressed,
+                                          compressed_size, final_size, workspace);
+
         case COMPRESSION_FORMAT_NONE:
         case COMPRESSION_FORMAT_DEFAULT:
             return STATUS_INVALID_PARAMETER;
@@ -417,6 +1421,13 @@ RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
                                     CompressBufferAndWorkSpaceSize,
                                     CompressFragmentWorkSpaceSize));
 
+   if ((Format == COMPRESSION_FORMAT_XPRESS) ||
+         (Format == COMPRESSION_FORMAT_XPRESS_HUFF))
+      return(RtlpWorkSpaceSizeXpress(Format,
+                                     Engine,
+                                     CompressBufferAndWorkSpaceSize,
+                                     CompressFragmentWorkSpaceSize));
+
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
 
@@ -2017,6 +2017,24 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small blocks without extra stuff are served by the front end, if there is one.
+       It grows itself by calling us with the lock held and HEAP_NO_SERIALIZE */
+    if (Heap->FrontEndHeap &&
+        Index <= HEAP_LFH_MAX_BLOCK_SIZE &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT) &&
+        !(Flags & HEAP_NO_SERIALIZE))
+    {
+        InUseEntry = RtlpAllocateFrontEndHeap(Heap, Index, Size, EntryFlags);
+        if (InUseEntry)
+        {
+            /* Zero memory if that was requested */
+            if (Flags & HEAP_ZERO_MEMORY)
+                RtlZeroMemory(InUseEntry + 1, Size);
+
+            return InUseEntry + 1;
+        }
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2229,7 +2247,8 @@ BOOLEAN NTAPI RtlFreeHeap(
         /* Check this entry, fail if it's invalid */
         if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
             (((ULONG_PTR)Ptr & 0x7) != 0) ||
-            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS))
+            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS &&
+             !(RtlpIsFrontEndEntry(Heap, HeapEntry) && RtlpValidateFrontEndEntry(Heap, HeapEntry))))
         {
             /* This is an invalid block */
             DPRINT1("HEAP: Trying to free an invalid address %p!\n", Ptr);
@@ -2246,6 +2265,13 @@ BOOLEAN NTAPI RtlFreeHeap(
     }
     _SEH2_END;
 
+    /* Front end blocks go back to their bucket, no lock needed */
+    if (RtlpIsFrontEndEntry(Heap, HeapEntry))
+    {
+        RtlpFreeFrontEndHeap(Heap, HeapEntry);
+        return TRUE;
+    }
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2676,6 +2702,12 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         AllocationSize += sizeof(HEAP_ENTRY_EXTRA);
     }
 
+    /* Front end blocks can't grow into their neighbours, they are handled separately */
+    if (RtlpIsFrontEndEntry(Heap, (PHEAP_ENTRY)Ptr - 1))
+    {
+        return RtlpReAllocateFrontEndHeap(Heap, Flags, Ptr, Size);
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -3235,8 +3267,15 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Front end blocks don't belong to a segment directly */
+    if (RtlpIsFrontEndEntry(Heap, HeapEntry))
+    {
+        if (!RtlpValidateFrontEndEntry(Heap, HeapEntry)) goto invalid_entry;
+        return TRUE;
+    }
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
-    Segment = Heap->Segments[HeapEntry->SegmentOffset];
+    Segment = (HeapEntry->SegmentOffset < HEAP_SEGMENTS) ? Heap->Segments[HeapEntry->SegmentOffset] : NULL;
 
     if (BigAllocation &&
         (((ULONG_PTR)HeapEntry & (PAGE_SIZE - 1)) != FIELD_OFFSET(HEAP_VIRTUAL_ALLOC_ENTRY, BusyBlock)))
@@ -3999,13 +4038,15 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LFH)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        if (!HeapHandle)
+            return STATUS_INVALID_PARAMETER;
+
+        return RtlpActivateFrontEndHeap((PHEAP)HeapHandle);
     }
 
     return STATUS_SUCCESS;
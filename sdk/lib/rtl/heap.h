@@ -55,6 +55,19 @@
 /* Segment flags */
 #define HEAP_USER_ALLOCATED    0x1
 
+/* Low fragmentation front end heap */
+#define HEAP_FRONT_END_LFH          2
+#define HEAP_LFH_SEGMENT_OFFSET     0xFF
+#define HEAP_LFH_MAX_BLOCK_SIZE     (0x1000 >> HEAP_ENTRY_SHIFT)
+#ifdef _WIN64
+#define HEAP_LFH_BUCKETS            80
+#else
+#define HEAP_LFH_BUCKETS            96
+#endif
+#define HEAP_LFH_SUBSEGMENT_SIZE    0x1000
+#define HEAP_LFH_SUBSEGMENT_GROWTH  4
+#define HEAP_LFH_MIN_BLOCK_COUNT    8
+
 /* A handy inline to distinguis normal heap, special "debug heap" and special "page heap" */
 FORCEINLINE BOOLEAN
 RtlpHeapIsSpecial(ULONG Flags)
@@ -278,6 +291,37 @@ typedef struct _HEAP_SEGMENT
     HEAP_SEGMENT_MEMBERS;
 } HEAP_SEGMENT, *PHEAP_SEGMENT;
 
+typedef struct _HEAP_LFH_BUCKET
+{
+    SLIST_HEADER FreeBlocks;
+    USHORT BlockUnits;
+    USHORT SubSegmentCount;
+} HEAP_LFH_BUCKET, *PHEAP_LFH_BUCKET;
+
+typedef struct _HEAP_LFH
+{
+    HEAP_LFH_BUCKET Buckets[HEAP_LFH_BUCKETS];
+} HEAP_LFH, *PHEAP_LFH;
+
+/* Header of a back end block carved into front end blocks. Every block
+   stores its distance to this header in PreviousSize */
+typedef struct _HEAP_LFH_SUBSEGMENT
+{
+    PHEAP_LFH_BUCKET Bucket;
+    ULONG BlockCount;
+} HEAP_LFH_SUBSEGMENT, *PHEAP_LFH_SUBSEGMENT;
+
+C_ASSERT((sizeof(HEAP_LFH_SUBSEGMENT) & (sizeof(HEAP_ENTRY) - 1)) == 0);
+
+/* Whether a busy block belongs to the front end rather than to a segment */
+FORCEINLINE BOOLEAN
+RtlpIsFrontEndEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry)
+{
+    return Heap->FrontEndHeap != NULL &&
+           !(HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC) &&
+           HeapEntry->SegmentOffset == HEAP_LFH_SEGMENT_OFFSET;
+}
+
 typedef struct _HEAP_UCR_DESCRIPTOR
 {
     LIST_ENTRY ListEntry;
@@ -397,6 +441,30 @@ RtlDebugSizeHeap(HANDLE HeapPtr,
                  ULONG Flags,
                  PVOID Ptr);
 
+/* heaplfh.c */
+NTSTATUS NTAPI
+RtlpActivateFrontEndHeap(PHEAP Heap);
+
+PHEAP_ENTRY NTAPI
+RtlpAllocateFrontEndHeap(PHEAP Heap,
+                         SIZE_T Index,
+                         SIZE_T Size,
+                         UCHAR EntryFlags);
+
+VOID NTAPI
+RtlpFreeFrontEndHeap(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpReAllocateFrontEndHeap(PHEAP Heap,
+                           ULONG Flags,
+                           PVOID Ptr,
+                           SIZE_T Size);
+
+BOOLEAN NTAPI
+RtlpValidateFrontEndEntry(PHEAP Heap,
+                          PHEAP_ENTRY HeapEntry);
+
 /* heappage.c */
 
 HANDLE NTAPI
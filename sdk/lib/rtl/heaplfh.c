@@ -0,0 +1,339 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         RTL Low Fragmentation Heap front end
+ */
+
+/* Useful references:
+   http://illmatics.com/Understanding_the_LFH.pdf
+*/
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* The front end serves blocks of up to HEAP_LFH_MAX_BLOCK_SIZE heap entries
+   (header included) out of size classes ("buckets"). The first 32 buckets
+   have a granularity of one heap entry, then every group of 16 buckets
+   doubles the granularity of the previous one. This keeps the rounding loss
+   under 1/16 of the block size and always small enough for UnusedBytes.
+
+   Each bucket owns an S-List of free blocks, so allocating and freeing a
+   block is a single interlocked operation. When a bucket runs dry, a new
+   subsegment is allocated from the back end with the heap lock held and
+   carved into blocks of the bucket's size. Subsegments are never given back
+   to the back end: the memory of a block stays valid until the heap is
+   destroyed, which is what makes popping from the S-List safe. */
+
+/* FUNCTIONS *****************************************************************/
+
+FORCEINLINE
+ULONG
+RtlpGetFrontEndBucketIndex(SIZE_T Index)
+{
+    ULONG Group;
+
+    if (Index <= 32)
+        return (ULONG)Index - 1;
+
+    /* Index is in (16 << Group, 32 << Group], with a granularity of 1 << Group */
+    BitScanReverse(&Group, (ULONG)Index - 1);
+    Group -= 4;
+
+    return 16 + 16 * Group + (((ULONG)Index - 1 - (16 << Group)) >> Group);
+}
+
+static
+USHORT
+RtlpGetFrontEndBucketSize(ULONG BucketIndex)
+{
+    ULONG Group;
+
+    if (BucketIndex < 32)
+        return (USHORT)(BucketIndex + 1);
+
+    Group = (BucketIndex - 32) / 16 + 1;
+    return (USHORT)((16 << Group) + (((BucketIndex - 32) % 16 + 1) << Group));
+}
+
+static
+PSLIST_ENTRY
+RtlpGrowFrontEndBucket(PHEAP Heap,
+                       PHEAP_LFH_BUCKET Bucket)
+{
+    PSLIST_ENTRY FirstBlock;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_ENTRY HeapEntry;
+    SIZE_T BlockSize;
+    ULONG BlockCount, i;
+
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    /* Somebody else might have refilled the bucket while we were waiting */
+    FirstBlock = RtlInterlockedPopEntrySList(&Bucket->FreeBlocks);
+    if (FirstBlock)
+    {
+        RtlLeaveHeapLock(Heap->LockVariable);
+        return FirstBlock;
+    }
+
+    /* Every new subsegment of a bucket is twice as big as the previous one */
+    BlockSize = Bucket->BlockUnits << HEAP_ENTRY_SHIFT;
+    BlockCount = (ULONG)((HEAP_LFH_SUBSEGMENT_SIZE << min(Bucket->SubSegmentCount, HEAP_LFH_SUBSEGMENT_GROWTH)) / BlockSize);
+    if (BlockCount < HEAP_LFH_MIN_BLOCK_COUNT)
+        BlockCount = HEAP_LFH_MIN_BLOCK_COUNT;
+
+    /* The lock is already held, so don't let the back end take it again */
+    SubSegment = RtlAllocateHeap(Heap,
+                                 HEAP_NO_SERIALIZE,
+                                 sizeof(HEAP_LFH_SUBSEGMENT) + BlockCount * BlockSize);
+    if (!SubSegment)
+    {
+        RtlLeaveHeapLock(Heap->LockVariable);
+        return NULL;
+    }
+
+    SubSegment->Bucket = Bucket;
+    SubSegment->BlockCount = BlockCount;
+    Bucket->SubSegmentCount++;
+
+    /* Carve the blocks, keep the first one for the caller */
+    HeapEntry = (PHEAP_ENTRY)(SubSegment + 1);
+    FirstBlock = (PSLIST_ENTRY)(HeapEntry + 1);
+
+    for (i = 0; i < BlockCount; i++, HeapEntry += Bucket->BlockUnits)
+    {
+        HeapEntry->Size = Bucket->BlockUnits;
+        HeapEntry->Flags = 0;
+        HeapEntry->SmallTagIndex = 0;
+        HeapEntry->PreviousSize = (USHORT)(HeapEntry - (PHEAP_ENTRY)SubSegment);
+        HeapEntry->SegmentOffset = HEAP_LFH_SEGMENT_OFFSET;
+        HeapEntry->UnusedBytes = 0;
+
+        if (i) RtlInterlockedPushEntrySList(&Bucket->FreeBlocks, (PSLIST_ENTRY)(HeapEntry + 1));
+    }
+
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    DPRINT("HEAP: LFH bucket of size %x got a subsegment %p of %lu blocks\n",
+           Bucket->BlockUnits, SubSegment, BlockCount);
+
+    return FirstBlock;
+}
+
+NTSTATUS NTAPI
+RtlpActivateFrontEndHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh;
+    ULONG i;
+
+    /* Nothing to do if it's already active */
+    if (Heap->FrontEndHeap)
+        return STATUS_SUCCESS;
+
+    /* The front end needs the heap lock to grow, and it knows nothing about
+       debug heaps, tagging, tail/free checking or a non default alignment */
+    if ((Heap->Flags & (HEAP_NO_SERIALIZE |
+                        HEAP_TAIL_CHECKING_ENABLED |
+                        HEAP_FREE_CHECKING_ENABLED |
+                        HEAP_CREATE_ALIGN_16)) ||
+        RtlpHeapIsSpecial(Heap->Flags | Heap->ForceFlags) ||
+        Heap->PseudoTagEntries)
+    {
+        DPRINT1("HEAP: Can't enable LFH for heap %p with flags %lx\n", Heap, Heap->Flags);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* The buckets themselves come from the back end */
+    Lfh = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, sizeof(HEAP_LFH));
+    if (!Lfh)
+        return STATUS_NO_MEMORY;
+
+    for (i = 0; i < HEAP_LFH_BUCKETS; i++)
+    {
+        RtlInitializeSListHead(&Lfh->Buckets[i].FreeBlocks);
+        Lfh->Buckets[i].BlockUnits = RtlpGetFrontEndBucketSize(i);
+    }
+
+    /* Publish it, unless somebody was faster */
+    if (InterlockedCompareExchangePointer(&Heap->FrontEndHeap, Lfh, NULL) != NULL)
+    {
+        RtlFreeHeap(Heap, 0, Lfh);
+        return STATUS_SUCCESS;
+    }
+
+    Heap->FrontEndHeapType = HEAP_FRONT_END_LFH;
+
+    return STATUS_SUCCESS;
+}
+
+PHEAP_ENTRY NTAPI
+RtlpAllocateFrontEndHeap(PHEAP Heap,
+                         SIZE_T Index,
+                         SIZE_T Size,
+                         UCHAR EntryFlags)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket;
+    PSLIST_ENTRY Block;
+    PHEAP_ENTRY HeapEntry;
+
+    ASSERT(Index <= HEAP_LFH_MAX_BLOCK_SIZE);
+
+    Bucket = &Lfh->Buckets[RtlpGetFrontEndBucketIndex(Index)];
+
+    Block = RtlInterlockedPopEntrySList(&Bucket->FreeBlocks);
+    if (!Block)
+    {
+        Block = RtlpGrowFrontEndBucket(Heap, Bucket);
+        if (!Block) return NULL;
+    }
+
+    /* Only the flags and the size change, the rest was set when carving */
+    HeapEntry = (PHEAP_ENTRY)Block - 1;
+    HeapEntry->Flags = EntryFlags;
+    HeapEntry->UnusedBytes = (UCHAR)((HeapEntry->Size << HEAP_ENTRY_SHIFT) - Size);
+
+    return HeapEntry;
+}
+
+VOID NTAPI
+RtlpFreeFrontEndHeap(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+
+    SubSegment = (PHEAP_LFH_SUBSEGMENT)(HeapEntry - HeapEntry->PreviousSize);
+
+    /* Mark it as free, so that a double free gets caught */
+    HeapEntry->Flags = 0;
+
+    RtlInterlockedPushEntrySList(&SubSegment->Bucket->FreeBlocks, (PSLIST_ENTRY)(HeapEntry + 1));
+}
+
+PVOID NTAPI
+RtlpReAllocateFrontEndHeap(PHEAP Heap,
+                           ULONG Flags,
+                           PVOID Ptr,
+                           SIZE_T Size)
+{
+    PHEAP_ENTRY InUseEntry = (PHEAP_ENTRY)Ptr - 1;
+    SIZE_T AllocationSize, OldSize;
+    PVOID NewBaseAddress;
+    EXCEPTION_RECORD ExceptionRecord;
+
+    /* If that entry is not really in-use, we have a problem */
+    if (!(InUseEntry->Flags & HEAP_ENTRY_BUSY))
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return Ptr;
+    }
+
+    OldSize = (InUseEntry->Size << HEAP_ENTRY_SHIFT) - InUseEntry->UnusedBytes;
+
+    if (Size)
+        AllocationSize = Size;
+    else
+        AllocationSize = 1;
+    AllocationSize = (AllocationSize + Heap->AlignRound) & Heap->AlignMask;
+
+    /* Stay in place as long as the new size falls into the same bucket */
+    if (!(Flags & HEAP_EXTRA_FLAGS_MASK) &&
+        (AllocationSize >> HEAP_ENTRY_SHIFT) <= HEAP_LFH_MAX_BLOCK_SIZE &&
+        RtlpGetFrontEndBucketSize(RtlpGetFrontEndBucketIndex(AllocationSize >> HEAP_ENTRY_SHIFT)) == InUseEntry->Size)
+    {
+        InUseEntry->UnusedBytes = (UCHAR)((InUseEntry->Size << HEAP_ENTRY_SHIFT) - Size);
+
+        if (Size > OldSize)
+        {
+            /* Growing overwrites user settable flags, just like the back end does */
+            InUseEntry->Flags &= ~HEAP_ENTRY_SETTABLE_FLAGS;
+            InUseEntry->Flags |= (Flags & HEAP_SETTABLE_USER_FLAGS) >> 4;
+
+            if (Flags & HEAP_ZERO_MEMORY)
+                RtlZeroMemory((PCHAR)Ptr + OldSize, Size - OldSize);
+        }
+
+        return Ptr;
+    }
+
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        DPRINT1("Realloc in place failed, but it was the only option\n");
+
+        if (Flags & HEAP_GENERATE_EXCEPTIONS)
+        {
+            ExceptionRecord.ExceptionCode = STATUS_NO_MEMORY;
+            ExceptionRecord.ExceptionRecord = NULL;
+            ExceptionRecord.NumberParameters = 1;
+            ExceptionRecord.ExceptionFlags = 0;
+            ExceptionRecord.ExceptionInformation[0] = AllocationSize;
+
+            RtlRaiseException(&ExceptionRecord);
+        }
+
+        return NULL;
+    }
+
+    /* Move it to wherever the new size belongs to */
+    NewBaseAddress = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+    if (!NewBaseAddress)
+        return NULL;
+
+    if (Size < OldSize)
+        RtlMoveMemory(NewBaseAddress, Ptr, Size);
+    else
+        RtlMoveMemory(NewBaseAddress, Ptr, OldSize);
+
+    if (Size > OldSize &&
+        (Flags & HEAP_ZERO_MEMORY))
+    {
+        RtlZeroMemory((PCHAR)NewBaseAddress + OldSize, Size - OldSize);
+    }
+
+    RtlpFreeFrontEndHeap(Heap, InUseEntry);
+
+    return NewBaseAddress;
+}
+
+BOOLEAN NTAPI
+RtlpValidateFrontEndEntry(PHEAP Heap,
+                          PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_LFH_BUCKET Bucket;
+
+    if (!Lfh || HeapEntry->SegmentOffset != HEAP_LFH_SEGMENT_OFFSET)
+        return FALSE;
+
+    if (HeapEntry->PreviousSize * sizeof(HEAP_ENTRY) < sizeof(HEAP_LFH_SUBSEGMENT))
+        return FALSE;
+
+    /* The subsegment must point back to one of our buckets of the same size */
+    SubSegment = (PHEAP_LFH_SUBSEGMENT)(HeapEntry - HeapEntry->PreviousSize);
+    Bucket = SubSegment->Bucket;
+
+    if (Bucket < &Lfh->Buckets[0] ||
+        Bucket >= &Lfh->Buckets[HEAP_LFH_BUCKETS] ||
+        Bucket->BlockUnits != HeapEntry->Size)
+    {
+        return FALSE;
+    }
+
+    /* And the entry must be one of its blocks */
+    if (((HeapEntry - (PHEAP_ENTRY)(SubSegment + 1)) % Bucket->BlockUnits) != 0 ||
+        (ULONG)((HeapEntry - (PHEAP_ENTRY)(SubSegment + 1)) / Bucket->BlockUnits) >= SubSegment->BlockCount)
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* EOF */
@@ -0,0 +1,305 @@
+/*
+ * PROJECT:     ReactOS DIB Blend Benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Checks and measures the 32bpp AlphaBlend and TransparentBlt
+ *              scanline kernels of win32k on the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include <win32k.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIDTH   1024
+#define HEIGHT  768
+#define PIXELS  (WIDTH * HEIGHT)
+
+typedef VOID (*PFN_BLEND_LINE)(PULONG, const ULONG*, ULONG, BLENDFUNCTION);
+typedef VOID (*PFN_TRANSPARENT_LINE)(PULONG, const ULONG*, const ULONG*, ULONG, ULONG);
+
+typedef struct _BLEND_MODE
+{
+    const char *Name;
+    BYTE SourceConstantAlpha;
+    BYTE AlphaFormat;
+} BLEND_MODE;
+
+static const BLEND_MODE Modes[] =
+{
+    { "premultiplied",     255, AC_SRC_ALPHA },
+    { "source alpha",      128, AC_SRC_ALPHA },
+    { "constant alpha",     77, 0 },
+    { "opaque",            255, 0 },
+};
+
+#define MODE_COUNT (sizeof(Modes) / sizeof(Modes[0]))
+
+static int Failures;
+
+static double Seconds(clock_t Start)
+{
+    return (double)(clock() - Start) / CLOCKS_PER_SEC;
+}
+
+static ULONG Random(void)
+{
+    static ULONG Seed = 0x12345678;
+
+    Seed = Seed * 1103515245 + 12345;
+    return (Seed >> 16) | (Seed << 16);
+}
+
+/* The per-pixel loop of DIB_32BPP_AlphaBlend before the kernels were added */
+
+typedef union
+{
+    ULONG ul;
+    struct
+    {
+        UCHAR red;
+        UCHAR green;
+        UCHAR blue;
+        UCHAR alpha;
+    } col;
+} NICEPIXEL32;
+
+static UCHAR Clamp8(ULONG val)
+{
+    return (val > 255) ? 255 : (UCHAR)val;
+}
+
+static VOID BlendLineReference(PULONG Dst, const ULONG *Src, ULONG cx, BLENDFUNCTION BlendFunc)
+{
+    NICEPIXEL32 DstPixel, SrcPixel;
+    UCHAR Alpha;
+    ULONG i;
+
+    for (i = 0; i < cx; i++)
+    {
+        SrcPixel.ul = Src[i];
+        SrcPixel.col.red = (SrcPixel.col.red * BlendFunc.SourceConstantAlpha) / 255;
+        SrcPixel.col.green = (SrcPixel.col.green * BlendFunc.SourceConstantAlpha) / 255;
+        SrcPixel.col.blue = (SrcPixel.col.blue * BlendFunc.SourceConstantAlpha) / 255;
+        SrcPixel.col.alpha = (SrcPixel.col.alpha * BlendFunc.SourceConstantAlpha) / 255;
+
+        Alpha = ((BlendFunc.AlphaFormat & AC_SRC_ALPHA) != 0) ?
+             SrcPixel.col.alpha : BlendFunc.SourceConstantAlpha;
+
+        DstPixel.ul = Dst[i];
+        DstPixel.col.red = Clamp8((DstPixel.col.red * (255 - Alpha)) / 255 + SrcPixel.col.red);
+        DstPixel.col.green = Clamp8((DstPixel.col.green * (255 - Alpha)) / 255 + SrcPixel.col.green);
+        DstPixel.col.blue = Clamp8((DstPixel.col.blue * (255 - Alpha)) / 255 + SrcPixel.col.blue);
+        DstPixel.col.alpha = Clamp8((DstPixel.col.alpha * (255 - Alpha)) / 255 + SrcPixel.col.alpha);
+        Dst[i] = DstPixel.ul;
+    }
+}
+
+static VOID TransparentLineReference(PULONG Dst, const ULONG *SrcIndex, const ULONG *SrcColor,
+                                     ULONG cx, ULONG iTransColor)
+{
+    ULONG i;
+
+    for (i = 0; i < cx; i++)
+    {
+        if ((0x00FFFFFF & SrcIndex[i]) != (0x00FFFFFF & iTransColor))
+            Dst[i] = SrcColor[i];
+    }
+}
+
+static const struct
+{
+    const char *Name;
+    PFN_BLEND_LINE pfnBlendLine;
+    PFN_TRANSPARENT_LINE pfnTransparentLine;
+} Kernels[] =
+{
+    { "per pixel", BlendLineReference, TransparentLineReference },
+    { "C",         DIB_32BPP_BlendLineC, DIB_32BPP_TransparentLineC },
+#ifdef GDI_SIMD
+    { "SIMD",      DIB_32BPP_BlendLineSimd, DIB_32BPP_TransparentLineSimd },
+#endif
+};
+
+#define KERNEL_COUNT (sizeof(Kernels) / sizeof(Kernels[0]))
+
+static void FillImages(PULONG Src, PULONG Dst)
+{
+    ULONG i, Alpha;
+
+    for (i = 0; i < PIXELS; i++)
+    {
+        /* Mostly opaque or clear like icons, with premultiplied colors */
+        Alpha = Random() & 0xFF;
+        if (i & 0x10)
+            Alpha = (i & 0x20) ? 0xFF : 0;
+        Src[i] = (Random() & 0x00FFFFFF) | (Alpha << 24);
+        Dst[i] = Random();
+    }
+
+    /* Some exact matches for TransparentBlt, with a different alpha */
+    for (i = 0; i < PIXELS; i += 3)
+        Src[i] = 0x5A00FF00;
+}
+
+static void CheckKernels(const ULONG *Src, const ULONG *Dst)
+{
+    static ULONG Expected[PIXELS], Actual[PIXELS];
+    BLENDFUNCTION BlendFunc = { AC_SRC_OVER, 0, 0, 0 };
+    ULONG k, m, cx, Alpha, Offset;
+
+    for (m = 0; m < MODE_COUNT; m++)
+    {
+        BlendFunc.SourceConstantAlpha = Modes[m].SourceConstantAlpha;
+        BlendFunc.AlphaFormat = Modes[m].AlphaFormat;
+
+        memcpy(Expected, Dst, sizeof(Expected));
+        BlendLineReference(Expected, Src, PIXELS, BlendFunc);
+
+        for (k = 1; k < KERNEL_COUNT; k++)
+        {
+            /* Odd lengths and offsets exercise the tails */
+            memcpy(Actual, Dst, sizeof(Actual));
+            for (Offset = 0; Offset < PIXELS; Offset += cx)
+            {
+                cx = min(PIXELS - Offset, 1 + Offset % 37);
+                Kernels[k].pfnBlendLine(Actual + Offset, Src + Offset, cx, BlendFunc);
+            }
+            if (memcmp(Actual, Expected, sizeof(Actual)))
+            {
+                printf("%s blend differs from the per pixel code (%s)\n", Kernels[k].Name, Modes[m].Name);
+                Failures++;
+            }
+        }
+    }
+
+    /* Every alpha and constant alpha with every channel value */
+    for (Alpha = 0; Alpha < 256; Alpha++)
+    {
+        for (m = 0; m < 256; m++)
+        {
+            ULONG Source[256], Destination[256], Result[256];
+
+            for (k = 0; k < 256; k++)
+            {
+                Source[k] = (Alpha << 24) | (k << 16) | ((255 - k) << 8) | (k ^ Alpha);
+                Destination[k] = (k << 24) | (Alpha << 16) | (m << 8) | (255 - m);
+            }
+            for (k = 0; k < 2; k++)
+            {
+                BlendFunc.SourceConstantAlpha = (BYTE)m;
+                BlendFunc.AlphaFormat = k ? AC_SRC_ALPHA : 0;
+                memcpy(Expected, Destination, sizeof(Destination));
+                BlendLineReference(Expected, Source, 256, BlendFunc);
+                memcpy(Result, Destination, sizeof(Destination));
+                Kernels[KERNEL_COUNT - 1].pfnBlendLine(Result, Source, 256, BlendFunc);
+                if (memcmp(Result, Expected, sizeof(Result)))
+                {
+                    printf("%s blend differs for alpha %lu, constant alpha %lu\n",
+                           Kernels[KERNEL_COUNT - 1].Name, (unsigned long)Alpha, (unsigned long)m);
+                    Failures++;
+                }
+            }
+        }
+    }
+
+    memcpy(Expected, Dst, sizeof(Expected));
+    TransparentLineReference(Expected, Src, Src, PIXELS, 0x0000FF00);
+    for (k = 1; k < KERNEL_COUNT; k++)
+    {
+        memcpy(Actual, Dst, sizeof(Actual));
+        for (Offset = 0; Offset < PIXELS; Offset += cx)
+        {
+            cx = min(PIXELS - Offset, 1 + Offset % 37);
+            Kernels[k].pfnTransparentLine(Actual + Offset, Src + Offset, Src + Offset, cx, 0x0000FF00);
+        }
+        if (memcmp(Actual, Expected, sizeof(Actual)))
+        {
+            printf("%s transparent copy differs from the per pixel code\n", Kernels[k].Name);
+            Failures++;
+        }
+    }
+}
+
+static void Benchmark(const ULONG *Src, PULONG Dst, ULONG Iterations)
+{
+    BLENDFUNCTION BlendFunc = { AC_SRC_OVER, 0, 0, 0 };
+    double Time, Baseline;
+    clock_t Start;
+    ULONG k, m, i, y;
+
+    printf("%-16s %-10s %10s %8s\n", "Operation", "Kernel", "MPixel/s", "Speedup");
+
+    for (m = 0; m < MODE_COUNT; m++)
+    {
+        BlendFunc.SourceConstantAlpha = Modes[m].SourceConstantAlpha;
+        BlendFunc.AlphaFormat = Modes[m].AlphaFormat;
+        Baseline = 0;
+
+        for (k = 0; k < KERNEL_COUNT; k++)
+        {
+            Start = clock();
+            for (i = 0; i < Iterations; i++)
+            {
+                for (y = 0; y < HEIGHT; y++)
+                    Kernels[k].pfnBlendLine(Dst + y * WIDTH, Src + y * WIDTH, WIDTH, BlendFunc);
+            }
+            Time = Seconds(Start);
+            if (!k)
+                Baseline = Time;
+            printf("%-16s %-10s %10.1f %7.2fx\n", Modes[m].Name, Kernels[k].Name,
+                   (double)PIXELS * Iterations / Time / 1e6, Baseline / Time);
+        }
+    }
+
+    Baseline = 0;
+    for (k = 0; k < KERNEL_COUNT; k++)
+    {
+        Start = clock();
+        for (i = 0; i < Iterations; i++)
+        {
+            for (y = 0; y < HEIGHT; y++)
+            {
+                Kernels[k].pfnTransparentLine(Dst + y * WIDTH, Src + y * WIDTH,
+                                              Src + y * WIDTH, WIDTH, 0x0000FF00);
+            }
+        }
+        Time = Seconds(Start);
+        if (!k)
+            Baseline = Time;
+        printf("%-16s %-10s %10.1f %7.2fx\n", "transparent", Kernels[k].Name,
+               (double)PIXELS * Iterations / Time / 1e6, Baseline / Time);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ULONG Iterations = 20;
+    PULONG Src, Dst;
+
+    if (argc > 2 && !strcmp(argv[1], "-n"))
+        Iterations = atoi(argv[2]);
+
+    Src = malloc(PIXELS * sizeof(ULONG));
+    Dst = malloc(PIXELS * sizeof(ULONG));
+    if (!Src || !Dst)
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    FillImages(Src, Dst);
+    CheckKernels(Src, Dst);
+    Benchmark(Src, Dst, Iterations);
+
+    free(Src);
+    free(Dst);
+
+    if (Failures)
+    {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+
+    printf("All kernels match the per pixel code\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+/*
+ * PROJECT:     ReactOS DIB Blend Benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Minimal <debug.h>, <typedefs.h> already has the macros
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
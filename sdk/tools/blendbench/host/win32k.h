@@ -0,0 +1,42 @@
+/*
+ * PROJECT:     ReactOS DIB Blend Benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Minimal <win32k.h> to build the 32bpp blend kernels on the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <typedefs.h>
+
+/* The vector kernels are selected like for an amd64 target */
+#if defined(__x86_64__) && !defined(_M_AMD64)
+#define _M_AMD64
+#endif
+
+#include <simd.h>
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#define AC_SRC_OVER  0x00
+#define AC_SRC_ALPHA 0x01
+
+typedef struct _BLENDFUNCTION
+{
+    BYTE BlendOp;
+    BYTE BlendFlags;
+    BYTE SourceConstantAlpha;
+    BYTE AlphaFormat;
+} BLENDFUNCTION;
+
+/* From win32ss/gdi/dib/dib.h */
+VOID DIB_32BPP_BlendLineC(PULONG, const ULONG*, ULONG, BLENDFUNCTION);
+VOID DIB_32BPP_TransparentLineC(PULONG, const ULONG*, const ULONG*, ULONG, ULONG);
+#ifdef GDI_SIMD
+VOID DIB_32BPP_BlendLineSimd(PULONG, const ULONG*, ULONG, BLENDFUNCTION);
+VOID DIB_32BPP_TransparentLineSimd(PULONG, const ULONG*, const ULONG*, ULONG, ULONG);
+#endif
@@ -25,7 +25,9 @@
 #endif
 #include "cabinet.h"
 #include "raw.h"
+#include "lzx.h"
 #include "mszip.h"
+#include "compqueue.h"
 
 #ifndef CAB_READ_ONLY
 
@@ -101,6 +103,9 @@ CCabinet::CCabinet()
     BlockIsSplit = false;
     ScratchFile  = NULL;
 
+    ThreadCount      = 1;
+    CompressionQueue = NULL;
+
     FolderUncompSize = 0;
     BytesLeftInBlock = 0;
     ReuseBlock       = false;
@@ -369,6 +374,8 @@ bool CCabinet::SetCompressionCodec(char* CodecName)
         SelectCodec(CAB_CODEC_RAW);
     else if( !strcasecmp(CodecName, "mszip") )
         SelectCodec(CAB_CODEC_MSZIP);
+    else if( !strcasecmp(CodecName, "lzx") )
+        SelectCodec(CAB_CODEC_LZX);
     else
     {
         printf("ERROR: Invalid codec specified!\n");
@@ -484,10 +491,12 @@ ULONG CCabinet::Open()
         ULONG BytesRead;
         ULONG Size;
 
-        OutputBuffer = malloc(CAB_BLOCKSIZE + 12);    // This should be enough
+        OutputBuffer = malloc(CAB_MAX_COMPSIZE);
         if (!OutputBuffer)
             return CAB_STATUS_NOMEMORY;
 
+        CurrentDataNode = NULL;
+
         FileHandle = fopen(CabinetName, "rb");
         if (FileHandle == NULL)
         {
@@ -758,6 +767,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
     PUCHAR CurrentBuffer;
     FILE* DestFile;
     PCFFILE_NODE File;
+    PCFDATA_NODE DataNode;
     CFDATA CFData;
     ULONG Status;
     bool Skip;
@@ -786,6 +796,10 @@ ULONG CCabinet::ExtractFile(char* FileName)
             SelectCodec(CAB_CODEC_MSZIP);
             break;
 
+        case CAB_COMP_LZX:
+            SelectCodec(CAB_CODEC_LZX);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -836,7 +850,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
     SetAttributesOnFile(DestName, File->File.Attributes);
 
-    Buffer = (PUCHAR)malloc(CAB_BLOCKSIZE + 12); // This should be enough
+    Buffer = (PUCHAR)malloc(CAB_MAX_COMPSIZE);
     if (!Buffer)
     {
         fclose(DestFile);
@@ -847,6 +861,21 @@ ULONG CCabinet::ExtractFile(char* FileName)
     /* Call OnExtract event handler */
     OnExtract(&File->File, FileName);
 
+    /* LZX blocks depend on the ones before them, so unless this file
+       starts where the last one ended, the folder is decoded up to it */
+    if ((CodecId == CAB_CODEC_LZX) && (File->File.FileSize > 0) &&
+        ((CurrentDataNode == NULL) ||
+         ((CurrentDataNode != File->DataBlock) && (CurrentDataNode->Next != File->DataBlock))))
+    {
+        Status = ReplayDataBlocks(File->DataBlock, Buffer);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            fclose(DestFile);
+            free(Buffer);
+            return Status;
+        }
+    }
+
     /* Search to start of file */
     if (fseek(FileHandle, (off_t)File->DataBlock->AbsoluteOffset, SEEK_SET) != 0)
     {
@@ -863,6 +892,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
     Skip = true;
 
     ReuseBlock = (CurrentDataNode == File->DataBlock);
+    DataNode   = File->DataBlock;
     if (Size > 0)
     {
         do
@@ -895,7 +925,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                         CFData.CompSize,
                         CFData.UncompSize));
 
-                    ASSERT(CFData.CompSize <= CAB_BLOCKSIZE + 12);
+                    ASSERT(CFData.CompSize <= CAB_MAX_COMPSIZE);
 
                     BytesToRead = CFData.CompSize;
 
@@ -971,6 +1001,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
                         /* The file is continued in the first data block in the folder */
                         File->DataBlock = CurrentFolderNode->DataListHead;
+                        DataNode = File->DataBlock;
 
                         /* Search to start of file */
                         if (fseek(FileHandle, (off_t)File->DataBlock->AbsoluteOffset, SEEK_SET) != 0)
@@ -996,9 +1027,12 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
                 DPRINT(MAX_TRACE, ("TotalBytesRead (%u).\n", (UINT)TotalBytesRead));
 
+                /* LZX needs to know the size of the frame */
+                BytesToWrite = CFData.UncompSize;
                 Status = Codec->Uncompress(OutputBuffer, Buffer, TotalBytesRead, &BytesToWrite);
                 if (Status != CS_SUCCESS)
                 {
+                    CurrentDataNode = NULL;
                     fclose(DestFile);
                     free(Buffer);
                     DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
@@ -1017,6 +1051,11 @@ ULONG CCabinet::ExtractFile(char* FileName)
                 }
 
                 BytesLeftInBlock = BytesToWrite;
+
+                /* Remember what is in OutputBuffer, so that the next file can use it */
+                CurrentDataNode = DataNode;
+                if (DataNode != NULL)
+                    DataNode = DataNode->Next;
             }
             else
             {
@@ -1049,6 +1088,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                     return CAB_STATUS_INVALID_CAB;
                 }
 
+                DataNode = CurrentDataNode->Next;
                 ReuseBlock = false;
             }
 
@@ -1106,6 +1146,31 @@ bool CCabinet::IsCodecSelected()
     return CodecSelected;
 }
 
+CCABCodec* CreateCodec(LONG Id)
+/*
+ * FUNCTION: Creates a codec engine
+ * ARGUMENTS:
+ *     Id = Codec identifier
+ * RETURNS:
+ *     Pointer to the codec, or NULL if the identifier is unknown
+ */
+{
+    switch (Id)
+    {
+        case CAB_CODEC_RAW:
+            return new CRawCodec();
+
+        case CAB_CODEC_LZX:
+            return new CLZXCodec();
+
+        case CAB_CODEC_MSZIP:
+            return new CMSZipCodec();
+
+        default:
+            return NULL;
+    }
+}
+
 void CCabinet::SelectCodec(LONG Id)
 /*
  * FUNCTION: Selects codec engine to use
@@ -1122,19 +1187,9 @@ void CCabinet::SelectCodec(LONG Id)
         delete Codec;
     }
 
-    switch (Id)
-    {
-        case CAB_CODEC_RAW:
-            Codec = new CRawCodec();
-            break;
-
-        case CAB_CODEC_MSZIP:
-            Codec = new CMSZipCodec();
-            break;
-
-        default:
-            return;
-    }
+    Codec = CreateCodec(Id);
+    if (!Codec)
+        return;
 
     CodecId       = Id;
     CodecSelected = true;
@@ -1156,8 +1211,8 @@ ULONG CCabinet::NewCabinet()
 
     CurrentDiskNumber = 0;
 
-    OutputBuffer = malloc(CAB_BLOCKSIZE + 12); // This should be enough
-    InputBuffer  = malloc(CAB_BLOCKSIZE + 12); // This should be enough
+    OutputBuffer = malloc(CAB_MAX_COMPSIZE);
+    InputBuffer  = malloc(CAB_MAX_COMPSIZE);
     if ((!OutputBuffer) || (!InputBuffer))
     {
         DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
@@ -1265,10 +1320,16 @@ ULONG CCabinet::NewFolder()
             CurrentFolderNode->Folder.CompressionType = CAB_COMP_MSZIP;
             break;
 
+        case CAB_CODEC_LZX:
+            CurrentFolderNode->Folder.CompressionType = CAB_COMP_LZX | (LZX_DEFAULT_WINDOW_BITS << 8);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
 
+    Codec->Reset(CurrentFolderNode->Folder.CompressionType);
+
     /* FIXME: This won't work if no files are added to the new folder */
 
     DiskSize += sizeof(CFFOLDER);
@@ -1479,6 +1540,11 @@ ULONG CCabinet::WriteDisk(ULONG MoreDisks)
             }
         } while (CreateNewDisk);
     }
+
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     CommitDisk(MoreDisks);
 
     return CAB_STATUS_SUCCESS;
@@ -1581,6 +1647,12 @@ ULONG CCabinet::CloseCabinet()
 {
     ULONG Status;
 
+    if (CompressionQueue)
+    {
+        delete CompressionQueue;
+        CompressionQueue = NULL;
+    }
+
     DestroyFileNodes();
 
     DestroyFolderNodes();
@@ -1839,6 +1911,16 @@ void CCabinet::SetMaxDiskSize(ULONG Size)
     MaxDiskSize = Size;
 }
 
+void CCabinet::SetThreadCount(ULONG Count)
+/*
+ * FUNCTION: Sets the number of threads compressing data blocks
+ * ARGUMENTS:
+ *     Count = Number of threads (1 compresses on the calling thread)
+ */
+{
+    ThreadCount = (Count > 0) ? Count : 1;
+}
+
 #endif /* CAB_READ_ONLY */
 
 
@@ -2225,6 +2307,68 @@ ULONG CCabinet::ReadDataBlocks(PCFFOLDER_NODE FolderNode)
 }
 
 
+ULONG CCabinet::ReplayDataBlocks(PCFDATA_NODE StopNode, PUCHAR Buffer)
+/*
+ * FUNCTION: Decodes the data blocks of the current folder up to a given one
+ * ARGUMENTS:
+ *     StopNode = Pointer to data node to stop at
+ *     Buffer   = Pointer to buffer for compressed data
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCFDATA_NODE Node;
+    CFDATA CFData;
+    ULONG BytesRead;
+    ULONG BytesToWrite;
+    ULONG Status;
+
+    if (Codec->Reset(CurrentFolderNode->Folder.CompressionType) != CS_SUCCESS)
+        return CAB_STATUS_UNSUPPCOMP;
+
+    CurrentDataNode = NULL;
+
+    for (Node = CurrentFolderNode->DataListHead; Node != NULL && Node != StopNode; Node = Node->Next)
+    {
+        if (fseek(FileHandle, (off_t)Node->AbsoluteOffset, SEEK_SET) != 0)
+        {
+            DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        if (((Status = ReadBlock(&CFData, sizeof(CFDATA), &BytesRead)) !=
+            CAB_STATUS_SUCCESS) || (BytesRead != sizeof(CFDATA)) ||
+            (CFData.CompSize > CAB_MAX_COMPSIZE))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        if (((Status = ReadBlock(Buffer, CFData.CompSize, &BytesRead)) !=
+            CAB_STATUS_SUCCESS) || (BytesRead != CFData.CompSize))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        BytesToWrite = CFData.UncompSize;
+        Status = Codec->Uncompress(OutputBuffer, Buffer, BytesRead, &BytesToWrite);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
+            if (Status == CS_NOMEMORY)
+                return CAB_STATUS_NOMEMORY;
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        BytesLeftInBlock = BytesToWrite;
+        CurrentDataNode  = Node;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
 PCFFOLDER_NODE CCabinet::NewFolderNode()
 /*
  * FUNCTION: Creates a new folder node
@@ -2986,12 +3130,27 @@ ULONG CCabinet::WriteDataBlock()
     ULONG BytesWritten;
     PCFDATA_NODE DataNode;
 
+    /* MSZIP blocks don't depend on each other, so other threads can compress
+       them. Split blocks need the compressed size right away */
+    if ((ThreadCount > 1) && (MaxDiskSize == 0) && (CodecId == CAB_CODEC_MSZIP))
+        return SubmitDataBlock();
+
+    /* Blocks are written in order, so the queued ones go first */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     if (!BlockIsSplit)
     {
         Status = Codec->Compress(OutputBuffer,
             InputBuffer,
             CurrentIBufferSize,
             &TotalCompSize);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)Status));
+            return (Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+        }
 
         DPRINT(MAX_TRACE, ("Block compressed. CurrentIBufferSize (%u)  TotalCompSize(%u).\n",
             (UINT)CurrentIBufferSize, (UINT)TotalCompSize));
@@ -3062,6 +3221,124 @@ ULONG CCabinet::WriteDataBlock()
     return CAB_STATUS_SUCCESS;
 }
 
+
+ULONG CCabinet::SubmitDataBlock()
+/*
+ * FUNCTION: Queues the current data block for compression by another thread
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCFDATA_NODE DataNode;
+    ULONG Status;
+
+    if (!CompressionQueue)
+    {
+        CompressionQueue = new CCompressionQueue;
+        Status = CompressionQueue->Start(CodecId, ThreadCount);
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+    }
+
+    /* Make room by writing the oldest block */
+    if (CompressionQueue->IsFull())
+    {
+        Status = RetireDataBlock();
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+    }
+
+    /* The node is created now to keep the blocks in order */
+    DataNode = NewDataNode(CurrentFolderNode);
+    if (!DataNode)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    DataNode->Data.Checksum   = 0;
+    DataNode->Data.UncompSize = (USHORT)CurrentIBufferSize;
+
+    DiskSize += sizeof(CFDATA);
+
+    LastBlockStart += CurrentIBufferSize;
+
+    CompressionQueue->Submit(CurrentFolderNode, DataNode, InputBuffer, CurrentIBufferSize);
+
+    CurrentIBufferSize = 0;
+    CurrentIBuffer     = InputBuffer;
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::RetireDataBlock()
+/*
+ * FUNCTION: Writes the oldest queued data block to the scratch file
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCOMPRESSION_JOB Job;
+    ULONG BytesWritten;
+    ULONG Status;
+
+    Job = CompressionQueue->WaitOldest();
+    if (!Job)
+        return CAB_STATUS_SUCCESS;
+
+    if (Job->Status != CS_SUCCESS)
+    {
+        DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)Job->Status));
+        return (Job->Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+    }
+
+    Job->DataNode->Data.CompSize = (USHORT)Job->OutputLength;
+    Job->DataNode->ScratchFilePosition = ScratchFile->Position();
+
+    DPRINT(MAX_TRACE, ("Writing block. Checksum (0x%X)  CompSize (%u)  UncompSize (%u).\n",
+        (UINT)Job->DataNode->Data.Checksum,
+        Job->DataNode->Data.CompSize,
+        Job->DataNode->Data.UncompSize));
+
+    Status = ScratchFile->WriteBlock(&Job->DataNode->Data,
+        Job->OutputBuffer, &BytesWritten);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
+    DiskSize += BytesWritten;
+
+    Job->FolderNode->TotalFolderSize += (BytesWritten + sizeof(CFDATA));
+    Job->FolderNode->Folder.DataBlockCount++;
+
+    CompressionQueue->RemoveOldest();
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::FlushDataBlocks()
+/*
+ * FUNCTION: Writes all queued data blocks to the scratch file
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Status;
+
+    if (!CompressionQueue)
+        return CAB_STATUS_SUCCESS;
+
+    while (!CompressionQueue->IsEmpty())
+    {
+        Status = RetireDataBlock();
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
 #if !defined(_WIN32)
 
 void CCabinet::ConvertDateAndTime(time_t* Time,
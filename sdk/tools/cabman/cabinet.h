@@ -102,6 +102,7 @@ extern ULONG DebugTraceLevel;
 #define CAB_SIGNATURE        0x4643534D // "MSCF"
 #define CAB_VERSION          0x0103
 #define CAB_BLOCKSIZE        32768
+#define CAB_MAX_COMPSIZE     (CAB_BLOCKSIZE + 6144) // LZX may expand a block by this much
 
 #define CAB_COMP_MASK        0x00FF
 #define CAB_COMP_NONE        0x0000
@@ -261,6 +262,11 @@ typedef struct _CAB_SEARCH
 
 /* Codecs */
 
+/* Codec status codes */
+#define CS_SUCCESS      0x0000  /* All data consumed */
+#define CS_NOMEMORY     0x0001  /* Not enough free memory */
+#define CS_BADSTREAM    0x0002  /* Bad data stream */
+
 class CCABCodec
 {
 public:
@@ -268,6 +274,8 @@ public:
     CCABCodec() {};
     /* Default destructor */
     virtual ~CCABCodec() {};
+    /* Starts a new folder, for codecs that keep state between data blocks */
+    virtual ULONG Reset(USHORT CompressionType) { return CS_SUCCESS; };
     /* Compresses a data block */
     virtual ULONG Compress(void* OutputBuffer,
                            void* InputBuffer,
@@ -281,23 +289,22 @@ public:
 };
 
 
-/* Codec status codes */
-#define CS_SUCCESS      0x0000  /* All data consumed */
-#define CS_NOMEMORY     0x0001  /* Not enough free memory */
-#define CS_BADSTREAM    0x0002  /* Bad data stream */
-
-
 /* Codec indentifiers */
 #define CAB_CODEC_RAW   0x00
 #define CAB_CODEC_LZX   0x01
 #define CAB_CODEC_MSZIP 0x02
 
+/* Creates a codec engine */
+CCABCodec* CreateCodec(LONG Id);
+
 
 
 /* Classes */
 
 #ifndef CAB_READ_ONLY
 
+class CCompressionQueue;
+
 class CCFDATAStorage
 {
 public:
@@ -396,6 +403,8 @@ public:
     ULONG AddFile(char* FileName);
     /* Sets the maximum size of the current disk */
     void SetMaxDiskSize(ULONG Size);
+    /* Sets the number of threads compressing data blocks */
+    void SetThreadCount(ULONG Count);
 #endif /* CAB_READ_ONLY */
 
     /* Default event handlers */
@@ -421,6 +430,7 @@ private:
     ULONG ReadString(char* String, LONG MaxLength);
     ULONG ReadFileTable();
     ULONG ReadDataBlocks(PCFFOLDER_NODE FolderNode);
+    ULONG ReplayDataBlocks(PCFDATA_NODE StopNode, PUCHAR Buffer);
     PCFFOLDER_NODE NewFolderNode();
     PCFFILE_NODE NewFileNode();
     PCFDATA_NODE NewDataNode(PCFFOLDER_NODE FolderNode);
@@ -439,6 +449,9 @@ private:
     ULONG WriteFileEntries();
     ULONG CommitDataBlocks(PCFFOLDER_NODE FolderNode);
     ULONG WriteDataBlock();
+    ULONG SubmitDataBlock();
+    ULONG RetireDataBlock();
+    ULONG FlushDataBlocks();
     ULONG GetAttributesOnFile(PCFFILE_NODE File);
     ULONG SetAttributesOnFile(char* FileName, USHORT FileAttributes);
     ULONG GetFileTimes(FILE* FileHandle, PCFFILE_NODE File);
@@ -504,6 +517,8 @@ private:
     ULONG TotalBytesLeft;
     bool BlockIsSplit;                  // true if current data block is split
     ULONG NextFolderNumber;     // Zero based folder number
+    ULONG ThreadCount;
+    CCompressionQueue *CompressionQueue; // Data blocks being compressed by other threads
 #endif /* CAB_READ_ONLY */
 };
 
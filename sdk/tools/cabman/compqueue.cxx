@@ -0,0 +1,229 @@
+/*
+ * PROJECT:     ReactOS cabinet manager
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Queue of data blocks compressed by worker threads
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ * NOTES:       Blocks are compressed in any order but retired in the order
+ *              they were submitted, so the cabinet is the same as with a
+ *              single thread. Only codecs that compress each block on its
+ *              own can be used here.
+ */
+#include "compqueue.h"
+
+
+/* CCompressionQueue */
+
+CCompressionQueue::CCompressionQueue()
+/*
+ * FUNCTION: Default constructor
+ */
+{
+    Jobs      = NULL;
+    SlotCount = 0;
+    Head      = 0;
+    Pending   = 0;
+    Tail      = 0;
+    Stopping  = false;
+}
+
+
+CCompressionQueue::~CCompressionQueue()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    Stop();
+}
+
+
+ULONG CCompressionQueue::Start(LONG CodecId, ULONG ThreadCount)
+/*
+ * FUNCTION: Starts the worker threads
+ * ARGUMENTS:
+ *     CodecId     = Codec identifier
+ *     ThreadCount = Number of worker threads
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    CCABCodec* Codec;
+    ULONG i;
+
+    /* Two slots per thread keep the workers busy while the oldest block is written */
+    SlotCount = ThreadCount * 2;
+    Jobs = (PCOMPRESSION_JOB)calloc(SlotCount, sizeof(COMPRESSION_JOB));
+    if (!Jobs)
+        return CAB_STATUS_NOMEMORY;
+
+    for (i = 0; i < SlotCount; i++)
+    {
+        Jobs[i].InputBuffer  = (PUCHAR)malloc(CAB_BLOCKSIZE);
+        Jobs[i].OutputBuffer = (PUCHAR)malloc(CAB_MAX_COMPSIZE);
+        if (!Jobs[i].InputBuffer || !Jobs[i].OutputBuffer)
+            return CAB_STATUS_NOMEMORY;
+    }
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Codec = CreateCodec(CodecId);
+        if (!Codec)
+            return CAB_STATUS_UNSUPPCOMP;
+        Codecs.push_back(Codec);
+        Threads.push_back(std::thread(&CCompressionQueue::Worker, this, Codec));
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+void CCompressionQueue::Stop()
+/*
+ * FUNCTION: Stops the worker threads, dropping jobs that were not retired
+ */
+{
+    ULONG i;
+
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Stopping = true;
+    }
+    WorkAvailable.notify_all();
+
+    for (i = 0; i < Threads.size(); i++)
+        Threads[i].join();
+    Threads.clear();
+
+    for (i = 0; i < Codecs.size(); i++)
+        delete Codecs[i];
+    Codecs.clear();
+
+    if (Jobs)
+    {
+        for (i = 0; i < SlotCount; i++)
+        {
+            free(Jobs[i].InputBuffer);
+            free(Jobs[i].OutputBuffer);
+        }
+        free(Jobs);
+        Jobs = NULL;
+    }
+}
+
+
+bool CCompressionQueue::IsFull()
+/*
+ * FUNCTION: Returns whether all slots hold unretired jobs
+ */
+{
+    std::lock_guard<std::mutex> Guard(Lock);
+    return (Tail - Head == SlotCount);
+}
+
+
+bool CCompressionQueue::IsEmpty()
+/*
+ * FUNCTION: Returns whether there are no unretired jobs
+ */
+{
+    std::lock_guard<std::mutex> Guard(Lock);
+    return (Tail == Head);
+}
+
+
+void CCompressionQueue::Submit(PCFFOLDER_NODE FolderNode,
+                               PCFDATA_NODE DataNode,
+                               void* Buffer,
+                               ULONG Length)
+/*
+ * FUNCTION: Queues a copy of a block for compression
+ * ARGUMENTS:
+ *     FolderNode = Pointer to folder node the block belongs to
+ *     DataNode   = Pointer to data node of the block
+ *     Buffer     = Pointer to buffer with data to be compressed
+ *     Length     = Length of buffer
+ * NOTES:
+ *     The queue must not be full
+ */
+{
+    PCOMPRESSION_JOB Job;
+
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+
+        ASSERT(Tail - Head < SlotCount);
+
+        Job = &Jobs[Tail % SlotCount];
+        Job->FolderNode  = FolderNode;
+        Job->DataNode    = DataNode;
+        Job->InputLength = Length;
+        Job->Done        = false;
+        memcpy(Job->InputBuffer, Buffer, Length);
+        Tail++;
+    }
+    WorkAvailable.notify_one();
+}
+
+
+PCOMPRESSION_JOB CCompressionQueue::WaitOldest()
+/*
+ * FUNCTION: Waits for the oldest job to complete
+ * RETURNS:
+ *     Pointer to the job, or NULL if the queue is empty
+ */
+{
+    std::unique_lock<std::mutex> Guard(Lock);
+    PCOMPRESSION_JOB Job;
+
+    if (Tail == Head)
+        return NULL;
+
+    Job = &Jobs[Head % SlotCount];
+    WorkDone.wait(Guard, [Job] { return Job->Done; });
+    return Job;
+}
+
+
+void CCompressionQueue::RemoveOldest()
+/*
+ * FUNCTION: Frees the slot of the oldest job
+ */
+{
+    std::lock_guard<std::mutex> Guard(Lock);
+
+    ASSERT(Tail != Head && Jobs[Head % SlotCount].Done);
+    Head++;
+}
+
+
+void CCompressionQueue::Worker(CCABCodec* Codec)
+/*
+ * FUNCTION: Compresses queued jobs until the queue is stopped
+ * ARGUMENTS:
+ *     Codec = Codec engine owned by this thread
+ */
+{
+    std::unique_lock<std::mutex> Guard(Lock);
+    PCOMPRESSION_JOB Job;
+
+    for (;;)
+    {
+        WorkAvailable.wait(Guard, [this] { return Stopping || Pending != Tail; });
+        if (Stopping)
+            return;
+
+        Job = &Jobs[Pending % SlotCount];
+        Pending++;
+
+        Guard.unlock();
+        Job->Status = Codec->Compress(Job->OutputBuffer,
+                                      Job->InputBuffer,
+                                      Job->InputLength,
+                                      &Job->OutputLength);
+        Guard.lock();
+
+        Job->Done = true;
+        WorkDone.notify_all();
+    }
+}
+
+/* EOF */
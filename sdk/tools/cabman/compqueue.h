@@ -0,0 +1,69 @@
+/*
+ * PROJECT:     ReactOS cabinet manager
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Queue of data blocks compressed by worker threads
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#include "cabinet.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef struct _COMPRESSION_JOB
+{
+    PCFFOLDER_NODE FolderNode;      // Folder the block belongs to
+    PCFDATA_NODE DataNode;          // Data node, created in submission order
+    PUCHAR InputBuffer;
+    PUCHAR OutputBuffer;
+    ULONG InputLength;
+    ULONG OutputLength;
+    ULONG Status;                   // Codec status (CS_*)
+    bool Done;
+} COMPRESSION_JOB, *PCOMPRESSION_JOB;
+
+
+/* Classes */
+
+class CCompressionQueue
+{
+public:
+    /* Default constructor */
+    CCompressionQueue();
+    /* Default destructor */
+    virtual ~CCompressionQueue();
+    /* Starts the worker threads */
+    ULONG Start(LONG CodecId, ULONG ThreadCount);
+    /* Stops the worker threads */
+    void Stop();
+    /* Returns whether all slots hold unretired jobs */
+    bool IsFull();
+    /* Returns whether there are no unretired jobs */
+    bool IsEmpty();
+    /* Queues a copy of a block for compression */
+    void Submit(PCFFOLDER_NODE FolderNode, PCFDATA_NODE DataNode, void* Buffer, ULONG Length);
+    /* Waits for the oldest job to complete */
+    PCOMPRESSION_JOB WaitOldest();
+    /* Frees the slot of the oldest job */
+    void RemoveOldest();
+private:
+    void Worker(CCABCodec* Codec);
+
+    std::vector<std::thread> Threads;
+    std::vector<CCABCodec*> Codecs;
+    PCOMPRESSION_JOB Jobs;
+    ULONG SlotCount;
+    ULONG Head;                     // Oldest unretired job
+    ULONG Pending;                  // Next job to be picked by a worker
+    ULONG Tail;                     // Next free slot
+    bool Stopping;
+    std::mutex Lock;
+    std::condition_variable WorkAvailable;
+    std::condition_variable WorkDone;
+};
+
+/* EOF */
@@ -0,0 +1,1274 @@
+/*
+ * PROJECT:     ReactOS cabinet manager
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     CAB codec for LZX compressed data
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ * NOTES:       The compressor emits one verbatim or uncompressed block per
+ *              32 KiB frame, so every CFDATA block holds exactly one frame.
+ *              The decompressor reads any conforming stream, including
+ *              aligned offset blocks and E8 translated data.
+ */
+#include "lzx.h"
+
+/* Position slot tables, shared by the compressor and the decompressor */
+static ULONG PositionBase[LZX_MAX_POSITION_SLOTS + 1];
+static UCHAR ExtraBits[LZX_MAX_POSITION_SLOTS + 1];
+static const UCHAR PositionSlotCount[] = { 30, 32, 34, 36, 38, 42, 50 };
+static bool TablesInitialized = false;
+
+static void InitTables()
+{
+    ULONG i;
+
+    if (TablesInitialized)
+        return;
+
+    PositionBase[0] = 0;
+    for (i = 0; i <= LZX_MAX_POSITION_SLOTS; i++)
+    {
+        ExtraBits[i] = (UCHAR)((i < 4) ? 0 : ((i - 2) / 2 > 17 ? 17 : (i - 2) / 2));
+        if (i < LZX_MAX_POSITION_SLOTS)
+            PositionBase[i + 1] = PositionBase[i] + (1 << ExtraBits[i]);
+    }
+    TablesInitialized = true;
+}
+
+static ULONG GetPositionSlot(ULONG FormattedOffset)
+{
+    ULONG Low = 0, High = LZX_MAX_POSITION_SLOTS - 1, Middle;
+
+    while (Low < High)
+    {
+        Middle = (Low + High + 1) / 2;
+        if (PositionBase[Middle] <= FormattedOffset)
+            Low = Middle;
+        else
+            High = Middle - 1;
+    }
+    return Low;
+}
+
+
+/* Huffman trees */
+
+typedef struct _LZX_LEAF
+{
+    ULONG Frequency;
+    USHORT Symbol;
+} LZX_LEAF, *PLZX_LEAF;
+
+static int CompareLeaves(const void* A, const void* B)
+{
+    const LZX_LEAF* LeafA = (const LZX_LEAF*)A;
+    const LZX_LEAF* LeafB = (const LZX_LEAF*)B;
+
+    if (LeafA->Frequency != LeafB->Frequency)
+        return (LeafA->Frequency < LeafB->Frequency) ? -1 : 1;
+    return (int)LeafA->Symbol - (int)LeafB->Symbol;
+}
+
+static void BuildLengths(const ULONG* Frequencies,
+                         ULONG Count,
+                         PUCHAR Lengths,
+                         ULONG MaxLength)
+/*
+ * FUNCTION: Computes length limited Huffman code lengths
+ * NOTES:
+ *     The decoders refuse incomplete codes, so a tree with less than
+ *     two used symbols still gets two codes of one bit
+ */
+{
+    LZX_LEAF Leaves[LZX_MAINTREE_MAXSYMBOLS];
+    ULONG Weight[LZX_MAINTREE_MAXSYMBOLS * 2];
+    ULONG Parent[LZX_MAINTREE_MAXSYMBOLS * 2];
+    UCHAR Depth[LZX_MAINTREE_MAXSYMBOLS * 2];
+    ULONG Scaled[LZX_MAINTREE_MAXSYMBOLS];
+    ULONG Used, Leaf, Node, Next, Pick, i, j;
+    ULONG Longest;
+
+    memset(Lengths, 0, Count);
+    memcpy(Scaled, Frequencies, Count * sizeof(ULONG));
+
+    for (;;)
+    {
+        Used = 0;
+        for (i = 0; i < Count; i++)
+        {
+            if (Scaled[i] != 0)
+            {
+                Leaves[Used].Frequency = Scaled[i];
+                Leaves[Used].Symbol = (USHORT)i;
+                Used++;
+            }
+        }
+
+        if (Used < 2)
+        {
+            i = (Used == 1) ? Leaves[0].Symbol : 0;
+            Lengths[i] = 1;
+            Lengths[(i == 0) ? 1 : 0] = 1;
+            return;
+        }
+
+        qsort(Leaves, Used, sizeof(LZX_LEAF), CompareLeaves);
+
+        /* Leaves and inner nodes are both taken in ascending order */
+        for (i = 0; i < Used; i++)
+            Weight[i] = Leaves[i].Frequency;
+        Leaf = 0;
+        Node = Used;
+        for (Next = Used; Next < Used * 2 - 1; Next++)
+        {
+            Weight[Next] = 0;
+            for (j = 0; j < 2; j++)
+            {
+                if (Leaf < Used && (Node >= Next || Weight[Leaf] <= Weight[Node]))
+                    Pick = Leaf++;
+                else
+                    Pick = Node++;
+                Weight[Next] += Weight[Pick];
+                Parent[Pick] = Next;
+            }
+        }
+
+        Depth[Used * 2 - 2] = 0;
+        Longest = 0;
+        for (i = Used * 2 - 2; i-- > 0;)
+        {
+            Depth[i] = Depth[Parent[i]] + 1;
+            if (i < Used && Depth[i] > Longest)
+                Longest = Depth[i];
+        }
+
+        if (Longest <= MaxLength)
+        {
+            for (i = 0; i < Used; i++)
+                Lengths[Leaves[i].Symbol] = Depth[i];
+            return;
+        }
+
+        /* Flatten the distribution and try again */
+        for (i = 0; i < Count; i++)
+        {
+            if (Scaled[i] != 0)
+                Scaled[i] = (Scaled[i] >> 1) | 1;
+        }
+    }
+}
+
+static void BuildCodes(const UCHAR* Lengths, ULONG Count, PUSHORT Codes)
+/*
+ * FUNCTION: Assigns canonical codes, shorter codes and lower symbols first
+ */
+{
+    ULONG LengthCount[LZX_MAX_CODE_LENGTH + 1];
+    ULONG NextCode[LZX_MAX_CODE_LENGTH + 1];
+    ULONG Code, i;
+
+    memset(LengthCount, 0, sizeof(LengthCount));
+    for (i = 0; i < Count; i++)
+        LengthCount[Lengths[i]]++;
+    LengthCount[0] = 0;
+
+    Code = 0;
+    for (i = 1; i <= LZX_MAX_CODE_LENGTH; i++)
+    {
+        Code = (Code + LengthCount[i - 1]) << 1;
+        NextCode[i] = Code;
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Lengths[i] != 0)
+            Codes[i] = (USHORT)NextCode[Lengths[i]]++;
+    }
+}
+
+static bool BuildDecodeTable(const UCHAR* Lengths, ULONG Count, PLZX_DECODE_TABLE Table, bool* Empty)
+/*
+ * FUNCTION: Builds a decoding table for a canonical Huffman code
+ * RETURNS:
+ *     false if the code is not complete
+ */
+{
+    USHORT NextCode[LZX_MAX_CODE_LENGTH + 1];
+    ULONG Index, Code, Fill, i;
+    LONG Left;
+
+    memset(Table->Count, 0, sizeof(Table->Count));
+    for (i = 0; i < Count; i++)
+        Table->Count[Lengths[i]]++;
+    Table->Count[0] = 0;
+
+    Left = 1;
+    Code = 0;
+    Index = 0;
+    for (i = 1; i <= LZX_MAX_CODE_LENGTH; i++)
+    {
+        Left = Left * 2 - Table->Count[i];
+        if (Left < 0)
+            return false;
+        Code = (Code + Table->Count[i - 1]) << 1;
+        Table->FirstCode[i] = (USHORT)Code;
+        Table->FirstIndex[i] = (USHORT)Index;
+        NextCode[i] = (USHORT)Code;
+        Index += Table->Count[i];
+    }
+
+    *Empty = (Index == 0);
+    if (Left != 0 && Index != 0)
+        return false;
+
+    memset(Table->Fast, 0, sizeof(Table->Fast));
+    for (i = 0; i < Count; i++)
+    {
+        if (Lengths[i] == 0)
+            continue;
+
+        Table->Sorted[Table->FirstIndex[Lengths[i]] + NextCode[Lengths[i]] - Table->FirstCode[Lengths[i]]] = (USHORT)i;
+
+        if (Lengths[i] <= LZX_FAST_BITS)
+        {
+            Code = (ULONG)NextCode[Lengths[i]] << (LZX_FAST_BITS - Lengths[i]);
+            for (Fill = 0; Fill < (1UL << (LZX_FAST_BITS - Lengths[i])); Fill++)
+                Table->Fast[Code + Fill] = (USHORT)(i | (Lengths[i] << 11));
+        }
+        NextCode[Lengths[i]]++;
+    }
+    return true;
+}
+
+
+/* CLZXCodec */
+
+CLZXCodec::CLZXCodec()
+/*
+ * FUNCTION: Default constructor
+ */
+{
+    InitTables();
+
+    WindowBits = 0;
+    WindowSize = 0;
+    History    = NULL;
+    HashHead   = NULL;
+    HashPrev   = NULL;
+    Window     = NULL;
+}
+
+
+CLZXCodec::~CLZXCodec()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    FreeWindow();
+}
+
+
+void CLZXCodec::FreeWindow()
+{
+    free(History);
+    free(HashHead);
+    free(HashPrev);
+    free(Window);
+    History  = NULL;
+    HashHead = NULL;
+    HashPrev = NULL;
+    Window   = NULL;
+}
+
+
+ULONG CLZXCodec::Reset(USHORT CompressionType)
+/*
+ * FUNCTION: Starts a new folder
+ * ARGUMENTS:
+ *     CompressionType = Folder compression type, which holds the window size
+ */
+{
+    ULONG Bits = (CompressionType >> 8) & 0x1F;
+
+    if (Bits < LZX_MIN_WINDOW_BITS || Bits > LZX_MAX_WINDOW_BITS)
+        return CS_BADSTREAM;
+
+    if (Bits != WindowBits)
+    {
+        FreeWindow();
+        WindowBits = Bits;
+        WindowSize = 1 << Bits;
+    }
+
+    PositionSlots = PositionSlotCount[Bits - LZX_MIN_WINDOW_BITS];
+    MainElements  = LZX_NUM_CHARS + PositionSlots * 8;
+
+    R0 = R1 = R2 = 1;
+    memset(MainLengths, 0, sizeof(MainLengths));
+    memset(LengthLengths, 0, sizeof(LengthLengths));
+    HeaderDone = false;
+
+    HistoryFill = 0;
+    HashPos     = 0;
+    if (HashHead)
+        memset(HashHead, 0xFF, sizeof(LONG) << LZX_HASH_BITS);
+
+    WindowPos      = 0;
+    FramePos       = 0;
+    FrameCount     = 0;
+    BlockType      = 0;
+    BlockLength    = 0;
+    BlockRemaining = 0;
+    IntelFileSize  = 0;
+    IntelCurPos    = 0;
+    IntelStarted   = false;
+
+    return CS_SUCCESS;
+}
+
+
+/* Compressor */
+
+bool CLZXCodec::AllocateHistory()
+{
+    History  = (PUCHAR)malloc(WindowSize * 2);
+    HashHead = (PLONG)malloc(sizeof(LONG) << LZX_HASH_BITS);
+    HashPrev = (PLONG)malloc(sizeof(LONG) * WindowSize * 2);
+    if (!History || !HashHead || !HashPrev)
+        return false;
+
+    memset(HashHead, 0xFF, sizeof(LONG) << LZX_HASH_BITS);
+    return true;
+}
+
+
+void CLZXCodec::SlideHistory()
+/*
+ * FUNCTION: Drops everything but the last window of input
+ */
+{
+    ULONG Delta = HistoryFill - WindowSize;
+    ULONG i;
+
+    memmove(History, History + Delta, WindowSize);
+    memmove(HashPrev, HashPrev + Delta, WindowSize * sizeof(LONG));
+    for (i = 0; i < (1UL << LZX_HASH_BITS); i++)
+        HashHead[i] = (HashHead[i] >= (LONG)Delta) ? HashHead[i] - (LONG)Delta : -1;
+    for (i = 0; i < WindowSize; i++)
+        HashPrev[i] = (HashPrev[i] >= (LONG)Delta) ? HashPrev[i] - (LONG)Delta : -1;
+
+    HistoryFill -= Delta;
+    HashPos -= Delta;
+}
+
+
+static inline ULONG HashBytes(const UCHAR* Data)
+{
+    return ((Data[0] | (Data[1] << 8) | (Data[2] << 16)) * 2654435761U) >> (32 - LZX_HASH_BITS);
+}
+
+
+void CLZXCodec::InsertUpTo(ULONG Position)
+{
+    ULONG Hash;
+
+    while (HashPos < Position && HashPos + 2 < HistoryFill)
+    {
+        Hash = HashBytes(&History[HashPos]);
+        HashPrev[HashPos] = HashHead[Hash];
+        HashHead[Hash] = (LONG)HashPos;
+        HashPos++;
+    }
+}
+
+
+ULONG CLZXCodec::FindMatch(ULONG Position, ULONG End, PULONG Distance)
+/*
+ * FUNCTION: Finds the longest match in the hash chain of a position
+ */
+{
+    ULONG MaxLength, Length, Best = 0, Chain = LZX_MAX_CHAIN;
+    LONG Candidate, Limit;
+    PUCHAR Current = &History[Position];
+    PUCHAR Match;
+
+    if (Position + 3 > End)
+        return 0;
+
+    MaxLength = End - Position;
+    if (MaxLength > LZX_MAX_MATCH)
+        MaxLength = LZX_MAX_MATCH;
+
+    Limit = (LONG)Position - (LONG)(WindowSize - 3);
+    Candidate = HashHead[HashBytes(Current)];
+    while (Candidate >= 0 && Candidate >= Limit && Chain-- > 0)
+    {
+        Match = &History[Candidate];
+        if (Match[Best] == Current[Best] && Match[0] == Current[0] && Match[1] == Current[1])
+        {
+            for (Length = 2; Length < MaxLength && Match[Length] == Current[Length]; Length++);
+            if (Length > Best)
+            {
+                Best = Length;
+                *Distance = Position - Candidate;
+                if (Length == MaxLength)
+                    break;
+            }
+        }
+        Candidate = HashPrev[Candidate];
+    }
+
+    return (Best >= 3) ? Best : 0;
+}
+
+
+ULONG CLZXCodec::RepeatMatch(ULONG Position, ULONG End, ULONG Distance)
+{
+    ULONG MaxLength, Length;
+    PUCHAR Current = &History[Position];
+    PUCHAR Match = Current - Distance;
+
+    if (Distance > Position)
+        return 0;
+
+    MaxLength = End - Position;
+    if (MaxLength > LZX_MAX_MATCH)
+        MaxLength = LZX_MAX_MATCH;
+
+    for (Length = 0; Length < MaxLength && Match[Length] == Current[Length]; Length++);
+    return Length;
+}
+
+
+ULONG CLZXCodec::BestMatch(ULONG Position, ULONG End, PULONG FormattedOffset)
+/*
+ * FUNCTION: Picks what to code at a position
+ * RETURNS:
+ *     Match length, or 0 for a literal
+ * NOTES:
+ *     Repeated offsets cost no extra bits, so they win over slightly
+ *     longer matches
+ */
+{
+    ULONG Repeats[3] = { R0, R1, R2 };
+    ULONG RepeatLength = 0, RepeatIndex = 0;
+    ULONG Length, Distance = 0, i;
+
+    for (i = 0; i < 3; i++)
+    {
+        Length = RepeatMatch(Position, End, Repeats[i]);
+        if (Length > RepeatLength)
+        {
+            RepeatLength = Length;
+            RepeatIndex = i;
+        }
+    }
+
+    Length = FindMatch(Position, End, &Distance);
+    if (Length == 3 && Distance > 8192)
+        Length = 0;
+
+    if (RepeatLength >= LZX_MIN_MATCH && RepeatLength + 1 >= Length)
+    {
+        *FormattedOffset = RepeatIndex;
+        return RepeatLength;
+    }
+
+    if (Length != 0)
+    {
+        *FormattedOffset = Distance + 2;
+        return Length;
+    }
+
+    return 0;
+}
+
+
+void CLZXCodec::AddMatch(ULONG FormattedOffset, ULONG Length)
+{
+    ULONG Slot, Header, Offset;
+
+    Matches[MatchCount].Offset = FormattedOffset;
+    Matches[MatchCount].Length = (USHORT)Length;
+    MatchCount++;
+
+    /* Update the repeated offsets like the decoder does */
+    switch (FormattedOffset)
+    {
+        case 0:
+            break;
+
+        case 1:
+            Offset = R1; R1 = R0; R0 = Offset;
+            break;
+
+        case 2:
+            Offset = R2; R2 = R0; R0 = Offset;
+            break;
+
+        default:
+            R2 = R1; R1 = R0; R0 = FormattedOffset - 2;
+            break;
+    }
+
+    Slot = GetPositionSlot(FormattedOffset);
+    Header = Length - LZX_MIN_MATCH;
+    if (Header >= LZX_NUM_PRIMARY_LENGTHS)
+    {
+        LengthFreq[Header - LZX_NUM_PRIMARY_LENGTHS]++;
+        Header = LZX_NUM_PRIMARY_LENGTHS;
+    }
+    MainFreq[LZX_NUM_CHARS + Slot * 8 + Header]++;
+    ExtraBitsTotal += ExtraBits[Slot];
+}
+
+
+void CLZXCodec::ParseFrame(ULONG Start, ULONG End)
+/*
+ * FUNCTION: Turns a frame into literals and matches, with one step of lazy matching
+ */
+{
+    ULONG Position = Start;
+    ULONG Length, NextLength, Offset, NextOffset;
+
+    MatchCount = 0;
+    ExtraBitsTotal = 0;
+    memset(MainFreq, 0, sizeof(MainFreq));
+    memset(LengthFreq, 0, sizeof(LengthFreq));
+
+    while (Position < End)
+    {
+        InsertUpTo(Position);
+        Length = BestMatch(Position, End, &Offset);
+
+        if (Length != 0 && Length < 32 && Position + 1 < End)
+        {
+            InsertUpTo(Position + 1);
+            NextLength = BestMatch(Position + 1, End, &NextOffset);
+            if (NextLength > Length)
+                Length = 0;
+        }
+
+        if (Length == 0)
+        {
+            Matches[MatchCount].Offset = History[Position];
+            Matches[MatchCount].Length = 0;
+            MatchCount++;
+            MainFreq[History[Position]]++;
+            Position++;
+        }
+        else
+        {
+            AddMatch(Offset, Length);
+            Position += Length;
+        }
+    }
+}
+
+
+void CLZXCodec::WriteBits(ULONG Count, ULONG Bits)
+/*
+ * FUNCTION: Writes up to 17 bits, as little endian 16-bit words filled from the top
+ */
+{
+    if (Count == 0)
+        return;
+
+    BitBuffer = (BitBuffer << Count) | Bits;
+    BitCount += Count;
+    while (BitCount >= 16)
+    {
+        BitCount -= 16;
+        *OutputPtr++ = (UCHAR)(BitBuffer >> BitCount);
+        *OutputPtr++ = (UCHAR)(BitBuffer >> (BitCount + 8));
+    }
+}
+
+
+void CLZXCodec::AlignOutput()
+{
+    if (BitCount != 0)
+        WriteBits(16 - BitCount, 0);
+}
+
+
+ULONG CLZXCodec::WriteLengths(PUCHAR Previous,
+                              PUCHAR Lengths,
+                              ULONG First,
+                              ULONG Last,
+                              bool CountOnly)
+/*
+ * FUNCTION: Writes a range of code lengths through a pretree
+ * ARGUMENTS:
+ *     Previous  = Code lengths of the previous block, which are delta coded against
+ *     Lengths   = New code lengths
+ *     First     = First symbol of the range
+ *     Last      = End of the range
+ *     CountOnly = true to only compute the size
+ * RETURNS:
+ *     Number of bits needed
+ */
+{
+    USHORT Tokens[LZX_MAINTREE_MAXSYMBOLS];
+    UCHAR TokenExtra[LZX_MAINTREE_MAXSYMBOLS];
+    ULONG PreFreq[LZX_PRETREE_NUM_ELEMENTS];
+    UCHAR PreLengths[LZX_PRETREE_NUM_ELEMENTS];
+    USHORT PreCodes[LZX_PRETREE_NUM_ELEMENTS];
+    ULONG TokenCount = 0, Bits, Run, Chunk, i;
+
+    memset(PreFreq, 0, sizeof(PreFreq));
+
+    i = First;
+    while (i < Last)
+    {
+        if (Lengths[i] == 0)
+        {
+            for (Run = 0; i + Run < Last && Lengths[i + Run] == 0; Run++);
+            if (Run >= 4)
+            {
+                while (Run >= 20)
+                {
+                    Chunk = (Run > 51) ? 51 : Run;
+                    Tokens[TokenCount] = 18;
+                    TokenExtra[TokenCount++] = (UCHAR)(Chunk - 20);
+                    i += Chunk;
+                    Run -= Chunk;
+                }
+                if (Run >= 4)
+                {
+                    Tokens[TokenCount] = 17;
+                    TokenExtra[TokenCount++] = (UCHAR)(Run - 4);
+                    i += Run;
+                }
+                continue;
+            }
+        }
+
+        Tokens[TokenCount] = (USHORT)((Previous[i] + 17 - Lengths[i]) % 17);
+        TokenExtra[TokenCount++] = 0;
+        i++;
+    }
+
+    for (i = 0; i < TokenCount; i++)
+        PreFreq[Tokens[i]]++;
+    BuildLengths(PreFreq, LZX_PRETREE_NUM_ELEMENTS, PreLengths, LZX_MAX_PRETREE_LENGTH);
+    BuildCodes(PreLengths, LZX_PRETREE_NUM_ELEMENTS, PreCodes);
+
+    Bits = LZX_PRETREE_NUM_ELEMENTS * 4;
+    for (i = 0; i < TokenCount; i++)
+    {
+        Bits += PreLengths[Tokens[i]];
+        if (Tokens[i] == 17)
+            Bits += 4;
+        else if (Tokens[i] == 18)
+            Bits += 5;
+    }
+
+    if (CountOnly)
+        return Bits;
+
+    for (i = 0; i < LZX_PRETREE_NUM_ELEMENTS; i++)
+        WriteBits(4, PreLengths[i]);
+
+    for (i = 0; i < TokenCount; i++)
+    {
+        WriteBits(PreLengths[Tokens[i]], PreCodes[Tokens[i]]);
+        if (Tokens[i] == 17)
+            WriteBits(4, TokenExtra[i]);
+        else if (Tokens[i] == 18)
+            WriteBits(5, TokenExtra[i]);
+    }
+
+    return Bits;
+}
+
+
+void CLZXCodec::WriteVerbatimBlock(ULONG Length)
+{
+    ULONG Slot, Header, Symbol, i;
+
+    WriteBits(3, LZX_BLOCKTYPE_VERBATIM);
+    WriteBits(16, Length >> 8);
+    WriteBits(8, Length & 0xFF);
+
+    WriteLengths(MainLengths, NewMainLengths, 0, LZX_NUM_CHARS, false);
+    WriteLengths(MainLengths, NewMainLengths, LZX_NUM_CHARS, MainElements, false);
+    WriteLengths(LengthLengths, NewLengthLengths, 0, LZX_NUM_SECONDARY_LENGTHS, false);
+    memcpy(MainLengths, NewMainLengths, sizeof(MainLengths));
+    memcpy(LengthLengths, NewLengthLengths, sizeof(LengthLengths));
+
+    for (i = 0; i < MatchCount; i++)
+    {
+        if (Matches[i].Length == 0)
+        {
+            Symbol = Matches[i].Offset;
+            WriteBits(MainLengths[Symbol], MainCodes[Symbol]);
+            continue;
+        }
+
+        Slot = GetPositionSlot(Matches[i].Offset);
+        Header = Matches[i].Length - LZX_MIN_MATCH;
+        if (Header > LZX_NUM_PRIMARY_LENGTHS)
+            Header = LZX_NUM_PRIMARY_LENGTHS;
+
+        Symbol = LZX_NUM_CHARS + Slot * 8 + Header;
+        WriteBits(MainLengths[Symbol], MainCodes[Symbol]);
+
+        if (Header == LZX_NUM_PRIMARY_LENGTHS)
+        {
+            Symbol = Matches[i].Length - LZX_MIN_MATCH - LZX_NUM_PRIMARY_LENGTHS;
+            WriteBits(LengthLengths[Symbol], LengthCodes[Symbol]);
+        }
+
+        WriteBits(ExtraBits[Slot], Matches[i].Offset - PositionBase[Slot]);
+    }
+
+    AlignOutput();
+}
+
+
+void CLZXCodec::WriteUncompressedBlock(PUCHAR Data, ULONG Length)
+{
+    ULONG Repeats[3] = { R0, R1, R2 };
+    ULONG i;
+
+    WriteBits(3, LZX_BLOCKTYPE_UNCOMPRESSED);
+    WriteBits(16, Length >> 8);
+    WriteBits(8, Length & 0xFF);
+
+    /* The decoder skips 1 to 16 bits to get to a word boundary */
+    if (BitCount == 0)
+        WriteBits(16, 0);
+    else
+        AlignOutput();
+
+    for (i = 0; i < 3; i++)
+    {
+        *OutputPtr++ = (UCHAR)Repeats[i];
+        *OutputPtr++ = (UCHAR)(Repeats[i] >> 8);
+        *OutputPtr++ = (UCHAR)(Repeats[i] >> 16);
+        *OutputPtr++ = (UCHAR)(Repeats[i] >> 24);
+    }
+
+    memcpy(OutputPtr, Data, Length);
+    OutputPtr += Length;
+    if (Length & 1)
+        *OutputPtr++ = 0;
+}
+
+
+ULONG CLZXCodec::Compress(void* OutputBuffer,
+                          void* InputBuffer,
+                          ULONG InputLength,
+                          PULONG OutputLength)
+/*
+ * FUNCTION: Compresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place compressed data
+ *     InputBuffer  = Pointer to buffer with data to be compressed
+ *     InputLength  = Length of input buffer, at most one frame
+ *     OutputLength = Address of buffer to place size of compressed data
+ */
+{
+    ULONG SavedR0, SavedR1, SavedR2;
+    ULONG Start, Bits, RawBits, i;
+
+    if (WindowBits == 0)
+        Reset(CAB_COMP_LZX | (LZX_DEFAULT_WINDOW_BITS << 8));
+
+    if (!History && !AllocateHistory())
+        return CS_NOMEMORY;
+
+    if (HistoryFill + InputLength > WindowSize * 2)
+        SlideHistory();
+
+    Start = HistoryFill;
+    memcpy(History + HistoryFill, InputBuffer, InputLength);
+    HistoryFill += InputLength;
+
+    SavedR0 = R0;
+    SavedR1 = R1;
+    SavedR2 = R2;
+    ParseFrame(Start, HistoryFill);
+
+    BuildLengths(MainFreq, MainElements, NewMainLengths, LZX_MAX_CODE_LENGTH);
+    BuildLengths(LengthFreq, LZX_NUM_SECONDARY_LENGTHS, NewLengthLengths, LZX_MAX_CODE_LENGTH);
+    BuildCodes(NewMainLengths, MainElements, MainCodes);
+    BuildCodes(NewLengthLengths, LZX_NUM_SECONDARY_LENGTHS, LengthCodes);
+
+    /* Store the frame if coding it does not pay off */
+    Bits = 3 + 24 + 15 + ExtraBitsTotal;
+    Bits += WriteLengths(MainLengths, NewMainLengths, 0, LZX_NUM_CHARS, true);
+    Bits += WriteLengths(MainLengths, NewMainLengths, LZX_NUM_CHARS, MainElements, true);
+    Bits += WriteLengths(LengthLengths, NewLengthLengths, 0, LZX_NUM_SECONDARY_LENGTHS, true);
+    for (i = 0; i < MainElements; i++)
+        Bits += MainFreq[i] * NewMainLengths[i];
+    for (i = 0; i < LZX_NUM_SECONDARY_LENGTHS; i++)
+        Bits += LengthFreq[i] * NewLengthLengths[i];
+    RawBits = 3 + 24 + 16 + 12 * 8 + InputLength * 8 + 8;
+
+    OutputPtr = (PUCHAR)OutputBuffer;
+    BitBuffer = 0;
+    BitCount  = 0;
+
+    if (!HeaderDone)
+    {
+        /* No E8 call translation */
+        WriteBits(1, 0);
+        HeaderDone = true;
+    }
+
+    if (Bits < RawBits)
+    {
+        WriteVerbatimBlock(InputLength);
+    }
+    else
+    {
+        R0 = SavedR0;
+        R1 = SavedR1;
+        R2 = SavedR2;
+        WriteUncompressedBlock(History + Start, InputLength);
+    }
+
+    *OutputLength = (ULONG)(OutputPtr - (PUCHAR)OutputBuffer);
+    return CS_SUCCESS;
+}
+
+
+/* Decompressor */
+
+void CLZXCodec::InitInput(PUCHAR Buffer, ULONG Length)
+{
+    InputPtr      = Buffer;
+    InputEnd      = Buffer + Length;
+    InputBits     = 0;
+    InputBitsLeft = 0;
+}
+
+
+void CLZXCodec::EnsureBits(ULONG Count)
+{
+    ULONG Word;
+
+    while (InputBitsLeft < Count)
+    {
+        /* Reading past the end gives zeros, callers check for overruns */
+        Word = 0;
+        if (InputPtr + 1 < InputEnd)
+            Word = InputPtr[0] | (InputPtr[1] << 8);
+        else if (InputPtr < InputEnd)
+            Word = InputPtr[0];
+        InputPtr += 2;
+
+        InputBits |= Word << (16 - InputBitsLeft);
+        InputBitsLeft += 16;
+    }
+}
+
+
+ULONG CLZXCodec::ReadBits(ULONG Count)
+{
+    ULONG Value;
+
+    if (Count == 0)
+        return 0;
+
+    EnsureBits(Count);
+    Value = InputBits >> (32 - Count);
+    InputBits <<= Count;
+    InputBitsLeft -= Count;
+    return Value;
+}
+
+
+ULONG CLZXCodec::ReadSymbol(PLZX_DECODE_TABLE Table)
+/*
+ * RETURNS:
+ *     Symbol, or 0xFFFF if the input does not match any code
+ */
+{
+    ULONG Peek, Entry, Length, Code;
+
+    EnsureBits(LZX_MAX_CODE_LENGTH);
+    Peek = InputBits >> (32 - LZX_MAX_CODE_LENGTH);
+
+    Entry = Table->Fast[Peek >> (LZX_MAX_CODE_LENGTH - LZX_FAST_BITS)];
+    if (Entry != 0)
+    {
+        Length = Entry >> 11;
+        InputBits <<= Length;
+        InputBitsLeft -= Length;
+        return Entry & 0x7FF;
+    }
+
+    for (Length = LZX_FAST_BITS + 1; Length <= LZX_MAX_CODE_LENGTH; Length++)
+    {
+        Code = Peek >> (LZX_MAX_CODE_LENGTH - Length);
+        if (Code >= Table->FirstCode[Length] &&
+            Code - Table->FirstCode[Length] < Table->Count[Length])
+        {
+            InputBits <<= Length;
+            InputBitsLeft -= Length;
+            return Table->Sorted[Table->FirstIndex[Length] + Code - Table->FirstCode[Length]];
+        }
+    }
+
+    return 0xFFFF;
+}
+
+
+bool CLZXCodec::ReadLengths(PUCHAR Lengths, ULONG First, ULONG Last)
+/*
+ * FUNCTION: Reads a range of code lengths coded through a pretree
+ */
+{
+    LZX_DECODE_TABLE PreTable;
+    UCHAR PreLengths[LZX_PRETREE_NUM_ELEMENTS];
+    ULONG Symbol, Run, i;
+    LONG Value;
+    bool Empty;
+
+    for (i = 0; i < LZX_PRETREE_NUM_ELEMENTS; i++)
+        PreLengths[i] = (UCHAR)ReadBits(4);
+
+    if (!BuildDecodeTable(PreLengths, LZX_PRETREE_NUM_ELEMENTS, &PreTable, &Empty) || Empty)
+        return false;
+
+    i = First;
+    while (i < Last)
+    {
+        Symbol = ReadSymbol(&PreTable);
+        if (Symbol == 17 || Symbol == 18)
+        {
+            Run = (Symbol == 17) ? ReadBits(4) + 4 : ReadBits(5) + 20;
+            if (i + Run > Last)
+                return false;
+            while (Run--)
+                Lengths[i++] = 0;
+        }
+        else if (Symbol == 19)
+        {
+            Run = ReadBits(1) + 4;
+            Symbol = ReadSymbol(&PreTable);
+            if (Symbol > 16 || i + Run > Last)
+                return false;
+            Value = (LONG)Lengths[i] - (LONG)Symbol;
+            if (Value < 0)
+                Value += 17;
+            while (Run--)
+                Lengths[i++] = (UCHAR)Value;
+        }
+        else if (Symbol <= 16)
+        {
+            Value = (LONG)Lengths[i] - (LONG)Symbol;
+            if (Value < 0)
+                Value += 17;
+            Lengths[i++] = (UCHAR)Value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+ULONG CLZXCodec::ReadBlockHeader()
+{
+    bool Empty;
+    ULONG i;
+
+    BlockType = ReadBits(3);
+    BlockLength = ReadBits(16) << 8;
+    BlockLength |= ReadBits(8);
+    BlockRemaining = (LONG)BlockLength;
+
+    switch (BlockType)
+    {
+        case LZX_BLOCKTYPE_ALIGNED:
+            for (i = 0; i < LZX_ALIGNED_NUM_ELEMENTS; i++)
+                AlignedLengths[i] = (UCHAR)ReadBits(3);
+            if (!BuildDecodeTable(AlignedLengths, LZX_ALIGNED_NUM_ELEMENTS, &AlignedTable, &Empty) || Empty)
+                return CS_BADSTREAM;
+            /* Fall through */
+
+        case LZX_BLOCKTYPE_VERBATIM:
+            if (!ReadLengths(MainLengths, 0, LZX_NUM_CHARS) ||
+                !ReadLengths(MainLengths, LZX_NUM_CHARS, MainElements) ||
+                !BuildDecodeTable(MainLengths, MainElements, &MainTable, &Empty) || Empty)
+            {
+                return CS_BADSTREAM;
+            }
+            if (MainLengths[0xE8] != 0)
+                IntelStarted = true;
+
+            if (!ReadLengths(LengthLengths, 0, LZX_NUM_SECONDARY_LENGTHS) ||
+                !BuildDecodeTable(LengthLengths, LZX_NUM_SECONDARY_LENGTHS, &LengthTable, &LengthEmpty))
+            {
+                return CS_BADSTREAM;
+            }
+            break;
+
+        case LZX_BLOCKTYPE_UNCOMPRESSED:
+            IntelStarted = true;
+
+            /* Skip 1 to 16 bits of padding, then continue bytewise */
+            if (InputBitsLeft == 0)
+                EnsureBits(16);
+            InputBits = 0;
+            InputBitsLeft = 0;
+
+            if (InputPtr + 12 > InputEnd)
+                return CS_BADSTREAM;
+            R0 = InputPtr[0] | (InputPtr[1] << 8) | (InputPtr[2] << 16) | ((ULONG)InputPtr[3] << 24);
+            R1 = InputPtr[4] | (InputPtr[5] << 8) | (InputPtr[6] << 16) | ((ULONG)InputPtr[7] << 24);
+            R2 = InputPtr[8] | (InputPtr[9] << 8) | (InputPtr[10] << 16) | ((ULONG)InputPtr[11] << 24);
+            InputPtr += 12;
+            break;
+
+        default:
+            return CS_BADSTREAM;
+    }
+
+    return CS_SUCCESS;
+}
+
+
+ULONG CLZXCodec::DecodeRun(LONG *Run)
+/*
+ * FUNCTION: Decodes part of the current block into the window
+ * ARGUMENTS:
+ *     Run = Number of bytes to decode. Negative on return if the last match went further
+ * NOTES:
+ *     Matches may not go past the end of the frame
+ */
+{
+    ULONG Symbol, Slot, Extra, MatchLength, MatchOffset, Source;
+
+    if (BlockType == LZX_BLOCKTYPE_UNCOMPRESSED)
+    {
+        if (InputPtr + *Run > InputEnd)
+            return CS_BADSTREAM;
+        memcpy(&Window[WindowPos], InputPtr, *Run);
+        InputPtr += *Run;
+        WindowPos += *Run;
+        *Run = 0;
+        return CS_SUCCESS;
+    }
+
+    while (*Run > 0)
+    {
+        Symbol = ReadSymbol(&MainTable);
+        if (Symbol >= MainElements)
+            return CS_BADSTREAM;
+
+        if (Symbol < LZX_NUM_CHARS)
+        {
+            Window[WindowPos++] = (UCHAR)Symbol;
+            (*Run)--;
+            continue;
+        }
+
+        Symbol -= LZX_NUM_CHARS;
+        Slot = Symbol >> 3;
+        MatchLength = Symbol & 7;
+        if (MatchLength == LZX_NUM_PRIMARY_LENGTHS)
+        {
+            if (LengthEmpty)
+                return CS_BADSTREAM;
+            Symbol = ReadSymbol(&LengthTable);
+            if (Symbol >= LZX_NUM_SECONDARY_LENGTHS)
+                return CS_BADSTREAM;
+            MatchLength += Symbol;
+        }
+        MatchLength += LZX_MIN_MATCH;
+
+        switch (Slot)
+        {
+            case 0:
+                MatchOffset = R0;
+                break;
+
+            case 1:
+                MatchOffset = R1;
+                R1 = R0;
+                R0 = MatchOffset;
+                break;
+
+            case 2:
+                MatchOffset = R2;
+                R2 = R0;
+                R0 = MatchOffset;
+                break;
+
+            default:
+                Extra = ExtraBits[Slot];
+                MatchOffset = PositionBase[Slot] - 2;
+                if (BlockType == LZX_BLOCKTYPE_ALIGNED && Extra >= 3)
+                {
+                    MatchOffset += ReadBits(Extra - 3) << 3;
+                    Symbol = ReadSymbol(&AlignedTable);
+                    if (Symbol >= LZX_ALIGNED_NUM_ELEMENTS)
+                        return CS_BADSTREAM;
+                    MatchOffset += Symbol;
+                }
+                else
+                {
+                    MatchOffset += ReadBits(Extra);
+                }
+                R2 = R1;
+                R1 = R0;
+                R0 = MatchOffset;
+                break;
+        }
+
+        if (MatchOffset == 0 || MatchOffset > WindowSize || WindowPos + MatchLength > FrameEnd)
+            return CS_BADSTREAM;
+
+        Source = (WindowPos >= MatchOffset) ? WindowPos - MatchOffset
+                                            : WindowPos + WindowSize - MatchOffset;
+        *Run -= MatchLength;
+        while (MatchLength--)
+        {
+            Window[WindowPos++] = Window[Source++];
+            Source &= WindowSize - 1;
+        }
+    }
+
+    return CS_SUCCESS;
+}
+
+
+void CLZXCodec::UndoE8Translation(PUCHAR Data, ULONG Length)
+/*
+ * FUNCTION: Turns absolute call targets back into relative ones
+ */
+{
+    PUCHAR End = Data + Length - 10;
+    LONG CurPos = IntelCurPos;
+    LONG AbsOffset, RelOffset;
+
+    if (FrameCount >= 32768 || IntelFileSize == 0)
+        return;
+
+    IntelCurPos += Length;
+    if (Length <= 10 || !IntelStarted)
+        return;
+
+    while (Data < End)
+    {
+        if (*Data++ != 0xE8)
+        {
+            CurPos++;
+            continue;
+        }
+
+        AbsOffset = (LONG)(Data[0] | (Data[1] << 8) | (Data[2] << 16) | ((ULONG)Data[3] << 24));
+        if (AbsOffset >= -CurPos && AbsOffset < IntelFileSize)
+        {
+            RelOffset = (AbsOffset >= 0) ? AbsOffset - CurPos : AbsOffset + IntelFileSize;
+            Data[0] = (UCHAR)RelOffset;
+            Data[1] = (UCHAR)(RelOffset >> 8);
+            Data[2] = (UCHAR)(RelOffset >> 16);
+            Data[3] = (UCHAR)(RelOffset >> 24);
+        }
+        Data += 4;
+        CurPos += 5;
+    }
+}
+
+
+ULONG CLZXCodec::Uncompress(void* OutputBuffer,
+                            void* InputBuffer,
+                            ULONG InputLength,
+                            PULONG OutputLength)
+/*
+ * FUNCTION: Uncompresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place uncompressed data
+ *     InputBuffer  = Pointer to buffer with data to be uncompressed
+ *     InputLength  = Length of input buffer
+ *     OutputLength = On input the size of the frame, as given by the data block.
+ *                    On output the size of the uncompressed data
+ * NOTES:
+ *     Blocks of a folder must be passed in order, starting after a Reset
+ */
+{
+    LONG Remaining, Run, Decoded;
+    ULONG FrameSize, Status;
+
+    if (WindowBits == 0)
+        Reset(CAB_COMP_LZX | (LZX_DEFAULT_WINDOW_BITS << 8));
+
+    if (!Window)
+    {
+        Window = (PUCHAR)calloc(WindowSize, 1);
+        if (!Window)
+            return CS_NOMEMORY;
+    }
+
+    FrameSize = *OutputLength;
+    if (FrameSize == 0 || FrameSize > LZX_FRAME_SIZE)
+        FrameSize = LZX_FRAME_SIZE;
+    FrameEnd = FramePos + FrameSize;
+
+    InitInput((PUCHAR)InputBuffer, InputLength);
+
+    if (!HeaderDone)
+    {
+        if (ReadBits(1))
+        {
+            IntelFileSize = (LONG)(ReadBits(16) << 16);
+            IntelFileSize |= (LONG)ReadBits(16);
+        }
+        HeaderDone = true;
+    }
+
+    Remaining = (LONG)FrameSize;
+    while (Remaining > 0)
+    {
+        if (BlockRemaining == 0)
+        {
+            Status = ReadBlockHeader();
+            if (Status != CS_SUCCESS)
+                return Status;
+            if (BlockRemaining == 0)
+                return CS_BADSTREAM;
+        }
+
+        Run = (BlockRemaining < Remaining) ? BlockRemaining : Remaining;
+        Decoded = Run;
+        Status = DecodeRun(&Run);
+        if (Status != CS_SUCCESS)
+            return Status;
+        Decoded -= Run;
+
+        if (Decoded > BlockRemaining)
+            return CS_BADSTREAM;
+        BlockRemaining -= Decoded;
+        Remaining -= Decoded;
+
+        /* Uncompressed blocks of odd length are padded to a word */
+        if (BlockType == LZX_BLOCKTYPE_UNCOMPRESSED && BlockRemaining == 0 && (BlockLength & 1))
+            InputPtr++;
+
+        if (InputPtr > InputEnd + 2)
+            return CS_BADSTREAM;
+    }
+
+    if (WindowPos != FrameEnd)
+        return CS_BADSTREAM;
+
+    memcpy(OutputBuffer, &Window[FramePos], FrameSize);
+    UndoE8Translation((PUCHAR)OutputBuffer, FrameSize);
+    FrameCount++;
+
+    if (WindowPos >= WindowSize)
+        WindowPos = 0;
+    FramePos = WindowPos;
+
+    *OutputLength = FrameSize;
+    return CS_SUCCESS;
+}
+
+/* EOF */
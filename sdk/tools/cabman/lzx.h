@@ -0,0 +1,155 @@
+/*
+ * PROJECT:     ReactOS cabinet manager
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     CAB codec for LZX compressed data
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#include "cabinet.h"
+
+/* Window sizes are given in bits, in the high byte of CFFOLDER.CompressionType */
+#define LZX_MIN_WINDOW_BITS         15
+#define LZX_MAX_WINDOW_BITS         21
+#define LZX_DEFAULT_WINDOW_BITS     21
+
+#define LZX_FRAME_SIZE              32768
+#define LZX_NUM_CHARS               256
+#define LZX_MIN_MATCH               2
+#define LZX_MAX_MATCH               257
+#define LZX_NUM_PRIMARY_LENGTHS     7
+#define LZX_NUM_SECONDARY_LENGTHS   249
+#define LZX_MAX_POSITION_SLOTS      50
+#define LZX_MAINTREE_MAXSYMBOLS     (LZX_NUM_CHARS + LZX_MAX_POSITION_SLOTS * 8)
+#define LZX_PRETREE_NUM_ELEMENTS    20
+#define LZX_ALIGNED_NUM_ELEMENTS    8
+#define LZX_MAX_CODE_LENGTH         16
+#define LZX_MAX_PRETREE_LENGTH      15
+
+#define LZX_BLOCKTYPE_VERBATIM      1
+#define LZX_BLOCKTYPE_ALIGNED       2
+#define LZX_BLOCKTYPE_UNCOMPRESSED  3
+
+#define LZX_FAST_BITS               10
+#define LZX_HASH_BITS               16
+#define LZX_MAX_CHAIN               48
+
+
+/* Structures */
+
+typedef struct _LZX_DECODE_TABLE
+{
+    USHORT Fast[1 << LZX_FAST_BITS];    // Symbol | (Length << 11) for short codes
+    USHORT FirstCode[LZX_MAX_CODE_LENGTH + 1];
+    USHORT FirstIndex[LZX_MAX_CODE_LENGTH + 1];
+    USHORT Count[LZX_MAX_CODE_LENGTH + 1];
+    USHORT Sorted[LZX_MAINTREE_MAXSYMBOLS];
+} LZX_DECODE_TABLE, *PLZX_DECODE_TABLE;
+
+typedef struct _LZX_MATCH
+{
+    ULONG Offset;                       // Literal if Length is 0, otherwise formatted offset
+    USHORT Length;
+} LZX_MATCH, *PLZX_MATCH;
+
+
+/* Classes */
+
+class CLZXCodec : public CCABCodec
+{
+public:
+    /* Default constructor */
+    CLZXCodec();
+    /* Default destructor */
+    virtual ~CLZXCodec();
+    /* Starts a new folder */
+    virtual ULONG Reset(USHORT CompressionType);
+    /* Compresses a data block */
+    virtual ULONG Compress(void* OutputBuffer,
+                           void* InputBuffer,
+                           ULONG InputLength,
+                           PULONG OutputLength);
+    /* Uncompresses a data block */
+    virtual ULONG Uncompress(void* OutputBuffer,
+                             void* InputBuffer,
+                             ULONG InputLength,
+                             PULONG OutputLength);
+private:
+    void FreeWindow();
+    /* Encoder */
+    bool AllocateHistory();
+    void SlideHistory();
+    void InsertUpTo(ULONG Position);
+    ULONG FindMatch(ULONG Position, ULONG End, PULONG Distance);
+    ULONG RepeatMatch(ULONG Position, ULONG End, ULONG Distance);
+    ULONG BestMatch(ULONG Position, ULONG End, PULONG FormattedOffset);
+    void AddMatch(ULONG FormattedOffset, ULONG Length);
+    void ParseFrame(ULONG Start, ULONG End);
+    void WriteBits(ULONG Count, ULONG Bits);
+    void AlignOutput();
+    ULONG WriteLengths(PUCHAR Previous, PUCHAR Lengths, ULONG First, ULONG Last, bool CountOnly);
+    void WriteVerbatimBlock(ULONG Length);
+    void WriteUncompressedBlock(PUCHAR Data, ULONG Length);
+    /* Decoder */
+    void InitInput(PUCHAR Buffer, ULONG Length);
+    void EnsureBits(ULONG Count);
+    ULONG ReadBits(ULONG Count);
+    ULONG ReadSymbol(PLZX_DECODE_TABLE Table);
+    bool ReadLengths(PUCHAR Lengths, ULONG First, ULONG Last);
+    ULONG ReadBlockHeader();
+    ULONG DecodeRun(LONG *Run);
+    void UndoE8Translation(PUCHAR Data, ULONG Length);
+
+    ULONG WindowBits;
+    ULONG WindowSize;
+    ULONG PositionSlots;
+    ULONG MainElements;
+    ULONG R0, R1, R2;
+    UCHAR MainLengths[LZX_MAINTREE_MAXSYMBOLS];
+    UCHAR LengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    bool HeaderDone;
+
+    /* Encoder state: a history buffer of twice the window, with hash chains */
+    PUCHAR History;
+    ULONG HistoryFill;
+    ULONG HashPos;
+    PLONG HashHead;
+    PLONG HashPrev;
+    LZX_MATCH Matches[LZX_FRAME_SIZE];
+    ULONG MatchCount;
+    ULONG ExtraBitsTotal;
+    ULONG MainFreq[LZX_MAINTREE_MAXSYMBOLS];
+    ULONG LengthFreq[LZX_NUM_SECONDARY_LENGTHS];
+    UCHAR NewMainLengths[LZX_MAINTREE_MAXSYMBOLS];
+    UCHAR NewLengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    USHORT MainCodes[LZX_MAINTREE_MAXSYMBOLS];
+    USHORT LengthCodes[LZX_NUM_SECONDARY_LENGTHS];
+    PUCHAR OutputPtr;
+    ULONGLONG BitBuffer;
+    ULONG BitCount;
+
+    /* Decoder state: the window is a ring of WindowSize bytes */
+    PUCHAR Window;
+    ULONG WindowPos;
+    ULONG FramePos;
+    ULONG FrameEnd;
+    ULONG FrameCount;
+    ULONG BlockType;
+    ULONG BlockLength;
+    LONG BlockRemaining;
+    LONG IntelFileSize;
+    LONG IntelCurPos;
+    bool IntelStarted;
+    UCHAR AlignedLengths[LZX_ALIGNED_NUM_ELEMENTS];
+    LZX_DECODE_TABLE MainTable;
+    LZX_DECODE_TABLE LengthTable;
+    LZX_DECODE_TABLE AlignedTable;
+    bool LengthEmpty;
+    PUCHAR InputPtr;
+    PUCHAR InputEnd;
+    ULONG InputBits;
+    ULONG InputBitsLeft;
+};
+
+/* EOF */
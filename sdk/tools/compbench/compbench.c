@@ -0,0 +1,530 @@
+/*
+ * PROJECT:     ReactOS Compression Benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Checks and measures the RTL compression engines on the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <typedefs.h>
+
+#ifndef min
+#define min(a, b)  (((a) < (b)) ? (a) : (b))
+#endif
+
+/* Definitions copied from <ntstatus.h> */
+#define STATUS_SUCCESS                   ((NTSTATUS)0x00000000)
+#define STATUS_NOT_IMPLEMENTED           ((NTSTATUS)0xC0000002)
+#define STATUS_ACCESS_VIOLATION          ((NTSTATUS)0xC0000005)
+#define STATUS_INVALID_PARAMETER         ((NTSTATUS)0xC000000D)
+#define STATUS_NO_MEMORY                 ((NTSTATUS)0xC0000017)
+#define STATUS_BUFFER_TOO_SMALL          ((NTSTATUS)0xC0000023)
+#define STATUS_NOT_SUPPORTED             ((NTSTATUS)0xC00000BB)
+#define STATUS_BAD_COMPRESSION_BUFFER    ((NTSTATUS)0xC0000242)
+#define STATUS_UNSUPPORTED_COMPRESSION   ((NTSTATUS)0xC000025F)
+
+/* Definitions copied from <winnt.h> */
+#define COMPRESSION_FORMAT_NONE          (0x0000)
+#define COMPRESSION_FORMAT_DEFAULT       (0x0001)
+#define COMPRESSION_FORMAT_LZNT1         (0x0002)
+#define COMPRESSION_FORMAT_XPRESS        (0x0003)
+#define COMPRESSION_FORMAT_XPRESS_HUFF   (0x0004)
+#define COMPRESSION_ENGINE_STANDARD      (0x0000)
+#define COMPRESSION_ENGINE_MAXIMUM       (0x0100)
+
+typedef struct _COMPRESSED_DATA_INFO *PCOMPRESSED_DATA_INFO;
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BitScanForward _BitScanForward
+#else
+static inline unsigned char BitScanForward(ULONG *Index, ULONG Mask)
+{
+    *Index = Mask ? __builtin_ctz(Mask) : 0;
+    return Mask ? 1 : 0;
+}
+#endif
+
+#define RtlpAllocateMemory(Bytes, Tag)   malloc(Bytes)
+#define RtlpFreeMemory(Mem, Tag)         free(Mem)
+
+/* The engines are built straight from the RTL sources */
+#include <compress.c>
+
+typedef struct _ENGINE
+{
+    const char *Name;
+    USHORT FormatAndEngine;
+} ENGINE;
+
+static const ENGINE Engines[] =
+{
+    { "LZNT1",            COMPRESSION_FORMAT_LZNT1 },
+    { "LZNT1 max",        COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM },
+    { "XPRESS",           COMPRESSION_FORMAT_XPRESS },
+    { "XPRESS max",       COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM },
+    { "XPRESS_HUFF",      COMPRESSION_FORMAT_XPRESS_HUFF },
+    { "XPRESS_HUFF max",  COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM },
+};
+
+#define ENGINE_COUNT (sizeof(Engines) / sizeof(Engines[0]))
+
+static int Failures;
+
+static double Seconds(clock_t Start)
+{
+    return (double)(clock() - Start) / CLOCKS_PER_SEC;
+}
+
+/* Compress and decompress a buffer, checking that the data survives the round trip */
+static BOOLEAN RoundTrip(const ENGINE *Engine, PUCHAR Data, ULONG Size, const char *What,
+                         PULONG CompressedSize)
+{
+    ULONG BufferWorkSpace, FragmentWorkSpace, FinalSize, OutSize;
+    PUCHAR Compressed, Decompressed, WorkSpace, FragWorkSpace;
+    NTSTATUS Status;
+    BOOLEAN Ok = FALSE;
+
+    Status = RtlGetCompressionWorkSpaceSize(Engine->FormatAndEngine, &BufferWorkSpace, &FragmentWorkSpace);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("%s/%s: RtlGetCompressionWorkSpaceSize failed 0x%08x\n", Engine->Name, What, Status);
+        Failures++;
+        return FALSE;
+    }
+
+    OutSize = Size + Size / 8 + 4096;
+    Compressed = malloc(OutSize);
+    Decompressed = malloc(Size + 4096);
+    WorkSpace = malloc(BufferWorkSpace + 1);
+    FragWorkSpace = malloc(FragmentWorkSpace + 1);
+
+    Status = RtlCompressBuffer(Engine->FormatAndEngine, Data, Size, Compressed, OutSize,
+                               4096, &FinalSize, WorkSpace);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("%s/%s: RtlCompressBuffer failed 0x%08x\n", Engine->Name, What, Status);
+        goto done;
+    }
+    *CompressedSize = FinalSize;
+
+    /* exact output size */
+    memset(Decompressed, 0xCC, Size + 4096);
+    Status = RtlDecompressFragment(Engine->FormatAndEngine, Decompressed, Size, Compressed,
+                                   FinalSize, 0, &OutSize, FragWorkSpace);
+    if (!NT_SUCCESS(Status) || OutSize != Size || memcmp(Data, Decompressed, Size))
+    {
+        printf("%s/%s: round trip failed 0x%08x, %u/%u bytes\n", Engine->Name, What, Status, OutSize, Size);
+        goto done;
+    }
+
+    /* larger output buffer, without a workspace */
+    Status = RtlDecompressBuffer(Engine->FormatAndEngine, Decompressed, Size + 4096, Compressed,
+                                 FinalSize, &OutSize);
+    if (!NT_SUCCESS(Status) || OutSize != Size || memcmp(Data, Decompressed, Size))
+    {
+        printf("%s/%s: oversized round trip failed 0x%08x, %u/%u bytes\n", Engine->Name, What, Status, OutSize, Size);
+        goto done;
+    }
+
+    Ok = TRUE;
+
+done:
+    if (!Ok)
+        Failures++;
+    free(Compressed);
+    free(Decompressed);
+    free(WorkSpace);
+    free(FragWorkSpace);
+    return Ok;
+}
+
+/* Data with some structure, repetitions of every length and long runs */
+static VOID CheckEdgeCases(VOID)
+{
+    static const ULONG Sizes[] = { 0, 1, 2, 3, 17, 4096, 65535, 65536, 65537, 131072, 300000 };
+    ULONG i, j, e, CompressedSize;
+    PUCHAR Data;
+    char What[64];
+
+    Data = malloc(300000);
+    for (i = 0; i < sizeof(Sizes) / sizeof(Sizes[0]); i++)
+    {
+        for (e = 0; e < ENGINE_COUNT; e++)
+        {
+            /* LZNT1 has no representation for empty data */
+            if (!Sizes[i] && (Engines[e].FormatAndEngine & COMPRESSION_FORMAT_MASK) == COMPRESSION_FORMAT_LZNT1)
+                continue;
+
+            /* pseudo random, incompressible */
+            for (j = 0; j < Sizes[i]; j++)
+                Data[j] = (UCHAR)((j * 2654435761U) >> 13);
+            sprintf(What, "random %u", Sizes[i]);
+            RoundTrip(&Engines[e], Data, Sizes[i], What, &CompressedSize);
+
+            /* a single repeated byte, exercising the longest matches */
+            memset(Data, 'a', Sizes[i]);
+            sprintf(What, "run %u", Sizes[i]);
+            RoundTrip(&Engines[e], Data, Sizes[i], What, &CompressedSize);
+
+            /* repeated text with varying distances and lengths */
+            for (j = 0; j < Sizes[i]; j++)
+                Data[j] = "ReactOS compression "[(j / 7 + j % (13 + j / 4099)) % 20];
+            sprintf(What, "text %u", Sizes[i]);
+            RoundTrip(&Engines[e], Data, Sizes[i], What, &CompressedSize);
+        }
+    }
+    free(Data);
+}
+
+/* The RTL compressor only stores LZNT1 chunks, this greedy encoder produces
+ * back references so that the decompressor can be checked and measured */
+static ULONG Lznt1Encode(PUCHAR Data, ULONG Size, PUCHAR Out)
+{
+    static USHORT Head[4096], Prev[4096];
+    ULONG Pos, ChunkSize, Chunk, OutPos = 0, FlagsPos, Flags, Count, Length, Best, BestOffset;
+    ULONG DisplacementBits, MaxLength, Hash, Candidate, Depth, Start;
+    PUCHAR Src;
+
+    for (Chunk = 0; Chunk < Size; Chunk += 4096)
+    {
+        Src = Data + Chunk;
+        ChunkSize = min(Size - Chunk, 4096);
+        memset(Head, 0xFF, sizeof(Head));
+        Start = OutPos;
+        OutPos += 2;
+
+        Pos = 0;
+        while (Pos < ChunkSize)
+        {
+            FlagsPos = OutPos++;
+            Flags = 0;
+            for (Count = 0; Count < 8 && Pos < ChunkSize; Count++)
+            {
+                for (DisplacementBits = 4; DisplacementBits < 12 && Pos > (1U << DisplacementBits); DisplacementBits++);
+                MaxLength = min((1U << (16 - DisplacementBits)) + 2, ChunkSize - Pos);
+
+                Best = 0;
+                BestOffset = 0;
+                if (MaxLength >= 3)
+                {
+                    Hash = (Src[Pos] | (Src[Pos + 1] << 8) | (Src[Pos + 2] << 16)) * 2654435761U >> 20;
+                    for (Candidate = Head[Hash], Depth = 0;
+                         Candidate != 0xFFFF && Depth < 16 && Pos - Candidate <= (1U << DisplacementBits);
+                         Candidate = Prev[Candidate], Depth++)
+                    {
+                        for (Length = 0; Length < MaxLength && Src[Candidate + Length] == Src[Pos + Length]; Length++);
+                        if (Length > Best)
+                        {
+                            Best = Length;
+                            BestOffset = Pos - Candidate;
+                        }
+                    }
+                }
+
+                if (Best >= 3)
+                {
+                    *(USHORT *)(Out + OutPos) = (USHORT)(((BestOffset - 1) << (16 - DisplacementBits)) | (Best - 3));
+                    OutPos += 2;
+                    Flags |= 1 << Count;
+                }
+                else
+                {
+                    Best = 1;
+                    Out[OutPos++] = Src[Pos];
+                }
+
+                for (; Best; Best--, Pos++)
+                {
+                    if (ChunkSize - Pos >= 3)
+                    {
+                        Hash = (Src[Pos] | (Src[Pos + 1] << 8) | (Src[Pos + 2] << 16)) * 2654435761U >> 20;
+                        Prev[Pos] = Head[Hash];
+                        Head[Hash] = (USHORT)Pos;
+                    }
+                }
+            }
+            Out[FlagsPos] = (UCHAR)Flags;
+        }
+
+        if (OutPos - Start - 2 >= ChunkSize)
+        {
+            /* store the chunk uncompressed */
+            memcpy(Out + Start + 2, Src, ChunkSize);
+            OutPos = Start + 2 + ChunkSize;
+            *(USHORT *)(Out + Start) = (USHORT)(0x3000 | (ChunkSize - 1));
+        }
+        else
+        {
+            *(USHORT *)(Out + Start) = (USHORT)(0xB000 | (OutPos - Start - 3));
+        }
+    }
+
+    return OutPos;
+}
+
+/* The byte-by-byte chunk decompressor the RTL used to have, kept as reference */
+static PUCHAR Lznt1ReferenceChunk(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size)
+{
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    ULONG displacement_bits, length_bits;
+    ULONG code_displacement, code_length;
+    WORD flags, code;
+
+    while (src_cur < src_end && dst_cur < dst_end)
+    {
+        flags = 0x8000 | *src_cur++;
+        while ((flags & 0xFF00) && src_cur < src_end)
+        {
+            if (flags & 1)
+            {
+                if (src_cur + sizeof(WORD) > src_end)
+                    return NULL;
+                code = *(WORD *)src_cur;
+                src_cur += sizeof(WORD);
+
+                for (displacement_bits = 12; displacement_bits > 4; displacement_bits--)
+                    if ((1 << (displacement_bits - 1)) < dst_cur - dst) break;
+                length_bits       = 16 - displacement_bits;
+                code_length       = (code & ((1 << length_bits) - 1)) + 3;
+                code_displacement = (code >> length_bits) + 1;
+
+                if (dst_cur < dst + code_displacement)
+                    return NULL;
+
+                while (code_length--)
+                {
+                    if (dst_cur >= dst_end) return dst_cur;
+                    *dst_cur = *(dst_cur - code_displacement);
+                    dst_cur++;
+                }
+            }
+            else
+            {
+                if (dst_cur >= dst_end) return dst_cur;
+                *dst_cur++ = *src_cur++;
+            }
+            flags >>= 1;
+        }
+    }
+
+    return dst_cur;
+}
+
+/* Walk the chunks of an LZNT1 stream, decoding each of them into Out */
+static VOID Lznt1DecodeChunks(PUCHAR Compressed, ULONG Size, PUCHAR Out, BOOLEAN Reference)
+{
+    ULONG Pos = 0, ChunkSize;
+    USHORT Header;
+
+    while (Pos + 2 <= Size)
+    {
+        Header = *(USHORT *)(Compressed + Pos);
+        ChunkSize = (Header & 0xFFF) + 1;
+        if (Header & 0x8000)
+        {
+            if (Reference)
+                Lznt1ReferenceChunk(Out, 4096, Compressed + Pos + 2, ChunkSize);
+            else
+                lznt1_decompress_chunk(Out, 4096, Compressed + Pos + 2, ChunkSize);
+        }
+        else
+        {
+            memcpy(Out, Compressed + Pos + 2, ChunkSize);
+        }
+        Pos += 2 + ChunkSize;
+        Out += 4096;
+    }
+}
+
+/* Compare the LZNT1 decompressor against the reference, including partial
+ * decompression and damaged input, then measure both */
+static VOID CheckLznt1(PUCHAR Data, ULONG Size, ULONG Iterations)
+{
+    ULONG CompressedSize, OutSize, Pos, ChunkSize, DstSize, i;
+    PUCHAR Compressed, Decompressed, Expected, Damaged, Result, ExpectedResult;
+    double ReferenceTime, Time;
+    NTSTATUS Status;
+    USHORT Header;
+    clock_t Start;
+
+    Compressed = malloc(Size + Size / 8 + 4096);
+    Decompressed = malloc(Size + 4096);
+    Expected = malloc(Size + 4096);
+    Damaged = malloc(4096 + 2);
+
+    CompressedSize = Lznt1Encode(Data, Size, Compressed);
+
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1, Decompressed, Size, Compressed,
+                                 CompressedSize, &OutSize);
+    if (!NT_SUCCESS(Status) || OutSize != Size || memcmp(Data, Decompressed, Size))
+    {
+        printf("LZNT1: round trip failed 0x%08x, %u/%u bytes\n", Status, OutSize, Size);
+        Failures++;
+        goto done;
+    }
+
+    /* every chunk, every output size, and with random damage */
+    srand(1);
+    for (Pos = 0; Pos + 2 <= CompressedSize; Pos += 2 + ChunkSize)
+    {
+        Header = *(USHORT *)(Compressed + Pos);
+        ChunkSize = (Header & 0xFFF) + 1;
+        if (!(Header & 0x8000))
+            continue;
+
+        for (DstSize = 0; DstSize <= 4096 + 16; DstSize += (DstSize < 64) ? 1 : 61)
+        {
+            for (i = 0; i < 2; i++)
+            {
+                memcpy(Damaged, Compressed + Pos + 2, ChunkSize);
+                if (i)
+                    Damaged[rand() % ChunkSize] ^= 1 << (rand() % 8);
+
+                memset(Decompressed, 0xCC, DstSize + 64);
+                memset(Expected, 0xCC, DstSize + 64);
+                Result = lznt1_decompress_chunk(Decompressed, DstSize, Damaged, ChunkSize);
+                ExpectedResult = Lznt1ReferenceChunk(Expected, DstSize, Damaged, ChunkSize);
+                /* the output is undefined when the data is found to be corrupt */
+                if ((Result ? Result - Decompressed : -1) != (ExpectedResult ? ExpectedResult - Expected : -1) ||
+                    (ExpectedResult && memcmp(Decompressed, Expected, DstSize + 64)))
+                {
+                    printf("LZNT1: chunk at %u differs from the reference for %u bytes of output\n", Pos, DstSize);
+                    Failures++;
+                    goto done;
+                }
+            }
+        }
+    }
+
+    Start = clock();
+    for (i = 0; i < Iterations; i++)
+        Lznt1DecodeChunks(Compressed, CompressedSize, Expected, TRUE);
+    ReferenceTime = Seconds(Start);
+
+    Start = clock();
+    for (i = 0; i < Iterations; i++)
+        Lznt1DecodeChunks(Compressed, CompressedSize, Decompressed, FALSE);
+    Time = Seconds(Start);
+
+    printf("LZNT1 expand: %u -> %u bytes, reference %.1f MB/s, current %.1f MB/s (%.2fx)\n",
+           CompressedSize, Size,
+           ReferenceTime > 0 ? (double)Size * Iterations / ReferenceTime / (1024 * 1024) : 0.0,
+           Time > 0 ? (double)Size * Iterations / Time / (1024 * 1024) : 0.0,
+           Time > 0 ? ReferenceTime / Time : 0.0);
+
+done:
+    free(Compressed);
+    free(Decompressed);
+    free(Expected);
+    free(Damaged);
+}
+
+static VOID Benchmark(PUCHAR Data, ULONG Size, ULONG Iterations)
+{
+    ULONG BufferWorkSpace, FragmentWorkSpace, FinalSize, OutSize, e, i;
+    PUCHAR Compressed, Decompressed, WorkSpace, FragWorkSpace;
+    double CompressTime, DecompressTime;
+    clock_t Start;
+
+    printf("%-16s %12s %8s %14s %14s\n", "engine", "compressed", "ratio", "compress MB/s", "expand MB/s");
+
+    for (e = 0; e < ENGINE_COUNT; e++)
+    {
+        if (!RoundTrip(&Engines[e], Data, Size, "corpus", &FinalSize))
+            continue;
+
+        RtlGetCompressionWorkSpaceSize(Engines[e].FormatAndEngine, &BufferWorkSpace, &FragmentWorkSpace);
+        OutSize = Size + Size / 8 + 4096;
+        Compressed = malloc(OutSize);
+        Decompressed = malloc(Size);
+        WorkSpace = malloc(BufferWorkSpace + 1);
+        FragWorkSpace = malloc(FragmentWorkSpace + 1);
+
+        Start = clock();
+        for (i = 0; i < Iterations; i++)
+        {
+            RtlCompressBuffer(Engines[e].FormatAndEngine, Data, Size, Compressed, OutSize,
+                              4096, &FinalSize, WorkSpace);
+        }
+        CompressTime = Seconds(Start);
+
+        Start = clock();
+        for (i = 0; i < Iterations; i++)
+        {
+            RtlDecompressFragment(Engines[e].FormatAndEngine, Decompressed, Size, Compressed,
+                                  FinalSize, 0, &OutSize, FragWorkSpace);
+        }
+        DecompressTime = Seconds(Start);
+
+        printf("%-16s %12u %8.3f %14.1f %14.1f\n", Engines[e].Name, FinalSize,
+               (double)FinalSize / Size,
+               CompressTime > 0 ? (double)Size * Iterations / CompressTime / (1024 * 1024) : 0.0,
+               DecompressTime > 0 ? (double)Size * Iterations / DecompressTime / (1024 * 1024) : 0.0);
+
+        free(Compressed);
+        free(Decompressed);
+        free(WorkSpace);
+        free(FragWorkSpace);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ULONG Size = 0, Iterations = 10;
+    PUCHAR Data = NULL;
+    long Length;
+    FILE *File;
+    int i;
+
+    CheckEdgeCases();
+
+    /* the corpus is the concatenation of the given files */
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            Iterations = atoi(argv[++i]);
+            continue;
+        }
+
+        File = fopen(argv[i], "rb");
+        if (!File)
+        {
+            printf("Cannot open %s\n", argv[i]);
+            return 1;
+        }
+        fseek(File, 0, SEEK_END);
+        Length = ftell(File);
+        fseek(File, 0, SEEK_SET);
+        Data = realloc(Data, Size + Length);
+        if (fread(Data + Size, 1, Length, File) != (size_t)Length)
+        {
+            printf("Cannot read %s\n", argv[i]);
+            fclose(File);
+            return 1;
+        }
+        fclose(File);
+        Size += Length;
+    }
+
+    if (Size)
+    {
+        printf("Corpus: %u bytes, %u iterations\n", Size, Iterations);
+        Benchmark(Data, Size, Iterations);
+        CheckLznt1(Data, Size, Iterations);
+    }
+    free(Data);
+
+    if (Failures)
+    {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+
+    printf("All round trips succeeded\n");
+    return 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * PROJECT:     ReactOS Fast486 Benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Checks and measures the Fast486 CPU emulator on the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include <windef.h>
+#include <time.h>
+#include <fast486.h>
+
+#define MEMORY_SIZE     0x110000
+
+#define CODE_ADDRESS    0x1000
+#define PMODE_ADDRESS   0x6000
+#define SOURCE_ADDRESS  0x2000
+#define COPY_ADDRESS    0x3000
+#define RESULT_ADDRESS  0x4000
+#define GDT_ADDRESS     0x5000
+#define GDTR_ADDRESS    0x5020
+#define STACK_ADDRESS   0x8000
+#define PAGE_DIRECTORY  0xA000
+#define PAGE_TABLE      0xB000
+#define ALIAS_ADDRESS   0x300000
+
+static UCHAR Memory[MEMORY_SIZE];
+static ULONG CodePtr;
+static int Failures;
+
+static VOID FASTCALL
+MemRead(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    UNREFERENCED_PARAMETER(State);
+
+    if (Address < MEMORY_SIZE && Size <= MEMORY_SIZE - Address)
+        memcpy(Buffer, &Memory[Address], Size);
+    else
+        memset(Buffer, 0xFF, Size);
+}
+
+static VOID FASTCALL
+MemWrite(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    UNREFERENCED_PARAMETER(State);
+
+    if (Address < MEMORY_SIZE && Size <= MEMORY_SIZE - Address)
+        memcpy(&Memory[Address], Buffer, Size);
+}
+
+/* Tiny assembler, all the jumps go backwards */
+static void Emit(const UCHAR *Bytes, ULONG Size)
+{
+    memcpy(&Memory[CodePtr], Bytes, Size);
+    CodePtr += Size;
+}
+
+#define EMIT(...) do { static const UCHAR Bytes[] = { __VA_ARGS__ }; Emit(Bytes, sizeof(Bytes)); } while (0)
+
+static void Emit8(UCHAR Value)
+{
+    Memory[CodePtr++] = Value;
+}
+
+static void Emit16(USHORT Value)
+{
+    Emit8(LOBYTE(Value));
+    Emit8(HIBYTE(Value));
+}
+
+static void Emit32(ULONG Value)
+{
+    Emit16(LOWORD(Value));
+    Emit16(HIWORD(Value));
+}
+
+static void EmitRel8(ULONG Label)
+{
+    LONG Offset = (LONG)Label - (LONG)(CodePtr + 1);
+
+    assert(Offset >= -128 && Offset < 0);
+    Emit8((UCHAR)Offset);
+}
+
+static void EmitRel16(ULONG Label)
+{
+    Emit16((USHORT)(Label - (CodePtr + 2)));
+}
+
+static USHORT ReadWord(ULONG Address)
+{
+    return Memory[Address] | (Memory[Address + 1] << 8);
+}
+
+static ULONG ReadDword(ULONG Address)
+{
+    return ReadWord(Address) | ((ULONG)ReadWord(Address + 2) << 16);
+}
+
+static void FillSource(ULONG Address, ULONG Size)
+{
+    ULONG i, Seed = 0x12345678;
+
+    for (i = 0; i < Size; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Memory[Address + i] = (UCHAR)(Seed >> 16);
+    }
+}
+
+/*
+ * 16-bit code: block copies, memory operands, near calls, and a self
+ * modifying loop which patches the immediate of the next instruction.
+ */
+static ULONG BuildRealModeProgram(USHORT Outer, PULONG Function)
+{
+    ULONG Start, OuterLoop, InnerLoop, SmcLoop, Patch;
+
+    CodePtr = CODE_ADDRESS;
+
+    *Function = CodePtr;
+    EMIT(0x35, 0x5A, 0x5A);                     /* xor ax, 5A5Ah */
+    EMIT(0xC3);                                 /* ret */
+
+    Start = CodePtr;
+    EMIT(0xB9); Emit16(Outer);                  /* mov cx, Outer */
+    OuterLoop = CodePtr;
+    EMIT(0x51);                                 /* push cx */
+    EMIT(0xBE); Emit16(SOURCE_ADDRESS);         /* mov si, SOURCE_ADDRESS */
+    EMIT(0xBF); Emit16(COPY_ADDRESS);           /* mov di, COPY_ADDRESS */
+    EMIT(0xB9, 0x40, 0x00);                     /* mov cx, 64 */
+    EMIT(0xFC);                                 /* cld */
+    EMIT(0xF3, 0xA5);                           /* rep movsw */
+    EMIT(0xB9, 0x64, 0x00);                     /* mov cx, 100 */
+    EMIT(0x31, 0xC0);                           /* xor ax, ax */
+    EMIT(0xBB); Emit16(COPY_ADDRESS);           /* mov bx, COPY_ADDRESS */
+    InnerLoop = CodePtr;
+    EMIT(0x03, 0x07);                           /* add ax, [bx] */
+    EMIT(0xD1, 0xC0);                           /* rol ax, 1 */
+    EMIT(0xE8); EmitRel16(*Function);           /* call Function */
+    EMIT(0x43);                                 /* inc bx */
+    EMIT(0xE2); EmitRel8(InnerLoop);            /* loop InnerLoop */
+    EMIT(0x01, 0x06); Emit16(RESULT_ADDRESS);   /* add [RESULT_ADDRESS], ax */
+    EMIT(0x59);                                 /* pop cx */
+    EMIT(0xE2); EmitRel8(OuterLoop);            /* loop OuterLoop */
+
+    EMIT(0x31, 0xD2);                           /* xor dx, dx */
+    EMIT(0xB9); Emit16(Outer);                  /* mov cx, Outer */
+    SmcLoop = CodePtr;
+    Patch = CodePtr + 4;
+    EMIT(0x88, 0x0E); Emit16(Patch + 2);        /* mov [Patch + 2], cl */
+    EMIT(0x80, 0xC2, 0x00);                     /* Patch: add dl, 0 */
+    EMIT(0xE2); EmitRel8(SmcLoop);              /* loop SmcLoop */
+    EMIT(0x89, 0x16); Emit16(RESULT_ADDRESS + 2); /* mov [RESULT_ADDRESS + 2], dx */
+    EMIT(0xF4);                                 /* hlt */
+
+    return Start;
+}
+
+static void CheckRealModeProgram(USHORT Outer, USHORT Key)
+{
+    USHORT Sum = 0, Expected;
+    UCHAR SmcSum = 0;
+    ULONG i;
+
+    /* Compute the same thing */
+    for (i = 0; i < 100; i++)
+    {
+        Sum += ReadWord(SOURCE_ADDRESS + i);
+        Sum = (USHORT)((Sum << 1) | (Sum >> 15));
+        Sum ^= Key;
+    }
+    Expected = (USHORT)(Sum * Outer);
+
+    for (i = Outer; i > 0; i--)
+        SmcSum += (UCHAR)i;
+
+    if (ReadWord(RESULT_ADDRESS) != Expected || ReadWord(RESULT_ADDRESS + 2) != SmcSum)
+    {
+        printf("Real mode: got %04x/%04x, expected %04x/%04x\n",
+               ReadWord(RESULT_ADDRESS), ReadWord(RESULT_ADDRESS + 2), Expected, SmcSum);
+        Failures++;
+    }
+}
+
+/*
+ * Switches to flat 32-bit protected mode, optionally with paging (identity
+ * mapping the first 4 MB), and runs a multiply/accumulate loop. Then a self
+ * modifying loop patches its code, through another mapping of it if paging
+ * is enabled.
+ */
+static ULONG BuildProtectedModeProgram(ULONG Outer, BOOLEAN Paging)
+{
+    static const UCHAR Gdt[] =
+    {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xFF, 0xFF, 0x00, 0x00, 0x00, 0x9A, 0xCF, 0x00, /* 08h: flat code */
+        0xFF, 0xFF, 0x00, 0x00, 0x00, 0x92, 0xCF, 0x00, /* 10h: flat data */
+    };
+    ULONG Start, OuterLoop, InnerLoop, SmcLoop, Patch, Target, i;
+
+    memcpy(&Memory[GDT_ADDRESS], Gdt, sizeof(Gdt));
+    Memory[GDTR_ADDRESS] = sizeof(Gdt) - 1;
+    Memory[GDTR_ADDRESS + 1] = 0;
+    Memory[GDTR_ADDRESS + 2] = LOBYTE(GDT_ADDRESS);
+    Memory[GDTR_ADDRESS + 3] = HIBYTE(GDT_ADDRESS);
+    Memory[GDTR_ADDRESS + 4] = 0;
+    Memory[GDTR_ADDRESS + 5] = 0;
+
+    for (i = 0; i < 1024; i++)
+    {
+        Memory[PAGE_TABLE + i * 4] = 0x07;      /* present, writable, user */
+        Memory[PAGE_TABLE + i * 4 + 1] = LOBYTE(i << 4);
+        Memory[PAGE_TABLE + i * 4 + 2] = LOBYTE(i >> 4);
+    }
+    Memory[PAGE_TABLE + (ALIAS_ADDRESS >> 10)] = 0x07;
+    Memory[PAGE_TABLE + (ALIAS_ADDRESS >> 10) + 1] = HIBYTE(PMODE_ADDRESS);
+    Memory[PAGE_TABLE + (ALIAS_ADDRESS >> 10) + 2] = 0;
+    Memory[PAGE_DIRECTORY] = 0x07;
+    Memory[PAGE_DIRECTORY + 1] = HIBYTE(PAGE_TABLE);
+
+    CodePtr = PMODE_ADDRESS;
+    Start = CodePtr;
+    EMIT(0x0F, 0x01, 0x16); Emit16(GDTR_ADDRESS); /* lgdt [GDTR_ADDRESS] */
+    EMIT(0x0F, 0x20, 0xC0);                     /* mov eax, cr0 */
+    EMIT(0x0C, 0x01);                           /* or al, 1 */
+    EMIT(0x0F, 0x22, 0xC0);                     /* mov cr0, eax */
+    Target = CodePtr + 5;
+    EMIT(0xEA); Emit16(Target); Emit16(0x08);   /* jmp 08h:Target */
+
+    EMIT(0x66, 0xB8, 0x10, 0x00);               /* mov ax, 10h */
+    EMIT(0x8E, 0xD8);                           /* mov ds, ax */
+    EMIT(0x8E, 0xC0);                           /* mov es, ax */
+    EMIT(0x8E, 0xD0);                           /* mov ss, ax */
+    EMIT(0xBC); Emit32(STACK_ADDRESS);          /* mov esp, STACK_ADDRESS */
+    if (Paging)
+    {
+        EMIT(0xB8); Emit32(PAGE_DIRECTORY);     /* mov eax, PAGE_DIRECTORY */
+        EMIT(0x0F, 0x22, 0xD8);                 /* mov cr3, eax */
+        EMIT(0x0F, 0x20, 0xC0);                 /* mov eax, cr0 */
+        EMIT(0x0D); Emit32(0x80000000);         /* or eax, 80000000h */
+        EMIT(0x0F, 0x22, 0xC0);                 /* mov cr0, eax */
+    }
+    EMIT(0xB9); Emit32(Outer);                  /* mov ecx, Outer */
+    OuterLoop = CodePtr;
+    EMIT(0xBE); Emit32(COPY_ADDRESS);           /* mov esi, COPY_ADDRESS */
+    EMIT(0xBA); Emit32(32);                     /* mov edx, 32 */
+    EMIT(0x31, 0xC0);                           /* xor eax, eax */
+    InnerLoop = CodePtr;
+    EMIT(0x03, 0x06);                           /* add eax, [esi] */
+    EMIT(0x6B, 0xC0, 0x21);                     /* imul eax, eax, 33 */
+    EMIT(0x83, 0xC6, 0x04);                     /* add esi, 4 */
+    EMIT(0x4A);                                 /* dec edx */
+    EMIT(0x75); EmitRel8(InnerLoop);            /* jnz InnerLoop */
+    EMIT(0x01, 0x05); Emit32(RESULT_ADDRESS + 0x10); /* add [RESULT_ADDRESS + 10h], eax */
+    EMIT(0xE2); EmitRel8(OuterLoop);            /* loop OuterLoop */
+
+    EMIT(0x31, 0xD2);                           /* xor edx, edx */
+    EMIT(0xB9); Emit32(Outer);                  /* mov ecx, Outer */
+    SmcLoop = CodePtr;
+    Patch = CodePtr + 6;
+    EMIT(0x88, 0x0D);                           /* mov [Patch + 2], cl */
+    Emit32(Paging ? ALIAS_ADDRESS + (Patch + 2 - PMODE_ADDRESS) : Patch + 2);
+    EMIT(0x80, 0xC2, 0x00);                     /* Patch: add dl, 0 */
+    EMIT(0xE2); EmitRel8(SmcLoop);              /* loop SmcLoop */
+    EMIT(0x89, 0x15); Emit32(RESULT_ADDRESS + 0x14); /* mov [RESULT_ADDRESS + 14h], edx */
+    EMIT(0xF4);                                 /* hlt */
+
+    return Start;
+}
+
+static void CheckProtectedModeProgram(ULONG Outer)
+{
+    ULONG Sum = 0, Expected, i;
+    UCHAR SmcSum = 0;
+
+    for (i = 0; i < 32; i++)
+        Sum = (Sum + ReadDword(COPY_ADDRESS + i * 4)) * 33;
+    Expected = Sum * Outer;
+
+    for (i = Outer; i > 0; i--)
+        SmcSum += (UCHAR)i;
+
+    if (ReadDword(RESULT_ADDRESS + 0x10) != Expected || ReadDword(RESULT_ADDRESS + 0x14) != SmcSum)
+    {
+        printf("Protected mode: got %08x/%08x, expected %08x/%08x\n",
+               ReadDword(RESULT_ADDRESS + 0x10), ReadDword(RESULT_ADDRESS + 0x14), Expected, SmcSum);
+        Failures++;
+    }
+}
+
+static double Run(PFAST486_STATE State, ULONG Start, ULONGLONG *Instructions)
+{
+    clock_t Begin;
+    ULONGLONG Count = 0;
+
+    Fast486Reset(State);
+    Fast486ExecuteAt(State, 0, Start);
+    Fast486SetStack(State, 0, STACK_ADDRESS);
+
+    Begin = clock();
+    while (!State->Halted)
+    {
+        Fast486StepInto(State);
+        Count++;
+    }
+
+    *Instructions = Count;
+    return (double)(clock() - Begin) / CLOCKS_PER_SEC;
+}
+
+static void Report(const char *What, ULONGLONG Instructions, double Seconds)
+{
+    printf("%-16s %12llu instructions %8.3f s %8.2f MIPS\n",
+           What, (unsigned long long)Instructions, Seconds,
+           Seconds > 0 ? Instructions / Seconds / 1e6 : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    static FAST486_STATE State;
+    ULONG Iterations = 20000, Start, Function;
+    ULONGLONG Instructions;
+    double Seconds;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            Iterations = atoi(argv[++i]);
+    }
+
+#ifndef FAST486_NO_CODE_CACHE
+    printf("Code cache: %u blocks of %u bytes\n", FAST486_CODE_CACHE_BLOCKS, FAST486_CACHE_SIZE);
+#else
+    printf("Code cache: disabled\n");
+#endif
+
+    Fast486Initialize(&State, MemRead, MemWrite, NULL, NULL, NULL, NULL, NULL, NULL);
+
+    /* The loop counters are 16-bit in real mode */
+    memset(Memory, 0, sizeof(Memory));
+    FillSource(SOURCE_ADDRESS, 0x100);
+    Start = BuildRealModeProgram((USHORT)min(Iterations, 0xFFFF), &Function);
+    Seconds = Run(&State, Start, &Instructions);
+    Report("Real mode", Instructions, Seconds);
+    CheckRealModeProgram((USHORT)min(Iterations, 0xFFFF), 0x5A5A);
+
+    /* Change the code behind the back of the CPU, and run it again without a reset */
+    Memory[Function + 1] = 0xA5;
+    Memory[Function + 2] = 0xA5;
+    Fast486InvalidateCodeRange(&State, Function + 1, 2);
+    memset(&Memory[RESULT_ADDRESS], 0, 4);
+    State.Halted = FALSE;
+    Fast486ExecuteAt(&State, 0, Start);
+    while (!State.Halted) Fast486StepInto(&State);
+    CheckRealModeProgram((USHORT)min(Iterations, 0xFFFF), 0xA5A5);
+
+    memset(Memory, 0, sizeof(Memory));
+    FillSource(COPY_ADDRESS, 0x100);
+    Start = BuildProtectedModeProgram(Iterations * 4, FALSE);
+    Seconds = Run(&State, Start, &Instructions);
+    Report("Protected mode", Instructions, Seconds);
+    CheckProtectedModeProgram(Iterations * 4);
+
+    /* Without a TLB, like NTVDM, every prefetch walks the page tables */
+    memset(Memory, 0, sizeof(Memory));
+    FillSource(COPY_ADDRESS, 0x100);
+    Start = BuildProtectedModeProgram(Iterations * 4, TRUE);
+    Seconds = Run(&State, Start, &Instructions);
+    Report("Paging", Instructions, Seconds);
+    CheckProtectedModeProgram(Iterations * 4);
+
+    if (Failures)
+    {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+
+    printf("All results are correct\n");
+    return 0;
+}
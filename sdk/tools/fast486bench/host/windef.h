@@ -0,0 +1,36 @@
+/*
+ * PROJECT:     ReactOS Fast486 Benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Minimal <windef.h> to build Fast486 on the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <typedefs.h>
+
+#if defined(_MSC_VER)
+#define FORCEINLINE __forceinline
+#else
+#define FORCEINLINE static inline __attribute__((always_inline))
+#endif
+
+/* Calling conventions only matter for the target */
+#define FASTCALL
+
+#define C_ASSERT(e) typedef char __C_ASSERT__[(e) ? 1 : -1]
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define UlongToPtr(u) ((PVOID)(ULONG_PTR)(u))
+#define RtlFillMemory(Destination, Length, Fill) memset(Destination, Fill, Length)
+
+typedef ULONGLONG *PULONGLONG;
+typedef LONGLONG *PLONGLONG;
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
@@ -0,0 +1,253 @@
+/*
+ * PROJECT:     ReactOS Hive Benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Measures building registry hives with cmlib on the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "mkhive.h"
+#include <wine/unicode.h>
+
+#define HIVE_LIST   "SYSTEM,SOFTWARE,DEFAULT,SAM,SECURITY"
+#define GROUPS      64
+
+static double Elapsed(clock_t Start)
+{
+    return (double)(clock() - Start) / CLOCKS_PER_SEC;
+}
+
+static PWCHAR AppendString(PWCHAR Buffer, PCSTR String)
+{
+    while (*String)
+        *Buffer++ = (WCHAR)*String++;
+    *Buffer = UNICODE_NULL;
+    return Buffer;
+}
+
+static PWCHAR AppendNumber(PWCHAR Buffer, ULONG Number, ULONG Digits)
+{
+    ULONG i;
+
+    for (i = Digits; i > 0; i--)
+    {
+        Buffer[i - 1] = (WCHAR)(L'0' + Number % 10);
+        Number /= 10;
+    }
+    Buffer[Digits] = UNICODE_NULL;
+    return Buffer + Digits;
+}
+
+static void MakeKeyName(PWCHAR Buffer, ULONG Index)
+{
+    Buffer = AppendString(Buffer, "Registry\\Machine\\SOFTWARE\\HiveBench\\Group");
+    Buffer = AppendNumber(Buffer, Index % GROUPS, 2);
+    Buffer = AppendString(Buffer, "\\Key");
+    AppendNumber(Buffer, Index, 7);
+}
+
+static ULONG DataSize(ULONG Index)
+{
+    return (Index * 37) % 400 + 8;
+}
+
+/* Grows SOFTWARE with keys and values of all sizes, then churns them */
+static BOOL SyntheticLoad(ULONG Keys)
+{
+    static const WCHAR Name[] = {'N','a','m','e',0};
+    static const WCHAR Data[] = {'D','a','t','a',0};
+    static const WCHAR Flags[] = {'F','l','a','g','s',0};
+    REG_APPEND_CONTEXT Context;
+    WCHAR KeyName[128];
+    UCHAR Buffer[1024];
+    HKEY Key;
+    ULONG i;
+    clock_t Start;
+
+    memset(Buffer, 0x5A, sizeof(Buffer));
+
+    Start = clock();
+    RegBeginAppend(&Context);
+    for (i = 0; i < Keys; i++)
+    {
+        MakeKeyName(KeyName, i);
+        if (RegAppendKey(&Context, KeyName, TRUE, &Key) != ERROR_SUCCESS)
+        {
+            printf("Creating key %lu failed\n", i);
+            RegEndAppend(&Context);
+            return FALSE;
+        }
+
+        RegSetValueExW(Key, Name, 0, REG_SZ, (PUCHAR)KeyName,
+                       (ULONG)((strlenW(KeyName) + 1) * sizeof(WCHAR)));
+        RegSetValueExW(Key, Data, 0, REG_BINARY, Buffer, DataSize(i));
+        RegSetValueExW(Key, Flags, 0, REG_DWORD, (PUCHAR)&i, sizeof(i));
+    }
+    printf("Creating the keys:             %6.3f s\n", Elapsed(Start));
+
+    /* Larger data frees the old cells and allocates new ones */
+    Start = clock();
+    for (i = 0; i < Keys; i += 3)
+    {
+        MakeKeyName(KeyName, i);
+        if (RegAppendKey(&Context, KeyName, FALSE, &Key) != ERROR_SUCCESS)
+            continue;
+        RegSetValueExW(Key, Data, 0, REG_BINARY, Buffer, DataSize(i) + 300);
+    }
+    for (i = 0; i < Keys; i += 5)
+    {
+        MakeKeyName(KeyName, i);
+        if (RegAppendKey(&Context, KeyName, FALSE, &Key) != ERROR_SUCCESS)
+            continue;
+        RegDeleteValueW(Key, Name);
+    }
+    RegEndAppend(&Context);
+    printf("Rewriting and deleting values: %6.3f s\n", Elapsed(Start));
+
+    return TRUE;
+}
+
+static ULONG HashBytes(ULONG Hash, const void *Data, ULONG Length)
+{
+    const UCHAR *Bytes = Data;
+
+    while (Length--)
+        Hash = (Hash ^ *Bytes++) * 16777619;
+    return Hash;
+}
+
+static ULONG HashName(ULONG Hash, PVOID Name, ULONG Length, BOOLEAN Compressed)
+{
+    WCHAR Char;
+    ULONG i;
+
+    if (Compressed)
+    {
+        for (i = 0; i < Length; i++)
+        {
+            Char = RtlUpcaseUnicodeChar(((PUCHAR)Name)[i]);
+            Hash = HashBytes(Hash, &Char, sizeof(Char));
+        }
+    }
+    else
+    {
+        for (i = 0; i < Length / sizeof(WCHAR); i++)
+        {
+            Char = RtlUpcaseUnicodeChar(((PWCHAR)Name)[i]);
+            Hash = HashBytes(Hash, &Char, sizeof(Char));
+        }
+    }
+    return Hash;
+}
+
+/* Hashes the names, values and data of a key tree in subkey order */
+static ULONG HashKey(PHHIVE Hive, HCELL_INDEX Cell, ULONG Hash, PULONG KeyCount)
+{
+    PCM_KEY_NODE Node;
+    PCM_KEY_VALUE Value;
+    PHCELL_INDEX ValueList;
+    HCELL_INDEX SubKey;
+    ULONG i, Length;
+
+    Node = (PCM_KEY_NODE)HvGetCell(Hive, Cell);
+    Hash = HashName(Hash, Node->Name, Node->NameLength, !!(Node->Flags & KEY_COMP_NAME));
+    (*KeyCount)++;
+
+    if (Node->ValueList.Count)
+    {
+        ValueList = (PHCELL_INDEX)HvGetCell(Hive, Node->ValueList.List);
+        for (i = 0; i < Node->ValueList.Count; i++)
+        {
+            Value = (PCM_KEY_VALUE)HvGetCell(Hive, ValueList[i]);
+            Hash = HashName(Hash, Value->Name, Value->NameLength,
+                            !!(Value->Flags & VALUE_COMP_NAME));
+            Hash = HashBytes(Hash, &Value->Type, sizeof(Value->Type));
+
+            Length = Value->DataLength & ~CM_KEY_VALUE_SPECIAL_SIZE;
+            if (Value->DataLength & CM_KEY_VALUE_SPECIAL_SIZE)
+                Hash = HashBytes(Hash, &Value->Data, Length);
+            else if (Length)
+                Hash = HashBytes(Hash, HvGetCell(Hive, Value->Data), Length);
+        }
+    }
+
+    for (i = 0; i < Node->SubKeyCounts[Stable]; i++)
+    {
+        SubKey = CmpFindSubKeyByNumber(Hive, Node, i);
+        Hash = HashKey(Hive, SubKey, Hash, KeyCount);
+    }
+
+    return Hash;
+}
+
+static void usage(void)
+{
+    printf("Usage: hivebench [-k:<keys>] <inffiles>\n\n"
+           "  -k:keys   - Synthetic keys to add to SOFTWARE afterwards (default: 100000).\n"
+           "  inffiles  - INF files to import, like the ones in boot/bootdata.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    ULONG Keys = 100000;
+    ULONG Hash, KeyCount;
+    PHHIVE Hive;
+    clock_t Start, Total;
+    int i;
+
+    for (i = 1; i < argc && *argv[i] == '-'; i++)
+    {
+        if (argv[i][1] == 'k' && (argv[i][2] == ':' || argv[i][2] == '='))
+        {
+            Keys = strtoul(argv[i] + 3, NULL, 0);
+        }
+        else
+        {
+            usage();
+            return argv[i][1] == '?' ? 0 : 1;
+        }
+    }
+    if (i >= argc)
+    {
+        usage();
+        return 1;
+    }
+
+    Total = clock();
+    RegInitializeRegistry(HIVE_LIST);
+
+    Start = clock();
+    for (; i < argc; i++)
+    {
+        if (!ImportRegistryFile(argv[i]))
+        {
+            printf("Importing %s failed\n", argv[i]);
+            return 1;
+        }
+    }
+    printf("Importing the INF files:       %6.3f s\n", Elapsed(Start));
+
+    if (Keys && !SyntheticLoad(Keys))
+        return 1;
+
+    printf("Total:                         %6.3f s\n\n", Elapsed(Total));
+
+    /* Print what was built, so that builds can be compared */
+    for (i = 0; i < MAX_NUMBER_OF_REGISTRY_HIVES; i++)
+    {
+        if (!strstr(HIVE_LIST, RegistryHives[i].HiveName))
+            continue;
+
+        Hive = &RegistryHives[i].CmHive->Hive;
+        KeyCount = 0;
+        Hash = HashKey(Hive, Hive->BaseBlock->RootCell, 2166136261U, &KeyCount);
+        printf("%-9s %8lu keys %10lu bytes  content hash %08lx\n",
+               RegistryHives[i].HiveName, KeyCount,
+               Hive->Storage[Stable].Length * HBLOCK_SIZE, Hash);
+    }
+
+    RegShutdownRegistry();
+    return 0;
+}
@@ -403,6 +403,7 @@ registry_callback(HINF hInf, PCWSTR Section, BOOL Delete)
     size_t Length;
 
     PINFCONTEXT Context = NULL;
+    REG_APPEND_CONTEXT AppendContext;
     HKEY KeyHandle;
     BOOL Ok;
 
@@ -410,6 +411,9 @@ registry_callback(HINF hInf, PCWSTR Section, BOOL Delete)
     if (!Ok)
         return TRUE; /* Don't fail if the section isn't present */
 
+    /* Consecutive lines mostly share their keys, keep them open */
+    RegBeginAppend(&AppendContext);
+
     for (Ok = TRUE; Ok; Ok = (InfHostFindNextLine(Context, Context) == 0))
     {
         /* Get root */
@@ -446,17 +450,17 @@ registry_callback(HINF hInf, PCWSTR Section, BOOL Delete)
 
         if (Delete || (Flags & FLG_ADDREG_OVERWRITEONLY))
         {
-            if (RegOpenKeyW(NULL, Buffer, &KeyHandle) != ERROR_SUCCESS)
+            if (RegAppendKey(&AppendContext, Buffer, FALSE, &KeyHandle) != ERROR_SUCCESS)
             {
-                DPRINT("RegOpenKey(%S) failed\n", Buffer);
+                DPRINT("RegAppendKey(%S) failed\n", Buffer);
                 continue;  /* ignore if it doesn't exist */
             }
         }
         else
         {
-            if (RegCreateKeyW(NULL, Buffer, &KeyHandle) != ERROR_SUCCESS)
+            if (RegAppendKey(&AppendContext, Buffer, TRUE, &KeyHandle) != ERROR_SUCCESS)
             {
-                DPRINT("RegCreateKey(%S) failed\n", Buffer);
+                DPRINT("RegAppendKey(%S) failed\n", Buffer);
                 continue;
             }
         }
@@ -474,13 +478,16 @@ registry_callback(HINF hInf, PCWSTR Section, BOOL Delete)
         /* And now do it */
         if (!do_reg_operation(KeyHandle, ValuePtr, Context, Flags))
         {
-            RegCloseKey(KeyHandle);
+            RegEndAppend(&AppendContext);
             return FALSE;
         }
 
-        RegCloseKey(KeyHandle);
+        /* The key may be gone, don't keep it around */
+        if (Flags & (FLG_ADDREG_DELREG_BIT | FLG_ADDREG_DELVAL))
+            RegEndAppend(&AppendContext);
     }
 
+    RegEndAppend(&AppendContext);
     InfHostFreeContext(Context);
 
     return TRUE;
@@ -652,6 +652,139 @@ RegOpenKeyW(
     return RegpCreateOrOpenKey(hKey, lpSubKey, FALSE, FALSE, phkResult);
 }
 
+/*
+ * The keys returned by RegAppendKey() belong to the context: they must not
+ * be closed, and stay valid until the next call or RegEndAppend(). Deleting
+ * one of them requires ending the append first.
+ */
+VOID
+RegBeginAppend(
+    OUT PREG_APPEND_CONTEXT Context)
+{
+    Context->Depth = 0;
+    Context->UncachedKey = NULL;
+}
+
+VOID
+RegEndAppend(
+    IN OUT PREG_APPEND_CONTEXT Context)
+{
+    while (Context->Depth > 0)
+        RegCloseKey(Context->Keys[--Context->Depth]);
+
+    if (Context->UncachedKey)
+    {
+        RegCloseKey(Context->UncachedKey);
+        Context->UncachedKey = NULL;
+    }
+}
+
+LONG
+RegAppendKey(
+    IN OUT PREG_APPEND_CONTEXT Context,
+    IN PCWSTR KeyName,
+    IN BOOL AllowCreation,
+    OUT PHKEY Key)
+{
+    PCWSTR Name, End;
+    USHORT Offset, Length;
+    ULONG Depth;
+    HKEY SubKey;
+    LONG rc;
+
+    if (Context->UncachedKey)
+    {
+        RegCloseKey(Context->UncachedKey);
+        Context->UncachedKey = NULL;
+    }
+
+    if (*KeyName == OBJ_NAME_PATH_SEPARATOR)
+        KeyName++;
+
+    /* Paths we can't cache are opened the usual way */
+    if (strlenW(KeyName) >= REG_APPEND_MAX_PATH)
+    {
+        rc = RegpCreateOrOpenKey(NULL, KeyName, AllowCreation, FALSE, &Context->UncachedKey);
+        *Key = Context->UncachedKey;
+        return rc;
+    }
+
+    /* Skip the components we already have open */
+    Name = KeyName;
+    for (Depth = 0; *Name; Depth++)
+    {
+        End = strchrW(Name, OBJ_NAME_PATH_SEPARATOR);
+        Length = (USHORT)(End ? End - Name : strlenW(Name));
+
+        if (Depth >= Context->Depth ||
+            Length != Context->NameLengths[Depth] ||
+            strncmpiW(Name, &Context->Path[Context->NameOffsets[Depth]], Length) != 0)
+        {
+            break;
+        }
+
+        Name += Length;
+        if (*Name)
+            Name++;
+    }
+
+    /* Close what is left of the previous path */
+    while (Context->Depth > Depth)
+        RegCloseKey(Context->Keys[--Context->Depth]);
+
+    /* Then walk down the new part, one component at a time */
+    strcpyW(Context->Path, KeyName);
+    Offset = (USHORT)(Name - KeyName);
+    while (Context->Path[Offset])
+    {
+        End = strchrW(&Context->Path[Offset], OBJ_NAME_PATH_SEPARATOR);
+        Length = (USHORT)(End ? End - &Context->Path[Offset] : strlenW(&Context->Path[Offset]));
+        if (Length == 0)
+        {
+            /* Empty component, like a trailing separator */
+            Offset++;
+            continue;
+        }
+
+        if (Context->Depth == REG_APPEND_MAX_DEPTH)
+        {
+            rc = RegpCreateOrOpenKey(Context->Keys[Context->Depth - 1], &Context->Path[Offset],
+                                     AllowCreation, FALSE, &Context->UncachedKey);
+            *Key = Context->UncachedKey;
+            return rc;
+        }
+
+        Context->Path[Offset + Length] = UNICODE_NULL;
+        rc = RegpCreateOrOpenKey(Context->Depth ? Context->Keys[Context->Depth - 1] : NULL,
+                                 &Context->Path[Offset],
+                                 AllowCreation,
+                                 FALSE,
+                                 &SubKey);
+        if (End)
+            Context->Path[Offset + Length] = OBJ_NAME_PATH_SEPARATOR;
+        if (rc != ERROR_SUCCESS)
+            return rc;
+
+        Context->Keys[Context->Depth] = SubKey;
+        Context->NameOffsets[Context->Depth] = Offset;
+        Context->NameLengths[Context->Depth] = Length;
+        Context->Depth++;
+
+        Offset += Length;
+        if (Context->Path[Offset])
+            Offset++;
+    }
+
+    if (Context->Depth == 0)
+    {
+        *Key = MEMKEY_TO_HKEY(RootKey);
+        return ERROR_SUCCESS;
+    }
+
+    *Key = Context->Keys[Context->Depth - 1];
+    return ERROR_SUCCESS;
+}
+
 LONG WINAPI
 RegSetValueExW(
     IN HKEY hKey,
@@ -751,7 +884,7 @@ RegSetValueExW(
         if (!DataCell)
             return ERROR_GEN_FAILURE; // STATUS_UNSUCCESSFUL;
 
-        DataCellSize = (ULONG)(-HvGetCellSize(Hive, DataCell));
+        DataCellSize = (ULONG)HvGetCellSize(Hive, DataCell);
     }
     else
     {
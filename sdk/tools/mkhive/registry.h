@@ -46,6 +46,39 @@ extern HIVE_LIST_ENTRY RegistryHives[];
 #define REG_QWORD                          11
 #define REG_QWORD_LITTLE_ENDIAN            11
 
+/*
+ * Appending a key tree: INF files add keys in long runs sharing most of
+ * their path. The context keeps the keys of the last path open, so that
+ * only the components which changed are looked up or created.
+ */
+#define REG_APPEND_MAX_DEPTH    32
+#define REG_APPEND_MAX_PATH     512
+
+typedef struct _REG_APPEND_CONTEXT
+{
+    ULONG Depth;
+    HKEY Keys[REG_APPEND_MAX_DEPTH];
+    USHORT NameOffsets[REG_APPEND_MAX_DEPTH];
+    USHORT NameLengths[REG_APPEND_MAX_DEPTH];
+    HKEY UncachedKey;
+    WCHAR Path[REG_APPEND_MAX_PATH];
+} REG_APPEND_CONTEXT, *PREG_APPEND_CONTEXT;
+
+VOID
+RegBeginAppend(
+    OUT PREG_APPEND_CONTEXT Context);
+
+LONG
+RegAppendKey(
+    IN OUT PREG_APPEND_CONTEXT Context,
+    IN PCWSTR KeyName,
+    IN BOOL AllowCreation,
+    OUT PHKEY Key);
+
+VOID
+RegEndAppend(
+    IN OUT PREG_APPEND_CONTEXT Context);
+
 VOID
 RegInitializeRegistry(
     IN PCSTR HiveList);
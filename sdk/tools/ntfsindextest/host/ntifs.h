@@ -0,0 +1,86 @@
+/*
+ * PROJECT:     ReactOS NTFS Index Test
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Minimal <ntifs.h> to build the NTFS B-tree code on the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <typedefs.h>
+
+#if defined(_MSC_VER)
+#define FORCEINLINE __forceinline
+#else
+#define FORCEINLINE static inline __attribute__((always_inline))
+#endif
+
+#define INIT_FUNCTION
+#define NT_ASSERT(x) assert(x)
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define BooleanFlagOn(F, SF) ((BOOLEAN)(((F) & (SF)) != 0))
+#define ALIGN_DOWN_BY(size, align) ((ULONG_PTR)(size) & ~((ULONG_PTR)(align) - 1))
+#define ALIGN_UP_BY(size, align) (ALIGN_DOWN_BY(((ULONG_PTR)(size) + (align) - 1), align))
+#define ALIGN_UP(size, type) ALIGN_UP_BY(size, sizeof(type))
+#define MAXIMUM_VOLUME_LABEL_LENGTH (32 * sizeof(WCHAR))
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000)
+#define STATUS_PENDING                  ((NTSTATUS)0x00000103)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002)
+#define STATUS_END_OF_FILE              ((NTSTATUS)0xC0000011)
+#define STATUS_OBJECT_NAME_NOT_FOUND    ((NTSTATUS)0xC0000034)
+#define STATUS_OBJECT_NAME_COLLISION    ((NTSTATUS)0xC0000035)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS)0xC000009A)
+#define STATUS_FILE_CORRUPT_ERROR       ((NTSTATUS)0xC0000102)
+
+typedef ULONGLONG *PULONGLONG;
+typedef LONGLONG *PLONGLONG;
+typedef ULONG_PTR KSPIN_LOCK;
+
+typedef union _ULARGE_INTEGER
+{
+    struct
+    {
+        ULONG LowPart;
+        ULONG HighPart;
+    };
+    ULONGLONG QuadPart;
+} ULARGE_INTEGER, *PULARGE_INTEGER;
+
+/* The B-tree code never looks inside the kernel objects the driver structures embed */
+typedef struct _HOST_KERNEL_OBJECT { PVOID Opaque[16]; } HOST_KERNEL_OBJECT;
+typedef HOST_KERNEL_OBJECT ERESOURCE, NPAGED_LOOKASIDE_LIST, LARGE_MCB, *PLARGE_MCB,
+                           SECTION_OBJECT_POINTERS, FSRTL_COMMON_FCB_HEADER, WORK_QUEUE_ITEM,
+                           CACHE_MANAGER_CALLBACKS, FAST_IO_DISPATCH;
+typedef struct _FILE_OBJECT *PFILE_OBJECT;
+typedef struct _DEVICE_OBJECT *PDEVICE_OBJECT;
+typedef struct _DRIVER_OBJECT *PDRIVER_OBJECT;
+typedef struct _IRP *PIRP;
+typedef struct _IO_STACK_LOCATION *PIO_STACK_LOCATION;
+typedef struct _VPB *PVPB;
+typedef enum _LOCK_OPERATION { IoReadAccess, IoWriteAccess, IoModifyAccess } LOCK_OPERATION;
+
+typedef NTSTATUS DRIVER_INITIALIZE(PDRIVER_OBJECT, PUNICODE_STRING);
+typedef NTSTATUS DRIVER_DISPATCH(PDEVICE_OBJECT, PIRP);
+typedef BOOLEAN FAST_IO_CHECK_IF_POSSIBLE(PFILE_OBJECT, PLARGE_INTEGER, ULONG, BOOLEAN, ULONG, BOOLEAN, PVOID, PDEVICE_OBJECT);
+typedef BOOLEAN FAST_IO_READ(PFILE_OBJECT, PLARGE_INTEGER, ULONG, BOOLEAN, ULONG, PVOID, PVOID, PDEVICE_OBJECT);
+typedef BOOLEAN FAST_IO_WRITE(PFILE_OBJECT, PLARGE_INTEGER, ULONG, BOOLEAN, ULONG, PVOID, PVOID, PDEVICE_OBJECT);
+
+/* Pool allocations go straight to the C heap */
+#define NonPagedPool 0
+#define PagedPool 1
+#define ExAllocatePoolWithTag(PoolType, NumberOfBytes, Tag) malloc(NumberOfBytes)
+#define ExFreePoolWithTag(P, Tag) free(P)
+#define ExAllocateFromNPagedLookasideList(Lookaside) malloc(4096)
+#define ExFreeToNPagedLookasideList(Lookaside, Entry) free(Entry)
+
+LONG NTAPI RtlCompareUnicodeString(PCUNICODE_STRING String1, PCUNICODE_STRING String2, BOOLEAN CaseInSensitive);
+VOID NTAPI RtlInitializeBitMap(PRTL_BITMAP BitMapHeader, PULONG BitMapBuffer, ULONG SizeOfBitMap);
+VOID NTAPI RtlSetBits(PRTL_BITMAP BitMapHeader, ULONG StartingIndex, ULONG NumberToSet);
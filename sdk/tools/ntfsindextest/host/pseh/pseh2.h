@@ -0,0 +1,8 @@
+/*
+ * PROJECT:     ReactOS NTFS Index Test
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Minimal <pseh/pseh2.h>, the B-tree code has no exception handlers
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
@@ -0,0 +1,8 @@
+/*
+ * PROJECT:     ReactOS NTFS Index Test
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Minimal <section_attribs.h>
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
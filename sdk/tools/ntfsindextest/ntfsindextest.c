@@ -0,0 +1,805 @@
+/*
+ * PROJECT:     ReactOS NTFS Index Test
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Checks the in place index record updates of the NTFS driver
+ *              on synthetic INDX records, and reads back an index built with them
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+/* The helpers under test are static */
+#include <btree.c>
+
+#define INDEX_BUFFER_SIZE   4096
+#define NO_CHILD            (~0ULL - NTFS_MAX_INDEX_DEPTH)
+
+static int Failures;
+
+#define CHECK(Expression) \
+    do { if (!(Expression)) { printf("%s:%d: %s\n", __FUNCTION__, __LINE__, #Expression); Failures++; } } while (0)
+
+/* Only the B_TREE rebuild path uses these */
+NTSTATUS AddBitmap(PNTFS_VCB Vcb, PFILE_RECORD_HEADER FileRecord, PNTFS_ATTR_RECORD AttributeAddress, PCWSTR Name, USHORT NameLength) UNIMPLEMENTED
+NTSTATUS AddIndexAllocation(PNTFS_VCB Vcb, PFILE_RECORD_HEADER FileRecord, PNTFS_ATTR_RECORD AttributeAddress, PCWSTR Name, USHORT NameLength) UNIMPLEMENTED
+
+/* The $I30 attributes of the directory the round trip runs on, kept in memory */
+enum { VolumeIndexRoot, VolumeIndexAllocation, VolumeBitmap, VolumeAttributeCount };
+
+static struct
+{
+    DEVICE_EXTENSION Vcb;
+    NTFS_ATTR_RECORD Records[VolumeAttributeCount];
+    NTFS_ATTR_CONTEXT Contexts[VolumeAttributeCount];
+    PUCHAR Data[VolumeAttributeCount];
+    ULONG Length[VolumeAttributeCount];
+} Volume;
+
+static void ResizeVolumeAttribute(ULONG Attribute, ULONG Length)
+{
+    Volume.Data[Attribute] = realloc(Volume.Data[Attribute], Length);
+    if (Length > Volume.Length[Attribute])
+        memset(Volume.Data[Attribute] + Volume.Length[Attribute], 0, Length - Volume.Length[Attribute]);
+    Volume.Length[Attribute] = Length;
+    Volume.Records[Attribute].Resident.ValueLength = Length;
+}
+
+ULONGLONG
+AttributeDataLength(PNTFS_ATTR_RECORD AttrRecord)
+{
+    return Volume.Length[AttrRecord - Volume.Records];
+}
+
+NTSTATUS
+FindAttribute(PDEVICE_EXTENSION Vcb, PFILE_RECORD_HEADER MftRecord, ULONG Type, PCWSTR Name, ULONG NameLength, PNTFS_ATTR_CONTEXT *AttrCtx, PULONG Offset)
+{
+    ULONG Attribute;
+
+    for (Attribute = 0; Attribute < VolumeAttributeCount; Attribute++)
+    {
+        if (Volume.Records[Attribute].Type == Type && Volume.Data[Attribute])
+        {
+            *AttrCtx = &Volume.Contexts[Attribute];
+            *Offset = 0x38 + Attribute * 0x80;
+            return STATUS_SUCCESS;
+        }
+    }
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+VOID
+ReleaseAttributeContext(PNTFS_ATTR_CONTEXT Context)
+{
+}
+
+ULONG
+ReadAttribute(PDEVICE_EXTENSION Vcb, PNTFS_ATTR_CONTEXT Context, ULONGLONG Offset, PCHAR Buffer, ULONG Length)
+{
+    ULONG Attribute = Context - Volume.Contexts;
+
+    if (Offset >= Volume.Length[Attribute])
+        return 0;
+    Length = min(Length, Volume.Length[Attribute] - (ULONG)Offset);
+    memcpy(Buffer, Volume.Data[Attribute] + Offset, Length);
+    return Length;
+}
+
+/* Like the driver, this doesn't grow the attribute */
+NTSTATUS
+WriteAttribute(PDEVICE_EXTENSION Vcb, PNTFS_ATTR_CONTEXT Context, ULONGLONG Offset, const PUCHAR Buffer, ULONG Length, PULONG LengthWritten, PFILE_RECORD_HEADER FileRecord)
+{
+    ULONG Attribute = Context - Volume.Contexts;
+
+    CHECK(Offset + Length <= Volume.Length[Attribute]);
+    if (Offset + Length > Volume.Length[Attribute])
+        return STATUS_END_OF_FILE;
+    memcpy(Volume.Data[Attribute] + Offset, Buffer, Length);
+    *LengthWritten = Length;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+SetNonResidentAttributeDataLength(PDEVICE_EXTENSION Vcb, PNTFS_ATTR_CONTEXT AttrContext, ULONG AttrOffset, PFILE_RECORD_HEADER FileRecord, PLARGE_INTEGER DataSize)
+{
+    ResizeVolumeAttribute(AttrContext - Volume.Contexts, (ULONG)DataSize->QuadPart);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+SetResidentAttributeDataLength(PDEVICE_EXTENSION Vcb, PNTFS_ATTR_CONTEXT AttrContext, ULONG AttrOffset, PFILE_RECORD_HEADER FileRecord, PLARGE_INTEGER DataSize)
+{
+    ResizeVolumeAttribute(AttrContext - Volume.Contexts, (ULONG)DataSize->QuadPart);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+InternalSetResidentAttributeLength(PDEVICE_EXTENSION DeviceExt, PNTFS_ATTR_CONTEXT AttrContext, PFILE_RECORD_HEADER FileRecord, ULONG AttrOffset, ULONG DataSize)
+{
+    ResizeVolumeAttribute(AttrContext - Volume.Contexts, DataSize);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+UpdateFileRecord(PDEVICE_EXTENSION Vcb, ULONGLONG MftIndex, PFILE_RECORD_HEADER FileRecord)
+{
+    return STATUS_SUCCESS;
+}
+
+/* Same as the driver's, so that a record changed after it was protected doesn't read back */
+NTSTATUS
+AddFixupArray(PDEVICE_EXTENSION Vcb, PNTFS_RECORD_HEADER Record)
+{
+    PFIXUP_ARRAY FixupArray = (PFIXUP_ARRAY)((PUCHAR)Record + Record->UsaOffset);
+    PUSHORT SectorEnd;
+    ULONG i;
+
+    FixupArray->USN++;
+    for (i = 0; i < Record->UsaCount - 1U; i++)
+    {
+        SectorEnd = (PUSHORT)((PUCHAR)Record + (i + 1) * Vcb->NtfsInfo.BytesPerSector - sizeof(USHORT));
+        FixupArray->Array[i] = *SectorEnd;
+        *SectorEnd = FixupArray->USN;
+    }
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+FixupUpdateSequenceArray(PDEVICE_EXTENSION Vcb, PNTFS_RECORD_HEADER Record)
+{
+    PFIXUP_ARRAY FixupArray = (PFIXUP_ARRAY)((PUCHAR)Record + Record->UsaOffset);
+    PUSHORT SectorEnd;
+    ULONG i;
+
+    for (i = 0; i < Record->UsaCount - 1U; i++)
+    {
+        SectorEnd = (PUSHORT)((PUCHAR)Record + (i + 1) * Vcb->NtfsInfo.BytesPerSector - sizeof(USHORT));
+        if (*SectorEnd != FixupArray->USN)
+            return STATUS_UNSUCCESSFUL;
+        *SectorEnd = FixupArray->Array[i];
+    }
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+RtlInitializeBitMap(PRTL_BITMAP BitMapHeader, PULONG BitMapBuffer, ULONG SizeOfBitMap)
+{
+    BitMapHeader->SizeOfBitMap = SizeOfBitMap;
+    BitMapHeader->Buffer = BitMapBuffer;
+}
+
+/* The real one asserts the same */
+VOID
+NTAPI
+RtlSetBits(PRTL_BITMAP BitMapHeader, ULONG StartingIndex, ULONG NumberToSet)
+{
+    CHECK(StartingIndex + NumberToSet <= BitMapHeader->SizeOfBitMap);
+    for (; NumberToSet != 0; NumberToSet--, StartingIndex++)
+        BitMapHeader->Buffer[StartingIndex / 32] |= 1UL << (StartingIndex % 32);
+}
+
+ULONG
+GetFileNameAttributeLength(PFILENAME_ATTRIBUTE FileNameAttribute)
+{
+    return FIELD_OFFSET(FILENAME_ATTRIBUTE, Name) + FileNameAttribute->NameLength * sizeof(WCHAR);
+}
+
+/* The names used here are plain ASCII */
+LONG
+NTAPI
+RtlCompareUnicodeString(PCUNICODE_STRING String1, PCUNICODE_STRING String2, BOOLEAN CaseInSensitive)
+{
+    USHORT i, Length = min(String1->Length, String2->Length) / sizeof(WCHAR);
+
+    for (i = 0; i < Length; i++)
+    {
+        WCHAR Char1 = String1->Buffer[i], Char2 = String2->Buffer[i];
+
+        if (CaseInSensitive)
+        {
+            if (Char1 >= 'a' && Char1 <= 'z') Char1 -= 'a' - 'A';
+            if (Char2 >= 'a' && Char2 <= 'z') Char2 -= 'a' - 'A';
+        }
+        if (Char1 != Char2)
+            return Char1 - Char2;
+    }
+
+    return String1->Length - String2->Length;
+}
+
+static PINDEX_ENTRY_ATTRIBUTE MakeEntry(const char *Name, ULONGLONG Child)
+{
+    ULONG NameLength = (ULONG)strlen(Name), i;
+    ULONG KeyLength = FIELD_OFFSET(FILENAME_ATTRIBUTE, Name) + NameLength * sizeof(WCHAR);
+    ULONG Length = ALIGN_UP_BY(FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName) + KeyLength, 8);
+    PINDEX_ENTRY_ATTRIBUTE Entry;
+
+    if (Child != NO_CHILD)
+        Length += sizeof(ULONGLONG);
+
+    Entry = calloc(1, Length);
+    Entry->Length = Length;
+    Entry->KeyLength = KeyLength;
+    Entry->FileName.NameLength = NameLength;
+    for (i = 0; i < NameLength; i++)
+        Entry->FileName.Name[i] = Name[i];
+    if (Child != NO_CHILD)
+    {
+        Entry->Flags = NTFS_INDEX_ENTRY_NODE;
+        SetIndexEntryVCN(Entry, Child);
+    }
+    return Entry;
+}
+
+static PINDEX_ENTRY_ATTRIBUTE EntryAt(PINDEX_HEADER_ATTRIBUTE Header, ULONG Offset)
+{
+    return (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)Header + Offset);
+}
+
+static ULONG EndEntryOffset(PINDEX_HEADER_ATTRIBUTE Header)
+{
+    ULONG Offset = Header->FirstEntryOffset;
+
+    while (!(EntryAt(Header, Offset)->Flags & NTFS_INDEX_ENTRY_END))
+        Offset += EntryAt(Header, Offset)->Length;
+    return Offset;
+}
+
+/* An empty record laid out like the ones Windows writes, ending in an end entry pointing to EndChild */
+static PINDEX_BUFFER MakeIndexBuffer(ULONGLONG VCN, ULONGLONG EndChild)
+{
+    PINDEX_BUFFER Buffer = calloc(1, INDEX_BUFFER_SIZE);
+    PINDEX_ENTRY_ATTRIBUTE EndEntry;
+
+    Buffer->Ntfs.Type = NRH_INDX_TYPE;
+    Buffer->Ntfs.UsaOffset = 0x28;
+    Buffer->Ntfs.UsaCount = INDEX_BUFFER_SIZE / 512 + 1;
+    Buffer->VCN = VCN;
+    Buffer->Header.FirstEntryOffset = 0x28;
+    Buffer->Header.AllocatedSize = INDEX_BUFFER_SIZE - FIELD_OFFSET(INDEX_BUFFER, Header);
+    Buffer->Header.Flags = (EndChild != NO_CHILD) ? INDEX_NODE_LARGE : 0;
+
+    EndEntry = EntryAt(&Buffer->Header, Buffer->Header.FirstEntryOffset);
+    EndEntry->Flags = NTFS_INDEX_ENTRY_END;
+    EndEntry->Length = FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName);
+    if (EndChild != NO_CHILD)
+    {
+        EndEntry->Flags |= NTFS_INDEX_ENTRY_NODE;
+        EndEntry->Length += sizeof(ULONGLONG);
+        SetIndexEntryVCN(EndEntry, EndChild);
+    }
+    Buffer->Header.TotalSizeOfEntries = Buffer->Header.FirstEntryOffset + EndEntry->Length;
+    return Buffer;
+}
+
+static BOOLEAN AppendEntry(PINDEX_HEADER_ATTRIBUTE Header, const char *Name, ULONGLONG Child)
+{
+    PINDEX_ENTRY_ATTRIBUTE Entry = MakeEntry(Name, Child);
+    BOOLEAN Fits = Header->TotalSizeOfEntries + Entry->Length <= Header->AllocatedSize;
+
+    if (Fits)
+        InsertEntryIntoIndexBuffer(Header, EndEntryOffset(Header), Entry);
+    free(Entry);
+    return Fits;
+}
+
+static void NameOf(PINDEX_ENTRY_ATTRIBUTE Entry, char *Name)
+{
+    ULONG i;
+
+    for (i = 0; i < Entry->FileName.NameLength; i++)
+        Name[i] = (char)Entry->FileName.Name[i];
+    Name[i] = 0;
+}
+
+/* Checks the record is well formed and sorted, and returns its number of entries, not counting the end entry */
+static ULONG CheckRecord(PINDEX_HEADER_ATTRIBUTE Header, PINDEX_ENTRY_ATTRIBUTE *First, PINDEX_ENTRY_ATTRIBUTE *Last)
+{
+    PINDEX_ENTRY_ATTRIBUTE Previous = NULL, Entry;
+    ULONG Offset = Header->FirstEntryOffset, Count = 0;
+
+    CHECK(Header->TotalSizeOfEntries <= Header->AllocatedSize);
+    for (;;)
+    {
+        Entry = EntryAt(Header, Offset);
+        CHECK(Entry->Length != 0 && Offset + Entry->Length <= Header->TotalSizeOfEntries);
+        if (Entry->Length == 0 || Offset + Entry->Length > Header->TotalSizeOfEntries)
+            return Count;
+        if (Entry->Flags & NTFS_INDEX_ENTRY_END)
+            break;
+        if (Previous)
+            CHECK(CompareIndexEntryNames(Previous, Entry, FALSE) < 0);
+        if (!Previous && First)
+            *First = Entry;
+        Previous = Entry;
+        Count++;
+        Offset += Entry->Length;
+    }
+    CHECK(Offset + Entry->Length == Header->TotalSizeOfEntries);
+    if (Last)
+        *Last = Previous;
+    return Count;
+}
+
+static void TestFindPosition(void)
+{
+    PINDEX_BUFFER Buffer = MakeIndexBuffer(0, NO_CHILD);
+    PINDEX_HEADER_ATTRIBUTE Header = &Buffer->Header;
+    PINDEX_ENTRY_ATTRIBUTE Entry;
+    ULONG Offset, EndOffset;
+    char Name[16];
+
+    AppendEntry(Header, "b", NO_CHILD);
+    AppendEntry(Header, "d", NO_CHILD);
+    AppendEntry(Header, "f", NO_CHILD);
+
+    /* Before the first entry */
+    Entry = MakeEntry("a", NO_CHILD);
+    CHECK(FindIndexEntryPosition(Header, Entry, FALSE, &Offset) == STATUS_SUCCESS);
+    CHECK(Offset == Header->FirstEntryOffset);
+    free(Entry);
+
+    /* Shorter names sort first */
+    Entry = MakeEntry("dd", NO_CHILD);
+    CHECK(FindIndexEntryPosition(Header, Entry, FALSE, &Offset) == STATUS_SUCCESS);
+    NameOf(EntryAt(Header, Offset), Name);
+    CHECK(!strcmp(Name, "f"));
+    free(Entry);
+
+    /* After the last entry, the end entry is the position */
+    Entry = MakeEntry("g", NO_CHILD);
+    CHECK(FindIndexEntryPosition(Header, Entry, FALSE, &Offset) == STATUS_SUCCESS);
+    CHECK(Offset == EndEntryOffset(Header));
+    free(Entry);
+
+    /* Case-insensitive collisions, case-sensitive order */
+    Entry = MakeEntry("D", NO_CHILD);
+    CHECK(FindIndexEntryPosition(Header, Entry, FALSE, &Offset) == STATUS_OBJECT_NAME_COLLISION);
+    CHECK(FindIndexEntryPosition(Header, Entry, TRUE, &Offset) == STATUS_SUCCESS);
+    CHECK(Offset == Header->FirstEntryOffset);
+    free(Entry);
+
+    /* A record whose entries run past its end is corrupt */
+    Entry = MakeEntry("g", NO_CHILD);
+    EndOffset = EndEntryOffset(Header);
+    EntryAt(Header, EndOffset)->Flags = 0;
+    CHECK(FindIndexEntryPosition(Header, Entry, FALSE, &Offset) == STATUS_FILE_CORRUPT_ERROR);
+    EntryAt(Header, EndOffset)->Flags = NTFS_INDEX_ENTRY_END;
+    Header->TotalSizeOfEntries -= 8;
+    CHECK(FindIndexEntryPosition(Header, Entry, FALSE, &Offset) == STATUS_FILE_CORRUPT_ERROR);
+    free(Entry);
+
+    free(Buffer);
+}
+
+/* Fills a record until the next entry doesn't fit, then splits it to insert one more */
+static void TestSplit(BOOLEAN HasChildren)
+{
+    INDEX_PATH_NODE Node;
+    PINDEX_HEADER_ATTRIBUTE Header;
+    PINDEX_ENTRY_ATTRIBUTE NewEntry, Median, LeftFirst, LeftLast, RightFirst, RightLast, EndEntry;
+    ULONG Count, LeftCount, RightCount, Offset, i;
+    ULONGLONG EndChild = HasChildren ? 1000 : NO_CHILD;
+    char Name[16];
+
+    RtlZeroMemory(&Node, sizeof(Node));
+    Node.Buffer = MakeIndexBuffer(7, EndChild);
+    Header = &Node.Buffer->Header;
+
+    for (Count = 0;; Count++)
+    {
+        sprintf(Name, "file%04u", Count * 2);
+        if (!AppendEntry(Header, Name, HasChildren ? 100 + Count : NO_CHILD))
+            break;
+    }
+    CHECK(CheckRecord(Header, NULL, NULL) == Count);
+
+    /* Goes in the middle of the record */
+    sprintf(Name, "file%04u", Count | 1);
+    NewEntry = MakeEntry(Name, HasChildren ? 2000 : NO_CHILD);
+    CHECK(FindIndexEntryPosition(Header, NewEntry, FALSE, &Offset) == STATUS_SUCCESS);
+    CHECK(Header->TotalSizeOfEntries + NewEntry->Length > Header->AllocatedSize);
+
+    CHECK(SplitIndexBuffer(&Node, 3, INDEX_BUFFER_SIZE, Offset, NewEntry, &Median) == STATUS_SUCCESS);
+    CHECK(Node.NewBuffer != NULL);
+    CHECK(Node.NewVCN == NTFS_SPLIT_PLACEHOLDER_VCN(3));
+    CHECK(Node.NewBuffer->VCN == Node.NewVCN);
+    CHECK(Node.NewBuffer->Ntfs.Type == NRH_INDX_TYPE);
+    CHECK(Node.Buffer->VCN == 7);
+
+    /* The median points to the original record, which keeps the lower half */
+    CHECK(Median->Flags & NTFS_INDEX_ENTRY_NODE);
+    CHECK(!(Median->Flags & NTFS_INDEX_ENTRY_END));
+    CHECK(GetIndexEntryVCN(Median) == 7);
+
+    LeftCount = CheckRecord(Header, &LeftFirst, &LeftLast);
+    RightCount = CheckRecord(&Node.NewBuffer->Header, &RightFirst, &RightLast);
+    CHECK(LeftCount + RightCount + 1 == Count + 1);
+    CHECK(LeftCount != 0 && RightCount != 0);
+    CHECK(CompareIndexEntryNames(LeftLast, Median, FALSE) < 0);
+    CHECK(CompareIndexEntryNames(Median, RightFirst, FALSE) < 0);
+    CHECK(Header->TotalSizeOfEntries - Header->FirstEntryOffset <= (Header->AllocatedSize - Header->FirstEntryOffset) / 2 + INDEX_BUFFER_SIZE / 8);
+
+    /* The left end entry takes over the child of the median, the right one keeps the old end's */
+    EndEntry = EntryAt(Header, EndEntryOffset(Header));
+    CHECK(BooleanFlagOn(EndEntry->Flags, NTFS_INDEX_ENTRY_NODE) == HasChildren);
+    EndEntry = EntryAt(&Node.NewBuffer->Header, EndEntryOffset(&Node.NewBuffer->Header));
+    CHECK(BooleanFlagOn(EndEntry->Flags, NTFS_INDEX_ENTRY_NODE) == HasChildren);
+    if (HasChildren)
+        CHECK(GetIndexEntryVCN(EndEntry) == 1000);
+
+    /* Every name made it to one side or the other */
+    for (i = 0; i <= Count; i++)
+    {
+        PINDEX_ENTRY_ATTRIBUTE Entry;
+        NTSTATUS Left, Right;
+
+        sprintf(Name, "file%04u", i < Count ? i * 2 : Count | 1);
+        Entry = MakeEntry(Name, NO_CHILD);
+        Left = FindIndexEntryPosition(Header, Entry, FALSE, &Offset);
+        Right = FindIndexEntryPosition(&Node.NewBuffer->Header, Entry, FALSE, &Offset);
+        CHECK((Left == STATUS_OBJECT_NAME_COLLISION) + (Right == STATUS_OBJECT_NAME_COLLISION) +
+              (CompareIndexEntryNames(Entry, Median, FALSE) == 0) == 1);
+        free(Entry);
+    }
+
+    free(Median);
+    free(NewEntry);
+    free(Node.NewBuffer);
+    free(Node.Buffer);
+}
+
+/* A split of the top record moves the root's entries, plus the median, into a new record */
+static void TestDemoteRoot(void)
+{
+    PINDEX_ROOT_ATTRIBUTE IndexRoot = calloc(1, 1024);
+    PINDEX_HEADER_ATTRIBUTE RootHeader = &IndexRoot->Header;
+    INDEX_PATH_NODE Node;
+    PINDEX_BUFFER NewBuffer;
+    PINDEX_ENTRY_ATTRIBUTE Median, Entry;
+    ULONG RootEntryOffset, Offset;
+    char Name[16];
+
+    RootHeader->FirstEntryOffset = sizeof(INDEX_HEADER_ATTRIBUTE);
+    RootHeader->AllocatedSize = 1024 - FIELD_OFFSET(INDEX_ROOT_ATTRIBUTE, Header);
+    RootHeader->Flags = INDEX_ROOT_LARGE;
+    Entry = EntryAt(RootHeader, RootHeader->FirstEntryOffset);
+    Entry->Flags = NTFS_INDEX_ENTRY_END | NTFS_INDEX_ENTRY_NODE;
+    Entry->Length = FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName) + sizeof(ULONGLONG);
+    SetIndexEntryVCN(Entry, 9);
+    RootHeader->TotalSizeOfEntries = RootHeader->FirstEntryOffset + Entry->Length;
+    AppendEntry(RootHeader, "c", 4);
+    AppendEntry(RootHeader, "x", 5);
+
+    /* "m" went down to VCN 7, which was split at "p" */
+    Entry = MakeEntry("m", NO_CHILD);
+    CHECK(FindIndexEntryPosition(RootHeader, Entry, FALSE, &RootEntryOffset) == STATUS_SUCCESS);
+    free(Entry);
+    SetIndexEntryVCN(EntryAt(RootHeader, RootEntryOffset), 7);
+
+    RtlZeroMemory(&Node, sizeof(Node));
+    Node.Buffer = MakeIndexBuffer(7, NO_CHILD);
+    Node.NewVCN = NTFS_SPLIT_PLACEHOLDER_VCN(0);
+    Median = MakeEntry("p", 7);
+
+    CHECK(DemoteIndexRoot(IndexRoot, RootEntryOffset, &Node, INDEX_BUFFER_SIZE, Median, &NewBuffer) == STATUS_SUCCESS);
+    CHECK(NewBuffer->Ntfs.Type == NRH_INDX_TYPE);
+    CHECK(NewBuffer->Header.Flags == INDEX_NODE_LARGE);
+    CHECK(NewBuffer->Header.FirstEntryOffset == Node.Buffer->Header.FirstEntryOffset);
+    CHECK(CheckRecord(&NewBuffer->Header, NULL, NULL) == 3);
+
+    /* c -> 4, p -> 7, x -> the right-hand sibling, end -> 9 */
+    Offset = NewBuffer->Header.FirstEntryOffset;
+    Entry = EntryAt(&NewBuffer->Header, Offset);
+    NameOf(Entry, Name);
+    CHECK(!strcmp(Name, "c") && GetIndexEntryVCN(Entry) == 4);
+    Entry = EntryAt(&NewBuffer->Header, Offset += Entry->Length);
+    NameOf(Entry, Name);
+    CHECK(!strcmp(Name, "p") && GetIndexEntryVCN(Entry) == 7);
+    Entry = EntryAt(&NewBuffer->Header, Offset += Entry->Length);
+    NameOf(Entry, Name);
+    CHECK(!strcmp(Name, "x") && GetIndexEntryVCN(Entry) == NTFS_SPLIT_PLACEHOLDER_VCN(0));
+    Entry = EntryAt(&NewBuffer->Header, Offset += Entry->Length);
+    CHECK((Entry->Flags & NTFS_INDEX_ENTRY_END) && GetIndexEntryVCN(Entry) == 9);
+
+    /* The root isn't touched until the new record is written */
+    CHECK(RootHeader->Flags == INDEX_ROOT_LARGE);
+    CHECK(GetIndexEntryVCN(EntryAt(RootHeader, RootEntryOffset)) == 7);
+    free(NewBuffer);
+
+    /* A root as large as an index record can't be moved into one */
+    RootHeader->TotalSizeOfEntries = Node.Buffer->Header.AllocatedSize;
+    CHECK(DemoteIndexRoot(IndexRoot, RootEntryOffset, &Node, INDEX_BUFFER_SIZE, Median, &NewBuffer) == STATUS_NOT_IMPLEMENTED);
+
+    free(Median);
+    free(Node.Buffer);
+    free(IndexRoot);
+}
+
+#define ROUND_TRIP_FILES    30000
+#define FILE_REFERENCE(i)   (0x0005000000000000ULL | (i))
+
+static PFILENAME_ATTRIBUTE MakeFileName(ULONG Number)
+{
+    PFILENAME_ATTRIBUTE FileName = calloc(1, FIELD_OFFSET(FILENAME_ATTRIBUTE, Name) + 16 * sizeof(WCHAR));
+    char Name[16];
+    ULONG i;
+
+    sprintf(Name, "file%05u", Number);
+    FileName->NameLength = (UCHAR)strlen(Name);
+    FileName->NameType = NTFS_FILE_NAME_WIN32_AND_DOS;
+    for (i = 0; i < FileName->NameLength; i++)
+        FileName->Name[i] = Name[i];
+    return FileName;
+}
+
+/* A large index the way Windows leaves it: empty leaves below an index root with RootEntries entries */
+static void CreateVolume(ULONG RootEntries, PUCHAR Expected)
+{
+    PINDEX_ROOT_ATTRIBUTE IndexRoot;
+    PINDEX_ENTRY_ATTRIBUTE Entry;
+    PINDEX_BUFFER Buffer;
+    ULONG Vcn;
+    char Name[16];
+
+    memset(&Volume, 0, sizeof(Volume));
+    Volume.Vcb.NtfsInfo.BytesPerSector = 512;
+    Volume.Vcb.NtfsInfo.SectorsPerCluster = 8;
+    Volume.Vcb.NtfsInfo.BytesPerCluster = 4096;
+    Volume.Vcb.NtfsInfo.BytesPerIndexRecord = INDEX_BUFFER_SIZE;
+
+    Volume.Records[VolumeIndexRoot].Type = AttributeIndexRoot;
+    Volume.Records[VolumeIndexAllocation].Type = AttributeIndexAllocation;
+    Volume.Records[VolumeIndexAllocation].IsNonResident = TRUE;
+    Volume.Records[VolumeBitmap].Type = AttributeBitmap;
+    for (Vcn = 0; Vcn < VolumeAttributeCount; Vcn++)
+        Volume.Contexts[Vcn].pRecord = &Volume.Records[Vcn];
+
+    IndexRoot = calloc(1, 1024);
+    IndexRoot->AttributeType = AttributeFileName;
+    IndexRoot->CollationRule = COLLATION_FILE_NAME;
+    IndexRoot->SizeOfEntry = INDEX_BUFFER_SIZE;
+    IndexRoot->ClustersPerIndexRecord = 1;
+    IndexRoot->Header.FirstEntryOffset = sizeof(INDEX_HEADER_ATTRIBUTE);
+    IndexRoot->Header.AllocatedSize = 1024 - FIELD_OFFSET(INDEX_ROOT_ATTRIBUTE, Header);
+    IndexRoot->Header.Flags = INDEX_ROOT_LARGE;
+    Entry = EntryAt(&IndexRoot->Header, IndexRoot->Header.FirstEntryOffset);
+    Entry->Flags = NTFS_INDEX_ENTRY_END | NTFS_INDEX_ENTRY_NODE;
+    Entry->Length = FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName) + sizeof(ULONGLONG);
+    SetIndexEntryVCN(Entry, RootEntries);
+    IndexRoot->Header.TotalSizeOfEntries = IndexRoot->Header.FirstEntryOffset + Entry->Length;
+
+    ResizeVolumeAttribute(VolumeIndexAllocation, (RootEntries + 1) * INDEX_BUFFER_SIZE);
+    ResizeVolumeAttribute(VolumeBitmap, 8);
+    for (Vcn = 0; Vcn <= RootEntries; Vcn++)
+    {
+        if (Vcn < RootEntries)
+        {
+            ULONG Number = (Vcn + 1) * ROUND_TRIP_FILES / (RootEntries + 1);
+
+            sprintf(Name, "file%05u", Number);
+            Entry = EntryAt(&IndexRoot->Header, EndEntryOffset(&IndexRoot->Header));
+            AppendEntry(&IndexRoot->Header, Name, Vcn);
+            Entry->Data.Directory.IndexedFile = FILE_REFERENCE(Number);
+            Expected[Number] = 1;
+        }
+
+        Buffer = MakeIndexBuffer(Vcn, NO_CHILD);
+        AddFixupArray(&Volume.Vcb, &Buffer->Ntfs);
+        memcpy(Volume.Data[VolumeIndexAllocation] + Vcn * INDEX_BUFFER_SIZE, Buffer, INDEX_BUFFER_SIZE);
+        Volume.Data[VolumeBitmap][Vcn / 8] |= 1 << (Vcn % 8);
+        free(Buffer);
+    }
+
+    ResizeVolumeAttribute(VolumeIndexRoot, FIELD_OFFSET(INDEX_ROOT_ATTRIBUTE, Header) + IndexRoot->Header.TotalSizeOfEntries);
+    IndexRoot->Header.AllocatedSize = IndexRoot->Header.TotalSizeOfEntries;
+    memcpy(Volume.Data[VolumeIndexRoot], IndexRoot, Volume.Length[VolumeIndexRoot]);
+    free(IndexRoot);
+}
+
+/* What NtfsAddFilenameToDirectory() does, reading the index root again every time */
+static NTSTATUS InsertFile(ULONG Number)
+{
+    PFILENAME_ATTRIBUTE FileName = MakeFileName(Number);
+    PINDEX_ROOT_ATTRIBUTE IndexRoot = malloc(Volume.Length[VolumeIndexRoot]);
+    NTSTATUS Status;
+
+    memcpy(IndexRoot, Volume.Data[VolumeIndexRoot], Volume.Length[VolumeIndexRoot]);
+    Status = NtfsInsertIndexEntry(&Volume.Vcb, NULL, IndexRoot, FILE_REFERENCE(Number), FileName, FALSE);
+
+    free(IndexRoot);
+    free(FileName);
+    return Status;
+}
+
+typedef struct
+{
+    PUCHAR Visited;
+    ULONG Count;
+    LONG LeafDepth;
+    ULONG Records;
+    PINDEX_ENTRY_ATTRIBUTE Previous;
+} INDEX_WALK;
+
+static void VisitEntry(INDEX_WALK *Walk, PINDEX_ENTRY_ATTRIBUTE Entry)
+{
+    PINDEX_ENTRY_ATTRIBUTE Copy;
+    char Name[16];
+    unsigned Number;
+
+    if (Walk->Previous)
+        CHECK(CompareIndexEntryNames(Walk->Previous, Entry, FALSE) < 0);
+
+    NameOf(Entry, Name);
+    CHECK(sscanf(Name, "file%05u", &Number) == 1 && Number < ROUND_TRIP_FILES);
+    if (Number < ROUND_TRIP_FILES)
+    {
+        CHECK(!Walk->Visited[Number]);
+        Walk->Visited[Number] = 1;
+    }
+    CHECK(Entry->Data.Directory.IndexedFile == FILE_REFERENCE(Number));
+    Walk->Count++;
+
+    Copy = malloc(Entry->Length);
+    memcpy(Copy, Entry, Entry->Length);
+    free(Walk->Previous);
+    Walk->Previous = Copy;
+}
+
+/* In-order walk of the index as it reads back from the volume */
+static void WalkIndex(INDEX_WALK *Walk, PINDEX_HEADER_ATTRIBUTE Header, LONG Depth, PUCHAR RecordsSeen)
+{
+    ULONG Offset = Header->FirstEntryOffset;
+    PINDEX_ENTRY_ATTRIBUTE Entry;
+
+    CheckRecord(Header, NULL, NULL);
+    for (;;)
+    {
+        Entry = EntryAt(Header, Offset);
+        if (Entry->Length == 0 || Offset + Entry->Length > Header->TotalSizeOfEntries)
+            return;
+
+        if (Entry->Flags & NTFS_INDEX_ENTRY_NODE)
+        {
+            ULONGLONG Vcn = GetIndexEntryVCN(Entry);
+            ULONG AllocationOffset;
+            PINDEX_BUFFER Buffer;
+
+            /* The child is a record that was allocated and written, reached only once */
+            CHECK(Vcn < Volume.Length[VolumeIndexAllocation] / INDEX_BUFFER_SIZE);
+            if (Vcn >= Volume.Length[VolumeIndexAllocation] / INDEX_BUFFER_SIZE)
+                return;
+            AllocationOffset = (ULONG)GetAllocationOffsetFromVCN(&Volume.Vcb, INDEX_BUFFER_SIZE, Vcn);
+            CHECK(Volume.Data[VolumeBitmap][Vcn / 8] & (1 << (Vcn % 8)));
+            CHECK(!RecordsSeen[Vcn]);
+            if (RecordsSeen[Vcn])
+                return;
+            RecordsSeen[Vcn] = 1;
+            Walk->Records++;
+
+            Buffer = malloc(INDEX_BUFFER_SIZE);
+            memcpy(Buffer, Volume.Data[VolumeIndexAllocation] + AllocationOffset, INDEX_BUFFER_SIZE);
+            CHECK(FixupUpdateSequenceArray(&Volume.Vcb, &Buffer->Ntfs) == STATUS_SUCCESS);
+            CHECK(Buffer->Ntfs.Type == NRH_INDX_TYPE);
+            CHECK(Buffer->VCN == Vcn);
+            CHECK(BooleanFlagOn(Buffer->Header.Flags, INDEX_NODE_LARGE) ==
+                  BooleanFlagOn(EntryAt(&Buffer->Header, Buffer->Header.FirstEntryOffset)->Flags, NTFS_INDEX_ENTRY_NODE));
+            WalkIndex(Walk, &Buffer->Header, Depth + 1, RecordsSeen);
+            free(Buffer);
+        }
+        else
+        {
+            /* Every leaf sits at the same depth */
+            if (Walk->LeafDepth < 0)
+                Walk->LeafDepth = Depth;
+            CHECK(Walk->LeafDepth == Depth);
+        }
+
+        if (Entry->Flags & NTFS_INDEX_ENTRY_END)
+            return;
+
+        VisitEntry(Walk, Entry);
+        Offset += Entry->Length;
+    }
+}
+
+static void CheckVolume(ULONG Inserted, const UCHAR *Expected, INDEX_WALK *Walk)
+{
+    PINDEX_ROOT_ATTRIBUTE IndexRoot = (PINDEX_ROOT_ATTRIBUTE)Volume.Data[VolumeIndexRoot];
+    ULONG RecordCount = Volume.Length[VolumeIndexAllocation] / INDEX_BUFFER_SIZE;
+    PUCHAR RecordsSeen = calloc(1, RecordCount);
+    ULONG i;
+
+    memset(Walk, 0, sizeof(*Walk));
+    Walk->Visited = calloc(1, ROUND_TRIP_FILES);
+    Walk->LeafDepth = -1;
+
+    CHECK(IndexRoot->Header.Flags == INDEX_ROOT_LARGE);
+    CHECK(FIELD_OFFSET(INDEX_ROOT_ATTRIBUTE, Header) + IndexRoot->Header.AllocatedSize == Volume.Length[VolumeIndexRoot]);
+    WalkIndex(Walk, &IndexRoot->Header, 0, RecordsSeen);
+
+    CHECK(Walk->Count == Inserted);
+    for (i = 0; i < ROUND_TRIP_FILES; i++)
+        CHECK(Walk->Visited[i] == Expected[i]);
+
+    /* Every allocated record is in the tree */
+    CHECK(Walk->Records == RecordCount);
+    for (i = 0; i < RecordCount; i++)
+        CHECK(Volume.Data[VolumeBitmap][i / 8] & (1 << (i % 8)));
+
+    free(Walk->Previous);
+    free(Walk->Visited);
+    free(RecordsSeen);
+}
+
+/* Inserts files in a scrambled order through NtfsInsertIndexEntry(), then reads the whole index back */
+static void TestRoundTrip(ULONG RootEntries)
+{
+    PUCHAR Expected = calloc(1, ROUND_TRIP_FILES);
+    ULONG Inserted = 0, i, Number;
+    PUCHAR Snapshot;
+    INDEX_WALK Walk;
+
+    CreateVolume(RootEntries, Expected);
+    Inserted = RootEntries;
+
+    /* 7919 is prime, so this goes through every number once */
+    for (i = 0; i < ROUND_TRIP_FILES; i++)
+    {
+        NTSTATUS Status;
+
+        Number = (ULONG)(((ULONGLONG)i * 7919) % ROUND_TRIP_FILES);
+        Status = InsertFile(Number);
+        if (Expected[Number])
+        {
+            CHECK(Status == STATUS_OBJECT_NAME_COLLISION);
+            continue;
+        }
+
+        CHECK(Status == STATUS_SUCCESS);
+        if (Status != STATUS_SUCCESS)
+        {
+            printf("Insertion %u of file%05u failed with 0x%lx\n", i, Number, Status);
+            break;
+        }
+        Expected[Number] = 1;
+        Inserted++;
+
+        /* Check the whole index every now and then, and right after the first split */
+        if (i == 40 || (i % 5000) == 4999)
+            CheckVolume(Inserted, Expected, &Walk);
+    }
+
+    CheckVolume(Inserted, Expected, &Walk);
+    CHECK(Inserted == ROUND_TRIP_FILES);
+    /* The top record was split after the first demotion too, the index got at least two levels deeper */
+    CHECK(Walk.LeafDepth >= 3);
+
+    /* A name that's already there, in any case, is refused without touching the index */
+    Snapshot = malloc(Volume.Length[VolumeIndexAllocation]);
+    memcpy(Snapshot, Volume.Data[VolumeIndexAllocation], Volume.Length[VolumeIndexAllocation]);
+    CHECK(InsertFile(1234) == STATUS_OBJECT_NAME_COLLISION);
+    CHECK(!memcmp(Snapshot, Volume.Data[VolumeIndexAllocation], Volume.Length[VolumeIndexAllocation]));
+    free(Snapshot);
+
+    for (i = 0; i < VolumeAttributeCount; i++)
+        free(Volume.Data[i]);
+    free(Expected);
+}
+
+int main(void)
+{
+    TestFindPosition();
+    TestSplit(FALSE);
+    TestSplit(TRUE);
+    TestDemoteRoot();
+    TestRoundTrip(0);
+    TestRoundTrip(3);
+
+    if (Failures)
+    {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+
+    printf("All results are correct\n");
+    return 0;
+}
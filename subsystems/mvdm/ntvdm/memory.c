@@ -42,6 +42,21 @@ static BOOLEAN A20Line = FALSE;
 
 /* PRIVATE FUNCTIONS **********************************************************/
 
+static inline VOID
+MemInvalidateCode(ULONG Address, ULONG Size)
+{
+#ifndef FAST486_NO_CODE_CACHE
+    /* Make the CPU forget the code it may have cached there */
+    Fast486InvalidateCodeRange(&EmulatorContext, Address, Size);
+
+    /* With the A20 line disabled, it may have been fetched from above 1 MB */
+    if (!A20Line) Fast486InvalidateCodeRange(&EmulatorContext, Address | (1 << 20), Size);
+#else
+    UNREFERENCED_PARAMETER(Address);
+    UNREFERENCED_PARAMETER(Size);
+#endif
+}
+
 static inline VOID
 MemFastMoveMemory(OUT VOID UNALIGNED *Destination,
                   IN const VOID UNALIGNED *Source,
@@ -193,6 +208,9 @@ VOID FASTCALL EmulatorWriteMemory(PFAST486_STATE State, ULONG Address, PVOID Buf
     if (Address >= MAX_ADDRESS) return;
     Size = min(Size, MAX_ADDRESS - Address);
 
+    /* The BIOS, DOS and hardware emulation write the guest memory through here too */
+    MemInvalidateCode(Address, Size);
+
     FirstPage = Address >> 12;
     LastPage = (Address + Size - 1) >> 12;
 
@@ -271,6 +289,11 @@ VOID FASTCALL EmulatorCopyMemory(PFAST486_STATE State, ULONG DestAddress, ULONG
 
 VOID EmulatorSetA20(BOOLEAN Enabled)
 {
+#ifndef FAST486_NO_CODE_CACHE
+    /* The code the CPU cached above 1 MB isn't the same anymore */
+    if (A20Line != Enabled) Fast486FlushCodeCache(&EmulatorContext);
+#endif
+
     A20Line = Enabled;
 }
 
@@ -343,6 +366,9 @@ MemInstallFastMemoryHook(PVOID Address,
     /* Add the hook entry to the page table */
     for (i = FirstPage; i <= LastPage; i++) PageTable[i] = Hook;
 
+    /* The memory isn't read the same way anymore */
+    MemInvalidateCode(FirstPage << 12, (LastPage - FirstPage + 1) << 12);
+
     return TRUE;
 }
 
@@ -371,6 +397,9 @@ MemRemoveFastMemoryHook(PVOID Address, ULONG Size)
         PageTable[i] = NULL;
     }
 
+    /* The memory isn't read the same way anymore */
+    MemInvalidateCode(FirstPage << 12, (LastPage - FirstPage + 1) << 12);
+
     return TRUE;
 }
 
@@ -440,7 +469,10 @@ VdmFlushCache(IN USHORT   Segment,
               IN VDM_MODE Mode)
 {
     // FIXME
-    UNIMPLEMENTED;
+    UNREFERENCED_PARAMETER(Mode);
+
+    /* The caller modified the code there */
+    MemInvalidateCode(TO_LINEAR(Segment, Offset), Size);
     return TRUE;
 }
 
@@ -539,6 +571,9 @@ VDDInstallMemoryHook(IN HANDLE hVdd,
     /* Add the hook entry to the page table */
     for (i = FirstPage; i <= LastPage; i++) PageTable[i] = Hook;
 
+    /* The memory isn't read the same way anymore */
+    MemInvalidateCode(FirstPage << 12, (LastPage - FirstPage + 1) << 12);
+
     return TRUE;
 }
 
@@ -595,6 +630,9 @@ VDDDeInstallMemoryHook(IN HANDLE hVdd,
         PageTable[i] = NULL;
     }
 
+    /* The memory isn't read the same way anymore */
+    MemInvalidateCode(FirstPage << 12, (LastPage - FirstPage + 1) << 12);
+
     return TRUE;
 }
 
@@ -81,6 +81,50 @@ DIB_XXBPP_AlphaBlend(SURFOBJ* Dest, SURFOBJ* Source, RECTL* DestRect,
   EXLATEOBJ_vInitialize(&exloDstRGB, pexlo->ppalDst, &gpalRGB, 0, 0, 0);
   EXLATEOBJ_vInitialize(&exloRGBSrc, &gpalRGB, pexlo->ppalSrc, 0, 0, 0);
 
+  /* Without stretching, translate and blend a chunk of each line at a time */
+  if (SourceRect->right - SourceRect->left == DestRect->right - DestRect->left &&
+      SourceRect->bottom - SourceRect->top == DestRect->bottom - DestRect->top)
+  {
+    PFN_DIB_GetPixel pfnSrcGetPixel = DibFunctionsForBitmapFormat[Source->iBitmapFormat].DIB_GetPixel;
+    PFN_DIB_GetPixel pfnDstGetPixel = DibFunctionsForBitmapFormat[Dest->iBitmapFormat].DIB_GetPixel;
+    ULONG SrcColors[DIB_LINE_CHUNK], DstColors[DIB_LINE_CHUNK], DstAlpha[DIB_LINE_CHUNK];
+    INT Col, Chunk, i;
+
+    SrcY = SourceRect->top;
+    for (DstY = DestRect->top; DstY < DestRect->bottom; DstY++, SrcY++)
+    {
+      for (Col = 0; Col < DestRect->right - DestRect->left; Col += Chunk)
+      {
+        Chunk = min(DestRect->right - DestRect->left - Col, DIB_LINE_CHUNK);
+        for (i = 0; i < Chunk; i++)
+        {
+          SrcColors[i] = pfnSrcGetPixel(Source, SourceRect->left + Col + i, SrcY);
+          DstColors[i] = pfnDstGetPixel(Dest, DestRect->left + Col + i, DstY);
+        }
+        XLATEOBJ_cXlateSpan(&exloSrcRGB.xlo, SrcColors, SrcColors, Chunk);
+        XLATEOBJ_cXlateSpan(&exloDstRGB.xlo, DstColors, DstColors, Chunk);
+
+        /* The line kernel blends the alpha byte too, keep the destination one */
+        for (i = 0; i < Chunk; i++)
+          DstAlpha[i] = DstColors[i] & 0xFF000000;
+        DIB_32BPP_BlendLine(DstColors, SrcColors, Chunk, BlendFunc);
+        for (i = 0; i < Chunk; i++)
+          DstColors[i] = (DstColors[i] & 0x00FFFFFF) | DstAlpha[i];
+
+        XLATEOBJ_cXlateSpan(&exloRGBSrc.xlo, DstColors, DstColors, Chunk);
+        XLATEOBJ_cXlateSpan(ColorTranslation, DstColors, DstColors, Chunk);
+        for (i = 0; i < Chunk; i++)
+          pfnDibPutPixel(Dest, DestRect->left + Col + i, DstY, DstColors[i]);
+      }
+    }
+
+    EXLATEOBJ_vCleanup(&exloDstRGB);
+    EXLATEOBJ_vCleanup(&exloRGBSrc);
+    EXLATEOBJ_vCleanup(&exloSrcRGB);
+
+    return TRUE;
+  }
+
   SrcY = SourceRect->top;
   DstY = DestRect->top;
   while ( DstY < DestRect->bottom )
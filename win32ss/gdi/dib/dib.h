@@ -123,6 +123,21 @@ BOOLEAN DIB_32BPP_TransparentBlt(SURFOBJ*,SURFOBJ*,RECTL*,RECTL*,XLATEOBJ*,ULONG
 BOOLEAN DIB_32BPP_ColorFill(SURFOBJ*, RECTL*, ULONG);
 BOOLEAN DIB_32BPP_AlphaBlend(SURFOBJ*, SURFOBJ*, RECTL*, RECTL*, CLIPOBJ*, XLATEOBJ*, BLENDOBJ*);
 
+VOID DIB_32BPP_BlendLineC(PULONG, const ULONG*, ULONG, BLENDFUNCTION);
+VOID DIB_32BPP_TransparentLineC(PULONG, const ULONG*, const ULONG*, ULONG, ULONG);
+#ifdef GDI_SIMD
+VOID DIB_32BPP_BlendLineSimd(PULONG, const ULONG*, ULONG, BLENDFUNCTION);
+VOID DIB_32BPP_TransparentLineSimd(PULONG, const ULONG*, const ULONG*, ULONG, ULONG);
+#define DIB_32BPP_BlendLine DIB_32BPP_BlendLineSimd
+#define DIB_32BPP_TransparentLine DIB_32BPP_TransparentLineSimd
+#else
+#define DIB_32BPP_BlendLine DIB_32BPP_BlendLineC
+#define DIB_32BPP_TransparentLine DIB_32BPP_TransparentLineC
+#endif
+
+/* Pixels processed at once through a stack buffer by the scanline paths */
+#define DIB_LINE_CHUNK 64
+
 BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ*,SURFOBJ*,SURFOBJ*,SURFOBJ*,RECTL*,RECTL*,POINTL*,BRUSHOBJ*,POINTL*,XLATEOBJ*,ROP4);
 BOOLEAN DIB_XXBPP_FloodFillSolid(SURFOBJ*, BRUSHOBJ*, RECTL*, POINTL*, ULONG, UINT);
 BOOLEAN DIB_XXBPP_AlphaBlend(SURFOBJ*, SURFOBJ*, RECTL*, RECTL*, CLIPOBJ*, XLATEOBJ*, BLENDOBJ*);
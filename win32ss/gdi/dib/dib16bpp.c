@@ -136,6 +136,40 @@ DIB_16BPP_VLine(SURFOBJ *SurfObj, LONG x, LONG y1, LONG y2, ULONG c)
 #endif
 }
 
+static
+VOID
+DIB_16BPP_XlateLineFrom16(XLATEOBJ *pxlo, PWORD Dest, PWORD Source, LONG cx)
+{
+  ULONG aulColors[DIB_LINE_CHUNK];
+  LONG i, n;
+
+  for (; cx > 0; cx -= n, Source += n, Dest += n)
+  {
+    n = min(cx, DIB_LINE_CHUNK);
+    for (i = 0; i < n; i++)
+      aulColors[i] = Source[i];
+    XLATEOBJ_cXlateSpan(pxlo, aulColors, aulColors, n);
+    for (i = 0; i < n; i++)
+      Dest[i] = (WORD)aulColors[i];
+  }
+}
+
+static
+VOID
+DIB_16BPP_XlateLineFrom32(XLATEOBJ *pxlo, PWORD Dest, PDWORD Source, LONG cx)
+{
+  ULONG aulColors[DIB_LINE_CHUNK];
+  LONG i, n;
+
+  for (; cx > 0; cx -= n, Source += n, Dest += n)
+  {
+    n = min(cx, DIB_LINE_CHUNK);
+    XLATEOBJ_cXlateSpan(pxlo, Source, aulColors, n);
+    for (i = 0; i < n; i++)
+      Dest[i] = (WORD)aulColors[i];
+  }
+}
+
 BOOLEAN
 DIB_16BPP_BitBltSrcCopy(PBLTINFO BltInfo)
 {
@@ -283,17 +317,9 @@ DIB_16BPP_BitBltSrcCopy(PBLTINFO BltInfo)
         DestLine = DestBits;
         for (j = BltInfo->DestRect.top; j < BltInfo->DestRect.bottom; j++)
         {
-          SourceBits = SourceLine;
-          DestBits = DestLine;
-          for (i = BltInfo->DestRect.left; i <
-            BltInfo->DestRect.right; i++)
-          {
-            *((WORD *)DestBits) = (WORD)XLATEOBJ_iXlate(
-              BltInfo->XlateSourceToDest,
-              *((WORD *)SourceBits));
-            SourceBits += 2;
-            DestBits += 2;
-          }
+          DIB_16BPP_XlateLineFrom16(BltInfo->XlateSourceToDest,
+            (PWORD)DestLine, (PWORD)SourceLine,
+            BltInfo->DestRect.right - BltInfo->DestRect.left);
           SourceLine += BltInfo->SourceSurface->lDelta;
           DestLine += BltInfo->DestSurface->lDelta;
         }
@@ -315,17 +341,9 @@ DIB_16BPP_BitBltSrcCopy(PBLTINFO BltInfo)
         for (j = BltInfo->DestRect.bottom - 1;
           BltInfo->DestRect.top <= j; j--)
         {
-          SourceBits = SourceLine;
-          DestBits = DestLine;
-          for (i = BltInfo->DestRect.left; i <
-            BltInfo->DestRect.right; i++)
-          {
-            *((WORD *)DestBits) = (WORD)XLATEOBJ_iXlate(
-              BltInfo->XlateSourceToDest,
-              *((WORD *)SourceBits));
-            SourceBits += 2;
-            DestBits += 2;
-          }
+          DIB_16BPP_XlateLineFrom16(BltInfo->XlateSourceToDest,
+            (PWORD)DestLine, (PWORD)SourceLine,
+            BltInfo->DestRect.right - BltInfo->DestRect.left);
           SourceLine -= BltInfo->SourceSurface->lDelta;
           DestLine -= BltInfo->DestSurface->lDelta;
         }
@@ -370,17 +388,9 @@ DIB_16BPP_BitBltSrcCopy(PBLTINFO BltInfo)
 
     for (j = BltInfo->DestRect.top; j < BltInfo->DestRect.bottom; j++)
     {
-      SourceBits = SourceLine;
-      DestBits = DestLine;
-
-      for (i = BltInfo->DestRect.left; i < BltInfo->DestRect.right; i++)
-      {
-        *((WORD *)DestBits) = (WORD)XLATEOBJ_iXlate(
-          BltInfo->XlateSourceToDest,
-          *((PDWORD) SourceBits));
-        SourceBits += 4;
-        DestBits += 2;
-      }
+      DIB_16BPP_XlateLineFrom32(BltInfo->XlateSourceToDest,
+        (PWORD)DestLine, (PDWORD)SourceLine,
+        BltInfo->DestRect.right - BltInfo->DestRect.left);
 
       SourceLine += BltInfo->SourceSurface->lDelta;
       DestLine += BltInfo->DestSurface->lDelta;
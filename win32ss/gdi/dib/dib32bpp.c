@@ -49,9 +49,10 @@ DIB_32BPP_VLine(SURFOBJ *SurfObj, LONG x, LONG y1, LONG y2, ULONG c)
 BOOLEAN
 DIB_32BPP_BitBltSrcCopy(PBLTINFO BltInfo)
 {
-  LONG     i, j, sx, sy, xColor, f1;
+  LONG     i, j, sx, sy, xColor, f1, cx;
   PBYTE    SourceBits, DestBits, SourceLine, DestLine;
   PBYTE    SourceBits_4BPP, SourceLine_4BPP;
+  PWORD    Source16;
   PDWORD   Source32, Dest32;
 
   DestBits = (PBYTE)BltInfo->DestSurface->pvScan0
@@ -114,19 +115,15 @@ DIB_32BPP_BitBltSrcCopy(PBLTINFO BltInfo)
   case BMF_8BPP:
     SourceLine = (PBYTE)BltInfo->SourceSurface->pvScan0 + (BltInfo->SourcePoint.y * BltInfo->SourceSurface->lDelta) + BltInfo->SourcePoint.x;
     DestLine = DestBits;
+    cx = BltInfo->DestRect.right - BltInfo->DestRect.left;
 
     for (j = BltInfo->DestRect.top; j < BltInfo->DestRect.bottom; j++)
     {
-      SourceBits = SourceLine;
-      DestBits = DestLine;
-
-      for (i = BltInfo->DestRect.left; i < BltInfo->DestRect.right; i++)
-      {
-        xColor = *SourceBits;
-        *((PDWORD) DestBits) = (DWORD)XLATEOBJ_iXlate(BltInfo->XlateSourceToDest, xColor);
-        SourceBits += 1;
-        DestBits += 4;
-      }
+      /* Widen the source line into the destination, then translate it there */
+      Dest32 = (PDWORD)DestLine;
+      for (i = 0; i < cx; i++)
+        Dest32[i] = SourceLine[i];
+      XLATEOBJ_cXlateSpan(BltInfo->XlateSourceToDest, Dest32, Dest32, cx);
 
       SourceLine += BltInfo->SourceSurface->lDelta;
       DestLine += BltInfo->DestSurface->lDelta;
@@ -136,19 +133,15 @@ DIB_32BPP_BitBltSrcCopy(PBLTINFO BltInfo)
   case BMF_16BPP:
     SourceLine = (PBYTE)BltInfo->SourceSurface->pvScan0 + (BltInfo->SourcePoint.y * BltInfo->SourceSurface->lDelta) + 2 * BltInfo->SourcePoint.x;
     DestLine = DestBits;
+    cx = BltInfo->DestRect.right - BltInfo->DestRect.left;
 
     for (j = BltInfo->DestRect.top; j < BltInfo->DestRect.bottom; j++)
     {
-      SourceBits = SourceLine;
-      DestBits = DestLine;
-
-      for (i = BltInfo->DestRect.left; i < BltInfo->DestRect.right; i++)
-      {
-        xColor = *((PWORD) SourceBits);
-        *((PDWORD) DestBits) = (DWORD)XLATEOBJ_iXlate(BltInfo->XlateSourceToDest, xColor);
-        SourceBits += 2;
-        DestBits += 4;
-      }
+      Source16 = (PWORD)SourceLine;
+      Dest32 = (PDWORD)DestLine;
+      for (i = 0; i < cx; i++)
+        Dest32[i] = Source16[i];
+      XLATEOBJ_cXlateSpan(BltInfo->XlateSourceToDest, Dest32, Dest32, cx);
 
       SourceLine += BltInfo->SourceSurface->lDelta;
       DestLine += BltInfo->DestSurface->lDelta;
@@ -160,21 +153,21 @@ DIB_32BPP_BitBltSrcCopy(PBLTINFO BltInfo)
       + (BltInfo->SourcePoint.y * BltInfo->SourceSurface->lDelta)
       + 3 * BltInfo->SourcePoint.x;
     DestLine = DestBits;
+    cx = BltInfo->DestRect.right - BltInfo->DestRect.left;
 
     for (j = BltInfo->DestRect.top; j < BltInfo->DestRect.bottom; j++)
     {
       SourceBits = SourceLine;
-      DestBits = DestLine;
+      Dest32 = (PDWORD)DestLine;
 
-      for (i = BltInfo->DestRect.left; i < BltInfo->DestRect.right; i++)
+      for (i = 0; i < cx; i++)
       {
-        xColor = (*(SourceBits + 2) << 0x10) +
+        Dest32[i] = (*(SourceBits + 2) << 0x10) +
           (*(SourceBits + 1) << 0x08) +
           (*(SourceBits));
-        *((PDWORD)DestBits) = (DWORD)XLATEOBJ_iXlate(BltInfo->XlateSourceToDest, xColor);
         SourceBits += 3;
-        DestBits += 4;
       }
+      XLATEOBJ_cXlateSpan(BltInfo->XlateSourceToDest, Dest32, Dest32, cx);
 
       SourceLine += BltInfo->SourceSurface->lDelta;
       DestLine += BltInfo->DestSurface->lDelta;
@@ -211,6 +204,20 @@ DIB_32BPP_BitBltSrcCopy(PBLTINFO BltInfo)
         }
       }
     }
+    else if (BltInfo->SourceSurface != BltInfo->DestSurface)
+    {
+      /* No overlap, translate whole lines */
+      SourceLine = (PBYTE)BltInfo->SourceSurface->pvScan0 + (BltInfo->SourcePoint.y * BltInfo->SourceSurface->lDelta) + 4 * BltInfo->SourcePoint.x;
+      DestLine = DestBits;
+      cx = BltInfo->DestRect.right - BltInfo->DestRect.left;
+
+      for (j = BltInfo->DestRect.top; j < BltInfo->DestRect.bottom; j++)
+      {
+        XLATEOBJ_cXlateSpan(BltInfo->XlateSourceToDest, (PDWORD)SourceLine, (PDWORD)DestLine, cx);
+        SourceLine += BltInfo->SourceSurface->lDelta;
+        DestLine += BltInfo->DestSurface->lDelta;
+      }
+    }
     else
     {
       if (BltInfo->DestRect.top < BltInfo->SourcePoint.y)
@@ -284,8 +291,9 @@ DIB_32BPP_TransparentBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf,
                          RECTL*  DestRect,  RECTL *SourceRect,
                          XLATEOBJ *ColorTranslation, ULONG iTransColor)
 {
-  LONG X, Y, SourceX, SourceY = 0, wd;
-  ULONG *DestBits, Source = 0;
+  LONG X, Y, SourceX, SourceY = 0, wd, Chunk;
+  ULONG *DestBits, *SrcLine, Source = 0;
+  ULONG SrcColors[DIB_LINE_CHUNK];
 
   LONG DstHeight;
   LONG DstWidth;
@@ -302,6 +310,40 @@ DIB_32BPP_TransparentBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf,
     DestRect->top * DestSurf->lDelta);
   wd = DestSurf->lDelta - ((DestRect->right - DestRect->left) << 2);
 
+  /* Unstretched 32bpp sources inside the bitmap are copied a whole line at a time */
+  if (SourceSurf->iBitmapFormat == BMF_32BPP && SourceSurf != DestSurf &&
+      SrcWidth == DstWidth && SrcHeight == DstHeight &&
+      SourceRect->left >= 0 && SourceRect->top >= 0 &&
+      SourceRect->right <= SourceSurf->sizlBitmap.cx &&
+      SourceRect->bottom <= SourceSurf->sizlBitmap.cy)
+  {
+    SrcLine = (ULONG*)((PBYTE)SourceSurf->pvScan0 +
+      (SourceRect->left << 2) +
+      SourceRect->top * SourceSurf->lDelta);
+
+    for (Y = DestRect->top; Y < DestRect->bottom; Y++)
+    {
+      if (!ColorTranslation || (ColorTranslation->flXlate & XO_TRIVIAL))
+      {
+        DIB_32BPP_TransparentLine(DestBits, SrcLine, SrcLine, DstWidth, iTransColor);
+      }
+      else
+      {
+        /* The transparent color is compared before translation */
+        for (X = 0; X < DstWidth; X += Chunk)
+        {
+          Chunk = min(DstWidth - X, DIB_LINE_CHUNK);
+          XLATEOBJ_cXlateSpan(ColorTranslation, SrcLine + X, SrcColors, Chunk);
+          DIB_32BPP_TransparentLine(DestBits + X, SrcLine + X, SrcColors, Chunk, iTransColor);
+        }
+      }
+      DestBits = (ULONG*)((PBYTE)DestBits + DestSurf->lDelta);
+      SrcLine = (ULONG*)((PBYTE)SrcLine + SourceSurf->lDelta);
+    }
+
+    return TRUE;
+  }
+
   for (Y = DestRect->top; Y < DestRect->bottom; Y++)
   {
     SourceY = SourceRect->top+(Y - DestRect->top) * SrcHeight / DstHeight;
@@ -346,8 +388,10 @@ DIB_32BPP_AlphaBlend(SURFOBJ* Dest, SURFOBJ* Source, RECTL* DestRect,
                      RECTL* SourceRect, CLIPOBJ* ClipRegion,
                      XLATEOBJ* ColorTranslation, BLENDOBJ* BlendObj)
 {
-  INT Rows, Cols, SrcX, SrcY;
+  INT Rows, Cols, SrcX, SrcY, cx, Chunk;
   register PULONG Dst;
+  PULONG SrcLine;
+  ULONG SrcColors[DIB_LINE_CHUNK];
   BLENDFUNCTION BlendFunc;
   register NICEPIXEL32 DstPixel, SrcPixel;
   UCHAR Alpha, SrcBpp;
@@ -383,6 +427,37 @@ DIB_32BPP_AlphaBlend(SURFOBJ* Dest, SURFOBJ* Source, RECTL* DestRect,
     (DestRect->left << 2));
   SrcBpp = BitsPerFormat(Source->iBitmapFormat);
 
+  /* Unstretched 32bpp sources are blended a whole line at a time */
+  if (SrcBpp == 32 && Source != Dest &&
+      SourceRect->right - SourceRect->left == DestRect->right - DestRect->left &&
+      SourceRect->bottom - SourceRect->top == DestRect->bottom - DestRect->top)
+  {
+    cx = DestRect->right - DestRect->left;
+    SrcLine = (PULONG)((ULONG_PTR)Source->pvScan0 + (SourceRect->top * Source->lDelta) +
+      (SourceRect->left << 2));
+
+    for (Rows = DestRect->top; Rows < DestRect->bottom; Rows++)
+    {
+      if (!ColorTranslation || (ColorTranslation->flXlate & XO_TRIVIAL))
+      {
+        DIB_32BPP_BlendLine(Dst, SrcLine, cx, BlendFunc);
+      }
+      else
+      {
+        for (Cols = 0; Cols < cx; Cols += Chunk)
+        {
+          Chunk = min(cx - Cols, DIB_LINE_CHUNK);
+          XLATEOBJ_cXlateSpan(ColorTranslation, SrcLine + Cols, SrcColors, Chunk);
+          DIB_32BPP_BlendLine(Dst + Cols, SrcColors, Chunk, BlendFunc);
+        }
+      }
+      Dst = (PULONG)((ULONG_PTR)Dst + Dest->lDelta);
+      SrcLine = (PULONG)((ULONG_PTR)SrcLine + Source->lDelta);
+    }
+
+    return TRUE;
+  }
+
   Rows = 0;
    SrcY = SourceRect->top;
    while (++Rows <= DestRect->bottom - DestRect->top)
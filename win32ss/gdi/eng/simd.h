@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+ * Vector types for the SIMD paths of the XLATEOBJ and DIB code.
+ *
+ * The crt intrinsics headers don't provide the SSE2 integer intrinsics,
+ * so these paths are written with the GCC vector extensions instead.
+ * They are only enabled on amd64, where SSE2 is always present and the
+ * XMM registers may be used by kernel mode code. x86 keeps the C paths,
+ * KeSaveFloatingPointState doesn't preserve the XMM registers there.
+ */
+#if defined(_M_AMD64) && defined(__GNUC__)
+
+#define GDI_SIMD
+
+/* 4 pixels of 32 bits */
+typedef ULONG GDI_V4UL __attribute__((__vector_size__(16), __may_alias__));
+typedef LONG GDI_V4L __attribute__((__vector_size__(16), __may_alias__));
+
+/* 8 channels of 16 bits */
+typedef USHORT GDI_V8US __attribute__((__vector_size__(16), __may_alias__));
+
+/* For loads and stores at ULONG alignment */
+typedef ULONG GDI_V4UL_UNALIGNED __attribute__((__vector_size__(16), __may_alias__, __aligned__(4)));
+
+#define GDI_V4UL_LOAD(p) (*(const GDI_V4UL_UNALIGNED*)(p))
+#define GDI_V4UL_STORE(p, v) (*(GDI_V4UL_UNALIGNED*)(p) = (v))
+
+#endif /* _M_AMD64 && __GNUC__ */
+
+/* EOF */
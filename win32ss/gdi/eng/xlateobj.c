@@ -19,9 +19,20 @@ EXLATEOBJ_iXlateTrivial(
     _In_ PEXLATEOBJ pexlo,
     _In_ ULONG iColor);
 
+_Function_class_(FN_XLATE_SPAN)
+VOID
+FASTCALL
+EXLATEOBJ_vXlateSpanTrivial(
+    _In_ PEXLATEOBJ pexlo,
+    _In_reads_(cColors) const ULONG *pulSrc,
+    _Out_writes_(cColors) ULONG *pulDst,
+    _In_ ULONG cColors);
+
 /** Globals *******************************************************************/
 
-EXLATEOBJ gexloTrivial = {{0, XO_TRIVIAL, 0, 0, 0, 0}, EXLATEOBJ_iXlateTrivial};
+EXLATEOBJ gexloTrivial = {{0, XO_TRIVIAL, 0, 0, 0, 0},
+                          EXLATEOBJ_iXlateTrivial,
+                          EXLATEOBJ_vXlateSpanTrivial};
 
 static ULONG giUniqueXlate = 0;
 
@@ -351,6 +362,290 @@ EXLATEOBJ_iXlateBitfieldsToPal(PEXLATEOBJ pexlo, ULONG iColor)
 }
 
 
+/** Span functions ************************************************************/
+
+/*
+ * Each span function translates a whole scanline with the matching iXlate
+ * function inlined into the loop, instead of one indirect call per pixel.
+ * They work front to back one pixel (or vector) at a time, so translating
+ * in place is fine.
+ */
+
+#define XLATE_SPAN_C(name) \
+_Function_class_(FN_XLATE_SPAN) \
+static \
+VOID \
+FASTCALL \
+EXLATEOBJ_vXlateSpan##name( \
+    _In_ PEXLATEOBJ pexlo, \
+    _In_reads_(cColors) const ULONG *pulSrc, \
+    _Out_writes_(cColors) ULONG *pulDst, \
+    _In_ ULONG cColors) \
+{ \
+    while (cColors--) \
+        *pulDst++ = EXLATEOBJ_iXlate##name(pexlo, *pulSrc++); \
+}
+
+#ifdef GDI_SIMD
+
+/*
+ * Vector versions of the RGB/BGR/555/565 conversions, 4 pixels at a time,
+ * giving exactly the same results as the scalar functions.
+ */
+
+#define XLATE_SPAN_SIMD(name) \
+_Function_class_(FN_XLATE_SPAN) \
+static \
+VOID \
+FASTCALL \
+EXLATEOBJ_vXlateSpan##name( \
+    _In_ PEXLATEOBJ pexlo, \
+    _In_reads_(cColors) const ULONG *pulSrc, \
+    _Out_writes_(cColors) ULONG *pulDst, \
+    _In_ ULONG cColors) \
+{ \
+    for (; cColors >= 4; cColors -= 4, pulSrc += 4, pulDst += 4) \
+        GDI_V4UL_STORE(pulDst, EXLATEOBJ_vecXlate##name(pexlo, GDI_V4UL_LOAD(pulSrc))); \
+    while (cColors--) \
+        *pulDst++ = EXLATEOBJ_iXlate##name(pexlo, *pulSrc++); \
+}
+
+/*
+ * Expand 5 and 6 bit channels like gajXlate5to8 and gajXlate6to8 do.
+ * (i * 527 + 23) >> 6 and (i * 259 + 33) >> 6 match the tables except
+ * for 3 entries, which are fixed up with a compare (true is -1). The
+ * products fit in the low word of each dword, so a 16 bit multiply is
+ * enough.
+ */
+static const GDI_V8US gvecMul5to8 = {527, 0, 527, 0, 527, 0, 527, 0};
+static const GDI_V8US gvecMul6to8 = {259, 0, 259, 0, 259, 0, 259, 0};
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecExpand5to8(GDI_V4UL x)
+{
+    GDI_V4UL y;
+
+    y = (GDI_V4UL)((GDI_V8US)x * gvecMul5to8);
+    y = (y + 23) >> 6;
+    return y - (GDI_V4UL)(x == 28);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecExpand6to8(GDI_V4UL x)
+{
+    GDI_V4UL y;
+
+    y = (GDI_V4UL)((GDI_V8US)x * gvecMul6to8);
+    y = (y + 33) >> 6;
+    return y - (GDI_V4UL)(x == 51) + (GDI_V4UL)(x == 13);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlateRGBtoBGR(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    GDI_V4UL y = x & 0x00ff00ff;
+
+    return (x & 0xff00ff00) | (y >> 16) | (y << 16);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlateRGBto555(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return ((x << 7) & 0x7C00) | ((x >> 6) & 0x3E0) | ((x >> 19) & 0x1F);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlateBGRto555(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return ((x >> 3) & 0x1F) | ((x >> 6) & 0x3E0) | ((x >> 9) & 0x7C00);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlateRGBto565(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return ((x << 8) & 0xF800) | ((x >> 5) & 0x7E0) | ((x >> 19) & 0x1F);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlateBGRto565(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return ((x >> 3) & 0x1F) | ((x >> 5) & 0x7E0) | ((x >> 8) & 0xF800);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlate555to565(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return (x & 0x1F) | ((x << 1) & 0xFFC0) | ((x >> 4) & 0x20);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlate565to555(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return (x & 0x1F) | ((x >> 1) & 0x7FE0);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlate555toRGB(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return (EXLATEOBJ_vecExpand5to8(x & 0x1F) << 16) |
+           (EXLATEOBJ_vecExpand5to8((x >> 5) & 0x1F) << 8) |
+           EXLATEOBJ_vecExpand5to8((x >> 10) & 0x1F);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlate555toBGR(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return EXLATEOBJ_vecExpand5to8(x & 0x1F) |
+           (EXLATEOBJ_vecExpand5to8((x >> 5) & 0x1F) << 8) |
+           (EXLATEOBJ_vecExpand5to8((x >> 10) & 0x1F) << 16);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlate565toRGB(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return (EXLATEOBJ_vecExpand5to8(x & 0x1F) << 16) |
+           (EXLATEOBJ_vecExpand6to8((x >> 5) & 0x3F) << 8) |
+           EXLATEOBJ_vecExpand5to8((x >> 11) & 0x1F);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlate565toBGR(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return EXLATEOBJ_vecExpand5to8(x & 0x1F) |
+           (EXLATEOBJ_vecExpand6to8((x >> 5) & 0x3F) << 8) |
+           (EXLATEOBJ_vecExpand5to8((x >> 11) & 0x1F) << 16);
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecRotl(GDI_V4UL x, ULONG ulShift)
+{
+    return (x << (ulShift & 31)) | (x >> ((32 - ulShift) & 31));
+}
+
+static __inline
+GDI_V4UL
+EXLATEOBJ_vecXlateShiftAndMask(PEXLATEOBJ pexlo, GDI_V4UL x)
+{
+    return (EXLATEOBJ_vecRotl(x, pexlo->ulRedShift) & pexlo->ulRedMask) |
+           (EXLATEOBJ_vecRotl(x, pexlo->ulGreenShift) & pexlo->ulGreenMask) |
+           (EXLATEOBJ_vecRotl(x, pexlo->ulBlueShift) & pexlo->ulBlueMask);
+}
+
+XLATE_SPAN_SIMD(RGBtoBGR)
+XLATE_SPAN_SIMD(RGBto555)
+XLATE_SPAN_SIMD(BGRto555)
+XLATE_SPAN_SIMD(RGBto565)
+XLATE_SPAN_SIMD(BGRto565)
+XLATE_SPAN_SIMD(555toRGB)
+XLATE_SPAN_SIMD(555toBGR)
+XLATE_SPAN_SIMD(555to565)
+XLATE_SPAN_SIMD(565to555)
+XLATE_SPAN_SIMD(565toRGB)
+XLATE_SPAN_SIMD(565toBGR)
+XLATE_SPAN_SIMD(ShiftAndMask)
+
+#else
+
+XLATE_SPAN_C(RGBtoBGR)
+XLATE_SPAN_C(RGBto555)
+XLATE_SPAN_C(BGRto555)
+XLATE_SPAN_C(RGBto565)
+XLATE_SPAN_C(BGRto565)
+XLATE_SPAN_C(555toRGB)
+XLATE_SPAN_C(555toBGR)
+XLATE_SPAN_C(555to565)
+XLATE_SPAN_C(565to555)
+XLATE_SPAN_C(565toRGB)
+XLATE_SPAN_C(565toBGR)
+XLATE_SPAN_C(ShiftAndMask)
+
+#endif /* GDI_SIMD */
+
+XLATE_SPAN_C(Table)
+XLATE_SPAN_C(ToMono)
+
+_Function_class_(FN_XLATE_SPAN)
+VOID
+FASTCALL
+EXLATEOBJ_vXlateSpanTrivial(
+    _In_ PEXLATEOBJ pexlo,
+    _In_reads_(cColors) const ULONG *pulSrc,
+    _Out_writes_(cColors) ULONG *pulDst,
+    _In_ ULONG cColors)
+{
+    if (pulDst != pulSrc)
+        RtlMoveMemory(pulDst, pulSrc, cColors * sizeof(ULONG));
+}
+
+/* Used for the palette lookups, these are too slow to gain anything */
+_Function_class_(FN_XLATE_SPAN)
+static
+VOID
+FASTCALL
+EXLATEOBJ_vXlateSpanGeneric(
+    _In_ PEXLATEOBJ pexlo,
+    _In_reads_(cColors) const ULONG *pulSrc,
+    _Out_writes_(cColors) ULONG *pulDst,
+    _In_ ULONG cColors)
+{
+    while (cColors--)
+        *pulDst++ = pexlo->pfnXlate(pexlo, *pulSrc++);
+}
+
+static const struct
+{
+    PFN_XLATE pfnXlate;
+    PFN_XLATE_SPAN pfnXlateSpan;
+} gaXlateSpans[] =
+{
+    {EXLATEOBJ_iXlateTrivial, EXLATEOBJ_vXlateSpanTrivial},
+    {EXLATEOBJ_iXlateToMono, EXLATEOBJ_vXlateSpanToMono},
+    {EXLATEOBJ_iXlateTable, EXLATEOBJ_vXlateSpanTable},
+    {EXLATEOBJ_iXlateRGBtoBGR, EXLATEOBJ_vXlateSpanRGBtoBGR},
+    {EXLATEOBJ_iXlateRGBto555, EXLATEOBJ_vXlateSpanRGBto555},
+    {EXLATEOBJ_iXlateBGRto555, EXLATEOBJ_vXlateSpanBGRto555},
+    {EXLATEOBJ_iXlateRGBto565, EXLATEOBJ_vXlateSpanRGBto565},
+    {EXLATEOBJ_iXlateBGRto565, EXLATEOBJ_vXlateSpanBGRto565},
+    {EXLATEOBJ_iXlate555toRGB, EXLATEOBJ_vXlateSpan555toRGB},
+    {EXLATEOBJ_iXlate555toBGR, EXLATEOBJ_vXlateSpan555toBGR},
+    {EXLATEOBJ_iXlate555to565, EXLATEOBJ_vXlateSpan555to565},
+    {EXLATEOBJ_iXlate565to555, EXLATEOBJ_vXlateSpan565to555},
+    {EXLATEOBJ_iXlate565toRGB, EXLATEOBJ_vXlateSpan565toRGB},
+    {EXLATEOBJ_iXlate565toBGR, EXLATEOBJ_vXlateSpan565toBGR},
+    {EXLATEOBJ_iXlateShiftAndMask, EXLATEOBJ_vXlateSpanShiftAndMask},
+};
+
+static
+PFN_XLATE_SPAN
+EXLATEOBJ_pfnGetXlateSpan(
+    _In_ PFN_XLATE pfnXlate)
+{
+    ULONG i;
+
+    for (i = 0; i < RTL_NUMBER_OF(gaXlateSpans); i++)
+    {
+        if (gaXlateSpans[i].pfnXlate == pfnXlate)
+            return gaXlateSpans[i].pfnXlateSpan;
+    }
+
+    return EXLATEOBJ_vXlateSpanGeneric;
+}
+
+
 /** Private Functions *********************************************************/
 
 VOID
@@ -374,6 +669,7 @@ EXLATEOBJ_vInitialize(
     pexlo->xlo.flXlate = 0;
     pexlo->xlo.pulXlate = pexlo->aulXlate;
     pexlo->pfnXlate = EXLATEOBJ_iXlateTrivial;
+    pexlo->pfnXlateSpan = EXLATEOBJ_vXlateSpanTrivial;
     pexlo->hColorTransform = NULL;
     pexlo->ppalSrc = ppalSrc;
     pexlo->ppalDst = ppalDst;
@@ -604,6 +900,8 @@ EXLATEOBJ_vInitialize(
         pexlo->xlo.flXlate = XO_TRIVIAL;
     else
         pexlo->xlo.flXlate &= ~XO_TRIVIAL;
+
+    pexlo->pfnXlateSpan = EXLATEOBJ_pfnGetXlateSpan(pexlo->pfnXlate);
 }
 
 VOID
@@ -674,6 +972,27 @@ XLATEOBJ_iXlate(
     return pexlo->pfnXlate(pexlo, iColor);
 }
 
+ULONG
+NTAPI
+XLATEOBJ_cXlateSpan(
+    _In_opt_ XLATEOBJ *pxlo,
+    _In_reads_(cColors) const ULONG *pulSrc,
+    _Out_writes_(cColors) ULONG *pulDst,
+    _In_ ULONG cColors)
+{
+    PEXLATEOBJ pexlo = (PEXLATEOBJ)pxlo;
+
+    if (!pxlo || (pxlo->flXlate & XO_TRIVIAL))
+    {
+        EXLATEOBJ_vXlateSpanTrivial(NULL, pulSrc, pulDst, cColors);
+        return cColors;
+    }
+
+    /* Call the span function */
+    pexlo->pfnXlateSpan(pexlo, pulSrc, pulDst, cColors);
+    return cColors;
+}
+
 ULONG
 NTAPI
 XLATEOBJ_cGetPalette(
@@ -16,11 +16,21 @@ ULONG
     _In_ struct _EXLATEOBJ *pexlo,
     _In_ ULONG iColor);
 
+_Function_class_(FN_XLATE_SPAN)
+typedef
+VOID
+(FASTCALL *PFN_XLATE_SPAN)(
+    _In_ struct _EXLATEOBJ *pexlo,
+    _In_reads_(cColors) const ULONG *pulSrc,
+    _Out_writes_(cColors) ULONG *pulDst,
+    _In_ ULONG cColors);
+
 typedef struct _EXLATEOBJ
 {
     XLATEOBJ xlo;
 
     PFN_XLATE pfnXlate;
+    PFN_XLATE_SPAN pfnXlateSpan;
 
     PPALETTE ppalSrc;
     PPALETTE ppalDst;
@@ -54,6 +64,15 @@ XLATEOBJ_pfnXlate(
     return ((PEXLATEOBJ)pxlo)->pfnXlate;
 }
 
+/* Translates cColors colors at once, pulSrc and pulDst may be the same buffer */
+ULONG
+NTAPI
+XLATEOBJ_cXlateSpan(
+    _In_opt_ XLATEOBJ *pxlo,
+    _In_reads_(cColors) const ULONG *pulSrc,
+    _Out_writes_(cColors) ULONG *pulDst,
+    _In_ ULONG cColors);
+
 VOID
 NTAPI
 EXLATEOBJ_vInitialize(
@@ -25,7 +25,12 @@ typedef struct _FONT_ENTRY_COLL_MEM
 
 typedef struct _FONT_CACHE_ENTRY
 {
-    LIST_ENTRY ListEntry;
+    LIST_ENTRY ListEntry;       /* Global LRU list */
+    LIST_ENTRY HashEntry;       /* Hash bucket */
+    LIST_ENTRY FaceEntry;       /* LRU list of the face */
+    ULONG Hash;
+    SIZE_T Size;
+    PSHARED_FACE SharedFace;
     int GlyphIndex;
     FT_Face Face;
     FT_BitmapGlyph BitmapGlyph;
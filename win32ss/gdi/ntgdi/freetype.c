@@ -88,10 +88,22 @@ static BOOL             g_RenderingEnabled = TRUE;
 #define ASSERT_FREETYPE_LOCK_NOT_HELD() \
     ASSERT(g_FreeTypeLock->Owner != KeGetCurrentThread())
 
-#define MAX_FONT_CACHE 256
+/*
+ * The glyph cache is budgeted in bytes, and a single face can't take more
+ * than its own share so that a page of large CJK text doesn't push out the
+ * glyphs of every other font.
+ */
+#define MAX_FONT_CACHE_SIZE     (2 * 1024 * 1024)
+#define MAX_FACE_CACHE_SIZE     (512 * 1024)
+#define FONT_CACHE_HASH_SIZE    1024
 
 static LIST_ENTRY g_FontCacheListHead;
+static LIST_ENTRY g_FontCacheHashTable[FONT_CACHE_HASH_SIZE];
 static UINT g_FontCacheNumEntries;
+static SIZE_T g_FontCacheSize;
+static ULONG g_FontCacheHits;
+static ULONG g_FontCacheMisses;
+static ULONG g_FontCacheEvictions;
 
 static PWCHAR g_ElfScripts[32] =   /* These are in the order of the fsCsb[0] bits */
 {
@@ -222,6 +234,11 @@ SharedFace_Create(FT_Face Face, PSHARED_MEM Memory)
         Ptr->Memory = Memory;
         SharedFaceCache_Init(&Ptr->EnglishUS);
         SharedFaceCache_Init(&Ptr->UserLanguage);
+        InitializeListHead(&Ptr->GlyphCacheListHead);
+        Ptr->GlyphCacheSize = 0;
+
+        /* So that the glyph cache can find its way back from the face */
+        Face->generic.data = Ptr;
 
         SharedMem_AddRef(Memory);
         DPRINT("Creating SharedFace for %s\n", Face->family_name ? Face->family_name : "<NULL>");
@@ -260,31 +277,31 @@ RemoveCachedEntry(PFONT_CACHE_ENTRY Entry)
 
     FT_Done_Glyph((FT_Glyph)Entry->BitmapGlyph);
     RemoveEntryList(&Entry->ListEntry);
-    ExFreePoolWithTag(Entry, TAG_FONT);
+    RemoveEntryList(&Entry->HashEntry);
+    RemoveEntryList(&Entry->FaceEntry);
+    ASSERT(Entry->SharedFace->GlyphCacheSize >= Entry->Size);
+    Entry->SharedFace->GlyphCacheSize -= Entry->Size;
+    ASSERT(g_FontCacheSize >= Entry->Size);
+    g_FontCacheSize -= Entry->Size;
     g_FontCacheNumEntries--;
-    ASSERT(g_FontCacheNumEntries <= MAX_FONT_CACHE);
+    ExFreePoolWithTag(Entry, TAG_FONT);
 }
 
 static void
-RemoveCacheEntries(FT_Face Face)
+RemoveCacheEntries(PSHARED_FACE SharedFace)
 {
-    PLIST_ENTRY CurrentEntry, NextEntry;
     PFONT_CACHE_ENTRY FontEntry;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
-    for (CurrentEntry = g_FontCacheListHead.Flink;
-         CurrentEntry != &g_FontCacheListHead;
-         CurrentEntry = NextEntry)
+    while (!IsListEmpty(&SharedFace->GlyphCacheListHead))
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
-        NextEntry = CurrentEntry->Flink;
-
-        if (FontEntry->Face == Face)
-        {
-            RemoveCachedEntry(FontEntry);
-        }
+        FontEntry = CONTAINING_RECORD(SharedFace->GlyphCacheListHead.Flink,
+                                      FONT_CACHE_ENTRY, FaceEntry);
+        RemoveCachedEntry(FontEntry);
     }
+
+    ASSERT(SharedFace->GlyphCacheSize == 0);
 }
 
 static void SharedMem_Release(PSHARED_MEM Ptr)
@@ -327,7 +344,7 @@ SharedFace_Release(PSHARED_FACE Ptr)
     if (Ptr->RefCount == 0)
     {
         DPRINT("Releasing SharedFace for %s\n", Ptr->Face->family_name ? Ptr->Face->family_name : "<NULL>");
-        RemoveCacheEntries(Ptr->Face);
+        RemoveCacheEntries(Ptr);
         FT_Done_Face(Ptr->Face);
         SharedMem_Release(Ptr->Memory);
         SharedFaceCache_Release(&Ptr->EnglishUS);
@@ -660,10 +677,16 @@ BOOL FASTCALL
 InitFontSupport(VOID)
 {
     ULONG ulError;
+    UINT i;
 
     InitializeListHead(&g_FontListHead);
     InitializeListHead(&g_FontCacheListHead);
+    for (i = 0; i < FONT_CACHE_HASH_SIZE; i++)
+    {
+        InitializeListHead(&g_FontCacheHashTable[i]);
+    }
     g_FontCacheNumEntries = 0;
+    g_FontCacheSize = 0;
     /* Fast Mutexes must be allocated from non paged pool */
     g_FontListLock = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
     if (g_FontListLock == NULL)
@@ -3130,6 +3153,26 @@ SameScaleMatrix(
             FLOATOBJ_Equal(&pmx1->efM22, &pmx2->efM22));
 }
 
+/*
+ * The transformation is left out of the hash: FLOATOBJs which compare equal
+ * don't necessarily have the same bits. It is still part of the key.
+ */
+static ULONG
+GlyphCacheHash(
+    FT_Face Face,
+    INT GlyphIndex,
+    INT Height,
+    FT_Render_Mode RenderMode)
+{
+    ULONG Hash;
+
+    Hash = (ULONG)((ULONG_PTR)Face >> 4);
+    Hash ^= (ULONG)GlyphIndex * 0x9E3779B1;
+    Hash ^= (ULONG)Height * 0x85EBCA6B;
+    Hash ^= (ULONG)RenderMode << 27;
+    return Hash ^ (Hash >> 15);
+}
+
 FT_BitmapGlyph APIENTRY
 ftGdiGlyphCacheGet(
     FT_Face Face,
@@ -3138,17 +3181,22 @@ ftGdiGlyphCacheGet(
     FT_Render_Mode RenderMode,
     PMATRIX pmx)
 {
-    PLIST_ENTRY CurrentEntry;
+    PLIST_ENTRY CurrentEntry, Bucket;
     PFONT_CACHE_ENTRY FontEntry;
+    ULONG Hash;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
-    for (CurrentEntry = g_FontCacheListHead.Flink;
-         CurrentEntry != &g_FontCacheListHead;
+    Hash = GlyphCacheHash(Face, GlyphIndex, Height, RenderMode);
+    Bucket = &g_FontCacheHashTable[Hash & (FONT_CACHE_HASH_SIZE - 1)];
+
+    for (CurrentEntry = Bucket->Flink;
+         CurrentEntry != Bucket;
          CurrentEntry = CurrentEntry->Flink)
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
-        if ((FontEntry->Face == Face) &&
+        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, HashEntry);
+        if ((FontEntry->Hash == Hash) &&
+            (FontEntry->Face == Face) &&
             (FontEntry->GlyphIndex == GlyphIndex) &&
             (FontEntry->Height == Height) &&
             (FontEntry->RenderMode == RenderMode) &&
@@ -3156,13 +3204,19 @@ ftGdiGlyphCacheGet(
             break;
     }
 
-    if (CurrentEntry == &g_FontCacheListHead)
+    if (CurrentEntry == Bucket)
     {
+        g_FontCacheMisses++;
         return NULL;
     }
 
-    RemoveEntryList(CurrentEntry);
-    InsertHeadList(&g_FontCacheListHead, CurrentEntry);
+    g_FontCacheHits++;
+
+    /* Most recently used, both globally and for its face */
+    RemoveEntryList(&FontEntry->ListEntry);
+    InsertHeadList(&g_FontCacheListHead, &FontEntry->ListEntry);
+    RemoveEntryList(&FontEntry->FaceEntry);
+    InsertHeadList(&FontEntry->SharedFace->GlyphCacheListHead, &FontEntry->FaceEntry);
     return FontEntry->BitmapGlyph;
 }
 
@@ -3219,11 +3273,13 @@ ftGdiGlyphCacheSet(
 {
     FT_Glyph GlyphCopy;
     INT error;
-    PFONT_CACHE_ENTRY NewEntry;
+    PFONT_CACHE_ENTRY NewEntry, OldEntry;
     FT_Bitmap AlignedBitmap;
     FT_BitmapGlyph BitmapGlyph;
+    PSHARED_FACE SharedFace = Face->generic.data;
 
     ASSERT_FREETYPE_LOCK_HELD();
+    ASSERT(SharedFace != NULL && SharedFace->Face == Face);
 
     error = FT_Get_Glyph(GlyphSlot, &GlyphCopy);
     if (error)
@@ -3268,17 +3324,51 @@ ftGdiGlyphCacheSet(
     NewEntry->Height = Height;
     NewEntry->RenderMode = RenderMode;
     NewEntry->mxWorldToDevice = *pmx;
+    NewEntry->SharedFace = SharedFace;
+    NewEntry->Hash = GlyphCacheHash(Face, GlyphIndex, Height, RenderMode);
+    NewEntry->Size = sizeof(FONT_CACHE_ENTRY) + sizeof(FT_BitmapGlyphRec) +
+                     (SIZE_T)abs(BitmapGlyph->bitmap.pitch) * BitmapGlyph->bitmap.rows;
 
     InsertHeadList(&g_FontCacheListHead, &NewEntry->ListEntry);
-    if (++g_FontCacheNumEntries > MAX_FONT_CACHE)
+    InsertHeadList(&g_FontCacheHashTable[NewEntry->Hash & (FONT_CACHE_HASH_SIZE - 1)],
+                   &NewEntry->HashEntry);
+    InsertHeadList(&SharedFace->GlyphCacheListHead, &NewEntry->FaceEntry);
+    SharedFace->GlyphCacheSize += NewEntry->Size;
+    g_FontCacheSize += NewEntry->Size;
+    g_FontCacheNumEntries++;
+
+    /* Trim the face first, then the whole cache, but never the new glyph */
+    while (SharedFace->GlyphCacheSize > MAX_FACE_CACHE_SIZE)
+    {
+        OldEntry = CONTAINING_RECORD(SharedFace->GlyphCacheListHead.Blink, FONT_CACHE_ENTRY, FaceEntry);
+        if (OldEntry == NewEntry)
+            break;
+        RemoveCachedEntry(OldEntry);
+        g_FontCacheEvictions++;
+    }
+
+    while (g_FontCacheSize > MAX_FONT_CACHE_SIZE)
     {
-        NewEntry = CONTAINING_RECORD(g_FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
-        RemoveCachedEntry(NewEntry);
+        OldEntry = CONTAINING_RECORD(g_FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
+        if (OldEntry == NewEntry)
+            break;
+        RemoveCachedEntry(OldEntry);
+        g_FontCacheEvictions++;
     }
 
     return BitmapGlyph;
 }
 
+VOID FASTCALL
+IntDumpGlyphCacheStats(VOID)
+{
+    /* Called from the debugger, the lock can't be taken */
+    DbgPrint("Glyph cache: %u entries, %lu of %u bytes\n",
+             g_FontCacheNumEntries, (ULONG)g_FontCacheSize, MAX_FONT_CACHE_SIZE);
+    DbgPrint("Hits: %lu, misses: %lu, evictions: %lu\n",
+             g_FontCacheHits, g_FontCacheMisses, g_FontCacheEvictions);
+}
+
 
 static unsigned int get_native_glyph_outline(FT_Outline *outline, unsigned int buflen, char *buf)
 {
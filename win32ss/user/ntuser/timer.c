@@ -14,7 +14,29 @@ DBG_DEFAULT_CHANNEL(UserTimer);
 /* GLOBALS *******************************************************************/
 
 static LIST_ENTRY TimersListHead;
-static LONG TimeLast = 0;
+static LIST_ENTRY TimersReadyListHead;
+
+/* Timers are hashed by window, or by id for window-less timers */
+#define TIMER_HASH_SIZE          256
+
+static LIST_ENTRY TimerHashTable[TIMER_HASH_SIZE];
+
+/*
+ * Hierarchical timer wheel, in milliseconds of interrupt time. A slot of level
+ * n covers 64^n ms, so the wheel spans more than USER_TIMER_MAXIMUM. A timer is
+ * filed at the lowest level whose slot for its due time is still ahead, and
+ * gets filed again at a lower level when that slot comes up too early.
+ */
+#define TIMER_WHEEL_LEVELS       6
+#define TIMER_WHEEL_SHIFT        6
+#define TIMER_WHEEL_SLOTS        (1 << TIMER_WHEEL_SHIFT)
+#define TIMER_WHEEL_MASK         (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_NO_DEADLINE        (~0ULL)
+
+static LIST_ENTRY TimerWheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static ULONGLONG  TimerWheelBitmap[TIMER_WHEEL_LEVELS];
+static ULONGLONG  TimerWheelTime;    // Time up to which the wheel was run
+static ULONGLONG  TimerNextDeadline; // Time the master timer is set to
 
 /* Windows 2000 has room for 32768 window-less timers */
 #define NUM_WINDOW_LESS_TIMERS   32768
@@ -46,10 +68,162 @@ ERESOURCE TimerLock;
 
 
 /* FUNCTIONS *****************************************************************/
+static
+ULONGLONG
+FASTCALL
+TimerGetTime(VOID)
+{
+  return KeQueryInterruptTime() / 10000;
+}
+
+static
+PLIST_ENTRY
+FASTCALL
+TimerHashBucket(PWND Window, UINT_PTR nID)
+{
+  ULONG_PTR Key;
+
+  Key = Window ? ((ULONG_PTR)Window >> 3) : nID;
+  Key ^= (Key >> 8) ^ (Key >> 16);
+  return &TimerHashTable[Key & (TIMER_HASH_SIZE - 1)];
+}
+
+static
+VOID
+FASTCALL
+WheelInsertTimer(PTIMER pTmr)
+{
+  ULONGLONG DueTime;
+  ULONG Level, Slot, Shift = 0;
+  PLIST_ENTRY ListHead;
+
+  /* Slots up to TimerWheelTime were run already */
+  DueTime = max(pTmr->DueTime, TimerWheelTime + 1);
+
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS - 1; Level++)
+  {
+     Shift = Level * TIMER_WHEEL_SHIFT;
+     if ((DueTime >> Shift) - (TimerWheelTime >> Shift) < TIMER_WHEEL_SLOTS)
+        break;
+  }
+  Shift = Level * TIMER_WHEEL_SHIFT;
+  Slot = (ULONG)(DueTime >> Shift) & TIMER_WHEEL_MASK;
+
+  ListHead = &TimerWheel[Level][Slot];
+  InsertTailList(ListHead, &pTmr->ptmrWheel);
+  TimerWheelBitmap[Level] |= 1ULL << Slot;
+  pTmr->WheelLevel = (UCHAR)Level;
+  pTmr->WheelSlot = (UCHAR)Slot;
+}
+
+static
+VOID
+FASTCALL
+WheelRemoveTimer(PTIMER pTmr)
+{
+  ULONG Level = pTmr->WheelLevel, Slot = pTmr->WheelSlot;
+
+  if (IsListEmpty(&pTmr->ptmrWheel))
+     return;
+
+  /* The timer may sit on the list of expiring timers instead of its slot */
+  RemoveEntryList(&pTmr->ptmrWheel);
+  InitializeListHead(&pTmr->ptmrWheel);
+  if (IsListEmpty(&TimerWheel[Level][Slot]))
+     TimerWheelBitmap[Level] &= ~(1ULL << Slot);
+}
+
+static
+VOID
+FASTCALL
+WheelCollectExpired(ULONGLONG Time, PLIST_ENTRY Expired)
+{
+  ULONGLONG First, Last;
+  ULONG Level, Shift, Count, Slot;
+  PLIST_ENTRY ListHead;
+
+  /* Move every slot that came up since the last run to the expired list */
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++)
+  {
+     if (!TimerWheelBitmap[Level])
+        continue;
+
+     Shift = Level * TIMER_WHEEL_SHIFT;
+     First = (TimerWheelTime >> Shift) + 1;
+     Last = Time >> Shift;
+     if (Last < First)
+        continue;
+
+     Count = (ULONG)min(Last - First + 1, TIMER_WHEEL_SLOTS);
+     for (; Count; Count--, First++)
+     {
+        Slot = (ULONG)First & TIMER_WHEEL_MASK;
+        if (!(TimerWheelBitmap[Level] & (1ULL << Slot)))
+           continue;
+
+        ListHead = &TimerWheel[Level][Slot];
+        AppendTailList(Expired, ListHead);
+        RemoveEntryList(ListHead);
+        InitializeListHead(ListHead);
+        TimerWheelBitmap[Level] &= ~(1ULL << Slot);
+     }
+  }
+
+  TimerWheelTime = Time;
+}
+
+static
+ULONGLONG
+FASTCALL
+WheelNextDeadline(VOID)
+{
+  ULONGLONG Bitmap, Current, Deadline, NextDeadline = TIMER_NO_DEADLINE;
+  ULONG Level, Shift, Start;
+
+  /* Find the first filled slot after the current one on each level */
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++)
+  {
+     Bitmap = TimerWheelBitmap[Level];
+     if (!Bitmap)
+        continue;
+
+     Shift = Level * TIMER_WHEEL_SHIFT;
+     Current = TimerWheelTime >> Shift;
+     Start = (ULONG)(Current + 1) & TIMER_WHEEL_MASK;
+     if (Start)
+        Bitmap = (Bitmap >> Start) | (Bitmap << (TIMER_WHEEL_SLOTS - Start));
+
+     Deadline = (Current + 1 + RtlFindLeastSignificantBit(Bitmap)) << Shift;
+     NextDeadline = min(NextDeadline, Deadline);
+  }
+
+  return NextDeadline;
+}
+
+static
+VOID
+FASTCALL
+SetMasterTimer(ULONGLONG Time)
+{
+  LARGE_INTEGER DueTime;
+  ULONGLONG Deadline;
+
+  /* Sleep until the next timer is due */
+  Deadline = WheelNextDeadline();
+  if (Deadline == TIMER_NO_DEADLINE)
+     Deadline = Time + USER_TIMER_MAXIMUM;
+
+  TimerNextDeadline = max(Deadline, Time + 1);
+  DueTime.QuadPart = -(LONGLONG)(TimerNextDeadline - Time) * 10000;
+
+  ASSERT(MasterTimer != NULL);
+  KeSetTimer(MasterTimer, DueTime, NULL);
+}
+
 static
 PTIMER
 FASTCALL
-CreateTimer(VOID)
+CreateTimer(PWND Window, UINT_PTR nID)
 {
   HANDLE Handle;
   PTIMER Ret = NULL;
@@ -59,6 +233,9 @@ CreateTimer(VOID)
   {
      Ret->head.h = Handle;
      InsertTailList(&TimersListHead, &Ret->ptmrList);
+     InsertTailList(TimerHashBucket(Window, nID), &Ret->ptmrHash);
+     InitializeListHead(&Ret->ptmrWheel);
+     InitializeListHead(&Ret->ptmrReady);
   }
 
   return Ret;
@@ -74,6 +251,9 @@ RemoveTimer(PTIMER pTmr)
   {
      /* Set the flag, it will be removed when ready */
      RemoveEntryList(&pTmr->ptmrList);
+     RemoveEntryList(&pTmr->ptmrHash);
+     RemoveEntryList(&pTmr->ptmrReady);
+     WheelRemoveTimer(pTmr);
      if ((pTmr->pWnd == NULL) && (!(pTmr->flags & TMRF_SYSTEM))) // System timers are reusable.
      {
         UINT_PTR IDEvent;
@@ -97,14 +277,15 @@ FindTimer(PWND Window,
           UINT_PTR nID,
           UINT flags)
 {
-  PLIST_ENTRY pLE;
+  PLIST_ENTRY ListHead, pLE;
   PTIMER pTmr, RetTmr = NULL;
 
   TimerEnterExclusive();
-  pLE = TimersListHead.Flink;
-  while (pLE != &TimersListHead)
+  ListHead = TimerHashBucket(Window, nID);
+  pLE = ListHead->Flink;
+  while (pLE != ListHead)
   {
-    pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
+    pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrHash);
 
     if ( pTmr->nID == nID &&
          pTmr->pWnd == Window &&
@@ -182,8 +363,7 @@ IntSetTimer( PWND Window,
 {
   PTIMER pTmr;
   UINT Ret = IDEvent;
-  LARGE_INTEGER DueTime;
-  DueTime.QuadPart = (LONGLONG)(-97656); // 1024hz .9765625 ms set to 10.0 ms
+  ULONGLONG Time;
 
 #if 0
   /* Windows NT/2k/XP behaviour */
@@ -213,6 +393,7 @@ IntSetTimer( PWND Window,
   if ((Window) && (IDEvent == 0))
      Ret = 1;
 
+  TimerEnterExclusive();
   pTmr = FindTimer(Window, IDEvent, Type);
 
   if ((!pTmr) && (Window == NULL) && (!(Type & TMRF_SYSTEM)))
@@ -224,6 +405,7 @@ IntSetTimer( PWND Window,
       if (IDEvent == (UINT_PTR) -1)
       {
          IntUnlockWindowlessTimerBitmap();
+         TimerLeave();
          ERR("Unable to find a free window-less timer id\n");
          EngSetLastError(ERROR_NO_SYSTEM_RESOURCES);
          ASSERT(FALSE);
@@ -238,8 +420,12 @@ IntSetTimer( PWND Window,
 
   if (!pTmr)
   {
-     pTmr = CreateTimer();
-     if (!pTmr) return 0;
+     pTmr = CreateTimer(Window, IDEvent);
+     if (!pTmr)
+     {
+        TimerLeave();
+        return 0;
+     }
 
      if (Window && (Type & TMRF_TIFROMWND))
         pTmr->pti = Window->head.pti->pEThread->Tcb.Win32Thread;
@@ -252,22 +438,29 @@ IntSetTimer( PWND Window,
      }
 
      pTmr->pWnd    = Window;
-     pTmr->cmsCountdown = Elapse;
      pTmr->cmsRate = Elapse;
      pTmr->pfn     = TimerFunc;
      pTmr->nID     = IDEvent;
-     pTmr->flags   = Type|TMRF_INIT;
+     pTmr->flags   = Type;
   }
   else
   {
-     pTmr->cmsCountdown = Elapse;
      pTmr->cmsRate = Elapse;
   }
 
-  ASSERT(MasterTimer != NULL);
-  // Start the timer thread!
-  if (TimersListHead.Flink == TimersListHead.Blink) // There is only one timer
-     KeSetTimer(MasterTimer, DueTime, NULL);
+  Time = TimerGetTime();
+  pTmr->DueTime = Time + Elapse;
+  if (!(pTmr->flags & TMRF_WAITING))
+  {
+     WheelRemoveTimer(pTmr);
+     WheelInsertTimer(pTmr);
+  }
+
+  // Wake the timer thread earlier if needed!
+  if (pTmr->DueTime < TimerNextDeadline)
+     SetMasterTimer(Time);
+
+  TimerLeave();
 
   return Ret;
 }
@@ -403,12 +596,12 @@ PostTimerMessages(PWND Window)
   pti = PsGetCurrentThreadWin32Thread();
 
   TimerEnterExclusive();
-  pLE = TimersListHead.Flink;
-  while(pLE != &TimersListHead)
+  pLE = TimersReadyListHead.Flink;
+  while(pLE != &TimersReadyListHead)
   {
-     pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
-     if ( (pTmr->flags & TMRF_READY) &&
-          (pTmr->pti == pti) &&
+     pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrReady);
+     ASSERT(pTmr->flags & TMRF_READY);
+     if ( (pTmr->pti == pti) &&
           ((pTmr->pWnd == Window) || (Window == NULL)) )
         {
            Msg.hwnd    = (pTmr->pWnd) ? pTmr->pWnd->head.h : 0;
@@ -421,15 +614,10 @@ PostTimerMessages(PWND Window)
 
            MsqPostMessage(pti, &Msg, FALSE, (QS_POSTMESSAGE|QS_ALLPOSTMESSAGE), 0, 0);
            pTmr->flags &= ~TMRF_READY;
+           RemoveEntryList(&pTmr->ptmrReady);
+           InitializeListHead(&pTmr->ptmrReady);
            ClearMsgBitsMask(pti, QS_TIMER);
            Hit = TRUE;
-           // Now move this entry to the end of the list so it will not be
-           // called again in the next msg loop.
-           if (pLE != &TimersListHead)
-           {
-              RemoveEntryList(&pTmr->ptmrList);
-              InsertTailList(&TimersListHead, &pTmr->ptmrList);
-           }
            break;
         }
 
@@ -445,74 +633,70 @@ VOID
 FASTCALL
 ProcessTimers(VOID)
 {
-  LARGE_INTEGER DueTime;
-  LONG Time;
+  LIST_ENTRY Expired;
+  ULONGLONG Time;
   PLIST_ENTRY pLE;
   PTIMER pTmr;
+  BOOL Fire;
   LONG TimerCount = 0;
 
   TimerEnterExclusive();
-  pLE = TimersListHead.Flink;
-  Time = EngGetTickCount32();
+  Time = TimerGetTime();
 
-  DueTime.QuadPart = (LONGLONG)(-97656); // 1024hz .9765625 ms set to 10.0 ms
+  // Only look at the timers in the slots that came up.
+  InitializeListHead(&Expired);
+  WheelCollectExpired(Time, &Expired);
 
-  while(pLE != &TimersListHead)
+  while (!IsListEmpty(&Expired))
   {
-    pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
+    pLE = RemoveHeadList(&Expired);
+    InitializeListHead(pLE);
+    pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrWheel);
     TimerCount++;
-    if (pTmr->flags & TMRF_WAITING)
+
+    // The slot came up before the timer is due, file it again.
+    if (pTmr->DueTime > Time)
     {
-       pLE = pTmr->ptmrList.Flink;
-       pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
+       WheelInsertTimer(pTmr);
        continue;
     }
 
-    if (pTmr->flags & TMRF_INIT)
+    ASSERT(pTmr->pti);
+    Fire = (!(pTmr->flags & TMRF_READY)) && (!(pTmr->pti->TIF_flags & TIF_INCLEANUP));
+    if (Fire && (pTmr->flags & TMRF_ONESHOT))
+       pTmr->flags |= TMRF_WAITING;
+
+    // Queue the next run before the callback, which may kill the timer.
+    if (!(pTmr->flags & TMRF_WAITING))
+    {
+       pTmr->DueTime = Time + pTmr->cmsRate;
+       WheelInsertTimer(pTmr);
+    }
+
+    if (!Fire)
+       continue;
+
+    if (pTmr->flags & TMRF_RIT)
     {
-       pTmr->flags &= ~TMRF_INIT; // Skip this run.
+       // Hard coded call here, inside raw input thread.
+       pTmr->pfn(NULL, WM_SYSTIMER, pTmr->nID, (LPARAM)pTmr);
     }
     else
     {
-       if (pTmr->cmsCountdown < 0)
-       {
-          ASSERT(pTmr->pti);
-          if ((!(pTmr->flags & TMRF_READY)) && (!(pTmr->pti->TIF_flags & TIF_INCLEANUP)))
-          {
-             if (pTmr->flags & TMRF_ONESHOT)
-                pTmr->flags |= TMRF_WAITING;
-
-             if (pTmr->flags & TMRF_RIT)
-             {
-                // Hard coded call here, inside raw input thread.
-                pTmr->pfn(NULL, WM_SYSTIMER, pTmr->nID, (LPARAM)pTmr);
-             }
-             else
-             {
-                pTmr->flags |= TMRF_READY; // Set timer ready to be ran.
-                // Set thread message queue for this timer.
-                if (pTmr->pti)
-                {  // Wakeup thread
-                   pTmr->pti->cTimersReady++;
-                   ASSERT(pTmr->pti->pEventQueueServer != NULL);
-                   MsqWakeQueue(pTmr->pti, QS_TIMER, TRUE);
-                }
-             }
-          }
-          pTmr->cmsCountdown = pTmr->cmsRate;
+       pTmr->flags |= TMRF_READY; // Set timer ready to be ran.
+       InsertTailList(&TimersReadyListHead, &pTmr->ptmrReady);
+       // Set thread message queue for this timer.
+       if (pTmr->pti)
+       {  // Wakeup thread
+          pTmr->pti->cTimersReady++;
+          ASSERT(pTmr->pti->pEventQueueServer != NULL);
+          MsqWakeQueue(pTmr->pti, QS_TIMER, TRUE);
        }
-       else
-          pTmr->cmsCountdown -= Time - TimeLast;
     }
-
-    pLE = pLE->Flink;
   }
 
   // Restart the timer thread!
-  ASSERT(MasterTimer != NULL);
-  KeSetTimer(MasterTimer, DueTime, NULL);
-
-  TimeLast = Time;
+  SetMasterTimer(Time);
 
   TimerLeave();
   TRACE("TimerCount = %d\n", TimerCount);
@@ -521,7 +705,7 @@ ProcessTimers(VOID)
 BOOL FASTCALL
 DestroyTimersForWindow(PTHREADINFO pti, PWND Window)
 {
-   PLIST_ENTRY pLE;
+   PLIST_ENTRY ListHead, pLE;
    PTIMER pTmr;
    BOOL TimersRemoved = FALSE;
 
@@ -529,10 +713,12 @@ DestroyTimersForWindow(PTHREADINFO pti, PWND Window)
       return FALSE;
 
    TimerEnterExclusive();
-   pLE = TimersListHead.Flink;
-   while(pLE != &TimersListHead)
+   /* All the timers of a window are in the same bucket */
+   ListHead = TimerHashBucket(Window, 0);
+   pLE = ListHead->Flink;
+   while(pLE != ListHead)
    {
-      pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
+      pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrHash);
       pLE = pLE->Flink; /* get next timer list entry before current timer is removed */
       if ((pTmr) && (pTmr->pti == pti) && (pTmr->pWnd == Window))
       {
@@ -548,12 +734,13 @@ DestroyTimersForWindow(PTHREADINFO pti, PWND Window)
 BOOL FASTCALL
 DestroyTimersForThread(PTHREADINFO pti)
 {
-   PLIST_ENTRY pLE = TimersListHead.Flink;
+   PLIST_ENTRY pLE;
    PTIMER pTmr;
    BOOL TimersRemoved = FALSE;
 
    TimerEnterExclusive();
 
+   pLE = TimersListHead.Flink;
    while(pLE != &TimersListHead)
    {
       pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
@@ -593,7 +780,7 @@ NTSTATUS
 NTAPI
 InitTimerImpl(VOID)
 {
-   ULONG BitmapBytes;
+   ULONG BitmapBytes, i, j;
 
    /* Allocate FAST_MUTEX from non paged pool */
    Mutex = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
@@ -620,6 +807,18 @@ InitTimerImpl(VOID)
 
    ExInitializeResourceLite(&TimerLock);
    InitializeListHead(&TimersListHead);
+   InitializeListHead(&TimersReadyListHead);
+
+   for (i = 0; i < TIMER_HASH_SIZE; i++)
+      InitializeListHead(&TimerHashTable[i]);
+
+   for (i = 0; i < TIMER_WHEEL_LEVELS; i++)
+   {
+      for (j = 0; j < TIMER_WHEEL_SLOTS; j++)
+         InitializeListHead(&TimerWheel[i][j]);
+   }
+   TimerWheelTime = TimerGetTime();
+   TimerNextDeadline = TIMER_NO_DEADLINE;
 
    return STATUS_SUCCESS;
 }
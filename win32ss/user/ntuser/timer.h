@@ -4,10 +4,15 @@ typedef struct _TIMER
 {
   HEAD           head;
   LIST_ENTRY     ptmrList;
+  LIST_ENTRY     ptmrHash;     // (window, id) hash bucket
+  LIST_ENTRY     ptmrWheel;    // Timer wheel slot
+  LIST_ENTRY     ptmrReady;    // Ready timers, while TMRF_READY is set
+  ULONGLONG      DueTime;      // Interrupt time in ms
+  UCHAR          WheelLevel;
+  UCHAR          WheelSlot;
   PTHREADINFO    pti;
   PWND           pWnd;         // hWnd
   UINT_PTR       nID;          // Specifies a nonzero timer identifier.
-  INT            cmsCountdown; // uElapse
   INT            cmsRate;      // uElapse
   FLONG          flags;
   TIMERPROC      pfn;          // lpTimerFunc
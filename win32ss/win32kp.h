@@ -31,6 +31,7 @@ typedef struct _DC *PDC;
 #include "gdi/eng/eng.h"
 #include "gdi/eng/engevent.h"
 #include "gdi/eng/inteng.h"
+#include "gdi/eng/simd.h"
 #include "gdi/eng/xlateobj.h"
 #include "gdi/eng/floatobj.h"
 #include "gdi/eng/mouse.h"